@@ -23,6 +23,7 @@
 #include <isc/stdio.h>
 #include <isc/string.h>
 #include <isc/task.h>
+#include <isc/taskpool.h>
 #include <isc/timer.h>
 #include <isc/util.h>
 
@@ -42,7 +43,9 @@
 #include <dns/rdatalist.h>
 #include <dns/rdataset.h>
 #include <dns/resolver.h>
+#include <dns/respcache.h>
 #include <dns/stats.h>
+#include <dns/tcpmsg.h>
 #include <dns/tsig.h>
 #include <dns/view.h>
 #include <dns/zone.h>
@@ -92,8 +95,31 @@
 #define TCP_CLIENT(c)	(((c)->attributes & NS_CLIENTATTR_TCP) != 0)
 
 #define TCP_BUFFER_SIZE			(65535 + 2)
+#define TCP_BUFFER_CLASSES		4
 #define SEND_BUFFER_SIZE		4096
 #define RECV_BUFFER_SIZE		4096
+#define ARENA_BLOCK_SIZE		8192
+/*%<
+ * Size of the scratch blocks handed out by ns_client_arenaget().
+ * One block is enough for the name buffers and database versions of
+ * a typical query.
+ */
+
+/*%
+ * TCP responses are built in buffers drawn from per-manager pools of
+ * these size classes, with the two octet length prefix right in front
+ * of the message so that both go out in a single write.  'freemax' is
+ * the number of free buffers a pool keeps.
+ */
+static const struct {
+	unsigned int size;
+	unsigned int freemax;
+} tcpbufclasses[TCP_BUFFER_CLASSES] = {
+	{ 1024, 256 },
+	{ SEND_BUFFER_SIZE, 64 },
+	{ 16384, 16 },
+	{ TCP_BUFFER_SIZE, 4 }
+};
 
 #ifdef ISC_PLATFORM_USETHREADS
 #define NMCTXS				100
@@ -118,6 +144,54 @@
 
 #define WANTNSID(x) (((x)->attributes & NS_CLIENTATTR_WANTNSID) != 0)
 #define WANTEXPIRE(x) (((x)->attributes & NS_CLIENTATTR_WANTEXPIRE) != 0)
+#define USEKEEPALIVE(x) (((x)->attributes & NS_CLIENTATTR_USEKEEPALIVE) != 0)
+
+/*%
+ * A block of per-request scratch memory.  The data follows the
+ * structure.
+ */
+struct ns_arenablock {
+	ns_arenablock_t *		next;
+	size_t				size;
+};
+
+#define ARENA_ALIGN(n)		(((n) + 7U) & ~((size_t)7U))
+#define ARENA_HDRSIZE		ARENA_ALIGN(sizeof(ns_arenablock_t))
+
+/*%
+ * A TCP connection; see client.h.  The fields below 'lock' are also
+ * changed by the clients answering the connection's requests, and
+ * 'lock' must be held to access them.
+ */
+struct ns_tcpconn {
+	unsigned int			magic;
+	isc_mem_t *			mctx;
+	ns_clientmgr_t *		manager;
+	ns_interface_t *		interface;
+	isc_task_t *			task;
+	isc_timer_t *			timer;
+	isc_socket_t *			sock;
+	isc_quota_t *			tcpquota;
+	dns_tcpmsg_t			tcpmsg;
+	isc_sockaddr_t			peeraddr;
+	isc_boolean_t			pipelined;   /*%< Read ahead */
+	isc_event_t			ctlevent;
+	ISC_LINK(ns_tcpconn_t)		link;
+
+	isc_mutex_t			lock;
+	isc_boolean_t			reading;
+	isc_boolean_t			closing;
+	isc_boolean_t			freeing;
+	isc_boolean_t			keepalive;   /*%< Client sent option */
+	unsigned int			nclients;    /*%< Requests in progress */
+	unsigned int			nreserved;   /*%< Read ahead quota */
+	unsigned int			nrequests;
+};
+
+#define TCPCONN_MAGIC			ISC_MAGIC('N', 'S', 'T', 'c')
+#define VALID_TCPCONN(c)		ISC_MAGIC_VALID(c, TCPCONN_MAGIC)
+
+typedef ISC_LIST(ns_tcpconn_t) tcpconn_list_t;
 
 /*% nameserver client manager structure */
 struct ns_clientmgr {
@@ -135,14 +209,22 @@ struct ns_clientmgr {
 	isc_mutex_t			lock;
 	isc_boolean_t			exiting;
 
-	/* Lock covers the clients list */
+	/* Lock covers the clients and TCP connection lists */
 	isc_mutex_t			listlock;
 	client_list_t			clients;      /*%< All active clients */
+	tcpconn_list_t			tcpconns;     /*%< Open connections */
+
+	/* Tasks that TCP connections are spread over */
+	isc_taskpool_t *		tcptasks;
 
 	/* Lock covers the recursing list */
 	isc_mutex_t			reclock;
 	client_list_t			recursing;    /*%< Recursing clients */
 
+	/* Lock covers the TCP send buffer pools */
+	isc_mutex_t			tcpbuflock;
+	isc_mempool_t *			tcpbufpools[TCP_BUFFER_CLASSES];
+
 #if NMCTXS > 0
 	/*%< mctx pool for clients. */
 	unsigned int			nextmctx;
@@ -185,7 +267,9 @@ struct ns_clientmgr {
  * client manager's list of active clients.
  *
  * If it is a TCP client object, it has a TCP listener socket
- * and an outstanding TCP listen request.
+ * and an outstanding TCP listen request.  Accepted connections
+ * are handed to TCP connection objects, and the client object
+ * stays in this state.
  *
  * If it is a UDP client object, it has a UDP listener socket
  * and an outstanding UDP receive request.
@@ -193,10 +277,10 @@ struct ns_clientmgr {
 
 #define NS_CLIENTSTATE_READING  3
 /*%<
- * The client object is a TCP client object that has received
- * a connection.  It has a tcpsocket, tcpmsg, TCP quota, and an
- * outstanding TCP read request.  This state is not used for
- * UDP client objects.
+ * The client object is a TCP client object that has been handed
+ * a request by a TCP connection object.  It has a tcpsocket and
+ * holds a reference to the connection.  This state is not used
+ * for UDP client objects.
  */
 
 #define NS_CLIENTSTATE_WORKING  4
@@ -228,19 +312,24 @@ struct ns_clientmgr {
 
 unsigned int ns_client_requests;
 
-static void client_read(ns_client_t *client);
 static void client_accept(ns_client_t *client);
 static void client_udprecv(ns_client_t *client);
 static void clientmgr_destroy(ns_clientmgr_t *manager);
 static isc_boolean_t exit_check(ns_client_t *client);
 static void ns_client_endrequest(ns_client_t *client);
+static void arena_reset(ns_client_t *client, isc_boolean_t everything);
 static void client_start(isc_task_t *task, isc_event_t *event);
 static void client_request(isc_task_t *task, isc_event_t *event);
 static void ns_client_dumpmessage(ns_client_t *client, const char *reason);
 static isc_result_t get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
 			       dns_dispatch_t *disp, isc_boolean_t tcp);
-static isc_result_t get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp,
-			       isc_socket_t *sock);
+static isc_result_t get_worker(ns_clientmgr_t *manager, ns_tcpconn_t *conn,
+			       isc_buffer_t *buffer);
+static void tcpconn_readdone(isc_task_t *task, isc_event_t *event);
+static void tcpconn_release(ns_client_t *client, isc_boolean_t sever);
+static void tcpconn_close(ns_tcpconn_t *conn);
+static void tcpconn_setkeepalive(ns_tcpconn_t *conn);
+static void client_puttcpbuf(ns_client_t *client);
 static inline isc_boolean_t
 allowed(isc_netaddr_t *addr, dns_name_t *signer, isc_netaddr_t *ecs_addr,
 	isc_uint8_t ecs_addrlen, isc_uint8_t *ecs_scope, dns_acl_t *acl);
@@ -300,6 +389,7 @@ ns_client_settimeout(ns_client_t *client, unsigned int seconds) {
 static isc_boolean_t
 exit_check(ns_client_t *client) {
 	isc_boolean_t destroy_manager = ISC_FALSE;
+	isc_boolean_t sever = ISC_TRUE;
 	ns_clientmgr_t *manager = NULL;
 
 	REQUIRE(NS_CLIENT_VALID(client));
@@ -380,43 +470,30 @@ exit_check(ns_client_t *client) {
 		INSIST(client->recursionquota == NULL);
 
 		if (NS_CLIENTSTATE_READING == client->newstate) {
-			if (!client->pipelined) {
-				client_read(client);
-				client->newstate = NS_CLIENTSTATE_MAX;
-				return (ISC_TRUE); /* We're done. */
-			} else if (client->mortal) {
-				client->newstate = NS_CLIENTSTATE_INACTIVE;
-			} else
-				return (ISC_FALSE);
+			/*
+			 * The request was answered.  The connection
+			 * reads the next one without us.
+			 */
+			client->newstate = NS_CLIENTSTATE_INACTIVE;
+			sever = ISC_FALSE;
 		}
 	}
 
 	if (client->state == NS_CLIENTSTATE_READING) {
 		/*
-		 * We are trying to abort the current TCP connection,
-		 * if any.
+		 * We are done with the current TCP request, if any.
+		 * Unless it was answered, the connection is closed.
 		 */
 		INSIST(client->recursionquota == NULL);
 		INSIST(client->newstate <= NS_CLIENTSTATE_READY);
-		if (client->nreads > 0)
-			dns_tcpmsg_cancelread(&client->tcpmsg);
-		if (client->nreads != 0) {
-			/* Still waiting for read cancel completion. */
-			return (ISC_TRUE);
-		}
 
-		if (client->tcpmsg_valid) {
-			dns_tcpmsg_invalidate(&client->tcpmsg);
-			client->tcpmsg_valid = ISC_FALSE;
-		}
+		if (client->tcpconn != NULL)
+			tcpconn_release(client, sever);
 		if (client->tcpsocket != NULL) {
 			CTRACE("closetcp");
 			isc_socket_detach(&client->tcpsocket);
 		}
 
-		if (client->tcpquota != NULL)
-			isc_quota_detach(&client->tcpquota);
-
 		if (client->timerset) {
 			(void)isc_timer_reset(client->timer,
 					      isc_timertype_inactive,
@@ -424,8 +501,6 @@ exit_check(ns_client_t *client) {
 			client->timerset = ISC_FALSE;
 		}
 
-		client->pipelined = ISC_FALSE;
-
 		client->peeraddr_valid = ISC_FALSE;
 
 		client->state = NS_CLIENTSTATE_READY;
@@ -437,17 +512,9 @@ exit_check(ns_client_t *client) {
 		 * that already.  Check whether this client needs to remain
 		 * active and force it to go inactive if not.
 		 *
-		 * UDP clients go inactive at this point, but TCP clients
-		 * may remain active if we have fewer active TCP client
-		 * objects than desired due to an earlier quota exhaustion.
+		 * Clients that answered a request read by a TCP
+		 * connection object are always mortal.
 		 */
-		if (client->mortal && TCP_CLIENT(client) && !ns_g_clienttest) {
-			LOCK(&client->interface->lock);
-			if (client->interface->ntcpcurrent <
-				    client->interface->ntcptarget)
-				client->mortal = ISC_FALSE;
-			UNLOCK(&client->interface->lock);
-		}
 
 		/*
 		 * We don't need the client; send it to the inactive
@@ -555,13 +622,15 @@ exit_check(ns_client_t *client) {
 			ISC_LIST_UNLINK(manager->clients, client, link);
 			LOCK(&manager->lock);
 			if (manager->exiting &&
-			    ISC_LIST_EMPTY(manager->clients))
+			    ISC_LIST_EMPTY(manager->clients) &&
+			    ISC_LIST_EMPTY(manager->tcpconns))
 				destroy_manager = ISC_TRUE;
 			UNLOCK(&manager->lock);
 			UNLOCK(&manager->listlock);
 		}
 
 		ns_query_free(client);
+		arena_reset(client, ISC_TRUE);
 		isc_mem_put(client->mctx, client->recvbuf, RECV_BUFFER_SIZE);
 		isc_event_free((isc_event_t **)&client->sendevent);
 		isc_event_free((isc_event_t **)&client->recvevent);
@@ -570,8 +639,7 @@ exit_check(ns_client_t *client) {
 			isc_timer_detach(&client->delaytimer);
 
 		if (client->tcpbuf != NULL)
-			isc_mem_put(client->mctx, client->tcpbuf,
-				    TCP_BUFFER_SIZE);
+			client_puttcpbuf(client);
 		if (client->opt != NULL) {
 			INSIST(dns_rdataset_isassociated(client->opt));
 			dns_rdataset_disassociate(client->opt);
@@ -635,8 +703,8 @@ client_start(isc_task_t *task, isc_event_t *event) {
 		return;
 
 	if (TCP_CLIENT(client)) {
-		if (client->pipelined) {
-			client_read(client);
+		if (client->tcpconn != NULL) {
+			client_request(task, event);
 		} else {
 			client_accept(client);
 		}
@@ -679,10 +747,61 @@ client_shutdown(isc_task_t *task, isc_event_t *event) {
 	(void)exit_check(client);
 }
 
+/*%
+ * Release the client's scratch memory.  Unless 'everything' is set, one
+ * standard sized block is kept for the next request.
+ */
+static void
+arena_reset(ns_client_t *client, isc_boolean_t everything) {
+	ns_arenablock_t *block, *next;
+
+	next = client->arena;
+	client->arena = NULL;
+	client->arenaused = 0;
+	for (block = next; block != NULL; block = next) {
+		next = block->next;
+		if (!everything && client->arena == NULL &&
+		    block->size == ARENA_BLOCK_SIZE)
+		{
+			block->next = NULL;
+			client->arena = block;
+			continue;
+		}
+		isc_mem_put(client->mctx, block, ARENA_HDRSIZE + block->size);
+	}
+}
+
+void *
+ns_client_arenaget(ns_client_t *client, size_t size) {
+	ns_arenablock_t *block;
+	size_t blocksize;
+	void *p;
+
+	REQUIRE(NS_CLIENT_VALID(client));
+
+	size = ARENA_ALIGN(size);
+	block = client->arena;
+	if (block == NULL || client->arenaused + size > block->size) {
+		blocksize = ARENA_BLOCK_SIZE;
+		if (size > blocksize)
+			blocksize = size;
+		block = isc_mem_get(client->mctx, ARENA_HDRSIZE + blocksize);
+		if (block == NULL)
+			return (NULL);
+		block->size = blocksize;
+		block->next = client->arena;
+		client->arena = block;
+		client->arenaused = 0;
+	}
+
+	p = (unsigned char *)block + ARENA_HDRSIZE + client->arenaused;
+	client->arenaused += size;
+	return (p);
+}
+
 static void
 ns_client_endrequest(ns_client_t *client) {
 	INSIST(client->naccepts == 0);
-	INSIST(client->nreads == 0);
 	INSIST(client->nsends == 0);
 	INSIST(client->nrecvs == 0);
 	INSIST(client->nupdates == 0);
@@ -716,6 +835,7 @@ ns_client_endrequest(ns_client_t *client) {
 	client->extflags = 0;
 	client->ednsversion = -1;
 	dns_message_reset(client->message, DNS_MESSAGE_INTENTPARSE);
+	arena_reset(client, ISC_FALSE);
 
 	if (client->recursionquota != NULL) {
 		isc_quota_detach(&client->recursionquota);
@@ -797,19 +917,118 @@ client_senddone(isc_task_t *task, isc_event_t *event) {
 
 	if (client->tcpbuf != NULL) {
 		INSIST(TCP_CLIENT(client));
-		isc_mem_put(client->mctx, client->tcpbuf, TCP_BUFFER_SIZE);
-		client->tcpbuf = NULL;
+		client_puttcpbuf(client);
 	}
 
 	ns_client_next(client, ISC_R_SUCCESS);
 }
 
+/*%
+ * Take a TCP send buffer of at least 'size' octets from the manager's
+ * pools.
+ */
+static unsigned char *
+client_gettcpbuf(ns_client_t *client, unsigned int size) {
+	ns_clientmgr_t *manager = client->manager;
+	unsigned int i;
+
+	REQUIRE(client->tcpbuf == NULL);
+	REQUIRE(size <= TCP_BUFFER_SIZE);
+
+	for (i = 0; size > tcpbufclasses[i].size; i++)
+		;
+	client->tcpbuf = isc_mempool_get(manager->tcpbufpools[i]);
+	if (client->tcpbuf != NULL)
+		client->tcpbufsize = tcpbufclasses[i].size;
+	return (client->tcpbuf);
+}
+
+static void
+tcpbuf_put(ns_clientmgr_t *manager, unsigned char *buf, unsigned int size) {
+	unsigned int i;
+
+	for (i = 0; size != tcpbufclasses[i].size; i++)
+		INSIST(i < TCP_BUFFER_CLASSES - 1);
+	isc_mempool_put(manager->tcpbufpools[i], buf);
+}
+
+static void
+client_puttcpbuf(ns_client_t *client) {
+	REQUIRE(client->tcpbuf != NULL);
+
+	tcpbuf_put(client->manager, client->tcpbuf, client->tcpbufsize);
+	client->tcpbuf = NULL;
+	client->tcpbufsize = 0;
+}
+
+/*%
+ * A TCP response did not fit in the buffer it was being rendered
+ * into.  If that was not already the largest size class, replace it
+ * with one that is, reset the rendering state of the message and
+ * return ISC_TRUE so that the caller renders it again.
+ */
+static isc_boolean_t
+client_growsendbuf(ns_client_t *client, dns_compress_t *cctx,
+		   isc_buffer_t *buffer, isc_buffer_t *tcpbuffer)
+{
+	unsigned char *old = client->tcpbuf;
+	unsigned int oldsize = client->tcpbufsize;
+
+	if (!TCP_CLIENT(client) || oldsize == TCP_BUFFER_SIZE)
+		return (ISC_FALSE);
+
+	client->tcpbuf = NULL;
+	if (client_gettcpbuf(client, TCP_BUFFER_SIZE) == NULL) {
+		client->tcpbuf = old;
+		client->tcpbufsize = oldsize;
+		return (ISC_FALSE);
+	}
+	tcpbuf_put(client->manager, old, oldsize);
+
+	dns_message_renderreset(client->message);
+	dns_compress_rollback(cctx, 0);
+	isc_buffer_init(tcpbuffer, client->tcpbuf, TCP_BUFFER_SIZE);
+	isc_buffer_init(buffer, client->tcpbuf + 2, TCP_BUFFER_SIZE - 2);
+	return (ISC_TRUE);
+}
+
+/*%
+ * Move a TCP response rendered into a buffer of the largest size
+ * class to one of the smallest class that holds it, so that a
+ * response waiting on a slow reader doesn't pin the full buffer.
+ */
+static void
+client_shrinksendbuf(ns_client_t *client, isc_buffer_t *buffer,
+		     isc_buffer_t *tcpbuffer)
+{
+	unsigned char *old = client->tcpbuf;
+	unsigned int length = isc_buffer_usedlength(buffer);
+
+	if (client->tcpbufsize != TCP_BUFFER_SIZE ||
+	    length + 2 > tcpbufclasses[TCP_BUFFER_CLASSES - 2].size)
+		return;
+
+	client->tcpbuf = NULL;
+	if (client_gettcpbuf(client, length + 2) == NULL) {
+		client->tcpbuf = old;
+		client->tcpbufsize = TCP_BUFFER_SIZE;
+		return;
+	}
+	memmove(client->tcpbuf + 2, old + 2, length);
+	tcpbuf_put(client->manager, old, TCP_BUFFER_SIZE);
+
+	isc_buffer_init(tcpbuffer, client->tcpbuf, client->tcpbufsize);
+	isc_buffer_init(buffer, client->tcpbuf + 2, client->tcpbufsize - 2);
+	isc_buffer_add(buffer, length);
+}
+
 /*%
  * We only want to fail with ISC_R_NOSPACE when called from
  * ns_client_sendraw() and not when called from ns_client_send(),
  * tcpbuffer is NULL when called from ns_client_sendraw() and
  * length != 0.  tcpbuffer != NULL when called from ns_client_send()
- * and length == 0.
+ * and length == 0.  In the latter case a TCP buffer of the size most
+ * responses fit in is used; otherwise it is sized for 'length'.
  */
 
 static isc_result_t
@@ -831,17 +1050,18 @@ client_allocsendbuf(ns_client_t *client, isc_buffer_t *buffer,
 			result = ISC_R_NOSPACE;
 			goto done;
 		}
-		client->tcpbuf = isc_mem_get(client->mctx, TCP_BUFFER_SIZE);
-		if (client->tcpbuf == NULL) {
+		bufsize = (length == 0) ? SEND_BUFFER_SIZE : length + 2;
+		data = client_gettcpbuf(client, bufsize);
+		if (data == NULL) {
 			result = ISC_R_NOMEMORY;
 			goto done;
 		}
-		data = client->tcpbuf;
+		bufsize = client->tcpbufsize;
 		if (tcpbuffer != NULL) {
-			isc_buffer_init(tcpbuffer, data, TCP_BUFFER_SIZE);
-			isc_buffer_init(buffer, data + 2, TCP_BUFFER_SIZE - 2);
+			isc_buffer_init(tcpbuffer, data, bufsize);
+			isc_buffer_init(buffer, data + 2, bufsize - 2);
 		} else {
-			isc_buffer_init(buffer, data, TCP_BUFFER_SIZE);
+			isc_buffer_init(buffer, data, bufsize);
 			INSIST(length <= 0xffff);
 			isc_buffer_putuint16(buffer, (isc_uint16_t)length);
 		}
@@ -986,13 +1206,119 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *message) {
 		return;
 
  done:
-	if (client->tcpbuf != NULL) {
-		isc_mem_put(client->mctx, client->tcpbuf, TCP_BUFFER_SIZE);
-		client->tcpbuf = NULL;
-	}
+	if (client->tcpbuf != NULL)
+		client_puttcpbuf(client);
 	ns_client_next(client, result);
 }
 
+void
+ns_client_sendwire(ns_client_t *client, isc_region_t *wire) {
+	isc_result_t result;
+	unsigned char *data;
+	isc_buffer_t buffer;
+	isc_region_t r;
+	unsigned char sendbuf[SEND_BUFFER_SIZE];
+	isc_stats_t *outstats;
+	isc_uint16_t flags;
+	isc_boolean_t opt_included;
+
+	REQUIRE(NS_CLIENT_VALID(client));
+	REQUIRE(wire->length >= DNS_MESSAGE_HEADERLEN);
+
+	CTRACE("sendwire");
+
+	result = client_allocsendbuf(client, &buffer, NULL, wire->length,
+				     sendbuf, &data);
+	if (result != ISC_R_SUCCESS)
+		goto done;
+
+	/*
+	 * Copy the response and fix up its id.
+	 */
+	isc_buffer_availableregion(&buffer, &r);
+	result = isc_buffer_copyregion(&buffer, wire);
+	if (result != ISC_R_SUCCESS)
+		goto done;
+	r.base[0] = (client->message->id >> 8) & 0xff;
+	r.base[1] = client->message->id & 0xff;
+
+	/*
+	 * Gather what the statistics need before the send can complete.
+	 */
+	if (TCP_CLIENT(client))
+		outstats = (isc_sockaddr_pf(&client->peeraddr) == AF_INET)
+				? ns_g_server->tcpoutstats4
+				: ns_g_server->tcpoutstats6;
+	else
+		outstats = (isc_sockaddr_pf(&client->peeraddr) == AF_INET)
+				? ns_g_server->udpoutstats4
+				: ns_g_server->udpoutstats6;
+	flags = (wire->base[2] << 8) | wire->base[3];
+	opt_included = ISC_TF((client->attributes &
+			       NS_CLIENTATTR_WANTOPT) != 0);
+
+	result = client_sendpkg(client, &buffer);
+	if (result != ISC_R_SUCCESS)
+		goto done;
+
+	isc_stats_increment(outstats, ISC_MIN((int)wire->length / 16, 256));
+	isc_stats_increment(ns_g_server->nsstats, dns_nsstatscounter_response);
+	dns_rcodestats_increment(ns_g_server->rcodestats,
+				 (dns_rcode_t)(flags & 0x000f));
+	if (opt_included)
+		isc_stats_increment(ns_g_server->nsstats,
+				    dns_nsstatscounter_edns0out);
+	if ((flags & DNS_MESSAGEFLAG_TC) != 0)
+		isc_stats_increment(ns_g_server->nsstats,
+				    dns_nsstatscounter_truncatedresp);
+	return;
+
+ done:
+	if (client->tcpbuf != NULL)
+		client_puttcpbuf(client);
+	ns_client_next(client, result);
+}
+
+/*
+ * Return ISC_TRUE if every RRset in the rendered 'message' is sent in a
+ * fixed order.  A response in which some RRset is shuffled on every
+ * send (cyclic or random rrset-order) must not be cached, as the cache
+ * would freeze one particular ordering.
+ */
+static isc_boolean_t
+respcache_fixedorder(dns_message_t *message) {
+	dns_section_t section;
+	dns_name_t *name;
+	dns_rdataset_t *rdataset;
+	isc_result_t result;
+
+	for (section = DNS_SECTION_ANSWER;
+	     section <= DNS_SECTION_ADDITIONAL;
+	     section++)
+	{
+		for (result = dns_message_firstname(message, section);
+		     result == ISC_R_SUCCESS;
+		     result = dns_message_nextname(message, section))
+		{
+			name = NULL;
+			dns_message_currentname(message, section, &name);
+			for (rdataset = ISC_LIST_HEAD(name->list);
+			     rdataset != NULL;
+			     rdataset = ISC_LIST_NEXT(rdataset, link))
+			{
+				if (rdataset->type == dns_rdatatype_rrsig ||
+				    (rdataset->attributes &
+				     (DNS_RDATASETATTR_NEGATIVE |
+				      DNS_RDATASETATTR_FIXEDORDER)) != 0)
+					continue;
+				if (dns_rdataset_count(rdataset) > 1)
+					return (ISC_FALSE);
+			}
+		}
+	}
+	return (ISC_TRUE);
+}
+
 static void
 client_send(ns_client_t *client) {
 	isc_result_t result;
@@ -1069,7 +1395,8 @@ client_send(ns_client_t *client) {
 	}
 
 	/*
-	 * XXXRTH  The following doesn't deal with TCP buffer resizing.
+	 * A TCP response that outgrows its first buffer is rendered
+	 * again; see client_growsendbuf().
 	 */
 	result = client_allocsendbuf(client, &buffer, &tcpbuffer, 0,
 				     sendbuf, &data);
@@ -1100,6 +1427,7 @@ client_send(ns_client_t *client) {
 	}
 	cleanup_cctx = ISC_TRUE;
 
+ render:
 	result = dns_message_renderbegin(client->message, &cctx, &buffer);
 	if (result != ISC_R_SUCCESS)
 		goto done;
@@ -1114,6 +1442,8 @@ client_send(ns_client_t *client) {
 	result = dns_message_rendersection(client->message,
 					   DNS_SECTION_QUESTION, 0);
 	if (result == ISC_R_NOSPACE) {
+		if (client_growsendbuf(client, &cctx, &buffer, &tcpbuffer))
+			goto render;
 		client->message->flags |= DNS_MESSAGEFLAG_TC;
 		goto renderend;
 	}
@@ -1129,6 +1459,8 @@ client_send(ns_client_t *client) {
 					   DNS_MESSAGERENDER_PARTIAL |
 					   render_opts);
 	if (result == ISC_R_NOSPACE) {
+		if (client_growsendbuf(client, &cctx, &buffer, &tcpbuffer))
+			goto render;
 		client->message->flags |= DNS_MESSAGEFLAG_TC;
 		goto renderend;
 	}
@@ -1139,6 +1471,8 @@ client_send(ns_client_t *client) {
 					   DNS_MESSAGERENDER_PARTIAL |
 					   render_opts);
 	if (result == ISC_R_NOSPACE) {
+		if (client_growsendbuf(client, &cctx, &buffer, &tcpbuffer))
+			goto render;
 		client->message->flags |= DNS_MESSAGEFLAG_TC;
 		goto renderend;
 	}
@@ -1147,6 +1481,9 @@ client_send(ns_client_t *client) {
 	result = dns_message_rendersection(client->message,
 					   DNS_SECTION_ADDITIONAL,
 					   preferred_glue | render_opts);
+	if (result == ISC_R_NOSPACE &&
+	    client_growsendbuf(client, &cctx, &buffer, &tcpbuffer))
+		goto render;
 	if (result != ISC_R_SUCCESS && result != ISC_R_NOSPACE)
 		goto done;
  renderend:
@@ -1155,6 +1492,9 @@ client_send(ns_client_t *client) {
 	if (result != ISC_R_SUCCESS)
 		goto done;
 
+	if (TCP_CLIENT(client))
+		client_shrinksendbuf(client, &buffer, &tcpbuffer);
+
 #ifdef HAVE_DNSTAP
 	memset(&zr, 0, sizeof(zr));
 	if (((client->message->flags & DNS_MESSAGEFLAG_AA) != 0) &&
@@ -1182,6 +1522,23 @@ client_send(ns_client_t *client) {
 		cleanup_cctx = ISC_FALSE;
 	}
 
+	if ((client->query.attributes & NS_QUERYATTR_RESPCACHE) != 0 &&
+	    (client->message->rcode == dns_rcode_noerror ||
+	     client->message->rcode == dns_rcode_nxdomain) &&
+	    client->query.authdb != NULL &&
+	    respcache_fixedorder(client->message))
+	{
+		isc_region_t key;
+
+		key.base = client->query.respcache.key;
+		key.length = client->query.respcache.keylen;
+		isc_buffer_usedregion(&buffer, &r);
+		dns_respcache_add(client->view->respcache, &key,
+				  client->query.authdb,
+				  client->query.respcache.serial,
+				  client->query.respcache.counter, &r);
+	}
+
 	if (TCP_CLIENT(client)) {
 		isc_buffer_usedregion(&buffer, &r);
 		isc_buffer_putuint16(&tcpbuffer, (isc_uint16_t) r.length);
@@ -1264,10 +1621,8 @@ client_send(ns_client_t *client) {
 		return;
 
  done:
-	if (client->tcpbuf != NULL) {
-		isc_mem_put(client->mctx, client->tcpbuf, TCP_BUFFER_SIZE);
-		client->tcpbuf = NULL;
-	}
+	if (client->tcpbuf != NULL)
+		client_puttcpbuf(client);
 
 	if (cleanup_cctx)
 		dns_compress_invalidate(&cctx);
@@ -1546,6 +1901,7 @@ ns_client_addopt(ns_client_t *client, dns_message_t *message,
 	int count = 0;
 	unsigned int flags;
 	unsigned char expire[4];
+	unsigned char advtimo[2];
 
 	REQUIRE(NS_CLIENT_VALID(client));
 	REQUIRE(opt != NULL && *opt == NULL);
@@ -1609,6 +1965,19 @@ ns_client_addopt(ns_client_t *client, dns_message_t *message,
 		ednsopts[count].value = expire;
 		count++;
 	}
+	if (TCP_CLIENT(client) && USEKEEPALIVE(client)) {
+		isc_buffer_t buf;
+
+		INSIST(count < DNS_EDNSOPTIONS);
+
+		isc_buffer_init(&buf, advtimo, sizeof(advtimo));
+		isc_buffer_putuint16(&buf,
+			     (isc_uint16_t)ns_g_server->tcpadvertisedtimo);
+		ednsopts[count].code = DNS_OPT_TCP_KEEPALIVE;
+		ednsopts[count].length = 2;
+		ednsopts[count].value = advtimo;
+		count++;
+	}
 	if (((client->attributes & NS_CLIENTATTR_HAVEECS) != 0) &&
 	    (client->ecs_addr.family == AF_INET ||
 	     client->ecs_addr.family == AF_INET6 ||
@@ -2148,6 +2517,28 @@ process_opt(ns_client_t *client, dns_rdataset_t *opt) {
 				client->attributes |= NS_CLIENTATTR_WANTEXPIRE;
 				isc_buffer_forward(&optbuf, optlen);
 				break;
+			case DNS_OPT_TCP_KEEPALIVE:
+				/*
+				 * RFC 7828: a client must not send a
+				 * timeout value; otherwise the option is
+				 * ignored over UDP.
+				 */
+				if (optlen != 0) {
+					result = DNS_R_FORMERR;
+					ns_client_error(client, result);
+					goto cleanup;
+				}
+				if (TCP_CLIENT(client) &&
+				    !USEKEEPALIVE(client)) {
+					isc_stats_increment(
+						ns_g_server->nsstats,
+						dns_nsstatscounter_keepaliveopt);
+					client->attributes |=
+						NS_CLIENTATTR_USEKEEPALIVE;
+					tcpconn_setkeepalive(client->tcpconn);
+				}
+				isc_buffer_forward(&optbuf, optlen);
+				break;
 			case DNS_OPT_CLIENT_SUBNET:
 				result = process_ecs(client, &optbuf, optlen);
 				if (result != ISC_R_SUCCESS) {
@@ -2175,7 +2566,7 @@ process_opt(ns_client_t *client, dns_rdataset_t *opt) {
 
 /*
  * Handle an incoming request event from the socket (UDP case)
- * or tcpmsg (TCP case).
+ * or from the TCP connection the request was read by (TCP case).
  */
 static void
 client_request(isc_task_t *task, isc_event_t *event) {
@@ -2240,15 +2631,14 @@ client_request(isc_task_t *task, isc_event_t *event) {
 		client->nrecvs--;
 	} else {
 		INSIST(TCP_CLIENT(client));
-		REQUIRE(event->ev_type == DNS_EVENT_TCPMSG);
-		REQUIRE(event->ev_sender == &client->tcpmsg);
-		buffer = &client->tcpmsg.buffer;
-		result = client->tcpmsg.result;
-		INSIST(client->nreads == 1);
+		REQUIRE(event == &client->ctlevent);
+		REQUIRE(client->tcpconn != NULL);
+		buffer = &client->tcpreq;
+		result = ISC_R_SUCCESS;
 		/*
-		 * client->peeraddr was set when the connection was accepted.
+		 * client->peeraddr was set when the request was handed
+		 * over by the connection.
 		 */
-		client->nreads--;
 	}
 
 	reqsize = isc_buffer_usedlength(buffer);
@@ -2420,24 +2810,6 @@ client_request(isc_task_t *task, isc_event_t *event) {
 		goto cleanup;
 	}
 
-	/*
-	 * Pipeline TCP query processing.
-	 */
-	if (client->message->opcode != dns_opcode_query)
-		client->pipelined = ISC_FALSE;
-	if (TCP_CLIENT(client) && client->pipelined) {
-		result = isc_quota_reserve(&ns_g_server->tcpquota);
-		if (result == ISC_R_SUCCESS)
-			result = ns_client_replace(client);
-		if (result != ISC_R_SUCCESS) {
-			ns_client_log(client, NS_LOGCATEGORY_CLIENT,
-				      NS_LOGMODULE_CLIENT, ISC_LOG_WARNING,
-				      "no more TCP clients(read): %s",
-				      isc_result_totext(result));
-			client->pipelined = ISC_FALSE;
-		}
-	}
-
 	dns_opcodestats_increment(ns_g_server->opcodestats,
 				  client->message->opcode);
 	switch (client->message->opcode) {
@@ -2948,6 +3320,8 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 		result = ISC_R_NOMEMORY;
 		goto cleanup_sendevent;
 	}
+	client->arena = NULL;
+	client->arenaused = 0;
 
 	client->recvevent = isc_socket_socketevent(client->mctx, client,
 						   ISC_SOCKEVENT_RECVDONE,
@@ -2962,7 +3336,6 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	client->state = NS_CLIENTSTATE_INACTIVE;
 	client->newstate = NS_CLIENTSTATE_MAX;
 	client->naccepts = 0;
-	client->nreads = 0;
 	client->nsends = 0;
 	client->nrecvs = 0;
 	client->nupdates = 0;
@@ -2974,8 +3347,11 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	client->udpsocket = NULL;
 	client->tcplistener = NULL;
 	client->tcpsocket = NULL;
-	client->tcpmsg_valid = ISC_FALSE;
+	client->tcpconn = NULL;
+	client->tcpreq.base = NULL;
+	client->tcpreq.length = 0;
 	client->tcpbuf = NULL;
+	client->tcpbufsize = 0;
 	client->opt = NULL;
 	client->udpsize = 512;
 	client->dscp = -1;
@@ -2987,8 +3363,6 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	client->signer = NULL;
 	dns_name_init(&client->signername, NULL);
 	client->mortal = ISC_FALSE;
-	client->pipelined = ISC_FALSE;
-	client->tcpquota = NULL;
 	client->recursionquota = NULL;
 	client->interface = NULL;
 	client->peeraddr_valid = ISC_FALSE;
@@ -3034,6 +3408,7 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 
  cleanup_query:
 	ns_query_free(client);
+	arena_reset(client, ISC_TRUE);
 
  cleanup_recvevent:
 	isc_event_free((isc_event_t **)&client->recvevent);
@@ -3062,36 +3437,419 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 }
 
 static void
-client_read(ns_client_t *client) {
+tcpconn_log(ns_tcpconn_t *conn, int level, const char *fmt, ...)
+     ISC_FORMAT_PRINTF(3, 4);
+
+static void
+tcpconn_log(ns_tcpconn_t *conn, int level, const char *fmt, ...) {
+	char msgbuf[2048];
+	char peerbuf[ISC_SOCKADDR_FORMATSIZE];
+	va_list ap;
+
+	if (! isc_log_wouldlog(ns_g_lctx, level))
+		return;
+
+	va_start(ap, fmt);
+	vsnprintf(msgbuf, sizeof(msgbuf), fmt, ap);
+	va_end(ap);
+
+	isc_sockaddr_format(&conn->peeraddr, peerbuf, sizeof(peerbuf));
+	isc_log_write(ns_g_lctx, NS_LOGCATEGORY_CLIENT, NS_LOGMODULE_CLIENT,
+		      level, "client %s: %s", peerbuf, msgbuf);
+}
+
+/*%
+ * Queue 'conn' for destruction if it is closing and neither a read nor
+ * any of its requests is outstanding.  Called with 'conn' locked.
+ */
+static void
+tcpconn_checkdestroy(ns_tcpconn_t *conn) {
+	isc_event_t *ev;
+
+	if (!conn->closing || conn->reading || conn->nclients > 0 ||
+	    conn->freeing)
+		return;
+
+	conn->freeing = ISC_TRUE;
+	ev = &conn->ctlevent;
+	isc_task_send(conn->task, &ev);
+}
+
+/*%
+ * Stop reading requests from 'conn'.  The connection is closed once
+ * the requests in progress have been answered.  Called with 'conn'
+ * locked.
+ */
+static void
+tcpconn_close(ns_tcpconn_t *conn) {
+	if (!conn->closing) {
+		conn->closing = ISC_TRUE;
+		(void)isc_timer_reset(conn->timer, isc_timertype_inactive,
+				      NULL, NULL, ISC_TRUE);
+	}
+	if (conn->reading)
+		dns_tcpmsg_cancelread(&conn->tcpmsg);
+	tcpconn_checkdestroy(conn);
+}
+
+/*%
+ * Arm the idle timer of 'conn' if no request is in progress, and stop
+ * it otherwise.  Called with 'conn' locked.
+ */
+static void
+tcpconn_settimer(ns_tcpconn_t *conn) {
+	isc_interval_t interval;
 	isc_result_t result;
+	unsigned int timeout;
+
+	if (conn->nclients > 0 || conn->closing) {
+		(void)isc_timer_reset(conn->timer, isc_timertype_inactive,
+				      NULL, NULL, ISC_TRUE);
+		return;
+	}
 
-	CTRACE("read");
+	if (conn->nrequests == 0)
+		timeout = ns_g_server->tcpinitialtimo;
+	else if (conn->keepalive)
+		timeout = ns_g_server->tcpkeepalivetimo;
+	else
+		timeout = ns_g_server->tcpidletimo;
 
-	result = dns_tcpmsg_readmessage(&client->tcpmsg, client->task,
-					client_request, client);
+	/* The timeouts are in units of 100 milliseconds. */
+	isc_interval_set(&interval, timeout / 10, (timeout % 10) * 100000000);
+	result = isc_timer_reset(conn->timer, isc_timertype_once, NULL,
+				 &interval, ISC_TRUE);
 	if (result != ISC_R_SUCCESS)
-		goto fail;
+		tcpconn_log(conn, ISC_LOG_ERROR, "setting timeout: %s",
+			    isc_result_totext(result));
+}
+
+/*%
+ * Start reading the next request from 'conn'.  Called with 'conn'
+ * locked.
+ */
+static void
+tcpconn_read(ns_tcpconn_t *conn) {
+	isc_result_t result;
+
+	INSIST(!conn->reading && !conn->closing);
+
+	result = dns_tcpmsg_readmessage(&conn->tcpmsg, conn->task,
+					tcpconn_readdone, conn);
+	if (result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "read failed: %s",
+			    isc_result_totext(result));
+		conn->closing = ISC_TRUE;
+		return;
+	}
+	conn->reading = ISC_TRUE;
+}
+
+/*%
+ * A request has been read from 'conn'; hand it to a client.
+ */
+static void
+tcpconn_readdone(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+	isc_buffer_t buffer;
+	isc_region_t r;
+	isc_result_t result;
+	isc_boolean_t readahead;
+
+	REQUIRE(event->ev_type == DNS_EVENT_TCPMSG);
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(task == conn->task);
+
+	UNUSED(task);
+
+	LOCK(&conn->lock);
+	INSIST(conn->reading);
+	conn->reading = ISC_FALSE;
+	result = conn->tcpmsg.result;
+	if (result != ISC_R_SUCCESS || conn->closing) {
+		if (result != ISC_R_SUCCESS && result != ISC_R_EOF &&
+		    result != ISC_R_CANCELED)
+			tcpconn_log(conn, ISC_LOG_DEBUG(3), "read failed: %s",
+				    isc_result_totext(result));
+		tcpconn_close(conn);
+		UNLOCK(&conn->lock);
+		return;
+	}
+	conn->nclients++;
+	conn->nrequests++;
+	tcpconn_settimer(conn);
+	UNLOCK(&conn->lock);
+
+	dns_tcpmsg_keepbuffer(&conn->tcpmsg, &buffer);
 
 	/*
-	 * Set a timeout to limit the amount of time we will wait
-	 * for a request on this TCP connection.
+	 * Queries may be answered out of order, so the next one can be
+	 * read while this one is being answered.  Anything else, such
+	 * as an update, must be answered before the next request is
+	 * read.  The opcode is in the upper half of the third octet.
 	 */
-	ns_client_settimeout(client, 30);
+	readahead = conn->pipelined;
+	isc_buffer_usedregion(&buffer, &r);
+	if (r.length < DNS_MESSAGE_HEADERLEN ||
+	    ((r.base[2] >> 3) & 0x0f) != dns_opcode_query)
+		readahead = ISC_FALSE;
 
-	client->state = client->newstate = NS_CLIENTSTATE_READING;
-	INSIST(client->nreads == 0);
-	INSIST(client->recursionquota == NULL);
-	client->nreads++;
+	result = get_worker(conn->manager, conn, &buffer);
+	if (result != ISC_R_SUCCESS) {
+		tcpconn_log(conn, ISC_LOG_WARNING,
+			    "no more TCP clients(read): %s",
+			    isc_result_totext(result));
+		isc_mem_put(conn->mctx, buffer.base, buffer.length);
+		LOCK(&conn->lock);
+		conn->nclients--;
+		tcpconn_close(conn);
+		UNLOCK(&conn->lock);
+		return;
+	}
 
-	return;
- fail:
-	ns_client_next(client, result);
+	/*
+	 * If the client has already answered the request, it has
+	 * started the next read itself.  Otherwise each request read
+	 * ahead takes another unit of the TCP client quota, as it
+	 * ties up another client, so tcp-clients bounds the requests
+	 * in progress rather than only the connections.
+	 */
+	LOCK(&conn->lock);
+	if (readahead && !conn->reading && !conn->closing) {
+		result = isc_quota_reserve(&ns_g_server->tcpquota);
+		if (result == ISC_R_SUCCESS) {
+			conn->nreserved++;
+			tcpconn_read(conn);
+		} else
+			tcpconn_log(conn, ISC_LOG_WARNING,
+				    "no more TCP clients(read): %s",
+				    isc_result_totext(result));
+	}
+	tcpconn_checkdestroy(conn);
+	UNLOCK(&conn->lock);
+}
+
+/*%
+ * The idle timer of 'conn' has expired.
+ */
+static void
+tcpconn_timeout(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+
+	REQUIRE(event->ev_type == ISC_TIMEREVENT_LIFE ||
+		event->ev_type == ISC_TIMEREVENT_IDLE);
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(task == conn->task);
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+
+	LOCK(&conn->lock);
+	if (conn->nclients == 0 && !conn->closing) {
+		tcpconn_log(conn, ISC_LOG_DEBUG(3), "idle connection timed out");
+		tcpconn_close(conn);
+	}
+	UNLOCK(&conn->lock);
+}
+
+/*%
+ * Free 'conn'.  This is the action of its control event, which is
+ * sent by tcpconn_checkdestroy().
+ */
+static void
+tcpconn_destroy(isc_task_t *task, isc_event_t *event) {
+	ns_tcpconn_t *conn = event->ev_arg;
+	ns_clientmgr_t *manager;
+	isc_boolean_t destroy_manager = ISC_FALSE;
+
+	REQUIRE(VALID_TCPCONN(conn));
+	REQUIRE(task == conn->task);
+
+	UNUSED(task);
+
+	INSIST(conn->freeing && !conn->reading && conn->nclients == 0);
+
+	tcpconn_log(conn, ISC_LOG_DEBUG(3), "closing TCP connection");
+
+	manager = conn->manager;
+	LOCK(&manager->listlock);
+	ISC_LIST_UNLINK(manager->tcpconns, conn, link);
+	LOCK(&manager->lock);
+	if (manager->exiting && ISC_LIST_EMPTY(manager->clients) &&
+	    ISC_LIST_EMPTY(manager->tcpconns))
+		destroy_manager = ISC_TRUE;
+	UNLOCK(&manager->lock);
+	UNLOCK(&manager->listlock);
+
+	conn->magic = 0;
+	isc_timer_detach(&conn->timer);
+	dns_tcpmsg_invalidate(&conn->tcpmsg);
+	isc_socket_detach(&conn->sock);
+	for (; conn->nreserved > 0; conn->nreserved--)
+		isc_quota_release(&ns_g_server->tcpquota);
+	isc_quota_detach(&conn->tcpquota);
+	ns_interface_detach(&conn->interface);
+	DESTROYLOCK(&conn->lock);
+	isc_task_detach(&conn->task);
+	isc_mem_putanddetach(&conn->mctx, conn, sizeof(*conn));
+
+	if (destroy_manager)
+		clientmgr_destroy(manager);
+}
+
+/*%
+ * Create a connection object for 'sock', which 'client' has just
+ * accepted, and start reading requests from it.  The connection runs
+ * on a task drawn from the manager's pool, so that reading from many
+ * connections accepted by the same client isn't serialized on that
+ * client's task.
+ */
+static isc_result_t
+tcpconn_create(ns_client_t *client, isc_socket_t *sock) {
+	ns_clientmgr_t *manager = client->manager;
+	ns_tcpconn_t *conn;
+	isc_netaddr_t netaddr;
+	isc_result_t result;
+
+	conn = isc_mem_get(manager->mctx, sizeof(*conn));
+	if (conn == NULL)
+		return (ISC_R_NOMEMORY);
+
+	conn->tcpquota = NULL;
+	result = isc_quota_attach(&ns_g_server->tcpquota, &conn->tcpquota);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_conn;
+
+	result = isc_mutex_init(&conn->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_quota;
+
+	conn->task = NULL;
+	isc_taskpool_gettask(manager->tcptasks, &conn->task);
+
+	conn->timer = NULL;
+	result = isc_timer_create(manager->timermgr, isc_timertype_inactive,
+				  NULL, NULL, conn->task, tcpconn_timeout,
+				  conn, &conn->timer);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_task;
+
+	conn->mctx = NULL;
+	isc_mem_attach(manager->mctx, &conn->mctx);
+	conn->manager = manager;
+	conn->interface = NULL;
+	ns_interface_attach(client->interface, &conn->interface);
+	conn->sock = NULL;
+	isc_socket_attach(sock, &conn->sock);
+	dns_tcpmsg_init(conn->mctx, conn->sock, &conn->tcpmsg);
+	conn->peeraddr = client->peeraddr;
+
+	/*
+	 * Answer queries out of order unless the client is listed
+	 * in keep-response-order.
+	 */
+	isc_netaddr_fromsockaddr(&netaddr, &conn->peeraddr);
+	conn->pipelined = ISC_TF(ns_g_server->keepresporder == NULL ||
+				 !allowed(&netaddr, NULL, NULL, 0, NULL,
+					  ns_g_server->keepresporder));
+
+	conn->reading = ISC_FALSE;
+	conn->closing = ISC_FALSE;
+	conn->freeing = ISC_FALSE;
+	conn->keepalive = ISC_FALSE;
+	conn->nclients = 0;
+	conn->nreserved = 0;
+	conn->nrequests = 0;
+	ISC_EVENT_INIT(&conn->ctlevent, sizeof(conn->ctlevent), 0, NULL,
+		       NS_EVENT_CLIENTCONTROL, tcpconn_destroy, conn, conn,
+		       NULL, NULL);
+	ISC_LINK_INIT(conn, link);
+	conn->magic = TCPCONN_MAGIC;
+
+	LOCK(&manager->listlock);
+	if (manager->exiting)
+		conn->closing = ISC_TRUE;
+	ISC_LIST_APPEND(manager->tcpconns, conn, link);
+	UNLOCK(&manager->listlock);
+
+	LOCK(&conn->lock);
+	if (!conn->closing)
+		tcpconn_read(conn);
+	tcpconn_settimer(conn);
+	tcpconn_checkdestroy(conn);
+	UNLOCK(&conn->lock);
+
+	return (ISC_R_SUCCESS);
+
+ cleanup_task:
+	isc_task_detach(&conn->task);
+	DESTROYLOCK(&conn->lock);
+
+ cleanup_quota:
+	isc_quota_detach(&conn->tcpquota);
+
+ cleanup_conn:
+	isc_mem_put(manager->mctx, conn, sizeof(*conn));
+
+	return (result);
+}
+
+/*%
+ * Called when 'client' is done with the request it was handed by its
+ * TCP connection.  If 'sever' is true, the connection is closed;
+ * otherwise it goes on reading requests.
+ */
+static void
+tcpconn_release(ns_client_t *client, isc_boolean_t sever) {
+	ns_tcpconn_t *conn = client->tcpconn;
+
+	REQUIRE(VALID_TCPCONN(conn));
+
+	client->tcpconn = NULL;
+	if (client->tcpreq.base != NULL) {
+		isc_mem_put(conn->mctx, client->tcpreq.base,
+			    client->tcpreq.length);
+		client->tcpreq.base = NULL;
+		client->tcpreq.length = 0;
+	}
+
+	LOCK(&conn->lock);
+	INSIST(conn->nclients > 0);
+	conn->nclients--;
+	if (conn->nreserved > 0) {
+		isc_quota_release(&ns_g_server->tcpquota);
+		conn->nreserved--;
+	}
+	if (sever)
+		tcpconn_close(conn);
+	else if (!conn->closing) {
+		if (!conn->reading)
+			tcpconn_read(conn);
+		tcpconn_settimer(conn);
+		tcpconn_checkdestroy(conn);
+	}
+	UNLOCK(&conn->lock);
+}
+
+/*%
+ * Note that the client sending the current request on 'conn' asked
+ * for the EDNS TCP keepalive timeout.
+ */
+static void
+tcpconn_setkeepalive(ns_tcpconn_t *conn) {
+	REQUIRE(VALID_TCPCONN(conn));
+
+	LOCK(&conn->lock);
+	conn->keepalive = ISC_TRUE;
+	UNLOCK(&conn->lock);
 }
 
 static void
 client_newconn(isc_task_t *task, isc_event_t *event) {
 	ns_client_t *client = event->ev_arg;
 	isc_socket_newconnev_t *nevent = (isc_socket_newconnev_t *)event;
+	isc_socket_t *sock = NULL;
 	isc_result_t result;
 
 	REQUIRE(event->ev_type == ISC_SOCKEVENT_NEWCONN);
@@ -3115,17 +3873,9 @@ client_newconn(isc_task_t *task, isc_event_t *event) {
 	 * check to make sure it gets destroyed if we decide to exit.
 	 */
 	if (nevent->result == ISC_R_SUCCESS) {
-		client->tcpsocket = nevent->newsocket;
-		isc_socket_setname(client->tcpsocket, "client-tcp", NULL);
-		client->state = NS_CLIENTSTATE_READING;
-		INSIST(client->recursionquota == NULL);
-
-		(void)isc_socket_getpeername(client->tcpsocket,
-					     &client->peeraddr);
-		client->peeraddr_valid = ISC_TRUE;
-		ns_client_log(client, NS_LOGCATEGORY_CLIENT,
-			   NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(3),
-			   "new TCP connection");
+		sock = nevent->newsocket;
+		isc_socket_setname(sock, "client-tcp", NULL);
+		(void)isc_socket_getpeername(sock, &client->peeraddr);
 	} else {
 		/*
 		 * XXXRTH  What should we do?  We're trying to accept but
@@ -3146,10 +3896,11 @@ client_newconn(isc_task_t *task, isc_event_t *event) {
 	if (exit_check(client))
 		goto freeevent;
 
-	if (nevent->result == ISC_R_SUCCESS) {
+	if (sock != NULL) {
 		int match;
 		isc_netaddr_t netaddr;
 
+		client->peeraddr_valid = ISC_TRUE;
 		isc_netaddr_fromsockaddr(&netaddr, &client->peeraddr);
 
 		if (ns_g_server->blackholeacl != NULL &&
@@ -3162,42 +3913,30 @@ client_newconn(isc_task_t *task, isc_event_t *event) {
 			ns_client_log(client, DNS_LOGCATEGORY_SECURITY,
 				      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(10),
 				      "blackholed connection attempt");
-			client->newstate = NS_CLIENTSTATE_READY;
-			(void)exit_check(client);
-			goto freeevent;
+		} else {
+			ns_client_log(client, NS_LOGCATEGORY_CLIENT,
+				      NS_LOGMODULE_CLIENT, ISC_LOG_DEBUG(3),
+				      "new TCP connection");
+			result = tcpconn_create(client, sock);
+			if (result != ISC_R_SUCCESS)
+				ns_client_log(client, NS_LOGCATEGORY_CLIENT,
+					      NS_LOGMODULE_CLIENT,
+					      ISC_LOG_WARNING,
+					      "no more TCP clients(accept): %s",
+					      isc_result_totext(result));
 		}
-
-		INSIST(client->tcpmsg_valid == ISC_FALSE);
-		dns_tcpmsg_init(client->mctx, client->tcpsocket,
-				&client->tcpmsg);
-		client->tcpmsg_valid = ISC_TRUE;
+		client->peeraddr_valid = ISC_FALSE;
 
 		/*
-		 * Let a new client take our place immediately, before
-		 * we wait for a request packet.  If we don't,
-		 * telnetting to port 53 (once per CPU) will
-		 * deny service to legitimate TCP clients.
+		 * The connection reads its requests itself, so we
+		 * can go straight back to accepting.
 		 */
-		client->pipelined = ISC_FALSE;
-		result = isc_quota_attach(&ns_g_server->tcpquota,
-					  &client->tcpquota);
-		if (result == ISC_R_SUCCESS)
-			result = ns_client_replace(client);
-		if (result != ISC_R_SUCCESS) {
-			ns_client_log(client, NS_LOGCATEGORY_CLIENT,
-				      NS_LOGMODULE_CLIENT, ISC_LOG_WARNING,
-				      "no more TCP clients(accept): %s",
-				      isc_result_totext(result));
-		} else if (ns_g_server->keepresporder == NULL ||
-			   !allowed(&netaddr, NULL, NULL, 0, NULL,
-				    ns_g_server->keepresporder)) {
-			client->pipelined = ISC_TRUE;
-		}
-
-		client_read(client);
+		client_accept(client);
 	}
 
  freeevent:
+	if (sock != NULL)
+		isc_socket_detach(&sock);
 	isc_event_free(&event);
 }
 
@@ -3297,13 +4036,8 @@ ns_client_replace(ns_client_t *client) {
 	REQUIRE(client->manager != NULL);
 
 	tcp = TCP_CLIENT(client);
-	if (tcp && client->pipelined) {
-		result = get_worker(client->manager, client->interface,
-				    client->tcpsocket);
-	} else {
-		result = get_client(client->manager, client->interface,
-				    client->dispatch, tcp);
-	}
+	result = get_client(client->manager, client->interface,
+			    client->dispatch, tcp);
 	if (result != ISC_R_SUCCESS)
 		return (result);
 
@@ -3323,11 +4057,13 @@ ns_client_replace(ns_client_t *client) {
 
 static void
 clientmgr_destroy(ns_clientmgr_t *manager) {
+	unsigned int j;
 #if NMCTXS > 0
 	int i;
 #endif
 
 	REQUIRE(ISC_LIST_EMPTY(manager->clients));
+	REQUIRE(ISC_LIST_EMPTY(manager->tcpconns));
 
 	MTRACE("clientmgr_destroy");
 
@@ -3338,6 +4074,11 @@ clientmgr_destroy(ns_clientmgr_t *manager) {
 	}
 #endif
 
+	for (j = 0; j < TCP_BUFFER_CLASSES; j++)
+		isc_mempool_destroy(&manager->tcpbufpools[j]);
+	DESTROYLOCK(&manager->tcpbuflock);
+	isc_taskpool_destroy(&manager->tcptasks);
+
 	ISC_QUEUE_DESTROY(manager->inactive);
 	DESTROYLOCK(&manager->lock);
 	DESTROYLOCK(&manager->listlock);
@@ -3352,6 +4093,7 @@ ns_clientmgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 {
 	ns_clientmgr_t *manager;
 	isc_result_t result;
+	unsigned int j;
 #if NMCTXS > 0
 	int i;
 #endif
@@ -3359,6 +4101,8 @@ ns_clientmgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	manager = isc_mem_get(mctx, sizeof(*manager));
 	if (manager == NULL)
 		return (ISC_R_NOMEMORY);
+	memset(manager->tcpbufpools, 0, sizeof(manager->tcpbufpools));
+	manager->tcptasks = NULL;
 
 	result = isc_mutex_init(&manager->lock);
 	if (result != ISC_R_SUCCESS)
@@ -3372,11 +4116,33 @@ ns_clientmgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_listlock;
 
+	result = isc_mutex_init(&manager->tcpbuflock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_reclock;
+
+	for (j = 0; j < TCP_BUFFER_CLASSES; j++) {
+		result = isc_mempool_create(mctx, tcpbufclasses[j].size,
+					    &manager->tcpbufpools[j]);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup_tcpbufpools;
+		isc_mempool_setname(manager->tcpbufpools[j], "client_tcpbuf");
+		isc_mempool_setfreemax(manager->tcpbufpools[j],
+				       tcpbufclasses[j].freemax);
+		isc_mempool_associatelock(manager->tcpbufpools[j],
+					  &manager->tcpbuflock);
+	}
+
+	result = isc_taskpool_create(taskmgr, mctx, ns_g_cpus, 0,
+				     &manager->tcptasks);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_tcpbufpools;
+
 	manager->mctx = mctx;
 	manager->taskmgr = taskmgr;
 	manager->timermgr = timermgr;
 	manager->exiting = ISC_FALSE;
 	ISC_LIST_INIT(manager->clients);
+	ISC_LIST_INIT(manager->tcpconns);
 	ISC_LIST_INIT(manager->recursing);
 	ISC_QUEUE_INIT(manager->inactive, ilink);
 #if NMCTXS > 0
@@ -3392,6 +4158,16 @@ ns_clientmgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 
 	return (ISC_R_SUCCESS);
 
+ cleanup_tcpbufpools:
+	for (j = 0; j < TCP_BUFFER_CLASSES; j++) {
+		if (manager->tcpbufpools[j] != NULL)
+			isc_mempool_destroy(&manager->tcpbufpools[j]);
+	}
+	(void) isc_mutex_destroy(&manager->tcpbuflock);
+
+ cleanup_reclock:
+	(void) isc_mutex_destroy(&manager->reclock);
+
  cleanup_listlock:
 	(void) isc_mutex_destroy(&manager->listlock);
 
@@ -3409,6 +4185,7 @@ ns_clientmgr_destroy(ns_clientmgr_t **managerp) {
 	isc_result_t result;
 	ns_clientmgr_t *manager;
 	ns_client_t *client;
+	ns_tcpconn_t *conn;
 	isc_boolean_t need_destroy = ISC_FALSE, unlock = ISC_FALSE;
 
 	REQUIRE(managerp != NULL);
@@ -3433,7 +4210,17 @@ ns_clientmgr_destroy(ns_clientmgr_t **managerp) {
 	     client = ISC_LIST_NEXT(client, link))
 		isc_task_shutdown(client->task);
 
-	if (ISC_LIST_EMPTY(manager->clients))
+	for (conn = ISC_LIST_HEAD(manager->tcpconns);
+	     conn != NULL;
+	     conn = ISC_LIST_NEXT(conn, link))
+	{
+		LOCK(&conn->lock);
+		tcpconn_close(conn);
+		UNLOCK(&conn->lock);
+	}
+
+	if (ISC_LIST_EMPTY(manager->clients) &&
+	    ISC_LIST_EMPTY(manager->tcpconns))
 		need_destroy = ISC_TRUE;
 
 	if (unlock)
@@ -3510,8 +4297,12 @@ get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
 	return (ISC_R_SUCCESS);
 }
 
+/*%
+ * Hand the request in 'buffer', which was read by 'conn', to a client.
+ * The client takes over the buffer.
+ */
 static isc_result_t
-get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock)
+get_worker(ns_clientmgr_t *manager, ns_tcpconn_t *conn, isc_buffer_t *buffer)
 {
 	isc_result_t result = ISC_R_SUCCESS;
 	isc_event_t *ev;
@@ -3548,26 +4339,22 @@ get_worker(ns_clientmgr_t *manager, ns_interface_t *ifp, isc_socket_t *sock)
 	}
 
 	client->manager = manager;
-	ns_interface_attach(ifp, &client->interface);
-	client->newstate = client->state = NS_CLIENTSTATE_WORKING;
+	ns_interface_attach(conn->interface, &client->interface);
+	client->state = NS_CLIENTSTATE_READING;
 	INSIST(client->recursionquota == NULL);
-	client->tcpquota = &ns_g_server->tcpquota;
 
-	client->dscp = ifp->dscp;
+	client->dscp = conn->interface->dscp;
 
 	client->attributes |= NS_CLIENTATTR_TCP;
-	client->pipelined = ISC_TRUE;
 	client->mortal = ISC_TRUE;
 
-	isc_socket_attach(ifp->tcpsocket, &client->tcplistener);
-	isc_socket_attach(sock, &client->tcpsocket);
-	isc_socket_setname(client->tcpsocket, "worker-tcp", NULL);
-	(void)isc_socket_getpeername(client->tcpsocket, &client->peeraddr);
+	isc_socket_attach(conn->sock, &client->tcpsocket);
+	client->peeraddr = conn->peeraddr;
 	client->peeraddr_valid = ISC_TRUE;
 
-	INSIST(client->tcpmsg_valid == ISC_FALSE);
-	dns_tcpmsg_init(client->mctx, client->tcpsocket, &client->tcpmsg);
-	client->tcpmsg_valid = ISC_TRUE;
+	INSIST(client->tcpconn == NULL);
+	client->tcpconn = conn;
+	client->tcpreq = *buffer;
 
 	INSIST(client->nctls == 0);
 	client->nctls++;
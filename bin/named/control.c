@@ -223,6 +223,8 @@ ns_control_docommand(isccc_sexpr_t *message, isc_boolean_t readonly,
 		result = ns_server_flushnode(ns_g_server, lex, ISC_FALSE);
 	} else if (command_compare(command, NS_COMMAND_FLUSHTREE)) {
 		result = ns_server_flushnode(ns_g_server, lex, ISC_TRUE);
+	} else if (command_compare(command, NS_COMMAND_SAVECACHE)) {
+		result = ns_server_savecache(ns_g_server, lex);
 	} else if (command_compare(command, NS_COMMAND_STATUS)) {
 		result = ns_server_status(ns_g_server, text);
 	} else if (command_compare(command, NS_COMMAND_TSIGLIST)) {
@@ -275,6 +277,10 @@ ns_control_docommand(isccc_sexpr_t *message, isc_boolean_t readonly,
 	} else if (command_compare(command, NS_COMMAND_DNSTAP) ||
 		   command_compare(command, NS_COMMAND_DNSTAPREOPEN)) {
 		result = ns_server_dnstap(ns_g_server, lex, text);
+	} else if (command_compare(command, NS_COMMAND_TASKPROFILE)) {
+		result = ns_server_taskprofile(ns_g_server, lex, text);
+	} else if (command_compare(command, NS_COMMAND_LOCKPROFILE)) {
+		result = ns_server_lockprofile(ns_g_server, lex, text);
 	} else {
 		isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
 			      NS_LOGMODULE_CONTROL, ISC_LOG_WARNING,
@@ -22,11 +22,20 @@
  * An ns_client_t object handles incoming DNS requests from clients
  * on a given network interface.
  *
- * Each ns_client_t object can handle only one TCP connection or UDP
- * request at a time.  Therefore, several ns_client_t objects are
- * typically created to serve each network interface, e.g., one
- * for handling TCP requests and a few (one per CPU) for handling
- * UDP requests.
+ * Each ns_client_t object can handle only one request at a time.
+ * Therefore, several ns_client_t objects are typically created to
+ * serve each network interface, e.g., a few for accepting TCP
+ * connections and a few (one per CPU) for handling UDP requests.
+ *
+ * An accepted TCP connection is owned by a small ns_tcpconn_t
+ * object rather than by a client.  It reads requests from the
+ * connection and hands each one to a client taken from the
+ * manager's pool, so a connection waiting for its next request
+ * does not tie up a client.  The connection is closed when it has
+ * been idle for longer than the configured TCP timeouts, which
+ * clients can extend with the EDNS TCP keepalive option (RFC 7828).
+ * A connection holds one unit of the TCP client quota, and each
+ * query it reads ahead of the answers holds another.
  *
  * Incoming requests are classified as queries, zone transfer
  * requests, update requests, notify requests, etc, and handed off
@@ -64,7 +73,6 @@
 #include <dns/name.h>
 #include <dns/rdataclass.h>
 #include <dns/rdatatype.h>
-#include <dns/tcpmsg.h>
 #include <dns/types.h>
 
 #include <named/types.h>
@@ -82,7 +90,6 @@ struct ns_client {
 	int			state;
 	int			newstate;
 	int			naccepts;
-	int			nreads;
 	int			nsends;
 	int			nrecvs;
 	int			nupdates;
@@ -103,8 +110,9 @@ struct ns_client {
 	isc_socket_t *		tcplistener;
 	isc_socket_t *		tcpsocket;
 	unsigned char *		tcpbuf;
-	dns_tcpmsg_t		tcpmsg;
-	isc_boolean_t		tcpmsg_valid;
+	unsigned int		tcpbufsize;	/*%< Size class of tcpbuf */
+	ns_tcpconn_t *		tcpconn;	/*%< Connection of request */
+	isc_buffer_t		tcpreq;		/*%< Request read from it */
 	isc_timer_t *		timer;
 	isc_timer_t *		delaytimer;
 	isc_boolean_t 		timerset;
@@ -112,6 +120,8 @@ struct ns_client {
 	isc_socketevent_t *	sendevent;
 	isc_socketevent_t *	recvevent;
 	unsigned char *		recvbuf;
+	ns_arenablock_t *	arena;		/*%< Per-request scratch */
+	size_t			arenaused;	/*%< Used in first block */
 	dns_rdataset_t *	opt;
 	isc_uint16_t		udpsize;
 	isc_uint16_t		extflags;
@@ -126,8 +136,6 @@ struct ns_client {
 	dns_name_t		signername;   /*%< [T]SIG key name */
 	dns_name_t *		signer;	      /*%< NULL if not valid sig */
 	isc_boolean_t		mortal;	      /*%< Die after handling request */
-	isc_boolean_t		pipelined;   /*%< TCP queries not in sequence */
-	isc_quota_t		*tcpquota;
 	isc_quota_t		*recursionquota;
 	ns_interface_t		*interface;
 
@@ -189,6 +197,7 @@ typedef ISC_LIST(ns_client_t) client_list_t;
 #define NS_CLIENTATTR_HAVEECS		0x4000 /*%< received an ECS option */
 
 #define NS_CLIENTATTR_NOSETFC		0x8000 /*%< don't set servfail cache */
+#define NS_CLIENTATTR_USEKEEPALIVE	0x10000 /*%< return TCP keepalive */
 
 /*
  * Flag to use with the SERVFAIL cache to indicate
@@ -226,6 +235,14 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *msg);
  * send msg as a response using client->message->id for the id.
  */
 
+void
+ns_client_sendwire(ns_client_t *client, isc_region_t *wire);
+/*%
+ * Finish processing the current client request and send the
+ * already rendered response 'wire' using client->message->id for
+ * the id.
+ */
+
 void
 ns_client_error(ns_client_t *client, isc_result_t result);
 /*%
@@ -407,4 +424,16 @@ isc_result_t
 ns_client_addopt(ns_client_t *client, dns_message_t *message,
 		 dns_rdataset_t **opt);
 
+void *
+ns_client_arenaget(ns_client_t *client, size_t size);
+/*%
+ * Allocate 'size' bytes of scratch memory for the current request.
+ * The memory is carved out of blocks owned by the client and is never
+ * freed individually; all of it is released at once when the request
+ * ends, and the client keeps one block for the next request, so most
+ * requests allocate nothing from the shared memory context.
+ *
+ * Returns NULL if memory could not be allocated.
+ */
+
 #endif /* NAMED_CLIENT_H */
@@ -16,6 +16,7 @@
 #include <isc/netaddr.h>
 
 #include <dns/rdataset.h>
+#include <dns/respcache.h>
 #include <dns/rpz.h>
 #include <dns/types.h>
 
@@ -70,6 +71,12 @@ struct ns_query {
 		dns_rdataset_t *	sigrdataset;
 		isc_boolean_t		authoritative;
 	} redirect;
+	struct {
+		unsigned char		key[DNS_RESPCACHE_MAXKEY];
+		unsigned int		keylen;
+		isc_uint32_t		serial;
+		unsigned int		counter;
+	} respcache;
 
 };
 
@@ -91,6 +98,9 @@ struct ns_query {
 #define NS_QUERYATTR_DNS64EXCLUDE	0x8000
 #define NS_QUERYATTR_RRL_CHECKED	0x10000
 #define NS_QUERYATTR_REDIRECT		0x20000
+#define NS_QUERYATTR_RESPCACHE		0x40000
+#define NS_QUERYATTR_RECURSED		0x80000
+#define NS_QUERYATTR_RPZREWRITE		0x100000
 
 isc_result_t
 ns_query_init(ns_client_t *client);
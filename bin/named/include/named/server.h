@@ -29,6 +29,19 @@
 #define NS_EVENT_CLIENTCONTROL	(NS_EVENTCLASS + 1)
 #define NS_EVENT_DELZONE	(NS_EVENTCLASS + 2)
 
+/*%
+ * Query latency histograms, by where the answer came from.  Used as
+ * indexes into ns_server_t.querylatency[].
+ */
+enum {
+	ns_latency_cachehit = 0,	/*%< Answered without recursing */
+	ns_latency_cachemiss = 1,	/*%< Answered after recursing */
+	ns_latency_auth = 2,		/*%< Authoritative answer */
+	ns_latency_rpz = 3,		/*%< Rewritten by RPZ */
+
+	ns_latency_max = 4
+};
+
 /*%
  * Name server state.  Better here than in lots of separate global variables.
  */
@@ -94,6 +107,7 @@ struct ns_server {
 	isc_stats_t *		zonestats;	/*% Zone management stats */
 	isc_stats_t  *		resolverstats;	/*% Resolver stats */
 	isc_stats_t *		sockstats;	/*%< Socket stats */
+	dns_cryptopool_t *	cryptopool;	/*%< Verification workers */
 	isc_stats_t *		udpinstats4;	/*%< Traffic size: UDPv4 in */
 	isc_stats_t *		udpoutstats4;	/*%< Traffic size: UDPv4 out */
 	isc_stats_t *		udpinstats6;	/*%< Traffic size: UDPv6 in */
@@ -103,13 +117,13 @@ struct ns_server {
 	isc_stats_t *		tcpinstats6;	/*%< Traffic size: TCPv6 in */
 	isc_stats_t *		tcpoutstats6;	/*%< Traffic size: TCPv6 out */
 	dns_stats_t *		rcodestats;	/*%< Sent Response code stats */
+	/*% Query latency, microseconds */
+	isc_histo_t *		querylatency[ns_latency_max];
 
 	ns_controls_t *		controls;	/*%< Control channels */
 	unsigned int		dispatchgen;
 	ns_dispatchlist_t	dispatches;
 
-	dns_acache_t		*acache;
-
 	ns_statschannellist_t	statschannels;
 
 	dns_tsigkey_t		*sessionkey;
@@ -126,6 +140,12 @@ struct ns_server {
 	char *			lockfile;
 
 	isc_uint16_t		transfer_tcp_message_size;
+
+	/*% TCP timeouts, in units of 100 milliseconds */
+	unsigned int		tcpinitialtimo;	/*%< Before first request */
+	unsigned int		tcpidletimo;	/*%< Between requests */
+	unsigned int		tcpkeepalivetimo; /*%< With keepalive */
+	unsigned int		tcpadvertisedtimo; /*%< Sent to clients */
 };
 
 #define NS_SERVER_MAGIC			ISC_MAGIC('S','V','E','R')
@@ -205,7 +225,27 @@ enum {
 	dns_nsstatscounter_cookienew = 54,
 	dns_nsstatscounter_badcookie = 55,
 
-	dns_nsstatscounter_max = 56
+	dns_nsstatscounter_respcachehit = 56,
+	dns_nsstatscounter_respcachemiss = 57,
+
+	dns_nsstatscounter_addcachehit = 58,
+	dns_nsstatscounter_addcachemiss = 59,
+
+	dns_nsstatscounter_keepaliveopt = 60,
+
+	dns_nsstatscounter_rpzclientiplookups = 61,
+	dns_nsstatscounter_rpzclientiptime = 62,
+	dns_nsstatscounter_rpzqnamelookups = 63,
+	dns_nsstatscounter_rpzqnametime = 64,
+	dns_nsstatscounter_rpziplookups = 65,
+	dns_nsstatscounter_rpziptime = 66,
+	dns_nsstatscounter_rpznsdnamelookups = 67,
+	dns_nsstatscounter_rpznsdnametime = 68,
+	dns_nsstatscounter_rpznsiplookups = 69,
+	dns_nsstatscounter_rpznsiptime = 70,
+	dns_nsstatscounter_rpznsipcachehit = 71,
+
+	dns_nsstatscounter_max = 72
 };
 
 /*%
@@ -617,6 +657,13 @@ ns_server_setdebuglevel(ns_server_t *server, isc_lex_t *lex);
 isc_result_t
 ns_server_flushcache(ns_server_t *server, isc_lex_t *lex);
 
+/*%
+ * Write a snapshot of the server's cache(s) and address database state
+ * to the configured "cache-file", so that it can be reloaded at startup.
+ */
+isc_result_t
+ns_server_savecache(ns_server_t *server, isc_lex_t *lex);
+
 /*%
  * Flush a particular name from the server's cache.  If 'tree' is false,
  * also flush the name from the ADB and badcache.  If 'tree' is true, also
@@ -744,4 +791,19 @@ ns_server_mkeys(ns_server_t *server, isc_lex_t *lex, isc_buffer_t **text);
 isc_result_t
 ns_server_dnstap(ns_server_t *server, isc_lex_t *lex, isc_buffer_t **text);
 
+/*%
+ * Turn task profiling on or off, clear it, or report it.
+ */
+isc_result_t
+ns_server_taskprofile(ns_server_t *server, isc_lex_t *lex,
+		      isc_buffer_t **text);
+
+/*%
+ * Turn lock contention profiling on (optionally with a sampling rate)
+ * or off, clear it, or report it.
+ */
+isc_result_t
+ns_server_lockprofile(ns_server_t *server, isc_lex_t *lex,
+		      isc_buffer_t **text);
+
 #endif /* NAMED_SERVER_H */
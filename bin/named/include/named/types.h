@@ -19,6 +19,8 @@ typedef struct ns_cache			ns_cache_t;
 typedef ISC_LIST(ns_cache_t)		ns_cachelist_t;
 typedef struct ns_client		ns_client_t;
 typedef struct ns_clientmgr		ns_clientmgr_t;
+typedef struct ns_arenablock		ns_arenablock_t;
+typedef struct ns_tcpconn		ns_tcpconn_t;
 typedef struct ns_query			ns_query_t;
 typedef struct ns_server 		ns_server_t;
 typedef struct ns_xmld			ns_xmld_t;
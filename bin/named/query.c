@@ -13,12 +13,14 @@
 #include <string.h>
 
 #include <isc/hex.h>
+#include <isc/histo.h>
 #include <isc/mem.h>
 #include <isc/print.h>
 #include <isc/rwlock.h>
 #include <isc/serial.h>
 #include <isc/stats.h>
 #include <isc/thread.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
 #include <dns/adb.h>
@@ -42,6 +44,7 @@
 #include <dns/rdatastruct.h>
 #include <dns/rdatatype.h>
 #include <dns/resolver.h>
+#include <dns/respcache.h>
 #include <dns/result.h>
 #include <dns/stats.h>
 #include <dns/tkey.h>
@@ -119,6 +122,9 @@
 #define REDIRECT(c)		(((c)->query.attributes & \
 				  NS_QUERYATTR_REDIRECT) != 0)
 
+#define RESPCACHE(c)		(((c)->query.attributes & \
+				  NS_QUERYATTR_RESPCACHE) != 0)
+
 /*% No QNAME Proof? */
 #define NOQNAME(r)		(((r)->attributes & \
 				  DNS_RDATASETATTR_NOQNAME) != 0)
@@ -250,10 +256,37 @@ inc_stats(ns_client_t *client, isc_statscounter_t counter) {
 	}
 }
 
+/*%
+ * Count how long the client waited for its answer in the latency
+ * histogram for where the answer came from.
+ */
+static void
+query_latency(ns_client_t *client, isc_boolean_t authoritative) {
+	isc_time_t now;
+	isc_uint64_t usecs;
+	int which;
+
+	if ((client->query.attributes & NS_QUERYATTR_RPZREWRITE) != 0)
+		which = ns_latency_rpz;
+	else if (authoritative)
+		which = ns_latency_auth;
+	else if ((client->query.attributes & NS_QUERYATTR_RECURSED) != 0)
+		which = ns_latency_cachemiss;
+	else
+		which = ns_latency_cachehit;
+
+	TIME_NOW(&now);
+	usecs = isc_time_microdiff(&now, &client->requesttime);
+	isc_histo_add(ns_g_server->querylatency[which], usecs);
+}
+
 static void
 query_send(ns_client_t *client) {
 	isc_statscounter_t counter;
 
+	query_latency(client, ISC_TF((client->message->flags &
+				      DNS_MESSAGEFLAG_AA) != 0));
+
 	if ((client->message->flags & DNS_MESSAGEFLAG_AA) == 0)
 		inc_stats(client, dns_nsstatscounter_nonauthans);
 	else
@@ -276,6 +309,7 @@ query_send(ns_client_t *client) {
 		counter = dns_nsstatscounter_failure;
 
 	inc_stats(client, counter);
+	client->query.respcache.counter = counter;
 	ns_client_send(client);
 }
 
@@ -301,6 +335,8 @@ query_error(ns_client_t *client, isc_result_t result, int line) {
 
 	log_queryerror(client, result, line, loglevel);
 
+	query_latency(client, ISC_FALSE);
+
 	ns_client_error(client, result);
 }
 
@@ -315,29 +351,6 @@ query_next(ns_client_t *client, isc_result_t result) {
 	ns_client_next(client, result);
 }
 
-static inline void
-query_freefreeversions(ns_client_t *client, isc_boolean_t everything) {
-	ns_dbversion_t *dbversion, *dbversion_next;
-	unsigned int i;
-
-	for (dbversion = ISC_LIST_HEAD(client->query.freeversions), i = 0;
-	     dbversion != NULL;
-	     dbversion = dbversion_next, i++)
-	{
-		dbversion_next = ISC_LIST_NEXT(dbversion, link);
-		/*
-		 * If we're not freeing everything, we keep the first three
-		 * dbversions structures around.
-		 */
-		if (i > 3 || everything) {
-			ISC_LIST_UNLINK(client->query.freeversions, dbversion,
-					link);
-			isc_mem_put(client->mctx, dbversion,
-				    sizeof(*dbversion));
-		}
-	}
-}
-
 void
 ns_query_cancel(ns_client_t *client) {
 	LOCK(&client->query.fetchlock);
@@ -364,7 +377,6 @@ query_putrdataset(ns_client_t *client, dns_rdataset_t **rdatasetp) {
 
 static inline void
 query_reset(ns_client_t *client, isc_boolean_t everything) {
-	isc_buffer_t *dbuf, *dbuf_next;
 	ns_dbversion_t *dbversion, *dbversion_next;
 
 	CTRACE(ISC_LOG_DEBUG(3), "query_reset");
@@ -388,8 +400,6 @@ query_reset(ns_client_t *client, isc_boolean_t everything) {
 		dns_db_closeversion(dbversion->db, &dbversion->version,
 				    ISC_FALSE);
 		dns_db_detach(&dbversion->db);
-		ISC_LIST_INITANDAPPEND(client->query.freeversions,
-				      dbversion, link);
 	}
 	ISC_LIST_INIT(client->query.activeversions);
 
@@ -402,13 +412,8 @@ query_reset(ns_client_t *client, isc_boolean_t everything) {
 		query_putrdataset(client, &client->query.dns64_aaaa);
 	if (client->query.dns64_sigaaaa != NULL)
 		query_putrdataset(client, &client->query.dns64_sigaaaa);
-	if (client->query.dns64_aaaaok != NULL) {
-		isc_mem_put(client->mctx, client->query.dns64_aaaaok,
-			    client->query.dns64_aaaaoklen *
-			    sizeof(isc_boolean_t));
-		client->query.dns64_aaaaok =  NULL;
-		client->query.dns64_aaaaoklen =  0;
-	}
+	client->query.dns64_aaaaok =  NULL;
+	client->query.dns64_aaaaoklen =  0;
 
 	query_putrdataset(client, &client->query.redirect.rdataset);
 	query_putrdataset(client, &client->query.redirect.sigrdataset);
@@ -421,17 +426,13 @@ query_reset(ns_client_t *client, isc_boolean_t everything) {
 	if (client->query.redirect.zone != NULL)
 		dns_zone_detach(&client->query.redirect.zone);
 
-	query_freefreeversions(client, everything);
-
-	for (dbuf = ISC_LIST_HEAD(client->query.namebufs);
-	     dbuf != NULL;
-	     dbuf = dbuf_next) {
-		dbuf_next = ISC_LIST_NEXT(dbuf, link);
-		if (dbuf_next != NULL || everything) {
-			ISC_LIST_UNLINK(client->query.namebufs, dbuf, link);
-			isc_buffer_free(&dbuf);
-		}
-	}
+	/*
+	 * The version structures, name buffers and DNS64 flags live in
+	 * the client's scratch memory, which is released in one go when
+	 * the request ends.
+	 */
+	ISC_LIST_INIT(client->query.freeversions);
+	ISC_LIST_INIT(client->query.namebufs);
 
 	if (client->query.restarts > 0) {
 		/*
@@ -477,20 +478,19 @@ ns_query_free(ns_client_t *client) {
 static inline isc_result_t
 query_newnamebuf(ns_client_t *client) {
 	isc_buffer_t *dbuf;
-	isc_result_t result;
 
 	CTRACE(ISC_LOG_DEBUG(3), "query_newnamebuf");
 	/*%
 	 * Allocate a name buffer.
 	 */
 
-	dbuf = NULL;
-	result = isc_buffer_allocate(client->mctx, &dbuf, 1024);
-	if (result != ISC_R_SUCCESS) {
+	dbuf = ns_client_arenaget(client, sizeof(*dbuf) + 1024);
+	if (dbuf == NULL) {
 		CTRACE(ISC_LOG_DEBUG(3),
-		       "query_newnamebuf: isc_buffer_allocate failed: done");
-		return (result);
+		       "query_newnamebuf: ns_client_arenaget failed: done");
+		return (ISC_R_NOMEMORY);
 	}
+	isc_buffer_init(dbuf, dbuf + 1, 1024);
 	ISC_LIST_APPEND(client->query.namebufs, dbuf, link);
 
 	CTRACE(ISC_LOG_DEBUG(3), "query_newnamebuf: done");
@@ -628,7 +628,7 @@ query_newdbversion(ns_client_t *client, unsigned int n) {
 	ns_dbversion_t *dbversion;
 
 	for (i = 0; i < n; i++) {
-		dbversion = isc_mem_get(client->mctx, sizeof(*dbversion));
+		dbversion = ns_client_arenaget(client, sizeof(*dbversion));
 		if (dbversion != NULL) {
 			dbversion->db = NULL;
 			dbversion->version = NULL;
@@ -705,18 +705,8 @@ ns_query_init(ns_client_t *client) {
 	client->query.redirect.fname =
 		dns_fixedname_name(&client->query.redirect.fixed);
 	query_reset(client, ISC_FALSE);
-	result = query_newdbversion(client, 3);
-	if (result != ISC_R_SUCCESS) {
-		DESTROYLOCK(&client->query.fetchlock);
-		return (result);
-	}
-	result = query_newnamebuf(client);
-	if (result != ISC_R_SUCCESS) {
-		query_freefreeversions(client, ISC_TRUE);
-		DESTROYLOCK(&client->query.fetchlock);
-	}
 
-	return (result);
+	return (ISC_R_SUCCESS);
 }
 
 static inline ns_dbversion_t *
@@ -941,6 +931,13 @@ query_getzonedb(ns_client_t *client, dns_name_t *name, dns_rdatatype_t qtype,
 	if (result != ISC_R_SUCCESS)
 		goto fail;
 
+	/*
+	 * A response that draws on another database can not be cached
+	 * on the strength of the authoritative database's serial alone.
+	 */
+	if (db != client->query.authdb)
+		client->query.attributes &= ~NS_QUERYATTR_RESPCACHE;
+
 	/* Transfer ownership. */
 	*zonep = zone;
 	*dbp = db;
@@ -978,6 +975,7 @@ rpz_log_rewrite(ns_client_t *client, isc_boolean_t disabled,
 	if (!disabled && policy != DNS_RPZ_POLICY_PASSTHRU) {
 		isc_stats_increment(ns_g_server->nsstats,
 				    dns_nsstatscounter_rpz_rewrites);
+		client->query.attributes |= NS_QUERYATTR_RPZREWRITE;
 	}
 	if (p_zone != NULL) {
 		zonestats = dns_zone_getrequeststats(p_zone);
@@ -1095,6 +1093,8 @@ query_getcachedb(ns_client_t *client, dns_name_t *name, dns_rdatatype_t qtype,
 	 * is not allowed to use the cache.
 	 */
 
+	client->query.attributes &= ~NS_QUERYATTR_RESPCACHE;
+
 	if (!USECACHE(client))
 		return (DNS_R_REFUSED);
 	dns_db_attach(client->view->cachedb, &db);
@@ -1720,72 +1720,21 @@ query_addadditional(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 	return (eresult);
 }
 
-static inline void
-query_discardcache(ns_client_t *client, dns_rdataset_t *rdataset_base,
-		   dns_rdatasetadditional_t additionaltype,
-		   dns_rdatatype_t type, dns_zone_t **zonep, dns_db_t **dbp,
-		   dns_dbversion_t **versionp, dns_dbnode_t **nodep,
-		   dns_name_t *fname)
-{
-	dns_rdataset_t *rdataset;
-
-	while  ((rdataset = ISC_LIST_HEAD(fname->list)) != NULL) {
-		ISC_LIST_UNLINK(fname->list, rdataset, link);
-		query_putrdataset(client, &rdataset);
-	}
-	if (*versionp != NULL)
-		dns_db_closeversion(*dbp, versionp, ISC_FALSE);
-	if (*nodep != NULL)
-		dns_db_detachnode(*dbp, nodep);
-	if (*dbp != NULL)
-		dns_db_detach(dbp);
-	if (*zonep != NULL)
-		dns_zone_detach(zonep);
-	(void)dns_rdataset_putadditional(client->view->acache, rdataset_base,
-					 additionaltype, type);
-}
-
-static inline isc_result_t
-query_iscachevalid(dns_zone_t *zone, dns_db_t *db, dns_db_t *db0,
-		   dns_dbversion_t *version)
-{
-	isc_result_t result = ISC_R_SUCCESS;
-	dns_dbversion_t *version_current = NULL;
-	dns_db_t *db_current = db0;
-
-	if (db_current == NULL) {
-		result = dns_zone_getdb(zone, &db_current);
-		if (result != ISC_R_SUCCESS)
-			return (result);
-	}
-	dns_db_currentversion(db_current, &version_current);
-	if (db_current != db || version_current != version) {
-		result = ISC_R_FAILURE;
-		goto cleanup;
-	}
-
- cleanup:
-	dns_db_closeversion(db_current, &version_current, ISC_FALSE);
-	if (db0 == NULL && db_current != NULL)
-		dns_db_detach(&db_current);
-
-	return (result);
-}
-
 static isc_result_t
 query_addadditional2(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 	client_additionalctx_t *additionalctx = arg;
 	dns_rdataset_t *rdataset_base;
 	ns_client_t *client;
 	isc_result_t result, eresult;
-	dns_dbnode_t *node, *cnode;
-	dns_db_t *db, *cdb;
+	dns_dbnode_t *node;
+	dns_db_t *db;
 	dns_name_t *fname, *mname0, cfname;
 	dns_rdataset_t *rdataset, *sigrdataset;
 	dns_rdataset_t *crdataset, *crdataset_next;
 	isc_buffer_t *dbuf;
 	isc_buffer_t b;
-	dns_dbversion_t *version, *cversion;
+	dns_dbversion_t *version;
+	ns_dbversion_t *dbversion;
 	isc_boolean_t added_something, need_addname, needadditionalcache;
 	isc_boolean_t need_sigrrset;
 	dns_zone_t *zone;
@@ -1794,13 +1743,10 @@ query_addadditional2(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 	dns_clientinfomethods_t cm;
 	dns_clientinfo_t ci;
 
-	/*
-	 * If we don't have an additional cache call query_addadditional.
-	 */
 	client = additionalctx->client;
 	REQUIRE(NS_CLIENT_VALID(client));
 
-	if (qtype != dns_rdatatype_a || client->view->acache == NULL) {
+	if (qtype != dns_rdatatype_a) {
 		/*
 		 * This function is optimized for "address" types.  For other
 		 * types, use a generic routine.
@@ -1809,6 +1755,14 @@ query_addadditional2(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 		return (query_addadditional(additionalctx->client,
 					    name, qtype));
 	}
+#ifdef ALLOW_FILTER_AAAA
+	/*
+	 * The additional cache doesn't know about AAAA filtering.
+	 */
+	if (client->filter_aaaa != dns_aaaa_ok)
+		return (query_addadditional(additionalctx->client,
+					    name, qtype));
+#endif
 
 	/*
 	 * Initialization.
@@ -1819,11 +1773,8 @@ query_addadditional2(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 	rdataset = NULL;
 	sigrdataset = NULL;
 	db = NULL;
-	cdb = NULL;
 	version = NULL;
-	cversion = NULL;
 	node = NULL;
-	cnode = NULL;
 	added_something = ISC_FALSE;
 	need_addname = ISC_FALSE;
 	zone = NULL;
@@ -1858,78 +1809,38 @@ query_addadditional2(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 		goto cleanup;
 	dns_name_setbuffer(&cfname, &b); /* share the buffer */
 
-	/* Check additional cache */
-	result = dns_rdataset_getadditional(rdataset_base, additionaltype,
-					    type, client->view->acache, &zone,
-					    &cdb, &cversion, &cnode, &cfname,
-					    client->message, client->now);
-	if (result != ISC_R_SUCCESS)
-		goto findauthdb;
-	if (zone == NULL) {
-		CTRACE(ISC_LOG_DEBUG(3),
-		       "query_addadditional2: auth zone not found");
-		goto try_cache;
-	}
-
-	/* Is the cached DB up-to-date? */
-	result = query_iscachevalid(zone, cdb, NULL, cversion);
-	if (result != ISC_R_SUCCESS) {
-		CTRACE(ISC_LOG_DEBUG(3),
-		       "query_addadditional2: old auth additional cache");
-		query_discardcache(client, rdataset_base, additionaltype,
-				   type, &zone, &cdb, &cversion, &cnode,
-				   &cfname);
-		goto findauthdb;
-	}
-
-	if (cnode == NULL) {
-		/*
-		 * We have a negative cache.  We don't have to check the zone
-		 * ACL, since the result (not using this zone) would be same
-		 * regardless of the result.
-		 */
-		CTRACE(ISC_LOG_DEBUG(3),
-		       "query_addadditional2: negative auth additional cache");
-		dns_db_closeversion(cdb, &cversion, ISC_FALSE);
-		dns_db_detach(&cdb);
-		dns_zone_detach(&zone);
-		goto try_cache;
-	}
-
-	result = query_validatezonedb(client, name, qtype, DNS_GETDB_NOLOG,
-				      zone, cdb, NULL);
-	if (result != ISC_R_SUCCESS) {
-		query_discardcache(client, rdataset_base, additionaltype,
-				   type, &zone, &cdb, &cversion, &cnode,
-				   &cfname);
-		goto try_cache;
-	}
-
-	/* We've got an active cache. */
-	CTRACE(ISC_LOG_DEBUG(3),
-	       "query_addadditional2: auth additional cache");
-	dns_db_closeversion(cdb, &cversion, ISC_FALSE);
-	db = cdb;
-	node = cnode;
-	dns_name_clone(&cfname, fname);
-	query_keepname(client, fname, dbuf);
-	goto foundcache;
-
 	/*
 	 * Look for a zone database that might contain authoritative
 	 * additional data.
 	 */
- findauthdb:
 	result = query_getzonedb(client, name, qtype, DNS_GETDB_NOLOG,
 				 &zone, &db, &version);
-	if (result != ISC_R_SUCCESS) {
-		/* Cache the negative result */
-		(void)dns_rdataset_setadditional(rdataset_base, additionaltype,
-						 type, client->view->acache,
-						 NULL, NULL, NULL, NULL,
-						 NULL);
+	if (result != ISC_R_SUCCESS)
 		goto try_cache;
-	}
+
+	/*
+	 * Check the additional cache of the zone version we are
+	 * answering from.
+	 */
+	result = dns_rdataset_getadditional(rdataset_base, additionaltype,
+					    db, version, &cfname,
+					    client->message);
+	if (result == ISC_R_SUCCESS) {
+		CTRACE(ISC_LOG_DEBUG(3),
+		       "query_addadditional2: auth additional cache");
+		inc_stats(client, dns_nsstatscounter_addcachehit);
+		dns_name_clone(&cfname, fname);
+		query_keepname(client, fname, dbuf);
+		goto foundcache;
+	} else if (result == DNS_R_NXRRSET) {
+		CTRACE(ISC_LOG_DEBUG(3),
+		       "query_addadditional2: negative auth additional cache");
+		inc_stats(client, dns_nsstatscounter_addcachehit);
+		version = NULL;
+		dns_db_detach(&db);
+		goto try_cache;
+	} else if (result == ISC_R_NOTFOUND)
+		inc_stats(client, dns_nsstatscounter_addcachemiss);
 
 	CTRACE(ISC_LOG_DEBUG(3), "query_addadditional2: db_find");
 
@@ -1948,8 +1859,7 @@ query_addadditional2(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 
 	/* Cache the negative result */
 	(void)dns_rdataset_setadditional(rdataset_base, additionaltype,
-					 type, client->view->acache, zone, db,
-					 version, NULL, fname);
+					 db, version, NULL);
 
 	if (node != NULL)
 		dns_db_detachnode(db, &node);
@@ -2005,45 +1915,32 @@ query_addadditional2(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 	if (!dns_name_issubdomain(name, dns_db_origin(client->query.gluedb)))
 		goto cleanup;
 
+	dns_db_attach(client->query.gluedb, &db);
+	dbversion = query_findversion(client, db);
+	if (dbversion == NULL)
+		goto cleanup;
+	version = dbversion->version;
+
 	/* Check additional cache */
 	additionaltype = dns_rdatasetadditional_fromglue;
 	result = dns_rdataset_getadditional(rdataset_base, additionaltype,
-					    type, client->view->acache, NULL,
-					    &cdb, &cversion, &cnode, &cfname,
-					    client->message, client->now);
-	if (result != ISC_R_SUCCESS)
-		goto findglue;
-
-	result = query_iscachevalid(zone, cdb, client->query.gluedb, cversion);
-	if (result != ISC_R_SUCCESS) {
+					    db, version, &cfname,
+					    client->message);
+	if (result == ISC_R_SUCCESS) {
 		CTRACE(ISC_LOG_DEBUG(3),
-		       "query_addadditional2: old glue additional cache");
-		query_discardcache(client, rdataset_base, additionaltype,
-				   type, &zone, &cdb, &cversion, &cnode,
-				   &cfname);
-		goto findglue;
-	}
-
-	if (cnode == NULL) {
-		/* We have a negative cache. */
+		       "query_addadditional2: glue additional cache");
+		inc_stats(client, dns_nsstatscounter_addcachehit);
+		dns_name_clone(&cfname, fname);
+		query_keepname(client, fname, dbuf);
+		goto foundcache;
+	} else if (result == DNS_R_NXRRSET) {
 		CTRACE(ISC_LOG_DEBUG(3),
 		       "query_addadditional2: negative glue additional cache");
-		dns_db_closeversion(cdb, &cversion, ISC_FALSE);
-		dns_db_detach(&cdb);
+		inc_stats(client, dns_nsstatscounter_addcachehit);
 		goto cleanup;
-	}
+	} else if (result == ISC_R_NOTFOUND)
+		inc_stats(client, dns_nsstatscounter_addcachemiss);
 
-	/* Cache hit. */
-	CTRACE(ISC_LOG_DEBUG(3), "query_addadditional2: glue additional cache");
-	dns_db_closeversion(cdb, &cversion, ISC_FALSE);
-	db = cdb;
-	node = cnode;
-	dns_name_clone(&cfname, fname);
-	query_keepname(client, fname, dbuf);
-	goto foundcache;
-
- findglue:
-	dns_db_attach(client->query.gluedb, &db);
 	result = dns_db_findext(db, name, version, type,
 				client->query.dboptions | DNS_DBFIND_GLUEOK,
 				client->now, &node, fname, &cm, &ci,
@@ -2053,9 +1950,7 @@ query_addadditional2(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 	      result == DNS_R_GLUE)) {
 		/* cache the negative result */
 		(void)dns_rdataset_setadditional(rdataset_base, additionaltype,
-						 type, client->view->acache,
-						 NULL, db, version, NULL,
-						 fname);
+						 db, version, NULL);
 		goto cleanup;
 	}
 
@@ -2164,9 +2059,7 @@ query_addadditional2(void *arg, dns_name_t *name, dns_rdatatype_t qtype) {
 	    (additionaltype == dns_rdatasetadditional_fromauth ||
 	     additionaltype == dns_rdatasetadditional_fromglue)) {
 		(void)dns_rdataset_setadditional(rdataset_base, additionaltype,
-						 type, client->view->acache,
-						 zone, db, version, node,
-						 &cfname);
+						 db, version, &cfname);
 	}
 
  foundcache:
@@ -4003,6 +3896,9 @@ query_recurse(ns_client_t *client, dns_rdatatype_t qtype, dns_name_t *qname,
 
 	if (!resuming)
 		inc_stats(client, dns_nsstatscounter_recursion);
+	client->query.attributes |= NS_QUERYATTR_RECURSED;
+
+	client->query.attributes &= ~NS_QUERYATTR_RESPCACHE;
 
 	/*
 	 * We are about to recurse, which means that this client will
@@ -4191,6 +4087,54 @@ rpz_st_clear(ns_client_t *client) {
 	st->m.policy = DNS_RPZ_POLICY_MISS;
 }
 
+/*%
+ * Count a lookup of the combined policy summary for one trigger type
+ * and the time it took, so the cost of each kind of trigger can be
+ * seen in the statistics.
+ */
+static void
+rpz_lookup_stats(dns_rpz_type_t rpz_type, const isc_time_t *start) {
+	isc_statscounter_t counter;
+	isc_time_t now;
+	isc_uint64_t ns;
+
+	switch (rpz_type) {
+	case DNS_RPZ_TYPE_CLIENT_IP:
+		counter = dns_nsstatscounter_rpzclientiplookups;
+		break;
+	case DNS_RPZ_TYPE_QNAME:
+		counter = dns_nsstatscounter_rpzqnamelookups;
+		break;
+	case DNS_RPZ_TYPE_IP:
+		counter = dns_nsstatscounter_rpziplookups;
+		break;
+	case DNS_RPZ_TYPE_NSDNAME:
+		counter = dns_nsstatscounter_rpznsdnamelookups;
+		break;
+	case DNS_RPZ_TYPE_NSIP:
+		counter = dns_nsstatscounter_rpznsiplookups;
+		break;
+	default:
+		INSIST(0);
+		return;
+	}
+
+	TIME_NOW(&now);
+	if (isc_time_compare(&now, start) <= 0)
+		ns = 0;
+	else
+		ns = (isc_uint64_t)(isc_time_seconds(&now) -
+				    isc_time_seconds(start)) * 1000000000 +
+		     isc_time_nanoseconds(&now) - isc_time_nanoseconds(start);
+
+	/*
+	 * The time counter follows the lookup counter.
+	 */
+	isc_stats_increment(ns_g_server->nsstats, counter);
+	isc_stats_add(ns_g_server->nsstats, counter + 1,
+		      (isc_uint32_t)ISC_MIN(ns, 0xffffffffU));
+}
+
 static dns_rpz_zbits_t
 rpz_get_zbits(ns_client_t *client,
 	      dns_rdatatype_t ip_type, dns_rpz_type_t rpz_type)
@@ -4678,11 +4622,14 @@ rpz_save_p(dns_rpz_st_t *st, dns_rpz_zone_t *rpz, dns_rpz_type_t rpz_type,
 
 /*
  * Check this address in every eligible policy zone.
+ * If 'matchedp' is not NULL, set '*matchedp' if any trigger in the
+ * summary data matched the address.
  */
 static isc_result_t
 rpz_rewrite_ip(ns_client_t *client, const isc_netaddr_t *netaddr,
 	       dns_rdatatype_t qtype, dns_rpz_type_t rpz_type,
-	       dns_rpz_zbits_t zbits, dns_rdataset_t **p_rdatasetp)
+	       dns_rpz_zbits_t zbits, dns_rdataset_t **p_rdatasetp,
+	       isc_boolean_t *matchedp)
 {
 	dns_rpz_zones_t *rpzs;
 	dns_rpz_st_t *st;
@@ -4710,10 +4657,16 @@ rpz_rewrite_ip(ns_client_t *client, const isc_netaddr_t *netaddr,
 	rpzs = client->view->rpzs;
 	st = client->query.rpz_st;
 	while (zbits != 0) {
+		isc_time_t start;
+
+		TIME_NOW(&start);
 		rpz_num = dns_rpz_find_ip(rpzs, rpz_type, zbits, netaddr,
 					  ip_name, &prefix);
+		rpz_lookup_stats(rpz_type, &start);
 		if (rpz_num == DNS_RPZ_INVALID_NUM)
 			break;
+		if (matchedp != NULL)
+			*matchedp = ISC_TRUE;
 		zbits &= (DNS_RPZ_ZMASK(rpz_num) >> 1);
 
 		/*
@@ -4827,18 +4780,42 @@ rpz_rewrite_ip_rrset(ns_client_t *client,
 		     dns_rdataset_t **ip_rdatasetp,
 		     dns_rdataset_t **p_rdatasetp, isc_boolean_t resuming)
 {
+	dns_rpz_st_t *st;
 	dns_rpz_zbits_t zbits;
 	isc_netaddr_t netaddr;
 	struct in_addr ina;
 	struct in6_addr in6a;
+	isc_boolean_t cacheable, matched;
 	isc_result_t result;
 
 	CTRACE(ISC_LOG_DEBUG(3), "rpz_rewrite_ip_rrset");
 
+	st = client->query.rpz_st;
 	zbits = rpz_get_zbits(client, ip_type, rpz_type);
 	if (zbits == 0)
 		return (ISC_R_SUCCESS);
 
+	/*
+	 * Don't look up, or worse recurse for, the addresses of a name
+	 * server that are already known to match no NSIP trigger.  Only
+	 * a search of every zone with such triggers tells us that.  When
+	 * resuming, the recursion result must be consumed regardless.
+	 */
+	cacheable = ISC_FALSE;
+	if (rpz_type == DNS_RPZ_TYPE_NSIP) {
+		if ((st->state & DNS_RPZ_RECURSING) == 0 &&
+		    dns_rpz_find_cleanns(client->view->rpzs, name, ip_type,
+					 st->generation))
+		{
+			isc_stats_increment(ns_g_server->nsstats,
+				dns_nsstatscounter_rpznsipcachehit);
+			return (ISC_R_SUCCESS);
+		}
+		cacheable = ISC_TF(zbits == (ip_type == dns_rdatatype_a
+					     ? st->have.nsipv4
+					     : st->have.nsipv6));
+	}
+
 	/*
 	 * Get the A or AAAA rdataset.
 	 */
@@ -4881,6 +4858,7 @@ rpz_rewrite_ip_rrset(ns_client_t *client,
 	/*
 	 * Check all of the IP addresses in the rdataset.
 	 */
+	matched = ISC_FALSE;
 	for (result = dns_rdataset_first(*ip_rdatasetp);
 	     result == ISC_R_SUCCESS;
 	     result = dns_rdataset_next(*ip_rdatasetp)) {
@@ -4903,11 +4881,14 @@ rpz_rewrite_ip_rrset(ns_client_t *client,
 		}
 
 		result = rpz_rewrite_ip(client, &netaddr, qtype, rpz_type,
-					zbits, p_rdatasetp);
+					zbits, p_rdatasetp, &matched);
 		if (result != ISC_R_SUCCESS)
 			return (result);
 	}
 
+	if (cacheable && !matched)
+		dns_rpz_add_cleanns(client->view->rpzs, name, ip_type,
+				    st->generation, (*ip_rdatasetp)->ttl);
 	return (ISC_R_SUCCESS);
 }
 
@@ -4992,6 +4973,7 @@ rpz_rewrite_name(ns_client_t *client, dns_name_t *trig_name,
 	dns_dbversion_t *p_version;
 	dns_dbnode_t *p_node;
 	dns_rpz_policy_t policy;
+	isc_time_t start;
 	isc_result_t result;
 
 	CTRACE(ISC_LOG_DEBUG(3), "rpz_rewrite_name");
@@ -5009,7 +4991,9 @@ rpz_rewrite_name(ns_client_t *client, dns_name_t *trig_name,
 	 * is only one eligible policy zone so that wildcard triggers
 	 * are matched correctly, and not into their parent.
 	 */
+	TIME_NOW(&start);
 	zbits = dns_rpz_find_name(rpzs, rpz_type, zbits, trig_name);
+	rpz_lookup_stats(rpz_type, &start);
 	if (zbits == 0)
 		return (ISC_R_SUCCESS);
 
@@ -5190,6 +5174,7 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 	dns_rpz_have_t have;
 	dns_rpz_popt_t popt;
 	int rpz_ver;
+	isc_uint32_t generation;
 
 	CTRACE(ISC_LOG_DEBUG(3), "rpz_rewrite");
 
@@ -5211,6 +5196,7 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 	have = rpzs->have;
 	popt = rpzs->p;
 	rpz_ver = rpzs->rpz_ver;
+	generation = rpzs->generation;
 	RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_read);
 
 	if (st == NULL) {
@@ -5236,6 +5222,7 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 		st->have = have;
 		st->popt = popt;
 		st->rpz_ver = rpz_ver;
+		st->generation = generation;
 		client->query.rpz_st = st;
 	}
 
@@ -5317,7 +5304,8 @@ rpz_rewrite(ns_client_t *client, dns_rdatatype_t qtype,
 							&client->peeraddr);
 				result = rpz_rewrite_ip(client, &netaddr, qtype,
 							DNS_RPZ_TYPE_CLIENT_IP,
-							zbits, &rdataset);
+							zbits, &rdataset,
+							NULL);
 				if (result != ISC_R_SUCCESS)
 					goto cleanup;
 			}
@@ -6157,7 +6145,7 @@ dns64_aaaaok(ns_client_t *client, dns_rdataset_t *rdataset,
 		flags |= DNS_DNS64_DNSSEC;
 
 	count = dns_rdataset_count(rdataset);
-	aaaaok = isc_mem_get(client->mctx, sizeof(isc_boolean_t) * count);
+	aaaaok = ns_client_arenaget(client, sizeof(isc_boolean_t) * count);
 
 	isc_netaddr_fromsockaddr(&netaddr, &client->peeraddr);
 	if (dns_dns64_aaaaok(dns64, &netaddr, client->signer,
@@ -6165,19 +6153,13 @@ dns64_aaaaok(ns_client_t *client, dns_rdataset_t *rdataset,
 			     aaaaok, count)) {
 		for (i = 0; i < count; i++) {
 			if (aaaaok != NULL && !aaaaok[i]) {
-				SAVE(client->query.dns64_aaaaok, aaaaok);
+				client->query.dns64_aaaaok = aaaaok;
 				client->query.dns64_aaaaoklen = count;
 				break;
 			}
 		}
-		if (aaaaok != NULL)
-			isc_mem_put(client->mctx, aaaaok,
-				    sizeof(isc_boolean_t) * count);
 		return (ISC_TRUE);
 	}
-	if (aaaaok != NULL)
-		isc_mem_put(client->mctx, aaaaok,
-			    sizeof(isc_boolean_t) * count);
 	return (ISC_FALSE);
 }
 
@@ -6467,6 +6449,103 @@ redirect2(ns_client_t *client, dns_name_t *name, dns_rdataset_t *rdataset,
 	return (result);
 }
 
+/*%
+ * Client attributes that change the rendered response.
+ */
+#define RESPCACHE_ATTRS	(NS_CLIENTATTR_TCP | NS_CLIENTATTR_RA | \
+			 NS_CLIENTATTR_WANTDNSSEC | NS_CLIENTATTR_WANTNSID | \
+			 NS_CLIENTATTR_WANTAD | NS_CLIENTATTR_WANTOPT | \
+			 NS_CLIENTATTR_USEKEEPALIVE)
+
+/*%
+ * Client attributes that make the response unique to the client.
+ */
+#define RESPCACHE_NOATTRS (NS_CLIENTATTR_MULTICAST | \
+			   NS_CLIENTATTR_WANTCOOKIE | \
+			   NS_CLIENTATTR_HAVECOOKIE | \
+			   NS_CLIENTATTR_WANTEXPIRE | \
+			   NS_CLIENTATTR_HAVEECS)
+
+/*
+ * Build the response cache key for the current query of 'client'.
+ * Returns ISC_FALSE if the response to this query must not come from
+ * or go into the response cache, because it may depend on something
+ * other than the query and the zone contents: who is asking, how the
+ * query is signed, or view features that rewrite or reorder answers.
+ */
+static isc_boolean_t
+respcache_setkey(ns_client_t *client, dns_rdatatype_t qtype) {
+	dns_view_t *view = client->view;
+	dns_message_t *message = client->message;
+	isc_buffer_t b;
+	isc_region_t r;
+
+	if (view->respcache == NULL)
+		return (ISC_FALSE);
+	if (view->rrl != NULL || view->rpzs != NULL ||
+	    view->sortlist != NULL || view->nocasecompress != NULL ||
+	    !ISC_LIST_EMPTY(view->dns64) ||
+	    view->redirect != NULL || view->redirectzone != NULL)
+		return (ISC_FALSE);
+#ifdef ALLOW_FILTER_AAAA
+	if (view->v4_aaaa != dns_aaaa_ok || view->v6_aaaa != dns_aaaa_ok)
+		return (ISC_FALSE);
+#endif
+	if ((client->attributes & RESPCACHE_NOATTRS) != 0 ||
+	    message->tsigkey != NULL || message->sig0 != NULL)
+		return (ISC_FALSE);
+
+	isc_buffer_init(&b, client->query.respcache.key,
+			sizeof(client->query.respcache.key));
+	isc_buffer_putuint32(&b, client->attributes & RESPCACHE_ATTRS);
+	isc_buffer_putuint16(&b, message->flags &
+			     (DNS_MESSAGEFLAG_RD | DNS_MESSAGEFLAG_CD));
+	isc_buffer_putuint16(&b, client->extflags &
+			     DNS_MESSAGEEXTFLAG_REPLYPRESERVE);
+	isc_buffer_putuint16(&b, TCP(client) ? 0 : client->udpsize);
+	isc_buffer_putuint16(&b, qtype);
+	isc_buffer_putuint16(&b, message->rdclass);
+	/*
+	 * The name is compared as is, as its case is echoed back.
+	 */
+	dns_name_toregion(client->query.qname, &r);
+	isc_buffer_copyregion(&b, &r);
+	client->query.respcache.keylen = isc_buffer_usedlength(&b);
+	return (ISC_TRUE);
+}
+
+/*
+ * Look for a cached response to the current query of 'client' that
+ * was rendered from 'version' of 'db'.  If there isn't one, arrange
+ * for the response that is about to be built to be cached.
+ */
+static isc_result_t
+respcache_find(ns_client_t *client, dns_db_t *db, dns_dbversion_t *version,
+	       isc_buffer_t *target, unsigned int *infop)
+{
+	isc_result_t result;
+	isc_region_t key;
+	isc_uint32_t serial;
+
+	result = dns_db_getsoaserial(db, version, &serial);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	key.base = client->query.respcache.key;
+	key.length = client->query.respcache.keylen;
+	result = dns_respcache_find(client->view->respcache, &key, db,
+				    serial, target, infop);
+	if (result == ISC_R_SUCCESS) {
+		inc_stats(client, dns_nsstatscounter_respcachehit);
+		return (result);
+	}
+
+	inc_stats(client, dns_nsstatscounter_respcachemiss);
+	client->query.respcache.serial = serial;
+	client->query.attributes |= NS_QUERYATTR_RESPCACHE;
+	return (result);
+}
+
 /*
  * Do the bulk of query processing for the current query of 'client'.
  * If 'event' is non-NULL, we are returning from recursion and 'qtype'
@@ -6515,6 +6594,10 @@ query_find(ns_client_t *client, dns_fetchevent_t *event, dns_rdatatype_t qtype)
 	dns_section_t section;
 	dns_ttl_t ttl;
 	isc_boolean_t failcache;
+	isc_boolean_t respcached = ISC_FALSE;
+	unsigned char *wire = NULL;
+	isc_buffer_t wireb;
+	unsigned int wireinfo = 0;
 	isc_uint32_t flags;
 #ifdef WANT_QUERYTRACE
 	char mbuf[BUFSIZ];
@@ -6928,6 +7011,24 @@ query_find(ns_client_t *client, dns_fetchevent_t *event, dns_rdatatype_t qtype)
 			inc_stats(client, dns_nsstatscounter_tcp);
 		else
 			inc_stats(client, dns_nsstatscounter_udp);
+
+		/*
+		 * Answer from the response cache if we can.  The response
+		 * is sent once everything here has been cleaned up.
+		 */
+		if (is_zone && zone != NULL &&
+		    respcache_setkey(client, qtype) &&
+		    (wire = ns_client_arenaget(client,
+					       DNS_RESPCACHE_MAXWIRE)) != NULL)
+		{
+			isc_buffer_init(&wireb, wire, DNS_RESPCACHE_MAXWIRE);
+			result = respcache_find(client, db, version, &wireb,
+						&wireinfo);
+			if (result == ISC_R_SUCCESS) {
+				respcached = ISC_TRUE;
+				goto cleanup;
+			}
+		}
 	}
 
  db_find:
@@ -8885,6 +8986,18 @@ query_find(ns_client_t *client, dns_fetchevent_t *event, dns_rdatatype_t qtype)
 			query_error(client, eresult, line);
 		}
 		ns_client_detach(&client);
+	} else if (respcached) {
+		isc_region_t r;
+
+		query_latency(client, ISC_TF((wire[2] & 0x04) != 0));
+		if ((wire[2] & 0x04) != 0)		/* AA */
+			inc_stats(client, dns_nsstatscounter_authans);
+		else
+			inc_stats(client, dns_nsstatscounter_nonauthans);
+		inc_stats(client, wireinfo);
+		isc_buffer_usedregion(&wireb, &r);
+		ns_client_sendwire(client, &r);
+		ns_client_detach(&client);
 	} else if (!RECURSING(client)) {
 		/*
 		 * We are done.  Set up sortlist data for the message
@@ -8918,6 +9031,12 @@ query_find(ns_client_t *client, dns_fetchevent_t *event, dns_rdatatype_t qtype)
 		     client->message->rcode != dns_rcode_noerror))
 			eresult = ISC_R_FAILURE;
 
+		/*
+		 * Don't cache a partial answer.
+		 */
+		if (eresult != ISC_R_SUCCESS)
+			client->query.attributes &= ~NS_QUERYATTR_RESPCACHE;
+
 		query_send(client);
 		ns_client_detach(&client);
 	}
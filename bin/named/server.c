@@ -26,9 +26,11 @@
 #include <isc/file.h>
 #include <isc/hash.h>
 #include <isc/hex.h>
+#include <isc/histo.h>
 #include <isc/hmacsha.h>
 #include <isc/httpd.h>
 #include <isc/lex.h>
+#include <isc/lockprof.h>
 #include <isc/meminfo.h>
 #include <isc/parseint.h>
 #include <isc/portset.h>
@@ -52,11 +54,11 @@
 
 #include <bind9/check.h>
 
-#include <dns/acache.h>
 #include <dns/adb.h>
 #include <dns/badcache.h>
 #include <dns/cache.h>
 #include <dns/catz.h>
+#include <dns/cryptopool.h>
 #include <dns/db.h>
 #include <dns/dispatch.h>
 #include <dns/dlz.h>
@@ -82,6 +84,7 @@
 #include <dns/rdataset.h>
 #include <dns/rdatastruct.h>
 #include <dns/resolver.h>
+#include <dns/respcache.h>
 #include <dns/rootns.h>
 #include <dns/rriterator.h>
 #include <dns/secalg.h>
@@ -2418,8 +2421,6 @@ configure_catz_zone(dns_view_t *view, const cfg_obj_t *config,
 			RUNTIME_CHECK(tresult == ISC_R_SUCCESS);
 
 			dns_zone_setview(dnszone, view);
-			if (view->acache != NULL)
-				dns_zone_setacache(dnszone, view->acache);
 			dns_view_addzone(view, dnszone);
 		}
 
@@ -3008,9 +3009,9 @@ configure_dnstap(const cfg_obj_t **maps, dns_view_t *view) {
 		dpath = cfg_obj_asstring(obj2);
 
 		fopt = fstrm_iothr_options_init();
-		fstrm_iothr_options_set_num_input_queues(fopt, ns_g_cpus);
+		fstrm_iothr_options_set_num_input_queues(fopt, 1);
 		fstrm_iothr_options_set_queue_model(fopt,
-						 FSTRM_IOTHR_QUEUE_MODEL_MPSC);
+						 FSTRM_IOTHR_QUEUE_MODEL_SPSC);
 
 		obj = NULL;
 		result = ns_config_get(maps, "fstrm-set-buffer-hint", &obj);
@@ -3174,7 +3175,6 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	unsigned int cleaning_interval;
 	size_t max_cache_size;
 	isc_uint32_t max_cache_size_percent = 0;
-	size_t max_acache_size;
 	size_t max_adb_size;
 	isc_uint32_t lame_ttl, fail_ttl;
 	dns_tsig_keyring_t *ring = NULL;
@@ -3187,6 +3187,7 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	int i = 0, j = 0, k = 0;
 	const char *str;
 	const char *cachename = NULL;
+	const char *cachefile = NULL;
 	dns_order_t *order = NULL;
 	isc_uint32_t udpsize;
 	isc_uint32_t maxbits;
@@ -3241,53 +3242,6 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	CHECKM(ns_config_getport(config, &port), "port");
 	dns_view_setdstport(view, port);
 
-	/*
-	 * Create additional cache for this view and zones under the view
-	 * if explicitly enabled.
-	 * XXX950 default to on.
-	 */
-	obj = NULL;
-	(void)ns_config_get(maps, "acache-enable", &obj);
-	if (obj != NULL && cfg_obj_asboolean(obj)) {
-		cmctx = NULL;
-		CHECK(isc_mem_create(0, 0, &cmctx));
-		CHECK(dns_acache_create(&view->acache, cmctx, ns_g_taskmgr,
-					ns_g_timermgr));
-		isc_mem_setname(cmctx, "acache", NULL);
-		isc_mem_detach(&cmctx);
-	}
-	if (view->acache != NULL) {
-		obj = NULL;
-		result = ns_config_get(maps, "acache-cleaning-interval", &obj);
-		INSIST(result == ISC_R_SUCCESS);
-		dns_acache_setcleaninginterval(view->acache,
-					       cfg_obj_asuint32(obj) * 60);
-
-		obj = NULL;
-		result = ns_config_get(maps, "max-acache-size", &obj);
-		INSIST(result == ISC_R_SUCCESS);
-		if (cfg_obj_isstring(obj)) {
-			str = cfg_obj_asstring(obj);
-			INSIST(strcasecmp(str, "unlimited") == 0);
-			max_acache_size = 0;
-		} else {
-			isc_resourcevalue_t value;
-			value = cfg_obj_asuint64(obj);
-			if (value > SIZE_MAX) {
-				cfg_obj_log(obj, ns_g_lctx,
-					    ISC_LOG_WARNING,
-					    "'max-acache-size "
-					    "%" ISC_PRINT_QUADFORMAT "u' "
-					    "is too large for this "
-					    "system; reducing to %lu",
-					    value, (unsigned long)SIZE_MAX);
-				value = SIZE_MAX;
-			}
-			max_acache_size = (size_t) value;
-		}
-		dns_acache_setcachesize(view->acache, max_acache_size);
-	}
-
 	CHECK(configure_view_acl(vconfig, config, "allow-query", NULL, actx,
 				 ns_g_mctx, &view->queryacl));
 	if (view->queryacl == NULL) {
@@ -3774,9 +3728,24 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	obj = NULL;
 	result = ns_config_get(maps, "cache-file", &obj);
 	if (result == ISC_R_SUCCESS && strcmp(view->name, "_bind") != 0) {
-		CHECK(dns_cache_setfilename(cache, cfg_obj_asstring(obj)));
-		if (!reused_cache && !shared_cache)
-			CHECK(dns_cache_load(cache));
+		cachefile = cfg_obj_asstring(obj);
+		CHECK(dns_cache_setfilename(cache, cachefile));
+		if (!reused_cache && !shared_cache) {
+			/*
+			 * A missing or unusable snapshot only means that
+			 * we start with a cold cache.
+			 */
+			result = dns_cache_load(cache);
+			if (result != ISC_R_SUCCESS &&
+			    result != ISC_R_FILENOTFOUND)
+				isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+					      NS_LOGMODULE_SERVER,
+					      ISC_LOG_WARNING,
+					      "view %s: loading cache file "
+					      "'%s' failed: %s", view->name,
+					      cachefile,
+					      isc_result_totext(result));
+		}
 	}
 
 	dns_cache_setcleaninginterval(cache, cleaning_interval);
@@ -3804,10 +3773,13 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	}
 
 	if (resstats == NULL) {
-		CHECK(isc_stats_create(mctx, &resstats,
-				       dns_resstatscounter_max));
+		CHECK(isc_stats_create2(mctx, &resstats,
+					dns_resstatscounter_max,
+					ISC_STATS_SHARDED));
 	}
 	dns_view_setresstats(view, resstats);
+	if (ns_g_server->cryptopool != NULL)
+		dns_view_setcryptopool(view, ns_g_server->cryptopool);
 	if (resquerystats == NULL)
 		CHECK(dns_rdatatypestats_create(mctx, &resquerystats));
 	dns_view_setresquerystats(view, resquerystats);
@@ -3848,6 +3820,29 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	}
 	dns_adb_setadbsize(view->adb, max_adb_size);
 
+	/*
+	 * Preserve the server RTT estimates alongside the cache snapshot.
+	 */
+	if (cachefile != NULL) {
+		char adbfile[PATH_MAX];
+
+		CHECK(isc_string_printf(adbfile, sizeof(adbfile),
+					"%s.adb", cachefile));
+		CHECK(dns_adb_setstatefile(view->adb, adbfile));
+		if (!reused_cache) {
+			result = dns_adb_loadstate(view->adb);
+			if (result != ISC_R_SUCCESS &&
+			    result != ISC_R_FILENOTFOUND)
+				isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+					      NS_LOGMODULE_SERVER,
+					      ISC_LOG_WARNING,
+					      "view %s: loading address "
+					      "database state '%s' failed: %s",
+					      view->name, adbfile,
+					      isc_result_totext(result));
+		}
+	}
+
 	/*
 	 * Set up ADB quotas
 	 */
@@ -4780,6 +4775,18 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 		fail_ttl = 30;
 	dns_view_setfailttl(view, fail_ttl);
 
+	/*
+	 * Cache of rendered authoritative responses.
+	 */
+	obj = NULL;
+	result = ns_config_get(maps, "response-cache-size", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	if (view->respcache != NULL)
+		dns_respcache_destroy(&view->respcache);
+	if (cfg_obj_asuint32(obj) != 0)
+		CHECK(dns_respcache_create(mctx, cfg_obj_asuint32(obj),
+					   &view->respcache));
+
 	/*
 	 * Name space to look up redirect information in.
 	 */
@@ -5466,8 +5473,6 @@ configure_zone(const cfg_obj_t *config, const cfg_obj_t *zconfig,
 		 * new view.
 		 */
 		dns_zone_setview(zone, view);
-		if (view->acache != NULL)
-			dns_zone_setacache(zone, view->acache);
 	} else {
 		/*
 		 * We cannot reuse an existing zone, we have
@@ -5476,8 +5481,6 @@ configure_zone(const cfg_obj_t *config, const cfg_obj_t *zconfig,
 		CHECK(dns_zonemgr_createzone(ns_g_server->zonemgr, &zone));
 		CHECK(dns_zone_setorigin(zone, origin));
 		dns_zone_setview(zone, view);
-		if (view->acache != NULL)
-			dns_zone_setacache(zone, view->acache);
 		CHECK(dns_zonemgr_managezone(ns_g_server->zonemgr, zone));
 		dns_zone_setstats(zone, ns_g_server->zonestats);
 	}
@@ -5536,8 +5539,6 @@ configure_zone(const cfg_obj_t *config, const cfg_obj_t *zconfig,
 			CHECK(dns_zone_create(&raw, mctx));
 			CHECK(dns_zone_setorigin(raw, origin));
 			dns_zone_setview(raw, view);
-			if (view->acache != NULL)
-				dns_zone_setacache(raw, view->acache);
 			dns_zone_setstats(raw, ns_g_server->zonestats);
 			CHECK(dns_zone_link(zone, raw));
 		}
@@ -5634,8 +5635,6 @@ add_keydata_zone(dns_view_t *view, const char *directory, isc_mem_t *mctx) {
 
 	CHECK(dns_zonemgr_managezone(ns_g_server->zonemgr, zone));
 
-	if (view->acache != NULL)
-		dns_zone_setacache(zone, view->acache);
 
 	CHECK(dns_acl_none(mctx, &none));
 	dns_zone_setqueryacl(zone, none);
@@ -5683,6 +5682,28 @@ configure_server_quota(const cfg_obj_t **maps, const char *name,
 	isc_quota_max(quota, cfg_obj_asuint32(obj));
 }
 
+/*
+ * Read a TCP timeout, in units of 100 milliseconds, limiting it to
+ * the range named.conf is checked against.
+ */
+static unsigned int
+configure_tcp_timeout(const cfg_obj_t **maps, const char *name,
+		      unsigned int min, unsigned int max)
+{
+	const cfg_obj_t *obj = NULL;
+	isc_result_t result;
+	isc_uint32_t timeout;
+
+	result = ns_config_get(maps, name, &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	timeout = cfg_obj_asuint32(obj);
+	if (timeout < min)
+		timeout = min;
+	if (timeout > max)
+		timeout = max;
+	return (timeout);
+}
+
 /*
  * This function is called as soon as the 'directory' statement has been
  * parsed.  This can be extended to support other options if necessary.
@@ -7238,6 +7259,18 @@ load_configuration(const char *filename, ns_server_t *server,
 
 	isc_quota_soft(&server->recursionquota, softquota);
 
+	/*
+	 * TCP timeouts, in units of 100 milliseconds.
+	 */
+	server->tcpinitialtimo =
+		configure_tcp_timeout(maps, "tcp-initial-timeout", 25, 1200);
+	server->tcpidletimo =
+		configure_tcp_timeout(maps, "tcp-idle-timeout", 1, 1200);
+	server->tcpkeepalivetimo =
+		configure_tcp_timeout(maps, "tcp-keepalive-timeout", 1, 65535);
+	server->tcpadvertisedtimo =
+		configure_tcp_timeout(maps, "tcp-advertised-timeout", 0, 65535);
+
 	CHECK(configure_view_acl(NULL, config, "blackhole", NULL,
 				 ns_g_aclconfctx, ns_g_mctx,
 				 &server->blackholeacl));
@@ -8380,6 +8413,7 @@ void
 ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 	isc_result_t result;
 	ns_server_t *server = isc_mem_get(mctx, sizeof(*server));
+	unsigned int i;
 
 	if (server == NULL)
 		fatal("allocating server object", ISC_R_NOMEMORY);
@@ -8392,6 +8426,10 @@ ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 	RUNTIME_CHECK(result == ISC_R_SUCCESS);
 	result = isc_quota_init(&server->tcpquota, 10);
 	RUNTIME_CHECK(result == ISC_R_SUCCESS);
+	server->tcpinitialtimo = 300;
+	server->tcpidletimo = 300;
+	server->tcpkeepalivetimo = 300;
+	server->tcpadvertisedtimo = 300;
 	result = isc_quota_init(&server->recursionquota, 100);
 	RUNTIME_CHECK(result == ISC_R_SUCCESS);
 
@@ -8484,11 +8522,31 @@ ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 	server->tcpoutstats4 = NULL;
 	server->tcpinstats6 = NULL;
 	server->tcpoutstats6 = NULL;
+	for (i = 0; i < ns_latency_max; i++)
+		server->querylatency[i] = NULL;
 	CHECKFATAL(isc_stats_create(server->mctx, &server->sockstats,
 				    isc_sockstatscounter_max),
 		   "isc_stats_create");
 	isc_socketmgr_setstats(ns_g_socketmgr, server->sockstats);
 
+	/*
+	 * Validators hand signature verifications, and zones being
+	 * signed their signings, to a pool of worker threads of their
+	 * own, so that a burst of them does not hold up the tasks they
+	 * were running on.  Without threads they work inline.
+	 */
+	server->cryptopool = NULL;
+	result = dns_cryptopool_create(server->mctx, ns_g_cpus,
+				       &server->cryptopool);
+	if (result == ISC_R_SUCCESS)
+		dns_zonemgr_setcryptopool(server->zonemgr,
+					  server->cryptopool);
+	else if (result != ISC_R_NOTIMPLEMENTED)
+		isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+			      NS_LOGMODULE_SERVER, ISC_LOG_WARNING,
+			      "unable to create crypto worker pool: %s",
+			      isc_result_totext(result));
+
 	server->bindkeysfile = isc_mem_strdup(server->mctx, "bind.keys");
 	CHECKFATAL(server->bindkeysfile == NULL ? ISC_R_NOMEMORY :
 						  ISC_R_SUCCESS,
@@ -8514,8 +8572,9 @@ ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 	server->server_usehostname = ISC_FALSE;
 	server->server_id = NULL;
 
-	CHECKFATAL(isc_stats_create(ns_g_mctx, &server->nsstats,
-				    dns_nsstatscounter_max),
+	CHECKFATAL(isc_stats_create2(ns_g_mctx, &server->nsstats,
+				     dns_nsstatscounter_max,
+				     ISC_STATS_SHARDED),
 		   "dns_stats_create (server)");
 
 	CHECKFATAL(dns_rdatatypestats_create(ns_g_mctx,
@@ -8532,8 +8591,9 @@ ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 				    dns_zonestatscounter_max),
 		   "dns_stats_create (zone)");
 
-	CHECKFATAL(isc_stats_create(ns_g_mctx, &server->resolverstats,
-				    dns_resstatscounter_max),
+	CHECKFATAL(isc_stats_create2(ns_g_mctx, &server->resolverstats,
+				     dns_resstatscounter_max,
+				     ISC_STATS_SHARDED),
 		   "dns_stats_create (resolver)");
 
 	CHECKFATAL(isc_stats_create(ns_g_mctx, &server->udpinstats4,
@@ -8568,6 +8628,11 @@ ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 				    dns_sizecounter_out_max),
 		   "dns_stats_create (outbound TCP IPv6 traffic size)");
 
+	for (i = 0; i < ns_latency_max; i++)
+		CHECKFATAL(isc_histo_create(ns_g_mctx, ISC_HISTO_SHARDED,
+					    &server->querylatency[i]),
+			   "isc_histo_create (query latency)");
+
 	server->flushonshutdown = ISC_FALSE;
 	server->log_queries = ISC_FALSE;
 
@@ -8598,6 +8663,8 @@ ns_server_create(isc_mem_t *mctx, ns_server_t **serverp) {
 void
 ns_server_destroy(ns_server_t **serverp) {
 	ns_server_t *server = *serverp;
+	unsigned int i;
+
 	REQUIRE(NS_SERVER_VALID(server));
 
 #ifdef HAVE_DNSTAP
@@ -8614,6 +8681,8 @@ ns_server_destroy(ns_server_t **serverp) {
 	isc_stats_detach(&server->zonestats);
 	isc_stats_detach(&server->resolverstats);
 	isc_stats_detach(&server->sockstats);
+	if (server->cryptopool != NULL)
+		dns_cryptopool_detach(&server->cryptopool);
 	isc_stats_detach(&server->udpinstats4);
 	isc_stats_detach(&server->udpoutstats4);
 	isc_stats_detach(&server->udpinstats6);
@@ -8622,6 +8691,8 @@ ns_server_destroy(ns_server_t **serverp) {
 	isc_stats_detach(&server->tcpoutstats4);
 	isc_stats_detach(&server->tcpinstats6);
 	isc_stats_detach(&server->tcpoutstats6);
+	for (i = 0; i < ns_latency_max; i++)
+		isc_histo_detach(&server->querylatency[i]);
 
 	isc_mem_free(server->mctx, server->statsfile);
 	isc_mem_free(server->mctx, server->bindkeysfile);
@@ -10052,6 +10123,89 @@ ns_server_flushcache(ns_server_t *server, isc_lex_t *lex) {
 	return (result);
 }
 
+isc_result_t
+ns_server_savecache(ns_server_t *server, isc_lex_t *lex) {
+	char *ptr;
+	dns_view_t *view;
+	ns_cache_t *nsc;
+	isc_boolean_t found = ISC_FALSE;
+	isc_result_t result, tresult = ISC_R_SUCCESS;
+
+	/* Skip the command name. */
+	ptr = next_token(lex, NULL);
+	if (ptr == NULL)
+		return (ISC_R_UNEXPECTEDEND);
+
+	/* Look for the view name. */
+	ptr = next_token(lex, NULL);
+
+	/*
+	 * Write each cache once, through the view that owns it, and the
+	 * address database state of every selected view.  Caches and
+	 * views without a "cache-file" are silently skipped.
+	 */
+	for (view = ISC_LIST_HEAD(server->viewlist);
+	     view != NULL;
+	     view = ISC_LIST_NEXT(view, link))
+	{
+		if (ptr != NULL && strcasecmp(ptr, view->name) != 0)
+			continue;
+		found = ISC_TRUE;
+
+		for (nsc = ISC_LIST_HEAD(server->cachelist);
+		     nsc != NULL;
+		     nsc = ISC_LIST_NEXT(nsc, link))
+		{
+			if (nsc->cache == view->cache)
+				break;
+		}
+		if (nsc != NULL &&
+		    (nsc->primaryview == view || ptr != NULL))
+		{
+			result = dns_cache_dump(view->cache);
+			if (result != ISC_R_SUCCESS) {
+				isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+					      NS_LOGMODULE_SERVER,
+					      ISC_LOG_ERROR,
+					      "saving cache in view '%s' "
+					      "failed: %s", view->name,
+					      isc_result_totext(result));
+				tresult = result;
+			}
+		}
+
+		if (view->adb != NULL) {
+			result = dns_adb_savestate(view->adb);
+			if (result != ISC_R_SUCCESS) {
+				isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+					      NS_LOGMODULE_SERVER,
+					      ISC_LOG_ERROR,
+					      "saving address database state "
+					      "in view '%s' failed: %s",
+					      view->name,
+					      isc_result_totext(result));
+				tresult = result;
+			}
+		}
+	}
+
+	if (!found) {
+		isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+			      NS_LOGMODULE_SERVER, ISC_LOG_ERROR,
+			      "saving cache in view '%s' failed: "
+			      "view not found", ptr);
+		return (ISC_R_NOTFOUND);
+	}
+
+	if (tresult == ISC_R_SUCCESS)
+		isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+			      NS_LOGMODULE_SERVER, ISC_LOG_INFO,
+			      "saving cache%s%s succeeded",
+			      ptr != NULL ? " in view " : "s",
+			      ptr != NULL ? ptr : "");
+	return (tresult);
+}
+
 isc_result_t
 ns_server_flushnode(ns_server_t *server, isc_lex_t *lex, isc_boolean_t tree) {
 	char *ptr, *viewname;
@@ -10250,6 +10404,11 @@ ns_server_status(ns_server_t *server, isc_buffer_t **text) {
 		     server->tcpquota.used, server->tcpquota.max);
 	CHECK(putstr(text, line));
 
+	snprintf(line, sizeof(line),
+		 "log messages dropped: %" ISC_PRINT_QUADFORMAT "u\n",
+		 isc_log_getdropped(ns_g_lctx));
+	CHECK(putstr(text, line));
+
 	CHECK(putstr(text, "server is up and running"));
 	CHECK(putnull(text));
 
@@ -13420,3 +13579,166 @@ ns_server_dnstap(ns_server_t *server, isc_lex_t *lex, isc_buffer_t **text) {
 	return (ISC_R_NOTIMPLEMENTED);
 #endif
 }
+
+typedef struct {
+	isc_buffer_t		**text;
+	isc_result_t		result;
+} profiletext_t;
+
+static void
+taskprofile_line(const char *key, isc_uint64_t events, isc_uint64_t runtime,
+		 isc_uint64_t waittime, void *arg)
+{
+	profiletext_t *pt = arg;
+	char line[128];
+
+	if (pt->result != ISC_R_SUCCESS)
+		return;
+
+	snprintf(line, sizeof(line),
+		 "%-20s %12" ISC_PRINT_QUADFORMAT "u %14"
+		 ISC_PRINT_QUADFORMAT "u %14" ISC_PRINT_QUADFORMAT "u\n",
+		 key[0] != '\0' ? key : "(unnamed)", events, runtime,
+		 waittime);
+	pt->result = putstr(pt->text, line);
+}
+
+isc_result_t
+ns_server_taskprofile(ns_server_t *server, isc_lex_t *lex,
+		      isc_buffer_t **text)
+{
+	profiletext_t pt;
+	isc_result_t result;
+	char *ptr;
+
+	UNUSED(server);
+
+	/* Skip the command name. */
+	ptr = next_token(lex, text);
+	if (ptr == NULL)
+		return (ISC_R_UNEXPECTEDEND);
+
+	ptr = next_token(lex, text);
+	if (ptr != NULL) {
+		if (strcasecmp(ptr, "on") == 0)
+			isc_taskmgr_setprofiling(ns_g_taskmgr, ISC_TRUE);
+		else if (strcasecmp(ptr, "off") == 0)
+			isc_taskmgr_setprofiling(ns_g_taskmgr, ISC_FALSE);
+		else if (strcasecmp(ptr, "reset") == 0)
+			isc_taskmgr_resetprofile(ns_g_taskmgr);
+		else
+			return (DNS_R_SYNTAX);
+		isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+			      NS_LOGMODULE_SERVER, ISC_LOG_INFO,
+			      "task profiling %s", ptr);
+		return (ISC_R_SUCCESS);
+	}
+
+	pt.text = text;
+	pt.result = ISC_R_SUCCESS;
+
+	CHECK(putstr(text, isc_taskmgr_profiling(ns_g_taskmgr)
+				? "task profiling is on\n"
+				: "task profiling is off\n"));
+	CHECK(putstr(text, "\ntask                       events   "
+			   "run time (us) queue time (us)\n"));
+	CHECK(isc_taskmgr_profile(ns_g_taskmgr, isc_taskprofile_name,
+				  taskprofile_line, &pt));
+	CHECK(pt.result);
+	CHECK(putstr(text, "\nevent type                 events   "
+			   "run time (us) queue time (us)\n"));
+	CHECK(isc_taskmgr_profile(ns_g_taskmgr, isc_taskprofile_eventtype,
+				  taskprofile_line, &pt));
+	CHECK(pt.result);
+	result = putnull(text);
+
+ cleanup:
+	return (result);
+}
+
+static void
+lockprofile_line(const isc_lockprofsite_t *site, void *arg) {
+	profiletext_t *pt = arg;
+	static const char *types[] = { "mutex", "read", "write" };
+	char line[256];
+
+	if (pt->result != ISC_R_SUCCESS)
+		return;
+
+	snprintf(line, sizeof(line),
+		 "%s:%u %s: %" ISC_PRINT_QUADFORMAT "u acquired, %"
+		 ISC_PRINT_QUADFORMAT "u contended, waited %"
+		 ISC_PRINT_QUADFORMAT "u us (max %"
+		 ISC_PRINT_QUADFORMAT "u us)\n",
+		 site->file, site->line, types[site->type], site->acquired,
+		 site->contended, site->waittime, site->maxwait);
+	pt->result = putstr(pt->text, line);
+}
+
+isc_result_t
+ns_server_lockprofile(ns_server_t *server, isc_lex_t *lex,
+		      isc_buffer_t **text)
+{
+	profiletext_t pt;
+	isc_result_t result;
+	unsigned int rate = 100;
+	char line[80];
+	char *ptr;
+
+	UNUSED(server);
+
+	/* Skip the command name. */
+	ptr = next_token(lex, text);
+	if (ptr == NULL)
+		return (ISC_R_UNEXPECTEDEND);
+
+	ptr = next_token(lex, text);
+	if (ptr != NULL) {
+		if (strcasecmp(ptr, "on") == 0) {
+			ptr = next_token(lex, text);
+			if (ptr != NULL) {
+				result = isc_parse_uint32(&rate, ptr, 10);
+				if (result != ISC_R_SUCCESS || rate == 0)
+					return (DNS_R_SYNTAX);
+			}
+			isc_lockprof_setrate(rate);
+			if (isc_lockprof_rate == 0) {
+				(void) putstr(text, "lock profiling is not "
+						    "available");
+				(void) putnull(text);
+				return (ISC_R_FAILURE);
+			}
+			isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+				      NS_LOGMODULE_SERVER, ISC_LOG_INFO,
+				      "lock profiling on, sampling 1 in %u",
+				      rate);
+			return (ISC_R_SUCCESS);
+		} else if (strcasecmp(ptr, "off") == 0)
+			isc_lockprof_setrate(0);
+		else if (strcasecmp(ptr, "reset") == 0)
+			isc_lockprof_reset();
+		else
+			return (DNS_R_SYNTAX);
+		isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+			      NS_LOGMODULE_SERVER, ISC_LOG_INFO,
+			      "lock profiling %s", ptr);
+		return (ISC_R_SUCCESS);
+	}
+
+	pt.text = text;
+	pt.result = ISC_R_SUCCESS;
+
+	rate = isc_lockprof_rate;
+	if (rate != 0)
+		snprintf(line, sizeof(line),
+			 "lock profiling is on, sampling 1 in %u\n\n", rate);
+	else
+		snprintf(line, sizeof(line), "lock profiling is off\n\n");
+	CHECK(putstr(text, line));
+	CHECK(isc_lockprof_dump(ns_g_mctx, lockprofile_line, &pt));
+	CHECK(pt.result);
+	result = putnull(text);
+
+ cleanup:
+	return (result);
+}
@@ -10,11 +10,15 @@
 
 #include <config.h>
 
+#include <stdarg.h>
+
 #include <isc/buffer.h>
+#include <isc/histo.h>
 #include <isc/httpd.h>
 #include <isc/json.h>
 #include <isc/mem.h>
 #include <isc/once.h>
+#include <isc/parseint.h>
 #include <isc/print.h>
 #include <isc/socket.h>
 #include <isc/stats.h>
@@ -22,7 +26,10 @@
 #include <isc/task.h>
 
 #include <dns/cache.h>
+#include <dns/cryptopool.h>
 #include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
 #include <dns/opcode.h>
 #include <dns/rcode.h>
 #include <dns/rdataclass.h>
@@ -73,6 +80,25 @@ static isc_once_t once = ISC_ONCE_INIT;
 #undef EXTENDED_STATS
 #endif
 
+#ifdef EXTENDED_STATS
+typedef struct zonestream zonestream_t;
+
+/*%
+ * The 'arg' of a stats_dumparg_t for isc_statsformat_prometheus: each
+ * counter becomes a sample of 'metric' with the given 'labels' (empty,
+ * or ending with a comma) and a label 'key' naming the counter.
+ */
+typedef struct metricarg {
+	zonestream_t		*zs;
+	const char		*metric;
+	const char		*labels;
+	const char		*key;
+} metricarg_t;
+
+static isc_result_t
+metrics_sample(metricarg_t *ma, const char *name, isc_uint64_t value);
+#endif
+
 #ifdef EXTENDED_STATS
 static const char *
 user_zonetype( dns_zone_t *zone ) {
@@ -106,6 +132,22 @@ user_zonetype( dns_zone_t *zone ) {
 		/* empty */;
 	return (tp->string);
 }
+
+/*%
+ * Histograms are rendered as their count, these quantiles, and their
+ * non-empty buckets.
+ */
+#define NQUANTILES	4
+static const double quantile_fractions[NQUANTILES] = {
+	0.5, 0.9, 0.99, 0.999
+};
+static const char *quantile_names[NQUANTILES] = {
+	"p50", "p90", "p99", "p99.9"
+};
+
+static const char *latency_names[ns_latency_max] = {
+	"cache-hit", "cache-miss", "auth", "rpz"
+};
 #endif
 
 /*%
@@ -287,6 +329,52 @@ init_desc(void) {
 		"resulted in a successful remote lookup",
 		"QryNXRedirRLookup");
 	SET_NSSTATDESC(badcookie, "sent badcookie response", "QryBADCOOKIE");
+	SET_NSSTATDESC(respcachehit, "responses sent from the response cache",
+		       "RespCacheHit");
+	SET_NSSTATDESC(respcachemiss, "response cache misses",
+		       "RespCacheMiss");
+	SET_NSSTATDESC(addcachehit,
+		       "additional section cache hits",
+		       "AddCacheHit");
+	SET_NSSTATDESC(addcachemiss,
+		       "additional section cache misses",
+		       "AddCacheMiss");
+	SET_NSSTATDESC(keepaliveopt,
+		       "TCP connections with keepalive option",
+		       "KeepAliveOpt");
+	SET_NSSTATDESC(rpzclientiplookups,
+		       "response policy CLIENT-IP trigger lookups",
+		       "RPZClientIPLookups");
+	SET_NSSTATDESC(rpzclientiptime,
+		       "response policy CLIENT-IP trigger lookup time (ns)",
+		       "RPZClientIPTime");
+	SET_NSSTATDESC(rpzqnamelookups,
+		       "response policy QNAME trigger lookups",
+		       "RPZQnameLookups");
+	SET_NSSTATDESC(rpzqnametime,
+		       "response policy QNAME trigger lookup time (ns)",
+		       "RPZQnameTime");
+	SET_NSSTATDESC(rpziplookups,
+		       "response policy IP trigger lookups",
+		       "RPZIPLookups");
+	SET_NSSTATDESC(rpziptime,
+		       "response policy IP trigger lookup time (ns)",
+		       "RPZIPTime");
+	SET_NSSTATDESC(rpznsdnamelookups,
+		       "response policy NSDNAME trigger lookups",
+		       "RPZNSDnameLookups");
+	SET_NSSTATDESC(rpznsdnametime,
+		       "response policy NSDNAME trigger lookup time (ns)",
+		       "RPZNSDnameTime");
+	SET_NSSTATDESC(rpznsiplookups,
+		       "response policy NSIP trigger lookups",
+		       "RPZNSIPLookups");
+	SET_NSSTATDESC(rpznsiptime,
+		       "response policy NSIP trigger lookup time (ns)",
+		       "RPZNSIPTime");
+	SET_NSSTATDESC(rpznsipcachehit,
+		       "response policy NSIP checks answered from cache",
+		       "RPZNSIPCacheHit");
 	INSIST(i == dns_nsstatscounter_max);
 
 	/* Initialize resolver statistics */
@@ -374,6 +462,35 @@ init_desc(void) {
 	SET_RESSTATDESC(serverquota, "spilled due to server quota",
 			"ServerQuota");
 	SET_RESSTATDESC(nextitem, "waited for next item", "NextItem");
+	SET_RESSTATDESC(sigcachehit, "signature verifications cached",
+			"SigCacheHit");
+	SET_RESSTATDESC(sigcachemiss, "signature verifications performed",
+			"SigCacheMiss");
+	SET_RESSTATDESC(sigcachesaved,
+			"verification time saved by the cache (us)",
+			"SigCacheSavedUsec");
+	SET_RESSTATDESC(cryptoqueue, "verifications queued for workers",
+			"CryptoQueue");
+	SET_RESSTATDESC(cryptooffload, "verifications offloaded to workers",
+			"CryptoOffload");
+	SET_RESSTATDESC(cryptolat0, "offloaded verifications < "
+			DNS_CRYPTOPOOL_LATCLASS0STR "ms",
+			"CryptoLat" DNS_CRYPTOPOOL_LATCLASS0STR);
+	SET_RESSTATDESC(cryptolat1, "offloaded verifications "
+			DNS_CRYPTOPOOL_LATCLASS0STR "-"
+			DNS_CRYPTOPOOL_LATCLASS1STR "ms",
+			"CryptoLat" DNS_CRYPTOPOOL_LATCLASS1STR);
+	SET_RESSTATDESC(cryptolat2, "offloaded verifications "
+			DNS_CRYPTOPOOL_LATCLASS1STR "-"
+			DNS_CRYPTOPOOL_LATCLASS2STR "ms",
+			"CryptoLat" DNS_CRYPTOPOOL_LATCLASS2STR);
+	SET_RESSTATDESC(cryptolat3, "offloaded verifications "
+			DNS_CRYPTOPOOL_LATCLASS2STR "-"
+			DNS_CRYPTOPOOL_LATCLASS3STR "ms",
+			"CryptoLat" DNS_CRYPTOPOOL_LATCLASS3STR);
+	SET_RESSTATDESC(cryptolat4, "offloaded verifications > "
+			DNS_CRYPTOPOOL_LATCLASS3STR "ms",
+			"CryptoLat" DNS_CRYPTOPOOL_LATCLASS3STR "+");
 
 	INSIST(i == dns_resstatscounter_max);
 
@@ -396,6 +513,17 @@ init_desc(void) {
 	SET_ADBSTATDESC(entriescnt, "Addresses in hash table", "entriescnt");
 	SET_ADBSTATDESC(nnames, "Name hash table size", "nnames");
 	SET_ADBSTATDESC(namescnt, "Names in hash table", "namescnt");
+	SET_ADBSTATDESC(nentrylocks, "Address hash table lock stripes",
+			"nentrylocks");
+	SET_ADBSTATDESC(nnamelocks, "Name hash table lock stripes",
+			"nnamelocks");
+	SET_ADBSTATDESC(entriesload, "Address hash table load factor (%)",
+			"entriesload");
+	SET_ADBSTATDESC(namesload, "Name hash table load factor (%)",
+			"namesload");
+	SET_ADBSTATDESC(entriesgrow, "Address hash table resizes",
+			"entriesgrow");
+	SET_ADBSTATDESC(namesgrow, "Name hash table resizes", "namesgrow");
 
 	INSIST(i == dns_adbstats_max);
 
@@ -597,6 +725,8 @@ init_desc(void) {
 	i = 0;
 	SET_DNSTAPSTATDESC(success, "dnstap messges written", "DNSTAPsuccess");
 	SET_DNSTAPSTATDESC(drop, "dnstap messages dropped", "DNSSECdropped");
+	SET_DNSTAPSTATDESC(ringfull, "dnstap messages dropped at a full ring",
+			   "DNSTAPringfull");
 	INSIST(i == dns_dnstapcounter_max);
 
 	/* Sanity check */
@@ -1011,6 +1141,9 @@ dump_counters(isc_stats_t *stats, isc_statsformat_t type, void *arg,
 	isc_uint64_t value;
 	stats_dumparg_t dumparg;
 	FILE *fp;
+#ifdef EXTENDED_STATS
+	isc_result_t result;
+#endif
 #ifdef HAVE_LIBXML2
 	xmlTextWriterPtr writer;
 	int xmlrc;
@@ -1111,6 +1244,13 @@ dump_counters(isc_stats_t *stats, isc_statsformat_t type, void *arg,
 			if (counter == NULL)
 				return (ISC_R_NOMEMORY);
 			json_object_object_add(cat, desc[idx], counter);
+#endif
+			break;
+		case isc_statsformat_prometheus:
+#ifdef EXTENDED_STATS
+			result = metrics_sample(arg, desc[idx], value);
+			if (result != ISC_R_SUCCESS)
+				return (result);
 #endif
 			break;
 		}
@@ -1174,6 +1314,13 @@ rdtypestat_dump(dns_rdatastatstype_t type, isc_uint64_t val, void *arg) {
 		if (obj == NULL)
 			return;
 		json_object_object_add(zoneobj, typestr, obj);
+#endif
+		break;
+	case isc_statsformat_prometheus:
+#ifdef EXTENDED_STATS
+		if (metrics_sample(dumparg->arg, typestr, val) !=
+		    ISC_R_SUCCESS)
+			dumparg->result = ISC_R_NOMEMORY;
 #endif
 		break;
 	}
@@ -1195,6 +1342,9 @@ rdatasetstats_dump(dns_rdatastatstype_t type, isc_uint64_t val, void *arg) {
 	const char *typestr;
 	isc_boolean_t nxrrset = ISC_FALSE;
 	isc_boolean_t stale = ISC_FALSE;
+#ifdef EXTENDED_STATS
+	char rrsetbuf[sizeof(typebuf) + 2];
+#endif
 #ifdef HAVE_LIBXML2
 	xmlTextWriterPtr writer;
 	int xmlrc;
@@ -1259,6 +1409,15 @@ rdatasetstats_dump(dns_rdatastatstype_t type, isc_uint64_t val, void *arg) {
 		if (obj == NULL)
 			return;
 		json_object_object_add(zoneobj, buf, obj);
+#endif
+		break;
+	case isc_statsformat_prometheus:
+#ifdef EXTENDED_STATS
+		snprintf(rrsetbuf, sizeof(rrsetbuf), "%s%s%s",
+			 stale ? "#" : "", nxrrset ? "!" : "", typestr);
+		if (metrics_sample(dumparg->arg, rrsetbuf, val) !=
+		    ISC_R_SUCCESS)
+			dumparg->result = ISC_R_NOMEMORY;
 #endif
 		break;
 	}
@@ -1314,6 +1473,13 @@ opcodestat_dump(dns_opcode_t code, isc_uint64_t val, void *arg) {
 		if (obj == NULL)
 			return;
 		json_object_object_add(zoneobj, codebuf, obj);
+#endif
+		break;
+	case isc_statsformat_prometheus:
+#ifdef EXTENDED_STATS
+		if (metrics_sample(dumparg->arg, codebuf, val) !=
+		    ISC_R_SUCCESS)
+			dumparg->result = ISC_R_NOMEMORY;
 #endif
 		break;
 	}
@@ -1370,6 +1536,13 @@ rcodestat_dump(dns_rcode_t code, isc_uint64_t val, void *arg) {
 		if (obj == NULL)
 			return;
 		json_object_object_add(zoneobj, codebuf, obj);
+#endif
+		break;
+	case isc_statsformat_prometheus:
+#ifdef EXTENDED_STATS
+		if (metrics_sample(dumparg->arg, codebuf, val) !=
+		    ISC_R_SUCCESS)
+			dumparg->result = ISC_R_NOMEMORY;
 #endif
 		break;
 	}
@@ -1384,197 +1557,1155 @@ rcodestat_dump(dns_rcode_t code, isc_uint64_t val, void *arg) {
 #endif
 }
 
-#ifdef HAVE_LIBXML2
-/*
- * Which statistics to include when rendering to XML
+#ifdef EXTENDED_STATS
+/*%
+ * Zone statistics for /xml/v3/zones and /json/v1/zones are streamed.
+ * The zones to report are taken from the zone tables up front as a list
+ * of zone references, and are then rendered a few at a time, each time
+ * the previous piece has been sent.  Neither a zone table nor the httpd
+ * task is held for longer than it takes to render one piece, and the
+ * counters are read with isc_stats_dump(), which never blocks queries.
+ *
+ * The query string may select the zones to report:
+ *
+ *	view=NAME	only the zones of view NAME
+ *	zone=NAME	only zone NAME and the zones below it
+ *	offset=N	skip the first N matching zones
+ *	limit=N		report at most N zones
+ *
+ * Views are always listed, even when none of their zones are reported.
  */
-#define STATS_XML_STATUS	0x00	/* display only common statistics */
-#define STATS_XML_SERVER	0x01
-#define STATS_XML_ZONES		0x02
-#define STATS_XML_TASKS		0x04
-#define STATS_XML_NET		0x08
-#define STATS_XML_MEM		0x10
-#define STATS_XML_TRAFFIC	0x20
-#define STATS_XML_ALL		0xff
-
-static isc_result_t
-zone_xmlrender(dns_zone_t *zone, void *arg) {
-	isc_result_t result;
-	char buf[1024 + 32];	/* sufficiently large for zone name and class */
-	dns_rdataclass_t rdclass;
-	isc_uint32_t serial;
-	xmlTextWriterPtr writer = arg;
-	isc_stats_t *zonestats;
-	dns_stats_t *rcvquerystats;
-	dns_zonestat_level_t statlevel;
-	isc_uint64_t nsstat_values[dns_nsstatscounter_max];
-	int xmlrc;
-	stats_dumparg_t dumparg;
-	const char *ztype;
-
-	statlevel = dns_zone_getstatlevel(zone);
-	if (statlevel == dns_zonestat_none)
-		return (ISC_R_SUCCESS);
-
-	dumparg.type = isc_statsformat_xml;
-	dumparg.arg = writer;
+#define CHECK(m) do { \
+	result = (m); \
+	if (result != ISC_R_SUCCESS) \
+		goto error; \
+} while (0)
 
-	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "zone"));
+#define ZONESTREAM_PIECE	16384	/* render about this much at a time */
+#define ZONESTREAM_QUERYLEN	1024
+
+struct zonestream {
+	isc_mem_t		*mctx;
+	isc_buffer_t		*buffer;	/* the piece being rendered */
+	dns_view_t		**views;	/* weak references */
+	unsigned int		*viewends;	/* end of each view's zones */
+	unsigned int		nviews;
+	unsigned int		viewalloc;
+	dns_zone_t		**zones;
+	unsigned int		nzones;
+	unsigned int		zonealloc;
+
+	/* Filter, applied while taking the snapshot. */
+	dns_fixedname_t		fixed;
+	dns_name_t		*origin;
+	isc_uint32_t		offset;
+	isc_uint32_t		limit;
+	isc_uint32_t		matched;
+
+	/* Rendering position. */
+	unsigned int		curview;
+	unsigned int		curzone;
+	isc_boolean_t		started;
+	isc_boolean_t		inview;
+	isc_boolean_t		comma;		/* JSON: not first in list */
+	unsigned int		stage;		/* metrics: family */
+	isc_boolean_t		done;
+#ifdef HAVE_LIBXML2
+	xmlTextWriterPtr	writer;
+#endif
+};
 
-	dns_zone_nameonly(zone, buf, sizeof(buf));
-	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "name",
-					 ISC_XMLCHAR buf));
+#define ZONESTREAM_VIEWSTART(zs, i) \
+	((i) == 0 ? 0 : (zs)->viewends[(i) - 1])
 
-	rdclass = dns_zone_getclass(zone);
-	dns_rdataclass_format(rdclass, buf, sizeof(buf));
-	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "rdataclass",
-					 ISC_XMLCHAR buf));
+static void
+zonestream_destroy(zonestream_t **zsp) {
+	zonestream_t *zs = *zsp;
+	unsigned int i;
 
-	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "type"));
-	ztype = user_zonetype(zone);
-	if (ztype != NULL)
-		TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR ztype));
-	else
-		TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR "unknown"));
-	TRY0(xmlTextWriterEndElement(writer)); /* type */
+	*zsp = NULL;
 
-	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "serial"));
-	if (dns_zone_getserial2(zone, &serial) == ISC_R_SUCCESS)
-		TRY0(xmlTextWriterWriteFormatString(writer, "%u", serial));
-	else
-		TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR "-"));
-	TRY0(xmlTextWriterEndElement(writer)); /* serial */
+#ifdef HAVE_LIBXML2
+	if (zs->writer != NULL)
+		xmlFreeTextWriter(zs->writer);
+#endif
+	for (i = 0; i < zs->nzones; i++)
+		if (zs->zones[i] != NULL)
+			dns_zone_detach(&zs->zones[i]);
+	if (zs->zones != NULL)
+		isc_mem_put(zs->mctx, zs->zones,
+			    zs->zonealloc * sizeof(*zs->zones));
+	for (i = 0; i < zs->nviews; i++)
+		dns_view_weakdetach(&zs->views[i]);
+	if (zs->views != NULL)
+		isc_mem_put(zs->mctx, zs->views,
+			    zs->viewalloc * sizeof(*zs->views));
+	if (zs->viewends != NULL)
+		isc_mem_put(zs->mctx, zs->viewends,
+			    zs->viewalloc * sizeof(*zs->viewends));
+	if (zs->buffer != NULL)
+		isc_buffer_free(&zs->buffer);
+	isc_mem_putanddetach(&zs->mctx, zs, sizeof(*zs));
+}
 
-	zonestats = dns_zone_getrequeststats(zone);
-	rcvquerystats = dns_zone_getrcvquerystats(zone);
-	if (statlevel == dns_zonestat_full && zonestats != NULL) {
-		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
-		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
-						 ISC_XMLCHAR "rcode"));
+static isc_result_t
+zonestream_collect(dns_zone_t *zone, void *arg) {
+	zonestream_t *zs = arg;
+	dns_zone_t **zones;
+	unsigned int zonealloc;
 
-		result = dump_counters(zonestats, isc_statsformat_xml, writer,
-				       NULL, nsstats_xmldesc,
-				       dns_nsstatscounter_max, nsstats_index,
-				       nsstat_values, ISC_STATSDUMP_VERBOSE);
-		if (result != ISC_R_SUCCESS)
-			goto error;
-		/* counters type="rcode"*/
-		TRY0(xmlTextWriterEndElement(writer));
+	if (dns_zone_getstatlevel(zone) == dns_zonestat_none)
+		return (ISC_R_SUCCESS);
+	if (zs->origin != NULL &&
+	    !dns_name_issubdomain(dns_zone_getorigin(zone), zs->origin))
+		return (ISC_R_SUCCESS);
+	if (zs->matched++ < zs->offset)
+		return (ISC_R_SUCCESS);
+	if (zs->nzones == zs->limit)
+		return (ISC_R_NOMORE);
+
+	if (zs->nzones == zs->zonealloc) {
+		zonealloc = (zs->zonealloc == 0) ? 64 : zs->zonealloc * 2;
+		zones = isc_mem_get(zs->mctx, zonealloc * sizeof(*zones));
+		if (zones == NULL)
+			return (ISC_R_NOMEMORY);
+		if (zs->zones != NULL) {
+			memmove(zones, zs->zones,
+				zs->nzones * sizeof(*zones));
+			isc_mem_put(zs->mctx, zs->zones,
+				    zs->zonealloc * sizeof(*zones));
+		}
+		zs->zones = zones;
+		zs->zonealloc = zonealloc;
 	}
 
-	if (statlevel == dns_zonestat_full && rcvquerystats != NULL) {
-		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
-		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
-						 ISC_XMLCHAR "qtype"));
+	zs->zones[zs->nzones] = NULL;
+	dns_zone_attach(zone, &zs->zones[zs->nzones]);
+	zs->nzones++;
 
-		dumparg.result = ISC_R_SUCCESS;
-		dns_rdatatypestats_dump(rcvquerystats, rdtypestat_dump,
-					&dumparg, 0);
-		if(dumparg.result != ISC_R_SUCCESS)
-			goto error;
+	return (ISC_R_SUCCESS);
+}
 
-		/* counters type="qtype"*/
-		TRY0(xmlTextWriterEndElement(writer));
-	}
+static isc_result_t
+zonestream_parse(zonestream_t *zs, const char *querystring,
+		 char *viewname, size_t viewlen)
+{
+	char buf[ZONESTREAM_QUERYLEN];
+	char *key, *value, *next;
+	isc_result_t result;
 
-	TRY0(xmlTextWriterEndElement(writer)); /* zone */
+	if (querystring == NULL)
+		return (ISC_R_SUCCESS);
+	if (strlcpy(buf, querystring, sizeof(buf)) >= sizeof(buf))
+		return (ISC_R_NOSPACE);
+
+	for (key = buf; key != NULL; key = next) {
+		next = strchr(key, '&');
+		if (next != NULL)
+			*next++ = '\0';
+		if (*key == '\0')
+			continue;
+		value = strchr(key, '=');
+		if (value == NULL)
+			return (ISC_R_UNEXPECTEDTOKEN);
+		*value++ = '\0';
+
+		if (strcmp(key, "view") == 0) {
+			if (strlcpy(viewname, value, viewlen) >= viewlen)
+				return (ISC_R_NOSPACE);
+		} else if (strcmp(key, "zone") == 0) {
+			dns_fixedname_init(&zs->fixed);
+			zs->origin = dns_fixedname_name(&zs->fixed);
+			result = dns_name_fromstring(zs->origin, value, 0,
+						     NULL);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+		} else if (strcmp(key, "offset") == 0) {
+			result = isc_parse_uint32(&zs->offset, value, 10);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+		} else if (strcmp(key, "limit") == 0) {
+			result = isc_parse_uint32(&zs->limit, value, 10);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+		}
+		/* Anything else is ignored. */
+	}
 
 	return (ISC_R_SUCCESS);
- error:
-	isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL, NS_LOGMODULE_SERVER,
-		      ISC_LOG_ERROR, "Failed at zone_xmlrender()");
-	return (ISC_R_FAILURE);
 }
 
+/*%
+ * Take the snapshot of the zones selected by 'querystring'.
+ */
 static isc_result_t
-generatexml(ns_server_t *server, isc_uint32_t flags,
-	    int *buflen, xmlChar **buf)
+zonestream_create(ns_server_t *server, const char *querystring,
+		  zonestream_t **zsp)
 {
-	char boottime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
-	char configtime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
-	char nowstr[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
-	isc_time_t now;
-	xmlTextWriterPtr writer = NULL;
-	xmlDocPtr doc = NULL;
-	int xmlrc;
+	char viewname[ZONESTREAM_QUERYLEN];
+	zonestream_t *zs;
 	dns_view_t *view;
-	stats_dumparg_t dumparg;
-	dns_stats_t *cacherrstats;
-	isc_uint64_t nsstat_values[dns_nsstatscounter_max];
-	isc_uint64_t resstat_values[dns_resstatscounter_max];
-	isc_uint64_t adbstat_values[dns_adbstats_max];
-	isc_uint64_t zonestat_values[dns_zonestatscounter_max];
-	isc_uint64_t sockstat_values[isc_sockstatscounter_max];
-	isc_uint64_t udpinsizestat_values[dns_sizecounter_in_max];
-	isc_uint64_t udpoutsizestat_values[dns_sizecounter_out_max];
-	isc_uint64_t tcpinsizestat_values[dns_sizecounter_in_max];
-	isc_uint64_t tcpoutsizestat_values[dns_sizecounter_out_max];
-#if HAVE_DNSTAP
-	isc_uint64_t dnstapstat_values[dns_dnstapcounter_max];
-#endif
+	unsigned int n;
 	isc_result_t result;
 
-	isc_time_now(&now);
-	isc_time_formatISO8601ms(&ns_g_boottime, boottime, sizeof boottime);
-	isc_time_formatISO8601ms(&ns_g_configtime, configtime, sizeof configtime);
-	isc_time_formatISO8601ms(&now, nowstr, sizeof nowstr);
+	REQUIRE(zsp != NULL && *zsp == NULL);
 
-	writer = xmlNewTextWriterDoc(&doc, 0);
-	if (writer == NULL)
-		goto error;
-	TRY0(xmlTextWriterStartDocument(writer, NULL, "UTF-8", NULL));
-	TRY0(xmlTextWriterWritePI(writer, ISC_XMLCHAR "xml-stylesheet",
-			ISC_XMLCHAR "type=\"text/xsl\" href=\"/bind9.xsl\""));
-	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "statistics"));
-	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "version",
-					 ISC_XMLCHAR "3.8"));
+	zs = isc_mem_get(server->mctx, sizeof(*zs));
+	if (zs == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(zs, 0, sizeof(*zs));
+	zs->mctx = NULL;
+	isc_mem_attach(server->mctx, &zs->mctx);
+	zs->limit = ISC_UINT32_MAX;
 
-	/* Set common fields for statistics dump */
-	dumparg.type = isc_statsformat_xml;
-	dumparg.arg = writer;
+	viewname[0] = '\0';
+	result = zonestream_parse(zs, querystring, viewname, sizeof(viewname));
+	if (result != ISC_R_SUCCESS) {
+		isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL,
+			      NS_LOGMODULE_SERVER, ISC_LOG_INFO,
+			      "statistics channel: bad query string '%s': %s",
+			      querystring, isc_result_totext(result));
+		goto cleanup;
+	}
 
-	/* Render server information */
-	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "server"));
-	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "boot-time"));
-	TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR boottime));
-	TRY0(xmlTextWriterEndElement(writer)); /* boot-time */
-	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "config-time"));
-	TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR configtime));
-	TRY0(xmlTextWriterEndElement(writer)); /* config-time */
-	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "current-time"));
-	TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR nowstr));
-	TRY0(xmlTextWriterEndElement(writer));  /* current-time */
-	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "version"));
-	TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR ns_g_version));
-	TRY0(xmlTextWriterEndElement(writer));  /* version */
+	n = 0;
+	for (view = ISC_LIST_HEAD(server->viewlist);
+	     view != NULL;
+	     view = ISC_LIST_NEXT(view, link))
+		n++;
+	if (n > 0) {
+		zs->views = isc_mem_get(zs->mctx, n * sizeof(*zs->views));
+		zs->viewends = isc_mem_get(zs->mctx,
+					   n * sizeof(*zs->viewends));
+		if (zs->views == NULL || zs->viewends == NULL) {
+			if (zs->views != NULL)
+				isc_mem_put(zs->mctx, zs->views,
+					    n * sizeof(*zs->views));
+			if (zs->viewends != NULL)
+				isc_mem_put(zs->mctx, zs->viewends,
+					    n * sizeof(*zs->viewends));
+			zs->views = NULL;
+			zs->viewends = NULL;
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+		zs->viewalloc = n;
+	}
 
-	if ((flags & STATS_XML_SERVER) != 0) {
-		dumparg.result = ISC_R_SUCCESS;
+	for (view = ISC_LIST_HEAD(server->viewlist);
+	     view != NULL && zs->nviews < zs->viewalloc;
+	     view = ISC_LIST_NEXT(view, link))
+	{
+		if (viewname[0] != '\0' && strcmp(viewname, view->name) != 0)
+			continue;
 
-		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
-		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
-						 ISC_XMLCHAR "opcode"));
+		zs->views[zs->nviews] = NULL;
+		dns_view_weakattach(view, &zs->views[zs->nviews]);
+		if (zs->nzones < zs->limit) {
+			result = dns_zt_apply(view->zonetable, ISC_TRUE,
+					      zonestream_collect, zs);
+			if (result != ISC_R_SUCCESS &&
+			    result != ISC_R_NOMORE)
+			{
+				zs->nviews++;
+				goto cleanup;
+			}
+		}
+		zs->viewends[zs->nviews++] = zs->nzones;
+	}
 
-		dns_opcodestats_dump(server->opcodestats, opcodestat_dump,
-				     &dumparg, ISC_STATSDUMP_VERBOSE);
-		if (dumparg.result != ISC_R_SUCCESS)
-			goto error;
+	result = isc_buffer_allocate(zs->mctx, &zs->buffer,
+				     ZONESTREAM_PIECE);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
 
-		TRY0(xmlTextWriterEndElement(writer));
+	*zsp = zs;
+	return (ISC_R_SUCCESS);
 
-		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
-		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
-						 ISC_XMLCHAR "rcode"));
+ cleanup:
+	zonestream_destroy(&zs);
+	return (result);
+}
 
-		dns_rcodestats_dump(server->rcodestats, rcodestat_dump,
-				    &dumparg, ISC_STATSDUMP_VERBOSE);
-		if (dumparg.result != ISC_R_SUCCESS)
-			goto error;
+/*%
+ * Point 'b' at the piece rendered into the stream's buffer.
+ */
+static void
+zonestream_piece(zonestream_t *zs, isc_buffer_t *b) {
+	isc_region_t r;
 
-		TRY0(xmlTextWriterEndElement(writer));
+	isc_buffer_usedregion(zs->buffer, &r);
+	isc_buffer_reinit(b, r.base, r.length);
+	isc_buffer_add(b, r.length);
+}
 
-		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
-		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
+static isc_result_t
+zonestream_printf(zonestream_t *zs, const char *fmt, ...)
+	ISC_FORMAT_PRINTF(2, 3);
+
+static isc_result_t
+zonestream_printf(zonestream_t *zs, const char *fmt, ...) {
+	va_list ap;
+	unsigned int avail;
+	int n;
+	isc_result_t result;
+
+	for (;;) {
+		avail = isc_buffer_availablelength(zs->buffer);
+		va_start(ap, fmt);
+		n = vsnprintf(isc_buffer_used(zs->buffer), avail, fmt, ap);
+		va_end(ap);
+		if (n < 0)
+			return (ISC_R_FAILURE);
+		if ((unsigned int)n < avail) {
+			isc_buffer_add(zs->buffer, n);
+			return (ISC_R_SUCCESS);
+		}
+		result = isc_buffer_reserve(&zs->buffer, n + 1);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+}
+
+/*%
+ * /metrics renders the counters in the Prometheus text exposition
+ * format, straight from the statistics counters into the stream's
+ * buffer.  Every family is written in one go, so the server-wide and
+ * per-view families make up the first piece and the per-zone families
+ * are then streamed like the zones of /xml/v3/zones, one pass over the
+ * zone snapshot for each family.  The query string filters the views
+ * and zones, as it does for the zone statistics.
+ */
+#define METRICS_NAMELEN		(2 * (1024 + 32))
+#define METRICS_LABELLEN	(3 * METRICS_NAMELEN)
+
+enum {
+	metrics_stage_server = 0,
+	metrics_stage_serial,
+	metrics_stage_nsstat,
+	metrics_stage_qtype,
+	metrics_stage_max
+};
+
+static const char *cachestats_names[dns_cachestatscounter_max] = {
+	NULL, "CacheHits", "CacheMisses", "QueryHits", "QueryMisses",
+	"DeleteLRU", "DeleteTTL"
+};
+
+/*%
+ * Copy 'src' to 'dst' escaped for use as a label value, truncating it
+ * to fit 'len' bytes.
+ */
+static void
+metrics_escape(const char *src, char *dst, size_t len) {
+	size_t i = 0;
+	char c;
+
+	INSIST(len > 0);
+
+	for (; *src != '\0'; src++) {
+		switch (*src) {
+		case '\\':
+		case '"':
+			c = *src;
+			break;
+		case '\n':
+			c = 'n';
+			break;
+		default:
+			if (i + 1 >= len)
+				goto done;
+			dst[i++] = *src;
+			continue;
+		}
+		if (i + 2 >= len)
+			break;
+		dst[i++] = '\\';
+		dst[i++] = c;
+	}
+ done:
+	dst[i] = '\0';
+}
+
+static isc_result_t
+metrics_family(zonestream_t *zs, const char *name, const char *type,
+	       const char *help)
+{
+	return (zonestream_printf(zs, "# HELP %s %s\n# TYPE %s %s\n",
+				  name, help, name, type));
+}
+
+static isc_result_t
+metrics_sample(metricarg_t *ma, const char *name, isc_uint64_t value) {
+	char buf[METRICS_NAMELEN];
+
+	metrics_escape(name, buf, sizeof(buf));
+	return (zonestream_printf(ma->zs, "%s{%s%s=\"%s\"} %"
+				  ISC_PRINT_QUADFORMAT "u\n", ma->metric,
+				  ma->labels, ma->key, buf, value));
+}
+
+/*%
+ * Render the families of a dns_rdatatypestats_dump() style counter set,
+ * setting 'ma->metric' beforehand.
+ */
+static isc_result_t
+metrics_rdtypestats(metricarg_t *ma, dns_stats_t *stats) {
+	stats_dumparg_t dumparg;
+
+	dumparg.type = isc_statsformat_prometheus;
+	dumparg.arg = ma;
+	dumparg.result = ISC_R_SUCCESS;
+	dns_rdatatypestats_dump(stats, rdtypestat_dump, &dumparg, 0);
+	return (dumparg.result);
+}
+
+static isc_result_t
+metrics_cachestats(metricarg_t *ma, isc_stats_t *stats) {
+	isc_uint64_t values[dns_cachestatscounter_max];
+	stats_dumparg_t dumparg;
+	isc_result_t result;
+	int i;
+
+	memset(values, 0, sizeof(values));
+	dumparg.type = isc_statsformat_prometheus;
+	dumparg.ncounters = dns_cachestatscounter_max;
+	dumparg.countervalues = values;
+	isc_stats_dump(stats, generalstat_dump, &dumparg, 0);
+
+	for (i = 0; i < dns_cachestatscounter_max; i++) {
+		if (cachestats_names[i] == NULL)
+			continue;
+		result = metrics_sample(ma, cachestats_names[i], values[i]);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Render the server-wide and per-view families.
+ */
+static isc_result_t
+metrics_server(zonestream_t *zs, ns_server_t *server) {
+	isc_uint64_t nsstat_values[dns_nsstatscounter_max];
+	isc_uint64_t resstat_values[dns_resstatscounter_max];
+	isc_uint64_t adbstat_values[dns_adbstats_max];
+	isc_uint64_t zonestat_values[dns_zonestatscounter_max];
+	isc_uint64_t sockstat_values[isc_sockstatscounter_max];
+	isc_uint64_t insizestat_values[dns_sizecounter_in_max];
+	isc_uint64_t outsizestat_values[dns_sizecounter_out_max];
+	isc_stats_t *trafficstats[8];
+	char labels[METRICS_LABELLEN];
+	char name[METRICS_NAMELEN];
+	stats_dumparg_t dumparg;
+	metricarg_t ma;
+	dns_view_t *view;
+	dns_stats_t *cacherrstats;
+	isc_stats_t *cachestats;
+	isc_boolean_t udp, ipv6, out;
+	unsigned int i;
+	isc_result_t result;
+
+	ma.zs = zs;
+	ma.labels = "";
+	dumparg.type = isc_statsformat_prometheus;
+	dumparg.arg = &ma;
+
+	CHECK(metrics_family(zs, "bind_boot_time_seconds", "gauge",
+			     "Time the server was started."));
+	CHECK(zonestream_printf(zs, "bind_boot_time_seconds %u\n",
+				isc_time_seconds(&ns_g_boottime)));
+	CHECK(metrics_family(zs, "bind_config_time_seconds", "gauge",
+			     "Time the configuration was last loaded."));
+	CHECK(zonestream_printf(zs, "bind_config_time_seconds %u\n",
+				isc_time_seconds(&ns_g_configtime)));
+
+	ma.metric = "bind_opcode_total";
+	ma.key = "opcode";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Incoming requests by opcode."));
+	dumparg.result = ISC_R_SUCCESS;
+	dns_opcodestats_dump(server->opcodestats, opcodestat_dump,
+			     &dumparg, ISC_STATSDUMP_VERBOSE);
+	CHECK(dumparg.result);
+
+	ma.metric = "bind_rcode_total";
+	ma.key = "rcode";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Outgoing responses by rcode."));
+	dumparg.result = ISC_R_SUCCESS;
+	dns_rcodestats_dump(server->rcodestats, rcodestat_dump,
+			    &dumparg, ISC_STATSDUMP_VERBOSE);
+	CHECK(dumparg.result);
+
+	ma.metric = "bind_qtype_total";
+	ma.key = "type";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Incoming queries by type."));
+	CHECK(metrics_rdtypestats(&ma, server->rcvquerystats));
+
+	ma.metric = "bind_nsstat_total";
+	ma.key = "name";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Name server statistics."));
+	CHECK(dump_counters(server->nsstats, isc_statsformat_prometheus,
+			    &ma, NULL, nsstats_xmldesc,
+			    dns_nsstatscounter_max, nsstats_index,
+			    nsstat_values, ISC_STATSDUMP_VERBOSE));
+
+	ma.metric = "bind_zonestat_total";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Zone maintenance statistics."));
+	CHECK(dump_counters(server->zonestats, isc_statsformat_prometheus,
+			    &ma, NULL, zonestats_xmldesc,
+			    dns_zonestatscounter_max, zonestats_index,
+			    zonestat_values, ISC_STATSDUMP_VERBOSE));
+
+	ma.metric = "bind_resstat_total";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Resolver statistics common to all views."));
+	CHECK(dump_counters(server->resolverstats, isc_statsformat_prometheus,
+			    &ma, NULL, resstats_xmldesc,
+			    dns_resstatscounter_max, resstats_index,
+			    resstat_values, 0));
+
+	ma.metric = "bind_sockstat";
+	CHECK(metrics_family(zs, ma.metric, "untyped",
+			     "Socket I/O statistics."));
+	CHECK(dump_counters(server->sockstats, isc_statsformat_prometheus,
+			    &ma, NULL, sockstats_xmldesc,
+			    isc_sockstatscounter_max, sockstats_index,
+			    sockstat_values, ISC_STATSDUMP_VERBOSE));
+
+	trafficstats[0] = server->udpinstats4;
+	trafficstats[1] = server->udpoutstats4;
+	trafficstats[2] = server->udpinstats6;
+	trafficstats[3] = server->udpoutstats6;
+	trafficstats[4] = server->tcpinstats4;
+	trafficstats[5] = server->tcpoutstats4;
+	trafficstats[6] = server->tcpinstats6;
+	trafficstats[7] = server->tcpoutstats6;
+
+	ma.metric = "bind_traffic_total";
+	ma.labels = labels;
+	ma.key = "size";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Request and response sizes in bytes."));
+	for (i = 0; i < 8; i++) {
+		udp = ISC_TF((i & 4) == 0);
+		ipv6 = ISC_TF((i & 2) != 0);
+		out = ISC_TF((i & 1) != 0);
+		snprintf(labels, sizeof(labels),
+			 "transport=\"%s\",family=\"%s\",direction=\"%s\",",
+			 udp ? "udp" : "tcp", ipv6 ? "ipv6" : "ipv4",
+			 out ? "sent" : "received");
+		if (out)
+			result = dump_counters(trafficstats[i],
+					       isc_statsformat_prometheus,
+					       &ma, NULL,
+					       udp ? udpoutsizestats_xmldesc
+						   : tcpoutsizestats_xmldesc,
+					       dns_sizecounter_out_max,
+					       udp ? udpoutsizestats_index
+						   : tcpoutsizestats_index,
+					       outsizestat_values, 0);
+		else
+			result = dump_counters(trafficstats[i],
+					       isc_statsformat_prometheus,
+					       &ma, NULL,
+					       udp ? udpinsizestats_xmldesc
+						   : tcpinsizestats_xmldesc,
+					       dns_sizecounter_in_max,
+					       udp ? udpinsizestats_index
+						   : tcpinsizestats_index,
+					       insizestat_values, 0);
+		CHECK(result);
+	}
+
+	/*
+	 * The per-view families.  Each has to be complete before the next
+	 * one starts, so every family loops over the views.
+	 */
+	ma.metric = "bind_view_resqtype_total";
+	ma.key = "type";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Outgoing queries by type."));
+	for (i = 0; i < zs->nviews; i++) {
+		view = zs->views[i];
+		if (view->resquerystats == NULL)
+			continue;
+		metrics_escape(view->name, name, sizeof(name));
+		snprintf(labels, sizeof(labels), "view=\"%s\",", name);
+		CHECK(metrics_rdtypestats(&ma, view->resquerystats));
+	}
+
+	ma.metric = "bind_view_resstat_total";
+	ma.key = "name";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Resolver statistics."));
+	for (i = 0; i < zs->nviews; i++) {
+		view = zs->views[i];
+		if (view->resstats == NULL)
+			continue;
+		metrics_escape(view->name, name, sizeof(name));
+		snprintf(labels, sizeof(labels), "view=\"%s\",", name);
+		CHECK(dump_counters(view->resstats,
+				    isc_statsformat_prometheus, &ma, NULL,
+				    resstats_xmldesc, dns_resstatscounter_max,
+				    resstats_index, resstat_values,
+				    ISC_STATSDUMP_VERBOSE));
+	}
+
+	ma.metric = "bind_view_adbstat";
+	CHECK(metrics_family(zs, ma.metric, "untyped",
+			     "Address database statistics."));
+	for (i = 0; i < zs->nviews; i++) {
+		view = zs->views[i];
+		if (view->adbstats == NULL)
+			continue;
+		metrics_escape(view->name, name, sizeof(name));
+		snprintf(labels, sizeof(labels), "view=\"%s\",", name);
+		CHECK(dump_counters(view->adbstats,
+				    isc_statsformat_prometheus, &ma, NULL,
+				    adbstats_xmldesc, dns_adbstats_max,
+				    adbstats_index, adbstat_values,
+				    ISC_STATSDUMP_VERBOSE));
+	}
+
+	ma.metric = "bind_view_cachestat_total";
+	CHECK(metrics_family(zs, ma.metric, "counter",
+			     "Cache statistics."));
+	for (i = 0; i < zs->nviews; i++) {
+		view = zs->views[i];
+		if (view->cache == NULL)
+			continue;
+		cachestats = dns_cache_getstats(view->cache);
+		if (cachestats == NULL)
+			continue;
+		metrics_escape(view->name, name, sizeof(name));
+		snprintf(labels, sizeof(labels), "view=\"%s\",", name);
+		CHECK(metrics_cachestats(&ma, cachestats));
+	}
+
+	CHECK(metrics_family(zs, "bind_view_cache_nodes", "gauge",
+			     "Nodes in the cache database."));
+	for (i = 0; i < zs->nviews; i++) {
+		view = zs->views[i];
+		if (view->cachedb == NULL)
+			continue;
+		metrics_escape(view->name, name, sizeof(name));
+		CHECK(zonestream_printf(zs, "bind_view_cache_nodes"
+					"{view=\"%s\"} %u\n", name,
+					dns_db_nodecount(view->cachedb)));
+	}
+
+	ma.metric = "bind_view_cache_rrsets";
+	ma.key = "type";
+	CHECK(metrics_family(zs, ma.metric, "gauge",
+			     "RRsets in the cache database by type; "
+			     "'!' marks negative and '#' stale entries."));
+	for (i = 0; i < zs->nviews; i++) {
+		view = zs->views[i];
+		if (view->cachedb == NULL)
+			continue;
+		cacherrstats = dns_db_getrrsetstats(view->cachedb);
+		if (cacherrstats == NULL)
+			continue;
+		metrics_escape(view->name, name, sizeof(name));
+		snprintf(labels, sizeof(labels), "view=\"%s\",", name);
+		dumparg.result = ISC_R_SUCCESS;
+		dns_rdatasetstats_dump(cacherrstats, rdatasetstats_dump,
+				       &dumparg, 0);
+		CHECK(dumparg.result);
+	}
+
+	return (ISC_R_SUCCESS);
+
+ error:
+	return (result);
+}
+
+/*%
+ * Render the current per-zone family for one zone.
+ */
+static isc_result_t
+metrics_zone(zonestream_t *zs, dns_view_t *view, dns_zone_t *zone) {
+	isc_uint64_t nsstat_values[dns_nsstatscounter_max];
+	char labels[METRICS_LABELLEN];
+	char viewname[METRICS_NAMELEN];
+	char zonename[METRICS_NAMELEN];
+	char buf[1024 + 32];	/* sufficiently large for zone name */
+	dns_zonestat_level_t statlevel;
+	isc_stats_t *zonestats;
+	dns_stats_t *rcvquerystats;
+	isc_uint32_t serial;
+	metricarg_t ma;
+
+	statlevel = dns_zone_getstatlevel(zone);
+
+	metrics_escape(view->name, viewname, sizeof(viewname));
+	dns_zone_nameonly(zone, buf, sizeof(buf));
+	metrics_escape(buf, zonename, sizeof(zonename));
+	snprintf(labels, sizeof(labels), "view=\"%s\",zone=\"%s\",",
+		 viewname, zonename);
+
+	ma.zs = zs;
+	ma.labels = labels;
+
+	switch (zs->stage) {
+	case metrics_stage_serial:
+		if (dns_zone_getserial2(zone, &serial) != ISC_R_SUCCESS)
+			break;
+		return (zonestream_printf(zs, "bind_zone_serial"
+					  "{view=\"%s\",zone=\"%s\"} %u\n",
+					  viewname, zonename, serial));
+	case metrics_stage_nsstat:
+		zonestats = dns_zone_getrequeststats(zone);
+		if (statlevel != dns_zonestat_full || zonestats == NULL)
+			break;
+		ma.metric = "bind_zone_nsstat_total";
+		ma.key = "name";
+		return (dump_counters(zonestats, isc_statsformat_prometheus,
+				      &ma, NULL, nsstats_xmldesc,
+				      dns_nsstatscounter_max, nsstats_index,
+				      nsstat_values, 0));
+	case metrics_stage_qtype:
+		rcvquerystats = dns_zone_getrcvquerystats(zone);
+		if (statlevel != dns_zonestat_full || rcvquerystats == NULL)
+			break;
+		ma.metric = "bind_zone_qtype_total";
+		ma.key = "type";
+		return (metrics_rdtypestats(&ma, rcvquerystats));
+	default:
+		INSIST(0);
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Start the per-zone family of the current stage.
+ */
+static isc_result_t
+metrics_zonefamily(zonestream_t *zs) {
+	switch (zs->stage) {
+	case metrics_stage_serial:
+		return (metrics_family(zs, "bind_zone_serial", "gauge",
+				       "Zone serial number."));
+	case metrics_stage_nsstat:
+		return (metrics_family(zs, "bind_zone_nsstat_total", "counter",
+				       "Name server statistics by zone."));
+	case metrics_stage_qtype:
+		return (metrics_family(zs, "bind_zone_qtype_total", "counter",
+				       "Incoming queries by zone and type."));
+	default:
+		INSIST(0);
+	}
+	return (ISC_R_UNEXPECTED);
+}
+
+static isc_result_t
+zonestream_metricsnext(isc_buffer_t *b, void *arg) {
+	zonestream_t *zs = arg;
+	isc_result_t result;
+
+	if (b == NULL) {
+		zonestream_destroy(&zs);
+		return (ISC_R_SUCCESS);
+	}
+	if (zs->done)
+		return (ISC_R_NOMORE);
+
+	isc_buffer_clear(zs->buffer);
+
+	if (!zs->started) {
+		CHECK(metrics_server(zs, ns_g_server));
+		zs->stage = metrics_stage_serial;
+		CHECK(metrics_zonefamily(zs));
+		zs->started = ISC_TRUE;
+	}
+
+	while (isc_buffer_usedlength(zs->buffer) < ZONESTREAM_PIECE) {
+		if (zs->curzone == zs->nzones) {
+			if (++zs->stage == metrics_stage_max) {
+				zs->done = ISC_TRUE;
+				break;
+			}
+			zs->curzone = 0;
+			zs->curview = 0;
+			CHECK(metrics_zonefamily(zs));
+			continue;
+		}
+
+		while (zs->curzone >= zs->viewends[zs->curview])
+			zs->curview++;
+		CHECK(metrics_zone(zs, zs->views[zs->curview],
+				   zs->zones[zs->curzone]));
+		zs->curzone++;
+	}
+
+	zonestream_piece(zs, b);
+	return (ISC_R_SUCCESS);
+
+ error:
+	isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL, NS_LOGMODULE_SERVER,
+		      ISC_LOG_ERROR, "failed streaming metrics");
+	return (result);
+}
+
+static isc_result_t
+render_metrics(const char *url, isc_httpdurl_t *urlinfo,
+	       const char *querystring, const char *headers, void *arg,
+	       unsigned int *retcode, const char **retmsg,
+	       const char **mimetype, isc_httpdnext_t **nextp,
+	       void **next_argp)
+{
+	ns_server_t *server = arg;
+	zonestream_t *zs = NULL;
+	isc_result_t result;
+
+	UNUSED(url);
+	UNUSED(urlinfo);
+	UNUSED(headers);
+
+	result = zonestream_create(server, querystring, &zs);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	*retcode = 200;
+	*retmsg = "OK";
+	*mimetype = "text/plain; version=0.0.4";
+	*nextp = zonestream_metricsnext;
+	*next_argp = zs;
+
+	return (ISC_R_SUCCESS);
+}
+#endif /* EXTENDED_STATS */
+
+#ifdef HAVE_LIBXML2
+/*
+ * Which statistics to include when rendering to XML
+ */
+#define STATS_XML_STATUS	0x00	/* display only common statistics */
+#define STATS_XML_SERVER	0x01
+#define STATS_XML_ZONES		0x02
+#define STATS_XML_TASKS		0x04
+#define STATS_XML_NET		0x08
+#define STATS_XML_MEM		0x10
+#define STATS_XML_TRAFFIC	0x20
+#define STATS_XML_LATENCY	0x40
+#define STATS_XML_ALL		0xff
+
+static void
+histo_xmldump(isc_uint64_t lower, isc_uint64_t upper, isc_uint64_t count,
+	      void *arg)
+{
+	stats_dumparg_t *dumparg = arg;
+	xmlTextWriterPtr writer = dumparg->arg;
+	int xmlrc;
+
+	if (dumparg->result != ISC_R_SUCCESS)
+		return;
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "bucket"));
+	TRY0(xmlTextWriterWriteFormatAttribute(writer, ISC_XMLCHAR "lower",
+					       "%" ISC_PRINT_QUADFORMAT "u",
+					       lower));
+	TRY0(xmlTextWriterWriteFormatAttribute(writer, ISC_XMLCHAR "upper",
+					       "%" ISC_PRINT_QUADFORMAT "u",
+					       upper));
+	TRY0(xmlTextWriterWriteFormatString(writer,
+					    "%" ISC_PRINT_QUADFORMAT "u",
+					    count));
+	TRY0(xmlTextWriterEndElement(writer)); /* bucket */
+	return;
+
+ error:
+	dumparg->result = ISC_R_FAILURE;
+}
+
+static isc_result_t
+histo_xmlrender(xmlTextWriterPtr writer, const char *name, const char *unit,
+		isc_histo_t *histo)
+{
+	isc_uint64_t values[NQUANTILES];
+	isc_uint64_t count;
+	stats_dumparg_t dumparg;
+	unsigned int i;
+	int xmlrc;
+
+	count = isc_histo_quantiles(histo, NQUANTILES, quantile_fractions,
+				    values);
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "histogram"));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "name",
+					 ISC_XMLCHAR name));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "unit",
+					 ISC_XMLCHAR unit));
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "count"));
+	TRY0(xmlTextWriterWriteFormatString(writer,
+					    "%" ISC_PRINT_QUADFORMAT "u",
+					    count));
+	TRY0(xmlTextWriterEndElement(writer)); /* count */
+
+	for (i = 0; i < NQUANTILES; i++) {
+		TRY0(xmlTextWriterStartElement(writer,
+					       ISC_XMLCHAR "quantile"));
+		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "name",
+						 ISC_XMLCHAR
+						 quantile_names[i]));
+		TRY0(xmlTextWriterWriteFormatString(writer,
+					    "%" ISC_PRINT_QUADFORMAT "u",
+					    values[i]));
+		TRY0(xmlTextWriterEndElement(writer)); /* quantile */
+	}
+
+	dumparg.type = isc_statsformat_xml;
+	dumparg.arg = writer;
+	dumparg.result = ISC_R_SUCCESS;
+	isc_histo_dump(histo, histo_xmldump, &dumparg);
+	if (dumparg.result != ISC_R_SUCCESS)
+		goto error;
+
+	TRY0(xmlTextWriterEndElement(writer)); /* histogram */
+
+	return (ISC_R_SUCCESS);
+ error:
+	isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL, NS_LOGMODULE_SERVER,
+		      ISC_LOG_ERROR, "Failed at histo_xmlrender()");
+	return (ISC_R_FAILURE);
+}
+
+static isc_result_t
+xfrin_xmlrender(dns_zone_t *zone, void *arg) {
+	char buf[1024 + 32];	/* sufficiently large for zone name and class */
+	xmlTextWriterPtr writer = arg;
+	isc_histo_t *xfrintimes;
+	int xmlrc;
+
+	xfrintimes = dns_zone_getxfrintimes(zone);
+	if (xfrintimes == NULL)
+		return (ISC_R_SUCCESS);
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "zone"));
+
+	dns_zone_nameonly(zone, buf, sizeof(buf));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "name",
+					 ISC_XMLCHAR buf));
+
+	dns_rdataclass_format(dns_zone_getclass(zone), buf, sizeof(buf));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "rdataclass",
+					 ISC_XMLCHAR buf));
+
+	if (histo_xmlrender(writer, "xfrin", "ms", xfrintimes) !=
+	    ISC_R_SUCCESS)
+		goto error;
+
+	TRY0(xmlTextWriterEndElement(writer)); /* zone */
+
+	return (ISC_R_SUCCESS);
+ error:
+	return (ISC_R_FAILURE);
+}
+
+static isc_result_t
+zone_xmlrender(dns_zone_t *zone, void *arg) {
+	isc_result_t result;
+	char buf[1024 + 32];	/* sufficiently large for zone name and class */
+	dns_rdataclass_t rdclass;
+	isc_uint32_t serial;
+	xmlTextWriterPtr writer = arg;
+	isc_stats_t *zonestats;
+	dns_stats_t *rcvquerystats;
+	dns_zonestat_level_t statlevel;
+	isc_uint64_t nsstat_values[dns_nsstatscounter_max];
+	int xmlrc;
+	stats_dumparg_t dumparg;
+	const char *ztype;
+
+	statlevel = dns_zone_getstatlevel(zone);
+	if (statlevel == dns_zonestat_none)
+		return (ISC_R_SUCCESS);
+
+	dumparg.type = isc_statsformat_xml;
+	dumparg.arg = writer;
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "zone"));
+
+	dns_zone_nameonly(zone, buf, sizeof(buf));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "name",
+					 ISC_XMLCHAR buf));
+
+	rdclass = dns_zone_getclass(zone);
+	dns_rdataclass_format(rdclass, buf, sizeof(buf));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "rdataclass",
+					 ISC_XMLCHAR buf));
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "type"));
+	ztype = user_zonetype(zone);
+	if (ztype != NULL)
+		TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR ztype));
+	else
+		TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR "unknown"));
+	TRY0(xmlTextWriterEndElement(writer)); /* type */
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "serial"));
+	if (dns_zone_getserial2(zone, &serial) == ISC_R_SUCCESS)
+		TRY0(xmlTextWriterWriteFormatString(writer, "%u", serial));
+	else
+		TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR "-"));
+	TRY0(xmlTextWriterEndElement(writer)); /* serial */
+
+	zonestats = dns_zone_getrequeststats(zone);
+	rcvquerystats = dns_zone_getrcvquerystats(zone);
+	if (statlevel == dns_zonestat_full && zonestats != NULL) {
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
+		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
+						 ISC_XMLCHAR "rcode"));
+
+		result = dump_counters(zonestats, isc_statsformat_xml, writer,
+				       NULL, nsstats_xmldesc,
+				       dns_nsstatscounter_max, nsstats_index,
+				       nsstat_values, ISC_STATSDUMP_VERBOSE);
+		if (result != ISC_R_SUCCESS)
+			goto error;
+		/* counters type="rcode"*/
+		TRY0(xmlTextWriterEndElement(writer));
+	}
+
+	if (statlevel == dns_zonestat_full && rcvquerystats != NULL) {
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
+		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
+						 ISC_XMLCHAR "qtype"));
+
+		dumparg.result = ISC_R_SUCCESS;
+		dns_rdatatypestats_dump(rcvquerystats, rdtypestat_dump,
+					&dumparg, 0);
+		if(dumparg.result != ISC_R_SUCCESS)
+			goto error;
+
+		/* counters type="qtype"*/
+		TRY0(xmlTextWriterEndElement(writer));
+	}
+
+	TRY0(xmlTextWriterEndElement(writer)); /* zone */
+
+	return (ISC_R_SUCCESS);
+ error:
+	isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL, NS_LOGMODULE_SERVER,
+		      ISC_LOG_ERROR, "Failed at zone_xmlrender()");
+	return (ISC_R_FAILURE);
+}
+
+/*%
+ * Render the document header and the start of the server element
+ * common to every XML statistics document.
+ */
+static isc_result_t
+xml_header(xmlTextWriterPtr writer) {
+	char boottime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
+	char configtime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
+	char nowstr[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
+	isc_time_t now;
+	int xmlrc;
+
+	isc_time_now(&now);
+	isc_time_formatISO8601ms(&ns_g_boottime, boottime, sizeof boottime);
+	isc_time_formatISO8601ms(&ns_g_configtime, configtime, sizeof configtime);
+	isc_time_formatISO8601ms(&now, nowstr, sizeof nowstr);
+
+	TRY0(xmlTextWriterStartDocument(writer, NULL, "UTF-8", NULL));
+	TRY0(xmlTextWriterWritePI(writer, ISC_XMLCHAR "xml-stylesheet",
+			ISC_XMLCHAR "type=\"text/xsl\" href=\"/bind9.xsl\""));
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "statistics"));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "version",
+					 ISC_XMLCHAR "3.9"));
+
+	/* Render server information */
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "server"));
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "boot-time"));
+	TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR boottime));
+	TRY0(xmlTextWriterEndElement(writer)); /* boot-time */
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "config-time"));
+	TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR configtime));
+	TRY0(xmlTextWriterEndElement(writer)); /* config-time */
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "current-time"));
+	TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR nowstr));
+	TRY0(xmlTextWriterEndElement(writer));  /* current-time */
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "version"));
+	TRY0(xmlTextWriterWriteString(writer, ISC_XMLCHAR ns_g_version));
+	TRY0(xmlTextWriterEndElement(writer));  /* version */
+
+	return (ISC_R_SUCCESS);
+
+ error:
+	return (ISC_R_FAILURE);
+}
+
+static isc_result_t
+generatexml(ns_server_t *server, isc_uint32_t flags,
+	    int *buflen, xmlChar **buf)
+{
+	xmlTextWriterPtr writer = NULL;
+	xmlDocPtr doc = NULL;
+	int xmlrc;
+	dns_view_t *view;
+	stats_dumparg_t dumparg;
+	dns_stats_t *cacherrstats;
+	isc_uint64_t nsstat_values[dns_nsstatscounter_max];
+	isc_uint64_t resstat_values[dns_resstatscounter_max];
+	isc_uint64_t adbstat_values[dns_adbstats_max];
+	isc_uint64_t zonestat_values[dns_zonestatscounter_max];
+	isc_uint64_t sockstat_values[isc_sockstatscounter_max];
+	isc_uint64_t udpinsizestat_values[dns_sizecounter_in_max];
+	isc_uint64_t udpoutsizestat_values[dns_sizecounter_out_max];
+	isc_uint64_t tcpinsizestat_values[dns_sizecounter_in_max];
+	isc_uint64_t tcpoutsizestat_values[dns_sizecounter_out_max];
+#if HAVE_DNSTAP
+	isc_uint64_t dnstapstat_values[dns_dnstapcounter_max];
+#endif
+	isc_result_t result;
+	unsigned int i;
+
+	writer = xmlNewTextWriterDoc(&doc, 0);
+	if (writer == NULL)
+		goto error;
+	if (xml_header(writer) != ISC_R_SUCCESS)
+		goto error;
+
+	/* Set common fields for statistics dump */
+	dumparg.type = isc_statsformat_xml;
+	dumparg.arg = writer;
+
+	if ((flags & STATS_XML_SERVER) != 0) {
+		dumparg.result = ISC_R_SUCCESS;
+
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
+		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
+						 ISC_XMLCHAR "opcode"));
+
+		dns_opcodestats_dump(server->opcodestats, opcodestat_dump,
+				     &dumparg, ISC_STATSDUMP_VERBOSE);
+		if (dumparg.result != ISC_R_SUCCESS)
+			goto error;
+
+		TRY0(xmlTextWriterEndElement(writer));
+
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
+		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
+						 ISC_XMLCHAR "rcode"));
+
+		dns_rcodestats_dump(server->rcodestats, rcodestat_dump,
+				    &dumparg, ISC_STATSDUMP_VERBOSE);
+		if (dumparg.result != ISC_R_SUCCESS)
+			goto error;
+
+		TRY0(xmlTextWriterEndElement(writer));
+
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "counters"));
+		TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "type",
 						 ISC_XMLCHAR "qtype"));
 
 		dumparg.result = ISC_R_SUCCESS;
@@ -1804,6 +2935,34 @@ generatexml(ns_server_t *server, isc_uint32_t flags,
 		TRY0(xmlTextWriterEndElement(writer)); /* </traffic> */
 	}
 
+	if ((flags & STATS_XML_LATENCY) != 0) {
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "latency"));
+		for (i = 0; i < ns_latency_max; i++) {
+			result = histo_xmlrender(writer, latency_names[i],
+						 "us", server->querylatency[i]);
+			if (result != ISC_R_SUCCESS)
+				goto error;
+		}
+
+		for (view = ISC_LIST_HEAD(server->viewlist);
+		     view != NULL;
+		     view = ISC_LIST_NEXT(view, link))
+		{
+			TRY0(xmlTextWriterStartElement(writer,
+						       ISC_XMLCHAR "view"));
+			TRY0(xmlTextWriterWriteAttribute(writer,
+							 ISC_XMLCHAR "name",
+							 ISC_XMLCHAR
+							 view->name));
+			result = dns_zt_apply(view->zonetable, ISC_TRUE,
+					      xfrin_xmlrender, writer);
+			if (result != ISC_R_SUCCESS)
+				goto error;
+			TRY0(xmlTextWriterEndElement(writer)); /* </view> */
+		}
+		TRY0(xmlTextWriterEndElement(writer)); /* </latency> */
+	}
+
 	/*
 	 * Render views.  For each view we know of, call its
 	 * rendering function.
@@ -2030,19 +3189,6 @@ render_xml_server(const char *url, isc_httpdurl_t *urlinfo,
 			   freecb, freecb_args));
 }
 
-static isc_result_t
-render_xml_zones(const char *url, isc_httpdurl_t *urlinfo,
-		 const char *querystring, const char *headers, void *arg,
-		 unsigned int *retcode, const char **retmsg,
-		 const char **mimetype, isc_buffer_t *b,
-		 isc_httpdfree_t **freecb, void **freecb_args)
-{
-	return (render_xml(STATS_XML_ZONES, url, urlinfo,
-			   querystring, headers, arg,
-			   retcode, retmsg, mimetype, b,
-			   freecb, freecb_args));
-}
-
 static isc_result_t
 render_xml_net(const char *url, isc_httpdurl_t *urlinfo,
 	       const char *querystring, const char *headers, void *arg,
@@ -2082,6 +3228,19 @@ render_xml_mem(const char *url, isc_httpdurl_t *urlinfo,
 			   freecb, freecb_args));
 }
 
+static isc_result_t
+render_xml_latency(const char *url, isc_httpdurl_t *urlinfo,
+		   const char *querystring, const char *headers, void *arg,
+		   unsigned int *retcode, const char **retmsg,
+		   const char **mimetype, isc_buffer_t *b,
+		   isc_httpdfree_t **freecb, void **freecb_args)
+{
+	return (render_xml(STATS_XML_LATENCY, url, urlinfo,
+			   querystring, headers, arg,
+			   retcode, retmsg, mimetype, b,
+			   freecb, freecb_args));
+}
+
 static isc_result_t
 render_xml_traffic(const char *url, isc_httpdurl_t *urlinfo,
 		   const char *querystring, const char *headers, void *arg,
@@ -2095,6 +3254,125 @@ render_xml_traffic(const char *url, isc_httpdurl_t *urlinfo,
 			   freecb, freecb_args));
 }
 
+static int
+zonestream_xmlwrite(void *arg, const char *buf, int len) {
+	zonestream_t *zs = arg;
+
+	if (isc_buffer_reserve(&zs->buffer, len) != ISC_R_SUCCESS)
+		return (-1);
+	isc_buffer_putmem(zs->buffer, (const unsigned char *)buf, len);
+	return (len);
+}
+
+static isc_result_t
+zonestream_xmlnext(isc_buffer_t *b, void *arg) {
+	zonestream_t *zs = arg;
+	xmlTextWriterPtr writer = zs->writer;
+	dns_view_t *view;
+	int xmlrc;
+
+	if (b == NULL) {
+		zonestream_destroy(&zs);
+		return (ISC_R_SUCCESS);
+	}
+	if (zs->done)
+		return (ISC_R_NOMORE);
+
+	isc_buffer_clear(zs->buffer);
+
+	if (!zs->started) {
+		if (xml_header(writer) != ISC_R_SUCCESS)
+			goto error;
+		TRY0(xmlTextWriterEndElement(writer)); /* server */
+		TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "views"));
+		zs->started = ISC_TRUE;
+	}
+
+	while (isc_buffer_usedlength(zs->buffer) < ZONESTREAM_PIECE) {
+		if (zs->curview == zs->nviews) {
+			TRY0(xmlTextWriterEndElement(writer)); /* /views */
+			TRY0(xmlTextWriterEndElement(writer)); /* /statistics */
+			TRY0(xmlTextWriterEndDocument(writer));
+			zs->done = ISC_TRUE;
+			break;
+		}
+
+		view = zs->views[zs->curview];
+		if (!zs->inview) {
+			TRY0(xmlTextWriterStartElement(writer,
+						       ISC_XMLCHAR "view"));
+			TRY0(xmlTextWriterWriteAttribute(writer,
+						 ISC_XMLCHAR "name",
+						 ISC_XMLCHAR view->name));
+			TRY0(xmlTextWriterStartElement(writer,
+						       ISC_XMLCHAR "zones"));
+			zs->inview = ISC_TRUE;
+		}
+
+		if (zs->curzone < zs->viewends[zs->curview]) {
+			if (zone_xmlrender(zs->zones[zs->curzone],
+					   writer) != ISC_R_SUCCESS)
+				goto error;
+			dns_zone_detach(&zs->zones[zs->curzone]);
+			zs->curzone++;
+		} else {
+			TRY0(xmlTextWriterEndElement(writer)); /* /zones */
+			TRY0(xmlTextWriterEndElement(writer)); /* /view */
+			zs->inview = ISC_FALSE;
+			zs->curview++;
+		}
+		TRY0(xmlTextWriterFlush(writer));
+	}
+
+	TRY0(xmlTextWriterFlush(writer));
+	zonestream_piece(zs, b);
+	return (ISC_R_SUCCESS);
+
+ error:
+	isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL, NS_LOGMODULE_SERVER,
+		      ISC_LOG_ERROR, "failed streaming XML zone statistics");
+	return (ISC_R_FAILURE);
+}
+
+static isc_result_t
+render_xml_zonestream(const char *url, isc_httpdurl_t *urlinfo,
+		      const char *querystring, const char *headers, void *arg,
+		      unsigned int *retcode, const char **retmsg,
+		      const char **mimetype, isc_httpdnext_t **nextp,
+		      void **next_argp)
+{
+	ns_server_t *server = arg;
+	zonestream_t *zs = NULL;
+	xmlOutputBufferPtr out;
+	isc_result_t result;
+
+	UNUSED(url);
+	UNUSED(urlinfo);
+	UNUSED(headers);
+
+	result = zonestream_create(server, querystring, &zs);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	out = xmlOutputBufferCreateIO(zonestream_xmlwrite, NULL, zs, NULL);
+	if (out != NULL) {
+		zs->writer = xmlNewTextWriter(out);
+		if (zs->writer == NULL)
+			(void)xmlOutputBufferClose(out);
+	}
+	if (zs->writer == NULL) {
+		zonestream_destroy(&zs);
+		return (ISC_R_NOMEMORY);
+	}
+
+	*retcode = 200;
+	*retmsg = "OK";
+	*mimetype = "text/xml";
+	*nextp = zonestream_xmlnext;
+	*next_argp = zs;
+
+	return (ISC_R_SUCCESS);
+}
 #endif	/* HAVE_LIBXML2 */
 
 #ifdef HAVE_JSON
@@ -2108,14 +3386,9 @@ render_xml_traffic(const char *url, isc_httpdurl_t *urlinfo,
 #define STATS_JSON_NET		0x08
 #define STATS_JSON_MEM		0x10
 #define STATS_JSON_TRAFFIC	0x20
+#define STATS_JSON_LATENCY	0x40
 #define STATS_JSON_ALL		0xff
 
-#define CHECK(m) do { \
-	result = (m); \
-	if (result != ISC_R_SUCCESS) \
-		goto error; \
-} while (0)
-
 #define CHECKMEM(m) do { \
 	if (m == NULL) { \
 		result = ISC_R_NOMEMORY;\
@@ -2150,6 +3423,100 @@ addzone(char *name, char *class, const char *ztype,
 	return (node);
 }
 
+static void
+histo_jsondump(isc_uint64_t lower, isc_uint64_t upper, isc_uint64_t count,
+	       void *arg)
+{
+	stats_dumparg_t *dumparg = arg;
+	json_object *buckets = dumparg->arg;
+	json_object *bucket;
+
+	if (dumparg->result != ISC_R_SUCCESS)
+		return;
+
+	/* The last bucket is unbounded; JSON integers are signed. */
+	if (upper > ISC_INT64_MAX)
+		upper = ISC_INT64_MAX;
+
+	bucket = json_object_new_object();
+	if (bucket == NULL) {
+		dumparg->result = ISC_R_NOMEMORY;
+		return;
+	}
+	json_object_object_add(bucket, "lower", json_object_new_int64(lower));
+	json_object_object_add(bucket, "upper", json_object_new_int64(upper));
+	json_object_object_add(bucket, "count", json_object_new_int64(count));
+	json_object_array_add(buckets, bucket);
+}
+
+static isc_result_t
+histo_jsonrender(json_object *parent, const char *name, const char *unit,
+		 isc_histo_t *histo)
+{
+	isc_result_t result;
+	isc_uint64_t values[NQUANTILES];
+	isc_uint64_t count;
+	stats_dumparg_t dumparg;
+	json_object *obj, *quantiles, *buckets;
+	unsigned int i;
+
+	obj = json_object_new_object();
+	if (obj == NULL)
+		return (ISC_R_NOMEMORY);
+	json_object_object_add(parent, name, obj);
+
+	count = isc_histo_quantiles(histo, NQUANTILES, quantile_fractions,
+				    values);
+
+	json_object_object_add(obj, "unit", json_object_new_string(unit));
+	json_object_object_add(obj, "count", json_object_new_int64(count));
+
+	quantiles = json_object_new_object();
+	CHECKMEM(quantiles);
+	json_object_object_add(obj, "quantiles", quantiles);
+	for (i = 0; i < NQUANTILES; i++)
+		json_object_object_add(quantiles, quantile_names[i],
+				       json_object_new_int64(values[i]));
+
+	buckets = json_object_new_array();
+	CHECKMEM(buckets);
+	json_object_object_add(obj, "buckets", buckets);
+
+	dumparg.type = isc_statsformat_json;
+	dumparg.arg = buckets;
+	dumparg.result = ISC_R_SUCCESS;
+	isc_histo_dump(histo, histo_jsondump, &dumparg);
+	result = dumparg.result;
+
+ error:
+	return (result);
+}
+
+static isc_result_t
+xfrin_jsonrender(dns_zone_t *zone, void *arg) {
+	isc_result_t result;
+	char buf[1024 + 32];	/* sufficiently large for zone name and class */
+	char class[1024 + 32];	/* sufficiently large for zone name and class */
+	json_object *zonearray = (json_object *) arg;
+	json_object *zoneobj;
+	isc_histo_t *xfrintimes;
+
+	xfrintimes = dns_zone_getxfrintimes(zone);
+	if (xfrintimes == NULL)
+		return (ISC_R_SUCCESS);
+
+	dns_zone_nameonly(zone, buf, sizeof(buf));
+	dns_rdataclass_format(dns_zone_getclass(zone), class, sizeof(class));
+
+	zoneobj = addzone(buf, class, NULL, 0, ISC_FALSE);
+	if (zoneobj == NULL)
+		return (ISC_R_NOMEMORY);
+	json_object_array_add(zonearray, zoneobj);
+
+	result = histo_jsonrender(zoneobj, "xfrin", "ms", xfrintimes);
+	return (result);
+}
+
 static isc_result_t
 zone_jsonrender(dns_zone_t *zone, void *arg) {
 	isc_result_t result = ISC_R_SUCCESS;
@@ -2242,13 +3609,57 @@ zone_jsonrender(dns_zone_t *zone, void *arg) {
 	return (result);
 }
 
+/*%
+ * Add the fields common to every JSON statistics document.
+ */
+static isc_result_t
+json_header(json_object *bindstats) {
+	char boottime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
+	char configtime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
+	char nowstr[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
+	isc_time_t now;
+	json_object *obj;
+	isc_result_t result;
+
+	obj = json_object_new_string("1.3");
+	CHECKMEM(obj);
+	json_object_object_add(bindstats, "json-stats-version", obj);
+
+	isc_time_now(&now);
+	isc_time_formatISO8601ms(&ns_g_boottime,
+			       boottime, sizeof(boottime));
+	isc_time_formatISO8601ms(&ns_g_configtime,
+			       configtime, sizeof configtime);
+	isc_time_formatISO8601ms(&now, nowstr, sizeof(nowstr));
+
+	obj = json_object_new_string(boottime);
+	CHECKMEM(obj);
+	json_object_object_add(bindstats, "boot-time", obj);
+
+	obj = json_object_new_string(configtime);
+	CHECKMEM(obj);
+	json_object_object_add(bindstats, "config-time", obj);
+
+	obj = json_object_new_string(nowstr);
+	CHECKMEM(obj);
+	json_object_object_add(bindstats, "current-time", obj);
+	obj = json_object_new_string(ns_g_version);
+	CHECKMEM(obj);
+	json_object_object_add(bindstats, "version", obj);
+
+	return (ISC_R_SUCCESS);
+
+ error:
+	return (result);
+}
+
 static isc_result_t
 generatejson(ns_server_t *server, size_t *msglen,
 	     const char **msg, json_object **rootp, isc_uint32_t flags)
 {
 	dns_view_t *view;
 	isc_result_t result = ISC_R_SUCCESS;
-	json_object *bindstats, *viewlist, *counters, *obj;
+	json_object *bindstats, *viewlist, *counters;
 	json_object *traffic = NULL;
 	json_object *udpreq4 = NULL, *udpresp4 = NULL;
 	json_object *tcpreq4 = NULL, *tcpresp4 = NULL;
@@ -2267,10 +3678,7 @@ generatejson(ns_server_t *server, size_t *msglen,
 	isc_uint64_t dnstapstat_values[dns_dnstapcounter_max];
 #endif
 	stats_dumparg_t dumparg;
-	char boottime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
-	char configtime[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
-	char nowstr[sizeof "yyyy-mm-ddThh:mm:ss.sssZ"];
-	isc_time_t now;
+	unsigned int i;
 
 	REQUIRE(msglen != NULL);
 	REQUIRE(msg != NULL && *msg == NULL);
@@ -2283,31 +3691,7 @@ generatejson(ns_server_t *server, size_t *msglen,
 	/*
 	 * These statistics are included no matter which URL we use.
 	 */
-	obj = json_object_new_string("1.2");
-	CHECKMEM(obj);
-	json_object_object_add(bindstats, "json-stats-version", obj);
-
-	isc_time_now(&now);
-	isc_time_formatISO8601ms(&ns_g_boottime,
-			       boottime, sizeof(boottime));
-	isc_time_formatISO8601ms(&ns_g_configtime,
-			       configtime, sizeof configtime);
-	isc_time_formatISO8601ms(&now, nowstr, sizeof(nowstr));
-
-	obj = json_object_new_string(boottime);
-	CHECKMEM(obj);
-	json_object_object_add(bindstats, "boot-time", obj);
-
-	obj = json_object_new_string(configtime);
-	CHECKMEM(obj);
-	json_object_object_add(bindstats, "config-time", obj);
-
-	obj = json_object_new_string(nowstr);
-	CHECKMEM(obj);
-	json_object_object_add(bindstats, "current-time", obj);
-	obj = json_object_new_string(ns_g_version);
-	CHECKMEM(obj);
-	json_object_object_add(bindstats, "version", obj);
+	CHECK(json_header(bindstats));
 
 	if ((flags & STATS_JSON_SERVER) != 0) {
 		/* OPCODE counters */
@@ -2782,6 +4166,52 @@ generatejson(ns_server_t *server, size_t *msglen,
 		traffic = NULL;
 	}
 
+	if ((flags & STATS_JSON_LATENCY) != 0) {
+		json_object *latency;
+
+		latency = json_object_new_object();
+		CHECKMEM(latency);
+		json_object_object_add(bindstats, "latency", latency);
+
+		for (i = 0; i < ns_latency_max; i++)
+			CHECK(histo_jsonrender(latency, latency_names[i], "us",
+					       server->querylatency[i]));
+
+		viewlist = json_object_new_object();
+		CHECKMEM(viewlist);
+		json_object_object_add(latency, "views", viewlist);
+
+		for (view = ISC_LIST_HEAD(server->viewlist);
+		     view != NULL;
+		     view = ISC_LIST_NEXT(view, link))
+		{
+			json_object *za;
+
+			za = json_object_new_array();
+			CHECKMEM(za);
+
+			result = dns_zt_apply(view->zonetable, ISC_TRUE,
+					      xfrin_jsonrender, za);
+			if (result != ISC_R_SUCCESS) {
+				json_object_put(za);
+				goto error;
+			}
+
+			if (json_object_array_length(za) != 0) {
+				json_object *v = json_object_new_object();
+				if (v == NULL) {
+					json_object_put(za);
+					result = ISC_R_NOMEMORY;
+					goto error;
+				}
+				json_object_object_add(v, "zones", za);
+				json_object_object_add(viewlist, view->name,
+						       v);
+			} else
+				json_object_put(za);
+		}
+	}
+
 	*msg = json_object_to_json_string_ext(bindstats,
 					      JSON_C_TO_STRING_PRETTY);
 	*msglen = strlen(*msg);
@@ -2895,19 +4325,6 @@ render_json_server(const char *url, isc_httpdurl_t *urlinfo,
 			    freecb, freecb_args));
 }
 
-static isc_result_t
-render_json_zones(const char *url, isc_httpdurl_t *urlinfo,
-		  const char *querystring, const char *headers, void *arg,
-		  unsigned int *retcode, const char **retmsg,
-		  const char **mimetype, isc_buffer_t *b,
-		  isc_httpdfree_t **freecb, void **freecb_args)
-{
-	return (render_json(STATS_JSON_ZONES, url, urlinfo,
-			    querystring, headers, arg,
-			    retcode, retmsg, mimetype, b,
-			    freecb, freecb_args));
-}
-
 static isc_result_t
 render_json_mem(const char *url, isc_httpdurl_t *urlinfo,
 		const char *querystring, const char *headers, void *arg,
@@ -2947,6 +4364,19 @@ render_json_net(const char *url, isc_httpdurl_t *urlinfo,
 			    freecb, freecb_args));
 }
 
+static isc_result_t
+render_json_latency(const char *url, isc_httpdurl_t *urlinfo,
+		    const char *querystring, const char *headers, void *arg,
+		    unsigned int *retcode, const char **retmsg,
+		    const char **mimetype, isc_buffer_t *b,
+		    isc_httpdfree_t **freecb, void **freecb_args)
+{
+	return (render_json(STATS_JSON_LATENCY, url, urlinfo,
+			    querystring, headers, arg,
+			    retcode, retmsg, mimetype, b,
+			    freecb, freecb_args));
+}
+
 static isc_result_t
 render_json_traffic(const char *url, isc_httpdurl_t *urlinfo,
 		    const char *querystring, const char *headers, void *arg,
@@ -2960,6 +4390,168 @@ render_json_traffic(const char *url, isc_httpdurl_t *urlinfo,
 			    freecb, freecb_args));
 }
 
+static isc_result_t
+zonestream_puts(zonestream_t *zs, const char *s, size_t len) {
+	isc_result_t result;
+
+	result = isc_buffer_reserve(&zs->buffer, len);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	isc_buffer_putmem(zs->buffer, (const unsigned char *)s, len);
+	return (ISC_R_SUCCESS);
+}
+
+/*%
+ * Append the JSON encoding of 'str', with its quotes and escapes.
+ */
+static isc_result_t
+zonestream_putstring(zonestream_t *zs, const char *str) {
+	json_object *obj;
+	const char *s;
+	isc_result_t result;
+
+	obj = json_object_new_string(str);
+	if (obj == NULL)
+		return (ISC_R_NOMEMORY);
+	s = json_object_to_json_string(obj);
+	result = zonestream_puts(zs, s, strlen(s));
+	json_object_put(obj);
+	return (result);
+}
+
+static isc_result_t
+zonestream_jsonzone(zonestream_t *zs, dns_zone_t *zone) {
+	json_object *za;
+	const char *s;
+	isc_result_t result;
+
+	za = json_object_new_array();
+	if (za == NULL)
+		return (ISC_R_NOMEMORY);
+
+	result = zone_jsonrender(zone, za);
+	if (result == ISC_R_SUCCESS && json_object_array_length(za) != 0) {
+		if (zs->comma)
+			result = zonestream_puts(zs, ",", 1);
+		if (result == ISC_R_SUCCESS) {
+			s = json_object_to_json_string(
+				json_object_array_get_idx(za, 0));
+			result = zonestream_puts(zs, s, strlen(s));
+		}
+		zs->comma = ISC_TRUE;
+	}
+
+	json_object_put(za);
+	return (result);
+}
+
+static isc_result_t
+zonestream_jsonnext(isc_buffer_t *b, void *arg) {
+	zonestream_t *zs = arg;
+	json_object *bindstats;
+	dns_view_t *view;
+	isc_boolean_t haszones;
+	const char *s;
+	isc_result_t result;
+
+	if (b == NULL) {
+		zonestream_destroy(&zs);
+		return (ISC_R_SUCCESS);
+	}
+	if (zs->done)
+		return (ISC_R_NOMORE);
+
+	isc_buffer_clear(zs->buffer);
+
+	if (!zs->started) {
+		bindstats = json_object_new_object();
+		if (bindstats == NULL)
+			return (ISC_R_NOMEMORY);
+		result = json_header(bindstats);
+		if (result == ISC_R_SUCCESS) {
+			/* Leave the object open for the views. */
+			s = json_object_to_json_string(bindstats);
+			result = zonestream_puts(zs, s, strlen(s) - 1);
+		}
+		json_object_put(bindstats);
+		CHECK(result);
+		CHECK(zonestream_puts(zs, ",\"views\":{", 10));
+		zs->started = ISC_TRUE;
+	}
+
+	while (isc_buffer_usedlength(zs->buffer) < ZONESTREAM_PIECE) {
+		if (zs->curview == zs->nviews) {
+			CHECK(zonestream_puts(zs, "}}", 2));
+			zs->done = ISC_TRUE;
+			break;
+		}
+
+		/* Views without zones have no "zones" array. */
+		view = zs->views[zs->curview];
+		haszones = ISC_TF(ZONESTREAM_VIEWSTART(zs, zs->curview) <
+				  zs->viewends[zs->curview]);
+		if (!zs->inview) {
+			if (zs->curview > 0)
+				CHECK(zonestream_puts(zs, ",", 1));
+			CHECK(zonestream_putstring(zs, view->name));
+			CHECK(zonestream_puts(zs, ":{", 2));
+			if (haszones)
+				CHECK(zonestream_puts(zs, "\"zones\":[", 9));
+			zs->inview = ISC_TRUE;
+			zs->comma = ISC_FALSE;
+		}
+
+		if (zs->curzone < zs->viewends[zs->curview]) {
+			CHECK(zonestream_jsonzone(zs,
+						  zs->zones[zs->curzone]));
+			dns_zone_detach(&zs->zones[zs->curzone]);
+			zs->curzone++;
+		} else {
+			if (haszones)
+				CHECK(zonestream_puts(zs, "]}", 2));
+			else
+				CHECK(zonestream_puts(zs, "}", 1));
+			zs->inview = ISC_FALSE;
+			zs->curview++;
+		}
+	}
+
+	zonestream_piece(zs, b);
+	return (ISC_R_SUCCESS);
+
+ error:
+	isc_log_write(ns_g_lctx, NS_LOGCATEGORY_GENERAL, NS_LOGMODULE_SERVER,
+		      ISC_LOG_ERROR, "failed streaming JSON zone statistics");
+	return (result);
+}
+
+static isc_result_t
+render_json_zonestream(const char *url, isc_httpdurl_t *urlinfo,
+		       const char *querystring, const char *headers,
+		       void *arg, unsigned int *retcode, const char **retmsg,
+		       const char **mimetype, isc_httpdnext_t **nextp,
+		       void **next_argp)
+{
+	ns_server_t *server = arg;
+	zonestream_t *zs = NULL;
+	isc_result_t result;
+
+	UNUSED(url);
+	UNUSED(urlinfo);
+	UNUSED(headers);
+
+	result = zonestream_create(server, querystring, &zs);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	*retcode = 200;
+	*retmsg = "OK";
+	*mimetype = "application/json";
+	*nextp = zonestream_jsonnext;
+	*next_argp = zs;
+
+	return (ISC_R_SUCCESS);
+}
 #endif /* HAVE_JSON */
 
 static isc_result_t
@@ -3148,8 +4740,8 @@ add_listener(ns_server_t *server, ns_statschannel_t **listenerp,
 			    render_xml_status, server);
 	isc_httpdmgr_addurl(listener->httpdmgr, "/xml/v3/server",
 			    render_xml_server, server);
-	isc_httpdmgr_addurl(listener->httpdmgr, "/xml/v3/zones",
-			    render_xml_zones, server);
+	isc_httpdmgr_addstream(listener->httpdmgr, "/xml/v3/zones",
+			       render_xml_zonestream, server);
 	isc_httpdmgr_addurl(listener->httpdmgr, "/xml/v3/net",
 			    render_xml_net, server);
 	isc_httpdmgr_addurl(listener->httpdmgr, "/xml/v3/tasks",
@@ -3158,6 +4750,8 @@ add_listener(ns_server_t *server, ns_statschannel_t **listenerp,
 			    render_xml_mem, server);
 	isc_httpdmgr_addurl(listener->httpdmgr, "/xml/v3/traffic",
 			    render_xml_traffic, server);
+	isc_httpdmgr_addurl(listener->httpdmgr, "/xml/v3/latency",
+			    render_xml_latency, server);
 #endif
 #ifdef HAVE_JSON
 	isc_httpdmgr_addurl(listener->httpdmgr, "/json",
@@ -3168,8 +4762,8 @@ add_listener(ns_server_t *server, ns_statschannel_t **listenerp,
 			    render_json_status, server);
 	isc_httpdmgr_addurl(listener->httpdmgr, "/json/v1/server",
 			    render_json_server, server);
-	isc_httpdmgr_addurl(listener->httpdmgr, "/json/v1/zones",
-			    render_json_zones, server);
+	isc_httpdmgr_addstream(listener->httpdmgr, "/json/v1/zones",
+			       render_json_zonestream, server);
 	isc_httpdmgr_addurl(listener->httpdmgr, "/json/v1/tasks",
 			    render_json_tasks, server);
 	isc_httpdmgr_addurl(listener->httpdmgr, "/json/v1/net",
@@ -3178,6 +4772,12 @@ add_listener(ns_server_t *server, ns_statschannel_t **listenerp,
 			    render_json_mem, server);
 	isc_httpdmgr_addurl(listener->httpdmgr, "/json/v1/traffic",
 			    render_json_traffic, server);
+	isc_httpdmgr_addurl(listener->httpdmgr, "/json/v1/latency",
+			    render_json_latency, server);
+#endif
+#ifdef EXTENDED_STATS
+	isc_httpdmgr_addstream(listener->httpdmgr, "/metrics",
+			       render_metrics, server);
 #endif
 	isc_httpdmgr_addurl2(listener->httpdmgr, "/bind9.xsl", ISC_TRUE,
 			     render_xsl, server);
@@ -14,6 +14,7 @@
 #include <isc/mem.h>
 #include <isc/timer.h>
 #include <isc/print.h>
+#include <isc/socket.h>
 #include <isc/stats.h>
 #include <isc/util.h>
 
@@ -10,6 +10,7 @@
 
 #include <isc/buffer.h>
 #include <isc/file.h>
+#include <isc/histo.h>
 #include <isc/mem.h>
 #include <isc/print.h>
 #include <isc/stats.h>
@@ -818,6 +819,7 @@ ns_zone_configure(const cfg_obj_t *config, const cfg_obj_t *vconfig,
 	const dns_master_style_t *masterstyle = &dns_master_style_default;
 	isc_stats_t *zoneqrystats;
 	dns_stats_t *rcvquerystats;
+	isc_histo_t *xfrintimes;
 	dns_zonestat_level_t statlevel;
 	int seconds;
 	dns_zone_t *mayberaw = (raw != NULL) ? raw : zone;
@@ -1094,14 +1096,18 @@ ns_zone_configure(const cfg_obj_t *config, const cfg_obj_t *vconfig,
 
 	zoneqrystats  = NULL;
 	rcvquerystats = NULL;
+	xfrintimes = NULL;
 	if (statlevel == dns_zonestat_full) {
 		RETERR(isc_stats_create(mctx, &zoneqrystats,
 					dns_nsstatscounter_max));
 		RETERR(dns_rdatatypestats_create(mctx,
 					&rcvquerystats));
+		if (ztype == dns_zone_slave)
+			RETERR(isc_histo_create(mctx, 0, &xfrintimes));
 	}
 	dns_zone_setrequeststats(zone,  zoneqrystats);
 	dns_zone_setrcvquerystats(zone, rcvquerystats);
+	dns_zone_setxfrintimes(zone, xfrintimes);
 
 	if (zoneqrystats != NULL)
 		isc_stats_detach(&zoneqrystats);
@@ -1109,6 +1115,9 @@ ns_zone_configure(const cfg_obj_t *config, const cfg_obj_t *vconfig,
 	if(rcvquerystats != NULL)
 		dns_stats_detach(&rcvquerystats);
 
+	if (xfrintimes != NULL)
+		isc_histo_detach(&xfrintimes);
+
 	/*
 	 * Configure master functionality.  This applies
 	 * to primary masters (type "master") and slaves
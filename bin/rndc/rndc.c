@@ -120,6 +120,10 @@ command is one of the following:\n\
 		process id.\n\
   loadkeys zone [class [view]]\n\
 		Update keys without signing immediately.\n\
+  lockprofile [on [rate] | off | reset]\n\
+		Enable, disable or clear lock contention profiling,\n\
+		sampling one lock acquisition in 'rate' (default 100),\n\
+		or display the profile.\n\
   managed-keys refresh [class [view]]\n\
 		Check trust anchor for RFC 5011 key changes\n\
   managed-keys status [class [view]]\n\
@@ -155,6 +159,8 @@ command is one of the following:\n\
 		Reload a single zone.\n\
   retransfer zone [class [view]]\n\
 		Retransfer a single zone without checking serial number.\n\
+  savecache [view]\n\
+		Write a snapshot of the cache(s) to the cache file(s).\n\
   scan		Scan available network interfaces for changes.\n\
   secroots [view ...]\n\
 		Write security roots to the secroots file.\n\
@@ -188,6 +194,9 @@ command is one of the following:\n\
   sync [-clean] zone [class [view]]\n\
 		Dump a single zone's changes to disk, and optionally\n\
 		remove its journal file.\n\
+  taskprofile [on | off | reset]\n\
+		Enable, disable or clear task profiling, or display the\n\
+		profile.\n\
   thaw		Enable updates to all dynamic zones and reload them.\n\
   thaw zone [class [view]]\n\
 		Enable updates to a frozen dynamic zone and reload it.\n\
@@ -14,8 +14,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <isc/commandline.h>
+#include <isc/mem.h>
 #include <isc/print.h>
 #include <isc/thread.h>
+#include <isc/time.h>
 #include <isc/rwlock.h>
 #include <isc/string.h>
 #include <isc/util.h>
@@ -90,6 +93,79 @@ run2(void *arg) {
 	return ((isc_threadresult_t)0);
 }
 
+/*
+ * Benchmark: each worker takes the lock 'iterations' times, for writing
+ * once in every 'ratio' times and otherwise for reading.  Writers
+ * update 'first' and 'second' together, and readers check that they
+ * agree.
+ */
+static unsigned int iterations = 1000000;
+static unsigned int ratio = 1000;
+static unsigned int first, second;
+
+static isc_threadresult_t
+#ifdef WIN32
+WINAPI
+#endif
+bench(void *arg) {
+	unsigned int i, writes = 0;
+
+	UNUSED(arg);
+
+	for (i = 1; i <= iterations; i++) {
+		if (i % ratio == 0) {
+			RWLOCK(&lock, isc_rwlocktype_write);
+			first++;
+			second++;
+			RWUNLOCK(&lock, isc_rwlocktype_write);
+			writes++;
+		} else {
+			RWLOCK(&lock, isc_rwlocktype_read);
+			RUNTIME_CHECK(first == second);
+			RWUNLOCK(&lock, isc_rwlocktype_read);
+		}
+	}
+	return ((isc_threadresult_t)(size_t)writes);
+}
+
+static void
+runbench(const char *kind, unsigned int nworkers) {
+	isc_thread_t workers[100];
+	isc_threadresult_t writes;
+	isc_time_t start, end;
+	isc_uint64_t usec;
+	unsigned int i, total = 0;
+
+	first = second = 0;
+	RUNTIME_CHECK(isc_time_now(&start) == ISC_R_SUCCESS);
+	for (i = 0; i < nworkers; i++)
+		RUNTIME_CHECK(isc_thread_create(bench, NULL, &workers[i]) ==
+			      ISC_R_SUCCESS);
+	for (i = 0; i < nworkers; i++) {
+		(void)isc_thread_join(workers[i], &writes);
+		total += (unsigned int)(size_t)writes;
+	}
+	RUNTIME_CHECK(isc_time_now(&end) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(first == total);
+
+	usec = isc_time_microdiff(&end, &start);
+	if (usec == 0)
+		usec = 1;
+	printf("%-12s %u workers, %u locks, 1 write in %u: "
+	       "%" ISC_PRINT_QUADFORMAT "u us, "
+	       "%" ISC_PRINT_QUADFORMAT "u locks/s\n",
+	       kind, nworkers, nworkers * iterations, ratio, usec,
+	       (isc_uint64_t)nworkers * iterations * 1000000 / usec);
+}
+
+static void
+usage(void) {
+	fprintf(stderr, "usage: rwlock_test [nworkers]\n"
+		"       rwlock_test -b [-i iterations] [-r ratio] "
+		"[nworkers]\n");
+	exit(1);
+}
+
 int
 main(int argc, char *argv[]) {
 	unsigned int nworkers;
@@ -97,13 +173,55 @@ main(int argc, char *argv[]) {
 	isc_thread_t workers[100];
 	char name[100];
 	void *dupname;
+	isc_boolean_t benchmark = ISC_FALSE;
+	isc_mem_t *mctx = NULL;
+	int ch;
 
-	if (argc > 1)
-		nworkers = atoi(argv[1]);
+	while ((ch = isc_commandline_parse(argc, argv, "bi:r:")) != -1) {
+		switch (ch) {
+		case 'b':
+			benchmark = ISC_TRUE;
+			break;
+		case 'i':
+			iterations = atoi(isc_commandline_argument);
+			break;
+		case 'r':
+			ratio = atoi(isc_commandline_argument);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= isc_commandline_index;
+	argv += isc_commandline_index;
+	if (iterations == 0 || ratio == 0)
+		usage();
+
+	if (argc > 0)
+		nworkers = atoi(argv[0]);
 	else
 		nworkers = 2;
 	if (nworkers > 100)
 		nworkers = 100;
+	if (nworkers == 0)
+		usage();
+
+	if (benchmark) {
+		RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+
+		RUNTIME_CHECK(isc_rwlock_init(&lock, 0, 0) == ISC_R_SUCCESS);
+		runbench("standard", nworkers);
+		isc_rwlock_destroy(&lock);
+
+		RUNTIME_CHECK(isc_rwlock_initdistributed(&lock, mctx) ==
+			      ISC_R_SUCCESS);
+		runbench("distributed", nworkers);
+		isc_rwlock_destroy(&lock);
+
+		isc_mem_destroy(&mctx);
+		return (0);
+	}
+
 	printf("%d workers\n", nworkers);
 
 	RUNTIME_CHECK(isc_rwlock_init(&lock, 5, 10) == ISC_R_SUCCESS);
@@ -14,3 +14,6 @@ rm -f ns*/named.lock
 rm -f ns*/named.stats
 rm -f xml.*stats json.*stats
 rm -f compressed.headers regular.headers compressed.out regular.out
+rm -f zones.*
+rm -f metrics.*
+rm -f latency.*
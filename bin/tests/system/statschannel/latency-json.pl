@@ -0,0 +1,37 @@
+#!/usr/bin/perl
+#
+# Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+# latency-json.pl:
+# Parses the JSON version of the query latency histograms into a
+# normalized format.
+
+use JSON;
+
+my $file = $ARGV[0];
+open(INPUT, "<$file");
+my $text = do{local$/;<INPUT>};
+close(INPUT);
+
+my $ref = decode_json($text);
+
+print "version " . $ref->{"json-stats-version"} . "\n";
+
+foreach $name ("cache-hit", "cache-miss", "auth", "rpz") {
+    my $histo = $ref->{latency}->{$name};
+    next unless defined $histo;
+    print "histogram " . $name . " " . $histo->{unit} . "\n";
+    print "count " . $histo->{count} . "\n";
+    foreach $quantile ("p50", "p90", "p99", "p99.9") {
+	print "quantile " . $quantile . " " .
+	      $histo->{quantiles}->{$quantile} . "\n";
+    }
+    foreach $bucket (@{$histo->{buckets}}) {
+	print "bucket " . $bucket->{lower} . " " . $bucket->{upper} . " " .
+	      $bucket->{count} . "\n";
+    }
+}
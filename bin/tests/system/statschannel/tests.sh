@@ -35,7 +35,7 @@ else
     echo "I:XML tests require XML::Simple; skipping" >&2
 fi
 
-if [ ! "$PERL_JSON" -a ! "$PERL_XML" ]; then
+if [ ! "$PERL_JSON" -a ! "$PERL_XML" -a ! "$CURL" ]; then
     echo "I:skipping all tests"
     exit 0
 fi
@@ -208,5 +208,399 @@ if [ $ret != 0 ]; then echo "I: failed"; fi
 status=`expr $status + $ret`
 n=`expr $n + 1`
 
+#
+# The zone statistics are streamed: chunked for HTTP/1.1 clients and
+# delimited by the connection closing for HTTP/1.0 clients.
+#
+if [ -n "$CURL" ]; then
+    URLS=
+    if [ "$HAVEXMLSTATS" ]; then URLS="$URLS xml/v3/zones"; fi
+    if [ "$HAVEJSONSTATS" ]; then URLS="$URLS json/v1/zones"; fi
+fi
+
+# Print the names of the zones listed in a zone statistics document.
+zonenames() {
+    case $1 in
+    xml*)
+	grep -o '<zone name="[^"]*"' $2 |
+	    sed -e 's/^<zone name="//' -e 's/"$//' ;;
+    json*)
+	grep -o '"name": *"[^"]*"' $2 |
+	    sed -e 's/^"name": *"//' -e 's/"$//' ;;
+    esac | tr '\n' ' ' | sed -e 's/ $//'
+}
+
+# Fetch http://10.53.0.2:8853/$1 into $2.out, with the headers in
+# $2.headers; any further arguments are passed to curl.
+getzones() {
+    zurl=http://10.53.0.2:8853/$1
+    zout=$2
+    shift 2
+    $CURL -s -D $zout.headers "$@" "$zurl" > $zout.out 2>/dev/null
+}
+
+for url in $URLS; do
+    fmt=`echo $url | sed 's#/.*##'`
+
+    ret=0
+    echo "I:streaming $url over HTTP/1.1 ($n)"
+    getzones "$url?view=_default" zones.$fmt.$n || ret=1
+    grep "^HTTP/1.1 200" zones.$fmt.$n.headers > /dev/null || ret=1
+    grep -i "^Transfer-Encoding: chunked" zones.$fmt.$n.headers > /dev/null ||
+	ret=1
+    grep -i "^Content-Length:" zones.$fmt.$n.headers > /dev/null && ret=1
+    case $fmt in
+    xml)
+	grep "</statistics>" zones.$fmt.$n.out > /dev/null || ret=1
+	if [ -n "$XMLLINT" ]; then
+	    $XMLLINT --noout zones.$fmt.$n.out > /dev/null 2>&1 || ret=1
+	fi
+	;;
+    json)
+	tail -c 2 zones.$fmt.$n.out | grep '}}' > /dev/null || ret=1
+	;;
+    esac
+    names=`zonenames $fmt zones.$fmt.$n.out`
+    for zone in example z1.test z2.test z3.test; do
+	case " $names " in
+	*" $zone "*) ;;
+	*) ret=1 ;;
+	esac
+    done
+    cp zones.$fmt.$n.out zones.$fmt.http11
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+
+    ret=0
+    echo "I:streaming $url over HTTP/1.0 ($n)"
+    getzones "$url?view=_default" zones.$fmt.$n --http1.0 || ret=1
+    grep "^HTTP/1.0 200" zones.$fmt.$n.headers > /dev/null || ret=1
+    grep -i "^Connection: close" zones.$fmt.$n.headers > /dev/null || ret=1
+    grep -i "^Transfer-Encoding:" zones.$fmt.$n.headers > /dev/null && ret=1
+    sed -e 's#<current-time>.*</current-time>##' \
+	-e 's#"current-time": *"[^"]*"##' zones.$fmt.http11 > zones.$fmt.a
+    sed -e 's#<current-time>.*</current-time>##' \
+	-e 's#"current-time": *"[^"]*"##' zones.$fmt.$n.out > zones.$fmt.b
+    cmp -s zones.$fmt.a zones.$fmt.b || ret=1
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+
+    ret=0
+    echo "I:filtering $url by view and zone ($n)"
+    getzones "$url?view=_default&zone=test" zones.$fmt.$n.1 || ret=1
+    names=`zonenames $fmt zones.$fmt.$n.1.out`
+    [ "$names" = "z1.test z2.test z3.test" ] || ret=1
+    getzones "$url?zone=z2.test" zones.$fmt.$n.2 || ret=1
+    names=`zonenames $fmt zones.$fmt.$n.2.out`
+    [ "$names" = "z2.test" ] || ret=1
+    getzones "$url?view=_bind" zones.$fmt.$n.3 || ret=1
+    names=`zonenames $fmt zones.$fmt.$n.3.out`
+    case " $names " in
+    *" z1.test "*|*" example "*) ret=1 ;;
+    *" version.bind "*) ;;
+    *) ret=1 ;;
+    esac
+    getzones "$url?view=nosuchview" zones.$fmt.$n.4 || ret=1
+    grep "^HTTP/1.1 200" zones.$fmt.$n.4.headers > /dev/null || ret=1
+    names=`zonenames $fmt zones.$fmt.$n.4.out`
+    [ -z "$names" ] || ret=1
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+
+    ret=0
+    echo "I:paginating $url with offset and limit ($n)"
+    q="view=_default&zone=test"
+    getzones "$url?$q&limit=2" zones.$fmt.$n.1 || ret=1
+    names=`zonenames $fmt zones.$fmt.$n.1.out`
+    [ "$names" = "z1.test z2.test" ] || ret=1
+    getzones "$url?$q&offset=2&limit=2" zones.$fmt.$n.2 || ret=1
+    names=`zonenames $fmt zones.$fmt.$n.2.out`
+    [ "$names" = "z3.test" ] || ret=1
+    getzones "$url?$q&offset=1&limit=1" zones.$fmt.$n.3 || ret=1
+    names=`zonenames $fmt zones.$fmt.$n.3.out`
+    [ "$names" = "z2.test" ] || ret=1
+    getzones "$url?$q&offset=3" zones.$fmt.$n.4 || ret=1
+    names=`zonenames $fmt zones.$fmt.$n.4.out`
+    [ -z "$names" ] || ret=1
+    getzones "$url?$q&limit=0" zones.$fmt.$n.5 || ret=1
+    names=`zonenames $fmt zones.$fmt.$n.5.out`
+    [ -z "$names" ] || ret=1
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+
+    ret=0
+    echo "I:rejecting bad $url query strings ($n)"
+    i=1
+    for q in "offset=x" "limit=-1" "limit=4294967296" "offset=" "limit" \
+	     "zone=bad..name"
+    do
+	getzones "$url?$q" zones.$fmt.$n.$i || ret=1
+	grep "^HTTP/1.1 500" zones.$fmt.$n.$i.headers > /dev/null || {
+	    echo "I: '$q' was not rejected"
+	    ret=1
+	}
+	i=`expr $i + 1`
+    done
+    # The server is still answering.
+    getzones "$url?view=_default&limit=1" zones.$fmt.$n.$i || ret=1
+    grep "^HTTP/1.1 200" zones.$fmt.$n.$i.headers > /dev/null || ret=1
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+done
+
+ret=0
+echo "I:scraping /metrics ($n)"
+if [ -n "$CURL" ]; then
+    for i in 1 2 3; do
+	$DIGCMD z1.test naptr > dig.out.$n.$i || ret=1
+    done
+    $CURL -s -D metrics.headers http://10.53.0.2:8853/metrics \
+	> metrics.out 2>/dev/null || ret=1
+    grep "^HTTP/1.1 200" metrics.headers > /dev/null || ret=1
+    grep -i "^Content-Type: text/plain; version=0.0.4" metrics.headers \
+	> /dev/null || ret=1
+else
+    echo "I:skipped"
+fi
+if [ $ret != 0 ]; then echo "I: failed"; fi
+status=`expr $status + $ret`
+n=`expr $n + 1`
+
+if [ -n "$CURL" ]; then
+    ret=0
+    echo "I:checking /metrics HELP and TYPE lines ($n)"
+    # Every family has a HELP line followed by a TYPE line, once, and
+    # its samples follow them with no other family in between.
+    awk '/^# HELP / {
+	    if (help[$3]++) { print "duplicate HELP: " $0; bad = 1 }
+	    helped = $3
+	    next
+	}
+	/^# TYPE / {
+	    if ($3 != helped) { print "TYPE without HELP: " $0; bad = 1 }
+	    if (type[$3]++) { print "duplicate TYPE: " $0; bad = 1 }
+	    if ($4 != "counter" && $4 != "gauge" && $4 != "untyped") {
+		print "bad TYPE: " $0; bad = 1
+	    }
+	    if ($4 == "counter" && $3 !~ /_total$/) {
+		print "counter not named _total: " $0; bad = 1
+	    }
+	    family = $3; helped = ""
+	    next
+	}
+	/^#/ { print "bad comment: " $0; bad = 1; next }
+	{
+	    name = $1; sub(/{.*/, "", name)
+	    if (name != family) { print "stray sample: " $0; bad = 1 }
+	    if ($NF !~ /^[0-9]+$/) { print "bad value: " $0; bad = 1 }
+	}
+	END { exit bad }' metrics.out > metrics.check || ret=1
+    sed 's/^/I: /' metrics.check
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+
+    ret=0
+    echo "I:checking /metrics counters ($n)"
+    sample() {
+	grep -F "$1 " metrics.out | awk '{ print $NF }'
+    }
+    value=`sample 'bind_qtype_total{type="NAPTR"}'`
+    [ "$value" = 3 ] || ret=1
+    queries=`sample 'bind_opcode_total{opcode="QUERY"}'`
+    [ "${queries:-0}" -ge 3 ] || ret=1
+    requests=`sample 'bind_nsstat_total{name="Requestv4"}'`
+    [ "${requests:-0}" -ge "$queries" ] || ret=1
+    udpin=`grep '^bind_traffic_total{transport="udp",family="ipv4",direction="received",' \
+	   metrics.out | awk '{ sum += $NF } END { print sum + 0 }'`
+    [ "$udpin" -ge 3 ] || ret=1
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+
+    ret=0
+    echo "I:checking /metrics per-zone families ($n)"
+    z1='view="_default",zone="z1.test"'
+    z2='view="_default",zone="z2.test"'
+    value=`sample "bind_zone_serial{$z2}"`
+    [ "$value" = 1 ] || ret=1
+    value=`sample "bind_zone_qtype_total{$z1,type=\"NAPTR\"}"`
+    [ "$value" = 3 ] || ret=1
+    value=`sample "bind_zone_nsstat_total{$z1,name=\"QryNxrrset\"}"`
+    [ "$value" = 3 ] || ret=1
+    # z2.test keeps terse statistics: a serial but no counters.
+    grep '^bind_zone_[a-z]*_total{view="_default",zone="z2.test"' \
+	metrics.out > /dev/null && ret=1
+    # The per-zone families come last, each once, in order.
+    grep "^# TYPE bind_zone_" metrics.out | awk '{ print $3 }' |
+	tr '\n' ' ' > metrics.stages
+    [ "`cat metrics.stages`" = "bind_zone_serial bind_zone_nsstat_total bind_zone_qtype_total " ] ||
+	ret=1
+    tail -1 metrics.out | grep "^bind_zone_qtype_total{" > /dev/null ||
+	ret=1
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+
+    ret=0
+    echo "I:checking /metrics label escaping ($n)"
+    # The zone is quo\"te\\back.example: the backslashes and the
+    # quote of its text form are each escaped with a backslash.
+    grep -F 'bind_zone_serial{view="_default",zone="quo\\\"te\\\\back.example"} 1' \
+	metrics.out > /dev/null || ret=1
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+
+    ret=0
+    echo "I:filtering /metrics by view and zone ($n)"
+    $CURL -s "http://10.53.0.2:8853/metrics?view=_default&zone=test" \
+	> metrics.filtered 2>/dev/null || ret=1
+    grep '^bind_opcode_total{opcode="QUERY"}' metrics.filtered \
+	> /dev/null || ret=1
+    grep -o 'zone="[^"]*"' metrics.filtered | sort -u > metrics.zones
+    [ "`cat metrics.zones | tr '\n' ' '`" = 'zone="z1.test" zone="z2.test" zone="z3.test" ' ] ||
+	ret=1
+    grep 'view="_bind"' metrics.filtered > /dev/null && ret=1
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+fi
+
+#
+# The latency histograms, normalized to lines of the form
+#
+#	version V
+#	histogram NAME UNIT
+#	count N
+#	quantile NAME VALUE
+#	bucket LOWER UPPER COUNT
+#
+getlatency() {
+    case $1 in
+    xml)
+	$CURL -s http://10.53.0.2:8853/xml/v3/latency 2>/dev/null |
+	    tr '<' '\n' |
+	    sed -n -e 's/^statistics version="\([^"]*\)".*/version \1/p' \
+		-e 's/^histogram name="\([^"]*\)" unit="\([^"]*\)".*/histogram \1 \2/p' \
+		-e 's/^count>\([0-9]*\)$/count \1/p' \
+		-e 's/^quantile name="\([^"]*\)">\([0-9]*\)$/quantile \1 \2/p' \
+		-e 's/^bucket lower="\([0-9]*\)" upper="\([0-9]*\)">\([0-9]*\)$/bucket \1 \2 \3/p'
+	;;
+    json)
+	$CURL -s http://10.53.0.2:8853/json/v1/latency > latency.json \
+	    2>/dev/null &&
+	$PERL latency-json.pl latency.json
+	;;
+    esac
+}
+
+# Check the layout of normalized histograms: the four histograms in
+# order, each with its quantiles in order and never decreasing, and
+# with its non-empty buckets ascending, disjoint and adding up to the
+# count.  Print the count of the auth histogram.
+checklatency() {
+    awk -v version=$2 '
+	function endhisto() {
+	    if (histo == "")
+		return
+	    if (nq != 4) { print "I: " histo ": " nq " quantiles"; bad = 1 }
+	    if (sum != count) {
+		print "I: " histo ": buckets add up to " sum ", not " count
+		bad = 1
+	    }
+	    if (count == 0 && (nb != 0 || q["p99.9"] != 0)) {
+		print "I: " histo ": empty histogram has values"; bad = 1
+	    }
+	    if (count > 0 && (q["p50"] < first || q["p99.9"] > last)) {
+		print "I: " histo ": quantiles outside the buckets"; bad = 1
+	    }
+	}
+	$1 == "version" {
+	    if ($2 != version) { print "I: version " $2; bad = 1 }
+	    next
+	}
+	$1 == "histogram" {
+	    endhisto()
+	    histo = $2; names = names " " $2
+	    if ($3 != "us") { print "I: " histo ": unit " $3; bad = 1 }
+	    nq = 0; nb = 0; sum = 0; prevq = 0; prevupper = -1
+	    split("", q)
+	    next
+	}
+	$1 == "count" { count = $2; if (histo == "auth") auth = $2; next }
+	$1 == "quantile" {
+	    split("p50 p90 p99 p99.9", qnames, " ")
+	    if ($2 != qnames[++nq]) {
+		print "I: " histo ": quantile " $2 " out of order"; bad = 1
+	    }
+	    if ($3 < prevq) {
+		print "I: " histo ": quantile " $2 " decreases"; bad = 1
+	    }
+	    q[$2] = $3; prevq = $3
+	    next
+	}
+	$1 == "bucket" {
+	    if ($2 > $3 || $2 <= prevupper || $4 == 0) {
+		print "I: " histo ": bad bucket " $2 ".." $3 ": " $4
+		bad = 1
+	    }
+	    if (nb++ == 0)
+		first = $2
+	    last = $3; prevupper = $3; sum += $4
+	    next
+	}
+	{ print "I: unexpected: " $0; bad = 1 }
+	END {
+	    endhisto()
+	    if (names != " cache-hit cache-miss auth rpz") {
+		print "I: histograms:" names; bad = 1
+	    }
+	    if (!bad)
+		print auth
+	    exit bad
+	}' $1
+}
+
+LATENCY=
+if [ -n "$CURL" -a "$HAVEXMLSTATS" ]; then
+    LATENCY="$LATENCY xml"
+fi
+if [ -n "$CURL" -a "$PERL_JSON" ]; then
+    LATENCY="$LATENCY json"
+fi
+
+for fmt in $LATENCY; do
+    case $fmt in
+    xml) version=3.9 ;;
+    json) version=1.3 ;;
+    esac
+
+    ret=0
+    echo "I:checking $fmt latency histogram layout ($n)"
+    getlatency $fmt > latency.$fmt.1 || ret=1
+    before=`checklatency latency.$fmt.1 $version` || ret=1
+    for i in 1 2 3; do
+	$DIGCMD example soa > dig.out.$n.$i || ret=1
+    done
+    getlatency $fmt > latency.$fmt.2 || ret=1
+    after=`checklatency latency.$fmt.2 $version` || ret=1
+    if [ $ret = 0 ]; then
+	# Each authoritative answer was timed.
+	[ `expr $after - $before` -ge 3 ] || ret=1
+	grep "^bucket " latency.$fmt.2 > /dev/null || ret=1
+    else
+	echo "$before" "$after" | grep "^I:"
+    fi
+    if [ $ret != 0 ]; then echo "I: failed"; fi
+    status=`expr $status + $ret`
+    n=`expr $n + 1`
+done
+
 echo "I:exit status: $status"
 [ $status -eq 0 ] || exit 1
@@ -10,4 +10,5 @@ rm -f */named.memstats
 rm -f */named.run
 rm -f */named.stats
 rm -f dig.out*
+rm -f tcpclients.out*
 rm -f ns*/named.lock
@@ -0,0 +1,111 @@
+#!/usr/bin/perl
+#
+# Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+# Exercise the TCP client quota and query pipelining of a server.
+#
+# Usage: tcpclients.pl -a <address> -p <port> conns <n>
+#        tcpclients.pl -a <address> -p <port> pipe <n>
+#
+# "conns" opens <n> connections without sending anything, waits for
+# the server to close the ones over its quota, and prints the number
+# of connections still open and closed.
+#
+# "pipe" sends <n> queries for ./SOA back to back over a single
+# connection and prints the number of distinct queries answered.
+
+require 5.006_001;
+
+use strict;
+use Getopt::Std;
+use IO::Select;
+use IO::Socket;
+
+sub usage {
+    print ("Usage: tcpclients.pl -a address -p port (conns|pipe) n\n");
+    exit 1;
+}
+
+my %options = ();
+getopts("a:p:", \%options);
+
+my $addr = "10.53.0.5";
+$addr = $options{a} if defined $options{a};
+
+my $port = 5300;
+$port = $options{p} if defined $options{p};
+
+usage() if (@ARGV != 2);
+my ($mode, $count) = @ARGV;
+
+sub connect_server {
+    my $sock = IO::Socket::INET->new(PeerAddr => $addr,
+				     PeerPort => $port,
+				     Proto => "tcp") or die "connect: $!";
+    return $sock;
+}
+
+# Read exactly $len octets, or return undef at EOF or timeout.
+sub read_octets {
+    my ($sock, $len) = @_;
+    my $sel = IO::Select->new($sock);
+    my $buf = "";
+    while (length($buf) < $len) {
+	return undef unless $sel->can_read(5);
+	my $n = sysread($sock, $buf, $len - length($buf), length($buf));
+	return undef unless $n;
+    }
+    return $buf;
+}
+
+if ($mode eq "conns") {
+    my @socks;
+    for (my $i = 0; $i < $count; $i++) {
+	push @socks, connect_server();
+    }
+    sleep 2;
+
+    # A connection the server has closed is readable at EOF; an
+    # idle one it kept open is not.
+    my ($open, $closed) = (0, 0);
+    my $sel = IO::Select->new(@socks);
+    my %ready = map { $_ => 1 } $sel->can_read(1);
+    foreach my $sock (@socks) {
+	my $buf;
+	if ($ready{$sock} && !sysread($sock, $buf, 1)) {
+	    $closed++;
+	} else {
+	    $open++;
+	}
+    }
+    print "open $open closed $closed\n";
+    close($_) foreach @socks;
+} elsif ($mode eq "pipe") {
+    my $sock = connect_server();
+    my $queries = "";
+    for (my $id = 1; $id <= $count; $id++) {
+	# ID, RD clear, one question: ./SOA/IN
+	my $msg = pack("nnnnnn", $id, 0, 1, 0, 0, 0) . pack("Cnn", 0, 6, 1);
+	$queries .= pack("n", length($msg)) . $msg;
+    }
+    syswrite($sock, $queries);
+
+    my %answered;
+    for (my $i = 0; $i < $count; $i++) {
+	my $len = read_octets($sock, 2);
+	last unless defined $len;
+	my $msg = read_octets($sock, unpack("n", $len));
+	last unless defined $msg;
+	my ($id, $flags) = unpack("nn", $msg);
+	# QR set and RCODE NOERROR
+	$answered{$id} = 1 if (($flags & 0x800f) == 0x8000);
+    }
+    print "answered " . scalar(keys %answered) . "\n";
+    close($sock);
+} else {
+    usage();
+}
@@ -49,5 +49,75 @@ if [ "$ntcp21" -ge "$ntcp22" ];then ret=1; fi
 if [ $ret != 0 ]; then echo "I:failed"; fi
 status=`expr $status + $ret`
 
+echo "I:check TCP keepalive is advertised on request"
+ret=0
+$DIG -p 5300 @10.53.0.5 +tcp +ednsopt=11 . soa > dig.out.5.1 || ret=1
+grep "status: NOERROR" dig.out.5.1 > /dev/null || ret=1
+grep "; TCP-KEEPALIVE: 15.0 secs" dig.out.5.1 > /dev/null || ret=1
+if [ $ret != 0 ]; then echo "I:failed"; fi
+status=`expr $status + $ret`
+
+echo "I:check TCP keepalive is not advertised unless requested"
+ret=0
+$DIG -p 5300 @10.53.0.5 +tcp . soa > dig.out.5.2 || ret=1
+grep "status: NOERROR" dig.out.5.2 > /dev/null || ret=1
+grep "TCP-KEEPALIVE" dig.out.5.2 > /dev/null && ret=1
+if [ $ret != 0 ]; then echo "I:failed"; fi
+status=`expr $status + $ret`
+
+echo "I:check TCP keepalive is ignored over UDP"
+ret=0
+$DIG -p 5300 @10.53.0.5 +notcp +ednsopt=11 . soa > dig.out.5.3 || ret=1
+grep "status: NOERROR" dig.out.5.3 > /dev/null || ret=1
+grep "TCP-KEEPALIVE" dig.out.5.3 > /dev/null && ret=1
+if [ $ret != 0 ]; then echo "I:failed"; fi
+status=`expr $status + $ret`
+
+echo "I:check TCP keepalive with a timeout from the client is FORMERR"
+ret=0
+$DIG -p 5300 @10.53.0.5 +tcp +ednsopt=11:0064 . soa > dig.out.5.4 || ret=1
+grep "status: FORMERR" dig.out.5.4 > /dev/null || ret=1
+$DIG -p 5300 @10.53.0.5 +notcp +ednsopt=11:0064 . soa > dig.out.5.5 || ret=1
+grep "status: FORMERR" dig.out.5.5 > /dev/null || ret=1
+if [ $ret != 0 ]; then echo "I:failed"; fi
+status=`expr $status + $ret`
+
+echo "I:check TCP keepalive option statistics"
+ret=0
+$RNDCCMD -s 10.53.0.5 stats > /dev/null 2>&1
+nka=`grep "TCP connections with keepalive option" ns5/named.stats | tail -1 | awk '{print $1}'`
+[ "$nka" = 1 ] || ret=1
+if [ $ret != 0 ]; then echo "I:failed"; fi
+status=`expr $status + $ret`
+
+if [ -n "$PERL" ]; then
+	TCPCLIENTS="$PERL tcpclients.pl -a 10.53.0.5 -p 5300"
+
+	echo "I:check pipelined TCP queries are all answered within the quota"
+	ret=0
+	$TCPCLIENTS pipe 20 > tcpclients.out.1 || ret=1
+	grep "^answered 20$" tcpclients.out.1 > /dev/null || ret=1
+	if [ $ret != 0 ]; then echo "I:failed"; fi
+	status=`expr $status + $ret`
+
+	echo "I:check TCP connections over the quota are closed"
+	ret=0
+	sleep 1
+	$TCPCLIENTS conns 6 > tcpclients.out.2 || ret=1
+	grep "^open 4 closed 2$" tcpclients.out.2 > /dev/null || ret=1
+	if [ $ret != 0 ]; then echo "I:failed"; fi
+	status=`expr $status + $ret`
+
+	echo "I:check TCP service resumes once connections close"
+	ret=0
+	sleep 1
+	$DIG -p 5300 @10.53.0.5 +tcp . soa > dig.out.5.6 || ret=1
+	grep "status: NOERROR" dig.out.5.6 > /dev/null || ret=1
+	if [ $ret != 0 ]; then echo "I:failed"; fi
+	status=`expr $status + $ret`
+else
+	echo "I:skipping TCP quota and pipelining checks: perl not found"
+fi
+
 echo "I:exit status: $status"
 [ $status -eq 0 ] || exit 1
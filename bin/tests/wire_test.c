@@ -16,6 +16,7 @@
 #include <isc/mem.h>
 #include <isc/print.h>
 #include <isc/string.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
 #include <dns/message.h>
@@ -25,6 +26,7 @@ int parseflags = 0;
 isc_mem_t *mctx = NULL;
 isc_boolean_t printmemstats = ISC_FALSE;
 isc_boolean_t dorender = ISC_FALSE;
+unsigned int repeat = 0;
 
 static void
 process_message(isc_buffer_t *source);
@@ -59,9 +61,11 @@ static void
 usage(void) {
 	fprintf(stderr, "wire_test [-b] [-d] [-p] [-r] [-s]\n");
 	fprintf(stderr, "          [-m {usage|trace|record|size|mctx}]\n");
+	fprintf(stderr, "          [-n count]\n");
 	fprintf(stderr, "          [filename]\n\n");
 	fprintf(stderr, "\t-b\tBest-effort parsing (ignore some errors)\n");
 	fprintf(stderr, "\t-d\tRead input as raw binary data\n");
+	fprintf(stderr, "\t-n\tTime parsing each message count times\n");
 	fprintf(stderr, "\t-p\tPreserve order of the records in messages\n");
 	fprintf(stderr, "\t-r\tAfter parsing, re-render the message\n");
 	fprintf(stderr, "\t-s\tPrint memory statistics\n");
@@ -109,7 +113,7 @@ main(int argc, char *argv[]) {
 	FILE *f;
 	int ch;
 
-#define CMDLINE_FLAGS "bdm:prst"
+#define CMDLINE_FLAGS "bdm:n:prst"
 	/*
 	 * Process memory debugging argument first.
 	 */
@@ -145,6 +149,10 @@ main(int argc, char *argv[]) {
 				break;
 			case 'm':
 				break;
+			case 'n':
+				repeat = strtoul(isc_commandline_argument,
+						 NULL, 10);
+				break;
 			case 'p':
 				parseflags |= DNS_MESSAGEPARSE_PRESERVEORDER;
 				break;
@@ -254,9 +262,43 @@ main(int argc, char *argv[]) {
 	return (0);
 }
 
+/*
+ * Parse the message at the start of 'source' 'repeat' times, resetting
+ * 'message' in between the way a server reuses a client's message, and
+ * report how long it took.
+ */
+static void
+time_parse(dns_message_t *message, isc_buffer_t *source) {
+	isc_buffer_t b;
+	isc_result_t result;
+	isc_time_t start, finish;
+	isc_uint64_t usecs;
+	unsigned int n;
+
+	result = isc_time_now(&start);
+	CHECKRESULT(result, "isc_time_now failed");
+	for (n = 0; n < repeat; n++) {
+		dns_message_reset(message, DNS_MESSAGE_INTENTPARSE);
+		b = *source;
+		result = dns_message_parse(message, &b, parseflags);
+		if (result == DNS_R_RECOVERABLE)
+			result = ISC_R_SUCCESS;
+		CHECKRESULT(result, "dns_message_parse failed");
+	}
+	result = isc_time_now(&finish);
+	CHECKRESULT(result, "isc_time_now failed");
+
+	usecs = isc_time_microdiff(&finish, &start);
+	if (usecs == 0)
+		usecs = 1;
+	printf(";; parsed %u times in %llu usec (%.0f/sec)\n", repeat,
+	       (unsigned long long)usecs, repeat * 1000000.0 / usecs);
+}
+
 static void
 process_message(isc_buffer_t *source) {
 	dns_message_t *message;
+	isc_buffer_t start;
 	isc_result_t result;
 	int i;
 
@@ -264,11 +306,15 @@ process_message(isc_buffer_t *source) {
 	result = dns_message_create(mctx, DNS_MESSAGE_INTENTPARSE, &message);
 	CHECKRESULT(result, "dns_message_create failed");
 
+	start = *source;
 	result = dns_message_parse(message, source, parseflags);
 	if (result == DNS_R_RECOVERABLE)
 		result = ISC_R_SUCCESS;
 	CHECKRESULT(result, "dns_message_parse failed");
 
+	if (repeat > 0)
+		time_parse(message, &start);
+
 	result = printmessage(message);
 	CHECKRESULT(result, "printmessage() failed");
 
@@ -878,6 +878,12 @@ typedef struct {
 	unsigned int max;
 } fstrmtable;
 
+typedef struct {
+	const char *name;
+	unsigned int min;
+	unsigned int max;
+} rangetable;
+
 typedef enum {
 	optlevel_config,
 	optlevel_options,
@@ -948,6 +954,16 @@ check_options(const cfg_obj_t *options, isc_log_t *logctx, isc_mem_t *mctx,
 	{ "statistics-interval", 60, 28 * 24 * 60 },	/* 28 days */
 	};
 
+	/*
+	 * TCP timeouts are in units of 100 milliseconds.
+	 */
+	static rangetable tcptimeouts[] = {
+	{ "tcp-initial-timeout", 25, 1200 },		/* 2.5 s .. 2 min */
+	{ "tcp-idle-timeout", 1, 1200 },		/* 0.1 s .. 2 min */
+	{ "tcp-keepalive-timeout", 1, 65535 },		/* RFC 7828 */
+	{ "tcp-advertised-timeout", 0, 65535 },		/* RFC 7828 */
+	};
+
 	static const char *server_contact[] = {
 		"empty-server", "empty-contact",
 		"dns64-server", "dns64-contact",
@@ -1014,6 +1030,22 @@ check_options(const cfg_obj_t *options, isc_log_t *logctx, isc_mem_t *mctx,
 		}
 	}
 
+	for (i = 0; i < sizeof(tcptimeouts) / sizeof(tcptimeouts[0]); i++) {
+		isc_uint32_t val;
+		obj = NULL;
+		(void)cfg_map_get(options, tcptimeouts[i].name, &obj);
+		if (obj == NULL)
+			continue;
+		val = cfg_obj_asuint32(obj);
+		if (val < tcptimeouts[i].min || val > tcptimeouts[i].max) {
+			cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
+				    "%s '%u' is out of range (%u..%u)",
+				    tcptimeouts[i].name, val,
+				    tcptimeouts[i].min, tcptimeouts[i].max);
+			result = ISC_R_RANGE;
+		}
+	}
+
 	obj = NULL;
 	cfg_map_get(options, "max-rsa-exponent-size", &obj);
 	if (obj != NULL) {
@@ -19,11 +19,14 @@
 
 #include <limits.h>
 
+#include <isc/buffer.h>
+#include <isc/file.h>
 #include <isc/mutexblock.h>
 #include <isc/netaddr.h>
 #include <isc/print.h>
 #include <isc/random.h>
 #include <isc/stats.h>
+#include <isc/stdio.h>
 #include <isc/string.h>         /* Required for HP/UX (and others?) */
 #include <isc/task.h>
 #include <isc/util.h>
@@ -65,6 +68,18 @@
 #define ADB_CACHE_MAXIMUM       86400   /*%< seconds (86400 = 24 hours) */
 #define ADB_ENTRY_WINDOW        1800    /*%< seconds */
 
+/*%
+ * The state file starts with a header of three 32-bit words: magic,
+ * version and the time it was written.  It is followed by one record
+ * per address: 16-bit address family (4 or 6), 16-bit port, the
+ * address itself and the 32-bit smoothed RTT in microseconds.  All
+ * values are in network byte order.
+ */
+#define ADB_STATE_MAGIC		0x41444253U	/* "ADBS" */
+#define ADB_STATE_VERSION	1U
+#define ADB_STATE_HDRSIZE	12U
+#define ADB_STATE_RECSIZE	24U		/* IPv6 record */
+
 /*%
  * The period in seconds after which an ADB name entry is regarded as stale
  * and forced to be cleaned up.
@@ -81,6 +96,23 @@
 
 #define DNS_ADB_MINADBSIZE      (1024U*1024U)     /*%< 1 Megabyte */
 
+/*%
+ * Names and entries are spread over a fixed number of lock stripes.  Each
+ * stripe owns a small chained hash table which is doubled whenever its
+ * load exceeds ADB_TABLE_MAXLOAD; the old chains are then moved across
+ * ADB_MIGRATE_BUCKETS at a time by later lookups and insertions in the
+ * same stripe, so a resize never holds more than one stripe lock.
+ */
+#ifdef TUNE_LARGE
+#define ADB_LOCKSTRIPES         4093
+#else
+#define ADB_LOCKSTRIPES         1021
+#endif /* TUNE_LARGE */
+#define ADB_TABLE_MINSIZE       4U      /*%< initial chains per stripe */
+#define ADB_TABLE_MAXSIZE       (1U << 20) /*%< maximum chains per stripe */
+#define ADB_TABLE_MAXLOAD       4U      /*%< average chain length to grow at */
+#define ADB_MIGRATE_BUCKETS     4U      /*%< old chains moved per access */
+
 typedef ISC_LIST(dns_adbname_t) dns_adbnamelist_t;
 typedef struct dns_adbnamehook dns_adbnamehook_t;
 typedef ISC_LIST(dns_adbnamehook_t) dns_adbnamehooklist_t;
@@ -88,6 +120,8 @@ typedef struct dns_adblameinfo dns_adblameinfo_t;
 typedef ISC_LIST(dns_adbentry_t) dns_adbentrylist_t;
 typedef struct dns_adbfetch dns_adbfetch_t;
 typedef struct dns_adbfetch6 dns_adbfetch6_t;
+typedef struct adbnametable adbnametable_t;
+typedef struct adbentrytable adbentrytable_t;
 
 /*% dns adb structure */
 struct dns_adb {
@@ -101,7 +135,6 @@ struct dns_adb {
 
 	isc_taskmgr_t                  *taskmgr;
 	isc_task_t                     *task;
-	isc_task_t                     *excl;
 
 	isc_interval_t                  tick_interval;
 	int                             next_cleanbucket;
@@ -119,29 +152,34 @@ struct dns_adb {
 	isc_mempool_t                  *afmp;   /*%< dns_adbfetch_t */
 
 	/*!
-	 * Bucketized locks and lists for names.
+	 * Lock stripes for names.  'names' is the per-stripe LRU list
+	 * and 'nametables' the per-stripe hash table used for lookups.
 	 *
 	 * XXXRTH  Have a per-bucket structure that contains all of these?
 	 */
-	unsigned int			nnames;
+	unsigned int			nnamelocks;
 	isc_mutex_t                     namescntlock;
 	unsigned int			namescnt;
+	unsigned int			nnamebuckets; /*%< all stripes */
 	dns_adbnamelist_t               *names;
 	dns_adbnamelist_t               *deadnames;
+	adbnametable_t                  *nametables;
 	isc_mutex_t                     *namelocks;
 	isc_boolean_t                   *name_sd;
 	unsigned int                    *name_refcnt;
 
 	/*!
-	 * Bucketized locks and lists for entries.
+	 * Lock stripes for entries.
 	 *
 	 * XXXRTH  Have a per-bucket structure that contains all of these?
 	 */
-	unsigned int			nentries;
+	unsigned int			nentrylocks;
 	isc_mutex_t                     entriescntlock;
 	unsigned int			entriescnt;
+	unsigned int			nentrybuckets; /*%< all stripes */
 	dns_adbentrylist_t              *entries;
 	dns_adbentrylist_t              *deadentries;
+	adbentrytable_t                 *entrytables;
 	isc_mutex_t                     *entrylocks;
 	isc_boolean_t                   *entry_sd; /*%< shutting down */
 	unsigned int                    *entry_refcnt;
@@ -150,16 +188,38 @@ struct dns_adb {
 	isc_boolean_t                   cevent_out;
 	isc_boolean_t                   shutting_down;
 	isc_eventlist_t                 whenshutdown;
-	isc_event_t			growentries;
-	isc_boolean_t			growentries_sent;
-	isc_event_t			grownames;
-	isc_boolean_t			grownames_sent;
 
 	isc_uint32_t			quota;
 	isc_uint32_t			atr_freq;
 	double				atr_low;
 	double				atr_high;
 	double				atr_discount;
+
+	char				*statefile;	/*%< locked by lock */
+};
+
+/*%
+ * The hash table owned by one lock stripe.  'size' is always a power of
+ * two.  While 'oldbuckets' is non-NULL the table is being resized: old
+ * chains below 'migrated' have been moved into 'buckets', the remainder
+ * are still in use.
+ */
+struct adbnametable {
+	unsigned int			size;
+	unsigned int			count;
+	dns_adbnamelist_t		*buckets;
+	unsigned int			oldsize;
+	unsigned int			migrated;
+	dns_adbnamelist_t		*oldbuckets;
+};
+
+struct adbentrytable {
+	unsigned int			size;
+	unsigned int			count;
+	dns_adbentrylist_t		*buckets;
+	unsigned int			oldsize;
+	unsigned int			migrated;
+	dns_adbentrylist_t		*oldbuckets;
 };
 
 /*
@@ -174,6 +234,7 @@ struct dns_adbname {
 	unsigned int                    partial_result;
 	unsigned int                    flags;
 	int                             lock_bucket;
+	unsigned int                    hashval;
 	dns_name_t                      target;
 	isc_stdtime_t                   expire_target;
 	isc_stdtime_t                   expire_v4;
@@ -190,6 +251,7 @@ struct dns_adbname {
 	isc_stdtime_t                   last_used;
 
 	ISC_LINK(dns_adbname_t)         plink;
+	ISC_LINK(dns_adbname_t)         hlink;  /*%< hash chain */
 };
 
 /*% The adbfetch structure */
@@ -235,6 +297,7 @@ struct dns_adbentry {
 	unsigned int                    magic;
 
 	int                             lock_bucket;
+	unsigned int                    hashval;
 	unsigned int                    refcnt;
 	unsigned int                    nh;
 
@@ -276,6 +339,7 @@ struct dns_adbentry {
 
 	ISC_LIST(dns_adblameinfo_t)     lameinfo;
 	ISC_LINK(dns_adbentry_t)        plink;
+	ISC_LINK(dns_adbentry_t)        hlink;  /*%< hash chain */
 };
 
 /*
@@ -303,6 +367,7 @@ static inline dns_adbentry_t *find_entry_and_lock(dns_adb_t *,
 						  isc_sockaddr_t *, int *,
 						  isc_stdtime_t);
 static void dump_adb(dns_adb_t *, FILE *, isc_boolean_t debug, isc_stdtime_t);
+static isc_result_t writestate(dns_adb_t *, const char *);
 static void print_dns_name(FILE *, dns_name_t *);
 static void print_namehook_list(FILE *, const char *legend,
 				dns_adb_t *adb,
@@ -533,330 +598,300 @@ ttlclamp(dns_ttl_t ttl) {
 	return (ttl);
 }
 
-/*
- * Hashing is most efficient if the number of buckets is prime.
- * The sequence below is the closest previous primes to 2^n and
- * 1.5 * 2^n, for values of n from 10 to 28.  (The tables will
- * no longer grow beyond 2^28 entries.)
- */
-static const unsigned nbuckets[] = { 1021, 1531, 2039, 3067, 4093, 6143,
-				     8191, 12281, 16381, 24571, 32749,
-				     49193, 65521, 98299, 131071, 199603,
-				     262139, 393209, 524287, 768431, 1048573,
-				     1572853, 2097143, 3145721, 4194301,
-				     6291449, 8388593, 12582893, 16777213,
-				     25165813, 33554393, 50331599, 67108859,
-				     100663291, 134217689, 201326557,
-				     268535431, 0 };
+static inline unsigned int
+hashval_name(dns_name_t *name) {
+	return (dns_name_fullhash(name, ISC_FALSE));
+}
+
+static inline unsigned int
+hashval_addr(isc_sockaddr_t *addr) {
+	return (isc_sockaddr_hash(addr, ISC_TRUE));
+}
 
 static void
-grow_entries(isc_task_t *task, isc_event_t *ev) {
-	dns_adb_t *adb;
-	dns_adbentry_t *e;
-	dns_adbentrylist_t *newdeadentries = NULL;
-	dns_adbentrylist_t *newentries = NULL;
-	isc_boolean_t *newentry_sd = NULL;
-	isc_mutex_t *newentrylocks = NULL;
-	isc_result_t result;
-	unsigned int *newentry_refcnt = NULL;
-	unsigned int i, n, bucket;
+set_nameload(dns_adb_t *adb) {
+	/* Requires namescntlock be held. */
+	set_adbstat(adb, (isc_uint64_t)adb->namescnt * 100 / adb->nnamebuckets,
+		    dns_adbstats_namesload);
+}
 
-	adb = ev->ev_arg;
-	INSIST(DNS_ADB_VALID(adb));
+static void
+set_entryload(dns_adb_t *adb) {
+	/* Requires entriescntlock be held. */
+	set_adbstat(adb,
+		    (isc_uint64_t)adb->entriescnt * 100 / adb->nentrybuckets,
+		    dns_adbstats_entriesload);
+}
 
-	isc_event_free(&ev);
+static isc_result_t
+init_nametable(dns_adb_t *adb, adbnametable_t *table) {
+	unsigned int i;
 
-	result = isc_task_beginexclusive(task);
-	if (result != ISC_R_SUCCESS)
-		goto check_exit;
+	table->buckets = isc_mem_get(adb->mctx, sizeof(*table->buckets) *
+						ADB_TABLE_MINSIZE);
+	if (table->buckets == NULL)
+		return (ISC_R_NOMEMORY);
+	for (i = 0; i < ADB_TABLE_MINSIZE; i++)
+		ISC_LIST_INIT(table->buckets[i]);
+	table->size = ADB_TABLE_MINSIZE;
+	table->count = 0;
+	table->oldbuckets = NULL;
+	table->oldsize = 0;
+	table->migrated = 0;
+	return (ISC_R_SUCCESS);
+}
 
-	i = 0;
-	while (nbuckets[i] != 0 && adb->nentries >= nbuckets[i])
-		i++;
-	if (nbuckets[i] != 0)
-		n = nbuckets[i];
-	else
-		goto done;
+static void
+free_nametable(dns_adb_t *adb, adbnametable_t *table) {
+	if (table->buckets != NULL)
+		isc_mem_put(adb->mctx, table->buckets,
+			    sizeof(*table->buckets) * table->size);
+	if (table->oldbuckets != NULL)
+		isc_mem_put(adb->mctx, table->oldbuckets,
+			    sizeof(*table->oldbuckets) * table->oldsize);
+	table->buckets = NULL;
+	table->oldbuckets = NULL;
+}
 
-	DP(ISC_LOG_INFO, "adb: grow_entries to %u starting", n);
+static isc_result_t
+init_entrytable(dns_adb_t *adb, adbentrytable_t *table) {
+	unsigned int i;
 
-	/*
-	 * Are we shutting down?
-	 */
-	for (i = 0; i < adb->nentries; i++)
-		if (adb->entry_sd[i])
-			goto cleanup;
+	table->buckets = isc_mem_get(adb->mctx, sizeof(*table->buckets) *
+						ADB_TABLE_MINSIZE);
+	if (table->buckets == NULL)
+		return (ISC_R_NOMEMORY);
+	for (i = 0; i < ADB_TABLE_MINSIZE; i++)
+		ISC_LIST_INIT(table->buckets[i]);
+	table->size = ADB_TABLE_MINSIZE;
+	table->count = 0;
+	table->oldbuckets = NULL;
+	table->oldsize = 0;
+	table->migrated = 0;
+	return (ISC_R_SUCCESS);
+}
 
-	/*
-	 * Grab all the resources we need.
-	 */
-	newentries = isc_mem_get(adb->mctx, sizeof(*newentries) * n);
-	newdeadentries = isc_mem_get(adb->mctx, sizeof(*newdeadentries) * n);
-	newentrylocks = isc_mem_get(adb->mctx, sizeof(*newentrylocks) * n);
-	newentry_sd = isc_mem_get(adb->mctx, sizeof(*newentry_sd) * n);
-	newentry_refcnt = isc_mem_get(adb->mctx, sizeof(*newentry_refcnt) * n);
-	if (newentries == NULL || newdeadentries == NULL ||
-	    newentrylocks == NULL || newentry_sd == NULL ||
-	    newentry_refcnt == NULL)
-		goto cleanup;
+static void
+free_entrytable(dns_adb_t *adb, adbentrytable_t *table) {
+	if (table->buckets != NULL)
+		isc_mem_put(adb->mctx, table->buckets,
+			    sizeof(*table->buckets) * table->size);
+	if (table->oldbuckets != NULL)
+		isc_mem_put(adb->mctx, table->oldbuckets,
+			    sizeof(*table->oldbuckets) * table->oldsize);
+	table->buckets = NULL;
+	table->oldbuckets = NULL;
+}
 
-	/*
-	 * Initialise the new resources.
-	 */
-	result = isc_mutexblock_init(newentrylocks, n);
-	if (result != ISC_R_SUCCESS)
-		goto cleanup;
+/*
+ * Requires the stripe be locked.  Return the chain which holds (or will
+ * hold) a name with hash value 'hashval'.  Chains in the old table that
+ * have not been migrated yet are still authoritative.
+ */
+static inline dns_adbnamelist_t *
+name_chain(dns_adb_t *adb, adbnametable_t *table, unsigned int hashval) {
+	unsigned int h = hashval / adb->nnamelocks;
+
+	if (table->oldbuckets != NULL &&
+	    (h & (table->oldsize - 1)) >= table->migrated)
+		return (&table->oldbuckets[h & (table->oldsize - 1)]);
+	return (&table->buckets[h & (table->size - 1)]);
+}
 
-	for (i = 0; i < n; i++) {
-		ISC_LIST_INIT(newentries[i]);
-		ISC_LIST_INIT(newdeadentries[i]);
-		newentry_sd[i] = ISC_FALSE;
-		newentry_refcnt[i] = 0;
-		adb->irefcnt++;
-	}
+static inline dns_adbentrylist_t *
+entry_chain(dns_adb_t *adb, adbentrytable_t *table, unsigned int hashval) {
+	unsigned int h = hashval / adb->nentrylocks;
 
-	/*
-	 * Move entries to new arrays.
-	 */
-	for (i = 0; i < adb->nentries; i++) {
-		e = ISC_LIST_HEAD(adb->entries[i]);
-		while (e != NULL) {
-			ISC_LIST_UNLINK(adb->entries[i], e, plink);
-			bucket = isc_sockaddr_hash(&e->sockaddr, ISC_TRUE) % n;
-			e->lock_bucket = bucket;
-			ISC_LIST_APPEND(newentries[bucket], e, plink);
-			INSIST(adb->entry_refcnt[i] > 0);
-			adb->entry_refcnt[i]--;
-			newentry_refcnt[bucket]++;
-			e = ISC_LIST_HEAD(adb->entries[i]);
-		}
-		e = ISC_LIST_HEAD(adb->deadentries[i]);
-		while (e != NULL) {
-			ISC_LIST_UNLINK(adb->deadentries[i], e, plink);
-			bucket = isc_sockaddr_hash(&e->sockaddr, ISC_TRUE) % n;
-			e->lock_bucket = bucket;
-			ISC_LIST_APPEND(newdeadentries[bucket], e, plink);
-			INSIST(adb->entry_refcnt[i] > 0);
-			adb->entry_refcnt[i]--;
-			newentry_refcnt[bucket]++;
-			e = ISC_LIST_HEAD(adb->deadentries[i]);
+	if (table->oldbuckets != NULL &&
+	    (h & (table->oldsize - 1)) >= table->migrated)
+		return (&table->oldbuckets[h & (table->oldsize - 1)]);
+	return (&table->buckets[h & (table->size - 1)]);
+}
+
+/*
+ * Requires the stripe be locked.  If the stripe's table is being resized,
+ * move the next ADB_MIGRATE_BUCKETS old chains into the new table, and
+ * release the old table once it is empty.
+ */
+static void
+migrate_names(dns_adb_t *adb, adbnametable_t *table) {
+	dns_adbnamelist_t *oldchain, *chain;
+	dns_adbname_t *name;
+	unsigned int i;
+
+	if (table->oldbuckets == NULL)
+		return;
+
+	for (i = 0;
+	     i < ADB_MIGRATE_BUCKETS && table->migrated < table->oldsize;
+	     i++)
+	{
+		oldchain = &table->oldbuckets[table->migrated++];
+		while ((name = ISC_LIST_HEAD(*oldchain)) != NULL) {
+			ISC_LIST_UNLINK(*oldchain, name, hlink);
+			chain = name_chain(adb, table, name->hashval);
+			ISC_LIST_APPEND(*chain, name, hlink);
 		}
-		INSIST(adb->entry_refcnt[i] == 0);
-		adb->irefcnt--;
 	}
 
-	/*
-	 * Cleanup old resources.
-	 */
-	DESTROYMUTEXBLOCK(adb->entrylocks, adb->nentries);
-	isc_mem_put(adb->mctx, adb->entries,
-		    sizeof(*adb->entries) * adb->nentries);
-	isc_mem_put(adb->mctx, adb->deadentries,
-		    sizeof(*adb->deadentries) * adb->nentries);
-	isc_mem_put(adb->mctx, adb->entrylocks,
-		    sizeof(*adb->entrylocks) * adb->nentries);
-	isc_mem_put(adb->mctx, adb->entry_sd,
-		    sizeof(*adb->entry_sd) * adb->nentries);
-	isc_mem_put(adb->mctx, adb->entry_refcnt,
-		    sizeof(*adb->entry_refcnt) * adb->nentries);
+	if (table->migrated == table->oldsize) {
+		isc_mem_put(adb->mctx, table->oldbuckets,
+			    sizeof(*table->oldbuckets) * table->oldsize);
+		table->oldbuckets = NULL;
+		table->oldsize = 0;
+		table->migrated = 0;
+	}
+}
 
-	/*
-	 * Install new resources.
-	 */
-	adb->entries = newentries;
-	adb->deadentries = newdeadentries;
-	adb->entrylocks = newentrylocks;
-	adb->entry_sd = newentry_sd;
-	adb->entry_refcnt = newentry_refcnt;
-	adb->nentries = n;
+static void
+migrate_entries(dns_adb_t *adb, adbentrytable_t *table) {
+	dns_adbentrylist_t *oldchain, *chain;
+	dns_adbentry_t *entry;
+	unsigned int i;
 
-	set_adbstat(adb, adb->nentries, dns_adbstats_nentries);
+	if (table->oldbuckets == NULL)
+		return;
 
-	/*
-	 * Only on success do we set adb->growentries_sent to ISC_FALSE.
-	 * This will prevent us being continuously being called on error.
-	 */
-	adb->growentries_sent = ISC_FALSE;
-	goto done;
+	for (i = 0;
+	     i < ADB_MIGRATE_BUCKETS && table->migrated < table->oldsize;
+	     i++)
+	{
+		oldchain = &table->oldbuckets[table->migrated++];
+		while ((entry = ISC_LIST_HEAD(*oldchain)) != NULL) {
+			ISC_LIST_UNLINK(*oldchain, entry, hlink);
+			chain = entry_chain(adb, table, entry->hashval);
+			ISC_LIST_APPEND(*chain, entry, hlink);
+		}
+	}
 
- cleanup:
-	if (newentries != NULL)
-		isc_mem_put(adb->mctx, newentries,
-			    sizeof(*newentries) * n);
-	if (newdeadentries != NULL)
-		isc_mem_put(adb->mctx, newdeadentries,
-			    sizeof(*newdeadentries) * n);
-	if (newentrylocks != NULL)
-		isc_mem_put(adb->mctx, newentrylocks,
-			    sizeof(*newentrylocks) * n);
-	if (newentry_sd != NULL)
-		isc_mem_put(adb->mctx, newentry_sd,
-			    sizeof(*newentry_sd) * n);
-	if (newentry_refcnt != NULL)
-		isc_mem_put(adb->mctx, newentry_refcnt,
-			     sizeof(*newentry_refcnt) * n);
- done:
-	isc_task_endexclusive(task);
-
- check_exit:
-	LOCK(&adb->lock);
-	if (dec_adb_irefcnt(adb))
-		check_exit(adb);
-	UNLOCK(&adb->lock);
-	DP(ISC_LOG_INFO, "adb: grow_entries finished");
+	if (table->migrated == table->oldsize) {
+		isc_mem_put(adb->mctx, table->oldbuckets,
+			    sizeof(*table->oldbuckets) * table->oldsize);
+		table->oldbuckets = NULL;
+		table->oldsize = 0;
+		table->migrated = 0;
+	}
 }
 
+/*
+ * Requires the stripe be locked.  Start doubling the stripe's table if it
+ * has become too heavily loaded and is not already being resized.  The
+ * chains are moved over later by migrate_names(), a few at a time, so
+ * this never touches more than the one stripe.  Failure to allocate the
+ * new table is harmless; we'll try again on the next insertion.
+ */
 static void
-grow_names(isc_task_t *task, isc_event_t *ev) {
-	dns_adb_t *adb;
-	dns_adbname_t *name;
-	dns_adbnamelist_t *newdeadnames = NULL;
-	dns_adbnamelist_t *newnames = NULL;
-	isc_boolean_t *newname_sd = NULL;
-	isc_mutex_t *newnamelocks = NULL;
-	isc_result_t result;
-	unsigned int *newname_refcnt = NULL;
-	unsigned int i, n, bucket;
+grow_names(dns_adb_t *adb, adbnametable_t *table) {
+	dns_adbnamelist_t *newbuckets;
+	unsigned int i, n;
 
-	adb = ev->ev_arg;
-	INSIST(DNS_ADB_VALID(adb));
-
-	isc_event_free(&ev);
+	if (table->oldbuckets != NULL ||
+	    table->count <= table->size * ADB_TABLE_MAXLOAD ||
+	    table->size >= ADB_TABLE_MAXSIZE)
+		return;
 
-	result = isc_task_beginexclusive(task);
-	if (result != ISC_R_SUCCESS)
-		goto check_exit;
+	n = table->size * 2;
+	newbuckets = isc_mem_get(adb->mctx, sizeof(*newbuckets) * n);
+	if (newbuckets == NULL)
+		return;
+	for (i = 0; i < n; i++)
+		ISC_LIST_INIT(newbuckets[i]);
 
-	i = 0;
-	while (nbuckets[i] != 0 && adb->nnames >= nbuckets[i])
-		i++;
-	if (nbuckets[i] != 0)
-		n = nbuckets[i];
-	else
-		goto done;
+	table->oldbuckets = table->buckets;
+	table->oldsize = table->size;
+	table->migrated = 0;
+	table->buckets = newbuckets;
+	table->size = n;
 
-	DP(ISC_LOG_INFO, "adb: grow_names to %u starting", n);
+	LOCK(&adb->namescntlock);
+	adb->nnamebuckets += n - table->oldsize;
+	set_adbstat(adb, adb->nnamebuckets, dns_adbstats_nnames);
+	set_nameload(adb);
+	UNLOCK(&adb->namescntlock);
+	inc_adbstats(adb, dns_adbstats_namesgrow);
+}
 
-	/*
-	 * Are we shutting down?
-	 */
-	for (i = 0; i < adb->nnames; i++)
-		if (adb->name_sd[i])
-			goto cleanup;
+static void
+grow_entries(dns_adb_t *adb, adbentrytable_t *table) {
+	dns_adbentrylist_t *newbuckets;
+	unsigned int i, n;
 
-	/*
-	 * Grab all the resources we need.
-	 */
-	newnames = isc_mem_get(adb->mctx, sizeof(*newnames) * n);
-	newdeadnames = isc_mem_get(adb->mctx, sizeof(*newdeadnames) * n);
-	newnamelocks = isc_mem_get(adb->mctx, sizeof(*newnamelocks) * n);
-	newname_sd = isc_mem_get(adb->mctx, sizeof(*newname_sd) * n);
-	newname_refcnt = isc_mem_get(adb->mctx, sizeof(*newname_refcnt) * n);
-	if (newnames == NULL || newdeadnames == NULL ||
-	    newnamelocks == NULL || newname_sd == NULL ||
-	    newname_refcnt == NULL)
-		goto cleanup;
+	if (table->oldbuckets != NULL ||
+	    table->count <= table->size * ADB_TABLE_MAXLOAD ||
+	    table->size >= ADB_TABLE_MAXSIZE)
+		return;
 
-	/*
-	 * Initialise the new resources.
-	 */
-	result = isc_mutexblock_init(newnamelocks, n);
-	if (result != ISC_R_SUCCESS)
-		goto cleanup;
+	n = table->size * 2;
+	newbuckets = isc_mem_get(adb->mctx, sizeof(*newbuckets) * n);
+	if (newbuckets == NULL)
+		return;
+	for (i = 0; i < n; i++)
+		ISC_LIST_INIT(newbuckets[i]);
 
-	for (i = 0; i < n; i++) {
-		ISC_LIST_INIT(newnames[i]);
-		ISC_LIST_INIT(newdeadnames[i]);
-		newname_sd[i] = ISC_FALSE;
-		newname_refcnt[i] = 0;
-		adb->irefcnt++;
-	}
+	table->oldbuckets = table->buckets;
+	table->oldsize = table->size;
+	table->migrated = 0;
+	table->buckets = newbuckets;
+	table->size = n;
 
-	/*
-	 * Move names to new arrays.
-	 */
-	for (i = 0; i < adb->nnames; i++) {
-		name = ISC_LIST_HEAD(adb->names[i]);
-		while (name != NULL) {
-			ISC_LIST_UNLINK(adb->names[i], name, plink);
-			bucket = dns_name_fullhash(&name->name, ISC_TRUE) % n;
-			name->lock_bucket = bucket;
-			ISC_LIST_APPEND(newnames[bucket], name, plink);
-			INSIST(adb->name_refcnt[i] > 0);
-			adb->name_refcnt[i]--;
-			newname_refcnt[bucket]++;
-			name = ISC_LIST_HEAD(adb->names[i]);
-		}
-		name = ISC_LIST_HEAD(adb->deadnames[i]);
-		while (name != NULL) {
-			ISC_LIST_UNLINK(adb->deadnames[i], name, plink);
-			bucket = dns_name_fullhash(&name->name, ISC_TRUE) % n;
-			name->lock_bucket = bucket;
-			ISC_LIST_APPEND(newdeadnames[bucket], name, plink);
-			INSIST(adb->name_refcnt[i] > 0);
-			adb->name_refcnt[i]--;
-			newname_refcnt[bucket]++;
-			name = ISC_LIST_HEAD(adb->deadnames[i]);
-		}
-		INSIST(adb->name_refcnt[i] == 0);
-		adb->irefcnt--;
-	}
-
-	/*
-	 * Cleanup old resources.
-	 */
-	DESTROYMUTEXBLOCK(adb->namelocks, adb->nnames);
-	isc_mem_put(adb->mctx, adb->names,
-		    sizeof(*adb->names) * adb->nnames);
-	isc_mem_put(adb->mctx, adb->deadnames,
-		    sizeof(*adb->deadnames) * adb->nnames);
-	isc_mem_put(adb->mctx, adb->namelocks,
-		    sizeof(*adb->namelocks) * adb->nnames);
-	isc_mem_put(adb->mctx, adb->name_sd,
-		    sizeof(*adb->name_sd) * adb->nnames);
-	isc_mem_put(adb->mctx, adb->name_refcnt,
-		    sizeof(*adb->name_refcnt) * adb->nnames);
+	LOCK(&adb->entriescntlock);
+	adb->nentrybuckets += n - table->oldsize;
+	set_adbstat(adb, adb->nentrybuckets, dns_adbstats_nentries);
+	set_entryload(adb);
+	UNLOCK(&adb->entriescntlock);
+	inc_adbstats(adb, dns_adbstats_entriesgrow);
+}
 
-	/*
-	 * Install new resources.
-	 */
-	adb->names = newnames;
-	adb->deadnames = newdeadnames;
-	adb->namelocks = newnamelocks;
-	adb->name_sd = newname_sd;
-	adb->name_refcnt = newname_refcnt;
-	adb->nnames = n;
+/*
+ * Requires the name's stripe be locked.
+ */
+static inline void
+hash_insert_name(dns_adb_t *adb, int bucket, dns_adbname_t *name) {
+	adbnametable_t *table = &adb->nametables[bucket];
+	dns_adbnamelist_t *chain;
+
+	grow_names(adb, table);
+	migrate_names(adb, table);
+	chain = name_chain(adb, table, name->hashval);
+	ISC_LIST_PREPEND(*chain, name, hlink);
+	table->count++;
+}
 
-	set_adbstat(adb, adb->nnames, dns_adbstats_nnames);
+static inline void
+hash_remove_name(dns_adb_t *adb, int bucket, dns_adbname_t *name) {
+	adbnametable_t *table = &adb->nametables[bucket];
+	dns_adbnamelist_t *chain;
+
+	chain = name_chain(adb, table, name->hashval);
+	ISC_LIST_UNLINK(*chain, name, hlink);
+	INSIST(table->count > 0);
+	table->count--;
+}
 
-	/*
-	 * Only on success do we set adb->grownames_sent to ISC_FALSE.
-	 * This will prevent us being continuously being called on error.
-	 */
-	adb->grownames_sent = ISC_FALSE;
-	goto done;
+/*
+ * Requires the entry's stripe be locked.
+ */
+static inline void
+hash_insert_entry(dns_adb_t *adb, int bucket, dns_adbentry_t *entry) {
+	adbentrytable_t *table = &adb->entrytables[bucket];
+	dns_adbentrylist_t *chain;
+
+	grow_entries(adb, table);
+	migrate_entries(adb, table);
+	chain = entry_chain(adb, table, entry->hashval);
+	ISC_LIST_PREPEND(*chain, entry, hlink);
+	table->count++;
+}
 
- cleanup:
-	if (newnames != NULL)
-		isc_mem_put(adb->mctx, newnames, sizeof(*newnames) * n);
-	if (newdeadnames != NULL)
-		isc_mem_put(adb->mctx, newdeadnames, sizeof(*newdeadnames) * n);
-	if (newnamelocks != NULL)
-		isc_mem_put(adb->mctx, newnamelocks, sizeof(*newnamelocks) * n);
-	if (newname_sd != NULL)
-		isc_mem_put(adb->mctx, newname_sd, sizeof(*newname_sd) * n);
-	if (newname_refcnt != NULL)
-		isc_mem_put(adb->mctx, newname_refcnt,
-			     sizeof(*newname_refcnt) * n);
- done:
-	isc_task_endexclusive(task);
-
- check_exit:
-	LOCK(&adb->lock);
-	if (dec_adb_irefcnt(adb))
-		check_exit(adb);
-	UNLOCK(&adb->lock);
-	DP(ISC_LOG_INFO, "adb: grow_names finished");
+static inline void
+hash_remove_entry(dns_adb_t *adb, int bucket, dns_adbentry_t *entry) {
+	adbentrytable_t *table = &adb->entrytables[bucket];
+	dns_adbentrylist_t *chain;
+
+	chain = entry_chain(adb, table, entry->hashval);
+	ISC_LIST_UNLINK(*chain, entry, hlink);
+	INSIST(table->count > 0);
+	table->count--;
 }
 
 /*
@@ -1059,6 +1094,7 @@ kill_name(dns_adbname_t **n, isc_eventtype_t ev) {
 		if (!NAME_DEAD(name)) {
 			bucket = name->lock_bucket;
 			ISC_LIST_UNLINK(adb->names[bucket], name, plink);
+			hash_remove_name(adb, bucket, name);
 			ISC_LIST_APPEND(adb->deadnames[bucket], name, plink);
 			name->flags |= NAME_IS_DEAD;
 		}
@@ -1123,6 +1159,7 @@ link_name(dns_adb_t *adb, int bucket, dns_adbname_t *name) {
 	INSIST(name->lock_bucket == DNS_ADB_INVALIDBUCKET);
 
 	ISC_LIST_PREPEND(adb->names[bucket], name, plink);
+	hash_insert_name(adb, bucket, name);
 	name->lock_bucket = bucket;
 	adb->name_refcnt[bucket]++;
 }
@@ -1140,8 +1177,10 @@ unlink_name(dns_adb_t *adb, dns_adbname_t *name) {
 
 	if (NAME_DEAD(name))
 		ISC_LIST_UNLINK(adb->deadnames[bucket], name, plink);
-	else
+	else {
 		ISC_LIST_UNLINK(adb->names[bucket], name, plink);
+		hash_remove_name(adb, bucket, name);
+	}
 	name->lock_bucket = DNS_ADB_INVALIDBUCKET;
 	INSIST(adb->name_refcnt[bucket] > 0);
 	adb->name_refcnt[bucket]--;
@@ -1171,11 +1210,14 @@ link_entry(dns_adb_t *adb, int bucket, dns_adbentry_t *entry) {
 			INSIST((e->flags & ENTRY_IS_DEAD) == 0);
 			e->flags |= ENTRY_IS_DEAD;
 			ISC_LIST_UNLINK(adb->entries[bucket], e, plink);
+			hash_remove_entry(adb, bucket, e);
 			ISC_LIST_PREPEND(adb->deadentries[bucket], e, plink);
 		}
 	}
 
+	entry->hashval = hashval_addr(&entry->sockaddr);
 	ISC_LIST_PREPEND(adb->entries[bucket], entry, plink);
+	hash_insert_entry(adb, bucket, entry);
 	entry->lock_bucket = bucket;
 	adb->entry_refcnt[bucket]++;
 }
@@ -1193,8 +1235,10 @@ unlink_entry(dns_adb_t *adb, dns_adbentry_t *entry) {
 
 	if ((entry->flags & ENTRY_IS_DEAD) != 0)
 		ISC_LIST_UNLINK(adb->deadentries[bucket], entry, plink);
-	else
+	else {
 		ISC_LIST_UNLINK(adb->entries[bucket], entry, plink);
+		hash_remove_entry(adb, bucket, entry);
+	}
 	entry->lock_bucket = DNS_ADB_INVALIDBUCKET;
 	INSIST(adb->entry_refcnt[bucket] > 0);
 	adb->entry_refcnt[bucket]--;
@@ -1223,7 +1267,7 @@ shutdown_names(dns_adb_t *adb) {
 	dns_adbname_t *name;
 	dns_adbname_t *next_name;
 
-	for (bucket = 0; bucket < adb->nnames; bucket++) {
+	for (bucket = 0; bucket < adb->nnamelocks; bucket++) {
 		LOCK(&adb->namelocks[bucket]);
 		adb->name_sd[bucket] = ISC_TRUE;
 
@@ -1268,7 +1312,7 @@ shutdown_entries(dns_adb_t *adb) {
 	dns_adbentry_t *entry;
 	dns_adbentry_t *next_entry;
 
-	for (bucket = 0; bucket < adb->nentries; bucket++) {
+	for (bucket = 0; bucket < adb->nentrylocks; bucket++) {
 		LOCK(&adb->entrylocks[bucket]);
 		adb->entry_sd[bucket] = ISC_TRUE;
 
@@ -1685,6 +1729,7 @@ new_adbname(dns_adb_t *adb, dns_name_t *dnsname) {
 	name->expire_target = INT_MAX;
 	name->chains = 0;
 	name->lock_bucket = DNS_ADB_INVALIDBUCKET;
+	name->hashval = hashval_name(dnsname);
 	ISC_LIST_INIT(name->v4);
 	ISC_LIST_INIT(name->v6);
 	name->fetch_a = NULL;
@@ -1693,18 +1738,12 @@ new_adbname(dns_adb_t *adb, dns_name_t *dnsname) {
 	name->fetch6_err = FIND_ERR_UNEXPECTED;
 	ISC_LIST_INIT(name->finds);
 	ISC_LINK_INIT(name, plink);
+	ISC_LINK_INIT(name, hlink);
 
 	LOCK(&adb->namescntlock);
 	adb->namescnt++;
 	inc_adbstats(adb, dns_adbstats_namescnt);
-	if (!adb->grownames_sent && adb->excl != NULL &&
-	    adb->namescnt > (adb->nnames * 8))
-	{
-		isc_event_t *event = &adb->grownames;
-		inc_adb_irefcnt(adb);
-		isc_task_send(adb->excl, &event);
-		adb->grownames_sent = ISC_TRUE;
-	}
+	set_nameload(adb);
 	UNLOCK(&adb->namescntlock);
 
 	return (name);
@@ -1723,6 +1762,7 @@ free_adbname(dns_adb_t *adb, dns_adbname_t **name) {
 	INSIST(!NAME_FETCH(n));
 	INSIST(ISC_LIST_EMPTY(n->finds));
 	INSIST(!ISC_LINK_LINKED(n, plink));
+	INSIST(!ISC_LINK_LINKED(n, hlink));
 	INSIST(n->lock_bucket == DNS_ADB_INVALIDBUCKET);
 	INSIST(n->adb == adb);
 
@@ -1733,6 +1773,7 @@ free_adbname(dns_adb_t *adb, dns_adbname_t **name) {
 	LOCK(&adb->namescntlock);
 	adb->namescnt--;
 	dec_adbstats(adb, dns_adbstats_namescnt);
+	set_nameload(adb);
 	UNLOCK(&adb->namescntlock);
 }
 
@@ -1815,6 +1856,7 @@ new_adbentry(dns_adb_t *adb) {
 
 	e->magic = DNS_ADBENTRY_MAGIC;
 	e->lock_bucket = DNS_ADB_INVALIDBUCKET;
+	e->hashval = 0;
 	e->refcnt = 0;
 	e->nh = 0;
 	e->flags = 0;
@@ -1840,17 +1882,11 @@ new_adbentry(dns_adb_t *adb) {
 	e->atr = 0.0;
 	ISC_LIST_INIT(e->lameinfo);
 	ISC_LINK_INIT(e, plink);
+	ISC_LINK_INIT(e, hlink);
 	LOCK(&adb->entriescntlock);
 	adb->entriescnt++;
 	inc_adbstats(adb, dns_adbstats_entriescnt);
-	if (!adb->growentries_sent && adb->excl != NULL &&
-	    adb->entriescnt > (adb->nentries * 8))
-	{
-		isc_event_t *event = &adb->growentries;
-		inc_adb_irefcnt(adb);
-		isc_task_send(adb->excl, &event);
-		adb->growentries_sent = ISC_TRUE;
-	}
+	set_entryload(adb);
 	UNLOCK(&adb->entriescntlock);
 
 	return (e);
@@ -1868,6 +1904,7 @@ free_adbentry(dns_adb_t *adb, dns_adbentry_t **entry) {
 	INSIST(e->lock_bucket == DNS_ADB_INVALIDBUCKET);
 	INSIST(e->refcnt == 0);
 	INSIST(!ISC_LINK_LINKED(e, plink));
+	INSIST(!ISC_LINK_LINKED(e, hlink));
 
 	e->magic = 0;
 
@@ -1885,6 +1922,7 @@ free_adbentry(dns_adb_t *adb, dns_adbentry_t **entry) {
 	LOCK(&adb->entriescntlock);
 	adb->entriescnt--;
 	dec_adbstats(adb, dns_adbstats_entriescnt);
+	set_entryload(adb);
 	UNLOCK(&adb->entriescntlock);
 }
 
@@ -2038,9 +2076,12 @@ find_name_and_lock(dns_adb_t *adb, dns_name_t *name,
 		   unsigned int options, int *bucketp)
 {
 	dns_adbname_t *adbname;
+	adbnametable_t *table;
+	unsigned int hashval;
 	int bucket;
 
-	bucket = dns_name_fullhash(name, ISC_FALSE) % adb->nnames;
+	hashval = hashval_name(name);
+	bucket = hashval % adb->nnamelocks;
 
 	if (*bucketp == DNS_ADB_INVALIDBUCKET) {
 		LOCK(&adb->namelocks[bucket]);
@@ -2051,15 +2092,18 @@ find_name_and_lock(dns_adb_t *adb, dns_name_t *name,
 		*bucketp = bucket;
 	}
 
-	adbname = ISC_LIST_HEAD(adb->names[bucket]);
+	table = &adb->nametables[bucket];
+	migrate_names(adb, table);
+
+	adbname = ISC_LIST_HEAD(*name_chain(adb, table, hashval));
 	while (adbname != NULL) {
-		if (!NAME_DEAD(adbname)) {
-			if (dns_name_equal(name, &adbname->name)
-			    && GLUEHINT_OK(adbname, options)
-			    && STARTATZONE_MATCHES(adbname, options))
-				return (adbname);
-		}
-		adbname = ISC_LIST_NEXT(adbname, plink);
+		INSIST(!NAME_DEAD(adbname));
+		if (adbname->hashval == hashval &&
+		    dns_name_equal(name, &adbname->name) &&
+		    GLUEHINT_OK(adbname, options) &&
+		    STARTATZONE_MATCHES(adbname, options))
+			return (adbname);
+		adbname = ISC_LIST_NEXT(adbname, hlink);
 	}
 
 	return (NULL);
@@ -2080,9 +2124,12 @@ find_entry_and_lock(dns_adb_t *adb, isc_sockaddr_t *addr, int *bucketp,
 	isc_stdtime_t now)
 {
 	dns_adbentry_t *entry, *entry_next;
+	adbentrytable_t *table;
+	unsigned int hashval;
 	int bucket;
 
-	bucket = isc_sockaddr_hash(addr, ISC_TRUE) % adb->nentries;
+	hashval = hashval_addr(addr);
+	bucket = hashval % adb->nentrylocks;
 
 	if (*bucketp == DNS_ADB_INVALIDBUCKET) {
 		LOCK(&adb->entrylocks[bucket]);
@@ -2093,11 +2140,14 @@ find_entry_and_lock(dns_adb_t *adb, isc_sockaddr_t *addr, int *bucketp,
 		*bucketp = bucket;
 	}
 
-	/* Search the list, while cleaning up expired entries. */
-	for (entry = ISC_LIST_HEAD(adb->entries[bucket]);
+	table = &adb->entrytables[bucket];
+	migrate_entries(adb, table);
+
+	/* Search the chain, while cleaning up expired entries. */
+	for (entry = ISC_LIST_HEAD(*entry_chain(adb, table, hashval));
 	     entry != NULL;
 	     entry = entry_next) {
-		entry_next = ISC_LIST_NEXT(entry, plink);
+		entry_next = ISC_LIST_NEXT(entry, hlink);
 		(void)check_expire_entry(adb, &entry, now);
 		if (entry != NULL &&
 		    (entry->expires == 0 || entry->expires > now) &&
@@ -2462,11 +2512,11 @@ cleanup_entries(dns_adb_t *adb, int bucket, isc_stdtime_t now) {
 
 static void
 destroy(dns_adb_t *adb) {
+	unsigned int i;
+
 	adb->magic = 0;
 
 	isc_task_detach(&adb->task);
-	if (adb->excl != NULL)
-		isc_task_detach(&adb->excl);
 
 	isc_mempool_destroy(&adb->nmp);
 	isc_mempool_destroy(&adb->nhmp);
@@ -2476,29 +2526,41 @@ destroy(dns_adb_t *adb) {
 	isc_mempool_destroy(&adb->aimp);
 	isc_mempool_destroy(&adb->afmp);
 
-	DESTROYMUTEXBLOCK(adb->entrylocks, adb->nentries);
+	for (i = 0; i < adb->nentrylocks; i++)
+		free_entrytable(adb, &adb->entrytables[i]);
+	for (i = 0; i < adb->nnamelocks; i++)
+		free_nametable(adb, &adb->nametables[i]);
+
+	DESTROYMUTEXBLOCK(adb->entrylocks, adb->nentrylocks);
 	isc_mem_put(adb->mctx, adb->entries,
-		    sizeof(*adb->entries) * adb->nentries);
+		    sizeof(*adb->entries) * adb->nentrylocks);
+	isc_mem_put(adb->mctx, adb->entrytables,
+		    sizeof(*adb->entrytables) * adb->nentrylocks);
 	isc_mem_put(adb->mctx, adb->deadentries,
-		    sizeof(*adb->deadentries) * adb->nentries);
+		    sizeof(*adb->deadentries) * adb->nentrylocks);
 	isc_mem_put(adb->mctx, adb->entrylocks,
-		    sizeof(*adb->entrylocks) * adb->nentries);
+		    sizeof(*adb->entrylocks) * adb->nentrylocks);
 	isc_mem_put(adb->mctx, adb->entry_sd,
-		    sizeof(*adb->entry_sd) * adb->nentries);
+		    sizeof(*adb->entry_sd) * adb->nentrylocks);
 	isc_mem_put(adb->mctx, adb->entry_refcnt,
-		    sizeof(*adb->entry_refcnt) * adb->nentries);
+		    sizeof(*adb->entry_refcnt) * adb->nentrylocks);
 
-	DESTROYMUTEXBLOCK(adb->namelocks, adb->nnames);
+	DESTROYMUTEXBLOCK(adb->namelocks, adb->nnamelocks);
 	isc_mem_put(adb->mctx, adb->names,
-		    sizeof(*adb->names) * adb->nnames);
+		    sizeof(*adb->names) * adb->nnamelocks);
+	isc_mem_put(adb->mctx, adb->nametables,
+		    sizeof(*adb->nametables) * adb->nnamelocks);
 	isc_mem_put(adb->mctx, adb->deadnames,
-		    sizeof(*adb->deadnames) * adb->nnames);
+		    sizeof(*adb->deadnames) * adb->nnamelocks);
 	isc_mem_put(adb->mctx, adb->namelocks,
-		    sizeof(*adb->namelocks) * adb->nnames);
+		    sizeof(*adb->namelocks) * adb->nnamelocks);
 	isc_mem_put(adb->mctx, adb->name_sd,
-		    sizeof(*adb->name_sd) * adb->nnames);
+		    sizeof(*adb->name_sd) * adb->nnamelocks);
 	isc_mem_put(adb->mctx, adb->name_refcnt,
-		    sizeof(*adb->name_refcnt) * adb->nnames);
+		    sizeof(*adb->name_refcnt) * adb->nnamelocks);
+
+	if (adb->statefile != NULL)
+		isc_mem_free(adb->mctx, adb->statefile);
 
 	DESTROYLOCK(&adb->reflock);
 	DESTROYLOCK(&adb->lock);
@@ -2550,7 +2612,6 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	adb->aimp = NULL;
 	adb->afmp = NULL;
 	adb->task = NULL;
-	adb->excl = NULL;
 	adb->mctx = NULL;
 	adb->view = view;
 	adb->taskmgr = taskmgr;
@@ -2561,44 +2622,32 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	adb->shutting_down = ISC_FALSE;
 	ISC_LIST_INIT(adb->whenshutdown);
 
-	adb->nentries = nbuckets[0];
+	adb->nentrylocks = ADB_LOCKSTRIPES;
 	adb->entriescnt = 0;
+	adb->nentrybuckets = ADB_LOCKSTRIPES * ADB_TABLE_MINSIZE;
 	adb->entries = NULL;
 	adb->deadentries = NULL;
+	adb->entrytables = NULL;
 	adb->entry_sd = NULL;
 	adb->entry_refcnt = NULL;
 	adb->entrylocks = NULL;
-	ISC_EVENT_INIT(&adb->growentries, sizeof(adb->growentries), 0, NULL,
-		       DNS_EVENT_ADBGROWENTRIES, grow_entries, adb,
-		       adb, NULL, NULL);
-	adb->growentries_sent = ISC_FALSE;
 
 	adb->quota = 0;
 	adb->atr_freq = 0;
 	adb->atr_low = 0.0;
 	adb->atr_high = 0.0;
 	adb->atr_discount = 0.0;
+	adb->statefile = NULL;
 
-	adb->nnames = nbuckets[0];
+	adb->nnamelocks = ADB_LOCKSTRIPES;
 	adb->namescnt = 0;
+	adb->nnamebuckets = ADB_LOCKSTRIPES * ADB_TABLE_MINSIZE;
 	adb->names = NULL;
 	adb->deadnames = NULL;
+	adb->nametables = NULL;
 	adb->name_sd = NULL;
 	adb->name_refcnt = NULL;
 	adb->namelocks = NULL;
-	ISC_EVENT_INIT(&adb->grownames, sizeof(adb->grownames), 0, NULL,
-		       DNS_EVENT_ADBGROWNAMES, grow_names, adb,
-		       adb, NULL, NULL);
-	adb->grownames_sent = ISC_FALSE;
-
-	result = isc_taskmgr_excltask(adb->taskmgr, &adb->excl);
-	if (result != ISC_R_SUCCESS) {
-		DP(DEF_LEVEL, "adb: task-exclusive mode unavailable, "
-			      "intializing table sizes to %u\n",
-			      nbuckets[11]);
-		adb->nentries = nbuckets[11];
-		adb->nnames = nbuckets[11];
-	}
 
 	isc_mem_attach(mem, &adb->mctx);
 
@@ -2629,7 +2678,7 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 #define ALLOCENTRY(adb, el) \
 	do { \
 		(adb)->el = isc_mem_get((adb)->mctx, \
-				     sizeof(*(adb)->el) * (adb)->nentries); \
+				     sizeof(*(adb)->el) * (adb)->nentrylocks); \
 		if ((adb)->el == NULL) { \
 			result = ISC_R_NOMEMORY; \
 			goto fail1; \
@@ -2637,6 +2686,9 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	} while (0)
 	ALLOCENTRY(adb, entries);
 	ALLOCENTRY(adb, deadentries);
+	ALLOCENTRY(adb, entrytables);
+	memset(adb->entrytables, 0,
+	       sizeof(*adb->entrytables) * adb->nentrylocks);
 	ALLOCENTRY(adb, entrylocks);
 	ALLOCENTRY(adb, entry_sd);
 	ALLOCENTRY(adb, entry_refcnt);
@@ -2645,7 +2697,7 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 #define ALLOCNAME(adb, el) \
 	do { \
 		(adb)->el = isc_mem_get((adb)->mctx, \
-				     sizeof(*(adb)->el) * (adb)->nnames); \
+				     sizeof(*(adb)->el) * (adb)->nnamelocks); \
 		if ((adb)->el == NULL) { \
 			result = ISC_R_NOMEMORY; \
 			goto fail1; \
@@ -2653,33 +2705,49 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	} while (0)
 	ALLOCNAME(adb, names);
 	ALLOCNAME(adb, deadnames);
+	ALLOCNAME(adb, nametables);
+	memset(adb->nametables, 0, sizeof(*adb->nametables) * adb->nnamelocks);
 	ALLOCNAME(adb, namelocks);
 	ALLOCNAME(adb, name_sd);
 	ALLOCNAME(adb, name_refcnt);
 #undef ALLOCNAME
 
+	/*
+	 * Initialize the per-stripe hash tables.
+	 */
+	for (i = 0; i < adb->nnamelocks; i++) {
+		result = init_nametable(adb, &adb->nametables[i]);
+		if (result != ISC_R_SUCCESS)
+			goto fail1;
+	}
+	for (i = 0; i < adb->nentrylocks; i++) {
+		result = init_entrytable(adb, &adb->entrytables[i]);
+		if (result != ISC_R_SUCCESS)
+			goto fail1;
+	}
+
 	/*
 	 * Initialize the bucket locks for names and elements.
 	 * May as well initialize the list heads, too.
 	 */
-	result = isc_mutexblock_init(adb->namelocks, adb->nnames);
+	result = isc_mutexblock_init(adb->namelocks, adb->nnamelocks);
 	if (result != ISC_R_SUCCESS)
 		goto fail1;
-	for (i = 0; i < adb->nnames; i++) {
+	for (i = 0; i < adb->nnamelocks; i++) {
 		ISC_LIST_INIT(adb->names[i]);
 		ISC_LIST_INIT(adb->deadnames[i]);
 		adb->name_sd[i] = ISC_FALSE;
 		adb->name_refcnt[i] = 0;
 		adb->irefcnt++;
 	}
-	for (i = 0; i < adb->nentries; i++) {
+	for (i = 0; i < adb->nentrylocks; i++) {
 		ISC_LIST_INIT(adb->entries[i]);
 		ISC_LIST_INIT(adb->deadentries[i]);
 		adb->entry_sd[i] = ISC_FALSE;
 		adb->entry_refcnt[i] = 0;
 		adb->irefcnt++;
 	}
-	result = isc_mutexblock_init(adb->entrylocks, adb->nentries);
+	result = isc_mutexblock_init(adb->entrylocks, adb->nentrylocks);
 	if (result != ISC_R_SUCCESS)
 		goto fail2;
 
@@ -2719,8 +2787,10 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	if (result != ISC_R_SUCCESS)
 		goto fail3;
 
-	set_adbstat(adb, adb->nentries, dns_adbstats_nentries);
-	set_adbstat(adb, adb->nnames, dns_adbstats_nnames);
+	set_adbstat(adb, adb->nentrybuckets, dns_adbstats_nentries);
+	set_adbstat(adb, adb->nnamebuckets, dns_adbstats_nnames);
+	set_adbstat(adb, adb->nentrylocks, dns_adbstats_nentrylocks);
+	set_adbstat(adb, adb->nnamelocks, dns_adbstats_nnamelocks);
 
 	/*
 	 * Normal return.
@@ -2734,42 +2804,54 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 		isc_task_detach(&adb->task);
 
 	/* clean up entrylocks */
-	DESTROYMUTEXBLOCK(adb->entrylocks, adb->nentries);
+	DESTROYMUTEXBLOCK(adb->entrylocks, adb->nentrylocks);
 
  fail2: /* clean up namelocks */
-	DESTROYMUTEXBLOCK(adb->namelocks, adb->nnames);
+	DESTROYMUTEXBLOCK(adb->namelocks, adb->nnamelocks);
 
  fail1: /* clean up only allocated memory */
 	if (adb->entries != NULL)
 		isc_mem_put(adb->mctx, adb->entries,
-			    sizeof(*adb->entries) * adb->nentries);
+			    sizeof(*adb->entries) * adb->nentrylocks);
 	if (adb->deadentries != NULL)
 		isc_mem_put(adb->mctx, adb->deadentries,
-			    sizeof(*adb->deadentries) * adb->nentries);
+			    sizeof(*adb->deadentries) * adb->nentrylocks);
+	if (adb->entrytables != NULL) {
+		for (i = 0; i < adb->nentrylocks; i++)
+			free_entrytable(adb, &adb->entrytables[i]);
+		isc_mem_put(adb->mctx, adb->entrytables,
+			    sizeof(*adb->entrytables) * adb->nentrylocks);
+	}
 	if (adb->entrylocks != NULL)
 		isc_mem_put(adb->mctx, adb->entrylocks,
-			    sizeof(*adb->entrylocks) * adb->nentries);
+			    sizeof(*adb->entrylocks) * adb->nentrylocks);
 	if (adb->entry_sd != NULL)
 		isc_mem_put(adb->mctx, adb->entry_sd,
-			    sizeof(*adb->entry_sd) * adb->nentries);
+			    sizeof(*adb->entry_sd) * adb->nentrylocks);
 	if (adb->entry_refcnt != NULL)
 		isc_mem_put(adb->mctx, adb->entry_refcnt,
-			    sizeof(*adb->entry_refcnt) * adb->nentries);
+			    sizeof(*adb->entry_refcnt) * adb->nentrylocks);
 	if (adb->names != NULL)
 		isc_mem_put(adb->mctx, adb->names,
-			    sizeof(*adb->names) * adb->nnames);
+			    sizeof(*adb->names) * adb->nnamelocks);
 	if (adb->deadnames != NULL)
 		isc_mem_put(adb->mctx, adb->deadnames,
-			    sizeof(*adb->deadnames) * adb->nnames);
+			    sizeof(*adb->deadnames) * adb->nnamelocks);
+	if (adb->nametables != NULL) {
+		for (i = 0; i < adb->nnamelocks; i++)
+			free_nametable(adb, &adb->nametables[i]);
+		isc_mem_put(adb->mctx, adb->nametables,
+			    sizeof(*adb->nametables) * adb->nnamelocks);
+	}
 	if (adb->namelocks != NULL)
 		isc_mem_put(adb->mctx, adb->namelocks,
-			    sizeof(*adb->namelocks) * adb->nnames);
+			    sizeof(*adb->namelocks) * adb->nnamelocks);
 	if (adb->name_sd != NULL)
 		isc_mem_put(adb->mctx, adb->name_sd,
-			    sizeof(*adb->name_sd) * adb->nnames);
+			    sizeof(*adb->name_sd) * adb->nnamelocks);
 	if (adb->name_refcnt != NULL)
 		isc_mem_put(adb->mctx, adb->name_refcnt,
-			    sizeof(*adb->name_refcnt) * adb->nnames);
+			    sizeof(*adb->name_refcnt) * adb->nnamelocks);
 	if (adb->nmp != NULL)
 		isc_mempool_destroy(&adb->nmp);
 	if (adb->nhmp != NULL)
@@ -2797,8 +2879,6 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
  fail0c:
 	DESTROYLOCK(&adb->lock);
  fail0b:
-	if (adb->excl != NULL)
-		isc_task_detach(&adb->excl);
 	isc_mem_putanddetach(&adb->mctx, adb, sizeof(dns_adb_t));
 
 	return (result);
@@ -2908,6 +2988,24 @@ dns_adb_shutdown(dns_adb_t *adb) {
 	LOCK(&adb->lock);
 
 	if (!adb->shutting_down) {
+		/*
+		 * Preserve the RTT estimates while the entries still exist.
+		 */
+		if (adb->statefile != NULL) {
+			isc_result_t result;
+
+			result = writestate(adb, adb->statefile);
+			if (result != ISC_R_SUCCESS)
+				isc_log_write(dns_lctx,
+					      DNS_LOGCATEGORY_DATABASE,
+					      DNS_LOGMODULE_ADB,
+					      ISC_LOG_WARNING,
+					      "error saving address database "
+					      "state to '%s': %s",
+					      adb->statefile,
+					      isc_result_totext(result));
+		}
+
 		adb->shutting_down = ISC_TRUE;
 		isc_mem_setwater(adb->mctx, water, adb, 0, 0);
 		/*
@@ -3419,15 +3517,294 @@ dns_adb_dump(dns_adb_t *adb, FILE *f) {
 	LOCK(&adb->lock);
 	isc_stdtime_get(&now);
 
-	for (i = 0; i < adb->nnames; i++)
+	for (i = 0; i < adb->nnamelocks; i++)
 		RUNTIME_CHECK(cleanup_names(adb, i, now) == ISC_FALSE);
-	for (i = 0; i < adb->nentries; i++)
+	for (i = 0; i < adb->nentrylocks; i++)
 		RUNTIME_CHECK(cleanup_entries(adb, i, now) == ISC_FALSE);
 
 	dump_adb(adb, f, ISC_FALSE, now);
 	UNLOCK(&adb->lock);
 }
 
+/*
+ * Write the address and SRTT of every live entry to 'filename'.  The
+ * data is written to a temporary file which then replaces 'filename',
+ * so a failed write leaves any previous state intact.  Each entry
+ * bucket is locked only while its entries are being written.
+ */
+static isc_result_t
+writestate(dns_adb_t *adb, const char *filename) {
+	isc_result_t result, tresult;
+	unsigned char data[ADB_STATE_RECSIZE];
+	isc_buffer_t buffer;
+	dns_adbentry_t *entry;
+	isc_netaddr_t netaddr;
+	isc_stdtime_t now;
+	char *tempname;
+	size_t tempnamelen;
+	FILE *fp = NULL;
+	unsigned int i;
+
+	tempnamelen = strlen(filename) + 20;
+	tempname = isc_mem_allocate(adb->mctx, tempnamelen);
+	if (tempname == NULL)
+		return (ISC_R_NOMEMORY);
+
+	result = isc_file_mktemplate(filename, tempname, tempnamelen);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	result = isc_file_bopenunique(tempname, &fp);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	isc_stdtime_get(&now);
+	isc_buffer_init(&buffer, data, sizeof(data));
+	isc_buffer_putuint32(&buffer, ADB_STATE_MAGIC);
+	isc_buffer_putuint32(&buffer, ADB_STATE_VERSION);
+	isc_buffer_putuint32(&buffer, now);
+	result = isc_stdio_write(data, 1, isc_buffer_usedlength(&buffer),
+				 fp, NULL);
+
+	for (i = 0; result == ISC_R_SUCCESS && i < adb->nentrylocks; i++) {
+		LOCK(&adb->entrylocks[i]);
+		for (entry = ISC_LIST_HEAD(adb->entries[i]);
+		     entry != NULL && result == ISC_R_SUCCESS;
+		     entry = ISC_LIST_NEXT(entry, plink))
+		{
+			isc_netaddr_fromsockaddr(&netaddr, &entry->sockaddr);
+			isc_buffer_clear(&buffer);
+			switch (netaddr.family) {
+			case AF_INET:
+				isc_buffer_putuint16(&buffer, 4);
+				isc_buffer_putuint16(&buffer,
+				      isc_sockaddr_getport(&entry->sockaddr));
+				isc_buffer_putmem(&buffer,
+				      (unsigned char *)&netaddr.type.in, 4);
+				break;
+			case AF_INET6:
+				isc_buffer_putuint16(&buffer, 6);
+				isc_buffer_putuint16(&buffer,
+				      isc_sockaddr_getport(&entry->sockaddr));
+				isc_buffer_putmem(&buffer,
+				      (unsigned char *)&netaddr.type.in6, 16);
+				break;
+			default:
+				continue;
+			}
+			isc_buffer_putuint32(&buffer, entry->srtt);
+			result = isc_stdio_write(data, 1,
+						 isc_buffer_usedlength(&buffer),
+						 fp, NULL);
+		}
+		UNLOCK(&adb->entrylocks[i]);
+	}
+
+	if (result == ISC_R_SUCCESS)
+		result = isc_stdio_flush(fp);
+	tresult = isc_stdio_close(fp);
+	if (result == ISC_R_SUCCESS)
+		result = tresult;
+	if (result == ISC_R_SUCCESS)
+		result = isc_file_rename(tempname, filename);
+	if (result != ISC_R_SUCCESS)
+		(void)isc_file_remove(tempname);
+
+ cleanup:
+	isc_mem_free(adb->mctx, tempname);
+	return (result);
+}
+
+/*
+ * Create an entry for 'sa' with the given SRTT unless one exists.
+ */
+static isc_result_t
+restore_entry(dns_adb_t *adb, isc_sockaddr_t *sa, unsigned int srtt,
+	      isc_stdtime_t now)
+{
+	dns_adbentry_t *entry;
+	isc_result_t result = ISC_R_SUCCESS;
+	int bucket;
+
+	bucket = DNS_ADB_INVALIDBUCKET;
+	entry = find_entry_and_lock(adb, sa, &bucket, now);
+	INSIST(bucket != DNS_ADB_INVALIDBUCKET);
+	if (adb->entry_sd[bucket]) {
+		result = ISC_R_SHUTTINGDOWN;
+		goto unlock;
+	}
+	if (entry == NULL) {
+		entry = new_adbentry(adb);
+		if (entry == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto unlock;
+		}
+		entry->sockaddr = *sa;
+		entry->srtt = srtt;
+		entry->expires = now + ADB_ENTRY_WINDOW;
+		link_entry(adb, bucket, entry);
+	}
+
+ unlock:
+	UNLOCK(&adb->entrylocks[bucket]);
+	return (result);
+}
+
+static isc_result_t
+readstate(dns_adb_t *adb, const char *filename) {
+	isc_result_t result;
+	unsigned char data[ADB_STATE_RECSIZE];
+	isc_buffer_t buffer;
+	isc_sockaddr_t sa;
+	struct in_addr in4;
+	struct in6_addr in6;
+	isc_stdtime_t now;
+	unsigned int family, srtt;
+	in_port_t port;
+	FILE *fp = NULL;
+
+	result = isc_stdio_open(filename, "rb", &fp);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	isc_buffer_init(&buffer, data, sizeof(data));
+	result = isc_stdio_read(data, 1, ADB_STATE_HDRSIZE, fp, NULL);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	isc_buffer_add(&buffer, ADB_STATE_HDRSIZE);
+	if (isc_buffer_getuint32(&buffer) != ADB_STATE_MAGIC ||
+	    isc_buffer_getuint32(&buffer) != ADB_STATE_VERSION)
+	{
+		result = ISC_R_INVALIDFILE;
+		goto cleanup;
+	}
+
+	isc_stdtime_get(&now);
+	for (;;) {
+		isc_buffer_clear(&buffer);
+		result = isc_stdio_read(data, 1, 4, fp, NULL);
+		if (result == ISC_R_EOF) {
+			result = ISC_R_SUCCESS;
+			break;
+		}
+		if (result != ISC_R_SUCCESS)
+			break;
+		isc_buffer_add(&buffer, 4);
+		family = isc_buffer_getuint16(&buffer);
+		port = isc_buffer_getuint16(&buffer);
+		if (family != 4 && family != 6) {
+			result = ISC_R_INVALIDFILE;
+			break;
+		}
+
+		isc_buffer_clear(&buffer);
+		if (family == 4) {
+			result = isc_stdio_read(data, 1, 4 + 4, fp, NULL);
+			if (result != ISC_R_SUCCESS)
+				break;
+			isc_buffer_add(&buffer, 4 + 4);
+			memmove(&in4, isc_buffer_current(&buffer), 4);
+			isc_buffer_forward(&buffer, 4);
+			isc_sockaddr_fromin(&sa, &in4, port);
+		} else {
+			result = isc_stdio_read(data, 1, 16 + 4, fp, NULL);
+			if (result != ISC_R_SUCCESS)
+				break;
+			isc_buffer_add(&buffer, 16 + 4);
+			memmove(&in6, isc_buffer_current(&buffer), 16);
+			isc_buffer_forward(&buffer, 16);
+			isc_sockaddr_fromin6(&sa, &in6, port);
+		}
+		srtt = isc_buffer_getuint32(&buffer);
+
+		result = restore_entry(adb, &sa, srtt, now);
+		if (result != ISC_R_SUCCESS)
+			break;
+	}
+
+	/* A truncated record means the file was damaged. */
+	if (result == ISC_R_EOF)
+		result = ISC_R_INVALIDFILE;
+
+ cleanup:
+	(void)isc_stdio_close(fp);
+	return (result);
+}
+
+isc_result_t
+dns_adb_setstatefile(dns_adb_t *adb, const char *filename) {
+	char *newname = NULL;
+
+	REQUIRE(DNS_ADB_VALID(adb));
+
+	if (filename != NULL) {
+		newname = isc_mem_strdup(adb->mctx, filename);
+		if (newname == NULL)
+			return (ISC_R_NOMEMORY);
+	}
+
+	LOCK(&adb->lock);
+	if (adb->statefile != NULL)
+		isc_mem_free(adb->mctx, adb->statefile);
+	adb->statefile = newname;
+	UNLOCK(&adb->lock);
+
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Take a private copy of the state file name so that the file can be
+ * read or written without holding the adb lock.
+ */
+static isc_result_t
+copystatefile(dns_adb_t *adb, char **filenamep) {
+	isc_result_t result = ISC_R_SUCCESS;
+
+	*filenamep = NULL;
+	LOCK(&adb->lock);
+	if (adb->statefile != NULL) {
+		*filenamep = isc_mem_strdup(adb->mctx, adb->statefile);
+		if (*filenamep == NULL)
+			result = ISC_R_NOMEMORY;
+	}
+	UNLOCK(&adb->lock);
+
+	return (result);
+}
+
+isc_result_t
+dns_adb_loadstate(dns_adb_t *adb) {
+	isc_result_t result;
+	char *filename;
+
+	REQUIRE(DNS_ADB_VALID(adb));
+
+	result = copystatefile(adb, &filename);
+	if (result != ISC_R_SUCCESS || filename == NULL)
+		return (result);
+
+	result = readstate(adb, filename);
+	isc_mem_free(adb->mctx, filename);
+
+	return (result);
+}
+
+isc_result_t
+dns_adb_savestate(dns_adb_t *adb) {
+	isc_result_t result;
+	char *filename;
+
+	REQUIRE(DNS_ADB_VALID(adb));
+
+	result = copystatefile(adb, &filename);
+	if (result != ISC_R_SUCCESS || filename == NULL)
+		return (result);
+
+	result = writestate(adb, filename);
+	isc_mem_free(adb->mctx, filename);
+
+	return (result);
+}
+
 static void
 dump_ttl(FILE *f, const char *legend, isc_stdtime_t value, isc_stdtime_t now) {
 	if (value == INT_MAX)
@@ -3450,15 +3827,15 @@ dump_adb(dns_adb_t *adb, FILE *f, isc_boolean_t debug, isc_stdtime_t now) {
 			adb, adb->erefcnt, adb->irefcnt,
 			isc_mempool_getallocated(adb->nhmp));
 
-	for (i = 0; i < adb->nnames; i++)
+	for (i = 0; i < adb->nnamelocks; i++)
 		LOCK(&adb->namelocks[i]);
-	for (i = 0; i < adb->nentries; i++)
+	for (i = 0; i < adb->nentrylocks; i++)
 		LOCK(&adb->entrylocks[i]);
 
 	/*
 	 * Dump the names
 	 */
-	for (i = 0; i < adb->nnames; i++) {
+	for (i = 0; i < adb->nnamelocks; i++) {
 		name = ISC_LIST_HEAD(adb->names[i]);
 		if (name == NULL)
 			continue;
@@ -3503,7 +3880,7 @@ dump_adb(dns_adb_t *adb, FILE *f, isc_boolean_t debug, isc_stdtime_t now) {
 
 	fprintf(f, ";\n; Unassociated entries\n;\n");
 
-	for (i = 0; i < adb->nentries; i++) {
+	for (i = 0; i < adb->nentrylocks; i++) {
 		entry = ISC_LIST_HEAD(adb->entries[i]);
 		while (entry != NULL) {
 			if (entry->nh == 0)
@@ -3515,9 +3892,9 @@ dump_adb(dns_adb_t *adb, FILE *f, isc_boolean_t debug, isc_stdtime_t now) {
 	/*
 	 * Unlock everything
 	 */
-	for (i = 0; i < adb->nentries; i++)
+	for (i = 0; i < adb->nentrylocks; i++)
 		UNLOCK(&adb->entrylocks[i]);
-	for (i = 0; i < adb->nnames; i++)
+	for (i = 0; i < adb->nnamelocks; i++)
 		UNLOCK(&adb->namelocks[i]);
 }
 
@@ -4663,9 +5040,9 @@ dns_adb_flush(dns_adb_t *adb) {
 	/*
 	 * Call our cleanup routines.
 	 */
-	for (i = 0; i < adb->nnames; i++)
+	for (i = 0; i < adb->nnamelocks; i++)
 		RUNTIME_CHECK(cleanup_names(adb, i, INT_MAX) == ISC_FALSE);
-	for (i = 0; i < adb->nentries; i++)
+	for (i = 0; i < adb->nentrylocks; i++)
 		RUNTIME_CHECK(cleanup_entries(adb, i, INT_MAX) == ISC_FALSE);
 
 #ifdef DUMP_ADB_AFTER_CLEANING
@@ -4679,19 +5056,23 @@ void
 dns_adb_flushname(dns_adb_t *adb, dns_name_t *name) {
 	dns_adbname_t *adbname;
 	dns_adbname_t *nextname;
+	adbnametable_t *table;
+	unsigned int hashval;
 	int bucket;
 
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(name != NULL);
 
 	LOCK(&adb->lock);
-	bucket = dns_name_hash(name, ISC_FALSE) % adb->nnames;
+	hashval = hashval_name(name);
+	bucket = hashval % adb->nnamelocks;
 	LOCK(&adb->namelocks[bucket]);
-	adbname = ISC_LIST_HEAD(adb->names[bucket]);
+	table = &adb->nametables[bucket];
+	migrate_names(adb, table);
+	adbname = ISC_LIST_HEAD(*name_chain(adb, table, hashval));
 	while (adbname != NULL) {
-		nextname = ISC_LIST_NEXT(adbname, plink);
-		if (!NAME_DEAD(adbname) &&
-		    dns_name_equal(name, &adbname->name)) {
+		nextname = ISC_LIST_NEXT(adbname, hlink);
+		if (dns_name_equal(name, &adbname->name)) {
 			RUNTIME_CHECK(kill_name(&adbname,
 						DNS_EVENT_ADBCANCELED) ==
 				      ISC_FALSE);
@@ -4711,7 +5092,7 @@ dns_adb_flushnames(dns_adb_t *adb, dns_name_t *name) {
 	REQUIRE(name != NULL);
 
 	LOCK(&adb->lock);
-	for (i = 0; i < adb->nnames; i++) {
+	for (i = 0; i < adb->nnamelocks; i++) {
 		LOCK(&adb->namelocks[i]);
 		adbname = ISC_LIST_HEAD(adb->names[i]);
 		while (adbname != NULL) {
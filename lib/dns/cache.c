@@ -15,6 +15,7 @@
 #include <isc/json.h>
 #include <isc/mem.h>
 #include <isc/print.h>
+#include <isc/stdio.h>
 #include <isc/string.h>
 #include <isc/stats.h>
 #include <isc/task.h>
@@ -502,6 +503,32 @@ dns_cache_setfilename(dns_cache_t *cache, const char *filename) {
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * Determine whether 'filename' holds a binary snapshot, as written by
+ * dns_cache_dump(), or a text master file from an older server.
+ */
+static dns_masterformat_t
+cachefile_format(const char *filename) {
+	unsigned char data[4];
+	isc_uint32_t format;
+	FILE *fp = NULL;
+	isc_result_t result;
+
+	result = isc_stdio_open(filename, "rb", &fp);
+	if (result != ISC_R_SUCCESS)
+		return (dns_masterformat_text);
+	result = isc_stdio_read(data, 1, sizeof(data), fp, NULL);
+	(void)isc_stdio_close(fp);
+	if (result != ISC_R_SUCCESS)
+		return (dns_masterformat_text);
+
+	format = ((isc_uint32_t)data[0] << 24) | (data[1] << 16) |
+		 (data[2] << 8) | data[3];
+	if (format == dns_masterformat_raw)
+		return (dns_masterformat_raw);
+	return (dns_masterformat_text);
+}
+
 isc_result_t
 dns_cache_load(dns_cache_t *cache) {
 	isc_result_t result;
@@ -512,7 +539,8 @@ dns_cache_load(dns_cache_t *cache) {
 		return (ISC_R_SUCCESS);
 
 	LOCK(&cache->filelock);
-	result = dns_db_load(cache->db, cache->filename);
+	result = dns_db_load2(cache->db, cache->filename,
+			      cachefile_format(cache->filename));
 	UNLOCK(&cache->filelock);
 
 	return (result);
@@ -528,8 +556,9 @@ dns_cache_dump(dns_cache_t *cache) {
 		return (ISC_R_SUCCESS);
 
 	LOCK(&cache->filelock);
-	result = dns_master_dump(cache->mctx, cache->db, NULL,
-				 &dns_master_style_cache, cache->filename);
+	result = dns_master_dump2(cache->mctx, cache->db, NULL,
+				  &dns_master_style_cache, cache->filename,
+				  dns_masterformat_raw);
 	UNLOCK(&cache->filelock);
 	return (result);
 
@@ -0,0 +1,660 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <isc/buffer.h>
+#include <isc/condition.h>
+#include <isc/event.h>
+#include <isc/mem.h>
+#include <isc/msgs.h>
+#include <isc/mutex.h>
+#include <isc/platform.h>
+#include <isc/string.h>
+#include <isc/task.h>
+#include <isc/thread.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/cryptopool.h>
+#include <dns/dnssec.h>
+#include <dns/events.h>
+#include <dns/name.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+
+#define CRYPTOPOOL_MAGIC		ISC_MAGIC('C', 'r', 'P', 'l')
+#define VALID_CRYPTOPOOL(p)		ISC_MAGIC_VALID(p, CRYPTOPOOL_MAGIC)
+
+#define CRYPTOBATCH_MAGIC		ISC_MAGIC('C', 'r', 'B', 't')
+#define VALID_CRYPTOBATCH(b)		ISC_MAGIC_VALID(b, CRYPTOBATCH_MAGIC)
+
+/*%
+ * The most jobs a worker takes off the queue at once.
+ */
+#define CRYPTOPOOL_BATCH		16U
+
+#define TIME_NOW(tp) 	RUNTIME_CHECK(isc_time_now((tp)) == ISC_R_SUCCESS)
+
+struct dns_cryptopool {
+	unsigned int			magic;
+	isc_mem_t			*mctx;
+	isc_mutex_t			lock;
+	/* Locked by lock. */
+	unsigned int			references;
+	isc_boolean_t			exiting;
+	isc_eventlist_t			queue;
+	unsigned int			depth;
+#ifdef ISC_PLATFORM_USETHREADS
+	isc_condition_t			wakeup;
+	unsigned int			nworkers;	/*%< running */
+	unsigned int			maxworkers;	/*%< allocated */
+	isc_thread_t			*workers;
+#endif
+};
+
+struct dns_cryptobatch {
+	unsigned int			magic;
+	isc_mem_t			*mctx;
+	dns_cryptopool_t		*pool;
+	isc_mutex_t			lock;
+	isc_condition_t			done;
+	/* Locked by lock. */
+	unsigned int			pending;
+	isc_eventlist_t			results;
+	isc_task_t			*task;		/*%< to notify */
+	isc_event_t			*event;
+};
+
+/*
+ * Free a job along with the copies of its arguments it owns.
+ */
+static void
+destroyevent(isc_event_t *event) {
+	dns_cryptoevent_t *cevent = (dns_cryptoevent_t *)event;
+	isc_mem_t *mctx = event->ev_destroy_arg;
+
+	if (dns_rdataset_isassociated(&cevent->rdataset))
+		dns_rdataset_disassociate(&cevent->rdataset);
+	if (cevent->key != NULL)
+		dst_key_free(&cevent->key);
+	if (cevent->sigbuf != NULL)
+		isc_mem_put(mctx, cevent->sigbuf, cevent->sigbuflen);
+	isc_mem_put(mctx, event, event->ev_size);
+}
+
+/*
+ * The completion events of batch jobs are handed back by
+ * dns_cryptobatch_wait() rather than sent, so this is never run.
+ */
+static void
+discard(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	isc_event_free(&event);
+}
+
+static void
+complete(dns_cryptoevent_t *cevent) {
+	dns_cryptobatch_t *batch = cevent->batch;
+	isc_task_t *task = cevent->task;
+	isc_time_t now;
+
+	TIME_NOW(&now);
+	cevent->latency = isc_time_microdiff(&now, &cevent->queued);
+
+	if (batch != NULL) {
+		isc_event_t *event = NULL;
+
+		LOCK(&batch->lock);
+		ISC_LIST_APPEND(batch->results, (isc_event_t *)cevent,
+				ev_link);
+		INSIST(batch->pending > 0);
+		if (--batch->pending == 0) {
+			SIGNAL(&batch->done);
+			task = batch->task;
+			event = batch->event;
+			batch->task = NULL;
+			batch->event = NULL;
+		}
+		UNLOCK(&batch->lock);
+		if (event != NULL)
+			isc_task_sendanddetach(&task, &event);
+		return;
+	}
+
+	cevent->task = NULL;
+	isc_task_sendanddetach(&task, ISC_EVENT_PTR(&cevent));
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+static void
+perform(dns_cryptopool_t *pool, dns_cryptoevent_t *cevent) {
+	dns_name_t *name, *wild;
+	isc_buffer_t buffer;
+	isc_time_t start, end;
+
+	name = dns_fixedname_name(&cevent->name);
+	wild = dns_fixedname_name(&cevent->wild);
+	TIME_NOW(&start);
+	if (cevent->op == dns_cryptoop_sign) {
+		isc_buffer_init(&buffer, cevent->sigbuf, cevent->sigbuflen);
+		cevent->result = dns_dnssec_sign(name, &cevent->rdataset,
+						 cevent->key,
+						 &cevent->inception,
+						 &cevent->expire, pool->mctx,
+						 &buffer, &cevent->sigrdata);
+		goto done;
+	}
+ again:
+	cevent->result = dns_dnssec_verify3(name, &cevent->rdataset,
+					    cevent->key, cevent->ignoretime,
+					    cevent->maxbits, pool->mctx,
+					    &cevent->sigrdata, wild);
+	if ((cevent->result == DNS_R_SIGEXPIRED ||
+	     cevent->result == DNS_R_SIGFUTURE) &&
+	    cevent->acceptexpired && !cevent->ignoretime)
+	{
+		cevent->ignoretime = ISC_TRUE;
+		goto again;
+	}
+ done:
+	TIME_NOW(&end);
+	cevent->cost = isc_time_microdiff(&end, &start);
+}
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+run(isc_threadarg_t arg) {
+	dns_cryptopool_t *pool = arg;
+	isc_eventlist_t batch;
+	isc_event_t *event;
+	unsigned int n;
+
+	LOCK(&pool->lock);
+	while (!pool->exiting) {
+		if (ISC_LIST_EMPTY(pool->queue)) {
+			WAIT(&pool->wakeup, &pool->lock);
+			continue;
+		}
+
+		/*
+		 * Take a share of the queue rather than all of it, so
+		 * that the other workers are not left idle behind us.
+		 */
+		n = (pool->depth + pool->nworkers - 1) / pool->nworkers;
+		if (n > CRYPTOPOOL_BATCH)
+			n = CRYPTOPOOL_BATCH;
+		ISC_LIST_INIT(batch);
+		while (n-- > 0 &&
+		       (event = ISC_LIST_HEAD(pool->queue)) != NULL)
+		{
+			ISC_LIST_UNLINK(pool->queue, event, ev_link);
+			ISC_LIST_APPEND(batch, event, ev_link);
+			pool->depth--;
+		}
+		UNLOCK(&pool->lock);
+
+		while ((event = ISC_LIST_HEAD(batch)) != NULL) {
+			ISC_LIST_UNLINK(batch, event, ev_link);
+			perform(pool, (dns_cryptoevent_t *)event);
+			complete((dns_cryptoevent_t *)event);
+		}
+
+		LOCK(&pool->lock);
+	}
+	UNLOCK(&pool->lock);
+
+	return ((isc_threadresult_t)0);
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+isc_result_t
+dns_cryptopool_create(isc_mem_t *mctx, unsigned int nworkers,
+		      dns_cryptopool_t **poolp)
+{
+#ifdef ISC_PLATFORM_USETHREADS
+	isc_result_t result;
+	dns_cryptopool_t *pool;
+	unsigned int i;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(nworkers > 0);
+	REQUIRE(poolp != NULL && *poolp == NULL);
+
+	pool = isc_mem_get(mctx, sizeof(*pool));
+	if (pool == NULL)
+		return (ISC_R_NOMEMORY);
+
+	pool->workers = isc_mem_get(mctx, nworkers * sizeof(isc_thread_t));
+	if (pool->workers == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_pool;
+	}
+
+	result = isc_mutex_init(&pool->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_workers;
+
+	if (isc_condition_init(&pool->wakeup) != ISC_R_SUCCESS) {
+		UNEXPECTED_ERROR(__FILE__, __LINE__,
+				 "isc_condition_init() %s",
+				 isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
+						ISC_MSG_FAILED, "failed"));
+		result = ISC_R_UNEXPECTED;
+		goto cleanup_lock;
+	}
+
+	pool->mctx = NULL;
+	isc_mem_attach(mctx, &pool->mctx);
+	pool->references = 1;
+	pool->exiting = ISC_FALSE;
+	ISC_LIST_INIT(pool->queue);
+	pool->depth = 0;
+	pool->nworkers = 0;
+	pool->maxworkers = nworkers;
+	pool->magic = CRYPTOPOOL_MAGIC;
+
+	for (i = 0; i < nworkers; i++) {
+		if (isc_thread_create(run, pool, &pool->workers[i]) !=
+		    ISC_R_SUCCESS)
+		{
+			UNEXPECTED_ERROR(__FILE__, __LINE__,
+					 "isc_thread_create() %s",
+					 isc_msgcat_get(isc_msgcat,
+							ISC_MSGSET_GENERAL,
+							ISC_MSG_FAILED,
+							"failed"));
+			break;
+		}
+		pool->nworkers++;
+	}
+	if (pool->nworkers == 0) {
+		dns_cryptopool_detach(&pool);
+		return (ISC_R_UNEXPECTED);
+	}
+
+	*poolp = pool;
+	return (ISC_R_SUCCESS);
+
+ cleanup_lock:
+	DESTROYLOCK(&pool->lock);
+ cleanup_workers:
+	isc_mem_put(mctx, pool->workers, nworkers * sizeof(isc_thread_t));
+ cleanup_pool:
+	isc_mem_put(mctx, pool, sizeof(*pool));
+	return (result);
+#else
+	REQUIRE(mctx != NULL);
+	REQUIRE(nworkers > 0);
+	REQUIRE(poolp != NULL && *poolp == NULL);
+
+	return (ISC_R_NOTIMPLEMENTED);
+#endif /* ISC_PLATFORM_USETHREADS */
+}
+
+static void
+destroy(dns_cryptopool_t *pool) {
+	isc_event_t *event;
+	dns_cryptoevent_t *cevent;
+	unsigned int i;
+
+	LOCK(&pool->lock);
+	pool->exiting = ISC_TRUE;
+#ifdef ISC_PLATFORM_USETHREADS
+	BROADCAST(&pool->wakeup);
+#endif
+	UNLOCK(&pool->lock);
+
+#ifdef ISC_PLATFORM_USETHREADS
+	for (i = 0; i < pool->nworkers; i++)
+		if (isc_thread_join(pool->workers[i], NULL) != ISC_R_SUCCESS)
+			UNEXPECTED_ERROR(__FILE__, __LINE__,
+					 "isc_thread_join() %s",
+					 isc_msgcat_get(isc_msgcat,
+							ISC_MSGSET_GENERAL,
+							ISC_MSG_FAILED,
+							"failed"));
+#else
+	UNUSED(i);
+#endif
+
+	/*
+	 * The workers are gone; whatever they did not get to is
+	 * cancelled so that its submitter is not left waiting.
+	 */
+	while ((event = ISC_LIST_HEAD(pool->queue)) != NULL) {
+		ISC_LIST_UNLINK(pool->queue, event, ev_link);
+		cevent = (dns_cryptoevent_t *)event;
+		cevent->result = ISC_R_CANCELED;
+		complete(cevent);
+	}
+
+#ifdef ISC_PLATFORM_USETHREADS
+	(void)isc_condition_destroy(&pool->wakeup);
+	isc_mem_put(pool->mctx, pool->workers,
+		    pool->maxworkers * sizeof(isc_thread_t));
+#endif
+	DESTROYLOCK(&pool->lock);
+	pool->magic = 0;
+	isc_mem_putanddetach(&pool->mctx, pool, sizeof(*pool));
+}
+
+void
+dns_cryptopool_attach(dns_cryptopool_t *source, dns_cryptopool_t **targetp) {
+	REQUIRE(VALID_CRYPTOPOOL(source));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	LOCK(&source->lock);
+	source->references++;
+	UNLOCK(&source->lock);
+
+	*targetp = source;
+}
+
+void
+dns_cryptopool_detach(dns_cryptopool_t **poolp) {
+	dns_cryptopool_t *pool;
+	isc_boolean_t free_now;
+
+	REQUIRE(poolp != NULL && VALID_CRYPTOPOOL(*poolp));
+
+	pool = *poolp;
+	*poolp = NULL;
+
+	LOCK(&pool->lock);
+	INSIST(pool->references > 0);
+	pool->references--;
+	free_now = ISC_TF(pool->references == 0);
+	UNLOCK(&pool->lock);
+
+	if (free_now)
+		destroy(pool);
+}
+
+/*
+ * Allocate a job for 'op' with its own copies of 'name', 'rdataset' and
+ * 'key', and a signature buffer of 'buflen' bytes.
+ */
+static isc_result_t
+newjob(dns_cryptopool_t *pool, dns_cryptoop_t op, dns_name_t *name,
+       dns_rdataset_t *rdataset, dst_key_t *key, unsigned int buflen,
+       isc_taskaction_t action, void *arg, dns_cryptoevent_t **ceventp)
+{
+	dns_cryptoevent_t *cevent;
+	isc_result_t result;
+
+	cevent = (dns_cryptoevent_t *)
+		isc_event_allocate(pool->mctx, pool, DNS_EVENT_CRYPTODONE,
+				   action, arg, sizeof(*cevent));
+	if (cevent == NULL)
+		return (ISC_R_NOMEMORY);
+	cevent->ev_destroy = destroyevent;
+
+	cevent->op = op;
+	dns_fixedname_init(&cevent->name);
+	dns_rdataset_init(&cevent->rdataset);
+	cevent->key = NULL;
+	dns_rdata_init(&cevent->sigrdata);
+	cevent->sigbuf = NULL;
+	cevent->sigbuflen = 0;
+	cevent->maxbits = 0;
+	cevent->acceptexpired = ISC_FALSE;
+	cevent->inception = 0;
+	cevent->expire = 0;
+	cevent->result = ISC_R_UNEXPECTED;
+	cevent->ignoretime = ISC_FALSE;
+	dns_fixedname_init(&cevent->wild);
+	cevent->latency = 0;
+	cevent->cost = 0;
+	cevent->task = NULL;
+	cevent->batch = NULL;
+
+	result = dns_name_copy(name, dns_fixedname_name(&cevent->name), NULL);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	dns_rdataset_clone(rdataset, &cevent->rdataset);
+	dst_key_attach(key, &cevent->key);
+
+	cevent->sigbuf = isc_mem_get(pool->mctx, buflen);
+	if (cevent->sigbuf == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup;
+	}
+	cevent->sigbuflen = buflen;
+
+	*ceventp = cevent;
+	return (ISC_R_SUCCESS);
+
+ cleanup:
+	isc_event_free(ISC_EVENT_PTR(&cevent));
+	return (result);
+}
+
+static isc_result_t
+enqueue(dns_cryptopool_t *pool, dns_cryptoevent_t *cevent) {
+	TIME_NOW(&cevent->queued);
+
+	LOCK(&pool->lock);
+	if (pool->exiting) {
+		UNLOCK(&pool->lock);
+		return (ISC_R_SHUTTINGDOWN);
+	}
+	ISC_LIST_APPEND(pool->queue, (isc_event_t *)cevent, ev_link);
+	pool->depth++;
+#ifdef ISC_PLATFORM_USETHREADS
+	SIGNAL(&pool->wakeup);
+#endif
+	UNLOCK(&pool->lock);
+
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+dns_cryptopool_verify(dns_cryptopool_t *pool, dns_name_t *name,
+		      dns_rdataset_t *rdataset, dst_key_t *key,
+		      dns_rdata_t *sigrdata, unsigned int maxbits,
+		      isc_boolean_t acceptexpired, isc_task_t *task,
+		      isc_taskaction_t action, void *arg)
+{
+	dns_cryptoevent_t *cevent = NULL;
+	isc_region_t r;
+	isc_result_t result;
+
+	REQUIRE(VALID_CRYPTOPOOL(pool));
+	REQUIRE(sigrdata != NULL && sigrdata->type == dns_rdatatype_rrsig);
+	REQUIRE(task != NULL);
+
+	result = newjob(pool, dns_cryptoop_verify, name, rdataset, key,
+			sigrdata->length, action, arg, &cevent);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	memmove(cevent->sigbuf, sigrdata->data, sigrdata->length);
+	r.base = cevent->sigbuf;
+	r.length = sigrdata->length;
+	dns_rdata_fromregion(&cevent->sigrdata, sigrdata->rdclass,
+			     sigrdata->type, &r);
+	cevent->maxbits = maxbits;
+	cevent->acceptexpired = acceptexpired;
+	isc_task_attach(task, &cevent->task);
+
+	result = enqueue(pool, cevent);
+	if (result != ISC_R_SUCCESS) {
+		isc_task_detach(&cevent->task);
+		isc_event_free(ISC_EVENT_PTR(&cevent));
+	}
+	return (result);
+}
+
+isc_result_t
+dns_cryptobatch_create(dns_cryptopool_t *pool, dns_cryptobatch_t **batchp) {
+	dns_cryptobatch_t *batch;
+	isc_result_t result;
+
+	REQUIRE(VALID_CRYPTOPOOL(pool));
+	REQUIRE(batchp != NULL && *batchp == NULL);
+
+	batch = isc_mem_get(pool->mctx, sizeof(*batch));
+	if (batch == NULL)
+		return (ISC_R_NOMEMORY);
+
+	result = isc_mutex_init(&batch->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_batch;
+
+	if (isc_condition_init(&batch->done) != ISC_R_SUCCESS) {
+		UNEXPECTED_ERROR(__FILE__, __LINE__,
+				 "isc_condition_init() %s",
+				 isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
+						ISC_MSG_FAILED, "failed"));
+		result = ISC_R_UNEXPECTED;
+		goto cleanup_lock;
+	}
+
+	batch->mctx = NULL;
+	isc_mem_attach(pool->mctx, &batch->mctx);
+	batch->pool = NULL;
+	dns_cryptopool_attach(pool, &batch->pool);
+	batch->pending = 0;
+	ISC_LIST_INIT(batch->results);
+	batch->task = NULL;
+	batch->event = NULL;
+	batch->magic = CRYPTOBATCH_MAGIC;
+
+	*batchp = batch;
+	return (ISC_R_SUCCESS);
+
+ cleanup_lock:
+	DESTROYLOCK(&batch->lock);
+ cleanup_batch:
+	isc_mem_put(pool->mctx, batch, sizeof(*batch));
+	return (result);
+}
+
+isc_result_t
+dns_cryptobatch_sign(dns_cryptobatch_t *batch, dns_name_t *name,
+		     dns_rdataset_t *rdataset, dst_key_t *key,
+		     isc_stdtime_t inception, isc_stdtime_t expire)
+{
+	dns_cryptoevent_t *cevent = NULL;
+	isc_result_t result;
+	unsigned int sigsize;
+
+	REQUIRE(VALID_CRYPTOBATCH(batch));
+
+	/* The RRSIG fields, the signer name and the signature. */
+	result = dst_key_sigsize(key, &sigsize);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	result = newjob(batch->pool, dns_cryptoop_sign, name, rdataset, key,
+			18 + dst_key_name(key)->length + sigsize,
+			discard, NULL, &cevent);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	cevent->inception = inception;
+	cevent->expire = expire;
+	cevent->batch = batch;
+
+	LOCK(&batch->lock);
+	INSIST(batch->event == NULL);
+	batch->pending++;
+	UNLOCK(&batch->lock);
+
+	result = enqueue(batch->pool, cevent);
+	if (result != ISC_R_SUCCESS) {
+		LOCK(&batch->lock);
+		batch->pending--;
+		UNLOCK(&batch->lock);
+		isc_event_free(ISC_EVENT_PTR(&cevent));
+	}
+	return (result);
+}
+
+void
+dns_cryptobatch_wait(dns_cryptobatch_t *batch, isc_eventlist_t *results) {
+	REQUIRE(VALID_CRYPTOBATCH(batch));
+	REQUIRE(results != NULL);
+
+	LOCK(&batch->lock);
+	while (batch->pending > 0)
+		WAIT(&batch->done, &batch->lock);
+	ISC_LIST_APPENDLIST(*results, batch->results, ev_link);
+	UNLOCK(&batch->lock);
+}
+
+void
+dns_cryptobatch_notify(dns_cryptobatch_t *batch, isc_task_t *task,
+		       isc_event_t **eventp)
+{
+	isc_task_t *clone = NULL;
+	isc_event_t *event;
+
+	REQUIRE(VALID_CRYPTOBATCH(batch));
+	REQUIRE(eventp != NULL && *eventp != NULL);
+
+	event = *eventp;
+	*eventp = NULL;
+	isc_task_attach(task, &clone);
+
+	LOCK(&batch->lock);
+	INSIST(batch->event == NULL);
+	if (batch->pending > 0) {
+		batch->task = clone;
+		batch->event = event;
+		event = NULL;
+	}
+	UNLOCK(&batch->lock);
+
+	if (event != NULL)
+		isc_task_sendanddetach(&clone, &event);
+}
+
+void
+dns_cryptobatch_destroy(dns_cryptobatch_t **batchp) {
+	dns_cryptobatch_t *batch;
+	isc_eventlist_t results;
+	isc_event_t *event;
+
+	REQUIRE(batchp != NULL && VALID_CRYPTOBATCH(*batchp));
+
+	batch = *batchp;
+	*batchp = NULL;
+
+	ISC_LIST_INIT(results);
+	dns_cryptobatch_wait(batch, &results);
+	while ((event = ISC_LIST_HEAD(results)) != NULL) {
+		ISC_LIST_UNLINK(results, event, ev_link);
+		isc_event_free(&event);
+	}
+	INSIST(batch->event == NULL);
+
+	batch->magic = 0;
+	(void)isc_condition_destroy(&batch->done);
+	DESTROYLOCK(&batch->lock);
+	dns_cryptopool_detach(&batch->pool);
+	isc_mem_putanddetach(&batch->mctx, batch, sizeof(*batch));
+}
+
+unsigned int
+dns_cryptopool_depth(dns_cryptopool_t *pool) {
+	unsigned int depth;
+
+	REQUIRE(VALID_CRYPTOPOOL(pool));
+
+	LOCK(&pool->lock);
+	depth = pool->depth;
+	UNLOCK(&pool->lock);
+
+	return (depth);
+}
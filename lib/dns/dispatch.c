@@ -18,6 +18,7 @@
 #include <isc/entropy.h>
 #include <isc/mem.h>
 #include <isc/mutex.h>
+#include <isc/mutexblock.h>
 #include <isc/portset.h>
 #include <isc/print.h>
 #include <isc/random.h>
@@ -46,15 +47,34 @@ typedef ISC_LIST(dispsocket_t)		dispsocketlist_t;
 typedef struct dispportentry		dispportentry_t;
 typedef ISC_LIST(dispportentry_t)	dispportlist_t;
 
+/*%
+ * The response and socket tables are split into 'qid_nlocks' stripes,
+ * bucket 'b' being protected by qid_locks[b % qid_nlocks], so that
+ * fetches and incoming responses that hash to different buckets don't
+ * contend for a single lock.  'lock' protects the port tables.
+ */
 typedef struct dns_qid {
 	unsigned int	magic;
 	unsigned int	qid_nbuckets;	/*%< hash table size */
 	unsigned int	qid_increment;	/*%< id increment on collision */
 	isc_mutex_t	lock;
+	unsigned int	qid_nlocks;	/*%< number of bucket locks */
+	isc_mutex_t	*qid_locks;	/*%< bucket locks */
 	dns_displist_t	*qid_table;	/*%< the table itself */
 	dispsocketlist_t *sock_table;	/*%< socket table */
 } dns_qid_t;
 
+#define QID_BUCKETLOCK(qid, bucket) \
+	(&(qid)->qid_locks[(bucket) % (qid)->qid_nlocks])
+
+/*%
+ * Number of bucket locks of the shared UDP query ID table.  Per dispatch
+ * TCP tables are only used by a single connection and get one lock.
+ */
+#ifndef DNS_QID_NLOCKS
+#define DNS_QID_NLOCKS		61
+#endif
+
 struct dns_dispatchmgr {
 	/* Unlocked. */
 	unsigned int			magic;
@@ -293,9 +313,6 @@ static void *allocate_udp_buffer(dns_dispatch_t *disp);
 static inline void free_devent(dns_dispatch_t *disp, dns_dispatchevent_t *ev);
 static inline dns_dispatchevent_t *allocate_devent(dns_dispatch_t *disp);
 static void do_cancel(dns_dispatch_t *disp);
-static dns_dispentry_t *linear_first(dns_qid_t *disp);
-static dns_dispentry_t *linear_next(dns_qid_t *disp,
-				    dns_dispentry_t *resp);
 static void dispatch_free(dns_dispatch_t **dispp);
 static isc_result_t get_udpsocket(dns_dispatchmgr_t *mgr,
 				  dns_dispatch_t *disp,
@@ -314,7 +331,8 @@ static isc_result_t dispatch_createudp(dns_dispatchmgr_t *mgr,
 static isc_boolean_t destroy_mgr_ok(dns_dispatchmgr_t *mgr);
 static void destroy_mgr(dns_dispatchmgr_t **mgrp);
 static isc_result_t qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
-				 unsigned int increment, dns_qid_t **qidp,
+				 unsigned int nlocks, unsigned int increment,
+				 dns_qid_t **qidp,
 				 isc_boolean_t needaddrtable);
 static void qid_destroy(isc_mem_t *mctx, dns_qid_t **qidp);
 static isc_result_t open_socket(isc_socketmgr_t *mgr, isc_sockaddr_t *local,
@@ -431,51 +449,6 @@ dns_hash(dns_qid_t *qid, isc_sockaddr_t *dest, dns_messageid_t id,
 	return (ret);
 }
 
-/*
- * Find the first entry in 'qid'.  Returns NULL if there are no entries.
- */
-static dns_dispentry_t *
-linear_first(dns_qid_t *qid) {
-	dns_dispentry_t *ret;
-	unsigned int bucket;
-
-	bucket = 0;
-
-	while (bucket < qid->qid_nbuckets) {
-		ret = ISC_LIST_HEAD(qid->qid_table[bucket]);
-		if (ret != NULL)
-			return (ret);
-		bucket++;
-	}
-
-	return (NULL);
-}
-
-/*
- * Find the next entry after 'resp' in 'qid'.  Return NULL if there are
- * no more entries.
- */
-static dns_dispentry_t *
-linear_next(dns_qid_t *qid, dns_dispentry_t *resp) {
-	dns_dispentry_t *ret;
-	unsigned int bucket;
-
-	ret = ISC_LIST_NEXT(resp, link);
-	if (ret != NULL)
-		return (ret);
-
-	bucket = resp->bucket;
-	bucket++;
-	while (bucket < qid->qid_nbuckets) {
-		ret = ISC_LIST_HEAD(qid->qid_table[bucket]);
-		if (ret != NULL)
-			return (ret);
-		bucket++;
-	}
-
-	return (NULL);
-}
-
 /*
  * The dispatch must be locked.
  */
@@ -615,8 +588,9 @@ deref_portentry(dns_dispatch_t *disp, dispportentry_t **portentryp) {
 	}
 
 	/*
-	 * Set '*portentryp' to NULL inside the lock so that
-	 * dispsock->portentry does not change in socket_search.
+	 * socket_search() only holds the bucket lock, so dispsocks are
+	 * removed from the socket table before their port entry is
+	 * released.
 	 */
 	*portentryp = NULL;
 
@@ -625,7 +599,8 @@ deref_portentry(dns_dispatch_t *disp, dispportentry_t **portentryp) {
 
 /*%
  * Find a dispsocket for socket address 'dest', and port number 'port'.
- * Return NULL if no such entry exists.  Requires qid->lock to be held.
+ * Return NULL if no such entry exists.  Requires the lock of 'bucket' to
+ * be held.
  */
 static dispsocket_t *
 socket_search(dns_qid_t *qid, isc_sockaddr_t *dest, in_port_t port,
@@ -718,13 +693,13 @@ get_dispsocket(dns_dispatch_t *disp, isc_sockaddr_t *dest,
 		port = ports[isc_rng_uniformrandom(DISP_RNGCTX(disp), nports)];
 		isc_sockaddr_setport(&localaddr, port);
 
-		LOCK(&qid->lock);
 		bucket = dns_hash(qid, dest, 0, port);
+		LOCK(QID_BUCKETLOCK(qid, bucket));
 		if (socket_search(qid, dest, port, bucket) != NULL) {
-			UNLOCK(&qid->lock);
+			UNLOCK(QID_BUCKETLOCK(qid, bucket));
 			continue;
 		}
-		UNLOCK(&qid->lock);
+		UNLOCK(QID_BUCKETLOCK(qid, bucket));
 		bindoptions = 0;
 		portentry = port_search(disp, port);
 
@@ -760,9 +735,9 @@ get_dispsocket(dns_dispatch_t *disp, isc_sockaddr_t *dest,
 		dispsock->host = *dest;
 		dispsock->portentry = portentry;
 		dispsock->bucket = bucket;
-		LOCK(&qid->lock);
+		LOCK(QID_BUCKETLOCK(qid, bucket));
 		ISC_LIST_APPEND(qid->sock_table[bucket], dispsock, blink);
-		UNLOCK(&qid->lock);
+		UNLOCK(QID_BUCKETLOCK(qid, bucket));
 		*dispsockp = dispsock;
 		*portp = port;
 	} else {
@@ -797,17 +772,17 @@ destroy_dispsocket(dns_dispatch_t *disp, dispsocket_t **dispsockp) {
 
 	disp->nsockets--;
 	dispsock->magic = 0;
-	if (dispsock->portentry != NULL)
-		deref_portentry(disp, &dispsock->portentry);
-	if (dispsock->socket != NULL)
-		isc_socket_detach(&dispsock->socket);
 	if (ISC_LINK_LINKED(dispsock, blink)) {
 		qid = DNS_QID(disp);
-		LOCK(&qid->lock);
+		LOCK(QID_BUCKETLOCK(qid, dispsock->bucket));
 		ISC_LIST_UNLINK(qid->sock_table[dispsock->bucket], dispsock,
 				blink);
-		UNLOCK(&qid->lock);
+		UNLOCK(QID_BUCKETLOCK(qid, dispsock->bucket));
 	}
+	if (dispsock->portentry != NULL)
+		deref_portentry(disp, &dispsock->portentry);
+	if (dispsock->socket != NULL)
+		isc_socket_detach(&dispsock->socket);
 	if (dispsock->task != NULL)
 		isc_task_detach(&dispsock->task);
 	isc_mempool_put(disp->mgr->spool, dispsock);
@@ -833,6 +808,11 @@ deactivate_dispsocket(dns_dispatch_t *disp, dispsocket_t *dispsock) {
 		dispsock->resp->dispsocket = NULL;
 	}
 
+	qid = DNS_QID(disp);
+	LOCK(QID_BUCKETLOCK(qid, dispsock->bucket));
+	ISC_LIST_UNLINK(qid->sock_table[dispsock->bucket], dispsock, blink);
+	UNLOCK(QID_BUCKETLOCK(qid, dispsock->bucket));
+
 	INSIST(dispsock->portentry != NULL);
 	deref_portentry(disp, &dispsock->portentry);
 
@@ -840,13 +820,6 @@ deactivate_dispsocket(dns_dispatch_t *disp, dispsocket_t *dispsock) {
 		destroy_dispsocket(disp, &dispsock);
 	else {
 		result = isc_socket_close(dispsock->socket);
-
-		qid = DNS_QID(disp);
-		LOCK(&qid->lock);
-		ISC_LIST_UNLINK(qid->sock_table[dispsock->bucket], dispsock,
-				blink);
-		UNLOCK(&qid->lock);
-
 		if (result == ISC_R_SUCCESS)
 			ISC_LIST_APPEND(disp->inactivesockets, dispsock, link);
 		else {
@@ -1183,7 +1156,7 @@ udp_recv(isc_event_t *ev_in, dns_dispatch_t *disp, dispsocket_t *dispsock) {
 	 */
 	if (resp == NULL) {
 		bucket = dns_hash(qid, &ev->address, id, disp->localport);
-		LOCK(&qid->lock);
+		LOCK(QID_BUCKETLOCK(qid, bucket));
 		qidlocked = ISC_TRUE;
 		resp = entry_search(qid, &ev->address, id, disp->localport,
 				    bucket);
@@ -1284,7 +1257,7 @@ udp_recv(isc_event_t *ev_in, dns_dispatch_t *disp, dispsocket_t *dispsock) {
 	}
  unlock:
 	if (qidlocked)
-		UNLOCK(&qid->lock);
+		UNLOCK(QID_BUCKETLOCK(qid, bucket));
 
 	/*
 	 * Restart recv() to get the next packet.
@@ -1439,7 +1412,7 @@ tcp_recv(isc_task_t *task, isc_event_t *ev_in) {
 	 * Response.
 	 */
 	bucket = dns_hash(qid, &tcpmsg->address, id, disp->localport);
-	LOCK(&qid->lock);
+	LOCK(QID_BUCKETLOCK(qid, bucket));
 	resp = entry_search(qid, &tcpmsg->address, id, disp->localport, bucket);
 	dispatch_log(disp, LVL(90),
 		     "search for response in bucket %d: %s",
@@ -1475,7 +1448,7 @@ tcp_recv(isc_task_t *task, isc_event_t *ev_in) {
 		isc_task_send(resp->task, ISC_EVENT_PTR(&rev));
 	}
  unlock:
-	UNLOCK(&qid->lock);
+	UNLOCK(QID_BUCKETLOCK(qid, bucket));
 
 	/*
 	 * Restart recv() to get the next packet.
@@ -2086,7 +2059,8 @@ dns_dispatchmgr_setudp(dns_dispatchmgr_t *mgr,
 	isc_mempool_associatelock(mgr->spool, &mgr->spool_lock);
 	isc_mempool_setfillcount(mgr->spool, 32);
 
-	result = qid_allocate(mgr, buckets, increment, &mgr->qid, ISC_TRUE);
+	result = qid_allocate(mgr, buckets, DNS_QID_NLOCKS, increment,
+			      &mgr->qid, ISC_TRUE);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup;
 
@@ -2278,7 +2252,7 @@ dispatch_find(dns_dispatchmgr_t *mgr, isc_sockaddr_t *local,
 
 static isc_result_t
 qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
-	     unsigned int increment, dns_qid_t **qidp,
+	     unsigned int nlocks, unsigned int increment, dns_qid_t **qidp,
 	     isc_boolean_t needsocktable)
 {
 	dns_qid_t *qid;
@@ -2288,8 +2262,12 @@ qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
 	REQUIRE(VALID_DISPATCHMGR(mgr));
 	REQUIRE(buckets < 2097169);  /* next prime > 65536 * 32 */
 	REQUIRE(increment > buckets);
+	REQUIRE(nlocks > 0);
 	REQUIRE(qidp != NULL && *qidp == NULL);
 
+	if (nlocks > buckets)
+		nlocks = buckets;
+
 	qid = isc_mem_get(mgr->mctx, sizeof(*qid));
 	if (qid == NULL)
 		return (ISC_R_NOMEMORY);
@@ -2325,6 +2303,18 @@ qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
 		return (result);
 	}
 
+	qid->qid_locks = isc_mem_get(mgr->mctx, nlocks * sizeof(isc_mutex_t));
+	if (qid->qid_locks == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_lock;
+	}
+	result = isc_mutexblock_init(qid->qid_locks, nlocks);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(mgr->mctx, qid->qid_locks,
+			    nlocks * sizeof(isc_mutex_t));
+		goto cleanup_lock;
+	}
+
 	for (i = 0; i < buckets; i++) {
 		ISC_LIST_INIT(qid->qid_table[i]);
 		if (qid->sock_table != NULL)
@@ -2332,10 +2322,22 @@ qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
 	}
 
 	qid->qid_nbuckets = buckets;
+	qid->qid_nlocks = nlocks;
 	qid->qid_increment = increment;
 	qid->magic = QID_MAGIC;
 	*qidp = qid;
 	return (ISC_R_SUCCESS);
+
+ cleanup_lock:
+	DESTROYLOCK(&qid->lock);
+	if (qid->sock_table != NULL) {
+		isc_mem_put(mgr->mctx, qid->sock_table,
+			    buckets * sizeof(dispsocketlist_t));
+	}
+	isc_mem_put(mgr->mctx, qid->qid_table,
+		    buckets * sizeof(dns_displist_t));
+	isc_mem_put(mgr->mctx, qid, sizeof(*qid));
+	return (result);
 }
 
 static void
@@ -2356,6 +2358,9 @@ qid_destroy(isc_mem_t *mctx, dns_qid_t **qidp) {
 			    qid->qid_nbuckets * sizeof(dispsocketlist_t));
 	}
 	DESTROYLOCK(&qid->lock);
+	(void)isc_mutexblock_destroy(qid->qid_locks, qid->qid_nlocks);
+	isc_mem_put(mctx, qid->qid_locks,
+		    qid->qid_nlocks * sizeof(isc_mutex_t));
 	isc_mem_put(mctx, qid, sizeof(*qid));
 }
 
@@ -2541,7 +2546,8 @@ dns_dispatch_createtcp2(dns_dispatchmgr_t *mgr, isc_socket_t *sock,
 		return (result);
 	}
 
-	result = qid_allocate(mgr, buckets, increment, &disp->qid, ISC_FALSE);
+	result = qid_allocate(mgr, buckets, 1, increment, &disp->qid,
+			      ISC_FALSE);
 	if (result != ISC_R_SUCCESS)
 		goto deallocate_dispatch;
 
@@ -3273,11 +3279,33 @@ dns_dispatch_addresponse3(dns_dispatch_t *disp, unsigned int options,
 		localport = disp->localport;
 	}
 
+	res = isc_mempool_get(disp->mgr->rpool);
+	if (res == NULL) {
+		if (dispsocket != NULL)
+			destroy_dispsocket(disp, &dispsocket);
+		UNLOCK(&disp->lock);
+		return (ISC_R_NOMEMORY);
+	}
+
+	res->task = NULL;
+	isc_task_attach(task, &res->task);
+	res->disp = disp;
+	res->port = localport;
+	res->host = *dest;
+	res->action = action;
+	res->arg = arg;
+	res->dispsocket = dispsocket;
+	res->item_out = ISC_FALSE;
+	ISC_LIST_INIT(res->items);
+	ISC_LINK_INIT(res, link);
+	res->magic = RESPONSE_MAGIC;
+
 	/*
 	 * Try somewhat hard to find an unique ID unless FIXEDID is set
-	 * in which case we use the id passed in via *idp.
+	 * in which case we use the id passed in via *idp.  The entry is
+	 * linked while the lock its bucket was searched under is still
+	 * held, so no other fetch can claim the same ID in the meantime.
 	 */
-	LOCK(&qid->lock);
 	if ((options & DNS_DISPATCHOPT_FIXEDID) != 0)
 		id = *idp;
 	else
@@ -3286,52 +3314,36 @@ dns_dispatch_addresponse3(dns_dispatch_t *disp, unsigned int options,
 	i = 0;
 	do {
 		bucket = dns_hash(qid, dest, id, localport);
+		LOCK(QID_BUCKETLOCK(qid, bucket));
 		if (entry_search(qid, dest, id, localport, bucket) == NULL) {
+			res->id = id;
+			res->bucket = bucket;
+			ISC_LIST_APPEND(qid->qid_table[bucket], res, link);
 			ok = ISC_TRUE;
-			break;
 		}
+		UNLOCK(QID_BUCKETLOCK(qid, bucket));
+		if (ok)
+			break;
 		if ((disp->attributes & DNS_DISPATCHATTR_FIXEDID) != 0)
 			break;
 		id += qid->qid_increment;
 		id &= 0x0000ffff;
 	} while (i++ < 64);
-	UNLOCK(&qid->lock);
 
 	if (!ok) {
-		UNLOCK(&disp->lock);
-		return (ISC_R_NOMORE);
-	}
-
-	res = isc_mempool_get(disp->mgr->rpool);
-	if (res == NULL) {
+		res->magic = 0;
+		isc_task_detach(&res->task);
+		isc_mempool_put(disp->mgr->rpool, res);
 		if (dispsocket != NULL)
 			destroy_dispsocket(disp, &dispsocket);
 		UNLOCK(&disp->lock);
-		return (ISC_R_NOMEMORY);
+		return (ISC_R_NOMORE);
 	}
 
 	disp->refcount++;
 	disp->requests++;
-	res->task = NULL;
-	isc_task_attach(task, &res->task);
-	res->disp = disp;
-	res->id = id;
-	res->port = localport;
-	res->bucket = bucket;
-	res->host = *dest;
-	res->action = action;
-	res->arg = arg;
-	res->dispsocket = dispsocket;
 	if (dispsocket != NULL)
 		dispsocket->resp = res;
-	res->item_out = ISC_FALSE;
-	ISC_LIST_INIT(res->items);
-	ISC_LINK_INIT(res, link);
-	res->magic = RESPONSE_MAGIC;
-
-	LOCK(&qid->lock);
-	ISC_LIST_APPEND(qid->qid_table[bucket], res, link);
-	UNLOCK(&qid->lock);
 
 	inc_stats(disp->mgr, (qid == disp->mgr->qid) ?
 			     dns_resstatscounter_disprequdp :
@@ -3344,9 +3356,9 @@ dns_dispatch_addresponse3(dns_dispatch_t *disp, unsigned int options,
 	    ((disp->attributes & DNS_DISPATCHATTR_CONNECTED) != 0)) {
 		result = startrecv(disp, dispsocket);
 		if (result != ISC_R_SUCCESS) {
-			LOCK(&qid->lock);
+			LOCK(QID_BUCKETLOCK(qid, bucket));
 			ISC_LIST_UNLINK(qid->qid_table[bucket], res, link);
-			UNLOCK(&qid->lock);
+			UNLOCK(QID_BUCKETLOCK(qid, bucket));
 
 			if (dispsocket != NULL)
 				destroy_dispsocket(disp, &dispsocket);
@@ -3508,9 +3520,9 @@ dns_dispatch_removeresponse(dns_dispentry_t **resp,
 
 	bucket = res->bucket;
 
-	LOCK(&qid->lock);
+	LOCK(QID_BUCKETLOCK(qid, bucket));
 	ISC_LIST_UNLINK(qid->qid_table[bucket], res, link);
-	UNLOCK(&qid->lock);
+	UNLOCK(QID_BUCKETLOCK(qid, bucket));
 
 	if (ev == NULL && res->item_out) {
 		/*
@@ -3571,8 +3583,9 @@ dns_dispatch_removeresponse(dns_dispentry_t **resp,
 static void
 do_cancel(dns_dispatch_t *disp) {
 	dns_dispatchevent_t *ev;
-	dns_dispentry_t *resp;
+	dns_dispentry_t *resp = NULL;
 	dns_qid_t *qid;
+	unsigned int bucket;
 
 	if (disp->shutdown_out == 1)
 		return;
@@ -3581,19 +3594,25 @@ do_cancel(dns_dispatch_t *disp) {
 
 	/*
 	 * Search for the first response handler without packets outstanding
-	 * unless a specific hander is given.
+	 * unless a specific hander is given.  The lock of the bucket it is
+	 * found in is kept until the event has been sent.
 	 */
-	LOCK(&qid->lock);
-	for (resp = linear_first(qid);
-	     resp != NULL && resp->item_out;
-	     /* Empty. */)
-		resp = linear_next(qid, resp);
+	for (bucket = 0; bucket < qid->qid_nbuckets; bucket++) {
+		LOCK(QID_BUCKETLOCK(qid, bucket));
+		for (resp = ISC_LIST_HEAD(qid->qid_table[bucket]);
+		     resp != NULL && resp->item_out;
+		     resp = ISC_LIST_NEXT(resp, link))
+			/* empty */;
+		if (resp != NULL)
+			break;
+		UNLOCK(QID_BUCKETLOCK(qid, bucket));
+	}
 
 	/*
 	 * No one to send the cancel event to, so nothing to do.
 	 */
 	if (resp == NULL)
-		goto unlock;
+		return;
 
 	/*
 	 * Send the shutdown failsafe event to this resp.
@@ -3610,8 +3629,7 @@ do_cancel(dns_dispatch_t *disp) {
 		    ev, resp->task);
 	resp->item_out = ISC_TRUE;
 	isc_task_send(resp->task, ISC_EVENT_PTR(&ev));
- unlock:
-	UNLOCK(&qid->lock);
+	UNLOCK(QID_BUCKETLOCK(qid, bucket));
 }
 
 isc_socket_t *
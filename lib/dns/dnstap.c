@@ -48,10 +48,16 @@
 
 #include <stdlib.h>
 
+#include <isc/atomic.h>
 #include <isc/buffer.h>
+#include <isc/condition.h>
 #include <isc/file.h>
+#include <isc/list.h>
 #include <isc/mem.h>
+#include <isc/msgs.h>
+#include <isc/mutex.h>
 #include <isc/once.h>
+#include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/sockaddr.h>
 #include <isc/thread.h>
@@ -78,6 +84,34 @@
 #define DNSTAP_CONTENT_TYPE	"protobuf:dnstap.Dnstap"
 #define DNSTAP_INITIAL_BUF_SIZE 256
 
+/*%
+ * Each thread that logs messages gets a ring of DT_RING_SIZE captured
+ * messages (a power of two).  The encoder thread is woken early when a
+ * ring reaches DT_RING_WAKE entries, and otherwise looks at the rings
+ * every DT_ENCODER_INTERVAL milliseconds.
+ */
+#define DT_RING_SIZE		4096
+#define DT_RING_WAKE		(DT_RING_SIZE / 4)
+#define DT_ENCODER_INTERVAL	10
+
+/*%
+ * How often the encoder thread retries a full fstrm input queue before
+ * dropping the message.  Waiting here leaves later messages in the
+ * rings, which are much larger.
+ */
+#define DT_SUBMIT_RETRIES	100
+
+/*%
+ * The ring indices are read and written with atomic operations when
+ * they are available, so that neither the logging thread nor the
+ * encoder thread ever waits for the other.
+ */
+#if defined(ISC_PLATFORM_HAVEXADD) && defined(ISC_PLATFORM_HAVEATOMICSTORE)
+#define DT_RING_ATOMIC 1
+#else
+#define DT_RING_ATOMIC 0
+#endif
+
 struct dns_dtmsg {
 	void *buf;
 	size_t len;
@@ -85,6 +119,37 @@ struct dns_dtmsg {
 	Dnstap__Message m;
 };
 
+/*%
+ * A message captured by dns_dt_send(), waiting in a ring to be encoded.
+ * The zone and the DNS message follow the structure.
+ */
+typedef struct dt_entry {
+	dns_dtmsgtype_t msgtype;
+	isc_boolean_t tcp;
+	isc_sockaddr_t sa;
+	isc_time_t qtime;
+	isc_time_t rtime;
+	unsigned int zonelen;
+	unsigned int msglen;
+} dt_entry_t;
+
+/*%
+ * Single producer, single consumer ring.  'head' is only advanced by
+ * the owning thread and 'tail' only by the encoder thread; both run
+ * freely and are taken modulo DT_RING_SIZE.  The slots keep them on
+ * separate cache lines.
+ */
+typedef struct dt_ring dt_ring_t;
+struct dt_ring {
+	isc_int32_t head;
+	dt_entry_t *slots[DT_RING_SIZE];
+	isc_int32_t tail;
+#if !DT_RING_ATOMIC
+	isc_mutex_t lock;
+#endif
+	ISC_LINK(dt_ring_t) link;
+};
+
 struct dns_dthandle {
 	dns_dtmode_t mode;
 	struct fstrm_reader *reader;
@@ -97,8 +162,16 @@ struct dns_dtenv {
 
 	isc_mem_t *mctx;
 
+	/* Locked by lock. */
+	isc_mutex_t lock;
+	isc_condition_t cond;
+	isc_boolean_t exiting;
 	struct fstrm_iothr *iothr;
+	struct fstrm_iothr_queue *ioq;
 	struct fstrm_iothr_options *fopt;
+	ISC_LIST(dt_ring_t) rings;
+
+	isc_thread_t encoder;
 
 	isc_region_t identity;
 	isc_region_t version;
@@ -124,6 +197,12 @@ static isc_mem_t *dt_mctx = NULL;
  */
 static unsigned int generation;
 
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+dt_encoder(isc_threadarg_t arg);
+
 static void
 mutex_init(void) {
 	RUNTIME_CHECK(isc_mutex_init(&dt_mutex) == ISC_R_SUCCESS);
@@ -180,6 +259,7 @@ dns_dt_create(isc_mem_t *mctx, dns_dtmode_t mode, const char *path,
 	struct fstrm_writer_options *fwopt = NULL;
 	struct fstrm_writer *fw = NULL;
 	dns_dtenv_t *env = NULL;
+	isc_boolean_t haslock = ISC_FALSE, hascond = ISC_FALSE;
 
 	REQUIRE(path != NULL);
 	REQUIRE(envp != NULL && *envp == NULL);
@@ -198,6 +278,12 @@ dns_dt_create(isc_mem_t *mctx, dns_dtmode_t mode, const char *path,
 	memset(env, 0, sizeof(dns_dtenv_t));
 
 	CHECK(isc_refcount_init(&env->refcount, 1));
+	CHECK(isc_mutex_init(&env->lock));
+	haslock = ISC_TRUE;
+	if (isc_condition_init(&env->cond) != ISC_R_SUCCESS)
+		CHECK(ISC_R_UNEXPECTED);
+	hascond = ISC_TRUE;
+	ISC_LIST_INIT(env->rings);
 	CHECK(isc_stats_create(mctx, &env->stats, dns_dnstapcounter_max));
 	env->path = isc_mem_strdup(mctx, path);
 	if (env->path == NULL)
@@ -240,6 +326,17 @@ dns_dt_create(isc_mem_t *mctx, dns_dtmode_t mode, const char *path,
 		fstrm_writer_destroy(&fw);
 		CHECK(ISC_R_FAILURE);
 	}
+
+	if (isc_thread_create(dt_encoder, env, &env->encoder) !=
+	    ISC_R_SUCCESS)
+	{
+		UNEXPECTED_ERROR(__FILE__, __LINE__,
+				 "isc_thread_create() %s",
+				 isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
+						ISC_MSG_FAILED, "failed"));
+		fstrm_iothr_destroy(&env->iothr);
+		CHECK(ISC_R_UNEXPECTED);
+	}
 	env->mode = mode;
 	env->fopt = *foptp;
 	*foptp = NULL;
@@ -267,6 +364,10 @@ dns_dt_create(isc_mem_t *mctx, dns_dtmode_t mode, const char *path,
 				isc_mem_free(mctx, env->path);
 			if (env->stats != NULL)
 				isc_stats_detach(&env->stats);
+			if (hascond)
+				(void)isc_condition_destroy(&env->cond);
+			if (haslock)
+				DESTROYLOCK(&env->lock);
 			isc_mem_put(mctx, env, sizeof(dns_dtenv_t));
 		}
 	}
@@ -283,6 +384,7 @@ dns_dt_reopen(dns_dtenv_t *env, int roll) {
 	struct fstrm_file_options *ffwopt = NULL;
 	struct fstrm_writer_options *fwopt = NULL;
 	struct fstrm_writer *fw = NULL;
+	isc_boolean_t locked = ISC_FALSE;
 
 	REQUIRE(VALID_DTENV(env));
 
@@ -327,8 +429,16 @@ dns_dt_reopen(dns_dtenv_t *env, int roll) {
 		      (roll < 0) ? "reopening" : "rolling",
 		      env->path);
 
-	generation++;
+	/*
+	 * The encoder thread holds the lock while it submits messages
+	 * to the I/O thread; once we have it, the I/O thread and its
+	 * input queue can be replaced.  Messages captured meanwhile
+	 * wait in the rings.
+	 */
+	LOCK(&env->lock);
+	locked = ISC_TRUE;
 
+	env->ioq = NULL;
 	if (env->iothr != NULL)
 		fstrm_iothr_destroy(&env->iothr);
 
@@ -357,6 +467,9 @@ dns_dt_reopen(dns_dtenv_t *env, int roll) {
 	}
 
  cleanup:
+	if (locked)
+		UNLOCK(&env->lock);
+
 	if (ffwopt != NULL)
 		fstrm_file_options_destroy(&ffwopt);
 
@@ -399,61 +512,124 @@ toregion(dns_dtenv_t *env, isc_region_t *r, const char *str) {
 
 isc_result_t
 dns_dt_setidentity(dns_dtenv_t *env, const char *identity) {
+	isc_result_t result;
+
 	REQUIRE(VALID_DTENV(env));
 
-	return (toregion(env, &env->identity, identity));
+	LOCK(&env->lock);
+	result = toregion(env, &env->identity, identity);
+	UNLOCK(&env->lock);
+
+	return (result);
 }
 
 isc_result_t
 dns_dt_setversion(dns_dtenv_t *env, const char *version) {
+	isc_result_t result;
+
 	REQUIRE(VALID_DTENV(env));
 
-	return (toregion(env, &env->version, version));
+	LOCK(&env->lock);
+	result = toregion(env, &env->version, version);
+	UNLOCK(&env->lock);
+
+	return (result);
+}
+
+static inline isc_uint32_t
+ring_get(dt_ring_t *ring, isc_int32_t *p) {
+#if DT_RING_ATOMIC
+	UNUSED(ring);
+
+	return ((isc_uint32_t)isc_atomic_xadd(p, 0));
+#else
+	isc_uint32_t v;
+
+	LOCK(&ring->lock);
+	v = (isc_uint32_t)*p;
+	UNLOCK(&ring->lock);
+
+	return (v);
+#endif
 }
 
-static struct fstrm_iothr_queue *
-dt_queue(dns_dtenv_t *env) {
+static inline void
+ring_set(dt_ring_t *ring, isc_int32_t *p, isc_uint32_t v) {
+#if DT_RING_ATOMIC
+	UNUSED(ring);
+
+	isc_atomic_store(p, (isc_int32_t)v);
+#else
+	LOCK(&ring->lock);
+	*p = (isc_int32_t)v;
+	UNLOCK(&ring->lock);
+#endif
+}
+
+/*
+ * Return the calling thread's ring in 'env', creating it on the
+ * thread's first message.  Rings belong to the environment and are
+ * freed with it.
+ */
+static dt_ring_t *
+dt_ring(dns_dtenv_t *env) {
 	isc_result_t result;
-	struct ioq {
+	struct dtring {
 		unsigned int generation;
-		struct fstrm_iothr_queue *ioq;
-	} *ioq;
+		dt_ring_t *ring;
+	} *dr;
+	dt_ring_t *ring;
 
 	REQUIRE(VALID_DTENV(env));
 
-	if (env->iothr == NULL)
-		return (NULL);
-
 	result = dt_init();
 	if (result != ISC_R_SUCCESS)
 		return (NULL);
 
-	ioq = (struct ioq *)isc_thread_key_getspecific(dt_key);
-	if (ioq != NULL && ioq->generation != generation) {
+	dr = (struct dtring *)isc_thread_key_getspecific(dt_key);
+	if (dr != NULL && dr->generation != generation) {
 		result = isc_thread_key_setspecific(dt_key, NULL);
 		if (result != ISC_R_SUCCESS)
 			return (NULL);
-		free(ioq);
-		ioq = NULL;
+		free(dr);
+		dr = NULL;
 	}
-	if (ioq == NULL) {
-		ioq = malloc(sizeof(*ioq));
-		if (ioq == NULL)
-			return (NULL);
-		ioq->generation = generation;
-		ioq->ioq = fstrm_iothr_get_input_queue(env->iothr);
-		if (ioq->ioq == NULL) {
-			free(ioq);
-			return (NULL);
-		}
-		result = isc_thread_key_setspecific(dt_key, ioq);
-		if (result != ISC_R_SUCCESS) {
-			free(ioq);
-			return (NULL);
-		}
+	if (dr != NULL)
+		return (dr->ring);
+
+	dr = malloc(sizeof(*dr));
+	if (dr == NULL)
+		return (NULL);
+	ring = isc_mem_get(env->mctx, sizeof(*ring));
+	if (ring == NULL) {
+		free(dr);
+		return (NULL);
 	}
+	memset(ring, 0, sizeof(*ring));
+#if !DT_RING_ATOMIC
+	result = isc_mutex_init(&ring->lock);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(env->mctx, ring, sizeof(*ring));
+		free(dr);
+		return (NULL);
+	}
+#endif
+	ISC_LINK_INIT(ring, link);
+
+	LOCK(&env->lock);
+	ISC_LIST_APPEND(env->rings, ring, link);
+	UNLOCK(&env->lock);
 
-	return (ioq->ioq);
+	dr->generation = generation;
+	dr->ring = ring;
+	result = isc_thread_key_setspecific(dt_key, dr);
+	if (result != ISC_R_SUCCESS) {
+		/* The ring stays with 'env'; only this message is lost. */
+		free(dr);
+		return (NULL);
+	}
+
+	return (ring);
 }
 
 void
@@ -478,6 +654,8 @@ dns_dt_getstats(dns_dtenv_t *env, isc_stats_t **statsp) {
 
 static void
 destroy(dns_dtenv_t *env) {
+	dt_ring_t *ring;
+	isc_uint32_t i;
 
 	isc_log_write(dns_lctx, DNS_LOGCATEGORY_DNSTAP,
 		      DNS_LOGMODULE_DNSTAP, ISC_LOG_INFO,
@@ -486,6 +664,29 @@ destroy(dns_dtenv_t *env) {
 
 	generation++;
 
+	/*
+	 * The encoder thread empties the rings before it exits.
+	 */
+	LOCK(&env->lock);
+	env->exiting = ISC_TRUE;
+	SIGNAL(&env->cond);
+	UNLOCK(&env->lock);
+	if (isc_thread_join(env->encoder, NULL) != ISC_R_SUCCESS)
+		UNEXPECTED_ERROR(__FILE__, __LINE__,
+				 "isc_thread_join() %s",
+				 isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
+						ISC_MSG_FAILED, "failed"));
+
+	while ((ring = ISC_LIST_HEAD(env->rings)) != NULL) {
+		ISC_LIST_UNLINK(env->rings, ring, link);
+		for (i = ring->tail; i != (isc_uint32_t)ring->head; i++)
+			free(ring->slots[i % DT_RING_SIZE]);
+#if !DT_RING_ATOMIC
+		DESTROYLOCK(&ring->lock);
+#endif
+		isc_mem_put(env->mctx, ring, sizeof(*ring));
+	}
+
 	if (env->iothr != NULL)
 		fstrm_iothr_destroy(&env->iothr);
 	if (env->fopt != NULL)
@@ -503,6 +704,8 @@ destroy(dns_dtenv_t *env) {
 		isc_mem_free(env->mctx, env->path);
 	if (env->stats != NULL)
 		isc_stats_detach(&env->stats);
+	(void)isc_condition_destroy(&env->cond);
+	DESTROYLOCK(&env->lock);
 
 	isc_mem_putanddetach(&env->mctx, env, sizeof(*env));
 }
@@ -548,24 +751,37 @@ pack_dt(const Dnstap__Dnstap *d, void **buf, size_t *sz) {
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * Hand a packed message to the I/O thread.  Called by the encoder
+ * thread with env->lock held.
+ */
 static void
 send_dt(dns_dtenv_t *env, void *buf, size_t len) {
-	struct fstrm_iothr_queue *ioq;
 	fstrm_res res;
+	unsigned int i;
 
 	REQUIRE(env != NULL);
 
 	if (buf == NULL)
 		return;
 
-	ioq = dt_queue(env);
-	if (ioq == NULL) {
+	if (env->ioq == NULL && env->iothr != NULL)
+		env->ioq = fstrm_iothr_get_input_queue(env->iothr);
+	if (env->ioq == NULL) {
+		if (env->stats != NULL)
+			isc_stats_increment(env->stats,
+					    dns_dnstapcounter_drop);
 		free(buf);
 		return;
 	}
 
-	res = fstrm_iothr_submit(env->iothr, ioq, buf, len,
-				 fstrm_free_wrapper, NULL);
+	for (i = 0; ; i++) {
+		res = fstrm_iothr_submit(env->iothr, env->ioq, buf, len,
+					 fstrm_free_wrapper, NULL);
+		if (res != fstrm_res_again || i == DT_SUBMIT_RETRIES)
+			break;
+		isc_thread_yield();
+	}
 	if (res != fstrm_res_success) {
 		if (env->stats != NULL)
 			isc_stats_increment(env->stats,
@@ -632,13 +848,6 @@ dnstap_type(dns_dtmsgtype_t msgtype) {
 	}
 }
 
-static void
-cpbuf(isc_buffer_t *buf, ProtobufCBinaryData *p, protobuf_c_boolean *has) {
-	p->data = isc_buffer_base(buf);
-	p->len = isc_buffer_usedlength(buf);
-	*has = 1;
-}
-
 static void
 setaddr(dns_dtmsg_t *dm, isc_sockaddr_t *sa, isc_boolean_t tcp,
 	ProtobufCBinaryData *addr, protobuf_c_boolean *has_addr,
@@ -672,49 +881,40 @@ setaddr(dns_dtmsg_t *dm, isc_sockaddr_t *sa, isc_boolean_t tcp,
 	*has_port = 1;
 }
 
-void
-dns_dt_send(dns_view_t *view, dns_dtmsgtype_t msgtype,
-	    isc_sockaddr_t *sa, isc_boolean_t tcp, isc_region_t *zone,
-	    isc_time_t *qtime, isc_time_t *rtime, isc_buffer_t *buf)
-{
-	isc_time_t now, *t;
+/*
+ * Build and pack the dnstap message for a captured entry.  Called by
+ * the encoder thread with env->lock held.
+ */
+static void
+encode(dns_dtenv_t *env, dt_entry_t *e) {
 	dns_dtmsg_t dm;
+	unsigned char *zone, *msg;
 
-	REQUIRE(DNS_VIEW_VALID(view));
-
-	if ((msgtype & view->dttypes) == 0)
-		return;
-
-	if (view->dtenv == NULL)
-		return;
-
-	REQUIRE(VALID_DTENV(view->dtenv));
-
-	TIME_NOW(&now);
-	t = &now;
+	zone = (unsigned char *)(e + 1);
+	msg = zone + e->zonelen;
 
-	init_msg(view->dtenv, &dm, dnstap_type(msgtype));
+	init_msg(env, &dm, dnstap_type(e->msgtype));
 
 	/* Query/response times */
-	switch (msgtype) {
+	switch (e->msgtype) {
 	case DNS_DTTYPE_AR:
 	case DNS_DTTYPE_CR:
 	case DNS_DTTYPE_RR:
 	case DNS_DTTYPE_FR:
 	case DNS_DTTYPE_SR:
 	case DNS_DTTYPE_TR:
-		if (rtime != NULL)
-			t = rtime;
-
-		dm.m.response_time_sec = isc_time_seconds(t);
+		dm.m.response_time_sec = isc_time_seconds(&e->rtime);
 		dm.m.has_response_time_sec = 1;
-		dm.m.response_time_nsec = isc_time_nanoseconds(t);
+		dm.m.response_time_nsec = isc_time_nanoseconds(&e->rtime);
 		dm.m.has_response_time_nsec = 1;
 
-		cpbuf(buf, &dm.m.response_message, &dm.m.has_response_message);
+		dm.m.response_message.data = msg;
+		dm.m.response_message.len = e->msglen;
+		dm.m.has_response_message = 1;
 
 		/* Types RR and FR get both query and response times */
-		if (msgtype == DNS_DTTYPE_CR || msgtype == DNS_DTTYPE_AR)
+		if (e->msgtype == DNS_DTTYPE_CR ||
+		    e->msgtype == DNS_DTTYPE_AR)
 			break;
 
 		/* FALLTHROUGH */
@@ -724,33 +924,29 @@ dns_dt_send(dns_view_t *view, dns_dtmsgtype_t msgtype,
 	case DNS_DTTYPE_RQ:
 	case DNS_DTTYPE_SQ:
 	case DNS_DTTYPE_TQ:
-		if (qtime != NULL)
-			t = qtime;
-
-		dm.m.query_time_sec = isc_time_seconds(t);
+		dm.m.query_time_sec = isc_time_seconds(&e->qtime);
 		dm.m.has_query_time_sec = 1;
-		dm.m.query_time_nsec = isc_time_nanoseconds(t);
+		dm.m.query_time_nsec = isc_time_nanoseconds(&e->qtime);
 		dm.m.has_query_time_nsec = 1;
 
-		cpbuf(buf, &dm.m.query_message, &dm.m.has_query_message);
+		dm.m.query_message.data = msg;
+		dm.m.query_message.len = e->msglen;
+		dm.m.has_query_message = 1;
 		break;
 	default:
-		isc_log_write(dns_lctx, DNS_LOGCATEGORY_DNSTAP,
-			      DNS_LOGMODULE_DNSTAP, ISC_LOG_ERROR,
-			      "invalid dnstap message type %d", msgtype);
-		return;
+		INSIST(0);
 	}
 
 	/* Zone/bailiwick */
-	switch (msgtype) {
+	switch (e->msgtype) {
 	case DNS_DTTYPE_AR:
 	case DNS_DTTYPE_RQ:
 	case DNS_DTTYPE_RR:
 	case DNS_DTTYPE_FQ:
 	case DNS_DTTYPE_FR:
-		if (zone != NULL && zone->base != NULL && zone->length != 0) {
-			dm.m.query_zone.data = zone->base;
-			dm.m.query_zone.len = zone->length;
+		if (e->zonelen != 0) {
+			dm.m.query_zone.data = zone;
+			dm.m.query_zone.len = e->zonelen;
 			dm.m.has_query_zone = 1;
 		}
 		break;
@@ -758,23 +954,184 @@ dns_dt_send(dns_view_t *view, dns_dtmsgtype_t msgtype,
 		break;
 	}
 
-	switch (msgtype) {
+	switch (e->msgtype) {
 	case DNS_DTTYPE_RQ:
 	case DNS_DTTYPE_RR:
 	case DNS_DTTYPE_FQ:
 	case DNS_DTTYPE_FR:
-		setaddr(&dm, sa, tcp,
+		setaddr(&dm, &e->sa, e->tcp,
 			&dm.m.response_address, &dm.m.has_response_address,
 			&dm.m.response_port, &dm.m.has_response_port);
 		break;
 	default:
-		setaddr(&dm, sa, tcp,
+		setaddr(&dm, &e->sa, e->tcp,
 			&dm.m.query_address, &dm.m.has_query_address,
 			&dm.m.query_port, &dm.m.has_query_port);
 	}
 
 	if (pack_dt(&dm.d, &dm.buf, &dm.len) == ISC_R_SUCCESS)
-		send_dt(view->dtenv, dm.buf, dm.len);
+		send_dt(env, dm.buf, dm.len);
+}
+
+/*
+ * Encode everything waiting in the rings, returning the number of
+ * messages handled.  Called with env->lock held.
+ */
+static unsigned int
+drain(dns_dtenv_t *env) {
+	dt_ring_t *ring;
+	dt_entry_t *e;
+	isc_uint32_t head, tail;
+	unsigned int n = 0;
+
+	for (ring = ISC_LIST_HEAD(env->rings);
+	     ring != NULL;
+	     ring = ISC_LIST_NEXT(ring, link))
+	{
+		tail = (isc_uint32_t)ring->tail;
+		head = ring_get(ring, &ring->head);
+		if (head == tail)
+			continue;
+		while (tail != head) {
+			e = ring->slots[tail % DT_RING_SIZE];
+			encode(env, e);
+			free(e);
+			tail++;
+			n++;
+		}
+		ring_set(ring, &ring->tail, tail);
+	}
+
+	return (n);
+}
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+dt_encoder(isc_threadarg_t arg) {
+	dns_dtenv_t *env = arg;
+	isc_interval_t interval;
+	isc_time_t due;
+
+	isc_interval_set(&interval, 0, DT_ENCODER_INTERVAL * 1000000);
+
+	LOCK(&env->lock);
+	for (;;) {
+		if (drain(env) != 0) {
+			/* Let reopen and new rings in between passes. */
+			UNLOCK(&env->lock);
+			LOCK(&env->lock);
+			continue;
+		}
+		if (env->exiting)
+			break;
+		if (isc_time_nowplusinterval(&due, &interval) !=
+		    ISC_R_SUCCESS)
+			break;
+		(void)WAITUNTIL(&env->cond, &env->lock, &due);
+	}
+	UNLOCK(&env->lock);
+
+	return ((isc_threadresult_t)0);
+}
+
+void
+dns_dt_send(dns_view_t *view, dns_dtmsgtype_t msgtype,
+	    isc_sockaddr_t *sa, isc_boolean_t tcp, isc_region_t *zone,
+	    isc_time_t *qtime, isc_time_t *rtime, isc_buffer_t *buf)
+{
+	dns_dtenv_t *env;
+	dt_ring_t *ring;
+	dt_entry_t *e;
+	isc_time_t now;
+	isc_uint32_t head, used;
+	unsigned int zonelen = 0, msglen;
+
+	REQUIRE(DNS_VIEW_VALID(view));
+
+	if ((msgtype & view->dttypes) == 0)
+		return;
+
+	if (view->dtenv == NULL)
+		return;
+
+	env = view->dtenv;
+	REQUIRE(VALID_DTENV(env));
+
+	if ((msgtype & DNS_DTTYPE_ALL) == 0 ||
+	    (msgtype & (msgtype - 1)) != 0)
+	{
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_DNSTAP,
+			      DNS_LOGMODULE_DNSTAP, ISC_LOG_ERROR,
+			      "invalid dnstap message type %d", msgtype);
+		return;
+	}
+
+	ring = dt_ring(env);
+	if (ring == NULL) {
+		if (env->stats != NULL)
+			isc_stats_increment(env->stats,
+					    dns_dnstapcounter_drop);
+		return;
+	}
+
+	/*
+	 * Only this thread advances 'head'.  If the encoder thread has
+	 * fallen a full ring behind, the message is dropped rather than
+	 * waiting for it.
+	 */
+	head = (isc_uint32_t)ring->head;
+	used = head - ring_get(ring, &ring->tail);
+	if (used >= DT_RING_SIZE) {
+		if (env->stats != NULL)
+			isc_stats_increment(env->stats,
+					    dns_dnstapcounter_ringfull);
+		return;
+	}
+
+	if (zone != NULL && zone->base != NULL)
+		zonelen = zone->length;
+	msglen = isc_buffer_usedlength(buf);
+
+	e = malloc(sizeof(*e) + zonelen + msglen);
+	if (e == NULL) {
+		if (env->stats != NULL)
+			isc_stats_increment(env->stats,
+					    dns_dnstapcounter_drop);
+		return;
+	}
+
+	e->msgtype = msgtype;
+	e->tcp = tcp;
+	e->sa = *sa;
+	e->zonelen = zonelen;
+	e->msglen = msglen;
+
+	/*
+	 * Missing times are the current time; a response's query time
+	 * defaults to its response time.
+	 */
+	TIME_NOW(&now);
+	e->qtime = e->rtime = now;
+	if ((msgtype & DNS_DTTYPE_RESPONSE) != 0) {
+		if (rtime != NULL)
+			e->rtime = *rtime;
+		e->qtime = e->rtime;
+	}
+	if (qtime != NULL)
+		e->qtime = *qtime;
+
+	if (zonelen != 0)
+		memmove(e + 1, zone->base, zonelen);
+	memmove((unsigned char *)(e + 1) + zonelen,
+		isc_buffer_base(buf), msglen);
+
+	ring->slots[head % DT_RING_SIZE] = e;
+	ring_set(ring, &ring->head, head + 1);
+
+	if (used + 1 == DT_RING_WAKE)
+		SIGNAL(&env->cond);
 }
 
 void
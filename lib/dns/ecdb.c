@@ -103,7 +103,6 @@ static dns_rdatasetmethods_t rdataset_methods = {
 	NULL,			/* getclosest */
 	NULL,			/* getadditional */
 	NULL,			/* setadditional */
-	NULL,			/* putadditional */
 	rdataset_settrust,	/* settrust */
 	NULL,			/* expire */
 	NULL,			/* clearprefetch */
@@ -479,6 +479,60 @@ dns_adb_dump(dns_adb_t *adb, FILE *f);
  *\li	f != NULL, and is a file open for writing.
  */
 
+isc_result_t
+dns_adb_setstatefile(dns_adb_t *adb, const char *filename);
+/*%<
+ * Set the file in which the smoothed round trip time of each known
+ * server address is preserved across restarts.  If 'filename' is NULL
+ * the state is not preserved.  When the adb is shut down the state is
+ * written to the file automatically.
+ *
+ * Requires:
+ *
+ *\li	adb be valid.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+isc_result_t
+dns_adb_loadstate(dns_adb_t *adb);
+/*%<
+ * Seed the adb with the server addresses and round trip times stored in
+ * the state file, if one has been set.  Addresses which are already
+ * known keep their current values.  Entries created here expire like
+ * those created by dns_adb_findaddrinfo() unless they are used.
+ *
+ * Requires:
+ *
+ *\li	adb be valid.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_INVALIDFILE	the file is not an adb state file.
+ *\li	#ISC_R_SHUTTINGDOWN
+ *\li	Various file-related failures
+ */
+
+isc_result_t
+dns_adb_savestate(dns_adb_t *adb);
+/*%<
+ * Write the address and round trip time of every server known to the
+ * adb to the state file, if one has been set, replacing any previous
+ * contents.
+ *
+ * Requires:
+ *
+ *\li	adb be valid.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	Various file-related failures
+ */
+
 void
 dns_adb_dumpfind(dns_adbfind_t *find, FILE *f);
 /*%<
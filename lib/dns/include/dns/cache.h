@@ -184,6 +184,10 @@ dns_cache_load(dns_cache_t *cache);
  * Previous cache contents are not discarded.
  * If no file name has been set, do nothing and return success.
  *
+ * The file may be either a binary snapshot written by dns_cache_dump(),
+ * in which case TTLs are reduced by the time elapsed since the snapshot
+ * was taken and expired RRsets are skipped, or a text master file.
+ *
  * MT:
  *\li	Multiple simultaneous attempts to load or dump the cache
  * 	will be serialized with respect to one another, but
@@ -205,6 +209,10 @@ dns_cache_dump(dns_cache_t *cache);
  * overwriting any preexisting file.  If no file name has been set,
  * do nothing and return success.
  *
+ * The contents are written as a binary ("raw" format) snapshot which
+ * preserves the remaining TTL, trust level and negative cache entries
+ * of each RRset.
+ *
  * MT:
  *\li	Multiple simultaneous attempts to load or dump the cache
  * 	will be serialized with respect to one another, but
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef DNS_CRYPTOPOOL_H
+#define DNS_CRYPTOPOOL_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file dns/cryptopool.h
+ * \brief
+ * Defines dns_cryptopool_t, a pool of worker threads that perform
+ * DNSSEC signature verifications and signings on behalf of tasks.
+ *
+ * Notes:
+ *\li	Public key operations are expensive enough that running them in
+ *	the task that asked for them delays every other event queued for
+ *	that task.  A task hands a verification to the pool instead and
+ *	receives a #DNS_EVENT_CRYPTODONE event carrying the result once a
+ *	worker has performed it.
+ *
+ *\li	A zone signer that has to produce many signatures in one event
+ *	submits them to a #dns_cryptobatch_t, so that they are computed
+ *	in parallel, and asks to be sent an event once the whole batch
+ *	has been performed.
+ *
+ *\li	Workers take queued jobs in batches to amortize the cost of the
+ *	queue lock when the pool is busy.
+ *
+ *\li	The pool is only available in threaded builds; elsewhere
+ *	dns_cryptopool_create() fails and callers verify inline.
+ *
+ * MP:
+ *\li	The pool is internally locked.  Each job takes its own copy of
+ *	the name, a clone of the rdataset, a reference to the key and,
+ *	for verifications, a copy of the RRSIG, so the submitter's are
+ *	not touched by the workers.
+ *
+ * Resources:
+ *\li	One thread per worker.
+ */
+
+/***
+ ***	Imports
+ ***/
+
+#include <isc/event.h>
+#include <isc/lang.h>
+#include <isc/stdtime.h>
+#include <isc/time.h>
+
+#include <dns/fixedname.h>
+#include <dns/rdata.h>
+#include <dns/rdataset.h>
+#include <dns/types.h>
+
+#include <dst/dst.h>
+
+ISC_LANG_BEGINDECLS
+
+/*%
+ * Upper bounds, in milliseconds, of the latency classes used to build
+ * the offloaded verification latency histogram.
+ */
+#define DNS_CRYPTOPOOL_LATCLASS0	1
+#define DNS_CRYPTOPOOL_LATCLASS0STR	"1"
+#define DNS_CRYPTOPOOL_LATCLASS1	10
+#define DNS_CRYPTOPOOL_LATCLASS1STR	"10"
+#define DNS_CRYPTOPOOL_LATCLASS2	100
+#define DNS_CRYPTOPOOL_LATCLASS2STR	"100"
+#define DNS_CRYPTOPOOL_LATCLASS3	500
+#define DNS_CRYPTOPOOL_LATCLASS3STR	"500"
+
+typedef enum {
+	dns_cryptoop_verify,
+	dns_cryptoop_sign
+} dns_cryptoop_t;
+
+struct dns_cryptoevent {
+	ISC_EVENT_COMMON(struct dns_cryptoevent);
+	/* Copied from the submitter's arguments. */
+	dns_cryptoop_t			op;
+	dns_fixedname_t			name;
+	dns_rdataset_t			rdataset;
+	dst_key_t *			key;
+	dns_rdata_t			sigrdata;	/*%< signed: result */
+	unsigned int			maxbits;
+	isc_boolean_t			acceptexpired;
+	isc_stdtime_t			inception;
+	isc_stdtime_t			expire;
+	/* Set by the pool. */
+	isc_result_t			result;
+	isc_boolean_t			ignoretime;
+	dns_fixedname_t			wild;
+	isc_time_t			queued;
+	isc_uint64_t			latency;	/*%< usecs, total */
+	isc_uint64_t			cost;		/*%< usecs, crypto */
+	isc_task_t *			task;
+	dns_cryptobatch_t *		batch;
+	unsigned char *			sigbuf;
+	unsigned int			sigbuflen;
+};
+
+/***
+ ***	Functions
+ ***/
+
+isc_result_t
+dns_cryptopool_create(isc_mem_t *mctx, unsigned int nworkers,
+		      dns_cryptopool_t **poolp);
+/*%<
+ * Create a pool of 'nworkers' verification threads.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	nworkers > 0
+ *\li	poolp != NULL && *poolp == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_NOTIMPLEMENTED	not a threaded build.
+ *\li	#ISC_R_UNEXPECTED
+ */
+
+void
+dns_cryptopool_attach(dns_cryptopool_t *source, dns_cryptopool_t **targetp);
+/*%<
+ * Attach '*targetp' to 'source'.
+ */
+
+void
+dns_cryptopool_detach(dns_cryptopool_t **poolp);
+/*%<
+ * Detach '*poolp' from its pool.  When the last reference goes away
+ * the workers are stopped, jobs still queued complete with
+ * #ISC_R_CANCELED and the pool is freed.
+ */
+
+isc_result_t
+dns_cryptopool_verify(dns_cryptopool_t *pool, dns_name_t *name,
+		      dns_rdataset_t *rdataset, dst_key_t *key,
+		      dns_rdata_t *sigrdata, unsigned int maxbits,
+		      isc_boolean_t acceptexpired, isc_task_t *task,
+		      isc_taskaction_t action, void *arg);
+/*%<
+ * Queue the verification of 'sigrdata' over 'name'/'rdataset' with
+ * 'key', as dns_dnssec_verify3() would perform it.  If 'acceptexpired'
+ * is true and the signature is outside of its validity period, the
+ * verification is repeated ignoring the validity period and
+ * 'ignoretime' is set in the completion event.
+ *
+ * When the verification is complete a dns_cryptoevent_t of type
+ * #DNS_EVENT_CRYPTODONE is sent to 'task' with 'action' and 'arg'.
+ * Its 'result' is the verification result, its 'wild' holds the
+ * wildcard name if the result is #DNS_R_FROMWILDCARD, 'latency' is the
+ * time from submission to completion and 'cost' the time spent in the
+ * verification itself.  The receiver must free it with
+ * isc_event_free().
+ *
+ * Requires:
+ *\li	'pool' is a valid pool.
+ *\li	'sigrdata' is an RRSIG.
+ *\li	'task' is a valid task.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_SHUTTINGDOWN
+ */
+
+isc_result_t
+dns_cryptobatch_create(dns_cryptopool_t *pool, dns_cryptobatch_t **batchp);
+/*%<
+ * Create a batch of jobs to be performed by 'pool'.
+ *
+ * Requires:
+ *\li	'pool' is a valid pool.
+ *\li	batchp != NULL && *batchp == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_UNEXPECTED
+ */
+
+isc_result_t
+dns_cryptobatch_sign(dns_cryptobatch_t *batch, dns_name_t *name,
+		     dns_rdataset_t *rdataset, dst_key_t *key,
+		     isc_stdtime_t inception, isc_stdtime_t expire);
+/*%<
+ * Queue the signing of 'name'/'rdataset' with 'key', as
+ * dns_dnssec_sign() would perform it, as part of 'batch'.
+ *
+ * Requires:
+ *\li	'batch' is a valid batch.
+ *\li	'rdataset' is associated and 'key' is a private key.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_SHUTTINGDOWN
+ */
+
+void
+dns_cryptobatch_wait(dns_cryptobatch_t *batch, isc_eventlist_t *results);
+/*%<
+ * Wait until every job queued to 'batch' has been performed and move
+ * their completion events to 'results', in the order in which they
+ * completed.  In each, 'result' is the dns_dnssec_sign() result and,
+ * if it is #ISC_R_SUCCESS, 'sigrdata' the RRSIG; 'name' and 'rdataset'
+ * are the job's copies.  The caller must free them with
+ * isc_event_free().
+ *
+ * The batch may be reused afterwards.
+ */
+
+void
+dns_cryptobatch_notify(dns_cryptobatch_t *batch, isc_task_t *task,
+		       isc_event_t **eventp);
+/*%<
+ * Send '*eventp' to 'task' once every job queued to 'batch' has been
+ * performed, or at once if there are none, so that the results can be
+ * collected with dns_cryptobatch_wait() without blocking.  '*eventp'
+ * is set to NULL.
+ *
+ * No more jobs may be queued to 'batch', and it must not be destroyed,
+ * until the event has been received.
+ *
+ * Requires:
+ *\li	'batch' is a valid batch.
+ *\li	'task' is a valid task.
+ *\li	eventp != NULL && *eventp != NULL
+ */
+
+void
+dns_cryptobatch_destroy(dns_cryptobatch_t **batchp);
+/*%<
+ * Wait for the jobs still queued to '*batchp', discard their results
+ * and free the batch.
+ */
+
+unsigned int
+dns_cryptopool_depth(dns_cryptopool_t *pool);
+/*%<
+ * Return the number of jobs waiting for a worker.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_CRYPTOPOOL_H */
@@ -126,10 +126,10 @@ dns_dt_create(isc_mem_t *mctx, dns_dtmode_t mode, const char *path,
  *	socket.
  *
  *\li	'*foptp' set the options for fstrm_iothr_init(). '*foptp' must have
- *	have had the number of input queues set and this should be set
- *	to the number of worker threads.  Additionally the queue model
- *	should also be set.  Other options may be set if desired.
- *	If dns_dt_create succeeds the *foptp is set to NULL.
+ *	have had the number of input queues set.  Messages are encoded
+ *	and submitted by a single thread belonging to the environment,
+ *	so one input queue is enough.  Other options may be set if
+ *	desired.  If dns_dt_create succeeds the *foptp is set to NULL.
  *
  * Requires:
  *
@@ -248,6 +248,11 @@ dns_dt_send(dns_view_t *view, dns_dtmsgtype_t msgtype,
  * NULL, they are set to the current time); and 'buf' (the DNS message
  * being logged, in wire format).
  *
+ * The message is copied to a ring belonging to the calling thread and
+ * encoded later by the environment's encoder thread, so the caller may
+ * reuse 'zone' and 'buf' on return.  If the ring is full the message is
+ * dropped and counted as 'dns_dnstapcounter_ringfull'.
+ *
  * Requires:
  *
  *\li	'view' is a valid view, and 'view->dtenv' is NULL or is a
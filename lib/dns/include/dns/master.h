@@ -67,6 +67,15 @@ ISC_LANG_BEGINDECLS
 #define DNS_MASTERRAW_COMPAT 		0x01
 #define DNS_MASTERRAW_SOURCESERIALSET	0x02
 #define DNS_MASTERRAW_LASTXFRINSET	0x04
+#define DNS_MASTERRAW_CACHE		0x08	/* cache snapshot; each RRset
+						 * carries trust and flags */
+
+/*
+ * Per-RRset flags stored in a cache snapshot (DNS_MASTERRAW_CACHE)
+ */
+#define DNS_MASTERRAW_RDATASET_NEGATIVE	0x0001
+#define DNS_MASTERRAW_RDATASET_NXDOMAIN	0x0002
+#define DNS_MASTERRAW_RDATASET_OPTOUT	0x0004
 
 /* Common header */
 struct dns_masterrawheader {
@@ -77,7 +86,8 @@ struct dns_masterrawheader {
 	isc_uint32_t		version;	/* compatibility for future
 						 * extensions */
 	isc_uint32_t		dumptime;	/* timestamp on creation
-						 * (currently unused) */
+						 * (used to age TTLs in
+						 * cache snapshots) */
 	isc_uint32_t		flags;		/* Flags */
 	isc_uint32_t		sourceserial;	/* Source serial number (used
 						 * by inline-signing zones) */
@@ -95,6 +105,8 @@ typedef struct {
 	dns_rdatatype_t		covers;		/* same as type */
 	dns_ttl_t		ttl;		/* 32-bit TTL */
 	isc_uint32_t		nrdata;		/* number of RRs in this set */
+	isc_uint16_t		trust;		/* DNS_MASTERRAW_CACHE only */
+	isc_uint16_t		flags;		/* DNS_MASTERRAW_CACHE only */
 	/* followed by encoded owner name, and then rdata */
 } dns_masterrawrdataset_t;
 
@@ -97,12 +97,13 @@
 #define DNS_OPT_CLIENT_SUBNET	8		/*%< client subnet opt code */
 #define DNS_OPT_EXPIRE		9		/*%< EXPIRE opt code */
 #define DNS_OPT_COOKIE		10		/*%< COOKIE opt code */
+#define DNS_OPT_TCP_KEEPALIVE	11		/*%< TCP keepalive opt code */
 #define DNS_OPT_PAD		12		/*%< PAD opt code */
 
 /*%< Experimental options [65001...65534] as per RFC6891 */
 
 /*%< The number of EDNS options we know about. */
-#define DNS_EDNSOPTIONS	5
+#define DNS_EDNSOPTIONS	6
 
 #define DNS_MESSAGE_REPLYPRESERVE	(DNS_MESSAGEFLAG_RD|DNS_MESSAGEFLAG_CD)
 #define DNS_MESSAGEEXTFLAG_REPLYPRESERVE (DNS_MESSAGEEXTFLAG_DO)
@@ -179,6 +180,7 @@ typedef int dns_messagetextflag_t;
 #endif
 
 typedef struct dns_msgblock dns_msgblock_t;
+typedef struct dns_msgfast dns_msgfast_t;
 
 struct dns_message {
 	/* public from here down */
@@ -252,6 +254,8 @@ struct dns_message {
 
 	dns_rdatasetorderfunc_t		order;
 	const void *			order_arg;
+
+	dns_msgfast_t		       *fast;	/* query fast path storage */
 };
 
 struct dns_ednsopt {
@@ -440,6 +444,14 @@ dns_message_parse(dns_message_t *msg, isc_buffer_t *source,
  * OPT and TSIG records are always handled specially, regardless of the
  * 'preserve_order' setting.
  *
+ * A query with a single question and at most an OPT record in the
+ * additional section, which is what nearly all queries look like, is
+ * decoded into storage that the message keeps from one use to the next
+ * instead of into names and rdatasets drawn from the message's pools.
+ * The result is indistinguishable from that of the full parser, which
+ * is used for everything else, including any query the fast path
+ * cannot decode completely.
+ *
  * Requires:
  *\li	"msg" be valid.
  *
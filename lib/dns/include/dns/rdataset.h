@@ -78,28 +78,15 @@ typedef struct dns_rdatasetmethods {
 					      dns_rdataset_t *negsig);
 	isc_result_t		(*getadditional)(dns_rdataset_t *rdataset,
 						 dns_rdatasetadditional_t type,
-						 dns_rdatatype_t qtype,
-						 dns_acache_t *acache,
-						 dns_zone_t **zonep,
-						 dns_db_t **dbp,
-						 dns_dbversion_t **versionp,
-						 dns_dbnode_t **nodep,
+						 dns_db_t *db,
+						 dns_dbversion_t *version,
 						 dns_name_t *fname,
-						 dns_message_t *msg,
-						 isc_stdtime_t now);
+						 dns_message_t *msg);
 	isc_result_t		(*setadditional)(dns_rdataset_t *rdataset,
 						 dns_rdatasetadditional_t type,
-						 dns_rdatatype_t qtype,
-						 dns_acache_t *acache,
-						 dns_zone_t *zone,
 						 dns_db_t *db,
 						 dns_dbversion_t *version,
-						 dns_dbnode_t *node,
 						 dns_name_t *fname);
-	isc_result_t		(*putadditional)(dns_acache_t *acache,
-						 dns_rdataset_t *rdataset,
-						 dns_rdatasetadditional_t type,
-						 dns_rdatatype_t qtype);
 	void			(*settrust)(dns_rdataset_t *rdataset,
 					    dns_trust_t trust);
 	void			(*expire)(dns_rdataset_t *rdataset);
@@ -545,93 +532,64 @@ dns_rdataset_addclosest(dns_rdataset_t *rdataset, dns_name_t *name);
 isc_result_t
 dns_rdataset_getadditional(dns_rdataset_t *rdataset,
 			   dns_rdatasetadditional_t type,
-			   dns_rdatatype_t qtype,
-			   dns_acache_t *acache,
-			   dns_zone_t **zonep,
-			   dns_db_t **dbp,
-			   dns_dbversion_t **versionp,
-			   dns_dbnode_t **nodep,
+			   dns_db_t *db,
+			   dns_dbversion_t *version,
 			   dns_name_t *fname,
-			   dns_message_t *msg,
-			   isc_stdtime_t now);
+			   dns_message_t *msg);
 /*%<
- * Get cached additional information from the DB node for a particular
- * 'rdataset.'  'type' is one of dns_rdatasetadditional_fromauth,
- * dns_rdatasetadditional_fromcache, and dns_rdatasetadditional_fromglue,
- * which specifies the origin of the information.  'qtype' is intended to
- * be used for specifying a particular rdata type in the cached information.
+ * Get the additional data cached for the current rdata of 'rdataset'
+ * (the one dns_rdataset_additionaldata() is processing) in 'version'
+ * of 'db'.  'type' is one of dns_rdatasetadditional_fromauth and
+ * dns_rdatasetadditional_fromglue, which specifies where the data was
+ * found; data found in a cache is never cached.
+ *
+ * The cache is kept by the database 'rdataset' belongs to, separately
+ * for each version, so it is only available when 'rdataset' was found
+ * in 'version' of 'db' and the additional data also comes from there.
+ * A new version starts with an empty cache.
+ *
+ * On success the owner name of the additional data is copied to
+ * 'fname', and an rdataset for each cached address RRset and its
+ * signature, allocated from 'msg', is appended to fname->list.
  *
  * Requires:
  * \li	'rdataset' is a valid rdataset.
- * \li	'acache' can be NULL, in which case this function will simply return
- * 	ISC_R_FAILURE.
- * \li	For the other pointers, see dns_acache_getentry().
- *
- * Ensures:
- * \li	See dns_acache_getentry().
+ * \li	'db' and 'version' are valid.
+ * \li	'fname' is a valid name with a dedicated buffer.
+ * \li	'msg' is a valid message.
  *
  * Returns:
  * \li	#ISC_R_SUCCESS
- * \li	#ISC_R_FAILURE	- additional information caching is not supported.
- * \li	#ISC_R_NOTFOUND	- the corresponding DB node has not cached additional
- *			  information for 'rdataset.'
- * \li	Any error that dns_acache_getentry() can return.
+ * \li	#DNS_R_NXRRSET	- it is cached that there is no additional data.
+ * \li	#ISC_R_NOTFOUND	- nothing has been cached for the current rdata.
+ * \li	#ISC_R_NOTIMPLEMENTED - caching is not supported for 'rdataset'
+ *			  or 'db'.
+ * \li	#ISC_R_NOMEMORY
  */
 
 isc_result_t
 dns_rdataset_setadditional(dns_rdataset_t *rdataset,
 			   dns_rdatasetadditional_t type,
-			   dns_rdatatype_t qtype,
-			   dns_acache_t *acache,
-			   dns_zone_t *zone,
 			   dns_db_t *db,
 			   dns_dbversion_t *version,
-			   dns_dbnode_t *node,
 			   dns_name_t *fname);
 /*%<
- * Set cached additional information to the DB node for a particular
- * 'rdataset.'  See dns_rdataset_getadditional for the semantics of 'type'
- * and 'qtype'.
+ * Cache the additional data found for the current rdata of 'rdataset'
+ * in 'version' of 'db'.  'fname' is the owner name of the data, with the
+ * address rdatasets and their signatures on its list, all found in
+ * 'version' of 'db'; the list may be empty.  If 'fname' is NULL, it is
+ * cached that there is no additional data.  See
+ * dns_rdataset_getadditional() for the semantics of the other arguments.
  *
  * Requires:
  * \li	'rdataset' is a valid rdataset.
- * \li	'acache' can be NULL, in which case this function will simply return
- *	ISC_R_FAILURE.
- * \li	For the other pointers, see dns_acache_setentry().
- *
- * Ensures:
- * \li	See dns_acache_setentry().
+ * \li	'db' and 'version' are valid.
  *
  * Returns:
  * \li	#ISC_R_SUCCESS
- * \li	#ISC_R_FAILURE	- additional information caching is not supported.
+ * \li	#ISC_R_NOTIMPLEMENTED - caching is not supported for 'rdataset',
+ *			  'db' or the rdatasets on fname->list.
  * \li	#ISC_R_NOMEMORY
- * \li	Any error that dns_acache_setentry() can return.
- */
-
-isc_result_t
-dns_rdataset_putadditional(dns_acache_t *acache,
-			   dns_rdataset_t *rdataset,
-			   dns_rdatasetadditional_t type,
-			   dns_rdatatype_t qtype);
-/*%<
- * Discard cached additional information stored in the DB node for a particular
- * 'rdataset.'  See dns_rdataset_getadditional for the semantics of 'type'
- * and 'qtype'.
- *
- * Requires:
- * \li	'rdataset' is a valid rdataset.
- * \li	'acache' can be NULL, in which case this function will simply return
- *	ISC_R_FAILURE.
- *
- * Ensures:
- * \li	See dns_acache_cancelentry().
- *
- * Returns:
- * \li	#ISC_R_SUCCESS
- * \li	#ISC_R_FAILURE	- additional information caching is not supported.
- * \li	#ISC_R_NOTFOUND	- the corresponding DB node has not cached additional
- *			  information for 'rdataset.'
  */
 
 void
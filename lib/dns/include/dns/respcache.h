@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef DNS_RESPCACHE_H
+#define DNS_RESPCACHE_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file dns/respcache.h
+ * \brief
+ * Defines dns_respcache_t, a cache of rendered authoritative responses.
+ *
+ * Notes:
+ *\li	A response cache holds complete responses in wire format, as they
+ *	were rendered for a previous query, so that an identical query
+ *	can be answered by copying the message and patching its ID instead
+ *	of looking up, assembling and compressing the answer again.
+ *
+ *\li	The caller defines what makes two queries identical by building
+ *	the lookup key; it must cover every property of the query and of
+ *	the client that the rendered response depends on.
+ *
+ *\li	Each entry records the database it was built from, without
+ *	holding a reference to it, and the SOA serial of the zone version
+ *	it was built from.  A lookup that presents a different database
+ *	or serial discards the entry.  The owner of a database must call
+ *	dns_respcache_flushdb() before it lets go of the database, so
+ *	that a later database allocated at the same address can't be
+ *	mistaken for it.
+ *
+ *\li	The cache is split into independently locked shards, each of
+ *	which holds a bounded number of entries and evicts the least
+ *	recently used one when full.
+ *
+ * Resources:
+ *\li	At most 'size' entries, each holding a key and a response of at
+ *	most #DNS_RESPCACHE_MAXKEY and #DNS_RESPCACHE_MAXWIRE octets.
+ */
+
+/***
+ ***	Imports
+ ***/
+
+#include <isc/buffer.h>
+#include <isc/lang.h>
+#include <isc/region.h>
+
+#include <dns/name.h>
+#include <dns/types.h>
+
+ISC_LANG_BEGINDECLS
+
+/*%
+ * Largest key and response that will be cached.
+ */
+#define DNS_RESPCACHE_MAXKEY	(DNS_NAME_MAXWIRE + 16)
+#define DNS_RESPCACHE_MAXWIRE	4096
+
+/***
+ ***	Functions
+ ***/
+
+isc_result_t
+dns_respcache_create(isc_mem_t *mctx, unsigned int size,
+		     dns_respcache_t **rcp);
+/*%<
+ * Allocate and initialize a response cache holding at most 'size'
+ * entries and store it in '*rcp'.
+ *
+ * Requires:
+ *\li	mctx != NULL
+ *\li	size > 0
+ *\li	rcp != NULL && *rcp == NULL
+ */
+
+void
+dns_respcache_destroy(dns_respcache_t **rcp);
+/*%<
+ * Flush and then free the cache in 'rcp'. '*rcp' is set to NULL on
+ * return.
+ *
+ * Requires:
+ *\li	'*rcp' to be a valid response cache.
+ */
+
+isc_result_t
+dns_respcache_find(dns_respcache_t *rc, isc_region_t *key, dns_db_t *db,
+		   isc_uint32_t serial, isc_buffer_t *target,
+		   unsigned int *infop);
+/*%<
+ * Look for the response cached under 'key' and, if it was built from
+ * 'db' at 'serial', copy it to 'target' and set '*infop' to the value
+ * it was added with.  An entry for 'key' that was built from another
+ * database or serial is removed.
+ *
+ * Requires:
+ *\li	'rc' to be a valid response cache.
+ *\li	'db' to be a valid database.
+ *\li	'target' to be a valid buffer.
+ *\li	infop != NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOTFOUND
+ *\li	#ISC_R_NOSPACE		'target' is too small for the response.
+ */
+
+void
+dns_respcache_add(dns_respcache_t *rc, isc_region_t *key, dns_db_t *db,
+		  isc_uint32_t serial, unsigned int info, isc_region_t *wire);
+/*%<
+ * Cache the rendered response 'wire' under 'key', recording that it
+ * was built from 'db' at 'serial'; 'db' is not attached.  'info'
+ * is an opaque value returned on every hit.  Keys or responses larger
+ * than #DNS_RESPCACHE_MAXKEY or #DNS_RESPCACHE_MAXWIRE are silently
+ * not cached.
+ *
+ * Requires:
+ *\li	'rc' to be a valid response cache.
+ *\li	'db' to be a valid database.
+ */
+
+void
+dns_respcache_flush(dns_respcache_t *rc);
+/*%<
+ * Flush the entire cache.
+ *
+ * Requires:
+ *\li	'rc' to be a valid response cache.
+ */
+
+void
+dns_respcache_flushdb(dns_respcache_t *rc, dns_db_t *db);
+/*%<
+ * Flush every response that was built from 'db'.  A response added
+ * afterwards by a query that still holds 'db' is discarded by the
+ * next lookup under its key, which presents the new database.
+ *
+ * Requires:
+ *\li	'rc' to be a valid response cache.
+ *\li	'db' to be a valid database.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_RESPCACHE_H */
@@ -13,6 +13,7 @@
 #define DNS_RPZ_H 1
 
 #include <isc/lang.h>
+#include <isc/list.h>
 #include <isc/refcount.h>
 #include <isc/rwlock.h>
 
@@ -173,6 +174,23 @@ struct dns_rpz_popt {
 	dns_rpz_num_t	    num_zones;
 };
 
+/*
+ * Incremental changes are applied to the summary databases in batches.
+ * A batch of DNS_RPZ_MAX_CHANGES or more is instead applied to a
+ * private copy of the summary databases that then replaces the live
+ * ones.
+ */
+#define DNS_RPZ_MAX_CHANGES	1024
+
+/*
+ * Initial size of the cache of name servers whose addresses matched no
+ * NSIP trigger, and the longest time an entry is kept, in seconds.
+ */
+#define DNS_RPZ_NSIPCACHE_SIZE	61
+#define DNS_RPZ_NSIPCACHE_TTL	300
+
+typedef struct dns_rpz_change dns_rpz_change_t;
+
 /*
  * Response policy zones known to a view.
  */
@@ -227,6 +245,23 @@ struct dns_rpz_zones {
 
 	dns_rpz_cidr_node_t	*cidr;
 	dns_rbt_t		*rbt;
+
+	/*
+	 * Additions and deletions not yet visible to searches,
+	 * protected by maint_lock.
+	 */
+	ISC_LIST(dns_rpz_change_t) changes;
+	unsigned int		nchanges;
+
+	/*
+	 * The generation of the summary data increases whenever changes
+	 * become visible to searches and is protected by search_lock.
+	 * nsipcache remembers name servers whose A or AAAA addresses
+	 * matched no NSIP trigger, and in which generation, so that
+	 * their addresses need not be looked up again for every query.
+	 */
+	isc_uint32_t		generation;
+	dns_badcache_t		*nsipcache;
 };
 
 
@@ -295,6 +330,7 @@ typedef struct {
 	dns_rpz_have_t		have;
 	dns_rpz_popt_t		popt;
 	int			rpz_ver;
+	isc_uint32_t		generation;
 
 	/*
 	 * p_name: current policy owner name
@@ -358,6 +394,23 @@ dns_rpz_add(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_name_t *name);
 void
 dns_rpz_delete(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_name_t *name);
 
+isc_result_t
+dns_rpz_commit(dns_rpz_zones_t *rpzs);
+/*
+ * Make the additions and deletions since the last commit visible to
+ * dns_rpz_find_ip() and dns_rpz_find_name().  Small batches are applied
+ * to the live summary databases under one write lock.  Larger batches
+ * are applied to a copy of the databases, which is then swapped in;
+ * searches are blocked only for the swap.  Since this copies the
+ * summary databases, it should not be called with database locks held.
+ *
+ * Every change is applied even if some fail.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	the first error adding a change
+ */
+
 dns_rpz_num_t
 dns_rpz_find_ip(dns_rpz_zones_t *rpzs, dns_rpz_type_t rpz_type,
 		dns_rpz_zbits_t zbits, const isc_netaddr_t *netaddr,
@@ -367,6 +420,15 @@ dns_rpz_zbits_t
 dns_rpz_find_name(dns_rpz_zones_t *rpzs, dns_rpz_type_t rpz_type,
 		  dns_rpz_zbits_t zbits, dns_name_t *trig_name);
 
+isc_boolean_t
+dns_rpz_find_cleanns(dns_rpz_zones_t *rpzs, dns_name_t *nsname,
+		     dns_rdatatype_t type, isc_uint32_t generation);
+
+void
+dns_rpz_add_cleanns(dns_rpz_zones_t *rpzs, dns_name_t *nsname,
+		    dns_rdatatype_t type, isc_uint32_t generation,
+		    dns_ttl_t ttl);
+
 ISC_LANG_ENDDECLS
 
 #endif /* DNS_RPZ_H */
@@ -192,33 +192,34 @@ struct dns_rrl_rate {
 };
 
 /*
- * Per-view query rate limit parameters and a pointer to database.
+ * The database is split into shards by client address block, so that
+ * all of the entries for a client, including its TCP and all-per-second
+ * entries, are in the same shard and a response takes only that
+ * shard's lock.  Each shard has its own share of the entries, its own
+ * hash table, LRU list, timestamp bases and log state.
  */
-typedef struct dns_rrl dns_rrl_t;
-struct dns_rrl {
-	isc_mutex_t	lock;
-	isc_mem_t	*mctx;
+#define DNS_RRL_SHARDS	16
 
-	isc_boolean_t	log_only;
-	dns_rrl_rate_t	responses_per_second;
-	dns_rrl_rate_t	referrals_per_second;
-	dns_rrl_rate_t	nodata_per_second;
-	dns_rrl_rate_t	nxdomains_per_second;
-	dns_rrl_rate_t	errors_per_second;
-	dns_rrl_rate_t	all_per_second;
-	dns_rrl_rate_t	slip;
-	int		window;
-	double		qps_scale;
-	int		max_entries;
-
-	dns_acl_t	*exempt;
+typedef struct dns_rrl_shard dns_rrl_shard_t;
+struct dns_rrl_shard {
+	isc_mutex_t	lock;
 
 	int		num_entries;
 
+	/*
+	 * Responses counted since this shard last added its count to
+	 * the view wide total, and the estimate it got back then.
+	 */
 	int		qps_responses;
 	isc_stdtime_t	qps_time;
 	double		qps;
 
+	/*
+	 * Rates scaled by that estimate, or 0 if never scaled.
+	 */
+	int		scaled[DNS_RRL_RTYPE_TCP];
+	int		slip_scaled;
+
 	unsigned int	probes;
 	unsigned int	searches;
 
@@ -233,11 +234,7 @@ struct dns_rrl {
 # define DNS_RRL_TS_BASES   (1<<DNS_RRL_TS_GEN_BITS)
 	isc_stdtime_t	ts_bases[DNS_RRL_TS_BASES];
 
-	int		ipv4_prefixlen;
-	isc_uint32_t	ipv4_mask;
-	int		ipv6_prefixlen;
-	isc_uint32_t	ipv6_mask[4];
-
+	isc_stdtime_t	sweep_time;
 	isc_stdtime_t	log_stops_time;
 	dns_rrl_entry_t	*last_logged;
 	int		num_logged;
@@ -247,6 +244,40 @@ struct dns_rrl {
 	dns_rrl_qname_buf_t *qnames[DNS_RRL_QNAMES];
 };
 
+/*
+ * Per-view query rate limit parameters and a pointer to database.
+ */
+typedef struct dns_rrl dns_rrl_t;
+struct dns_rrl {
+	isc_mutex_t	lock;		/* protects the qps estimate */
+	isc_mem_t	*mctx;
+
+	isc_boolean_t	log_only;
+	dns_rrl_rate_t	responses_per_second;
+	dns_rrl_rate_t	referrals_per_second;
+	dns_rrl_rate_t	nodata_per_second;
+	dns_rrl_rate_t	nxdomains_per_second;
+	dns_rrl_rate_t	errors_per_second;
+	dns_rrl_rate_t	all_per_second;
+	dns_rrl_rate_t	slip;
+	int		window;
+	double		qps_scale;
+	int		max_entries;
+
+	dns_acl_t	*exempt;
+
+	int		qps_responses;
+	isc_stdtime_t	qps_time;
+	double		qps;
+
+	int		ipv4_prefixlen;
+	isc_uint32_t	ipv4_mask;
+	int		ipv6_prefixlen;
+	isc_uint32_t	ipv6_mask[4];
+
+	dns_rrl_shard_t	shards[DNS_RRL_SHARDS];
+};
+
 typedef enum {
 	DNS_RRL_RESULT_OK,
 	DNS_RRL_RESULT_DROP,
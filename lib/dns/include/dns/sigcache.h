@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef DNS_SIGCACHE_H
+#define DNS_SIGCACHE_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file dns/sigcache.h
+ * \brief
+ * Defines dns_sigcache_t, the signature verification cache.
+ *
+ * Notes:
+ *\li	A signature verification cache remembers RRSIG verifications
+ *	that succeeded, so that the validator does not have to repeat
+ *	the public key operation when the same RRset, signature and
+ *	DNSKEY are seen again (e.g., by another fetch shortly after).
+ *
+ *\li	Entries are keyed by a SHA-256 digest of the exact owner name,
+ *	RRset contents, RRSIG rdata and DNSKEY, so any change in the
+ *	data results in a miss.  The signature validity period is
+ *	checked again on every hit.
+ *
+ *\li	The cache is split into independently locked shards, each of
+ *	which holds a bounded number of entries and evicts the least
+ *	recently used one when full.
+ *
+ * Reliability:
+ *
+ * Resources:
+ *\li	At most 'size' entries of a few dozen bytes each.
+ *
+ * Security:
+ *\li	Only successful verifications are cached, and only under a
+ *	collision resistant digest of all of their inputs.
+ *
+ * Standards:
+ */
+
+/***
+ ***	Imports
+ ***/
+
+#include <isc/sha2.h>
+#include <isc/stdtime.h>
+
+#include <dns/types.h>
+
+#include <dst/dst.h>
+
+ISC_LANG_BEGINDECLS
+
+#define DNS_SIGCACHE_DIGESTLENGTH	ISC_SHA256_DIGESTLENGTH
+
+/***
+ ***	Functions
+ ***/
+
+isc_result_t
+dns_sigcache_create(isc_mem_t *mctx, unsigned int size,
+		    dns_sigcache_t **scp);
+/*%
+ * Allocate and initialize a signature verification cache holding at
+ * most 'size' entries and store it in '*scp'.
+ *
+ * Requires:
+ * \li	mctx != NULL
+ * \li	size > 0
+ * \li	scp != NULL && *scp == NULL
+ */
+
+void
+dns_sigcache_destroy(dns_sigcache_t **scp);
+/*%
+ * Flush and then free the cache in 'scp'. '*scp' is set to NULL on
+ * return.
+ *
+ * Requires:
+ * \li	'*scp' to be a valid sigcache
+ */
+
+isc_result_t
+dns_sigcache_digest(dns_name_t *name, dns_rdataset_t *rdataset,
+		    dst_key_t *key, unsigned int maxbits,
+		    dns_rdata_t *sigrdata,
+		    unsigned char digest[DNS_SIGCACHE_DIGESTLENGTH]);
+/*%
+ * Compute the key under which the verification of 'sigrdata' over
+ * 'name'/'rdataset' with 'key' (subject to 'maxbits') is cached.
+ *
+ * Requires:
+ * \li	'rdataset' to be a valid, associated rdataset.
+ * \li	'sigrdata' to be an RRSIG.
+ *
+ * Returns:
+ * \li	#ISC_R_SUCCESS
+ * \li	#ISC_R_NOSPACE	the key could not be converted.
+ */
+
+isc_boolean_t
+dns_sigcache_find(dns_sigcache_t *sc,
+		  const unsigned char digest[DNS_SIGCACHE_DIGESTLENGTH],
+		  isc_stdtime_t now, isc_uint32_t *costp);
+/*%
+ * Returns ISC_TRUE if a verification with digest 'digest' succeeded
+ * before and its signature is still temporally valid at 'now'.  If
+ * 'costp' is not NULL, '*costp' is set to the time in microseconds
+ * the original verification took.
+ *
+ * Requires:
+ * \li	'sc' to be a valid sigcache.
+ */
+
+void
+dns_sigcache_add(dns_sigcache_t *sc,
+		 const unsigned char digest[DNS_SIGCACHE_DIGESTLENGTH],
+		 isc_uint32_t timesigned, isc_uint32_t timeexpire,
+		 isc_uint32_t cost);
+/*%
+ * Record that the verification with digest 'digest' succeeded.  The
+ * entry is only valid between 'timesigned' and 'timeexpire', the
+ * validity period of the RRSIG.  'cost' is the time in microseconds
+ * the verification took.
+ *
+ * Requires:
+ * \li	'sc' to be a valid sigcache.
+ */
+
+void
+dns_sigcache_flush(dns_sigcache_t *sc);
+/*%
+ * Flush the entire cache.
+ *
+ * Requires:
+ * \li	'sc' to be a valid sigcache.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_SIGCACHE_H */
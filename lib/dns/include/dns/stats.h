@@ -66,7 +66,17 @@ enum {
 	dns_resstatscounter_zonequota = 41,
 	dns_resstatscounter_serverquota = 42,
 	dns_resstatscounter_nextitem = 43,
-	dns_resstatscounter_max = 44,
+	dns_resstatscounter_sigcachehit = 44,
+	dns_resstatscounter_sigcachemiss = 45,
+	dns_resstatscounter_sigcachesaved = 46,
+	dns_resstatscounter_cryptoqueue = 47,
+	dns_resstatscounter_cryptooffload = 48,
+	dns_resstatscounter_cryptolat0 = 49,
+	dns_resstatscounter_cryptolat1 = 50,
+	dns_resstatscounter_cryptolat2 = 51,
+	dns_resstatscounter_cryptolat3 = 52,
+	dns_resstatscounter_cryptolat4 = 53,
+	dns_resstatscounter_max = 54,
 
 	/*
 	 * DNSSEC stats.
@@ -104,8 +114,14 @@ enum {
 	dns_adbstats_entriescnt = 1,
 	dns_adbstats_nnames = 2,
 	dns_adbstats_namescnt = 3,
+	dns_adbstats_nentrylocks = 4,
+	dns_adbstats_nnamelocks = 5,
+	dns_adbstats_entriesload = 6,
+	dns_adbstats_namesload = 7,
+	dns_adbstats_entriesgrow = 8,
+	dns_adbstats_namesgrow = 9,
 
-	dns_adbstats_max = 4,
+	dns_adbstats_max = 10,
 
 	/*
 	 * Cache statistics values.
@@ -136,7 +152,8 @@ enum {
 	 */
 	dns_dnstapcounter_success = 0,
 	dns_dnstapcounter_drop =  1,
-	dns_dnstapcounter_max = 2
+	dns_dnstapcounter_ringfull = 2,
+	dns_dnstapcounter_max = 3
 };
 
 #define DNS_STATS_NCOUNTERS 8
@@ -54,6 +54,7 @@
 #include <dns/types.h>
 #include <dns/rdataset.h>
 #include <dns/rdatastruct.h> /* for dns_rdata_rrsig_t */
+#include <dns/sigcache.h>
 
 #include <dst/dst.h>
 
@@ -157,6 +158,9 @@ struct dns_validator {
 	unsigned int			authcount;
 	unsigned int			authfail;
 	isc_stdtime_t			start;
+	dns_cryptoevent_t *		cryptoevent;
+	isc_boolean_t			cachesig;
+	unsigned char			sigdigest[DNS_SIGCACHE_DIGESTLENGTH];
 };
 
 /*%
@@ -83,7 +83,6 @@ struct dns_view {
 	dns_resolver_t *		resolver;
 	dns_adb_t *			adb;
 	dns_requestmgr_t *		requestmgr;
-	dns_acache_t *			acache;
 	dns_cache_t *			cache;
 	dns_db_t *			cachedb;
 	dns_db_t *			hints;
@@ -176,6 +175,9 @@ struct dns_view {
 	dns_dlzdblist_t 		dlz_unsearched;
 	isc_uint32_t			fail_ttl;
 	dns_badcache_t			*failcache;
+	dns_sigcache_t			*sigcache;
+	dns_respcache_t			*respcache;
+	dns_cryptopool_t		*cryptopool;
 
 	/*
 	 * Configurable data for server use only,
@@ -1037,6 +1039,18 @@ dns_view_setresstats(dns_view_t *view, isc_stats_t *stats);
  *	(see dns/stats.h).
  */
 
+void
+dns_view_setcryptopool(dns_view_t *view, dns_cryptopool_t *pool);
+/*%<
+ * Set the worker pool to which the validators of 'view' hand their
+ * signature verifications.  Without one they verify inline.
+ *
+ * Requires:
+ * \li	'view' is valid and is not frozen.
+ *
+ *\li	'pool' is a valid crypto pool.
+ */
+
 void
 dns_view_getresstats(dns_view_t *view, isc_stats_t **statsp);
 /*%<
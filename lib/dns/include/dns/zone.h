@@ -1765,6 +1765,18 @@ dns_zonemgr_setiolimit(dns_zonemgr_t *zmgr, isc_uint32_t iolimit);
  *\li	'iolimit' to be positive.
  */
 
+void
+dns_zonemgr_setcryptopool(dns_zonemgr_t *zmgr, dns_cryptopool_t *pool);
+/*%<
+ *	Set the worker pool that computes the signatures needed when
+ *	zones are signed with a new key.  Without one they are computed
+ *	inline in the zone's task.
+ *
+ * Requires:
+ *\li	'zmgr' to be a valid zone manager.
+ *\li	'pool' to be a valid crypto pool.
+ */
+
 isc_uint32_t
 dns_zonemgr_getiolimit(dns_zonemgr_t *zmgr);
 /*%<
@@ -1929,6 +1941,9 @@ dns_zone_setrequeststats(dns_zone_t *zone, isc_stats_t *stats);
 
 void
 dns_zone_setrcvquerystats(dns_zone_t *zone, dns_stats_t *stats);
+
+void
+dns_zone_setxfrintimes(dns_zone_t *zone, isc_histo_t *histo);
 /*%<
  * Set additional statistics sets to zone.  These are attached to the zone
  * but are not counted in the zone module; only the caller updates the
@@ -1938,6 +1953,9 @@ dns_zone_setrcvquerystats(dns_zone_t *zone, dns_stats_t *stats);
  * \li	'zone' to be a valid zone.
  *
  *\li	stats is a valid statistics.
+ *
+ *\li	histo is a valid histogram; the durations of successful incoming
+ *	transfers are counted in it in milliseconds.
  */
 
 isc_stats_t *
@@ -1945,6 +1963,9 @@ dns_zone_getrequeststats(dns_zone_t *zone);
 
 dns_stats_t *
 dns_zone_getrcvquerystats(dns_zone_t *zone);
+
+isc_histo_t *
+dns_zone_getxfrintimes(dns_zone_t *zone);
 /*%<
  * Get the additional statistics for zone, if one is installed.
  *
@@ -2024,19 +2045,6 @@ dns_zone_checknames(dns_zone_t *zone, dns_name_t *name, dns_rdata_t *rdata);
  *	DNS_R_BADNAME		failed rdata checks.
  */
 
-void
-dns_zone_setacache(dns_zone_t *zone, dns_acache_t *acache);
-/*%<
- *	Associate the zone with an additional cache.
- *
- * Require:
- *	'zone' to be a valid zone.
- *	'acache' to be a non NULL pointer.
- *
- * Ensures:
- *	'zone' will have a reference to 'acache'
- */
-
 void
 dns_zone_setcheckmx(dns_zone_t *zone, dns_checkmxfunc_t checkmx);
 /*%<
@@ -82,7 +82,7 @@ dns_keytable_create(isc_mem_t *mctx, dns_keytable_t **keytablep) {
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_rbt;
 
-	result = isc_rwlock_init(&keytable->rwlock, 0, 0);
+	result = isc_rwlock_initdistributed(&keytable->rwlock, mctx);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_lock;
 
@@ -130,6 +130,9 @@ struct dns_loadctx {
 	FILE			*f;
 	isc_boolean_t		first;
 	dns_masterrawheader_t	header;
+	dns_trust_t		trust;		/*%< of the RRset being
+						 * committed */
+	unsigned int		attributes;	/*%< ditto */
 
 	/* Which fixed buffers we are using? */
 	unsigned int		loop_cnt;		/*% records per quantum,
@@ -623,6 +626,8 @@ loadctx_create(dns_masterformat_t format, isc_mem_t *mctx,
 
 	lctx->f = NULL;
 	lctx->first = ISC_TRUE;
+	lctx->trust = dns_trust_ultimate;
+	lctx->attributes = 0;
 	dns_master_initrawheader(&lctx->header);
 
 	lctx->loop_cnt = (done != NULL) ? 100 : 0;
@@ -2281,6 +2286,8 @@ load_raw(dns_loadctx_t *lctx) {
 	isc_buffer_t target, buf;
 	unsigned char *target_mem = NULL;
 	dns_decompress_t dctx;
+	isc_boolean_t cache;
+	isc_uint32_t ttl_offset = 0;
 
 	callbacks = lctx->callbacks;
 	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_NONE);
@@ -2291,6 +2298,11 @@ load_raw(dns_loadctx_t *lctx) {
 			return (result);
 	}
 
+	cache = ISC_TF((lctx->header.flags & DNS_MASTERRAW_CACHE) != 0);
+	if (cache && lctx->header.dumptime != 0 &&
+	    lctx->now > lctx->header.dumptime)
+		ttl_offset = lctx->now - lctx->header.dumptime;
+
 	ISC_LIST_INIT(head);
 	ISC_LIST_INIT(dummy);
 
@@ -2324,6 +2336,7 @@ load_raw(dns_loadctx_t *lctx) {
 		isc_uint32_t totallen;
 		size_t minlen, readlen;
 		isc_boolean_t sequential_read = ISC_FALSE;
+		isc_boolean_t expired = ISC_FALSE;
 
 		/* Read the data length */
 		isc_buffer_clear(&target);
@@ -2348,6 +2361,8 @@ load_raw(dns_loadctx_t *lctx) {
 		minlen = sizeof(totallen) + sizeof(isc_uint16_t) +
 			sizeof(isc_uint16_t) + sizeof(isc_uint16_t) +
 			sizeof(isc_uint32_t) + sizeof(isc_uint32_t);
+		if (cache)
+			minlen += sizeof(isc_uint16_t) + sizeof(isc_uint16_t);
 		if (totallen < minlen) {
 			result = ISC_R_RANGE;
 			goto cleanup;
@@ -2399,6 +2414,29 @@ load_raw(dns_loadctx_t *lctx) {
 			result = ISC_R_RANGE;
 			goto cleanup;
 		}
+		if (cache) {
+			isc_uint16_t flags;
+
+			lctx->trust = isc_buffer_getuint16(&target);
+			flags = isc_buffer_getuint16(&target);
+			lctx->attributes = 0;
+			if ((flags & DNS_MASTERRAW_RDATASET_NEGATIVE) != 0)
+				lctx->attributes |= DNS_RDATASETATTR_NEGATIVE;
+			if ((flags & DNS_MASTERRAW_RDATASET_NXDOMAIN) != 0)
+				lctx->attributes |= DNS_RDATASETATTR_NXDOMAIN;
+			if ((flags & DNS_MASTERRAW_RDATASET_OPTOUT) != 0)
+				lctx->attributes |= DNS_RDATASETATTR_OPTOUT;
+
+			/*
+			 * The TTL is what remained when the snapshot was
+			 * taken; age it by the time since then and drop
+			 * RRsets that have expired in the meantime.
+			 */
+			if (rdatalist.ttl <= ttl_offset)
+				expired = ISC_TRUE;
+			else
+				rdatalist.ttl -= ttl_offset;
+		}
 		INSIST(isc_buffer_consumedlength(&target) <= readlen);
 
 		/* Owner name: length followed by name */
@@ -2462,9 +2500,12 @@ load_raw(dns_loadctx_t *lctx) {
 				INSIST(i > 0); /* detect an infinite loop */
 
 				/* Partial Commit. */
-				ISC_LIST_APPEND(head, &rdatalist, link);
-				result = commit(callbacks, lctx, &head, name,
-						NULL, 0);
+				if (!expired) {
+					ISC_LIST_APPEND(head, &rdatalist,
+							link);
+					result = commit(callbacks, lctx, &head,
+							name, NULL, 0);
+				}
 				for (j = 0; j < i; j++) {
 					ISC_LIST_UNLINK(rdatalist.rdata,
 							&rdata[j], link);
@@ -2495,6 +2536,22 @@ load_raw(dns_loadctx_t *lctx) {
 			if (result != ISC_R_SUCCESS)
 				goto cleanup;
 			isc_buffer_setactive(&target, (unsigned int)rdlen);
+			if (cache && rdatalist.type == 0) {
+				isc_region_t r;
+
+				/*
+				 * Negative cache entries hold the internal
+				 * ncache encoding, which has no wire form.
+				 */
+				isc_buffer_activeregion(&target, &r);
+				dns_rdata_fromregion(&rdata[i],
+						     rdatalist.rdclass,
+						     rdatalist.type, &r);
+				isc_buffer_forward(&target, rdlen);
+				ISC_LIST_APPEND(rdatalist.rdata, &rdata[i],
+						link);
+				continue;
+			}
 			/*
 			 * It is safe to have the source active region and
 			 * the target available region be the same if
@@ -2522,10 +2579,11 @@ load_raw(dns_loadctx_t *lctx) {
 			goto cleanup;
 		}
 
-		ISC_LIST_APPEND(head, &rdatalist, link);
-
 		/* Commit this RRset.  rdatalist will be unlinked. */
-		result = commit(callbacks, lctx, &head, name, NULL, 0);
+		if (!expired) {
+			ISC_LIST_APPEND(head, &rdatalist, link);
+			result = commit(callbacks, lctx, &head, name, NULL, 0);
+		}
 
 		for (i = 0; i < rdcount; i++) {
 			ISC_LIST_UNLINK(rdatalist.rdata, &rdata[i], link);
@@ -3089,7 +3147,8 @@ commit(dns_rdatacallbacks_t *callbacks, dns_loadctx_t *lctx,
 		dns_rdataset_init(&dataset);
 		RUNTIME_CHECK(dns_rdatalist_tordataset(this, &dataset)
 			      == ISC_R_SUCCESS);
-		dataset.trust = dns_trust_ultimate;
+		dataset.trust = lctx->trust;
+		dataset.attributes |= lctx->attributes;
 		/*
 		 * If this is a secure dynamic zone set the re-signing time.
 		 */
@@ -1037,11 +1037,11 @@ dump_rdatasets_text(isc_mem_t *mctx, dns_name_t *name,
  */
 static isc_result_t
 dump_rdataset_raw(isc_mem_t *mctx, dns_name_t *name, dns_rdataset_t *rdataset,
-		  isc_buffer_t *buffer, FILE *f)
+		  isc_boolean_t cache, isc_buffer_t *buffer, FILE *f)
 {
 	isc_result_t result;
 	isc_uint32_t totallen;
-	isc_uint16_t dlen;
+	isc_uint16_t dlen, flags;
 	isc_region_t r, r_hdr;
 
 	REQUIRE(buffer->length > 0);
@@ -1068,6 +1068,22 @@ dump_rdataset_raw(isc_mem_t *mctx, dns_name_t *name, dns_rdataset_t *rdataset,
 	isc_buffer_putuint16(buffer, rdataset->covers);	/* same as type */
 	isc_buffer_putuint32(buffer, rdataset->ttl); /* 32-bit TTL */
 	isc_buffer_putuint32(buffer, dns_rdataset_count(rdataset));
+	if (cache) {
+		/*
+		 * Cache snapshots also record the trust level and the
+		 * negative cache attributes so that the data can be
+		 * reloaded with the same semantics.
+		 */
+		flags = 0;
+		if ((rdataset->attributes & DNS_RDATASETATTR_NEGATIVE) != 0)
+			flags |= DNS_MASTERRAW_RDATASET_NEGATIVE;
+		if (NXDOMAIN(rdataset))
+			flags |= DNS_MASTERRAW_RDATASET_NXDOMAIN;
+		if ((rdataset->attributes & DNS_RDATASETATTR_OPTOUT) != 0)
+			flags |= DNS_MASTERRAW_RDATASET_OPTOUT;
+		isc_buffer_putuint16(buffer, rdataset->trust);
+		isc_buffer_putuint16(buffer, flags);
+	}
 	totallen = isc_buffer_usedlength(buffer);
 	INSIST(totallen <= sizeof(dns_masterrawrdataset_t));
 
@@ -1143,9 +1159,9 @@ dump_rdataset_raw(isc_mem_t *mctx, dns_name_t *name, dns_rdataset_t *rdataset,
 }
 
 static isc_result_t
-dump_rdatasets_raw(isc_mem_t *mctx, dns_name_t *name,
-		   dns_rdatasetiter_t *rdsiter, dns_totext_ctx_t *ctx,
-		   isc_buffer_t *buffer, FILE *f)
+dump_rdatasets_rawcommon(isc_mem_t *mctx, dns_name_t *name,
+			 dns_rdatasetiter_t *rdsiter, dns_totext_ctx_t *ctx,
+			 isc_boolean_t cache, isc_buffer_t *buffer, FILE *f)
 {
 	isc_result_t result;
 	dns_rdataset_t rdataset;
@@ -1158,11 +1174,11 @@ dump_rdatasets_raw(isc_mem_t *mctx, dns_name_t *name,
 		dns_rdatasetiter_current(rdsiter, &rdataset);
 
 		if (((rdataset.attributes & DNS_RDATASETATTR_NEGATIVE) != 0) &&
-		    (ctx->style.flags & DNS_STYLEFLAG_NCACHE) == 0) {
+		    !cache && (ctx->style.flags & DNS_STYLEFLAG_NCACHE) == 0) {
 			/* Omit negative cache entries */
 		} else {
 			result = dump_rdataset_raw(mctx, name, &rdataset,
-						   buffer, f);
+						   cache, buffer, f);
 		}
 		dns_rdataset_disassociate(&rdataset);
 		if (result != ISC_R_SUCCESS)
@@ -1175,6 +1191,28 @@ dump_rdatasets_raw(isc_mem_t *mctx, dns_name_t *name,
 	return (result);
 }
 
+static isc_result_t
+dump_rdatasets_raw(isc_mem_t *mctx, dns_name_t *name,
+		   dns_rdatasetiter_t *rdsiter, dns_totext_ctx_t *ctx,
+		   isc_buffer_t *buffer, FILE *f)
+{
+	return (dump_rdatasets_rawcommon(mctx, name, rdsiter, ctx, ISC_FALSE,
+					 buffer, f));
+}
+
+/*
+ * Dump a cache snapshot: like "raw", but each RRset also carries its
+ * trust level and negative cache attributes.
+ */
+static isc_result_t
+dump_rdatasets_rawcache(isc_mem_t *mctx, dns_name_t *name,
+			dns_rdatasetiter_t *rdsiter, dns_totext_ctx_t *ctx,
+			isc_buffer_t *buffer, FILE *f)
+{
+	return (dump_rdatasets_rawcommon(mctx, name, rdsiter, ctx, ISC_TRUE,
+					 buffer, f));
+}
+
 static isc_result_t
 dump_rdatasets_map(isc_mem_t *mctx, dns_name_t *name,
 		   dns_rdatasetiter_t *rdsiter, dns_totext_ctx_t *ctx,
@@ -1430,7 +1468,11 @@ dumpctx_create(isc_mem_t *mctx, dns_db_t *db, dns_dbversion_t *version,
 		dctx->dumpsets = dump_rdatasets_text;
 		break;
 	case dns_masterformat_raw:
-		dctx->dumpsets = dump_rdatasets_raw;
+		if (dns_db_iscache(db)) {
+			dctx->dumpsets = dump_rdatasets_rawcache;
+			dctx->header.flags |= DNS_MASTERRAW_CACHE;
+		} else
+			dctx->dumpsets = dump_rdatasets_raw;
 		break;
 	case dns_masterformat_map:
 		dctx->dumpsets = dump_rdatasets_map;
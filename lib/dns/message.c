@@ -148,6 +148,36 @@ struct dns_msgblock {
 	ISC_LINK(dns_msgblock_t)	link;
 }; /* dynamically sized */
 
+/*%
+ * Largest OPT rdata the query fast path will decode.  Queries with
+ * more options than this, such as heavily padded ones, take the full
+ * parser.
+ */
+#define FAST_OPTSIZE		512
+
+/*%
+ * Storage for the question and the OPT record of a query decoded by
+ * the fast path in dns_message_parse().  It is allocated the first time
+ * a message needs it and reused after every reset.
+ */
+struct dns_msgfast {
+	dns_name_t			qname;
+	dns_offsets_t			qoffsets;
+	unsigned char			qdata[DNS_NAME_MAXWIRE];
+	dns_rdatalist_t			qrdatalist;
+	dns_rdataset_t			qrdataset;
+	dns_rdata_t			optrdata;
+	dns_rdatalist_t			optrdatalist;
+	dns_rdataset_t			optrdataset;
+	unsigned char			optdata[FAST_OPTSIZE];
+};
+
+#define FAST_NAME(m, n) \
+	((m)->fast != NULL && (n) == &(m)->fast->qname)
+#define FAST_RDATASET(m, r) \
+	((m)->fast != NULL && \
+	 ((r) == &(m)->fast->qrdataset || (r) == &(m)->fast->optrdataset))
+
 static inline dns_msgblock_t *
 msgblock_allocate(isc_mem_t *, unsigned int, unsigned int);
 
@@ -444,12 +474,14 @@ msgresetnames(dns_message_t *msg, unsigned int first_section) {
 
 				INSIST(dns_rdataset_isassociated(rds));
 				dns_rdataset_disassociate(rds);
-				isc_mempool_put(msg->rdspool, rds);
+				if (!FAST_RDATASET(msg, rds))
+					isc_mempool_put(msg->rdspool, rds);
 				rds = next_rds;
 			}
 			if (dns_name_dynamic(name))
 				dns_name_free(name, msg->mctx);
-			isc_mempool_put(msg->namepool, name);
+			if (!FAST_NAME(msg, name))
+				isc_mempool_put(msg->namepool, name);
 			name = next_name;
 		}
 	}
@@ -465,7 +497,8 @@ msgresetopt(dns_message_t *msg)
 		}
 		INSIST(dns_rdataset_isassociated(msg->opt));
 		dns_rdataset_disassociate(msg->opt);
-		isc_mempool_put(msg->rdspool, msg->opt);
+		if (!FAST_RDATASET(msg, msg->opt))
+			isc_mempool_put(msg->rdspool, msg->opt);
 		msg->opt = NULL;
 		msg->cc_ok = 0;
 		msg->cc_bad = 0;
@@ -725,6 +758,7 @@ dns_message_create(isc_mem_t *mctx, unsigned int intent, dns_message_t **msgp)
 	ISC_LIST_INIT(m->cleanup);
 	m->namepool = NULL;
 	m->rdspool = NULL;
+	m->fast = NULL;
 	ISC_LIST_INIT(m->rdatas);
 	ISC_LIST_INIT(m->rdatalists);
 	ISC_LIST_INIT(m->offsets);
@@ -801,6 +835,8 @@ dns_message_destroy(dns_message_t **msgp) {
 	msgreset(msg, ISC_TRUE);
 	isc_mempool_destroy(&msg->namepool);
 	isc_mempool_destroy(&msg->rdspool);
+	if (msg->fast != NULL)
+		isc_mem_put(msg->mctx, msg->fast, sizeof(*msg->fast));
 	msg->magic = 0;
 	isc_mem_putanddetach(&msg->mctx, msg, sizeof(dns_message_t));
 }
@@ -1576,6 +1612,134 @@ getsection(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx,
 	return (result);
 }
 
+/*
+ * Decode a query with one question and nothing but an optional OPT
+ * record after it into the message's fast path storage.  Nothing is
+ * added to the message unless the whole query decodes; otherwise
+ * 'source' is left where it was and ISC_R_NOTFOUND is returned, and
+ * the caller falls back to the full parser, which will reach the same
+ * verdict on any error.
+ */
+static isc_result_t
+getquery(isc_buffer_t *source, dns_message_t *msg, dns_decompress_t *dctx) {
+	dns_msgfast_t *fast;
+	isc_buffer_t start = *source;
+	isc_buffer_t target;
+	isc_region_t r;
+	dns_rdatatype_t rdtype;
+	dns_rdataclass_t rdclass, udpsize;
+	dns_ttl_t ttl;
+	unsigned int rdatalen;
+	isc_boolean_t haveopt = ISC_FALSE;
+
+	if (msg->opcode != dns_opcode_query ||
+	    (msg->flags & DNS_MESSAGEFLAG_QR) != 0 ||
+	    msg->counts[DNS_SECTION_QUESTION] != 1 ||
+	    msg->counts[DNS_SECTION_ANSWER] != 0 ||
+	    msg->counts[DNS_SECTION_AUTHORITY] != 0 ||
+	    msg->counts[DNS_SECTION_ADDITIONAL] > 1)
+		return (ISC_R_NOTFOUND);
+
+	fast = msg->fast;
+	if (fast == NULL) {
+		fast = isc_mem_get(msg->mctx, sizeof(*fast));
+		if (fast == NULL)
+			return (ISC_R_NOTFOUND);
+		msg->fast = fast;
+	} else if (msg->opt == &fast->optrdataset ||
+		   ISC_LINK_LINKED(&fast->qname, link))
+		return (ISC_R_NOTFOUND);
+
+	/*
+	 * The question.
+	 */
+	dns_name_init(&fast->qname, fast->qoffsets);
+	isc_buffer_init(&target, fast->qdata, sizeof(fast->qdata));
+	isc_buffer_remainingregion(source, &r);
+	isc_buffer_setactive(source, r.length);
+	if (dns_name_fromwire(&fast->qname, source, dctx, ISC_FALSE,
+			      &target) != ISC_R_SUCCESS)
+		goto fallback;
+
+	isc_buffer_remainingregion(source, &r);
+	if (r.length < 4)
+		goto fallback;
+	rdtype = isc_buffer_getuint16(source);
+	rdclass = isc_buffer_getuint16(source);
+	if (rdtype == dns_rdatatype_tkey)
+		goto fallback;
+
+	/*
+	 * The OPT record, whose owner must be the root.
+	 */
+	if (msg->counts[DNS_SECTION_ADDITIONAL] == 1) {
+		isc_buffer_remainingregion(source, &r);
+		if (r.length < 1 + 2 + 2 + 4 + 2 || r.base[0] != 0)
+			goto fallback;
+		isc_buffer_forward(source, 1);
+		if (isc_buffer_getuint16(source) != dns_rdatatype_opt)
+			goto fallback;
+		udpsize = isc_buffer_getuint16(source);
+		ttl = isc_buffer_getuint32(source);
+		rdatalen = isc_buffer_getuint16(source);
+		if (rdatalen > FAST_OPTSIZE ||
+		    isc_buffer_remaininglength(source) < rdatalen)
+			goto fallback;
+
+		dns_rdata_init(&fast->optrdata);
+		isc_buffer_init(&target, fast->optdata,
+				sizeof(fast->optdata));
+		isc_buffer_setactive(source, rdatalen);
+		if (dns_rdata_fromwire(&fast->optrdata, udpsize,
+				       dns_rdatatype_opt, source, dctx, 0,
+				       &target) != ISC_R_SUCCESS)
+			goto fallback;
+		fast->optrdata.rdclass = udpsize;
+
+		dns_rdatalist_init(&fast->optrdatalist);
+		fast->optrdatalist.type = dns_rdatatype_opt;
+		fast->optrdatalist.rdclass = udpsize;
+		fast->optrdatalist.ttl = ttl;
+		ISC_LIST_APPEND(fast->optrdatalist.rdata, &fast->optrdata,
+				link);
+		haveopt = ISC_TRUE;
+	}
+
+	/*
+	 * Everything decoded; now fill in the message.
+	 */
+	msg->rdclass = rdclass;
+	msg->rdclass_set = 1;
+
+	dns_rdatalist_init(&fast->qrdatalist);
+	fast->qrdatalist.type = rdtype;
+	fast->qrdatalist.rdclass = rdclass;
+	dns_rdataset_init(&fast->qrdataset);
+	RUNTIME_CHECK(dns_rdatalist_tordataset(&fast->qrdatalist,
+					       &fast->qrdataset)
+		      == ISC_R_SUCCESS);
+	fast->qrdataset.attributes |= DNS_RDATASETATTR_QUESTION;
+	ISC_LIST_APPEND(fast->qname.list, &fast->qrdataset, link);
+	ISC_LIST_APPEND(msg->sections[DNS_SECTION_QUESTION], &fast->qname,
+			link);
+
+	if (haveopt) {
+		dns_rdataset_init(&fast->optrdataset);
+		RUNTIME_CHECK(dns_rdatalist_tordataset(&fast->optrdatalist,
+						       &fast->optrdataset)
+			      == ISC_R_SUCCESS);
+		msg->opt = &fast->optrdataset;
+		msg->rcode |= (dns_rcode_t)
+			((ttl & DNS_MESSAGE_EDNSRCODE_MASK) >> 20);
+	}
+
+	return (ISC_R_SUCCESS);
+
+ fallback:
+	*source = start;
+	return (ISC_R_NOTFOUND);
+}
+
 isc_result_t
 dns_message_parse(dns_message_t *msg, isc_buffer_t *source,
 		  unsigned int options)
@@ -1625,6 +1789,12 @@ dns_message_parse(dns_message_t *msg, isc_buffer_t *source,
 
 	dns_decompress_setmethods(&dctx, DNS_COMPRESS_GLOBAL14);
 
+	ret = getquery(source, msg, &dctx);
+	if (ret == ISC_R_SUCCESS) {
+		msg->question_ok = 1;
+		goto done;
+	}
+
 	ret = getquestions(source, msg, &dctx, options);
 	if (ret == ISC_R_UNEXPECTEDEND && ignore_tc)
 		goto truncated;
@@ -1666,6 +1836,7 @@ dns_message_parse(dns_message_t *msg, isc_buffer_t *source,
 	if (ret != ISC_R_SUCCESS)
 		return (ret);
 
+ done:
 	isc_buffer_remainingregion(source, &r);
 	if (r.length != 0) {
 		isc_log_write(dns_lctx, ISC_LOGCATEGORY_GENERAL,
@@ -3409,6 +3580,18 @@ dns_message_pseudosectiontotext(dns_message_t *msg,
 					continue;
 				}
 				ADD_STRING(target, "; EXPIRE");
+			} else if (optcode == DNS_OPT_TCP_KEEPALIVE) {
+				if (optlen == 2) {
+					unsigned int dsecs;
+					dsecs = isc_buffer_getuint16(&optbuf);
+					ADD_STRING(target, "; TCP-KEEPALIVE: ");
+					snprintf(buf, sizeof(buf), "%u.%u",
+						 dsecs / 10U, dsecs % 10U);
+					ADD_STRING(target, buf);
+					ADD_STRING(target, " secs\n");
+					continue;
+				}
+				ADD_STRING(target, "; TCP-KEEPALIVE");
 			} else if (optcode == DNS_OPT_PAD) {
 				ADD_STRING(target, "; PAD");
 			} else {
@@ -490,7 +490,6 @@ static dns_rdatasetmethods_t rdataset_methods = {
 	NULL,
 	NULL,
 	NULL,
-	NULL,
 	rdataset_settrust,
 	NULL,
 	NULL,
@@ -24,6 +24,7 @@
 #include <isc/event.h>
 #include <isc/heap.h>
 #include <isc/file.h>
+#include <isc/hash.h>
 #include <isc/hex.h>
 #include <isc/mem.h>
 #include <isc/mutex.h>
@@ -41,7 +42,6 @@
 #include <isc/time.h>
 #include <isc/util.h>
 
-#include <dns/acache.h>
 #include <dns/callbacks.h>
 #include <dns/db.h>
 #include <dns/dbiterator.h>
@@ -50,6 +50,7 @@
 #include <dns/lib.h>
 #include <dns/log.h>
 #include <dns/masterdump.h>
+#include <dns/message.h>
 #include <dns/nsec.h>
 #include <dns/nsec3.h>
 #include <dns/rbt.h>
@@ -144,8 +145,6 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define slab_methods slab_methods64
 #define zone_methods zone_methods64
 
-#define acache_callback acache_callback64
-#define acache_cancelentry acache_cancelentry64
 #define activeempty activeempty64
 #define activeemtpynode activeemtpynode64
 #define add32 add64
@@ -192,11 +191,12 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define find_closest_nsec find_closest_nsec64
 #define find_coveringnsec find_coveringnsec64
 #define find_deepest_zonecut find_deepest_zonecut64
+#define find_additional find_additional64
 #define findnode findnode64
 #define findnodeintree findnodeintree64
 #define findnsec3node findnsec3node64
 #define flush_deletions flush_deletions64
-#define free_acachearray free_acachearray64
+#define free_additional free_additional64
 #define free_noqname free_noqname64
 #define free_rbtdb free_rbtdb64
 #define free_rbtdb_callback free_rbtdb_callback64
@@ -206,6 +206,8 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define getoriginnode getoriginnode64
 #define getrrsetstats getrrsetstats64
 #define getsigningtime getsigningtime64
+#define grow_additional grow_additional64
+#define hash_additional hash_additional64
 #define hashsize hashsize64
 #define init_file_version init_file_version64
 #define isdnssec isdnssec64
@@ -238,7 +240,6 @@ typedef isc_uint64_t                    rbtdb_serial_t;
 #define rdataset_getnoqname rdataset_getnoqname64
 #define rdataset_getownercase rdataset_getownercase64
 #define rdataset_next rdataset_next64
-#define rdataset_putadditional rdataset_putadditional64
 #define rdataset_setadditional rdataset_setadditional64
 #define rdataset_setownercase rdataset_setownercase64
 #define rdataset_settrust rdataset_settrust64
@@ -394,8 +395,6 @@ struct noqname {
 	dns_rdatatype_t	type;
 };
 
-typedef struct acachectl acachectl_t;
-
 typedef struct rdatasetheader {
 	/*%
 	 * Locked by the owning node's lock.
@@ -439,9 +438,6 @@ typedef struct rdatasetheader {
 	 * performance reasons.
 	 */
 
-	acachectl_t                     *additional_auth;
-	acachectl_t                     *additional_glue;
-
 	dns_rbtnode_t                   *node;
 	isc_stdtime_t                   last_used;
 	ISC_LINK(struct rdatasetheader) link;
@@ -475,19 +471,40 @@ typedef ISC_LIST(dns_rbtnode_t)         rbtnodelist_t;
 #define RDATASET_ATTR_CASESET           0x0400
 #define RDATASET_ATTR_ZEROTTL           0x0800
 
-typedef struct acache_cbarg {
+/*%
+ * Maximum number of rdatasets remembered per additional cache entry.
+ */
+#define RBTDB_ADDITIONAL_MAX		4
+#define RBTDB_ADDITIONAL_INITSIZE	64	/*%< Must be a power of two. */
+
+/*%
+ * An additional cache entry records what the additional section
+ * processing found for one rdata of an rdataset in a zone version:
+ * either the node and the headers of the rdatasets found at the target
+ * name, or that nothing was found.  The rdata is identified by the
+ * position of the rdataset's cursor in its slab.  The target name
+ * follows the structure in wire format.
+ *
+ * Entries hold no references.  The headers and nodes visible in a
+ * version cannot be freed while the version is open, and the entries
+ * are discarded with the version.
+ */
+typedef struct rbtdb_additional rbtdb_additional_t;
+
+struct rbtdb_additional {
+	unsigned int                    hashval;
+	unsigned char                   *rdata;
 	dns_rdatasetadditional_t        type;
+	isc_boolean_t                   negative;
+	dns_rbtnode_t                   *node;
 	unsigned int                    count;
-	dns_db_t                        *db;
-	dns_dbnode_t                    *node;
-	rdatasetheader_t                *header;
-} acache_cbarg_t;
-
-struct acachectl {
-	dns_acacheentry_t               *entry;
-	acache_cbarg_t                  *cbarg;
+	rdatasetheader_t                *headers[RBTDB_ADDITIONAL_MAX];
+	unsigned int                    namelen;
+	rbtdb_additional_t              *next;
 };
 
+#define ADDITIONAL_NAME(a)	((unsigned char *)((a) + 1))
+
 /*
  * XXX
  * When the cache will pre-expire data (due to memory low or other
@@ -611,6 +628,14 @@ typedef struct rbtdb_version {
 	isc_rwlock_t                    rwlock;
 	isc_uint64_t			records;
 	isc_uint64_t			bytes;
+
+	/*
+	 * The additional cache is covered by addrwlock.
+	 */
+	isc_rwlock_t                    addrwlock;
+	unsigned int                    addcount;
+	unsigned int                    addsize;
+	rbtdb_additional_t              **addtable;
 } rbtdb_version_t;
 
 typedef ISC_LIST(rbtdb_version_t)       rbtdb_versionlist_t;
@@ -733,28 +758,16 @@ static isc_result_t rdataset_getclosest(dns_rdataset_t *rdataset,
 					dns_rdataset_t *negsig);
 static isc_result_t rdataset_getadditional(dns_rdataset_t *rdataset,
 					   dns_rdatasetadditional_t type,
-					   dns_rdatatype_t qtype,
-					   dns_acache_t *acache,
-					   dns_zone_t **zonep,
-					   dns_db_t **dbp,
-					   dns_dbversion_t **versionp,
-					   dns_dbnode_t **nodep,
+					   dns_db_t *db,
+					   dns_dbversion_t *version,
 					   dns_name_t *fname,
-					   dns_message_t *msg,
-					   isc_stdtime_t now);
+					   dns_message_t *msg);
 static isc_result_t rdataset_setadditional(dns_rdataset_t *rdataset,
 					   dns_rdatasetadditional_t type,
-					   dns_rdatatype_t qtype,
-					   dns_acache_t *acache,
-					   dns_zone_t *zone,
 					   dns_db_t *db,
 					   dns_dbversion_t *version,
-					   dns_dbnode_t *node,
 					   dns_name_t *fname);
-static isc_result_t rdataset_putadditional(dns_acache_t *acache,
-					   dns_rdataset_t *rdataset,
-					   dns_rdatasetadditional_t type,
-					   dns_rdatatype_t qtype);
+static void free_additional(dns_rbtdb_t *rbtdb, rbtdb_version_t *version);
 static inline isc_boolean_t need_headerupdate(rdatasetheader_t *header,
 					      isc_stdtime_t now);
 static void update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
@@ -789,7 +802,6 @@ static dns_rdatasetmethods_t rdataset_methods = {
 	rdataset_getclosest,
 	rdataset_getadditional,
 	rdataset_setadditional,
-	rdataset_putadditional,
 	rdataset_settrust,
 	rdataset_expire,
 	rdataset_clearprefetch,
@@ -814,7 +826,6 @@ static dns_rdatasetmethods_t slab_methods = {
 	NULL,
 	NULL,
 	NULL,
-	NULL,
 	NULL
 };
 
@@ -1183,6 +1194,8 @@ free_rbtdb(dns_rbtdb_t *rbtdb, isc_boolean_t log, isc_event_t *event) {
 		UNLINK(rbtdb->open_versions, rbtdb->current_version, link);
 		isc_refcount_destroy(&rbtdb->current_version->references);
 		isc_rwlock_destroy(&rbtdb->current_version->rwlock);
+		free_additional(rbtdb, rbtdb->current_version);
+		isc_rwlock_destroy(&rbtdb->current_version->addrwlock);
 		isc_mem_put(rbtdb->common.mctx, rbtdb->current_version,
 			    sizeof(rbtdb_version_t));
 	}
@@ -1435,11 +1448,20 @@ allocate_version(isc_mem_t *mctx, rbtdb_serial_t serial,
 		isc_mem_put(mctx, version, sizeof(*version));
 		return (NULL);
 	}
+	result = isc_rwlock_init(&version->addrwlock, 0, 0);
+	if (result != ISC_R_SUCCESS) {
+		isc_refcount_destroy(&version->references);
+		isc_mem_put(mctx, version, sizeof(*version));
+		return (NULL);
+	}
 	version->writer = writer;
 	version->commit_ok = ISC_FALSE;
 	ISC_LIST_INIT(version->changed_list);
 	ISC_LIST_INIT(version->resigned_list);
 	ISC_LINK_INIT(version, link);
+	version->addcount = 0;
+	version->addsize = 0;
+	version->addtable = NULL;
 
 	return (version);
 }
@@ -1482,6 +1504,7 @@ newversion(dns_db_t *db, dns_dbversion_t **versionp) {
 		result = isc_rwlock_init(&version->rwlock, 0, 0);
 		if (result != ISC_R_SUCCESS) {
 			isc_refcount_destroy(&version->references);
+			isc_rwlock_destroy(&version->addrwlock);
 			isc_mem_put(rbtdb->common.mctx, version,
 				    sizeof(*version));
 			version = NULL;
@@ -1556,35 +1579,6 @@ add_changed(dns_rbtdb_t *rbtdb, rbtdb_version_t *version,
 	return (changed);
 }
 
-static void
-free_acachearray(isc_mem_t *mctx, rdatasetheader_t *header,
-		 acachectl_t *array)
-{
-	unsigned int count;
-	unsigned int i;
-	unsigned char *raw;     /* RDATASLAB */
-
-	/*
-	 * The caller must be holding the corresponding node lock.
-	 */
-
-	if (array == NULL)
-		return;
-
-	raw = (unsigned char *)header + sizeof(*header);
-	count = raw[0] * 256 + raw[1];
-
-	/*
-	 * Sanity check: since an additional cache entry has a reference to
-	 * the original DB node (in the callback arg), there should be no
-	 * acache entries when the node can be freed.
-	 */
-	for (i = 0; i < count; i++)
-		INSIST(array[i].entry == NULL && array[i].cbarg == NULL);
-
-	isc_mem_put(mctx, array, count * sizeof(acachectl_t));
-}
-
 static inline void
 free_noqname(isc_mem_t *mctx, struct noqname **noqname) {
 
@@ -1682,9 +1676,6 @@ free_rdataset(dns_rbtdb_t *rbtdb, isc_mem_t *mctx, rdatasetheader_t *rdataset) {
 	if (rdataset->closest != NULL)
 		free_noqname(mctx, &rdataset->closest);
 
-	free_acachearray(mctx, rdataset, rdataset->additional_auth);
-	free_acachearray(mctx, rdataset, rdataset->additional_glue);
-
 	if (NONEXISTENT(rdataset))
 		size = sizeof(*rdataset);
 	else
@@ -2326,6 +2317,25 @@ decrement_reference(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 	return (no_reference);
 }
 
+/*
+ * Make the policy zone changes made so far visible to searches.
+ */
+static void
+commit_rpzs(dns_rbtdb_t *rbtdb) {
+	isc_result_t result;
+
+	result = dns_rpz_commit(rbtdb->rpzs);
+	if (result != ISC_R_SUCCESS) {
+		/*
+		 * It is too late to give up, so merely complain.
+		 */
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
+			      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
+			      "dns_rpz_commit(): %s",
+			      isc_result_totext(result));
+	}
+}
+
 /*
  * Prune the tree by recursively cleaning-up single leaves.  In the worst
  * case, the number of iteration is the number of tree levels, which is at
@@ -2386,6 +2396,9 @@ prune_tree(isc_task_t *task, isc_event_t *event) {
 	NODE_UNLOCK(&rbtdb->node_locks[locknum].lock, isc_rwlocktype_write);
 	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
 
+	if (rbtdb->rpzs != NULL)
+		commit_rpzs(rbtdb);
+
 	detach((dns_db_t **)&rbtdb);
 }
 
@@ -2600,6 +2613,8 @@ cleanup_dead_nodes_callback(isc_task_t *task, isc_event_t *event) {
 			    isc_rwlocktype_write);
 	}
 	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
+	if (rbtdb->rpzs != NULL)
+		commit_rpzs(rbtdb);
 	if (again)
 		isc_task_send(task, &event);
 	else {
@@ -2622,6 +2637,7 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, isc_boolean_t commit) {
 	dns_rbtnode_t *rbtnode;
 	unsigned int refs;
 	rdatasetheader_t *header;
+	isc_boolean_t rpz_commit = ISC_FALSE;
 
 	REQUIRE(VALID_RBTDB(rbtdb));
 	version = (rbtdb_version_t *)*versionp;
@@ -2641,6 +2657,12 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, isc_boolean_t commit) {
 		goto end;
 	}
 
+	/*
+	 * Policy zone changes made in this version, or by cleaning up
+	 * nodes it was the last to use, become visible when it closes.
+	 */
+	rpz_commit = ISC_TF(rbtdb->rpzs != NULL);
+
 	/*
 	 * Update the zone's secure status in version before making
 	 * it the current version.
@@ -2657,6 +2679,11 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, isc_boolean_t commit) {
 
 			INSIST(version->commit_ok);
 			INSIST(version == rbtdb->future_version);
+			/*
+			 * Anything cached while the version was being
+			 * written may be stale.
+			 */
+			free_additional(rbtdb, version);
 			/*
 			 * The current version is going to be replaced.
 			 * Release the (likely last) reference to it from the
@@ -2786,6 +2813,8 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, isc_boolean_t commit) {
 	if (cleanup_version != NULL) {
 		INSIST(EMPTY(cleanup_version->changed_list));
 		isc_rwlock_destroy(&cleanup_version->rwlock);
+		free_additional(rbtdb, cleanup_version);
+		isc_rwlock_destroy(&cleanup_version->addrwlock);
 		isc_mem_put(rbtdb->common.mctx, cleanup_version,
 			    sizeof(*cleanup_version));
 	}
@@ -2879,6 +2908,8 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, isc_boolean_t commit) {
 	}
 
  end:
+	if (rpz_commit)
+		commit_rpzs(rbtdb);
 	*versionp = NULL;
 }
 
@@ -6705,8 +6736,6 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	newheader->closest = NULL;
 	newheader->count = init_count++;
 	newheader->trust = rdataset->trust;
-	newheader->additional_auth = NULL;
-	newheader->additional_glue = NULL;
 	newheader->last_used = now;
 	newheader->node = rbtnode;
 	if (rbtversion != NULL) {
@@ -6893,8 +6922,6 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	newheader->noqname = NULL;
 	newheader->closest = NULL;
 	newheader->count = init_count++;
-	newheader->additional_auth = NULL;
-	newheader->additional_glue = NULL;
 	newheader->last_used = 0;
 	newheader->node = rbtnode;
 	if ((rdataset->attributes & DNS_RDATASETATTR_RESIGN) != 0) {
@@ -6963,13 +6990,6 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 			 * header, not newheader.
 			 */
 			newheader->serial = rbtversion->serial;
-			/*
-			 * XXXJT: dns_rdataslab_subtract() copied the pointers
-			 * to additional info.  We need to clear these fields
-			 * to avoid having duplicated references.
-			 */
-			newheader->additional_auth = NULL;
-			newheader->additional_glue = NULL;
 			rbtversion->records +=
 				dns_rdataslab_count((unsigned char *)newheader,
 						    sizeof(*newheader));
@@ -6996,8 +7016,6 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 			newheader->noqname = NULL;
 			newheader->closest = NULL;
 			newheader->count = 0;
-			newheader->additional_auth = NULL;
-			newheader->additional_glue = NULL;
 			newheader->node = rbtnode;
 			newheader->resign = 0;
 			newheader->resign_lsb = 0;
@@ -7089,8 +7107,6 @@ deleterdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	newheader->trust = 0;
 	newheader->noqname = NULL;
 	newheader->closest = NULL;
-	newheader->additional_auth = NULL;
-	newheader->additional_glue = NULL;
 	if (rbtversion != NULL)
 		newheader->serial = rbtversion->serial;
 	else
@@ -7314,13 +7330,22 @@ loading_addrdataset(void *arg, dns_name_t *name, dns_rdataset_t *rdataset) {
 	newheader->type = RBTDB_RDATATYPE_VALUE(rdataset->type,
 						rdataset->covers);
 	newheader->attributes = 0;
+	if (IS_CACHE(rbtdb)) {
+		/*
+		 * Cache snapshots carry negative cache entries.
+		 */
+		if ((rdataset->attributes & DNS_RDATASETATTR_NEGATIVE) != 0)
+			newheader->attributes |= RDATASET_ATTR_NEGATIVE;
+		if ((rdataset->attributes & DNS_RDATASETATTR_NXDOMAIN) != 0)
+			newheader->attributes |= RDATASET_ATTR_NXDOMAIN;
+		if ((rdataset->attributes & DNS_RDATASETATTR_OPTOUT) != 0)
+			newheader->attributes |= RDATASET_ATTR_OPTOUT;
+	}
 	newheader->trust = rdataset->trust;
 	newheader->serial = 1;
 	newheader->noqname = NULL;
 	newheader->closest = NULL;
 	newheader->count = init_count++;
-	newheader->additional_auth = NULL;
-	newheader->additional_glue = NULL;
 	newheader->last_used = 0;
 	newheader->node = node;
 	setownercase(newheader, name);
@@ -8570,6 +8595,7 @@ dns_rbtdb_create
 	result = isc_rwlock_init(&rbtdb->current_version->rwlock, 0, 0);
 	if (result != ISC_R_SUCCESS) {
 		isc_refcount_destroy(&rbtdb->current_version->references);
+		isc_rwlock_destroy(&rbtdb->current_version->addrwlock);
 		isc_mem_put(mctx, rbtdb->current_version,
 			    sizeof(*rbtdb->current_version));
 		rbtdb->current_version = NULL;
@@ -9589,352 +9615,261 @@ dbiterator_origin(dns_dbiterator_t *iterator, dns_name_t *name) {
 
 /*%
  * Additional cache routines.
+ *
+ * Each zone version has its own additional cache, which starts out
+ * empty and is freed with the version, so committing a new version
+ * invalidates everything cached for the old one at once.  Lookups take
+ * the cache lock for reading only.
  */
-static isc_result_t
-rdataset_getadditional(dns_rdataset_t *rdataset, dns_rdatasetadditional_t type,
-		       dns_rdatatype_t qtype, dns_acache_t *acache,
-		       dns_zone_t **zonep, dns_db_t **dbp,
-		       dns_dbversion_t **versionp, dns_dbnode_t **nodep,
-		       dns_name_t *fname, dns_message_t *msg,
-		       isc_stdtime_t now)
-{
-	dns_rbtdb_t *rbtdb = rdataset->private1;
-	dns_rbtnode_t *rbtnode = rdataset->private2;
-	unsigned char *raw = rdataset->private3;        /* RDATASLAB */
-	unsigned int current_count = rdataset->privateuint4;
-	unsigned int count;
-	rdatasetheader_t *header;
-	nodelock_t *nodelock;
-	unsigned int total_count;
-	acachectl_t *acarray;
-	dns_acacheentry_t *entry;
-	isc_result_t result;
-
-	UNUSED(qtype); /* we do not use this value at least for now */
-	UNUSED(acache);
-
-	header = (struct rdatasetheader *)(raw - sizeof(*header));
+static inline unsigned int
+hash_additional(unsigned char *rdata, dns_rdatasetadditional_t type) {
+	struct {
+		unsigned char *rdata;
+		unsigned int type;
+	} key;
 
-	total_count = raw[0] * 256 + raw[1];
-	INSIST(total_count > current_count);
-	count = total_count - current_count - 1;
-
-	acarray = NULL;
-
-	nodelock = &rbtdb->node_locks[rbtnode->locknum].lock;
-	NODE_LOCK(nodelock, isc_rwlocktype_read);
+	memset(&key, 0, sizeof(key));
+	key.rdata = rdata;
+	key.type = type;
+	return (isc_hash_function(&key, sizeof(key), ISC_TRUE, NULL));
+}
 
-	switch (type) {
-	case dns_rdatasetadditional_fromauth:
-		acarray = header->additional_auth;
-		break;
-	case dns_rdatasetadditional_fromcache:
-		acarray = NULL;
-		break;
-	case dns_rdatasetadditional_fromglue:
-		acarray = header->additional_glue;
-		break;
-	default:
-		INSIST(0);
-	}
+/*
+ * The caller must be holding the version's addrwlock.
+ */
+static rbtdb_additional_t *
+find_additional(rbtdb_version_t *version, unsigned int hashval,
+		unsigned char *rdata, dns_rdatasetadditional_t type)
+{
+	rbtdb_additional_t *entry;
 
-	if (acarray == NULL) {
-		if (type != dns_rdatasetadditional_fromcache)
-			dns_acache_countquerymiss(acache);
-		NODE_UNLOCK(nodelock, isc_rwlocktype_read);
-		return (ISC_R_NOTFOUND);
-	}
+	if (version->addtable == NULL)
+		return (NULL);
 
-	if (acarray[count].entry == NULL) {
-		dns_acache_countquerymiss(acache);
-		NODE_UNLOCK(nodelock, isc_rwlocktype_read);
-		return (ISC_R_NOTFOUND);
+	for (entry = version->addtable[hashval & (version->addsize - 1)];
+	     entry != NULL;
+	     entry = entry->next)
+	{
+		if (entry->hashval == hashval && entry->rdata == rdata &&
+		    entry->type == type)
+			break;
 	}
-
-	entry = NULL;
-	dns_acache_attachentry(acarray[count].entry, &entry);
-
-	NODE_UNLOCK(nodelock, isc_rwlocktype_read);
-
-	result = dns_acache_getentry(entry, zonep, dbp, versionp,
-				     nodep, fname, msg, now);
-
-	dns_acache_detachentry(&entry);
-
-	return (result);
+	return (entry);
 }
 
+/*
+ * The caller must be holding the version's addrwlock for writing.
+ * On allocation failure the old table is kept.
+ */
 static void
-acache_callback(dns_acacheentry_t *entry, void **arg) {
-	dns_rbtdb_t *rbtdb;
-	dns_rbtnode_t *rbtnode;
-	nodelock_t *nodelock;
-	acachectl_t *acarray = NULL;
-	acache_cbarg_t *cbarg;
-	unsigned int count;
-
-	REQUIRE(arg != NULL);
-	cbarg = *arg;
+grow_additional(dns_rbtdb_t *rbtdb, rbtdb_version_t *version) {
+	rbtdb_additional_t **table, *entry, *next;
+	unsigned int i, size, bucket;
 
-	/*
-	 * The caller must hold the entry lock.
-	 */
-
-	rbtdb = (dns_rbtdb_t *)cbarg->db;
-	rbtnode = (dns_rbtnode_t *)cbarg->node;
-
-	nodelock = &rbtdb->node_locks[rbtnode->locknum].lock;
-	NODE_LOCK(nodelock, isc_rwlocktype_write);
+	if (version->addsize == 0)
+		size = RBTDB_ADDITIONAL_INITSIZE;
+	else
+		size = version->addsize * 2;
 
-	switch (cbarg->type) {
-	case dns_rdatasetadditional_fromauth:
-		acarray = cbarg->header->additional_auth;
-		break;
-	case dns_rdatasetadditional_fromglue:
-		acarray = cbarg->header->additional_glue;
-		break;
-	default:
-		INSIST(0);
-	}
+	table = isc_mem_get(rbtdb->common.mctx, size * sizeof(*table));
+	if (table == NULL)
+		return;
+	memset(table, 0, size * sizeof(*table));
 
-	count = cbarg->count;
-	if (acarray != NULL && acarray[count].entry == entry) {
-		acarray[count].entry = NULL;
-		INSIST(acarray[count].cbarg == cbarg);
-		acarray[count].cbarg = NULL;
-		isc_mem_put(rbtdb->common.mctx, cbarg, sizeof(acache_cbarg_t));
-		dns_acache_detachentry(&entry);
+	for (i = 0; i < version->addsize; i++) {
+		for (entry = version->addtable[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			bucket = entry->hashval & (size - 1);
+			entry->next = table[bucket];
+			table[bucket] = entry;
+		}
 	}
 
-	NODE_UNLOCK(nodelock, isc_rwlocktype_write);
-
-	dns_db_detachnode((dns_db_t *)rbtdb, (dns_dbnode_t **)(void*)&rbtnode);
-	dns_db_detach((dns_db_t **)(void*)&rbtdb);
-
-	*arg = NULL;
+	if (version->addtable != NULL)
+		isc_mem_put(rbtdb->common.mctx, version->addtable,
+			    version->addsize * sizeof(*version->addtable));
+	version->addtable = table;
+	version->addsize = size;
 }
 
 static void
-acache_cancelentry(isc_mem_t *mctx, dns_acacheentry_t *entry,
-		      acache_cbarg_t **cbargp)
-{
-	acache_cbarg_t *cbarg;
-
-	REQUIRE(mctx != NULL);
-	REQUIRE(entry != NULL);
-	REQUIRE(cbargp != NULL && *cbargp != NULL);
+free_additional(dns_rbtdb_t *rbtdb, rbtdb_version_t *version) {
+	rbtdb_additional_t *entry, *next;
+	unsigned int i;
 
-	cbarg = *cbargp;
+	if (version->addtable == NULL)
+		return;
 
-	if (dns_acache_cancelentry(entry)) {
-		dns_db_detachnode(cbarg->db, &cbarg->node);
-		dns_db_detach(&cbarg->db);
+	for (i = 0; i < version->addsize; i++) {
+		for (entry = version->addtable[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			isc_mem_put(rbtdb->common.mctx, entry,
+				    sizeof(*entry) + entry->namelen);
+		}
 	}
-
-	isc_mem_put(mctx, cbarg, sizeof(acache_cbarg_t));
-
-	*cbargp = NULL;
+	isc_mem_put(rbtdb->common.mctx, version->addtable,
+		    version->addsize * sizeof(*version->addtable));
+	version->addtable = NULL;
+	version->addsize = 0;
+	version->addcount = 0;
 }
 
 static isc_result_t
-rdataset_setadditional(dns_rdataset_t *rdataset, dns_rdatasetadditional_t type,
-		       dns_rdatatype_t qtype, dns_acache_t *acache,
-		       dns_zone_t *zone, dns_db_t *db,
-		       dns_dbversion_t *version, dns_dbnode_t *node,
-		       dns_name_t *fname)
+rdataset_getadditional(dns_rdataset_t *rdataset, dns_rdatasetadditional_t type,
+		       dns_db_t *db, dns_dbversion_t *version,
+		       dns_name_t *fname, dns_message_t *msg)
 {
 	dns_rbtdb_t *rbtdb = rdataset->private1;
-	dns_rbtnode_t *rbtnode = rdataset->private2;
-	unsigned char *raw = rdataset->private3;        /* RDATASLAB */
-	unsigned int current_count = rdataset->privateuint4;
-	rdatasetheader_t *header;
-	unsigned int total_count, count;
+	rbtdb_version_t *rbtversion = version;
+	unsigned char *rdata = rdataset->private5;
+	rbtdb_additional_t *entry;
+	dns_rdataset_t *found[RBTDB_ADDITIONAL_MAX];
 	nodelock_t *nodelock;
+	dns_name_t name;
+	isc_region_t r;
 	isc_result_t result;
-	acachectl_t *acarray;
-	dns_acacheentry_t *newentry, *oldentry = NULL;
-	acache_cbarg_t *newcbarg, *oldcbarg = NULL;
-
-	UNUSED(qtype);
+	unsigned int i, hashval;
 
-	if (type == dns_rdatasetadditional_fromcache)
-		return (ISC_R_SUCCESS);
-
-	header = (struct rdatasetheader *)(raw - sizeof(*header));
+	if (db != (dns_db_t *)rbtdb || IS_CACHE(rbtdb) ||
+	    type == dns_rdatasetadditional_fromcache || rdata == NULL)
+		return (ISC_R_NOTIMPLEMENTED);
+	INSIST(rbtversion->rbtdb == rbtdb);
 
-	total_count = raw[0] * 256 + raw[1];
-	INSIST(total_count > current_count);
-	count = total_count - current_count - 1; /* should be private data */
+	hashval = hash_additional(rdata, type);
+	RWLOCK(&rbtversion->addrwlock, isc_rwlocktype_read);
+	entry = find_additional(rbtversion, hashval, rdata, type);
+	RWUNLOCK(&rbtversion->addrwlock, isc_rwlocktype_read);
 
-	newcbarg = isc_mem_get(rbtdb->common.mctx, sizeof(*newcbarg));
-	if (newcbarg == NULL)
-		return (ISC_R_NOMEMORY);
-	newcbarg->type = type;
-	newcbarg->count = count;
-	newcbarg->header = header;
-	newcbarg->db = NULL;
-	dns_db_attach((dns_db_t *)rbtdb, &newcbarg->db);
-	newcbarg->node = NULL;
-	dns_db_attachnode((dns_db_t *)rbtdb, (dns_dbnode_t *)rbtnode,
-			  &newcbarg->node);
-	newentry = NULL;
-	result = dns_acache_createentry(acache, (dns_db_t *)rbtdb,
-					acache_callback, newcbarg, &newentry);
-	if (result != ISC_R_SUCCESS)
-		goto fail;
+	/*
+	 * Entries are never changed or removed while the version is
+	 * open, so 'entry' can be used without the lock.
+	 */
+	if (entry == NULL)
+		return (ISC_R_NOTFOUND);
+	if (entry->negative)
+		return (DNS_R_NXRRSET);
 
-	/* Set cache data in the new entry. */
-	result = dns_acache_setentry(acache, newentry, zone, db,
-				     version, node, fname);
+	r.base = ADDITIONAL_NAME(entry);
+	r.length = entry->namelen;
+	dns_name_init(&name, NULL);
+	dns_name_fromregion(&name, &r);
+	result = dns_name_copy(&name, fname, NULL);
 	if (result != ISC_R_SUCCESS)
-		goto fail;
-
-	nodelock = &rbtdb->node_locks[rbtnode->locknum].lock;
-	NODE_LOCK(nodelock, isc_rwlocktype_write);
-
-	acarray = NULL;
-	switch (type) {
-	case dns_rdatasetadditional_fromauth:
-		acarray = header->additional_auth;
-		break;
-	case dns_rdatasetadditional_fromglue:
-		acarray = header->additional_glue;
-		break;
-	default:
-		INSIST(0);
-	}
-
-	if (acarray == NULL) {
-		unsigned int i;
-
-		acarray = isc_mem_get(rbtdb->common.mctx, total_count *
-				      sizeof(acachectl_t));
+		return (result);
 
-		if (acarray == NULL) {
-			NODE_UNLOCK(nodelock, isc_rwlocktype_write);
+	memset(found, 0, sizeof(found));
+	for (i = 0; i < entry->count; i++) {
+		result = dns_message_gettemprdataset(msg, &found[i]);
+		if (result != ISC_R_SUCCESS)
 			goto fail;
-		}
-
-		for (i = 0; i < total_count; i++) {
-			acarray[i].entry = NULL;
-			acarray[i].cbarg = NULL;
-		}
-	}
-	switch (type) {
-	case dns_rdatasetadditional_fromauth:
-		header->additional_auth = acarray;
-		break;
-	case dns_rdatasetadditional_fromglue:
-		header->additional_glue = acarray;
-		break;
-	default:
-		INSIST(0);
 	}
 
-	if (acarray[count].entry != NULL) {
-		/*
-		 * Swap the entry.  Delay cleaning-up the old entry since
-		 * it would require a node lock.
-		 */
-		oldentry = acarray[count].entry;
-		INSIST(acarray[count].cbarg != NULL);
-		oldcbarg = acarray[count].cbarg;
+	if (entry->count > 0) {
+		nodelock = &rbtdb->node_locks[entry->node->locknum].lock;
+		NODE_LOCK(nodelock, isc_rwlocktype_read);
+		for (i = 0; i < entry->count; i++)
+			bind_rdataset(rbtdb, entry->node, entry->headers[i],
+				      0, found[i]);
+		NODE_UNLOCK(nodelock, isc_rwlocktype_read);
 	}
-	acarray[count].entry = newentry;
-	acarray[count].cbarg = newcbarg;
 
-	NODE_UNLOCK(nodelock, isc_rwlocktype_write);
-
-	if (oldentry != NULL) {
-		acache_cancelentry(rbtdb->common.mctx, oldentry, &oldcbarg);
-		dns_acache_detachentry(&oldentry);
-	}
+	for (i = 0; i < entry->count; i++)
+		ISC_LIST_APPEND(fname->list, found[i], link);
 
 	return (ISC_R_SUCCESS);
 
  fail:
-	if (newcbarg != NULL) {
-		if (newentry != NULL) {
-			acache_cancelentry(rbtdb->common.mctx, newentry,
-					   &newcbarg);
-			dns_acache_detachentry(&newentry);
-		} else {
-			dns_db_detachnode((dns_db_t *)rbtdb, &newcbarg->node);
-			dns_db_detach(&newcbarg->db);
-			isc_mem_put(rbtdb->common.mctx, newcbarg,
-			    sizeof(*newcbarg));
-		}
+	for (i = 0; i < entry->count; i++) {
+		if (found[i] != NULL)
+			dns_message_puttemprdataset(msg, &found[i]);
 	}
-
 	return (result);
 }
 
 static isc_result_t
-rdataset_putadditional(dns_acache_t *acache, dns_rdataset_t *rdataset,
-		       dns_rdatasetadditional_t type, dns_rdatatype_t qtype)
+rdataset_setadditional(dns_rdataset_t *rdataset, dns_rdatasetadditional_t type,
+		       dns_db_t *db, dns_dbversion_t *version,
+		       dns_name_t *fname)
 {
 	dns_rbtdb_t *rbtdb = rdataset->private1;
-	dns_rbtnode_t *rbtnode = rdataset->private2;
-	unsigned char *raw = rdataset->private3;        /* RDATASLAB */
-	unsigned int current_count = rdataset->privateuint4;
-	rdatasetheader_t *header;
-	nodelock_t *nodelock;
-	unsigned int total_count, count;
-	acachectl_t *acarray;
-	dns_acacheentry_t *entry;
-	acache_cbarg_t *cbarg;
-
-	UNUSED(qtype);          /* we do not use this value at least for now */
-	UNUSED(acache);
-
-	if (type == dns_rdatasetadditional_fromcache)
-		return (ISC_R_SUCCESS);
-
-	header = (struct rdatasetheader *)(raw - sizeof(*header));
-
-	total_count = raw[0] * 256 + raw[1];
-	INSIST(total_count > current_count);
-	count = total_count - current_count - 1;
-
-	acarray = NULL;
-	entry = NULL;
-
-	nodelock = &rbtdb->node_locks[rbtnode->locknum].lock;
-	NODE_LOCK(nodelock, isc_rwlocktype_write);
+	rbtdb_version_t *rbtversion = version;
+	unsigned char *rdata = rdataset->private5;
+	rbtdb_additional_t *entry;
+	rdatasetheader_t *headers[RBTDB_ADDITIONAL_MAX];
+	dns_rbtnode_t *node = NULL;
+	dns_rdataset_t *found;
+	unsigned char *raw;	/* RDATASLAB */
+	unsigned int count = 0;
+	isc_region_t r;
 
-	switch (type) {
-	case dns_rdatasetadditional_fromauth:
-		acarray = header->additional_auth;
-		break;
-	case dns_rdatasetadditional_fromglue:
-		acarray = header->additional_glue;
-		break;
-	default:
-		INSIST(0);
-	}
+	if (db != (dns_db_t *)rbtdb || IS_CACHE(rbtdb) ||
+	    type == dns_rdatasetadditional_fromcache || rdata == NULL)
+		return (ISC_R_NOTIMPLEMENTED);
+	INSIST(rbtversion->rbtdb == rbtdb);
 
-	if (acarray == NULL) {
-		NODE_UNLOCK(nodelock, isc_rwlocktype_write);
-		return (ISC_R_NOTFOUND);
+	r.base = NULL;
+	r.length = 0;
+	if (fname != NULL) {
+		/*
+		 * Only rdatasets bound from this database can be
+		 * remembered.
+		 */
+		for (found = ISC_LIST_HEAD(fname->list);
+		     found != NULL;
+		     found = ISC_LIST_NEXT(found, link))
+		{
+			if (found->methods != &rdataset_methods ||
+			    found->private1 != rbtdb ||
+			    (node != NULL && found->private2 != node) ||
+			    count == RBTDB_ADDITIONAL_MAX)
+				return (ISC_R_NOTIMPLEMENTED);
+			node = found->private2;
+			raw = found->private3;
+			headers[count++] = (rdatasetheader_t *)
+					   (raw - sizeof(rdatasetheader_t));
+		}
+		dns_name_toregion(fname, &r);
 	}
 
-	entry = acarray[count].entry;
-	if (entry == NULL) {
-		NODE_UNLOCK(nodelock, isc_rwlocktype_write);
-		return (ISC_R_NOTFOUND);
+	entry = isc_mem_get(rbtdb->common.mctx, sizeof(*entry) + r.length);
+	if (entry == NULL)
+		return (ISC_R_NOMEMORY);
+	entry->hashval = hash_additional(rdata, type);
+	entry->rdata = rdata;
+	entry->type = type;
+	entry->negative = ISC_TF(fname == NULL);
+	entry->node = node;
+	entry->count = count;
+	if (count > 0)
+		memmove(entry->headers, headers, count * sizeof(headers[0]));
+	entry->namelen = r.length;
+	if (r.length > 0)
+		memmove(ADDITIONAL_NAME(entry), r.base, r.length);
+
+	RWLOCK(&rbtversion->addrwlock, isc_rwlocktype_write);
+	if (find_additional(rbtversion, entry->hashval, rdata, type) != NULL) {
+		/*
+		 * Another client got here first.
+		 */
+		RWUNLOCK(&rbtversion->addrwlock, isc_rwlocktype_write);
+		isc_mem_put(rbtdb->common.mctx, entry,
+			    sizeof(*entry) + entry->namelen);
+		return (ISC_R_SUCCESS);
 	}
-
-	acarray[count].entry = NULL;
-	cbarg = acarray[count].cbarg;
-	acarray[count].cbarg = NULL;
-
-	NODE_UNLOCK(nodelock, isc_rwlocktype_write);
-
-	if (entry != NULL) {
-		if (cbarg != NULL)
-			acache_cancelentry(rbtdb->common.mctx, entry, &cbarg);
-		dns_acache_detachentry(&entry);
+	if (rbtversion->addcount >= rbtversion->addsize * 2)
+		grow_additional(rbtdb, rbtversion);
+	if (rbtversion->addtable == NULL) {
+		RWUNLOCK(&rbtversion->addrwlock, isc_rwlocktype_write);
+		isc_mem_put(rbtdb->common.mctx, entry,
+			    sizeof(*entry) + entry->namelen);
+		return (ISC_R_NOMEMORY);
 	}
+	entry->next = rbtversion->addtable[entry->hashval &
+					   (rbtversion->addsize - 1)];
+	rbtversion->addtable[entry->hashval & (rbtversion->addsize - 1)] =
+		entry;
+	rbtversion->addcount++;
+	RWUNLOCK(&rbtversion->addrwlock, isc_rwlocktype_write);
 
 	return (ISC_R_SUCCESS);
 }
@@ -41,7 +41,6 @@ static dns_rdatasetmethods_t methods = {
 	NULL,
 	NULL,
 	NULL,
-	NULL,
 	isc__rdatalist_setownercase,
 	isc__rdatalist_getownercase
 };
@@ -200,7 +200,6 @@ static dns_rdatasetmethods_t question_methods = {
 	NULL,
 	NULL,
 	NULL,
-	NULL,
 	NULL
 };
 
@@ -685,75 +684,44 @@ dns_rdataset_getclosest(dns_rdataset_t *rdataset, dns_name_t *name,
 isc_result_t
 dns_rdataset_getadditional(dns_rdataset_t *rdataset,
 			   dns_rdatasetadditional_t type,
-			   dns_rdatatype_t qtype,
-			   dns_acache_t *acache,
-			   dns_zone_t **zonep,
-			   dns_db_t **dbp,
-			   dns_dbversion_t **versionp,
-			   dns_dbnode_t **nodep,
+			   dns_db_t *db,
+			   dns_dbversion_t *version,
 			   dns_name_t *fname,
-			   dns_message_t *msg,
-			   isc_stdtime_t now)
+			   dns_message_t *msg)
 {
 	REQUIRE(DNS_RDATASET_VALID(rdataset));
 	REQUIRE(rdataset->methods != NULL);
-	REQUIRE(zonep == NULL || *zonep == NULL);
-	REQUIRE(dbp != NULL && *dbp == NULL);
-	REQUIRE(versionp != NULL && *versionp == NULL);
-	REQUIRE(nodep != NULL && *nodep == NULL);
+	REQUIRE(db != NULL && version != NULL);
 	REQUIRE(fname != NULL);
 	REQUIRE(msg != NULL);
 
-	if (acache != NULL && rdataset->methods->getadditional != NULL) {
+	if (rdataset->methods->getadditional != NULL) {
 		return ((rdataset->methods->getadditional)(rdataset, type,
-							   qtype, acache,
-							   zonep, dbp,
-							   versionp, nodep,
-							   fname, msg, now));
+							   db, version,
+							   fname, msg));
 	}
 
-	return (ISC_R_FAILURE);
+	return (ISC_R_NOTIMPLEMENTED);
 }
 
 isc_result_t
 dns_rdataset_setadditional(dns_rdataset_t *rdataset,
 			   dns_rdatasetadditional_t type,
-			   dns_rdatatype_t qtype,
-			   dns_acache_t *acache,
-			   dns_zone_t *zone,
 			   dns_db_t *db,
 			   dns_dbversion_t *version,
-			   dns_dbnode_t *node,
 			   dns_name_t *fname)
 {
 	REQUIRE(DNS_RDATASET_VALID(rdataset));
 	REQUIRE(rdataset->methods != NULL);
+	REQUIRE(db != NULL && version != NULL);
 
-	if (acache != NULL && rdataset->methods->setadditional != NULL) {
+	if (rdataset->methods->setadditional != NULL) {
 		return ((rdataset->methods->setadditional)(rdataset, type,
-							   qtype, acache, zone,
 							   db, version,
-							   node, fname));
-	}
-
-	return (ISC_R_FAILURE);
-}
-
-isc_result_t
-dns_rdataset_putadditional(dns_acache_t *acache,
-			   dns_rdataset_t *rdataset,
-			   dns_rdatasetadditional_t type,
-			   dns_rdatatype_t qtype)
-{
-	REQUIRE(DNS_RDATASET_VALID(rdataset));
-	REQUIRE(rdataset->methods != NULL);
-
-	if (acache != NULL && rdataset->methods->putadditional != NULL) {
-		return ((rdataset->methods->putadditional)(acache, rdataset,
-							   type, qtype));
+							   fname));
 	}
 
-	return (ISC_R_FAILURE);
+	return (ISC_R_NOTIMPLEMENTED);
 }
 
 void
@@ -1303,11 +1303,18 @@ fcount_decr(fetchctx_t *fctx) {
 	UNLOCK(&dbucket->lock);
 }
 
+/*%
+ * Completion events for clients waiting on the same fetch are sent
+ * SENDEVENTS_BATCH at a time with isc_task_sendmanyanddetach().
+ */
+#define SENDEVENTS_BATCH	16
+
 static inline void
 fctx_sendevents(fetchctx_t *fctx, isc_result_t result, int line) {
 	dns_fetchevent_t *event, *next_event;
-	isc_task_t *task;
-	unsigned int count = 0;
+	isc_task_t *tasks[SENDEVENTS_BATCH];
+	isc_event_t *events[SENDEVENTS_BATCH];
+	unsigned int count = 0, n = 0;
 	isc_interval_t i;
 	isc_boolean_t logit = ISC_FALSE;
 	isc_time_t now;
@@ -1335,7 +1342,7 @@ fctx_sendevents(fetchctx_t *fctx, isc_result_t result, int line) {
 	     event = next_event) {
 		next_event = ISC_LIST_NEXT(event, ev_link);
 		ISC_LIST_UNLINK(fctx->events, event, ev_link);
-		task = event->ev_sender;
+		tasks[n] = event->ev_sender;
 		event->ev_sender = fctx;
 		event->vresult = fctx->vresult;
 		if (!HAVE_ANSWER(fctx))
@@ -1356,9 +1363,15 @@ fctx_sendevents(fetchctx_t *fctx, isc_result_t result, int line) {
 			       event->result == DNS_R_NCACHENXRRSET);
 		}
 
-		isc_task_sendanddetach(&task, ISC_EVENT_PTR(&event));
+		events[n++] = (isc_event_t *)event;
+		if (n == SENDEVENTS_BATCH) {
+			isc_task_sendmanyanddetach(tasks, events, n);
+			n = 0;
+		}
 		count++;
 	}
+	if (n > 0)
+		isc_task_sendmanyanddetach(tasks, events, n);
 
 	if ((fctx->attributes & FCTX_ATTR_HAVEANSWER) != 0 &&
 	    fctx->spilled &&
@@ -9002,12 +9015,12 @@ dns_resolver_create(dns_view_t *view,
 		goto cleanup_primelock;
 
 #if USE_ALGLOCK
-	result = isc_rwlock_init(&res->alglock, 0, 0);
+	result = isc_rwlock_initdistributed(&res->alglock, res->mctx);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_spillattimer;
 #endif
 #if USE_MBSLOCK
-	result = isc_rwlock_init(&res->mbslock, 0, 0);
+	result = isc_rwlock_initdistributed(&res->mbslock, res->mctx);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_alglock;
 #endif
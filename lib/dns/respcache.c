@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <isc/buffer.h>
+#include <isc/hash.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/respcache.h>
+
+#define RESPCACHE_MAGIC			ISC_MAGIC('R', 's', 'C', 'a')
+#define VALID_RESPCACHE(m)		ISC_MAGIC_VALID(m, RESPCACHE_MAGIC)
+
+/*%
+ * Number of independently locked shards.  Must be a power of two.
+ */
+#define RESPCACHE_SHARDS		16U
+
+typedef struct dns_rcentry dns_rcentry_t;
+
+/*%
+ * An entry is allocated together with its key and response, which
+ * follow the structure in that order.
+ */
+struct dns_rcentry {
+	isc_uint32_t			hashval;
+	const dns_db_t			*db;		/*%< not attached */
+	isc_uint32_t			serial;
+	unsigned int			info;
+	unsigned int			keylen;
+	unsigned int			wirelen;
+	ISC_LINK(dns_rcentry_t)		hlink;
+	ISC_LINK(dns_rcentry_t)		lru;
+};
+
+#define ENTRY_KEY(e)	((unsigned char *)((e) + 1))
+#define ENTRY_WIRE(e)	(ENTRY_KEY(e) + (e)->keylen)
+#define ENTRY_SIZE(e)	(sizeof(*(e)) + (e)->keylen + (e)->wirelen)
+
+typedef ISC_LIST(dns_rcentry_t) dns_rcentrylist_t;
+
+typedef struct respcacheshard {
+	isc_mutex_t			lock;
+	unsigned int			count;
+	unsigned int			max;
+	unsigned int			nbuckets;	/*%< power of two */
+	dns_rcentrylist_t		*buckets;
+	dns_rcentrylist_t		lru;		/*%< head is newest */
+} respcacheshard_t;
+
+struct dns_respcache {
+	unsigned int			magic;
+	isc_mem_t			*mctx;
+	respcacheshard_t		shards[RESPCACHE_SHARDS];
+};
+
+static inline respcacheshard_t *
+getshard(dns_respcache_t *rc, isc_uint32_t hashval) {
+	return (&rc->shards[hashval & (RESPCACHE_SHARDS - 1)]);
+}
+
+static inline dns_rcentrylist_t *
+getbucket(respcacheshard_t *shard, isc_uint32_t hashval) {
+	return (&shard->buckets[(hashval >> 4) & (shard->nbuckets - 1)]);
+}
+
+/*
+ * Remove 'entry' from 'shard' and put it on 'dead'.  Entries are
+ * freed by freeentries() once the shard is unlocked.
+ */
+static void
+unlinkentry(respcacheshard_t *shard, dns_rcentry_t *entry,
+	    dns_rcentrylist_t *dead)
+{
+	ISC_LIST_UNLINK(shard->lru, entry, lru);
+	ISC_LIST_UNLINK(*getbucket(shard, entry->hashval), entry, hlink);
+	shard->count--;
+	ISC_LIST_APPEND(*dead, entry, lru);
+}
+
+static void
+freeentries(dns_respcache_t *rc, dns_rcentrylist_t *dead) {
+	dns_rcentry_t *entry;
+
+	while ((entry = ISC_LIST_HEAD(*dead)) != NULL) {
+		ISC_LIST_UNLINK(*dead, entry, lru);
+		isc_mem_put(rc->mctx, entry, ENTRY_SIZE(entry));
+	}
+}
+
+static void
+flushshard(respcacheshard_t *shard, dns_rcentrylist_t *dead) {
+	dns_rcentry_t *entry;
+
+	while ((entry = ISC_LIST_HEAD(shard->lru)) != NULL)
+		unlinkentry(shard, entry, dead);
+	INSIST(shard->count == 0);
+}
+
+static dns_rcentry_t *
+lookup(respcacheshard_t *shard, isc_uint32_t hashval, isc_region_t *key) {
+	dns_rcentry_t *entry;
+
+	for (entry = ISC_LIST_HEAD(*getbucket(shard, hashval));
+	     entry != NULL;
+	     entry = ISC_LIST_NEXT(entry, hlink))
+	{
+		if (entry->hashval == hashval &&
+		    entry->keylen == key->length &&
+		    memcmp(ENTRY_KEY(entry), key->base, key->length) == 0)
+			break;
+	}
+	return (entry);
+}
+
+isc_result_t
+dns_respcache_create(isc_mem_t *mctx, unsigned int size,
+		     dns_respcache_t **rcp)
+{
+	isc_result_t result;
+	dns_respcache_t *rc;
+	respcacheshard_t *shard;
+	unsigned int i, j, max, nbuckets;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(size > 0);
+	REQUIRE(rcp != NULL && *rcp == NULL);
+
+	rc = isc_mem_get(mctx, sizeof(*rc));
+	if (rc == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(rc, 0, sizeof(*rc));
+
+	max = (size + RESPCACHE_SHARDS - 1) / RESPCACHE_SHARDS;
+	for (nbuckets = 1; nbuckets < max; nbuckets <<= 1)
+		;
+
+	for (i = 0; i < RESPCACHE_SHARDS; i++) {
+		shard = &rc->shards[i];
+		result = isc_mutex_init(&shard->lock);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		shard->buckets = isc_mem_get(mctx, nbuckets *
+					     sizeof(*shard->buckets));
+		if (shard->buckets == NULL) {
+			DESTROYLOCK(&shard->lock);
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+		for (j = 0; j < nbuckets; j++)
+			ISC_LIST_INIT(shard->buckets[j]);
+		ISC_LIST_INIT(shard->lru);
+		shard->nbuckets = nbuckets;
+		shard->max = max;
+		shard->count = 0;
+	}
+
+	isc_mem_attach(mctx, &rc->mctx);
+	rc->magic = RESPCACHE_MAGIC;
+	*rcp = rc;
+	return (ISC_R_SUCCESS);
+
+ cleanup:
+	while (i-- > 0) {
+		shard = &rc->shards[i];
+		isc_mem_put(mctx, shard->buckets,
+			    shard->nbuckets * sizeof(*shard->buckets));
+		DESTROYLOCK(&shard->lock);
+	}
+	isc_mem_put(mctx, rc, sizeof(*rc));
+	return (result);
+}
+
+void
+dns_respcache_destroy(dns_respcache_t **rcp) {
+	dns_respcache_t *rc;
+	respcacheshard_t *shard;
+	dns_rcentrylist_t dead;
+	unsigned int i;
+
+	REQUIRE(rcp != NULL && VALID_RESPCACHE(*rcp));
+	rc = *rcp;
+	*rcp = NULL;
+
+	rc->magic = 0;
+	for (i = 0; i < RESPCACHE_SHARDS; i++) {
+		shard = &rc->shards[i];
+		ISC_LIST_INIT(dead);
+		flushshard(shard, &dead);
+		freeentries(rc, &dead);
+		isc_mem_put(rc->mctx, shard->buckets,
+			    shard->nbuckets * sizeof(*shard->buckets));
+		DESTROYLOCK(&shard->lock);
+	}
+	isc_mem_putanddetach(&rc->mctx, rc, sizeof(*rc));
+}
+
+isc_result_t
+dns_respcache_find(dns_respcache_t *rc, isc_region_t *key, dns_db_t *db,
+		   isc_uint32_t serial, isc_buffer_t *target,
+		   unsigned int *infop)
+{
+	respcacheshard_t *shard;
+	dns_rcentry_t *entry;
+	dns_rcentrylist_t dead;
+	isc_uint32_t hashval;
+	isc_region_t r;
+	isc_result_t result = ISC_R_NOTFOUND;
+
+	REQUIRE(VALID_RESPCACHE(rc));
+	REQUIRE(DNS_DB_VALID(db));
+	REQUIRE(ISC_BUFFER_VALID(target));
+	REQUIRE(infop != NULL);
+
+	ISC_LIST_INIT(dead);
+	hashval = isc_hash_function(key->base, key->length, ISC_TRUE, NULL);
+	shard = getshard(rc, hashval);
+	LOCK(&shard->lock);
+	entry = lookup(shard, hashval, key);
+	if (entry == NULL)
+		goto unlock;
+
+	if (entry->db != db || entry->serial != serial) {
+		/*
+		 * The zone has changed since this was rendered.
+		 */
+		unlinkentry(shard, entry, &dead);
+		goto unlock;
+	}
+
+	isc_buffer_availableregion(target, &r);
+	if (r.length < entry->wirelen) {
+		result = ISC_R_NOSPACE;
+		goto unlock;
+	}
+	memmove(r.base, ENTRY_WIRE(entry), entry->wirelen);
+	isc_buffer_add(target, entry->wirelen);
+	*infop = entry->info;
+
+	ISC_LIST_UNLINK(shard->lru, entry, lru);
+	ISC_LIST_PREPEND(shard->lru, entry, lru);
+	result = ISC_R_SUCCESS;
+
+ unlock:
+	UNLOCK(&shard->lock);
+	freeentries(rc, &dead);
+	return (result);
+}
+
+void
+dns_respcache_add(dns_respcache_t *rc, isc_region_t *key, dns_db_t *db,
+		  isc_uint32_t serial, unsigned int info, isc_region_t *wire)
+{
+	respcacheshard_t *shard;
+	dns_rcentry_t *entry, *old;
+	dns_rcentrylist_t dead;
+
+	REQUIRE(VALID_RESPCACHE(rc));
+	REQUIRE(DNS_DB_VALID(db));
+
+	if (key->length > DNS_RESPCACHE_MAXKEY ||
+	    wire->length > DNS_RESPCACHE_MAXWIRE)
+		return;
+
+	/*
+	 * Build the entry before taking the lock.
+	 */
+	entry = isc_mem_get(rc->mctx, sizeof(*entry) + key->length +
+			    wire->length);
+	if (entry == NULL)
+		return;
+	entry->hashval = isc_hash_function(key->base, key->length,
+					   ISC_TRUE, NULL);
+	entry->db = db;
+	entry->serial = serial;
+	entry->info = info;
+	entry->keylen = key->length;
+	entry->wirelen = wire->length;
+	memmove(ENTRY_KEY(entry), key->base, key->length);
+	memmove(ENTRY_WIRE(entry), wire->base, wire->length);
+	ISC_LINK_INIT(entry, hlink);
+	ISC_LINK_INIT(entry, lru);
+
+	ISC_LIST_INIT(dead);
+	shard = getshard(rc, entry->hashval);
+	LOCK(&shard->lock);
+	old = lookup(shard, entry->hashval, key);
+	if (old != NULL)
+		unlinkentry(shard, old, &dead);
+	if (shard->count >= shard->max)
+		unlinkentry(shard, ISC_LIST_TAIL(shard->lru), &dead);
+	ISC_LIST_PREPEND(*getbucket(shard, entry->hashval), entry, hlink);
+	ISC_LIST_PREPEND(shard->lru, entry, lru);
+	shard->count++;
+	UNLOCK(&shard->lock);
+	freeentries(rc, &dead);
+}
+
+void
+dns_respcache_flush(dns_respcache_t *rc) {
+	respcacheshard_t *shard;
+	dns_rcentrylist_t dead;
+	unsigned int i;
+
+	REQUIRE(VALID_RESPCACHE(rc));
+
+	for (i = 0; i < RESPCACHE_SHARDS; i++) {
+		shard = &rc->shards[i];
+		ISC_LIST_INIT(dead);
+		LOCK(&shard->lock);
+		flushshard(shard, &dead);
+		UNLOCK(&shard->lock);
+		freeentries(rc, &dead);
+	}
+}
+
+void
+dns_respcache_flushdb(dns_respcache_t *rc, dns_db_t *db) {
+	respcacheshard_t *shard;
+	dns_rcentry_t *entry, *next;
+	dns_rcentrylist_t dead;
+	unsigned int i;
+
+	REQUIRE(VALID_RESPCACHE(rc));
+	REQUIRE(DNS_DB_VALID(db));
+
+	for (i = 0; i < RESPCACHE_SHARDS; i++) {
+		shard = &rc->shards[i];
+		ISC_LIST_INIT(dead);
+		LOCK(&shard->lock);
+		for (entry = ISC_LIST_HEAD(shard->lru);
+		     entry != NULL;
+		     entry = next)
+		{
+			next = ISC_LIST_NEXT(entry, lru);
+			if (entry->db == db)
+				unlinkentry(shard, entry, &dead);
+		}
+		UNLOCK(&shard->lock);
+		freeentries(rc, &dead);
+	}
+}
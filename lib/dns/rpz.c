@@ -18,8 +18,10 @@
 #include <isc/rwlock.h>
 #include <isc/stdlib.h>
 #include <isc/string.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
+#include <dns/badcache.h>
 #include <dns/db.h>
 #include <dns/fixedname.h>
 #include <dns/log.h>
@@ -144,6 +146,20 @@ struct dns_rpz_nm_data {
 	dns_rpz_nm_zbits_t	wild;
 };
 
+/*
+ * A pending addition or deletion of a policy zone owner name.
+ */
+struct dns_rpz_change {
+	dns_rpz_num_t		rpz_num;
+	dns_rpz_type_t		rpz_type;
+	isc_boolean_t		add;
+	dns_name_t		name;
+	ISC_LINK(dns_rpz_change_t) link;
+};
+
+static isc_result_t
+commit_changes(dns_rpz_zones_t *rpzs);
+
 #if 0
 /*
  * Catch a name while debugging.
@@ -1422,6 +1438,19 @@ dns_rpz_new_zones(dns_rpz_zones_t **rpzsp, isc_mem_t *mctx) {
 		return (result);
 	}
 
+	result = dns_badcache_init(mctx, DNS_RPZ_NSIPCACHE_SIZE,
+				   &new->nsipcache);
+	if (result != ISC_R_SUCCESS) {
+		dns_rbt_destroy(&new->rbt);
+		isc_refcount_decrement(&new->refs, NULL);
+		isc_refcount_destroy(&new->refs);
+		DESTROYLOCK(&new->maint_lock);
+		isc_rwlock_destroy(&new->search_lock);
+		isc_mem_put(mctx, new, sizeof(*new));
+		return (result);
+	}
+
+	ISC_LIST_INIT(new->changes);
 	isc_mem_attach(mctx, &new->mctx);
 
 	*rpzsp = new;
@@ -1498,6 +1527,13 @@ rpz_detach(dns_rpz_zone_t **rpzp, dns_rpz_zones_t *rpzs) {
 	isc_mem_put(rpzs->mctx, rpz, sizeof(*rpz));
 }
 
+static void
+free_change(dns_rpz_zones_t *rpzs, dns_rpz_change_t *change) {
+	if (dns_name_dynamic(&change->name))
+		dns_name_free(&change->name, rpzs->mctx);
+	isc_mem_put(rpzs->mctx, change, sizeof(*change));
+}
+
 void
 dns_rpz_attach_rpzs(dns_rpz_zones_t *rpzs, dns_rpz_zones_t **rpzsp) {
 	REQUIRE(rpzsp != NULL && *rpzsp == NULL);
@@ -1512,6 +1548,7 @@ void
 dns_rpz_detach_rpzs(dns_rpz_zones_t **rpzsp) {
 	dns_rpz_zones_t *rpzs;
 	dns_rpz_zone_t *rpz;
+	dns_rpz_change_t *change;
 	dns_rpz_num_t rpz_num;
 	unsigned int refs;
 
@@ -1526,6 +1563,11 @@ dns_rpz_detach_rpzs(dns_rpz_zones_t **rpzsp) {
 	 * Forget the last of view's rpz machinery after the last reference.
 	 */
 	if (refs == 0) {
+		while ((change = ISC_LIST_HEAD(rpzs->changes)) != NULL) {
+			ISC_LIST_UNLINK(rpzs->changes, change, link);
+			free_change(rpzs, change);
+		}
+
 		for (rpz_num = 0; rpz_num < DNS_RPZ_MAX_ZONES; ++rpz_num) {
 			rpz = rpzs->zones[rpz_num];
 			rpzs->zones[rpz_num] = NULL;
@@ -1535,6 +1577,7 @@ dns_rpz_detach_rpzs(dns_rpz_zones_t **rpzsp) {
 
 		cidr_free(rpzs);
 		dns_rbt_destroy(&rpzs->rbt);
+		dns_badcache_destroy(&rpzs->nsipcache);
 		DESTROYLOCK(&rpzs->maint_lock);
 		isc_rwlock_destroy(&rpzs->search_lock);
 		isc_refcount_destroy(&rpzs->refs);
@@ -1611,6 +1654,111 @@ dns_rpz_beginload(dns_rpz_zones_t **load_rpzsp,
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * Copy the triggers of the policy zones in 'keep' from the summary
+ * databases of 'from' into those of 'to'.  The trigger counts are not
+ * changed.  The caller must hold the maint_lock of 'from' and keep
+ * searches away from 'to'.
+ */
+static isc_result_t
+copy_summary(dns_rpz_zones_t *from, dns_rpz_zones_t *to,
+	     dns_rpz_zbits_t keep)
+{
+	const dns_rpz_cidr_node_t *cnode, *next_cnode, *parent_cnode;
+	dns_rpz_cidr_node_t *found;
+	dns_rpz_addr_zbits_t new_ip;
+	dns_rbtnodechain_t chain;
+	dns_rbtnode_t *nmnode;
+	dns_rpz_nm_data_t *nm_data, new_data;
+	dns_fixedname_t labelf, originf, namef;
+	dns_name_t *label, *origin, *name;
+	isc_result_t result;
+
+	/*
+	 * Copy to the radix tree.
+	 */
+	for (cnode = from->cidr; cnode != NULL; cnode = next_cnode) {
+		new_ip.ip = cnode->set.ip & keep;
+		new_ip.client_ip = cnode->set.client_ip & keep;
+		new_ip.nsip = cnode->set.nsip & keep;
+		if (new_ip.client_ip != 0 ||
+		    new_ip.ip != 0 ||
+		    new_ip.nsip != 0) {
+			result = search(to, &cnode->ip, cnode->prefix,
+					&new_ip, ISC_TRUE, &found);
+			if (result == ISC_R_NOMEMORY)
+				return (result);
+			INSIST(result == ISC_R_SUCCESS);
+		}
+		/*
+		 * Do down and to the left as far as possible.
+		 */
+		next_cnode = cnode->child[0];
+		if (next_cnode != NULL)
+			continue;
+		/*
+		 * Go up until we find a branch to the right where
+		 * we previously took the branch to the left.
+		 */
+		for (;;) {
+			parent_cnode = cnode->parent;
+			if (parent_cnode == NULL)
+				break;
+			if (parent_cnode->child[0] == cnode) {
+				next_cnode = parent_cnode->child[1];
+				if (next_cnode != NULL)
+				    break;
+			}
+			cnode = parent_cnode;
+		}
+	}
+
+	/*
+	 * Copy to the summary RBT.
+	 */
+	dns_fixedname_init(&namef);
+	name = dns_fixedname_name(&namef);
+	dns_fixedname_init(&labelf);
+	label = dns_fixedname_name(&labelf);
+	dns_fixedname_init(&originf);
+	origin = dns_fixedname_name(&originf);
+	dns_rbtnodechain_init(&chain, NULL);
+	result = dns_rbtnodechain_first(&chain, from->rbt, NULL, NULL);
+	while (result == DNS_R_NEWORIGIN || result == ISC_R_SUCCESS) {
+		result = dns_rbtnodechain_current(&chain, label, origin,
+						&nmnode);
+		INSIST(result == ISC_R_SUCCESS);
+		nm_data = nmnode->data;
+		if (nm_data != NULL) {
+			new_data.set.qname = nm_data->set.qname & keep;
+			new_data.set.ns = nm_data->set.ns & keep;
+			new_data.wild.qname = nm_data->wild.qname & keep;
+			new_data.wild.ns = nm_data->wild.ns & keep;
+			if (new_data.set.qname != 0 ||
+			    new_data.set.ns != 0 ||
+			    new_data.wild.qname != 0 ||
+			    new_data.wild.ns != 0) {
+				result = dns_name_concatenate(label, origin,
+							      name, NULL);
+				INSIST(result == ISC_R_SUCCESS);
+				result = add_nm(to, name, &new_data);
+				if (result != ISC_R_SUCCESS)
+					return (result);
+			}
+		}
+		result = dns_rbtnodechain_next(&chain, NULL, NULL);
+	}
+	if (result != ISC_R_NOMORE && result != ISC_R_NOTFOUND) {
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
+			      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
+			      "rpz copy_summary(): unexpected %s",
+			      isc_result_totext(result));
+		return (result);
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
 /*
  * This function updates "have" bits and also the qname_skip_recurse
  * mask. It must be called when holding a write lock on rpzs->search_lock.
@@ -1724,16 +1872,8 @@ dns_rpz_ready(dns_rpz_zones_t *rpzs,
 	      dns_rpz_zones_t **load_rpzsp, dns_rpz_num_t rpz_num)
 {
 	dns_rpz_zones_t *load_rpzs;
-	const dns_rpz_cidr_node_t *cnode, *next_cnode, *parent_cnode;
 	dns_rpz_cidr_node_t *found;
-	dns_rpz_zbits_t new_bit;
-	dns_rpz_addr_zbits_t new_ip;
 	dns_rbt_t *rbt;
-	dns_rbtnodechain_t chain;
-	dns_rbtnode_t *nmnode;
-	dns_rpz_nm_data_t *nm_data, new_data;
-	dns_fixedname_t labelf, originf, namef;
-	dns_name_t *label, *origin, *name;
 	isc_result_t result;
 
 	INSIST(rpzs != NULL);
@@ -1741,6 +1881,12 @@ dns_rpz_ready(dns_rpz_zones_t *rpzs,
 	load_rpzs = *load_rpzsp;
 	INSIST(load_rpzs != NULL);
 
+	/*
+	 * The merge below reads the live summary databases, so bring
+	 * them up to date first.
+	 */
+	result = commit_changes(rpzs);
+
 	if (load_rpzs == rpzs) {
 		/*
 		 * This is a successful initial zone loading, perhaps
@@ -1748,107 +1894,38 @@ dns_rpz_ready(dns_rpz_zones_t *rpzs,
 		 */
 		RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
 		fix_triggers(rpzs, rpz_num);
+		rpzs->generation++;
 		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
 		UNLOCK(&rpzs->maint_lock);
 		dns_rpz_detach_rpzs(load_rpzsp);
-		return (ISC_R_SUCCESS);
+		return (result);
+	}
+
+	if (result != ISC_R_SUCCESS) {
+		/*
+		 * These changes belong to other versions, and failing
+		 * this load would not undo them, so merely complain.
+		 */
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
+			      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
+			      "rpz commit of pending changes failed: %s",
+			      isc_result_totext(result));
 	}
 
 	LOCK(&load_rpzs->maint_lock);
+	result = commit_changes(load_rpzs);
 	RWLOCK(&load_rpzs->search_lock, isc_rwlocktype_write);
+	if (result != ISC_R_SUCCESS)
+		goto unlock_and_detach;
 
 	/*
 	 * Unless there is only one policy zone, copy the other policy zones
 	 * from the old policy structure to the new summary databases.
 	 */
 	if (rpzs->p.num_zones > 1) {
-		new_bit = ~DNS_RPZ_ZBIT(rpz_num);
-
-		/*
-		 * Copy to the radix tree.
-		 */
-		for (cnode = rpzs->cidr; cnode != NULL; cnode = next_cnode) {
-			new_ip.ip = cnode->set.ip & new_bit;
-			new_ip.client_ip = cnode->set.client_ip & new_bit;
-			new_ip.nsip = cnode->set.nsip & new_bit;
-			if (new_ip.client_ip != 0 ||
-			    new_ip.ip != 0 ||
-			    new_ip.nsip != 0) {
-				result = search(load_rpzs,
-						&cnode->ip, cnode->prefix,
-						&new_ip, ISC_TRUE, &found);
-				if (result == ISC_R_NOMEMORY)
-					goto unlock_and_detach;
-				INSIST(result == ISC_R_SUCCESS);
-			}
-			/*
-			 * Do down and to the left as far as possible.
-			 */
-			next_cnode = cnode->child[0];
-			if (next_cnode != NULL)
-				continue;
-			/*
-			 * Go up until we find a branch to the right where
-			 * we previously took the branch to the left.
-			 */
-			for (;;) {
-				parent_cnode = cnode->parent;
-				if (parent_cnode == NULL)
-					break;
-				if (parent_cnode->child[0] == cnode) {
-					next_cnode = parent_cnode->child[1];
-					if (next_cnode != NULL)
-					    break;
-				}
-				cnode = parent_cnode;
-			}
-		}
-
-		/*
-		 * Copy to the summary RBT.
-		 */
-		dns_fixedname_init(&namef);
-		name = dns_fixedname_name(&namef);
-		dns_fixedname_init(&labelf);
-		label = dns_fixedname_name(&labelf);
-		dns_fixedname_init(&originf);
-		origin = dns_fixedname_name(&originf);
-		dns_rbtnodechain_init(&chain, NULL);
-		result = dns_rbtnodechain_first(&chain, rpzs->rbt, NULL, NULL);
-		while (result == DNS_R_NEWORIGIN || result == ISC_R_SUCCESS) {
-			result = dns_rbtnodechain_current(&chain, label, origin,
-							&nmnode);
-			INSIST(result == ISC_R_SUCCESS);
-			nm_data = nmnode->data;
-			if (nm_data != NULL) {
-				new_data.set.qname = (nm_data->set.qname &
-						      new_bit);
-				new_data.set.ns = nm_data->set.ns & new_bit;
-				new_data.wild.qname = (nm_data->wild.qname &
-						       new_bit);
-				new_data.wild.ns = nm_data->wild.ns & new_bit;
-				if (new_data.set.qname != 0 ||
-				    new_data.set.ns != 0 ||
-				    new_data.wild.qname != 0 ||
-				    new_data.wild.ns != 0) {
-					result = dns_name_concatenate(label,
-							origin, name, NULL);
-					INSIST(result == ISC_R_SUCCESS);
-					result = add_nm(load_rpzs, name,
-							&new_data);
-					if (result != ISC_R_SUCCESS)
-						goto unlock_and_detach;
-				}
-			}
-			result = dns_rbtnodechain_next(&chain, NULL, NULL);
-		}
-		if (result != ISC_R_NOMORE && result != ISC_R_NOTFOUND) {
-			isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
-				      DNS_LOGMODULE_RBTDB, DNS_RPZ_ERROR_LEVEL,
-				      "dns_rpz_ready(): unexpected %s",
-				      isc_result_totext(result));
+		result = copy_summary(rpzs, load_rpzs, ~DNS_RPZ_ZBIT(rpz_num));
+		if (result != ISC_R_SUCCESS)
 			goto unlock_and_detach;
-		}
 	}
 
 	/*
@@ -1866,6 +1943,7 @@ dns_rpz_ready(dns_rpz_zones_t *rpzs,
 	rbt = rpzs->rbt;
 	rpzs->rbt = load_rpzs->rbt;
 	load_rpzs->rbt = rbt;
+	rpzs->generation++;
 
 	RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
 
@@ -1879,44 +1957,6 @@ dns_rpz_ready(dns_rpz_zones_t *rpzs,
 	return (result);
 }
 
-/*
- * Add an IP address to the radix tree or a name to the summary database.
- */
-isc_result_t
-dns_rpz_add(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_name_t *src_name)
-{
-	dns_rpz_zone_t *rpz;
-	dns_rpz_type_t rpz_type;
-	isc_result_t result = ISC_R_FAILURE;
-
-	REQUIRE(rpzs != NULL && rpz_num < rpzs->p.num_zones);
-	rpz = rpzs->zones[rpz_num];
-	REQUIRE(rpz != NULL);
-
-	rpz_type = type_from_name(rpz, src_name);
-
-	LOCK(&rpzs->maint_lock);
-	RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
-
-	switch (rpz_type) {
-	case DNS_RPZ_TYPE_QNAME:
-	case DNS_RPZ_TYPE_NSDNAME:
-		result = add_name(rpzs, rpz_num, rpz_type, src_name);
-		break;
-	case DNS_RPZ_TYPE_CLIENT_IP:
-	case DNS_RPZ_TYPE_IP:
-	case DNS_RPZ_TYPE_NSIP:
-		result = add_cidr(rpzs, rpz_num, rpz_type, src_name);
-		break;
-	case DNS_RPZ_TYPE_BAD:
-		break;
-	}
-
-	RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
-	UNLOCK(&rpzs->maint_lock);
-	return (result);
-}
-
 /*
  * Remove an IP address from the radix tree.
  */
@@ -2083,40 +2123,268 @@ del_name(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 	adj_trigger_cnt(rpzs, rpz_num, rpz_type, NULL, 0, ISC_FALSE);
 }
 
+/*
+ * Add or remove one trigger in the summary databases of 'rpzs'.
+ */
+static isc_result_t
+apply_change(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
+	     dns_rpz_type_t rpz_type, isc_boolean_t add, dns_name_t *src_name)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+
+	switch (rpz_type) {
+	case DNS_RPZ_TYPE_QNAME:
+	case DNS_RPZ_TYPE_NSDNAME:
+		if (add)
+			result = add_name(rpzs, rpz_num, rpz_type, src_name);
+		else
+			del_name(rpzs, rpz_num, rpz_type, src_name);
+		break;
+	case DNS_RPZ_TYPE_CLIENT_IP:
+	case DNS_RPZ_TYPE_IP:
+	case DNS_RPZ_TYPE_NSIP:
+		if (add)
+			result = add_cidr(rpzs, rpz_num, rpz_type, src_name);
+		else
+			del_cidr(rpzs, rpz_num, rpz_type, src_name);
+		break;
+	case DNS_RPZ_TYPE_BAD:
+		if (add)
+			result = ISC_R_FAILURE;
+		break;
+	}
+
+	return (result);
+}
+
+/*
+ * Apply the pending changes of 'rpzs' to the summary databases of
+ * 'target', which is either 'rpzs' itself or its next generation.
+ * Every change is applied; the first failure is returned.
+ */
+static isc_result_t
+drain_changes(dns_rpz_zones_t *rpzs, dns_rpz_zones_t *target) {
+	char namebuf[DNS_NAME_FORMATSIZE];
+	dns_rpz_change_t *change;
+	isc_result_t result, tresult;
+
+	result = ISC_R_SUCCESS;
+	while ((change = ISC_LIST_HEAD(rpzs->changes)) != NULL) {
+		ISC_LIST_UNLINK(rpzs->changes, change, link);
+		tresult = apply_change(target, change->rpz_num,
+				       change->rpz_type, change->add,
+				       &change->name);
+		if (tresult != ISC_R_SUCCESS) {
+			dns_name_format(&change->name, namebuf,
+					sizeof(namebuf));
+			isc_log_write(dns_lctx, DNS_LOGCATEGORY_RPZ,
+				      DNS_LOGMODULE_RBTDB,
+				      DNS_RPZ_DEBUG_LEVEL1,
+				      "rpz add(%s) failed: %s",
+				      namebuf, isc_result_totext(tresult));
+			if (result == ISC_R_SUCCESS)
+				result = tresult;
+		}
+		free_change(rpzs, change);
+	}
+	rpzs->nchanges = 0;
+	return (result);
+}
+
+/*
+ * Start the next generation of the summary databases as a copy of the
+ * live ones.  Searches continue on the live databases meanwhile.
+ * The caller must hold rpzs->maint_lock, which keeps the live
+ * databases from changing.
+ */
+static isc_result_t
+begin_generation(dns_rpz_zones_t *rpzs, dns_rpz_zones_t **nextp) {
+	dns_rpz_zones_t *next = NULL;
+	dns_rpz_num_t rpz_num;
+	isc_result_t result;
+
+	result = dns_rpz_new_zones(&next, rpzs->mctx);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	next->p = rpzs->p;
+	for (rpz_num = 0; rpz_num < DNS_RPZ_MAX_ZONES; ++rpz_num) {
+		if (rpzs->zones[rpz_num] == NULL)
+			continue;
+		isc_refcount_increment(&rpzs->zones[rpz_num]->refs, NULL);
+		next->zones[rpz_num] = rpzs->zones[rpz_num];
+	}
+	memmove(next->triggers, rpzs->triggers, sizeof(next->triggers));
+	next->have = rpzs->have;
+
+	result = copy_summary(rpzs, next, DNS_RPZ_ALL_ZBITS);
+	if (result != ISC_R_SUCCESS) {
+		dns_rpz_detach_rpzs(&next);
+		return (result);
+	}
+
+	*nextp = next;
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Make the pending changes visible to searches.
+ * The caller must hold rpzs->maint_lock.
+ */
+static isc_result_t
+commit_changes(dns_rpz_zones_t *rpzs) {
+	dns_rpz_zones_t *next = NULL;
+	dns_rpz_cidr_node_t *cidr;
+	dns_rbt_t *rbt;
+	isc_result_t result;
+
+	if (ISC_LIST_EMPTY(rpzs->changes))
+		return (ISC_R_SUCCESS);
+
+	/*
+	 * A small batch is applied in place under the write lock.
+	 * Rather than hold the search lock while applying a large one,
+	 * such as an IXFR of a busy feed, build the next generation of
+	 * the summary databases on the side and swap it in.
+	 */
+	if (rpzs->nchanges < DNS_RPZ_MAX_CHANGES ||
+	    begin_generation(rpzs, &next) != ISC_R_SUCCESS)
+	{
+		RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+		result = drain_changes(rpzs, rpzs);
+		rpzs->generation++;
+		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+		return (result);
+	}
+
+	result = drain_changes(rpzs, next);
+
+	RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+
+	memmove(rpzs->triggers, next->triggers, sizeof(rpzs->triggers));
+	rpzs->have = next->have;
+
+	cidr = rpzs->cidr;
+	rpzs->cidr = next->cidr;
+	next->cidr = cidr;
+
+	rbt = rpzs->rbt;
+	rpzs->rbt = next->rbt;
+	next->rbt = rbt;
+	rpzs->generation++;
+
+	RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+
+	/*
+	 * Free the old generation without blocking searches.
+	 */
+	dns_rpz_detach_rpzs(&next);
+	return (result);
+}
+
+/*
+ * Record a change to be made visible by the next commit.
+ * The caller must hold rpzs->maint_lock.
+ */
+static isc_result_t
+queue_change(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
+	     dns_rpz_type_t rpz_type, isc_boolean_t add, dns_name_t *src_name)
+{
+	dns_rpz_change_t *change;
+	isc_result_t result;
+
+	change = isc_mem_get(rpzs->mctx, sizeof(*change));
+	if (change == NULL)
+		return (ISC_R_NOMEMORY);
+	change->rpz_num = rpz_num;
+	change->rpz_type = rpz_type;
+	change->add = add;
+	dns_name_init(&change->name, NULL);
+	result = dns_name_dup(src_name, rpzs->mctx, &change->name);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(rpzs->mctx, change, sizeof(*change));
+		return (result);
+	}
+	ISC_LINK_INIT(change, link);
+	ISC_LIST_APPEND(rpzs->changes, change, link);
+	rpzs->nchanges++;
+
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Add an IP address to the radix tree or a name to the summary database.
+ * The change becomes visible to searches at the next dns_rpz_commit().
+ */
+isc_result_t
+dns_rpz_add(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num, dns_name_t *src_name)
+{
+	dns_rpz_zone_t *rpz;
+	dns_rpz_type_t rpz_type;
+	isc_result_t result;
+
+	REQUIRE(rpzs != NULL && rpz_num < rpzs->p.num_zones);
+	rpz = rpzs->zones[rpz_num];
+	REQUIRE(rpz != NULL);
+
+	rpz_type = type_from_name(rpz, src_name);
+	if (rpz_type == DNS_RPZ_TYPE_BAD)
+		return (ISC_R_FAILURE);
+
+	LOCK(&rpzs->maint_lock);
+	result = queue_change(rpzs, rpz_num, rpz_type, ISC_TRUE, src_name);
+	UNLOCK(&rpzs->maint_lock);
+	return (result);
+}
+
 /*
  * Remove an IP address from the radix tree or a name from the summary database.
+ * The change becomes visible to searches at the next dns_rpz_commit().
  */
 void
 dns_rpz_delete(dns_rpz_zones_t *rpzs, dns_rpz_num_t rpz_num,
 	       dns_name_t *src_name) {
 	dns_rpz_zone_t *rpz;
 	dns_rpz_type_t rpz_type;
+	isc_result_t result;
 
 	REQUIRE(rpzs != NULL && rpz_num < rpzs->p.num_zones);
 	rpz = rpzs->zones[rpz_num];
 	REQUIRE(rpz != NULL);
 
 	rpz_type = type_from_name(rpz, src_name);
+	if (rpz_type == DNS_RPZ_TYPE_BAD)
+		return;
 
 	LOCK(&rpzs->maint_lock);
-	RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
-
-	switch (rpz_type) {
-	case DNS_RPZ_TYPE_QNAME:
-	case DNS_RPZ_TYPE_NSDNAME:
-		del_name(rpzs, rpz_num, rpz_type, src_name);
-		break;
-	case DNS_RPZ_TYPE_CLIENT_IP:
-	case DNS_RPZ_TYPE_IP:
-	case DNS_RPZ_TYPE_NSIP:
-		del_cidr(rpzs, rpz_num, rpz_type, src_name);
-		break;
-	case DNS_RPZ_TYPE_BAD:
-		break;
+	result = queue_change(rpzs, rpz_num, rpz_type, ISC_FALSE, src_name);
+	if (result != ISC_R_SUCCESS) {
+		/*
+		 * Without memory to remember the deletion, apply it now.
+		 */
+		(void)commit_changes(rpzs);
+		RWLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+		(void)apply_change(rpzs, rpz_num, rpz_type, ISC_FALSE,
+				   src_name);
+		rpzs->generation++;
+		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
 	}
+	UNLOCK(&rpzs->maint_lock);
+}
 
-	RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_write);
+/*
+ * Make the queued additions and deletions visible to searches.
+ */
+isc_result_t
+dns_rpz_commit(dns_rpz_zones_t *rpzs) {
+	isc_result_t result;
+
+	REQUIRE(rpzs != NULL);
+
+	LOCK(&rpzs->maint_lock);
+	result = commit_changes(rpzs);
 	UNLOCK(&rpzs->maint_lock);
+	return (result);
 }
 
 /*
@@ -2140,9 +2408,14 @@ dns_rpz_find_ip(dns_rpz_zones_t *rpzs, dns_rpz_type_t rpz_type,
 	dns_rpz_have_t have;
 	int i;
 
-	LOCK(&rpzs->maint_lock);
+	/*
+	 * The trigger bits only change with the search lock held for
+	 * writing, so read them under the same read lock as the tree
+	 * instead of serializing every lookup on the maintenance lock,
+	 * which is held for the whole of a policy zone reload.
+	 */
+	RWLOCK(&rpzs->search_lock, isc_rwlocktype_read);
 	have = rpzs->have;
-	UNLOCK(&rpzs->maint_lock);
 
 	/*
 	 * Convert IP address to CIDR tree key.
@@ -2193,14 +2466,16 @@ dns_rpz_find_ip(dns_rpz_zones_t *rpzs, dns_rpz_type_t rpz_type,
 			break;
 		}
 	} else {
+		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_read);
 		return (DNS_RPZ_INVALID_NUM);
 	}
 
-	if (zbits == 0)
+	if (zbits == 0) {
+		RWUNLOCK(&rpzs->search_lock, isc_rwlocktype_read);
 		return (DNS_RPZ_INVALID_NUM);
+	}
 	make_addr_set(&tgt_set, zbits, rpz_type);
 
-	RWLOCK(&rpzs->search_lock, isc_rwlocktype_read);
 	result = search(rpzs, &tgt_ip, 128, &tgt_set, ISC_FALSE, &found);
 	if (result == ISC_R_NOTFOUND) {
 		/*
@@ -2311,6 +2586,50 @@ dns_rpz_find_name(dns_rpz_zones_t *rpzs, dns_rpz_type_t rpz_type,
 	return (zbits & found_zbits);
 }
 
+/*
+ * Check whether the 'type' addresses of the name server 'nsname' are
+ * known to match no NSIP trigger in 'generation' of the summary data.
+ */
+isc_boolean_t
+dns_rpz_find_cleanns(dns_rpz_zones_t *rpzs, dns_name_t *nsname,
+		     dns_rdatatype_t type, isc_uint32_t generation)
+{
+	isc_uint32_t found;
+	isc_time_t now;
+
+	REQUIRE(rpzs != NULL);
+
+	TIME_NOW(&now);
+	if (!dns_badcache_find(rpzs->nsipcache, nsname, type, &found, &now))
+		return (ISC_FALSE);
+	return (ISC_TF(found == generation));
+}
+
+/*
+ * Remember for 'ttl' seconds that none of the 'type' addresses of the
+ * name server 'nsname' matched an NSIP trigger in 'generation'.
+ */
+void
+dns_rpz_add_cleanns(dns_rpz_zones_t *rpzs, dns_name_t *nsname,
+		    dns_rdatatype_t type, isc_uint32_t generation,
+		    dns_ttl_t ttl)
+{
+	isc_interval_t i;
+	isc_time_t now, expire;
+
+	REQUIRE(rpzs != NULL);
+
+	if (ttl == 0)
+		return;
+
+	TIME_NOW(&now);
+	isc_interval_set(&i, ISC_MIN(ttl, DNS_RPZ_NSIPCACHE_TTL), 0);
+	if (isc_time_add(&now, &i, &expire) != ISC_R_SUCCESS)
+		return;
+	dns_badcache_add(rpzs->nsipcache, nsname, type, ISC_TRUE,
+			 generation, &expire);
+}
+
 /*
  * Translate CNAME rdata to a QNAME response policy action.
  */
@@ -1422,7 +1422,6 @@ static dns_rdatasetmethods_t methods = {
 	NULL,
 	NULL,
 	NULL,
-	NULL,
 	NULL
 };
 
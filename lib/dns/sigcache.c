@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <isc/buffer.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/serial.h>
+#include <isc/sha2.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdataset.h>
+#include <dns/sigcache.h>
+
+#include <dst/dst.h>
+
+#define SIGCACHE_MAGIC			ISC_MAGIC('S', 'g', 'C', 'a')
+#define VALID_SIGCACHE(m)		ISC_MAGIC_VALID(m, SIGCACHE_MAGIC)
+
+/*%
+ * Number of independently locked shards.  Must be a power of two.
+ */
+#define SIGCACHE_SHARDS			16U
+
+typedef struct dns_scentry dns_scentry_t;
+
+struct dns_scentry {
+	unsigned char			digest[DNS_SIGCACHE_DIGESTLENGTH];
+	isc_uint32_t			timesigned;
+	isc_uint32_t			timeexpire;
+	isc_uint32_t			cost;
+	ISC_LINK(dns_scentry_t)		hlink;
+	ISC_LINK(dns_scentry_t)		lru;
+};
+
+typedef ISC_LIST(dns_scentry_t) dns_scentrylist_t;
+
+typedef struct sigcacheshard {
+	isc_mutex_t			lock;
+	unsigned int			count;
+	unsigned int			max;
+	unsigned int			nbuckets;	/*%< power of two */
+	dns_scentrylist_t		*buckets;
+	dns_scentrylist_t		lru;		/*%< head is newest */
+} sigcacheshard_t;
+
+struct dns_sigcache {
+	unsigned int			magic;
+	isc_mem_t			*mctx;
+	sigcacheshard_t			shards[SIGCACHE_SHARDS];
+};
+
+/*
+ * The digest is uniformly distributed, so its leading octets serve as
+ * the shard and bucket index directly.
+ */
+static inline sigcacheshard_t *
+getshard(dns_sigcache_t *sc, const unsigned char *digest) {
+	return (&sc->shards[digest[0] & (SIGCACHE_SHARDS - 1)]);
+}
+
+static inline dns_scentrylist_t *
+getbucket(sigcacheshard_t *shard, const unsigned char *digest) {
+	isc_uint32_t h;
+
+	h = (digest[1] << 24) | (digest[2] << 16) | (digest[3] << 8) |
+	    digest[4];
+	return (&shard->buckets[h & (shard->nbuckets - 1)]);
+}
+
+static void
+flushshard(dns_sigcache_t *sc, sigcacheshard_t *shard) {
+	dns_scentry_t *entry;
+
+	while ((entry = ISC_LIST_HEAD(shard->lru)) != NULL) {
+		ISC_LIST_UNLINK(shard->lru, entry, lru);
+		ISC_LIST_UNLINK(*getbucket(shard, entry->digest),
+				entry, hlink);
+		isc_mem_put(sc->mctx, entry, sizeof(*entry));
+	}
+	shard->count = 0;
+}
+
+isc_result_t
+dns_sigcache_create(isc_mem_t *mctx, unsigned int size,
+		    dns_sigcache_t **scp)
+{
+	isc_result_t result;
+	dns_sigcache_t *sc;
+	sigcacheshard_t *shard;
+	unsigned int i, j, max, nbuckets;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(size > 0);
+	REQUIRE(scp != NULL && *scp == NULL);
+
+	sc = isc_mem_get(mctx, sizeof(*sc));
+	if (sc == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(sc, 0, sizeof(*sc));
+
+	max = (size + SIGCACHE_SHARDS - 1) / SIGCACHE_SHARDS;
+	for (nbuckets = 1; nbuckets < max; nbuckets <<= 1)
+		;
+
+	for (i = 0; i < SIGCACHE_SHARDS; i++) {
+		shard = &sc->shards[i];
+		result = isc_mutex_init(&shard->lock);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+		shard->buckets = isc_mem_get(mctx, nbuckets *
+					     sizeof(*shard->buckets));
+		if (shard->buckets == NULL) {
+			DESTROYLOCK(&shard->lock);
+			result = ISC_R_NOMEMORY;
+			goto cleanup;
+		}
+		for (j = 0; j < nbuckets; j++)
+			ISC_LIST_INIT(shard->buckets[j]);
+		ISC_LIST_INIT(shard->lru);
+		shard->nbuckets = nbuckets;
+		shard->max = max;
+		shard->count = 0;
+	}
+
+	isc_mem_attach(mctx, &sc->mctx);
+	sc->magic = SIGCACHE_MAGIC;
+	*scp = sc;
+	return (ISC_R_SUCCESS);
+
+ cleanup:
+	while (i-- > 0) {
+		shard = &sc->shards[i];
+		isc_mem_put(mctx, shard->buckets,
+			    shard->nbuckets * sizeof(*shard->buckets));
+		DESTROYLOCK(&shard->lock);
+	}
+	isc_mem_put(mctx, sc, sizeof(*sc));
+	return (result);
+}
+
+void
+dns_sigcache_destroy(dns_sigcache_t **scp) {
+	dns_sigcache_t *sc;
+	sigcacheshard_t *shard;
+	unsigned int i;
+
+	REQUIRE(scp != NULL && VALID_SIGCACHE(*scp));
+	sc = *scp;
+	*scp = NULL;
+
+	sc->magic = 0;
+	for (i = 0; i < SIGCACHE_SHARDS; i++) {
+		shard = &sc->shards[i];
+		flushshard(sc, shard);
+		isc_mem_put(sc->mctx, shard->buckets,
+			    shard->nbuckets * sizeof(*shard->buckets));
+		DESTROYLOCK(&shard->lock);
+	}
+	isc_mem_putanddetach(&sc->mctx, sc, sizeof(*sc));
+}
+
+static void
+digest_region(isc_sha256_t *ctx, isc_region_t *r) {
+	unsigned char len[2];
+
+	INSIST(r->length <= 0xffff);
+	len[0] = (r->length >> 8) & 0xff;
+	len[1] = r->length & 0xff;
+	isc_sha256_update(ctx, len, sizeof(len));
+	isc_sha256_update(ctx, r->base, r->length);
+}
+
+isc_result_t
+dns_sigcache_digest(dns_name_t *name, dns_rdataset_t *rdataset,
+		    dst_key_t *key, unsigned int maxbits,
+		    dns_rdata_t *sigrdata,
+		    unsigned char digest[DNS_SIGCACHE_DIGESTLENGTH])
+{
+	isc_sha256_t ctx;
+	isc_result_t result;
+	isc_buffer_t b;
+	isc_region_t r;
+	unsigned char keydata[DST_KEY_MAXSIZE];
+	unsigned char hdr[8];
+
+	REQUIRE(DNS_RDATASET_VALID(rdataset));
+	REQUIRE(sigrdata != NULL && sigrdata->type == dns_rdatatype_rrsig);
+
+	isc_buffer_init(&b, keydata, sizeof(keydata));
+	result = dst_key_todns(key, &b);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	isc_sha256_init(&ctx);
+
+	/* Class, type and the bit limit the verification was subject to. */
+	hdr[0] = (rdataset->rdclass >> 8) & 0xff;
+	hdr[1] = rdataset->rdclass & 0xff;
+	hdr[2] = (rdataset->type >> 8) & 0xff;
+	hdr[3] = rdataset->type & 0xff;
+	hdr[4] = (maxbits >> 24) & 0xff;
+	hdr[5] = (maxbits >> 16) & 0xff;
+	hdr[6] = (maxbits >> 8) & 0xff;
+	hdr[7] = maxbits & 0xff;
+	isc_sha256_update(&ctx, hdr, sizeof(hdr));
+
+	dns_name_toregion(name, &r);
+	digest_region(&ctx, &r);
+	dns_name_toregion(dst_key_name(key), &r);
+	digest_region(&ctx, &r);
+	isc_buffer_usedregion(&b, &r);
+	digest_region(&ctx, &r);
+	dns_rdata_toregion(sigrdata, &r);
+	digest_region(&ctx, &r);
+
+	hdr[0] = (dns_rdataset_count(rdataset) >> 8) & 0xff;
+	hdr[1] = dns_rdataset_count(rdataset) & 0xff;
+	isc_sha256_update(&ctx, hdr, 2);
+	for (result = dns_rdataset_first(rdataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(rdataset))
+	{
+		dns_rdata_t rdata = DNS_RDATA_INIT;
+
+		dns_rdataset_current(rdataset, &rdata);
+		dns_rdata_toregion(&rdata, &r);
+		digest_region(&ctx, &r);
+	}
+
+	isc_sha256_final(digest, &ctx);
+	return (ISC_R_SUCCESS);
+}
+
+isc_boolean_t
+dns_sigcache_find(dns_sigcache_t *sc,
+		  const unsigned char digest[DNS_SIGCACHE_DIGESTLENGTH],
+		  isc_stdtime_t now, isc_uint32_t *costp)
+{
+	sigcacheshard_t *shard;
+	dns_scentrylist_t *bucket;
+	dns_scentry_t *entry;
+	isc_boolean_t found = ISC_FALSE;
+
+	REQUIRE(VALID_SIGCACHE(sc));
+
+	shard = getshard(sc, digest);
+	LOCK(&shard->lock);
+	bucket = getbucket(shard, digest);
+	for (entry = ISC_LIST_HEAD(*bucket);
+	     entry != NULL;
+	     entry = ISC_LIST_NEXT(entry, hlink))
+	{
+		if (memcmp(entry->digest, digest, sizeof(entry->digest)) == 0)
+			break;
+	}
+	if (entry != NULL) {
+		if (isc_serial_lt((isc_uint32_t)now, entry->timesigned) ||
+		    isc_serial_lt(entry->timeexpire, (isc_uint32_t)now))
+		{
+			/*
+			 * Out of its validity period; the verifier will
+			 * report why.
+			 */
+			ISC_LIST_UNLINK(*bucket, entry, hlink);
+			ISC_LIST_UNLINK(shard->lru, entry, lru);
+			isc_mem_put(sc->mctx, entry, sizeof(*entry));
+			shard->count--;
+		} else {
+			ISC_LIST_UNLINK(shard->lru, entry, lru);
+			ISC_LIST_PREPEND(shard->lru, entry, lru);
+			if (costp != NULL)
+				*costp = entry->cost;
+			found = ISC_TRUE;
+		}
+	}
+	UNLOCK(&shard->lock);
+
+	return (found);
+}
+
+void
+dns_sigcache_add(dns_sigcache_t *sc,
+		 const unsigned char digest[DNS_SIGCACHE_DIGESTLENGTH],
+		 isc_uint32_t timesigned, isc_uint32_t timeexpire,
+		 isc_uint32_t cost)
+{
+	sigcacheshard_t *shard;
+	dns_scentrylist_t *bucket;
+	dns_scentry_t *entry;
+
+	REQUIRE(VALID_SIGCACHE(sc));
+
+	shard = getshard(sc, digest);
+	LOCK(&shard->lock);
+	bucket = getbucket(shard, digest);
+	for (entry = ISC_LIST_HEAD(*bucket);
+	     entry != NULL;
+	     entry = ISC_LIST_NEXT(entry, hlink))
+	{
+		if (memcmp(entry->digest, digest, sizeof(entry->digest)) == 0)
+			goto unlock;
+	}
+
+	if (shard->count >= shard->max) {
+		/*
+		 * Recycle the least recently used entry.
+		 */
+		entry = ISC_LIST_TAIL(shard->lru);
+		INSIST(entry != NULL);
+		ISC_LIST_UNLINK(shard->lru, entry, lru);
+		ISC_LIST_UNLINK(*getbucket(shard, entry->digest),
+				entry, hlink);
+	} else {
+		entry = isc_mem_get(sc->mctx, sizeof(*entry));
+		if (entry == NULL)
+			goto unlock;
+		shard->count++;
+	}
+
+	memmove(entry->digest, digest, sizeof(entry->digest));
+	entry->timesigned = timesigned;
+	entry->timeexpire = timeexpire;
+	entry->cost = cost;
+	ISC_LINK_INIT(entry, hlink);
+	ISC_LINK_INIT(entry, lru);
+	ISC_LIST_PREPEND(*bucket, entry, hlink);
+	ISC_LIST_PREPEND(shard->lru, entry, lru);
+
+ unlock:
+	UNLOCK(&shard->lock);
+}
+
+void
+dns_sigcache_flush(dns_sigcache_t *sc) {
+	sigcacheshard_t *shard;
+	unsigned int i;
+
+	REQUIRE(VALID_SIGCACHE(sc));
+
+	for (i = 0; i < SIGCACHE_SHARDS; i++) {
+		shard = &sc->shards[i];
+		LOCK(&shard->lock);
+		flushshard(sc, shard);
+		UNLOCK(&shard->lock);
+	}
+}
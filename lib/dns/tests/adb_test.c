@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <unistd.h>
+
+#include <isc/sockaddr.h>
+#include <isc/stats.h>
+#include <isc/stdtime.h>
+
+#include <dns/adb.h>
+#include <dns/events.h>
+#include <dns/stats.h>
+#include <dns/view.h>
+
+#include "dnstest.h"
+
+/*
+ * Enough distinct addresses to push every lock stripe's hash table
+ * through at least one resize.
+ */
+#define NADDRS	40000
+
+static isc_uint64_t adbstat_values[dns_adbstats_max];
+static isc_boolean_t adb_done = ISC_FALSE;
+
+static void
+adb_shutdown(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	isc_event_free(&event);
+	adb_done = ISC_TRUE;
+}
+
+static void
+adbstat_dump(isc_statscounter_t counter, isc_uint64_t value, void *arg) {
+	UNUSED(arg);
+
+	adbstat_values[counter] = value;
+}
+
+static void
+make_addr(unsigned int i, isc_sockaddr_t *sa) {
+	struct in_addr ina;
+
+	ina.s_addr = htonl(0x0a000000 | i);
+	isc_sockaddr_fromin(sa, &ina, 53);
+}
+
+/*
+ * The ADB updates the view's statistics while shutting down, so wait
+ * for it to finish before the view can be released.
+ */
+static void
+destroy_adb(dns_adb_t **adbp) {
+	isc_event_t *event;
+	unsigned int i;
+
+	adb_done = ISC_FALSE;
+	event = isc_event_allocate(mctx, NULL, DNS_EVENT_VIEWADBSHUTDOWN,
+				   adb_shutdown, NULL, sizeof(*event));
+	ATF_REQUIRE(event != NULL);
+	dns_adb_whenshutdown(*adbp, maintask, &event);
+	dns_adb_shutdown(*adbp);
+	dns_adb_detach(adbp);
+	for (i = 0; !adb_done && i < 5000; i++)
+		dns_test_nap(1000);
+	ATF_CHECK(adb_done);
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(grow);
+ATF_TC_HEAD(grow, tc) {
+	atf_tc_set_md_var(tc, "descr", "entries remain reachable while the "
+				       "address table is resized");
+}
+ATF_TC_BODY(grow, tc) {
+	isc_result_t result;
+	dns_view_t *view = NULL;
+	dns_adb_t *adb = NULL;
+	dns_adbaddrinfo_t *addr = NULL;
+	dns_adbentry_t **entries;
+	isc_sockaddr_t sa;
+	isc_stdtime_t now;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_test_makeview("view", &view);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_adb_create(mctx, view, timermgr, taskmgr, &adb);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	entries = isc_mem_get(mctx, sizeof(*entries) * NADDRS);
+	ATF_REQUIRE(entries != NULL);
+
+	isc_stdtime_get(&now);
+	for (i = 0; i < NADDRS; i++) {
+		make_addr(i, &sa);
+		result = dns_adb_findaddrinfo(adb, &sa, &addr, now);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		entries[i] = addr->entry;
+		dns_adb_freeaddrinfo(adb, &addr);
+	}
+
+	/*
+	 * Every address must still map to the entry first created for it,
+	 * whether or not its chain has been migrated yet.
+	 */
+	for (i = 0; i < NADDRS; i++) {
+		make_addr(i, &sa);
+		result = dns_adb_findaddrinfo(adb, &sa, &addr, now);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(addr->entry, entries[i]);
+		dns_adb_freeaddrinfo(adb, &addr);
+	}
+
+	memset(adbstat_values, 0, sizeof(adbstat_values));
+	isc_stats_dump(view->adbstats, adbstat_dump, NULL,
+		       ISC_STATSDUMP_VERBOSE);
+	ATF_CHECK_EQ(adbstat_values[dns_adbstats_entriescnt], NADDRS);
+	ATF_CHECK(adbstat_values[dns_adbstats_entriesgrow] > 0);
+	ATF_CHECK(adbstat_values[dns_adbstats_nentries] >
+		  adbstat_values[dns_adbstats_nentrylocks]);
+	ATF_CHECK(adbstat_values[dns_adbstats_entriesload] > 0);
+
+	isc_mem_put(mctx, entries, sizeof(*entries) * NADDRS);
+
+	destroy_adb(&adb);
+	dns_view_detach(&view);
+	dns_test_end();
+}
+
+ATF_TC(state);
+ATF_TC_HEAD(state, tc) {
+	atf_tc_set_md_var(tc, "descr", "round trip times survive a save "
+				       "and reload of the adb state");
+}
+ATF_TC_BODY(state, tc) {
+	isc_result_t result;
+	dns_view_t *view = NULL;
+	dns_adb_t *adb = NULL;
+	dns_adbaddrinfo_t *addr = NULL;
+	isc_sockaddr_t sa;
+	isc_stdtime_t now;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_test_makeview("view", &view);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	unlink("adb.state");
+	result = dns_adb_create(mctx, view, timermgr, taskmgr, &adb);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_adb_setstatefile(adb, "adb.state");
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* A missing state file is reported as such. */
+	result = dns_adb_loadstate(adb);
+	ATF_CHECK_EQ(result, ISC_R_FILENOTFOUND);
+
+	isc_stdtime_get(&now);
+	for (i = 0; i < 100; i++) {
+		make_addr(i, &sa);
+		result = dns_adb_findaddrinfo(adb, &sa, &addr, now);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		dns_adb_adjustsrtt(adb, addr, 1000 + 10 * i,
+				   DNS_ADB_RTTADJREPLACE);
+		dns_adb_freeaddrinfo(adb, &addr);
+	}
+
+	/* The state is written when the adb is shut down. */
+	destroy_adb(&adb);
+	dns_view_detach(&view);
+
+	result = dns_test_makeview("view", &view);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_adb_create(mctx, view, timermgr, taskmgr, &adb);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_adb_setstatefile(adb, "adb.state");
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_adb_loadstate(adb);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 100; i++) {
+		make_addr(i, &sa);
+		result = dns_adb_findaddrinfo(adb, &sa, &addr, now);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(addr->srtt, 1000 + 10 * i);
+		dns_adb_freeaddrinfo(adb, &addr);
+	}
+
+	result = dns_adb_setstatefile(adb, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	destroy_adb(&adb);
+	unlink("adb.state");
+
+	dns_view_detach(&view);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, grow);
+	ATF_TP_ADD_TC(tp, state);
+	return (atf_no_error());
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <string.h>
+
+#ifdef HAVE_INTTYPES_H
+#include <inttypes.h> /* uintptr_t */
+#endif
+
+#include <isc/buffer.h>
+#include <isc/stdtime.h>
+#include <isc/task.h>
+
+#include <dns/cryptopool.h>
+#include <dns/dnssec.h>
+#include <dns/events.h>
+#include <dns/keyvalues.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+#include <dns/rdatastruct.h>
+#include <dns/result.h>
+
+#include <dst/dst.h>
+
+#include "dnstest.h"
+
+#define NJOBS	100
+
+static unsigned int ndone;
+static isc_result_t results[NJOBS];
+static isc_boolean_t ignored[NJOBS];
+
+static void
+done(isc_task_t *task, isc_event_t *event) {
+	dns_cryptoevent_t *cevent = (dns_cryptoevent_t *)event;
+	unsigned int i = (unsigned int)(uintptr_t)event->ev_arg;
+
+	UNUSED(task);
+
+	ATF_CHECK_EQ(event->ev_type, DNS_EVENT_CRYPTODONE);
+	results[i] = cevent->result;
+	ignored[i] = cevent->ignoretime;
+	isc_event_free(&event);
+	ndone++;
+}
+
+static void
+notified(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	ATF_CHECK_EQ(event->ev_type, DNS_EVENT_CRYPTODONE);
+	isc_event_free(&event);
+	ndone++;
+}
+
+static void
+waitfor(unsigned int n) {
+	unsigned int i;
+
+	for (i = 0; ndone < n && i < 5000; i++)
+		dns_test_nap(1000);
+	ATF_REQUIRE_EQ(ndone, n);
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(verify);
+ATF_TC_HEAD(verify, tc) {
+	atf_tc_set_md_var(tc, "descr", "queued verifications are performed "
+				       "and their results delivered");
+}
+ATF_TC_BODY(verify, tc) {
+	isc_result_t result;
+	dns_cryptopool_t *pool = NULL;
+	dst_key_t *key = NULL;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdata_t sigrdata = DNS_RDATA_INIT;
+	dns_rdata_rrsig_t sig;
+	unsigned char addr[4] = { 10, 53, 0, 1 };
+	unsigned char secret[32];
+	unsigned char sigbuf[512];
+	isc_buffer_t b;
+	isc_stdtime_t now;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_cryptopool_create(mctx, 4, &pool);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		dns_test_end();
+		atf_tc_skip("crypto pool requires threads");
+	}
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	memset(secret, 0x5a, sizeof(secret));
+	isc_buffer_init(&b, secret, sizeof(secret));
+	isc_buffer_add(&b, sizeof(secret));
+	result = dst_key_frombuffer(dns_rootname, DST_ALG_HMACSHA256, 0,
+				    DNS_KEYPROTO_DNSSEC, dns_rdataclass_in,
+				    &b, mctx, &key);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* A one record A RRset... */
+	rdata.data = addr;
+	rdata.length = sizeof(addr);
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = dns_rdatatype_a;
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = dns_rdatatype_a;
+	rdatalist.ttl = 300;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* ...and an RRSIG for it that expired an hour ago. */
+	isc_stdtime_get(&now);
+	memset(&sig, 0, sizeof(sig));
+	sig.common.rdclass = dns_rdataclass_in;
+	sig.common.rdtype = dns_rdatatype_rrsig;
+	ISC_LINK_INIT(&sig.common, link);
+	sig.covered = dns_rdatatype_a;
+	sig.algorithm = DST_ALG_HMACSHA256;
+	sig.labels = 0;
+	sig.originalttl = 300;
+	sig.timesigned = now - 7200;
+	sig.timeexpire = now - 3600;
+	sig.keyid = dst_key_id(key);
+	dns_name_init(&sig.signer, NULL);
+	dns_name_clone(dns_rootname, &sig.signer);
+	sig.siglen = sizeof(secret);
+	sig.signature = secret;
+	isc_buffer_init(&b, sigbuf, sizeof(sigbuf));
+	result = dns_rdata_fromstruct(&sigrdata, dns_rdataclass_in,
+				      dns_rdatatype_rrsig, &sig, &b);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ndone = 0;
+	for (i = 0; i < NJOBS; i++) {
+		results[i] = ISC_R_UNEXPECTED;
+		result = dns_cryptopool_verify(pool, dns_rootname, &rdataset,
+					       key, &sigrdata, 0,
+					       ISC_TF(i % 2 == 1), maintask,
+					       done, (void *)(uintptr_t)i);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	waitfor(NJOBS);
+	ATF_CHECK_EQ(dns_cryptopool_depth(pool), 0);
+
+	for (i = 0; i < NJOBS; i++) {
+		if (i % 2 == 0) {
+			ATF_CHECK_EQ(results[i], DNS_R_SIGEXPIRED);
+			ATF_CHECK(!ignored[i]);
+		} else {
+			/* Retried without the validity period. */
+			ATF_CHECK(results[i] != DNS_R_SIGEXPIRED);
+			ATF_CHECK(results[i] != ISC_R_SUCCESS);
+			ATF_CHECK(ignored[i]);
+		}
+	}
+
+	dns_cryptopool_detach(&pool);
+	ATF_CHECK_EQ(pool, NULL);
+	dns_rdataset_disassociate(&rdataset);
+	dst_key_free(&key);
+	dns_test_end();
+}
+
+ATF_TC(sign);
+ATF_TC_HEAD(sign, tc) {
+	atf_tc_set_md_var(tc, "descr", "a batch of signings is performed "
+				       "on copies of the submitter's data "
+				       "and its completion is notified");
+}
+ATF_TC_BODY(sign, tc) {
+	isc_result_t result;
+	dns_cryptopool_t *pool = NULL;
+	dns_cryptobatch_t *batch = NULL;
+	dns_cryptoevent_t *cevent;
+	isc_eventlist_t done;
+	isc_event_t *event;
+	dst_key_t *key = NULL;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	dns_rdata_t sigrdata = DNS_RDATA_INIT;
+	dns_fixedname_t fname;
+	dns_name_t *name;
+	unsigned char addr[4] = { 10, 53, 0, 1 };
+	unsigned char secret[32];
+	unsigned char sigbuf[512];
+	isc_buffer_t b;
+	isc_stdtime_t now, inception, expire;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_cryptopool_create(mctx, 4, &pool);
+	if (result == ISC_R_NOTIMPLEMENTED) {
+		dns_test_end();
+		atf_tc_skip("crypto pool requires threads");
+	}
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* HMAC is deterministic, so every signature must be the same. */
+	memset(secret, 0x5a, sizeof(secret));
+	isc_buffer_init(&b, secret, sizeof(secret));
+	isc_buffer_add(&b, sizeof(secret));
+	result = dst_key_frombuffer(dns_rootname, DST_ALG_HMACSHA256,
+				    DNS_KEYOWNER_ZONE, DNS_KEYPROTO_DNSSEC,
+				    dns_rdataclass_in, &b, mctx, &key);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	rdata.data = addr;
+	rdata.length = sizeof(addr);
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = dns_rdatatype_a;
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = dns_rdatatype_a;
+	rdatalist.ttl = 300;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_fixedname_init(&fname);
+	name = dns_fixedname_name(&fname);
+	result = dns_name_fromstring(name, "www.example", 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_stdtime_get(&now);
+	inception = now - 3600;
+	expire = now + 86400;
+	isc_buffer_init(&b, sigbuf, sizeof(sigbuf));
+	result = dns_dnssec_sign(name, &rdataset, key, &inception, &expire,
+				 mctx, &b, &sigrdata);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_cryptobatch_create(pool, &batch);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	for (i = 0; i < NJOBS; i++) {
+		result = dns_cryptobatch_sign(batch, name, &rdataset, key,
+					      inception, expire);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	/* The jobs have their own copies. */
+	dns_rdataset_disassociate(&rdataset);
+	dns_name_reset(name);
+
+	/* Be told when the batch is done, then collect the results. */
+	ndone = 0;
+	event = isc_event_allocate(mctx, NULL, DNS_EVENT_CRYPTODONE,
+				   notified, NULL, sizeof(*event));
+	ATF_REQUIRE(event != NULL);
+	dns_cryptobatch_notify(batch, maintask, &event);
+	ATF_CHECK_EQ(event, NULL);
+	waitfor(1);
+	ISC_LIST_INIT(done);
+	dns_cryptobatch_wait(batch, &done);
+	ATF_CHECK_EQ(dns_cryptopool_depth(pool), 0);
+
+	i = 0;
+	while ((event = ISC_LIST_HEAD(done)) != NULL) {
+		ISC_LIST_UNLINK(done, event, ev_link);
+		cevent = (dns_cryptoevent_t *)event;
+		ATF_CHECK_EQ(cevent->result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(cevent->rdataset.ttl, 300);
+		ATF_CHECK_EQ(dns_name_countlabels(
+				     dns_fixedname_name(&cevent->name)), 3);
+		ATF_CHECK_EQ(dns_rdata_compare(&cevent->sigrdata,
+					       &sigrdata), 0);
+		isc_event_free(&event);
+		i++;
+	}
+	ATF_CHECK_EQ(i, NJOBS);
+
+	/* An empty batch is done at once. */
+	event = isc_event_allocate(mctx, NULL, DNS_EVENT_CRYPTODONE,
+				   notified, NULL, sizeof(*event));
+	ATF_REQUIRE(event != NULL);
+	dns_cryptobatch_notify(batch, maintask, &event);
+	waitfor(2);
+
+	dns_cryptobatch_destroy(&batch);
+	ATF_CHECK_EQ(batch, NULL);
+	dns_cryptopool_detach(&pool);
+	dst_key_free(&key);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, verify);
+	ATF_TP_ADD_TC(tp, sign);
+	return (atf_no_error());
+}
@@ -19,8 +19,11 @@
 
 #include <dns/db.h>
 #include <dns/dbiterator.h>
+#include <dns/fixedname.h>
+#include <dns/message.h>
 #include <dns/name.h>
 #include <dns/journal.h>
+#include <dns/rdataset.h>
 
 #include "dnstest.h"
 
@@ -69,10 +72,179 @@ ATF_TC_BODY(getoriginnode, tc) {
 	isc_mem_detach(&mymctx);
 }
 
+static void
+findrdataset(dns_db_t *db, dns_dbversion_t *version, const char *namestr,
+	     dns_rdatatype_t type, dns_rdataset_t *rdataset)
+{
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	dns_dbnode_t *node = NULL;
+	isc_result_t result;
+
+	dns_fixedname_init(&fixed);
+	name = dns_fixedname_name(&fixed);
+	result = dns_name_fromstring(name, namestr, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_db_findnode(db, name, ISC_FALSE, &node);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_db_findrdataset(db, node, version, type, 0, 0,
+				     rdataset, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_db_detachnode(db, &node);
+}
+
+static void
+clearlist(dns_message_t *msg, dns_name_t *name) {
+	dns_rdataset_t *rdataset;
+
+	while ((rdataset = ISC_LIST_HEAD(name->list)) != NULL) {
+		ISC_LIST_UNLINK(name->list, rdataset, link);
+		if (dns_rdataset_isassociated(rdataset))
+			dns_rdataset_disassociate(rdataset);
+		dns_message_puttemprdataset(msg, &rdataset);
+	}
+}
+
+ATF_TC(additional);
+ATF_TC_HEAD(additional, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "additional data is cached per rdata and per zone "
+			  "version");
+}
+ATF_TC_BODY(additional, tc) {
+	dns_db_t *db = NULL, *db2 = NULL;
+	dns_dbversion_t *v1 = NULL, *v2 = NULL;
+	dns_message_t *msg = NULL;
+	dns_rdataset_t nsset, *a;
+	dns_fixedname_t ffound, fcached;
+	dns_name_t *found, *cached;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_test_loaddb(&db, dns_dbtype_zone, TEST_ORIGIN,
+				 "testdata/dbiterator/zone1.data");
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_test_loaddb(&db2, dns_dbtype_zone, TEST_ORIGIN,
+				 "testdata/dbiterator/zone1.data");
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	dns_fixedname_init(&ffound);
+	found = dns_fixedname_name(&ffound);
+	dns_fixedname_init(&fcached);
+	cached = dns_fixedname_name(&fcached);
+
+	dns_db_currentversion(db, &v1);
+	dns_rdataset_init(&nsset);
+	findrdataset(db, v1, "test", dns_rdatatype_ns, &nsset);
+	result = dns_rdataset_first(&nsset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_rdataset_getadditional(&nsset,
+					    dns_rdatasetadditional_fromauth,
+					    db, v1, cached, msg);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	/* Remember the address of the first name server... */
+	result = dns_name_fromstring(found, "ns.test", 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	a = NULL;
+	result = dns_message_gettemprdataset(msg, &a);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	findrdataset(db, v1, "ns.test", dns_rdatatype_a, a);
+	ISC_LIST_APPEND(found->list, a, link);
+	result = dns_rdataset_setadditional(&nsset,
+					    dns_rdatasetadditional_fromauth,
+					    db, v1, found);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	clearlist(msg, found);
+
+	/* ...and get it back. */
+	result = dns_rdataset_getadditional(&nsset,
+					    dns_rdatasetadditional_fromauth,
+					    db, v1, cached, msg);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(dns_name_equal(cached, found));
+	a = ISC_LIST_HEAD(cached->list);
+	ATF_REQUIRE(a != NULL);
+	ATF_CHECK_EQ(a->type, dns_rdatatype_a);
+	ATF_CHECK_EQ(dns_rdataset_count(a), 1);
+	ATF_CHECK_EQ(ISC_LIST_NEXT(a, link), NULL);
+	clearlist(msg, cached);
+
+	/* Other kinds of additional data are cached separately. */
+	result = dns_rdataset_getadditional(&nsset,
+					    dns_rdatasetadditional_fromglue,
+					    db, v1, cached, msg);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+	result = dns_rdataset_getadditional(&nsset,
+					    dns_rdatasetadditional_fromcache,
+					    db, v1, cached, msg);
+	ATF_CHECK_EQ(result, ISC_R_NOTIMPLEMENTED);
+
+	/* So are other databases. */
+	dns_db_currentversion(db2, &v2);
+	result = dns_rdataset_getadditional(&nsset,
+					    dns_rdatasetadditional_fromauth,
+					    db2, v2, cached, msg);
+	ATF_CHECK_EQ(result, ISC_R_NOTIMPLEMENTED);
+	dns_db_closeversion(db2, &v2, ISC_FALSE);
+
+	/* Negative entries. */
+	result = dns_rdataset_next(&nsset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_rdataset_getadditional(&nsset,
+					    dns_rdatasetadditional_fromauth,
+					    db, v1, cached, msg);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+	result = dns_rdataset_setadditional(&nsset,
+					    dns_rdatasetadditional_fromauth,
+					    db, v1, NULL);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	result = dns_rdataset_getadditional(&nsset,
+					    dns_rdatasetadditional_fromauth,
+					    db, v1, cached, msg);
+	ATF_CHECK_EQ(result, DNS_R_NXRRSET);
+
+	/* A new version of the zone starts with an empty cache. */
+	result = dns_db_newversion(db, &v2);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db, &v2, ISC_TRUE);
+	dns_db_currentversion(db, &v2);
+	ATF_REQUIRE(v2 != v1);
+	result = dns_rdataset_first(&nsset);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_rdataset_getadditional(&nsset,
+					    dns_rdatasetadditional_fromauth,
+					    db, v2, cached, msg);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	/* The old version still has its own. */
+	result = dns_rdataset_getadditional(&nsset,
+					    dns_rdatasetadditional_fromauth,
+					    db, v1, cached, msg);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	clearlist(msg, cached);
+
+	dns_rdataset_disassociate(&nsset);
+	dns_db_closeversion(db, &v2, ISC_FALSE);
+	dns_db_closeversion(db, &v1, ISC_FALSE);
+	dns_message_destroy(&msg);
+	dns_db_detach(&db2);
+	dns_db_detach(&db);
+	dns_test_end();
+}
+
 /*
  * Main
  */
 ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, getoriginnode);
+	ATF_TP_ADD_TC(tp, additional);
 	return (atf_no_error());
 }
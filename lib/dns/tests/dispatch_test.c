@@ -16,8 +16,11 @@
 
 #include <isc/app.h>
 #include <isc/buffer.h>
+#include <isc/os.h>
 #include <isc/socket.h>
 #include <isc/task.h>
+#include <isc/thread.h>
+#include <isc/time.h>
 #include <isc/timer.h>
 
 #include <dns/dispatch.h>
@@ -325,6 +328,200 @@ ATF_TC_BODY(dispatch_getnext, tc) {
 	dns_test_end();
 }
 
+#ifdef ISC_PLATFORM_USETHREADS
+#define STRESS_THREADS		8
+#define STRESS_ROUNDS		20
+#define STRESS_OUTSTANDING	512
+
+static isc_sockaddr_t stress_dest;
+static isc_task_t *stress_task = NULL;
+
+typedef struct {
+	dns_dispatch_t *disp;
+	unsigned int rounds;
+	unsigned int added;
+	unsigned int failures;
+	unsigned int duplicates;
+} stress_arg_t;
+
+static void
+stress_response(isc_task_t *task, isc_event_t *event) {
+	UNUSED(task);
+
+	/* No responses are expected. */
+	isc_event_free(&event);
+}
+
+/*
+ * Keep STRESS_OUTSTANDING fetches to the same destination outstanding
+ * on one dispatch, checking that none of them share a query ID, then
+ * cancel them all, 'rounds' times.
+ */
+static isc_threadresult_t
+#ifdef WIN32
+WINAPI
+#endif
+stress_thread(isc_threadarg_t arg) {
+	stress_arg_t *sa = arg;
+	dns_dispentry_t *entries[STRESS_OUTSTANDING];
+	unsigned char seen[65536 / 8];
+	dns_messageid_t id;
+	isc_result_t result;
+	unsigned int i, round;
+
+	for (round = 0; round < sa->rounds; round++) {
+		memset(seen, 0, sizeof(seen));
+		for (i = 0; i < STRESS_OUTSTANDING; i++) {
+			entries[i] = NULL;
+			result = dns_dispatch_addresponse(sa->disp,
+							  &stress_dest,
+							  stress_task,
+							  stress_response,
+							  NULL, &id,
+							  &entries[i]);
+			if (result != ISC_R_SUCCESS) {
+				sa->failures++;
+				continue;
+			}
+			sa->added++;
+			if ((seen[id / 8] & (1 << (id % 8))) != 0)
+				sa->duplicates++;
+			seen[id / 8] |= 1 << (id % 8);
+		}
+		for (i = 0; i < STRESS_OUTSTANDING; i++) {
+			if (entries[i] != NULL)
+				dns_dispatch_removeresponse(&entries[i], NULL);
+		}
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+/*
+ * Run 'rounds' rounds of stress_thread() in as many threads as there
+ * are CPUs, each on its own dispatch of a set, and return the number of
+ * fetches added.
+ */
+static unsigned int
+stress(unsigned int rounds, unsigned int *nthreadsp) {
+	isc_result_t result;
+	isc_sockaddr_t any;
+	isc_thread_t threads[STRESS_THREADS];
+	stress_arg_t args[STRESS_THREADS];
+	dns_dispatch_t *disp = NULL;
+	struct in_addr ina;
+	unsigned int attrs, nthreads, i, added = 0;
+
+	result = isc_task_create(taskmgr, 0, &stress_task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_dispatchmgr_create(mctx, NULL, &dispatchmgr);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_sockaddr_any(&any);
+	attrs = DNS_DISPATCHATTR_IPV4 | DNS_DISPATCHATTR_UDP;
+	result = dns_dispatch_getudp(dispatchmgr, socketmgr, taskmgr,
+				     &any, 512, 6, 2 * STRESS_OUTSTANDING,
+				     16411, 16433, attrs, attrs, &disp);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	nthreads = ISC_MIN(isc_os_ncpus(), STRESS_THREADS);
+	nthreads = ISC_MAX(nthreads, 2);
+	result = dns_dispatchset_create(mctx, socketmgr, taskmgr, disp,
+					&dset, nthreads);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_dispatch_detach(&disp);
+
+	/* Nothing is ever sent to it. */
+	ina.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&stress_dest, &ina, 53);
+
+	for (i = 0; i < nthreads; i++) {
+		memset(&args[i], 0, sizeof(args[i]));
+		args[i].disp = dns_dispatchset_get(dset);
+		args[i].rounds = rounds;
+		result = isc_thread_create(stress_thread, &args[i],
+					   &threads[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		result = isc_thread_join(threads[i], NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		ATF_CHECK_EQ(args[i].failures, 0);
+		ATF_CHECK_EQ(args[i].duplicates, 0);
+		added += args[i].added;
+	}
+
+	ATF_CHECK_EQ(added, nthreads * rounds * STRESS_OUTSTANDING);
+
+	isc_task_detach(&stress_task);
+	teardown();
+
+	*nthreadsp = nthreads;
+	return (added);
+}
+
+ATF_TC(dispatch_stress);
+ATF_TC_HEAD(dispatch_stress, tc) {
+	atf_tc_set_md_var(tc, "descr", "many concurrent fetches on a "
+				       "set of dispatches");
+}
+ATF_TC_BODY(dispatch_stress, tc) {
+	isc_result_t result;
+	unsigned int nthreads;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	(void)stress(STRESS_ROUNDS, &nthreads);
+
+	dns_test_end();
+}
+
+#ifdef DNS_BENCHMARK_TESTS
+
+/*
+ * Don't delete this code. It is useful in benchmarking the query ID
+ * table, but we don't require it as part of the unit test runs.
+ */
+
+ATF_TC(benchmark);
+ATF_TC_HEAD(benchmark, tc) {
+	atf_tc_set_md_var(tc, "descr", "Benchmark concurrent fetches");
+}
+ATF_TC_BODY(benchmark, tc) {
+	isc_result_t result;
+	unsigned int nthreads, added;
+	isc_time_t ts1, ts2;
+	double t;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_time_now(&ts1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	added = stress(10 * STRESS_ROUNDS, &nthreads);
+
+	result = isc_time_now(&ts2);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	t = isc_time_microdiff(&ts2, &ts1);
+	printf("%u threads, %u fetches added and removed, %f seconds, "
+	       "%f fetches/second\n", nthreads, added, t / 1000000.0,
+	       added / (t / 1000000.0));
+
+	dns_test_end();
+}
+
+#endif /* DNS_BENCHMARK_TESTS */
+#endif /* ISC_PLATFORM_USETHREADS */
+
 /*
  * Main
  */
@@ -332,5 +529,11 @@ ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, dispatchset_create);
 	ATF_TP_ADD_TC(tp, dispatchset_get);
 	ATF_TP_ADD_TC(tp, dispatch_getnext);
+#ifdef ISC_PLATFORM_USETHREADS
+	ATF_TP_ADD_TC(tp, dispatch_stress);
+#ifdef DNS_BENCHMARK_TESTS
+	ATF_TP_ADD_TC(tp, benchmark);
+#endif /* DNS_BENCHMARK_TESTS */
+#endif
 	return (atf_no_error());
 }
@@ -17,11 +17,13 @@
 
 #include <isc/buffer.h>
 #include <isc/file.h>
+#include <isc/stats.h>
 #include <isc/stdio.h>
 #include <isc/print.h>
 #include <isc/types.h>
 
 #include <dns/dnstap.h>
+#include <dns/stats.h>
 #include <dns/view.h>
 
 #include "dnstest.h"
@@ -45,6 +47,13 @@ cleanup() {
 	(void) isc_file_remove(TAPSOCK);
 }
 
+static void
+getcounter(isc_statscounter_t counter, isc_uint64_t value, void *arg) {
+	isc_uint64_t *values = arg;
+
+	values[counter] = value;
+}
+
 /*
  * Individual unit tests
  */
@@ -136,6 +145,8 @@ ATF_TC_BODY(send, tc) {
 	isc_stdtime_t now;
 	isc_time_t p, f;
 	struct fstrm_iothr_options *fopt;
+	isc_stats_t *stats = NULL;
+	isc_uint64_t values[dns_dnstapcounter_max];
 
 	UNUSED(tc);
 
@@ -156,6 +167,9 @@ ATF_TC_BODY(send, tc) {
 	dns_dt_attach(dtenv, &view->dtenv);
 	view->dttypes = DNS_DTTYPE_ALL;
 
+	result = dns_dt_getstats(dtenv, &stats);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
 	/*
 	 * Set up some test data
 	 */
@@ -238,6 +252,17 @@ ATF_TC_BODY(send, tc) {
 	dns_dt_shutdown();
 	dns_view_detach(&view);
 
+	/*
+	 * Every message was encoded and written by the time the
+	 * environment was destroyed.
+	 */
+	memset(values, 0, sizeof(values));
+	isc_stats_dump(stats, getcounter, values, ISC_STATSDUMP_VERBOSE);
+	ATF_CHECK_EQ(values[dns_dnstapcounter_success], 96);
+	ATF_CHECK_EQ(values[dns_dnstapcounter_drop], 0);
+	ATF_CHECK_EQ(values[dns_dnstapcounter_ringfull], 0);
+	isc_stats_detach(&stats);
+
 	/*
 	 * XXX now read back and check content.
 	 */
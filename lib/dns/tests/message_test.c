@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <string.h>
+
+#include <isc/buffer.h>
+
+#include <dns/message.h>
+#include <dns/name.h>
+#include <dns/rdata.h>
+#include <dns/rdataset.h>
+#include <dns/result.h>
+
+#include "dnstest.h"
+
+/*
+ * Query header with the given additional count, for www.example/A/IN.
+ */
+static void
+putquery(isc_buffer_t *b, unsigned int arcount) {
+	static const unsigned char qname[] = "\003www\007example";
+
+	isc_buffer_putuint16(b, 0x1234);
+	isc_buffer_putuint16(b, 0x0100);		/* RD */
+	isc_buffer_putuint16(b, 1);
+	isc_buffer_putuint16(b, 0);
+	isc_buffer_putuint16(b, 0);
+	isc_buffer_putuint16(b, arcount);
+	isc_buffer_putmem(b, qname, sizeof(qname));	/* with root label */
+	isc_buffer_putuint16(b, dns_rdatatype_a);
+	isc_buffer_putuint16(b, dns_rdataclass_in);
+}
+
+/*
+ * OPT record with a client cookie and, optionally, an ECS option and
+ * 'padding' octets of PADDING.
+ */
+static void
+putopt(isc_buffer_t *b, isc_uint32_t ttl, isc_boolean_t ecs,
+       unsigned int padding)
+{
+	static const unsigned char cookie[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	unsigned int rdlen = 4 + sizeof(cookie);
+
+	if (ecs)
+		rdlen += 4 + 7;
+	if (padding > 0)
+		rdlen += 4 + padding;
+
+	isc_buffer_putuint8(b, 0);
+	isc_buffer_putuint16(b, dns_rdatatype_opt);
+	isc_buffer_putuint16(b, 4096);
+	isc_buffer_putuint32(b, ttl);
+	isc_buffer_putuint16(b, rdlen);
+	isc_buffer_putuint16(b, DNS_OPT_COOKIE);
+	isc_buffer_putuint16(b, sizeof(cookie));
+	isc_buffer_putmem(b, cookie, sizeof(cookie));
+	if (ecs) {
+		isc_buffer_putuint16(b, DNS_OPT_CLIENT_SUBNET);
+		isc_buffer_putuint16(b, 7);
+		isc_buffer_putuint16(b, 1);		/* IPv4 */
+		isc_buffer_putuint8(b, 24);
+		isc_buffer_putuint8(b, 0);
+		isc_buffer_putuint8(b, 10);
+		isc_buffer_putuint8(b, 53);
+		isc_buffer_putuint8(b, 0);
+	}
+	if (padding > 0) {
+		isc_buffer_putuint16(b, DNS_OPT_PAD);
+		isc_buffer_putuint16(b, padding);
+		while (padding-- > 0)
+			isc_buffer_putuint8(b, 0);
+	}
+}
+
+static isc_result_t
+parse(dns_message_t *msg, isc_buffer_t *b) {
+	isc_buffer_t source;
+	isc_region_t r;
+
+	isc_buffer_usedregion(b, &r);
+	isc_buffer_init(&source, r.base, r.length);
+	isc_buffer_add(&source, r.length);
+	dns_message_reset(msg, DNS_MESSAGE_INTENTPARSE);
+	return (dns_message_parse(msg, &source, 0));
+}
+
+static void
+checkquestion(dns_message_t *msg) {
+	dns_fixedname_t fixed;
+	dns_name_t *expected, *qname = NULL;
+	dns_rdataset_t *rdataset;
+	isc_buffer_t b;
+	isc_result_t result;
+
+	dns_fixedname_init(&fixed);
+	expected = dns_fixedname_name(&fixed);
+	isc_buffer_constinit(&b, "www.example.", 12);
+	isc_buffer_add(&b, 12);
+	result = dns_name_fromtext(expected, &b, dns_rootname, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ATF_CHECK_EQ(msg->id, 0x1234);
+	ATF_CHECK_EQ(msg->rdclass, dns_rdataclass_in);
+	result = dns_message_firstname(msg, DNS_SECTION_QUESTION);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	dns_message_currentname(msg, DNS_SECTION_QUESTION, &qname);
+	ATF_CHECK(dns_name_equal(qname, expected));
+	rdataset = ISC_LIST_HEAD(qname->list);
+	ATF_REQUIRE(rdataset != NULL);
+	ATF_CHECK_EQ(rdataset->type, dns_rdatatype_a);
+	ATF_CHECK_EQ(rdataset->rdclass, dns_rdataclass_in);
+	ATF_CHECK((rdataset->attributes & DNS_RDATASETATTR_QUESTION) != 0);
+	ATF_CHECK_EQ(ISC_LIST_NEXT(rdataset, link), NULL);
+	result = dns_message_nextname(msg, DNS_SECTION_QUESTION);
+	ATF_CHECK_EQ(result, ISC_R_NOMORE);
+}
+
+static unsigned int
+optlength(dns_message_t *msg) {
+	dns_rdataset_t *opt = dns_message_getopt(msg);
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+
+	ATF_REQUIRE(opt != NULL);
+	ATF_REQUIRE_EQ(dns_rdataset_first(opt), ISC_R_SUCCESS);
+	dns_rdataset_current(opt, &rdata);
+	return (rdata.length);
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(query);
+ATF_TC_HEAD(query, tc) {
+	atf_tc_set_md_var(tc, "descr", "simple queries, with and without "
+				       "OPT, parse to the same message as "
+				       "any other");
+}
+ATF_TC_BODY(query, tc) {
+	isc_result_t result;
+	dns_message_t *msg = NULL;
+	dns_rdataset_t *opt;
+	unsigned char data[1024];
+	isc_buffer_t b;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTPARSE, &msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* Reusing the message must not leak or corrupt anything. */
+	for (i = 0; i < 3; i++) {
+		isc_buffer_init(&b, data, sizeof(data));
+		putquery(&b, 0);
+		result = parse(msg, &b);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		checkquestion(msg);
+		ATF_CHECK_EQ(dns_message_getopt(msg), NULL);
+
+		isc_buffer_init(&b, data, sizeof(data));
+		putquery(&b, 1);
+		putopt(&b, 0x00008000, ISC_FALSE, 0);
+		result = parse(msg, &b);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		checkquestion(msg);
+		opt = dns_message_getopt(msg);
+		ATF_REQUIRE(opt != NULL);
+		ATF_CHECK_EQ(opt->rdclass, 4096);
+		ATF_CHECK_EQ(opt->ttl, 0x00008000);
+		ATF_CHECK_EQ(optlength(msg), 12);
+		ATF_CHECK_EQ(msg->rcode, dns_rcode_noerror);
+
+		isc_buffer_init(&b, data, sizeof(data));
+		putquery(&b, 1);
+		putopt(&b, 0x01000000, ISC_TRUE, 0);
+		result = parse(msg, &b);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		checkquestion(msg);
+		ATF_CHECK_EQ(optlength(msg), 12 + 11);
+		/* The extended rcode is picked up. */
+		ATF_CHECK_EQ(msg->rcode, dns_rcode_badvers);
+	}
+
+	/* Turning the query into a reply keeps the question. */
+	isc_buffer_init(&b, data, sizeof(data));
+	putquery(&b, 1);
+	putopt(&b, 0, ISC_TRUE, 0);
+	result = parse(msg, &b);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_message_reply(msg, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(dns_message_getopt(msg), NULL);
+	checkquestion(msg);
+
+	dns_message_destroy(&msg);
+	dns_test_end();
+}
+
+ATF_TC(fallback);
+ATF_TC_HEAD(fallback, tc) {
+	atf_tc_set_md_var(tc, "descr", "queries the fast path cannot take "
+				       "are parsed in full, and malformed "
+				       "ones are rejected");
+}
+ATF_TC_BODY(fallback, tc) {
+	isc_result_t result;
+	dns_message_t *msg = NULL;
+	unsigned char data[2048];
+	isc_buffer_t b;
+	isc_region_t r;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTPARSE, &msg);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* An OPT too large for the fast path. */
+	isc_buffer_init(&b, data, sizeof(data));
+	putquery(&b, 1);
+	putopt(&b, 0, ISC_TRUE, 1000);
+	result = parse(msg, &b);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	checkquestion(msg);
+	ATF_CHECK_EQ(optlength(msg), 12 + 11 + 4 + 1000);
+
+	/* A second additional record. */
+	isc_buffer_init(&b, data, sizeof(data));
+	putquery(&b, 2);
+	putopt(&b, 0, ISC_FALSE, 0);
+	isc_buffer_putuint8(&b, 0);
+	isc_buffer_putuint16(&b, dns_rdatatype_a);
+	isc_buffer_putuint16(&b, dns_rdataclass_in);
+	isc_buffer_putuint32(&b, 300);
+	isc_buffer_putuint16(&b, 4);
+	isc_buffer_putuint32(&b, 0x0a000001);
+	result = parse(msg, &b);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	checkquestion(msg);
+	ATF_CHECK_EQ(optlength(msg), 12);
+	result = dns_message_firstname(msg, DNS_SECTION_ADDITIONAL);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+
+	/* An OPT not owned by the root. */
+	isc_buffer_init(&b, data, sizeof(data));
+	putquery(&b, 1);
+	isc_buffer_putuint16(&b, 0xc00c);	/* pointer to www.example */
+	isc_buffer_putuint16(&b, dns_rdatatype_opt);
+	isc_buffer_putuint16(&b, 4096);
+	isc_buffer_putuint32(&b, 0);
+	isc_buffer_putuint16(&b, 0);
+	result = parse(msg, &b);
+	ATF_CHECK_EQ(result, DNS_R_FORMERR);
+
+	/* Truncated OPT rdata. */
+	isc_buffer_init(&b, data, sizeof(data));
+	putquery(&b, 1);
+	putopt(&b, 0, ISC_FALSE, 0);
+	isc_buffer_subtract(&b, 2);
+	result = parse(msg, &b);
+	ATF_CHECK_EQ(result, ISC_R_UNEXPECTEDEND);
+
+	/* Truncated question. */
+	isc_buffer_init(&b, data, sizeof(data));
+	putquery(&b, 0);
+	isc_buffer_subtract(&b, 3);
+	result = parse(msg, &b);
+	ATF_CHECK_EQ(result, ISC_R_UNEXPECTEDEND);
+
+	/* A bad compression pointer in the question. */
+	isc_buffer_init(&b, data, sizeof(data));
+	putquery(&b, 0);
+	isc_buffer_usedregion(&b, &r);
+	r.base[12] = 0xc0;
+	r.base[13] = 0x0c;
+	result = parse(msg, &b);
+	ATF_CHECK(result != ISC_R_SUCCESS);
+
+	/* And the fast path still works afterwards. */
+	isc_buffer_init(&b, data, sizeof(data));
+	putquery(&b, 1);
+	putopt(&b, 0, ISC_TRUE, 0);
+	result = parse(msg, &b);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	checkquestion(msg);
+
+	dns_message_destroy(&msg);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, query);
+	ATF_TP_ADD_TC(tp, fallback);
+	return (atf_no_error());
+}
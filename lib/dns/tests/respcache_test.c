@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <isc/buffer.h>
+
+#include <dns/db.h>
+#include <dns/respcache.h>
+
+#include "dnstest.h"
+
+static dns_db_t *db1 = NULL, *db2 = NULL;
+#define DB1	db1
+#define DB2	db2
+
+static void
+make_dbs(void) {
+	isc_result_t result;
+
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db2);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+static void
+destroy_dbs(void) {
+	dns_db_detach(&db1);
+	dns_db_detach(&db2);
+}
+
+static void
+make_key(unsigned int i, unsigned char *buf, isc_region_t *key) {
+	snprintf((char *)buf, DNS_RESPCACHE_MAXKEY, "key%u", i);
+	key->base = buf;
+	key->length = strlen((char *)buf);
+}
+
+static void
+make_wire(unsigned int i, unsigned char *buf, unsigned int len,
+	  isc_region_t *wire)
+{
+	memset(buf, i & 0xff, len);
+	wire->base = buf;
+	wire->length = len;
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(findadd);
+ATF_TC_HEAD(findadd, tc) {
+	atf_tc_set_md_var(tc, "descr", "cached responses are returned only "
+				       "for the database and serial they "
+				       "were built from");
+}
+ATF_TC_BODY(findadd, tc) {
+	isc_result_t result;
+	dns_respcache_t *rc = NULL;
+	unsigned char keybuf[DNS_RESPCACHE_MAXKEY];
+	unsigned char keybuf2[DNS_RESPCACHE_MAXKEY];
+	unsigned char wirebuf[512], out[512], small[16];
+	isc_region_t key, key2, wire;
+	isc_buffer_t b;
+	unsigned int info = 0;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	make_dbs();
+	result = dns_respcache_create(mctx, 1024, &rc);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	make_key(1, keybuf, &key);
+	isc_buffer_init(&b, out, sizeof(out));
+	result = dns_respcache_find(rc, &key, DB1, 1, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	make_wire(1, wirebuf, 100, &wire);
+	dns_respcache_add(rc, &key, DB1, 1, 42, &wire);
+	result = dns_respcache_find(rc, &key, DB1, 1, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(info, 42);
+	ATF_CHECK_EQ(isc_buffer_usedlength(&b), 100);
+	ATF_CHECK(memcmp(out, wirebuf, 100) == 0);
+
+	/* A response that doesn't fit is reported but kept. */
+	isc_buffer_init(&b, small, sizeof(small));
+	result = dns_respcache_find(rc, &key, DB1, 1, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_NOSPACE);
+	isc_buffer_init(&b, out, sizeof(out));
+	result = dns_respcache_find(rc, &key, DB1, 1, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+
+	/* Replacing a response. */
+	make_wire(2, wirebuf, 200, &wire);
+	dns_respcache_add(rc, &key, DB1, 1, 43, &wire);
+	isc_buffer_init(&b, out, sizeof(out));
+	result = dns_respcache_find(rc, &key, DB1, 1, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(info, 43);
+	ATF_CHECK_EQ(isc_buffer_usedlength(&b), 200);
+	ATF_CHECK(memcmp(out, wirebuf, 200) == 0);
+
+	/* A new serial invalidates the response. */
+	isc_buffer_init(&b, out, sizeof(out));
+	result = dns_respcache_find(rc, &key, DB1, 2, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+	result = dns_respcache_find(rc, &key, DB1, 1, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	/* So does a new database. */
+	dns_respcache_add(rc, &key, DB1, 2, 44, &wire);
+	result = dns_respcache_find(rc, &key, DB2, 2, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+	result = dns_respcache_find(rc, &key, DB1, 2, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	/* Flushing. */
+	dns_respcache_add(rc, &key, DB2, 2, 45, &wire);
+	dns_respcache_flush(rc);
+	result = dns_respcache_find(rc, &key, DB2, 2, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	/* Flushing a database removes only its responses. */
+	dns_respcache_add(rc, &key, DB1, 2, 46, &wire);
+	make_key(2, keybuf2, &key2);
+	dns_respcache_add(rc, &key2, DB2, 2, 47, &wire);
+	dns_respcache_flushdb(rc, DB1);
+	isc_buffer_init(&b, out, sizeof(out));
+	result = dns_respcache_find(rc, &key, DB1, 2, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+	result = dns_respcache_find(rc, &key2, DB2, 2, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(info, 47);
+
+	/* Entries don't keep their database alive. */
+	destroy_dbs();
+	make_dbs();
+
+	dns_respcache_destroy(&rc);
+	ATF_CHECK_EQ(rc, NULL);
+	destroy_dbs();
+	dns_test_end();
+}
+
+ATF_TC(bounded);
+ATF_TC_HEAD(bounded, tc) {
+	atf_tc_set_md_var(tc, "descr", "the cache holds a bounded number of "
+				       "responses and evicts the least "
+				       "recently used");
+}
+ATF_TC_BODY(bounded, tc) {
+	isc_result_t result;
+	dns_respcache_t *rc = NULL;
+	unsigned char keybuf[DNS_RESPCACHE_MAXKEY];
+	unsigned char wirebuf[DNS_RESPCACHE_MAXWIRE + 1];
+	unsigned char out[DNS_RESPCACHE_MAXWIRE + 1];
+	isc_region_t key, wire;
+	isc_buffer_t b;
+	unsigned int i, info, found;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* One entry per shard. */
+	make_dbs();
+	result = dns_respcache_create(mctx, 16, &rc);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 1000; i++) {
+		make_key(i, keybuf, &key);
+		make_wire(i, wirebuf, 64, &wire);
+		dns_respcache_add(rc, &key, DB1, 1, i, &wire);
+	}
+
+	found = 0;
+	for (i = 0; i < 1000; i++) {
+		make_key(i, keybuf, &key);
+		isc_buffer_init(&b, out, sizeof(out));
+		result = dns_respcache_find(rc, &key, DB1, 1, &b, &info);
+		if (result == ISC_R_SUCCESS) {
+			ATF_CHECK_EQ(info, i);
+			found++;
+		}
+	}
+	ATF_CHECK(found > 0);
+	ATF_CHECK(found <= 16);
+
+	/* The most recently added response is always present. */
+	make_key(999, keybuf, &key);
+	isc_buffer_init(&b, out, sizeof(out));
+	result = dns_respcache_find(rc, &key, DB1, 1, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+
+	/* Oversized responses are not cached. */
+	make_key(1000, keybuf, &key);
+	make_wire(0, wirebuf, sizeof(wirebuf), &wire);
+	dns_respcache_add(rc, &key, DB1, 1, 0, &wire);
+	isc_buffer_init(&b, out, sizeof(out));
+	result = dns_respcache_find(rc, &key, DB1, 1, &b, &info);
+	ATF_CHECK_EQ(result, ISC_R_NOTFOUND);
+
+	dns_respcache_destroy(&rc);
+	destroy_dbs();
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, findadd);
+	ATF_TP_ADD_TC(tp, bounded);
+	return (atf_no_error());
+}
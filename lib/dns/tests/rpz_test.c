@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <isc/mem.h>
+#include <isc/netaddr.h>
+#include <isc/os.h>
+#include <isc/print.h>
+#include <isc/thread.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/result.h>
+#include <dns/rpz.h>
+
+#include "dnstest.h"
+
+static void
+make_name(const char *str, const dns_name_t *origin, dns_name_t *name) {
+	isc_result_t result;
+
+	dns_name_init(name, NULL);
+	result = dns_name_fromstring2(name, str, origin, 0, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Set up one policy zone named "rpz." the way named configures it.
+ */
+static void
+setup(dns_rpz_zones_t **rpzsp) {
+	isc_result_t result;
+	dns_rpz_zones_t *rpzs = NULL;
+	dns_rpz_zone_t *rpz;
+
+	result = dns_rpz_new_zones(&rpzs, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	rpz = isc_mem_get(mctx, sizeof(*rpz));
+	ATF_REQUIRE(rpz != NULL);
+	memset(rpz, 0, sizeof(*rpz));
+	result = isc_refcount_init(&rpz->refs, 1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	make_name("rpz.", NULL, &rpz->origin);
+	make_name(DNS_RPZ_CLIENT_IP_ZONE, &rpz->origin, &rpz->client_ip);
+	make_name(DNS_RPZ_IP_ZONE, &rpz->origin, &rpz->ip);
+	make_name(DNS_RPZ_NSDNAME_ZONE, &rpz->origin, &rpz->nsdname);
+	make_name(DNS_RPZ_NSIP_ZONE, &rpz->origin, &rpz->nsip);
+	dns_name_init(&rpz->passthru, NULL);
+	dns_name_init(&rpz->drop, NULL);
+	dns_name_init(&rpz->tcp_only, NULL);
+	dns_name_init(&rpz->cname, NULL);
+	rpz->policy = DNS_RPZ_POLICY_GIVEN;
+	rpz->num = rpzs->p.num_zones++;
+	rpzs->zones[rpz->num] = rpz;
+
+	*rpzsp = rpzs;
+}
+
+static void
+change(dns_rpz_zones_t *rpzs, const char *owner, isc_boolean_t add) {
+	isc_result_t result;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+
+	dns_fixedname_init(&fixed);
+	name = dns_fixedname_name(&fixed);
+	result = dns_name_fromstring2(name, owner, &rpzs->zones[0]->origin,
+				      0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	if (add) {
+		result = dns_rpz_add(rpzs, 0, name);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	} else
+		dns_rpz_delete(rpzs, 0, name);
+}
+
+static dns_rpz_zbits_t
+find_name(dns_rpz_zones_t *rpzs, const char *str) {
+	isc_result_t result;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+
+	dns_fixedname_init(&fixed);
+	name = dns_fixedname_name(&fixed);
+	result = dns_name_fromstring(name, str, 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	return (dns_rpz_find_name(rpzs, DNS_RPZ_TYPE_QNAME,
+				  DNS_RPZ_ALL_ZBITS, name));
+}
+
+static dns_rpz_num_t
+find_ip(dns_rpz_zones_t *rpzs, isc_uint32_t addr) {
+	isc_netaddr_t netaddr;
+	struct in_addr ina;
+	dns_fixedname_t fixed;
+	dns_rpz_prefix_t prefix;
+
+	ina.s_addr = htonl(addr);
+	isc_netaddr_fromin(&netaddr, &ina);
+	dns_fixedname_init(&fixed);
+	return (dns_rpz_find_ip(rpzs, DNS_RPZ_TYPE_IP, DNS_RPZ_ALL_ZBITS,
+				&netaddr, dns_fixedname_name(&fixed),
+				&prefix));
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(commit);
+ATF_TC_HEAD(commit, tc) {
+	atf_tc_set_md_var(tc, "descr", "small batches of changes become "
+				       "visible when committed");
+}
+ATF_TC_BODY(commit, tc) {
+	isc_result_t result;
+	dns_rpz_zones_t *rpzs = NULL;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	setup(&rpzs);
+
+	change(rpzs, "bad.example", ISC_TRUE);
+	change(rpzs, "*.evil.example", ISC_TRUE);
+	change(rpzs, "32.4.3.2.10.rpz-ip", ISC_TRUE);
+	ATF_CHECK_EQ(rpzs->nchanges, 3);
+
+	ATF_CHECK_EQ(find_name(rpzs, "bad.example."), 0);
+	ATF_CHECK_EQ(find_ip(rpzs, 0x0a020304), DNS_RPZ_INVALID_NUM);
+
+	ATF_CHECK_EQ(dns_rpz_commit(rpzs), ISC_R_SUCCESS);
+	ATF_CHECK_EQ(rpzs->nchanges, 0);
+	ATF_CHECK_EQ(find_name(rpzs, "bad.example."), DNS_RPZ_ZBIT(0));
+	ATF_CHECK_EQ(find_name(rpzs, "www.evil.example."), DNS_RPZ_ZBIT(0));
+	ATF_CHECK_EQ(find_name(rpzs, "good.example."), 0);
+	ATF_CHECK_EQ(find_ip(rpzs, 0x0a020304), 0);
+	ATF_CHECK_EQ(rpzs->triggers[0].qname, 2);
+	ATF_CHECK_EQ(rpzs->triggers[0].ipv4, 1);
+
+	change(rpzs, "bad.example", ISC_FALSE);
+	change(rpzs, "32.4.3.2.10.rpz-ip", ISC_FALSE);
+	ATF_CHECK_EQ(find_name(rpzs, "bad.example."), DNS_RPZ_ZBIT(0));
+
+	ATF_CHECK_EQ(dns_rpz_commit(rpzs), ISC_R_SUCCESS);
+	ATF_CHECK_EQ(find_name(rpzs, "bad.example."), 0);
+	ATF_CHECK_EQ(find_ip(rpzs, 0x0a020304), DNS_RPZ_INVALID_NUM);
+	ATF_CHECK_EQ(rpzs->triggers[0].qname, 1);
+	ATF_CHECK_EQ(rpzs->triggers[0].ipv4, 0);
+	ATF_CHECK_EQ(rpzs->have.ipv4, 0);
+
+	dns_rpz_detach_rpzs(&rpzs);
+	dns_test_end();
+}
+
+ATF_TC(generation);
+ATF_TC_HEAD(generation, tc) {
+	atf_tc_set_md_var(tc, "descr", "large batches are applied to the "
+				       "next generation of the summary "
+				       "and swapped in when committed");
+}
+ATF_TC_BODY(generation, tc) {
+	isc_result_t result;
+	dns_rpz_zones_t *rpzs = NULL;
+	char buf[64];
+	unsigned int i, n = DNS_RPZ_MAX_CHANGES * 4;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	setup(&rpzs);
+
+	change(rpzs, "old.example", ISC_TRUE);
+	ATF_CHECK_EQ(dns_rpz_commit(rpzs), ISC_R_SUCCESS);
+
+	for (i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "n%u.feed.example", i);
+		change(rpzs, buf, ISC_TRUE);
+	}
+	change(rpzs, "old.example", ISC_FALSE);
+	ATF_CHECK_EQ(rpzs->nchanges, n + 1);
+
+	/* Searches still see the old generation. */
+	ATF_CHECK_EQ(find_name(rpzs, "n0.feed.example."), 0);
+	ATF_CHECK_EQ(find_name(rpzs, "old.example."), DNS_RPZ_ZBIT(0));
+	ATF_CHECK_EQ(rpzs->triggers[0].qname, 1);
+
+	ATF_CHECK_EQ(dns_rpz_commit(rpzs), ISC_R_SUCCESS);
+	ATF_CHECK_EQ(rpzs->nchanges, 0);
+	ATF_CHECK_EQ(find_name(rpzs, "n0.feed.example."), DNS_RPZ_ZBIT(0));
+	snprintf(buf, sizeof(buf), "n%u.feed.example.", n - 1);
+	ATF_CHECK_EQ(find_name(rpzs, buf), DNS_RPZ_ZBIT(0));
+	ATF_CHECK_EQ(find_name(rpzs, "old.example."), 0);
+	ATF_CHECK_EQ(rpzs->triggers[0].qname, n);
+
+	for (i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "n%u.feed.example", i);
+		change(rpzs, buf, ISC_FALSE);
+	}
+	ATF_CHECK_EQ(dns_rpz_commit(rpzs), ISC_R_SUCCESS);
+	ATF_CHECK_EQ(find_name(rpzs, "n0.feed.example."), 0);
+	ATF_CHECK_EQ(rpzs->triggers[0].qname, 0);
+	ATF_CHECK_EQ(rpzs->have.qname, 0);
+
+	/* Uncommitted changes are discarded with the policy zones. */
+	change(rpzs, "late.example", ISC_TRUE);
+	dns_rpz_detach_rpzs(&rpzs);
+	dns_test_end();
+}
+
+ATF_TC(cleanns);
+ATF_TC_HEAD(cleanns, tc) {
+	atf_tc_set_md_var(tc, "descr", "name servers known to match no NSIP "
+				       "trigger are forgotten when the "
+				       "summary changes");
+}
+ATF_TC_BODY(cleanns, tc) {
+	isc_result_t result;
+	dns_rpz_zones_t *rpzs = NULL;
+	dns_fixedname_t fixed;
+	dns_name_t *ns;
+	isc_uint32_t generation;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	setup(&rpzs);
+	dns_fixedname_init(&fixed);
+	ns = dns_fixedname_name(&fixed);
+	result = dns_name_fromstring(ns, "ns1.example.", 0, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	generation = rpzs->generation;
+	ATF_CHECK(!dns_rpz_find_cleanns(rpzs, ns, dns_rdatatype_a,
+					generation));
+
+	dns_rpz_add_cleanns(rpzs, ns, dns_rdatatype_a, generation, 60);
+	ATF_CHECK(dns_rpz_find_cleanns(rpzs, ns, dns_rdatatype_a,
+				       generation));
+	ATF_CHECK(!dns_rpz_find_cleanns(rpzs, ns, dns_rdatatype_aaaa,
+					generation));
+
+	/* A zero TTL is not remembered. */
+	dns_rpz_add_cleanns(rpzs, ns, dns_rdatatype_aaaa, generation, 0);
+	ATF_CHECK(!dns_rpz_find_cleanns(rpzs, ns, dns_rdatatype_aaaa,
+					generation));
+
+	/* Committing a new NSIP trigger starts a new generation. */
+	change(rpzs, "32.1.2.0.192.rpz-nsip", ISC_TRUE);
+	ATF_CHECK_EQ(rpzs->generation, generation);
+	ATF_CHECK_EQ(dns_rpz_commit(rpzs), ISC_R_SUCCESS);
+	ATF_CHECK(rpzs->generation != generation);
+	ATF_CHECK(!dns_rpz_find_cleanns(rpzs, ns, dns_rdatatype_a,
+					rpzs->generation));
+
+	dns_rpz_detach_rpzs(&rpzs);
+	dns_test_end();
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+#ifdef DNS_BENCHMARK_TESTS
+
+/*
+ * Not part of the unit test runs; build with -DDNS_BENCHMARK_TESTS to
+ * measure policy lookups while a large feed update is applied.
+ */
+
+#define BENCH_CHANGES	1000000
+
+static dns_rpz_zones_t *bench_rpzs;
+static isc_boolean_t bench_done;
+
+typedef struct {
+	isc_uint64_t	lookups;
+	isc_uint64_t	total;
+	isc_uint64_t	max;
+} bench_stats_t;
+
+ATF_TC(benchmark);
+ATF_TC_HEAD(benchmark, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "Benchmark policy lookups during a feed update");
+}
+
+static void *
+lookup_thread(void *arg) {
+	bench_stats_t *stats = arg;
+	isc_time_t ts1, ts2;
+	isc_uint64_t t;
+	char buf[64];
+
+	while (!bench_done) {
+		snprintf(buf, sizeof(buf), "n%u.feed.example.",
+			 (unsigned int)(stats->lookups % BENCH_CHANGES));
+		(void)isc_time_now(&ts1);
+		(void)find_name(bench_rpzs, buf);
+		(void)isc_time_now(&ts2);
+		t = isc_time_microdiff(&ts2, &ts1);
+		stats->lookups++;
+		stats->total += t;
+		if (t > stats->max)
+			stats->max = t;
+	}
+
+	return (NULL);
+}
+
+ATF_TC_BODY(benchmark, tc) {
+	isc_result_t result;
+	unsigned int i;
+	isc_time_t ts1, ts2;
+	double t;
+	unsigned int nthreads;
+	isc_thread_t threads[32];
+	bench_stats_t stats[32];
+	isc_uint64_t lookups = 0, total = 0, max = 0;
+	char buf[64];
+
+	UNUSED(tc);
+
+	debug_mem_record = ISC_FALSE;
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	setup(&bench_rpzs);
+	bench_done = ISC_FALSE;
+
+	nthreads = ISC_MIN(isc_os_ncpus(), 32);
+	nthreads = ISC_MAX(nthreads, 1);
+	memset(stats, 0, sizeof(stats));
+	for (i = 0; i < nthreads; i++) {
+		result = isc_thread_create(lookup_thread, &stats[i],
+					   &threads[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	result = isc_time_now(&ts1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < BENCH_CHANGES; i++) {
+		snprintf(buf, sizeof(buf), "n%u.feed.example", i);
+		change(bench_rpzs, buf, ISC_TRUE);
+	}
+	ATF_CHECK_EQ(dns_rpz_commit(bench_rpzs), ISC_R_SUCCESS);
+
+	result = isc_time_now(&ts2);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	bench_done = ISC_TRUE;
+	for (i = 0; i < nthreads; i++) {
+		result = isc_thread_join(threads[i], NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		lookups += stats[i].lookups;
+		total += stats[i].total;
+		if (stats[i].max > max)
+			max = stats[i].max;
+	}
+
+	t = isc_time_microdiff(&ts2, &ts1);
+
+	printf("%u changes applied in %f seconds\n",
+	       BENCH_CHANGES, t / 1000000.0);
+	printf("%llu lookups in %u threads, average %f us, max %llu us\n",
+	       (unsigned long long)lookups, nthreads,
+	       lookups != 0 ? (double)total / lookups : 0.0,
+	       (unsigned long long)max);
+
+	dns_rpz_detach_rpzs(&bench_rpzs);
+	dns_test_end();
+}
+
+#endif /* DNS_BENCHMARK_TESTS */
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, commit);
+	ATF_TP_ADD_TC(tp, generation);
+	ATF_TP_ADD_TC(tp, cleanns);
+#ifdef ISC_PLATFORM_USETHREADS
+#ifdef DNS_BENCHMARK_TESTS
+	ATF_TP_ADD_TC(tp, benchmark);
+#endif /* DNS_BENCHMARK_TESTS */
+#endif /* ISC_PLATFORM_USETHREADS */
+
+	return (atf_no_error());
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <isc/net.h>
+#include <isc/os.h>
+#include <isc/print.h>
+#include <isc/random.h>
+#include <isc/sockaddr.h>
+#include <isc/stdtime.h>
+#include <isc/thread.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/name.h>
+#include <dns/result.h>
+#include <dns/rrl.h>
+#include <dns/view.h>
+
+#include "dnstest.h"
+
+#define SET_RATE(rrl, rate, val)					\
+	do {								\
+		(rrl)->rate.r = (val);					\
+		(rrl)->rate.scaled = (val);				\
+		(rrl)->rate.str = #rate;				\
+	} while (0)
+
+/*
+ * Set up a view with rate limiting configured the way named does it.
+ */
+static void
+setup(dns_view_t **viewp, int responses, int slip, int max_entries) {
+	isc_result_t result;
+	dns_view_t *view = NULL;
+	dns_rrl_t *rrl = NULL;
+	int i;
+
+	result = dns_test_makeview("view", &view);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_rrl_init(&rrl, view, 100);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	rrl->max_entries = max_entries;
+	SET_RATE(rrl, responses_per_second, responses);
+	SET_RATE(rrl, referrals_per_second, responses);
+	SET_RATE(rrl, nodata_per_second, responses);
+	SET_RATE(rrl, nxdomains_per_second, responses);
+	SET_RATE(rrl, errors_per_second, responses);
+	SET_RATE(rrl, all_per_second, 0);
+	SET_RATE(rrl, slip, slip);
+	rrl->window = 15;
+	rrl->qps_scale = 0;
+	rrl->qps = 1.0;
+	rrl->ipv4_prefixlen = 24;
+	rrl->ipv4_mask = htonl(0xffffff00);
+	rrl->ipv6_prefixlen = 56;
+	rrl->ipv6_mask[0] = 0xffffffff;
+	rrl->ipv6_mask[1] = htonl(0xffffff00);
+	for (i = 2; i < 4; i++)
+		rrl->ipv6_mask[i] = 0;
+
+	*viewp = view;
+}
+
+static void
+make_addr(isc_sockaddr_t *sa, isc_uint32_t addr) {
+	struct in_addr ina;
+
+	ina.s_addr = htonl(addr);
+	isc_sockaddr_fromin(sa, &ina, 53);
+}
+
+static dns_rrl_result_t
+rrl(dns_view_t *view, isc_sockaddr_t *sa, isc_stdtime_t now) {
+	char log_buf[DNS_RRL_LOG_BUF_LEN];
+
+	return (dns_rrl(view, sa, ISC_FALSE, dns_rdataclass_in,
+			dns_rdatatype_a, dns_rootname, ISC_R_SUCCESS, now,
+			ISC_FALSE, log_buf, sizeof(log_buf)));
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(limit);
+ATF_TC_HEAD(limit, tc) {
+	atf_tc_set_md_var(tc, "descr", "responses over the limit are "
+				       "dropped or slipped, per address "
+				       "block, and credited over time");
+}
+ATF_TC_BODY(limit, tc) {
+	isc_result_t result;
+	dns_view_t *view = NULL;
+	isc_sockaddr_t client, neighbor, other;
+	isc_stdtime_t now;
+	int i;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	setup(&view, 5, 2, 1000);
+	make_addr(&client, 0x0a000001);
+	make_addr(&neighbor, 0x0a0000fe);	/* same /24 */
+	make_addr(&other, 0x0a000101);
+	isc_stdtime_get(&now);
+
+	for (i = 0; i < 5; i++)
+		ATF_CHECK_EQ(rrl(view, &client, now), DNS_RRL_RESULT_OK);
+	for (i = 0; i < 10; i++)
+		ATF_CHECK_EQ(rrl(view, &client, now),
+			     (i % 2 == 0) ? DNS_RRL_RESULT_SLIP
+					  : DNS_RRL_RESULT_DROP);
+	ATF_CHECK(rrl(view, &neighbor, now) != DNS_RRL_RESULT_OK);
+	ATF_CHECK_EQ(rrl(view, &other, now), DNS_RRL_RESULT_OK);
+
+	/* Eleven responses over the limit take three seconds to pay off. */
+	now += 2;
+	ATF_CHECK(rrl(view, &client, now) != DNS_RRL_RESULT_OK);
+	now += 1;
+	ATF_CHECK_EQ(rrl(view, &client, now), DNS_RRL_RESULT_OK);
+
+	/* TCP responses are never limited. */
+	for (i = 0; i < 20; i++) {
+		char log_buf[DNS_RRL_LOG_BUF_LEN];
+
+		ATF_CHECK_EQ(dns_rrl(view, &client, ISC_TRUE,
+				     dns_rdataclass_in, dns_rdatatype_a,
+				     dns_rootname, ISC_R_SUCCESS, now,
+				     ISC_FALSE, log_buf, sizeof(log_buf)),
+			     DNS_RRL_RESULT_OK);
+	}
+
+	dns_view_detach(&view);
+	dns_test_end();
+}
+
+ATF_TC(spoofed);
+ATF_TC_HEAD(spoofed, tc) {
+	atf_tc_set_md_var(tc, "descr", "many sources are spread over the "
+				       "shards within max-table-size");
+}
+ATF_TC_BODY(spoofed, tc) {
+	isc_result_t result;
+	dns_view_t *view = NULL;
+	isc_sockaddr_t sa;
+	isc_stdtime_t now;
+	unsigned int i, total, used;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	setup(&view, 5, 2, 1600);
+	isc_stdtime_get(&now);
+
+	for (i = 0; i < 20000; i++) {
+		make_addr(&sa, 0x0a000000 + (i << 8));
+		ATF_CHECK_EQ(rrl(view, &sa, now + i / 1000),
+			     DNS_RRL_RESULT_OK);
+	}
+
+	/* Every shard grew past its share of the initial entries. */
+	total = used = 0;
+	for (i = 0; i < DNS_RRL_SHARDS; i++) {
+		unsigned int n = view->rrl->shards[i].num_entries;
+
+		total += n;
+		if (n > 100 / DNS_RRL_SHARDS + 1)
+			used++;
+	}
+	ATF_CHECK(total <= 1600);
+	ATF_CHECK_EQ(used, DNS_RRL_SHARDS);
+
+	dns_view_detach(&view);
+	dns_test_end();
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+#ifdef DNS_BENCHMARK_TESTS
+
+/*
+ * Not part of the unit test runs; build with -DDNS_BENCHMARK_TESTS to
+ * measure dns_rrl() under attack traffic from many threads.
+ */
+
+#define BENCH_CALLS	2000000
+
+static dns_view_t *bench_view;
+static isc_stdtime_t bench_now;
+
+ATF_TC(benchmark);
+ATF_TC_HEAD(benchmark, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "Benchmark dns_rrl() with spoofed sources");
+}
+
+static void *
+spoof_thread(void *arg) {
+	isc_sockaddr_t sa;
+	isc_uint32_t addr;
+	unsigned int i;
+
+	UNUSED(arg);
+
+	for (i = 0; i < BENCH_CALLS; i++) {
+		isc_random_get(&addr);
+		make_addr(&sa, addr);
+		(void)rrl(bench_view, &sa, bench_now + i / 100000);
+	}
+
+	return (NULL);
+}
+
+ATF_TC_BODY(benchmark, tc) {
+	isc_result_t result;
+	unsigned int i;
+	isc_time_t ts1, ts2;
+	double t;
+	unsigned int nthreads;
+	isc_thread_t threads[32];
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	setup(&bench_view, 5, 2, 100000);
+	isc_stdtime_get(&bench_now);
+
+	result = isc_time_now(&ts1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	nthreads = ISC_MIN(isc_os_ncpus(), 32);
+	nthreads = ISC_MAX(nthreads, 1);
+	for (i = 0; i < nthreads; i++) {
+		result = isc_thread_create(spoof_thread, NULL, &threads[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		result = isc_thread_join(threads[i], NULL);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	result = isc_time_now(&ts2);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	t = isc_time_microdiff(&ts2, &ts1);
+
+	printf("%u dns_rrl() calls in %u threads, %f seconds, "
+	       "%f calls/second\n",
+	       nthreads * BENCH_CALLS, nthreads, t / 1000000.0,
+	       (nthreads * BENCH_CALLS) / (t / 1000000.0));
+
+	dns_view_detach(&bench_view);
+	dns_test_end();
+}
+
+#endif /* DNS_BENCHMARK_TESTS */
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, limit);
+	ATF_TP_ADD_TC(tp, spoofed);
+#ifdef ISC_PLATFORM_USETHREADS
+#ifdef DNS_BENCHMARK_TESTS
+	ATF_TP_ADD_TC(tp, benchmark);
+#endif /* DNS_BENCHMARK_TESTS */
+#endif /* ISC_PLATFORM_USETHREADS */
+
+	return (atf_no_error());
+}
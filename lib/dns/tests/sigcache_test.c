@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <string.h>
+
+#include <isc/stdtime.h>
+
+#include <dns/sigcache.h>
+
+#include "dnstest.h"
+
+static void
+make_digest(unsigned int i, unsigned char *digest) {
+	memset(digest, 0, DNS_SIGCACHE_DIGESTLENGTH);
+	digest[0] = i & 0xff;
+	digest[1] = (i >> 8) & 0xff;
+	digest[DNS_SIGCACHE_DIGESTLENGTH - 1] = 0xa5;
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(findadd);
+ATF_TC_HEAD(findadd, tc) {
+	atf_tc_set_md_var(tc, "descr", "successful verifications are found "
+				       "only within the signature validity "
+				       "period");
+}
+ATF_TC_BODY(findadd, tc) {
+	isc_result_t result;
+	dns_sigcache_t *sc = NULL;
+	unsigned char digest[DNS_SIGCACHE_DIGESTLENGTH];
+	isc_stdtime_t now;
+	isc_uint32_t cost = 0;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_sigcache_create(mctx, 1024, &sc);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_stdtime_get(&now);
+	make_digest(1, digest);
+	ATF_CHECK(!dns_sigcache_find(sc, digest, now, NULL));
+
+	dns_sigcache_add(sc, digest, now - 3600, now + 3600, 1234);
+	ATF_CHECK(dns_sigcache_find(sc, digest, now, &cost));
+	ATF_CHECK_EQ(cost, 1234);
+
+	/* A different digest misses. */
+	make_digest(2, digest);
+	ATF_CHECK(!dns_sigcache_find(sc, digest, now, NULL));
+
+	/* Outside the validity period the entry is no longer used. */
+	make_digest(1, digest);
+	ATF_CHECK(!dns_sigcache_find(sc, digest, now + 7200, NULL));
+	ATF_CHECK(!dns_sigcache_find(sc, digest, now, NULL));
+
+	dns_sigcache_add(sc, digest, now - 3600, now + 3600, 1);
+	dns_sigcache_flush(sc);
+	ATF_CHECK(!dns_sigcache_find(sc, digest, now, NULL));
+
+	dns_sigcache_destroy(&sc);
+	ATF_CHECK_EQ(sc, NULL);
+	dns_test_end();
+}
+
+ATF_TC(bounded);
+ATF_TC_HEAD(bounded, tc) {
+	atf_tc_set_md_var(tc, "descr", "the least recently used entry is "
+				       "evicted when a shard is full");
+}
+ATF_TC_BODY(bounded, tc) {
+	isc_result_t result;
+	dns_sigcache_t *sc = NULL;
+	unsigned char digest[DNS_SIGCACHE_DIGESTLENGTH];
+	isc_stdtime_t now;
+	unsigned int i, found;
+
+	UNUSED(tc);
+
+	result = dns_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = dns_sigcache_create(mctx, 64, &sc);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_stdtime_get(&now);
+	for (i = 0; i < 4096; i++) {
+		make_digest(i, digest);
+		dns_sigcache_add(sc, digest, now - 60, now + 60, i);
+	}
+
+	found = 0;
+	for (i = 0; i < 4096; i++) {
+		make_digest(i, digest);
+		if (dns_sigcache_find(sc, digest, now, NULL))
+			found++;
+	}
+	ATF_CHECK(found <= 64);
+	ATF_CHECK(found > 0);
+
+	/* The most recently added entries survive. */
+	make_digest(4095, digest);
+	ATF_CHECK(dns_sigcache_find(sc, digest, now, NULL));
+
+	dns_sigcache_destroy(&sc);
+	dns_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, findadd);
+	ATF_TP_ADD_TC(tp, bounded);
+	return (atf_no_error());
+}
@@ -13,9 +13,12 @@
 #include <isc/print.h>
 #include <isc/sha2.h>
 #include <isc/string.h>
+#include <isc/stats.h>
 #include <isc/task.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
+#include <dns/cryptopool.h>
 #include <dns/db.h>
 #include <dns/dnssec.h>
 #include <dns/ds.h>
@@ -32,6 +35,8 @@
 #include <dns/rdatatype.h>
 #include <dns/resolver.h>
 #include <dns/result.h>
+#include <dns/sigcache.h>
+#include <dns/stats.h>
 #include <dns/validator.h>
 #include <dns/view.h>
 
@@ -83,6 +88,7 @@
 						 * have attempted a verify. */
 #define VALATTR_INSECURITY		0x0010	/*%< Attempting proveunsecure. */
 #define VALATTR_DLVTRIED		0x0020	/*%< Looked for a DLV record. */
+#define VALATTR_OFFLOADED		0x0040	/*%< Verification offloaded. */
 
 /*!
  * NSEC proofs to be looked for.
@@ -120,6 +126,8 @@
 
 #define NEGATIVE(r)	(((r)->attributes & DNS_RDATASETATTR_NEGATIVE) != 0)
 
+#define TIME_NOW(tp) 	RUNTIME_CHECK(isc_time_now((tp)) == ISC_R_SUCCESS)
+
 static void
 destroy(dns_validator_t *val);
 
@@ -130,6 +138,9 @@ get_dst_key(dns_validator_t *val, dns_rdata_rrsig_t *siginfo,
 static isc_result_t
 validate(dns_validator_t *val, isc_boolean_t resume);
 
+static void
+verified(isc_task_t *task, isc_event_t *event);
+
 static isc_result_t
 validatezonekey(dns_validator_t *val);
 
@@ -187,6 +198,20 @@ marksecure(dns_validatorevent_t *event) {
 	event->secure = ISC_TRUE;
 }
 
+static inline void
+inc_stat(dns_validator_t *val, isc_statscounter_t counter) {
+	if (val->view->resstats != NULL)
+		isc_stats_increment(val->view->resstats, counter);
+}
+
+static inline void
+add_stat(dns_validator_t *val, isc_statscounter_t counter,
+	 isc_uint32_t value)
+{
+	if (val->view->resstats != NULL)
+		isc_stats_add(val->view->resstats, counter, value);
+}
+
 static void
 validator_done(dns_validator_t *val, isc_result_t result) {
 	isc_task_t *task;
@@ -217,7 +242,8 @@ exit_check(dns_validator_t *val) {
 
 	INSIST(val->event == NULL);
 
-	if (val->fetch != NULL || val->subvalidator != NULL)
+	if (val->fetch != NULL || val->subvalidator != NULL ||
+	    (val->attributes & VALATTR_OFFLOADED) != 0)
 		return (ISC_FALSE);
 
 	return (ISC_TRUE);
@@ -702,6 +728,70 @@ keyvalidated(isc_task_t *task, isc_event_t *event) {
 		destroy(val);
 }
 
+/*%
+ * Callback from when an offloaded signature verification is done.
+ *
+ * Resumes the stalled validation process.
+ */
+static void
+verified(isc_task_t *task, isc_event_t *event) {
+	dns_cryptoevent_t *cevent;
+	dns_validator_t *val;
+	isc_boolean_t want_destroy;
+	isc_result_t result;
+	isc_statscounter_t counter;
+	isc_uint64_t msecs;
+
+	UNUSED(task);
+	INSIST(event->ev_type == DNS_EVENT_CRYPTODONE);
+
+	cevent = (dns_cryptoevent_t *)event;
+	val = cevent->ev_arg;
+
+	validator_log(val, ISC_LOG_DEBUG(3), "in verified");
+	LOCK(&val->lock);
+	INSIST((val->attributes & VALATTR_OFFLOADED) != 0);
+	INSIST(val->cryptoevent == NULL);
+	val->attributes &= ~VALATTR_OFFLOADED;
+
+	if (val->view->resstats != NULL) {
+		isc_stats_decrement(val->view->resstats,
+				    dns_resstatscounter_cryptoqueue);
+		msecs = cevent->latency / 1000;
+		if (msecs < DNS_CRYPTOPOOL_LATCLASS0)
+			counter = dns_resstatscounter_cryptolat0;
+		else if (msecs < DNS_CRYPTOPOOL_LATCLASS1)
+			counter = dns_resstatscounter_cryptolat1;
+		else if (msecs < DNS_CRYPTOPOOL_LATCLASS2)
+			counter = dns_resstatscounter_cryptolat2;
+		else if (msecs < DNS_CRYPTOPOOL_LATCLASS3)
+			counter = dns_resstatscounter_cryptolat3;
+		else
+			counter = dns_resstatscounter_cryptolat4;
+		isc_stats_increment(val->view->resstats, counter);
+	}
+
+	if (CANCELED(val) || cevent->result == ISC_R_CANCELED) {
+		isc_event_free(&event);
+		validator_done(val, ISC_R_CANCELED);
+	} else {
+		val->cryptoevent = cevent;
+		result = validate(val, ISC_TRUE);
+		if (val->cryptoevent != NULL) {
+			/* validate() gave up before consuming it. */
+			event = (isc_event_t *)val->cryptoevent;
+			val->cryptoevent = NULL;
+			isc_event_free(&event);
+		}
+		if (result != DNS_R_WAIT)
+			validator_done(val, result);
+	}
+	want_destroy = exit_check(val);
+	UNLOCK(&val->lock);
+	if (want_destroy)
+		destroy(val);
+}
+
 /*%
  * Callback when the DS record has been validated.
  *
@@ -1484,36 +1574,27 @@ isselfsigned(dns_validator_t *val) {
 }
 
 /*%
- * Attempt to verify the rdataset using the given key and rdata (RRSIG).
- * The signature was good and from a wildcard record and the QNAME does
- * not match the wildcard we need to look for a NOQNAME proof.
- *
- * Returns:
- * \li	ISC_R_SUCCESS if the verification succeeds.
- * \li	Others if the verification fails.
+ * Account for the outcome of a verification of the rdataset with 'rdata'
+ * (RRSIG): record it in the signature cache, log it and, if the
+ * signature was good and from a wildcard record and the QNAME does not
+ * match the wildcard, arrange to look for a NOQNAME proof.
  */
 static isc_result_t
-verify(dns_validator_t *val, dst_key_t *key, dns_rdata_t *rdata,
-       isc_uint16_t keyid)
+verify_done(dns_validator_t *val, dns_rdata_t *rdata, isc_uint16_t keyid,
+	    isc_result_t result, isc_boolean_t ignore, dns_name_t *wild,
+	    isc_uint64_t cost)
 {
-	isc_result_t result;
-	dns_fixedname_t fixed;
-	isc_boolean_t ignore = ISC_FALSE;
-	dns_name_t *wild;
-
-	val->attributes |= VALATTR_TRIEDVERIFY;
-	dns_fixedname_init(&fixed);
-	wild = dns_fixedname_name(&fixed);
- again:
-	result = dns_dnssec_verify3(val->event->name, val->event->rdataset,
-				    key, ignore, val->view->maxbits,
-				    val->view->mctx, rdata, wild);
-	if ((result == DNS_R_SIGEXPIRED || result == DNS_R_SIGFUTURE) &&
-	    val->view->acceptexpired)
-	{
-		ignore = ISC_TRUE;
-		goto again;
+	if (val->cachesig && !ignore && result == ISC_R_SUCCESS) {
+		dns_rdata_rrsig_t sig;
+
+		RUNTIME_CHECK(dns_rdata_tostruct(rdata, &sig, NULL) ==
+			      ISC_R_SUCCESS);
+		dns_sigcache_add(val->view->sigcache, val->sigdigest,
+				 sig.timesigned, sig.timeexpire,
+				 (isc_uint32_t)ISC_MIN(cost, 0xffffffffU));
 	}
+	val->cachesig = ISC_FALSE;
+
 	if (ignore && (result == ISC_R_SUCCESS || result == DNS_R_FROMWILDCARD))
 		validator_log(val, ISC_LOG_INFO,
 			      "accepted expired %sRRSIG (keyid=%u)",
@@ -1547,6 +1628,96 @@ verify(dns_validator_t *val, dst_key_t *key, dns_rdata_t *rdata,
 	return (result);
 }
 
+/*%
+ * Attempt to verify the rdataset using the given key and rdata (RRSIG).
+ * The signature was good and from a wildcard record and the QNAME does
+ * not match the wildcard we need to look for a NOQNAME proof.
+ *
+ * If 'offload' is true and the view has a crypto pool, the verification
+ * is handed to the pool and DNS_R_WAIT is returned; verified() resumes
+ * the validation once it is done.
+ *
+ * Returns:
+ * \li	ISC_R_SUCCESS if the verification succeeds.
+ * \li	DNS_R_WAIT if the verification has been offloaded.
+ * \li	Others if the verification fails.
+ */
+static isc_result_t
+verify(dns_validator_t *val, dst_key_t *key, dns_rdata_t *rdata,
+       isc_uint16_t keyid, isc_boolean_t offload)
+{
+	isc_result_t result;
+	dns_fixedname_t fixed;
+	isc_boolean_t ignore = ISC_FALSE;
+	dns_name_t *wild;
+	isc_time_t start, end;
+	isc_stdtime_t now;
+	isc_uint32_t cost;
+
+	val->attributes |= VALATTR_TRIEDVERIFY;
+	dns_fixedname_init(&fixed);
+	wild = dns_fixedname_name(&fixed);
+
+	/*
+	 * Skip the public key operation if this exact signature, RRset
+	 * and key were verified successfully before.
+	 */
+	val->cachesig = ISC_FALSE;
+	if (val->view->sigcache != NULL &&
+	    dns_sigcache_digest(val->event->name, val->event->rdataset,
+				key, val->view->maxbits, rdata,
+				val->sigdigest) == ISC_R_SUCCESS)
+	{
+		isc_stdtime_get(&now);
+		if (dns_sigcache_find(val->view->sigcache, val->sigdigest,
+				      now, &cost))
+		{
+			inc_stat(val, dns_resstatscounter_sigcachehit);
+			add_stat(val, dns_resstatscounter_sigcachesaved, cost);
+			validator_log(val, ISC_LOG_DEBUG(3),
+				      "verify rdataset (keyid=%u): "
+				      "success (cached)", keyid);
+			return (ISC_R_SUCCESS);
+		}
+		inc_stat(val, dns_resstatscounter_sigcachemiss);
+		val->cachesig = ISC_TRUE;
+	}
+
+	if (offload && val->view->cryptopool != NULL) {
+		result = dns_cryptopool_verify(val->view->cryptopool,
+					       val->event->name,
+					       val->event->rdataset, key,
+					       rdata, val->view->maxbits,
+					       val->view->acceptexpired,
+					       val->task, verified, val);
+		if (result == ISC_R_SUCCESS) {
+			inc_stat(val, dns_resstatscounter_cryptooffload);
+			inc_stat(val, dns_resstatscounter_cryptoqueue);
+			val->attributes |= VALATTR_OFFLOADED;
+			return (DNS_R_WAIT);
+		}
+		validator_log(val, ISC_LOG_DEBUG(3),
+			      "offloading verification failed: %s",
+			      isc_result_totext(result));
+	}
+
+	TIME_NOW(&start);
+ again:
+	result = dns_dnssec_verify3(val->event->name, val->event->rdataset,
+				    key, ignore, val->view->maxbits,
+				    val->view->mctx, rdata, wild);
+	if ((result == DNS_R_SIGEXPIRED || result == DNS_R_SIGFUTURE) &&
+	    val->view->acceptexpired)
+	{
+		ignore = ISC_TRUE;
+		goto again;
+	}
+	TIME_NOW(&end);
+
+	return (verify_done(val, rdata, keyid, result, ignore, wild,
+			    isc_time_microdiff(&end, &start)));
+}
+
 /*%
  * Attempts positive response validation of a normal RRset.
  *
@@ -1623,8 +1794,29 @@ validate(dns_validator_t *val, isc_boolean_t resume) {
 		}
 
 		do {
-			vresult = verify(val, val->key, &rdata,
-					val->siginfo->keyid);
+			if (val->cryptoevent != NULL) {
+				/*
+				 * We are resuming after an offloaded
+				 * verification of this signature.
+				 */
+				dns_cryptoevent_t *cevent = val->cryptoevent;
+
+				val->cryptoevent = NULL;
+				vresult = verify_done(val, &rdata,
+						      val->siginfo->keyid,
+						      cevent->result,
+						      cevent->ignoretime,
+						      dns_fixedname_name(
+							      &cevent->wild),
+						      cevent->cost);
+				isc_event_free(ISC_EVENT_PTR(&cevent));
+			} else {
+				vresult = verify(val, val->key, &rdata,
+						 val->siginfo->keyid,
+						 ISC_TRUE);
+				if (vresult == DNS_R_WAIT)
+					return (DNS_R_WAIT);
+			}
 			if (vresult == ISC_R_SUCCESS)
 				break;
 			if (val->keynode != NULL) {
@@ -1738,7 +1930,7 @@ checkkey(dns_validator_t *val, dns_rdata_t *keyrdata, isc_uint16_t keyid,
 				 */
 				continue;
 		}
-		result = verify(val, dstkey, &rdata, sig.keyid);
+		result = verify(val, dstkey, &rdata, sig.keyid, ISC_FALSE);
 		if (result == ISC_R_SUCCESS)
 			break;
 	}
@@ -2015,7 +2207,7 @@ validatezonekey(dns_validator_t *val) {
 					break;
 				}
 				result = verify(val, dstkey, &sigrdata,
-						sig.keyid);
+						sig.keyid, ISC_FALSE);
 				if (result == ISC_R_SUCCESS) {
 					dns_keytable_detachkeynode(
 								val->keytable,
@@ -3789,6 +3981,8 @@ dns_validator_create(dns_view_t *view, dns_name_t *name, dns_rdatatype_t type,
 	dns_fixedname_init(&val->nearest);
 	dns_fixedname_init(&val->closest);
 	isc_stdtime_get(&val->start);
+	val->cryptoevent = NULL;
+	val->cachesig = ISC_FALSE;
 	ISC_LINK_INIT(val, link);
 	val->magic = VALIDATOR_MAGIC;
 
@@ -3868,6 +4062,7 @@ destroy(dns_validator_t *val) {
 	REQUIRE(SHUTDOWN(val));
 	REQUIRE(val->event == NULL);
 	REQUIRE(val->fetch == NULL);
+	REQUIRE(val->cryptoevent == NULL);
 
 	if (val->keynode != NULL)
 		dns_keytable_detachkeynode(val->keytable, &val->keynode);
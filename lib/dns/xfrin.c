@@ -12,6 +12,7 @@
 
 #include <config.h>
 
+#include <isc/histo.h>
 #include <isc/mem.h>
 #include <isc/print.h>
 #include <isc/random.h>
@@ -1473,6 +1474,7 @@ maybe_free(dns_xfrin_ctx_t *xfr) {
 	isc_uint64_t msecs;
 	isc_uint64_t persec;
 	const char *result_str;
+	isc_histo_t *histo;
 
 	REQUIRE(VALID_XFRIN(xfr));
 
@@ -1508,6 +1510,14 @@ maybe_free(dns_xfrin_ctx_t *xfr) {
 		  (unsigned int) (msecs / 1000), (unsigned int) (msecs % 1000),
 		  (unsigned int) persec);
 
+	if (xfr->shuttingdown && xfr->shutdown_result == ISC_R_SUCCESS &&
+	    xfr->zone != NULL)
+	{
+		histo = dns_zone_getxfrintimes(xfr->zone);
+		if (histo != NULL)
+			isc_histo_add(histo, msecs);
+	}
+
 	if (xfr->socket != NULL)
 		isc_socket_detach(&xfr->socket);
 
@@ -13,6 +13,7 @@
 
 #include <isc/file.h>
 #include <isc/hex.h>
+#include <isc/histo.h>
 #include <isc/mutex.h>
 #include <isc/pool.h>
 #include <isc/print.h>
@@ -30,11 +31,11 @@
 #include <isc/timer.h>
 #include <isc/util.h>
 
-#include <dns/acache.h>
 #include <dns/acl.h>
 #include <dns/adb.h>
 #include <dns/callbacks.h>
 #include <dns/catz.h>
+#include <dns/cryptopool.h>
 #include <dns/db.h>
 #include <dns/dbiterator.h>
 #include <dns/dlz.h>
@@ -63,6 +64,7 @@
 #include <dns/rdatatype.h>
 #include <dns/request.h>
 #include <dns/resolver.h>
+#include <dns/respcache.h>
 #include <dns/result.h>
 #include <dns/rriterator.h>
 #include <dns/soa.h>
@@ -302,7 +304,6 @@ struct dns_zone {
 	isc_uint32_t		sigvalidityinterval;
 	isc_uint32_t		sigresigninginterval;
 	dns_view_t		*view;
-	dns_acache_t		*acache;
 	dns_checkmxfunc_t	checkmx;
 	dns_checksrvfunc_t	checksrv;
 	dns_checknsfunc_t	checkns;
@@ -327,6 +328,7 @@ struct dns_zone {
 	isc_boolean_t		requeststats_on;
 	isc_stats_t		*requeststats;
 	dns_stats_t		*rcvquerystats;
+	isc_histo_t		*xfrintimes;
 	isc_uint32_t		notifydelay;
 	dns_isselffunc_t	isself;
 	void			*isselfarg;
@@ -345,6 +347,14 @@ struct dns_zone {
 	 */
 	dns_signinglist_t	signing;
 	dns_nsec3chainlist_t	nsec3chain;
+	/*%
+	 * Signatures of the last signing quantum that are still being
+	 * computed by the crypto pool, with the database they are for
+	 * and a version that keeps the signed data alive.
+	 */
+	dns_cryptobatch_t	*signbatch;
+	dns_db_t		*signdb;
+	dns_dbversion_t		*signversion;
 	/*%
 	 * Signing / re-signing quantum stopping parameters.
 	 */
@@ -529,6 +539,7 @@ struct dns_zonemgr {
 	isc_taskpool_t *	loadtasks;
 	isc_task_t *		task;
 	isc_pool_t *		mctxpool;
+	dns_cryptopool_t *	cryptopool;
 	isc_ratelimiter_t *	notifyrl;
 	isc_ratelimiter_t *	refreshrl;
 	isc_ratelimiter_t *	startupnotifyrl;
@@ -816,6 +827,7 @@ static isc_result_t delete_nsec(dns_db_t *db, dns_dbversion_t *ver,
 				dns_dbnode_t *node, dns_name_t *name,
 				dns_diff_t *diff);
 static void zone_rekey(dns_zone_t *zone);
+static void zone_signbatchdone(isc_task_t *task, isc_event_t *event);
 static isc_result_t zone_send_securedb(dns_zone_t *zone, dns_db_t *db);
 static void setrl(isc_ratelimiter_t *rl, unsigned int *rate,
 		  unsigned int value);
@@ -1016,7 +1028,6 @@ dns_zone_create(dns_zone_t **zonep, isc_mem_t *mctx) {
 	zone->sigvalidityinterval = 30 * 24 * 3600;
 	zone->sigresigninginterval = 7 * 24 * 3600;
 	zone->view = NULL;
-	zone->acache = NULL;
 	zone->checkmx = NULL;
 	zone->checksrv = NULL;
 	zone->checkns = NULL;
@@ -1027,11 +1038,15 @@ dns_zone_create(dns_zone_t **zonep, isc_mem_t *mctx) {
 	zone->statlevel = dns_zonestat_none;
 	zone->requeststats = NULL;
 	zone->rcvquerystats = NULL;
+	zone->xfrintimes = NULL;
 	zone->notifydelay = 5;
 	zone->isself = NULL;
 	zone->isselfarg = NULL;
 	ISC_LIST_INIT(zone->signing);
 	ISC_LIST_INIT(zone->nsec3chain);
+	zone->signbatch = NULL;
+	zone->signdb = NULL;
+	zone->signversion = NULL;
 	zone->signatures = 10;
 	zone->nodes = 100;
 	zone->privatetype = (dns_rdatatype_t)0xffffU;
@@ -1113,6 +1128,7 @@ zone_free(dns_zone_t *zone) {
 	INSIST(zone->readio == NULL);
 	INSIST(zone->statelist == NULL);
 	INSIST(zone->writeio == NULL);
+	INSIST(zone->signbatch == NULL);
 
 	if (zone->task != NULL)
 		isc_task_detach(&zone->task);
@@ -1168,10 +1184,10 @@ zone_free(dns_zone_t *zone) {
 		isc_stats_detach(&zone->requeststats);
 	if (zone->rcvquerystats != NULL)
 		dns_stats_detach(&zone->rcvquerystats);
+	if (zone->xfrintimes != NULL)
+		isc_histo_detach(&zone->xfrintimes);
 	if (zone->db != NULL)
 		zone_detachdb(zone);
-	if (zone->acache != NULL)
-		dns_acache_detach(&zone->acache);
 	if (zone->rpzs != NULL) {
 		REQUIRE(zone->rpz_num < zone->rpzs->p.num_zones);
 		dns_rpz_detach_rpzs(&zone->rpzs);
@@ -1518,36 +1534,6 @@ dns_zone_setorigin(dns_zone_t *zone, const dns_name_t *origin) {
 	return (result);
 }
 
-void
-dns_zone_setacache(dns_zone_t *zone, dns_acache_t *acache) {
-	REQUIRE(DNS_ZONE_VALID(zone));
-	REQUIRE(acache != NULL);
-
-	LOCK_ZONE(zone);
-	if (zone->acache != NULL)
-		dns_acache_detach(&zone->acache);
-	dns_acache_attach(acache, &zone->acache);
-	ZONEDB_LOCK(&zone->dblock, isc_rwlocktype_read);
-	if (zone->db != NULL) {
-		isc_result_t result;
-
-		/*
-		 * If the zone reuses an existing DB, the DB needs to be
-		 * set in the acache explicitly.  We can safely ignore the
-		 * case where the DB is already set.  If other error happens,
-		 * the acache will not work effectively.
-		 */
-		result = dns_acache_setdb(acache, zone->db);
-		if (result != ISC_R_SUCCESS && result != ISC_R_EXISTS) {
-			UNEXPECTED_ERROR(__FILE__, __LINE__,
-					 "dns_acache_setdb() failed: %s",
-					 isc_result_totext(result));
-		}
-	}
-	ZONEDB_UNLOCK(&zone->dblock, isc_rwlocktype_read);
-	UNLOCK_ZONE(zone);
-}
-
 static isc_result_t
 dns_zone_setstring(dns_zone_t *zone, char **field, const char *value) {
 	char *copy;
@@ -6557,6 +6543,89 @@ add_nsec(dns_db_t *db, dns_dbversion_t *version, dns_name_t *name,
 	return (result);
 }
 
+/*
+ * Return ISC_TRUE if 'a' and 'b' hold the same records with the same TTL.
+ */
+static isc_boolean_t
+same_rdataset(dns_rdataset_t *a, dns_rdataset_t *b) {
+	isc_result_t resulta, resultb;
+	dns_rdata_t rdataa = DNS_RDATA_INIT;
+	dns_rdata_t rdatab = DNS_RDATA_INIT;
+
+	if (a->ttl != b->ttl ||
+	    dns_rdataset_count(a) != dns_rdataset_count(b))
+		return (ISC_FALSE);
+	for (resulta = dns_rdataset_first(a), resultb = dns_rdataset_first(b);
+	     resulta == ISC_R_SUCCESS && resultb == ISC_R_SUCCESS;
+	     resulta = dns_rdataset_next(a), resultb = dns_rdataset_next(b))
+	{
+		dns_rdataset_current(a, &rdataa);
+		dns_rdataset_current(b, &rdatab);
+		if (dns_rdata_compare(&rdataa, &rdatab) != 0)
+			return (ISC_FALSE);
+		dns_rdata_reset(&rdataa);
+		dns_rdata_reset(&rdatab);
+	}
+	return (ISC_TF(resulta == resultb));
+}
+
+/*
+ * Add the signatures that the crypto pool computed for sign_a_node()
+ * to 'version' of 'db' and to 'diff'.  They were computed from an
+ * earlier version, so a signature is dropped if the RRset it covers
+ * has changed or gone since, or has been signed with the same key.
+ */
+static isc_result_t
+add_batch_sigs(dns_db_t *db, dns_dbversion_t *version,
+	       isc_eventlist_t *results, dns_diff_t *diff)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_event_t *event;
+	dns_cryptoevent_t *cevent;
+	dns_dbnode_t *node;
+	dns_rdataset_t rdataset;
+	dns_rdatatype_t type;
+	dns_name_t *name;
+
+	dns_rdataset_init(&rdataset);
+	while ((event = ISC_LIST_HEAD(*results)) != NULL) {
+		ISC_LIST_UNLINK(*results, event, ev_link);
+		cevent = (dns_cryptoevent_t *)event;
+		name = dns_fixedname_name(&cevent->name);
+		type = cevent->rdataset.type;
+		node = NULL;
+		if (result == ISC_R_SUCCESS)
+			result = cevent->result;
+		if (result != ISC_R_SUCCESS)
+			goto next;
+		if (type == dns_rdatatype_nsec3)
+			result = dns_db_findnsec3node(db, name, ISC_FALSE,
+						      &node);
+		else
+			result = dns_db_findnode(db, name, ISC_FALSE, &node);
+		if (result == ISC_R_NOTFOUND) {
+			result = ISC_R_SUCCESS;
+			goto next;
+		}
+		if (result != ISC_R_SUCCESS)
+			goto next;
+		if (dns_db_findrdataset(db, node, version, type, 0, 0,
+					&rdataset, NULL) == ISC_R_SUCCESS &&
+		    same_rdataset(&rdataset, &cevent->rdataset) &&
+		    !signed_with_key(db, node, version, type, cevent->key))
+			result = update_one_rr(db, version, diff,
+					       DNS_DIFFOP_ADDRESIGN, name,
+					       rdataset.ttl,
+					       &cevent->sigrdata);
+		if (dns_rdataset_isassociated(&rdataset))
+			dns_rdataset_disassociate(&rdataset);
+		dns_db_detachnode(db, &node);
+ next:
+		isc_event_free(&event);
+	}
+	return (result);
+}
+
 static isc_result_t
 sign_a_node(dns_db_t *db, dns_name_t *name, dns_dbnode_t *node,
 	    dns_dbversion_t *version, isc_boolean_t build_nsec3,
@@ -6564,7 +6633,8 @@ sign_a_node(dns_db_t *db, dns_name_t *name, dns_dbnode_t *node,
 	    isc_stdtime_t inception, isc_stdtime_t expire,
 	    unsigned int minimum, isc_boolean_t is_ksk,
 	    isc_boolean_t keyset_kskonly, isc_boolean_t *delegation,
-	    dns_diff_t *diff, isc_int32_t *signatures, isc_mem_t *mctx)
+	    dns_diff_t *diff, isc_int32_t *signatures, isc_mem_t *mctx,
+	    dns_cryptobatch_t *batch)
 {
 	isc_result_t result;
 	dns_rdatasetiter_t *iterator = NULL;
@@ -6661,6 +6731,17 @@ sign_a_node(dns_db_t *db, dns_name_t *name, dns_dbnode_t *node,
 			goto next_rdataset;
 		if (signed_with_key(db, node, version, rdataset.type, key))
 			goto next_rdataset;
+		/*
+		 * Have the crypto pool calculate the signature if we can;
+		 * add_batch_sigs() adds it later.
+		 */
+		if (batch != NULL &&
+		    dns_cryptobatch_sign(batch, name, &rdataset, key,
+					 inception, expire) == ISC_R_SUCCESS)
+		{
+			(*signatures)--;
+			goto next_rdataset;
+		}
 		/* Calculate the signature, creating a RRSIG RDATA. */
 		isc_buffer_clear(&buffer);
 		CHECK(dns_dnssec_sign(name, &rdataset, key, &inception,
@@ -8021,6 +8102,26 @@ del_sig(dns_db_t *db, dns_dbversion_t *version, dns_name_t *name,
 	return (result);
 }
 
+/*
+ * Schedule the next zone_sign() quantum if there is still signing to
+ * be done and the last quantum is complete.  Retry in a minute if it
+ * failed.
+ */
+static void
+set_signingtime(dns_zone_t *zone, isc_result_t result) {
+	isc_interval_t interval;
+
+	if (ISC_LIST_HEAD(zone->signing) == NULL || zone->signbatch != NULL) {
+		isc_time_settoepoch(&zone->signingtime);
+		return;
+	}
+	if (zone->update_disabled || result != ISC_R_SUCCESS)
+		isc_interval_set(&interval, 60, 0);	  /* 1 minute */
+	else
+		isc_interval_set(&interval, 0, 10000000); /* 10 ms */
+	isc_time_nowplusinterval(&zone->signingtime, &interval);
+}
+
 /*
  * Incrementally sign the zone using the keys requested.
  * Builds the NSEC chain if required.
@@ -8054,9 +8155,21 @@ zone_sign(dns_zone_t *zone) {
 	unsigned int i, j;
 	unsigned int nkeys = 0;
 	isc_uint32_t nodes;
+	dns_cryptobatch_t *batch = NULL;
+	isc_event_t *signevent = NULL;
+	dns_zone_t *dummy = NULL;
 
 	ENTER;
 
+	/*
+	 * The signatures of the last quantum are still being computed;
+	 * zone_signbatchdone() schedules the next one.
+	 */
+	if (zone->signbatch != NULL) {
+		isc_time_settoepoch(&zone->signingtime);
+		return;
+	}
+
 	dns_rdataset_init(&rdataset);
 	dns_fixedname_init(&fixed);
 	name = dns_fixedname_name(&fixed);
@@ -8135,6 +8248,23 @@ zone_sign(dns_zone_t *zone) {
 	if (!build_nsec && !build_nsec3)
 		build_nsec = ISC_TRUE;
 
+	/*
+	 * Compute this quantum's signatures in parallel if there is a
+	 * crypto pool.
+	 */
+	LOCK_ZONE(zone);
+	if (zone->zmgr != NULL && zone->zmgr->cryptopool != NULL)
+		(void)dns_cryptobatch_create(zone->zmgr->cryptopool, &batch);
+	UNLOCK_ZONE(zone);
+	if (batch != NULL) {
+		signevent = isc_event_allocate(zone->mctx, zone,
+					       DNS_EVENT_CRYPTODONE,
+					       zone_signbatchdone, zone,
+					       sizeof(isc_event_t));
+		if (signevent == NULL)
+			dns_cryptobatch_destroy(&batch);
+	}
+
 	while (signing != NULL && nodes-- > 0 && signatures > 0) {
 		nextsigning = ISC_LIST_NEXT(signing, link);
 
@@ -8280,7 +8410,7 @@ zone_sign(dns_zone_t *zone) {
 					  expire, zone->minimum, is_ksk,
 					  ISC_TF(both && keyset_kskonly),
 					  &delegation, zonediff.diff,
-					  &signatures, zone->mctx));
+					  &signatures, zone->mctx, batch));
 			/*
 			 * If we are adding we are done.  Look for other keys
 			 * of the same algorithm if deleting.
@@ -8434,8 +8564,12 @@ zone_sign(dns_zone_t *zone) {
 		dns_dbiterator_pause(signing->dbiterator);
 
 	/*
-	 * Everything has succeeded. Commit the changes.
+	 * Everything has succeeded. Commit the changes.  The crypto pool
+	 * may still be reading RRsets of this version or of older ones;
+	 * holding the current version keeps them until it is done.
 	 */
+	if (batch != NULL)
+		dns_db_currentversion(db, &zone->signversion);
 	dns_db_closeversion(db, &version, commit);
 
 	/*
@@ -8459,7 +8593,32 @@ zone_sign(dns_zone_t *zone) {
 		UNLOCK_ZONE(zone);
 	}
 
+	/*
+	 * Rather than wait for the crypto pool, have it tell us when it
+	 * has computed the signatures queued by sign_a_node(), and add
+	 * them then.
+	 */
+	if (batch != NULL) {
+		LOCK_ZONE(zone);
+		dns_db_attach(db, &zone->signdb);
+		zone->signbatch = batch;
+		batch = NULL;
+		zone_iattach(zone, &dummy);
+		dns_cryptobatch_notify(zone->signbatch, zone->task,
+				       &signevent);
+		UNLOCK_ZONE(zone);
+	}
+
  failure:
+	/*
+	 * The pool's jobs refer to the new version; they must be done
+	 * before it is closed.
+	 */
+	if (batch != NULL)
+		dns_cryptobatch_destroy(&batch);
+	if (signevent != NULL)
+		isc_event_free(&signevent);
+
 	/*
 	 * Rollback the cleanup list.
 	 */
@@ -8491,19 +8650,180 @@ zone_sign(dns_zone_t *zone) {
 	} else if (db != NULL)
 		dns_db_detach(&db);
 
-	if (ISC_LIST_HEAD(zone->signing) != NULL) {
-		isc_interval_t interval;
-		if (zone->update_disabled || result != ISC_R_SUCCESS)
-			isc_interval_set(&interval, 60, 0);	  /* 1 minute */
-		else
-			isc_interval_set(&interval, 0, 10000000); /* 10 ms */
-		isc_time_nowplusinterval(&zone->signingtime, &interval);
-	} else
-		isc_time_settoepoch(&zone->signingtime);
+	set_signingtime(zone, result);
 
 	INSIST(version == NULL);
 }
 
+/*
+ * The crypto pool has computed the signatures of the last zone_sign()
+ * quantum.  Add them to the zone in a transaction of their own and
+ * schedule the next quantum.
+ */
+static void
+zone_signbatchdone(isc_task_t *task, isc_event_t *event) {
+	const char *me = "zone_signbatchdone";
+	dns_zone_t *zone = event->ev_arg;
+	dns_cryptobatch_t *batch;
+	dns_db_t *db;
+	dns_dbversion_t *oldversion, *version = NULL;
+	dns_diff_t _sig_diff;
+	zonediff_t zonediff;
+	dst_key_t *zone_keys[DNS_MAXZONEKEYS];
+	isc_boolean_t check_ksk, keyset_kskonly;
+	isc_boolean_t reloaded;
+	isc_eventlist_t results;
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_stdtime_t now, inception, soaexpire;
+	isc_time_t timenow;
+	unsigned int i, nkeys = 0;
+
+	UNUSED(task);
+
+	INSIST(DNS_ZONE_VALID(zone));
+
+	ENTER;
+
+	isc_event_free(&event);
+	dns_diff_init(zone->mctx, &_sig_diff);
+	zonediff_init(&zonediff, &_sig_diff);
+	ISC_LIST_INIT(results);
+
+	LOCK_ZONE(zone);
+	batch = zone->signbatch;
+	db = zone->signdb;
+	oldversion = zone->signversion;
+	zone->signbatch = NULL;
+	zone->signdb = NULL;
+	zone->signversion = NULL;
+	UNLOCK_ZONE(zone);
+	INSIST(batch != NULL && db != NULL && oldversion != NULL);
+
+	/*
+	 * Every job is done, so this doesn't block.
+	 */
+	dns_cryptobatch_wait(batch, &results);
+	if (ISC_LIST_EMPTY(results) ||
+	    DNS_ZONE_FLAG(zone, DNS_ZONEFLG_EXITING))
+		goto failure;
+
+	/*
+	 * The signatures are useless if the zone has been reloaded.
+	 */
+	ZONEDB_LOCK(&zone->dblock, isc_rwlocktype_read);
+	reloaded = ISC_TF(zone->db != db);
+	ZONEDB_UNLOCK(&zone->dblock, isc_rwlocktype_read);
+	if (reloaded)
+		goto failure;
+
+	result = dns_db_newversion(db, &version);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "zone_signbatchdone:dns_db_newversion -> %s",
+			     dns_result_totext(result));
+		goto failure;
+	}
+
+	isc_stdtime_get(&now);
+
+	result = find_zone_keys(zone, db, version, now, zone->mctx,
+				DNS_MAXZONEKEYS, zone_keys, &nkeys);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "zone_signbatchdone:find_zone_keys -> %s",
+			     dns_result_totext(result));
+		goto failure;
+	}
+
+	inception = now - 3600;	/* Allow for clock skew. */
+	soaexpire = now + dns_zone_getsigvalidityinterval(zone);
+	check_ksk = DNS_ZONE_OPTION(zone, DNS_ZONEOPT_UPDATECHECKKSK);
+	keyset_kskonly = DNS_ZONE_OPTION(zone, DNS_ZONEOPT_DNSKEYKSKONLY);
+
+	result = add_batch_sigs(db, version, &results, zonediff.diff);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "zone_signbatchdone:add_batch_sigs -> %s",
+			     dns_result_totext(result));
+		goto failure;
+	}
+
+	/*
+	 * Have we changed anything?
+	 */
+	if (ISC_LIST_EMPTY(zonediff.diff->tuples))
+		goto failure;
+
+	result = del_sigs(zone, db, version, &zone->origin, dns_rdatatype_soa,
+			  &zonediff, zone_keys, nkeys, now, ISC_FALSE);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "zone_signbatchdone:del_sigs -> %s",
+			     dns_result_totext(result));
+		goto failure;
+	}
+
+	result = update_soa_serial(db, version, zonediff.diff, zone->mctx,
+				   zone->updatemethod);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "zone_signbatchdone:update_soa_serial -> %s",
+			     dns_result_totext(result));
+		goto failure;
+	}
+
+	result = add_sigs(db, version, &zone->origin, dns_rdatatype_soa,
+			  zonediff.diff, zone_keys, nkeys, zone->mctx,
+			  inception, soaexpire, check_ksk, keyset_kskonly);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "zone_signbatchdone:add_sigs -> %s",
+			     dns_result_totext(result));
+		goto failure;
+	}
+
+	/*
+	 * Write changes to journal file.
+	 */
+	CHECK(zone_journal(zone, zonediff.diff, NULL, "zone_signbatchdone"));
+
+	/*
+	 * Everything has succeeded. Commit the changes.
+	 */
+	dns_db_closeversion(db, &version, ISC_TRUE);
+	set_resigntime(zone);
+
+	LOCK_ZONE(zone);
+	DNS_ZONE_SETFLAG(zone, DNS_ZONEFLG_NEEDNOTIFY);
+	zone_needdump(zone, DNS_DUMP_DELAY);
+	UNLOCK_ZONE(zone);
+
+ failure:
+	while ((event = ISC_LIST_HEAD(results)) != NULL) {
+		ISC_LIST_UNLINK(results, event, ev_link);
+		isc_event_free(&event);
+	}
+	dns_cryptobatch_destroy(&batch);
+
+	dns_diff_clear(&_sig_diff);
+
+	for (i = 0; i < nkeys; i++)
+		dst_key_free(&zone_keys[i]);
+
+	if (version != NULL)
+		dns_db_closeversion(db, &version, ISC_FALSE);
+	dns_db_closeversion(db, &oldversion, ISC_FALSE);
+	dns_db_detach(&db);
+
+	LOCK_ZONE(zone);
+	set_signingtime(zone, result);
+	TIME_NOW(&timenow);
+	zone_settimer(zone, &timenow);
+	UNLOCK_ZONE(zone);
+
+	dns_zone_idetach(&zone);
+}
+
 static isc_result_t
 normalize_key(dns_rdata_t *rr, dns_rdata_t *target,
 	      unsigned char *data, int size)
@@ -14627,15 +14947,6 @@ zone_attachdb(dns_zone_t *zone, dns_db_t *db) {
 	REQUIRE(zone->db == NULL && db != NULL);
 
 	dns_db_attach(db, &zone->db);
-	if (zone->acache != NULL) {
-		isc_result_t result;
-		result = dns_acache_setdb(zone->acache, db);
-		if (result != ISC_R_SUCCESS && result != ISC_R_EXISTS) {
-			UNEXPECTED_ERROR(__FILE__, __LINE__,
-					 "dns_acache_setdb() failed: %s",
-					 isc_result_totext(result));
-		}
-	}
 }
 
 /* The caller must hold the dblock as a writer. */
@@ -14643,8 +14954,11 @@ static inline void
 zone_detachdb(dns_zone_t *zone) {
 	REQUIRE(zone->db != NULL);
 
-	if (zone->acache != NULL)
-		(void)dns_acache_putdb(zone->acache, zone->db);
+	/*
+	 * Cached responses don't keep the database alive.
+	 */
+	if (zone->view != NULL && zone->view->respcache != NULL)
+		dns_respcache_flushdb(zone->view->respcache, zone->db);
 	dns_db_detach(&zone->db);
 }
 
@@ -15537,6 +15851,7 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	zmgr->zonetasks = NULL;
 	zmgr->loadtasks = NULL;
 	zmgr->mctxpool = NULL;
+	zmgr->cryptopool = NULL;
 	zmgr->task = NULL;
 	zmgr->notifyrl = NULL;
 	zmgr->refreshrl = NULL;
@@ -15952,6 +16267,8 @@ zonemgr_free(dns_zonemgr_t *zmgr) {
 	isc_ratelimiter_detach(&zmgr->refreshrl);
 	isc_ratelimiter_detach(&zmgr->startupnotifyrl);
 	isc_ratelimiter_detach(&zmgr->startuprefreshrl);
+	if (zmgr->cryptopool != NULL)
+		dns_cryptopool_detach(&zmgr->cryptopool);
 
 	isc_rwlock_destroy(&zmgr->urlock);
 	isc_rwlock_destroy(&zmgr->rwlock);
@@ -16142,6 +16459,16 @@ dns_zonemgr_setiolimit(dns_zonemgr_t *zmgr, isc_uint32_t iolimit) {
 	zmgr->iolimit = iolimit;
 }
 
+void
+dns_zonemgr_setcryptopool(dns_zonemgr_t *zmgr, dns_cryptopool_t *pool) {
+
+	REQUIRE(DNS_ZONEMGR_VALID(zmgr));
+
+	if (zmgr->cryptopool != NULL)
+		dns_cryptopool_detach(&zmgr->cryptopool);
+	dns_cryptopool_attach(pool, &zmgr->cryptopool);
+}
+
 isc_uint32_t
 dns_zonemgr_getiolimit(dns_zonemgr_t *zmgr) {
 
@@ -16605,6 +16932,19 @@ dns_zone_setrcvquerystats(dns_zone_t *zone, dns_stats_t *stats) {
 	UNLOCK_ZONE(zone);
 }
 
+void
+dns_zone_setxfrintimes(dns_zone_t *zone, isc_histo_t *histo) {
+
+	REQUIRE(DNS_ZONE_VALID(zone));
+
+	LOCK_ZONE(zone);
+	if (zone->requeststats_on && histo != NULL) {
+		if (zone->xfrintimes == NULL)
+			isc_histo_attach(histo, &zone->xfrintimes);
+	}
+	UNLOCK_ZONE(zone);
+}
+
 isc_stats_t *
 dns_zone_getrequeststats(dns_zone_t *zone) {
 	/*
@@ -16633,6 +16973,18 @@ dns_zone_getrcvquerystats(dns_zone_t *zone) {
 		return (NULL);
 }
 
+/*
+ * Return the incoming transfer duration histogram
+ * see note from dns_zone_getrequeststats()
+ */
+isc_histo_t *
+dns_zone_getxfrintimes(dns_zone_t *zone) {
+	if (zone->requeststats_on)
+		return (zone->xfrintimes);
+	else
+		return (NULL);
+}
+
 void
 dns_zone_dialup(dns_zone_t *zone) {
 
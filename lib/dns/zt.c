@@ -80,7 +80,7 @@ dns_zt_create(isc_mem_t *mctx, dns_rdataclass_t rdclass, dns_zt_t **ztp) {
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_zt;
 
-	result = isc_rwlock_init(&zt->rwlock, 0, 0);
+	result = isc_rwlock_initdistributed(&zt->rwlock, mctx);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup_rbt;
 
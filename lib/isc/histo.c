@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <isc/histo.h>
+#include <isc/magic.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/stats.h>
+#include <isc/util.h>
+
+#define ISC_HISTO_MAGIC			ISC_MAGIC('H', 's', 't', 'o')
+#define ISC_HISTO_VALID(x)		ISC_MAGIC_VALID(x, ISC_HISTO_MAGIC)
+
+#define SUBMASK		(ISC_HISTO_SUBBUCKETS - 1)
+#define MAXVALUE	(((isc_uint64_t)1 << ISC_HISTO_MAXBITS) - 1)
+
+/*%
+ * Bucket numbers below ISC_HISTO_SUBBUCKETS hold exactly their own
+ * value.  Above that, a value whose most significant bit is 'e' falls
+ * into group 'e - SUBBITS + 1', and the SUBBITS bits below its most
+ * significant bit select the bucket within the group.
+ */
+
+struct isc_histo {
+	/*% Unlocked */
+	unsigned int	magic;
+	isc_mem_t	*mctx;
+	isc_stats_t	*buckets;
+
+	isc_mutex_t	lock;
+	unsigned int	references;	/* locked by lock */
+};
+
+static inline unsigned int
+msbit(isc_uint64_t value) {
+	unsigned int bit = 0;
+
+	if ((value >> 32) != 0) {
+		value >>= 32;
+		bit += 32;
+	}
+	if ((value >> 16) != 0) {
+		value >>= 16;
+		bit += 16;
+	}
+	if ((value >> 8) != 0) {
+		value >>= 8;
+		bit += 8;
+	}
+	if ((value >> 4) != 0) {
+		value >>= 4;
+		bit += 4;
+	}
+	if ((value >> 2) != 0) {
+		value >>= 2;
+		bit += 2;
+	}
+	if ((value >> 1) != 0)
+		bit += 1;
+	return (bit);
+}
+
+unsigned int
+isc_histo_bucket(isc_uint64_t value) {
+	unsigned int shift;
+
+	if (value < ISC_HISTO_SUBBUCKETS)
+		return ((unsigned int)value);
+	if (value > MAXVALUE)
+		value = MAXVALUE;
+
+	shift = msbit(value) - ISC_HISTO_SUBBITS;
+	return ((shift + 1) * ISC_HISTO_SUBBUCKETS +
+		(unsigned int)((value >> shift) & SUBMASK));
+}
+
+static inline isc_uint64_t
+lowest(unsigned int bucket) {
+	unsigned int group;
+
+	if (bucket < ISC_HISTO_SUBBUCKETS)
+		return (bucket);
+
+	group = bucket / ISC_HISTO_SUBBUCKETS;
+	return ((isc_uint64_t)(ISC_HISTO_SUBBUCKETS + (bucket & SUBMASK)) <<
+		(group - 1));
+}
+
+void
+isc_histo_bucketrange(unsigned int bucket, isc_uint64_t *lowerp,
+		      isc_uint64_t *upperp)
+{
+	REQUIRE(bucket < ISC_HISTO_NBUCKETS);
+	REQUIRE(lowerp != NULL && upperp != NULL);
+
+	*lowerp = lowest(bucket);
+	if (bucket == ISC_HISTO_NBUCKETS - 1)
+		*upperp = ISC_UINT64_MAX;
+	else
+		*upperp = lowest(bucket + 1) - 1;
+}
+
+isc_result_t
+isc_histo_create(isc_mem_t *mctx, unsigned int flags,
+		 isc_histo_t **histop)
+{
+	isc_histo_t *histo;
+	isc_result_t result;
+
+	REQUIRE(histop != NULL && *histop == NULL);
+
+	histo = isc_mem_get(mctx, sizeof(*histo));
+	if (histo == NULL)
+		return (ISC_R_NOMEMORY);
+
+	result = isc_mutex_init(&histo->lock);
+	if (result != ISC_R_SUCCESS)
+		goto clean_histo;
+
+	histo->buckets = NULL;
+	result = isc_stats_create2(mctx, &histo->buckets, ISC_HISTO_NBUCKETS,
+				   (flags & ISC_HISTO_SHARDED) != 0 ?
+				   ISC_STATS_SHARDED : 0);
+	if (result != ISC_R_SUCCESS)
+		goto clean_mutex;
+
+	histo->references = 1;
+	histo->mctx = NULL;
+	isc_mem_attach(mctx, &histo->mctx);
+	histo->magic = ISC_HISTO_MAGIC;
+
+	*histop = histo;
+
+	return (ISC_R_SUCCESS);
+
+clean_mutex:
+	DESTROYLOCK(&histo->lock);
+
+clean_histo:
+	isc_mem_put(mctx, histo, sizeof(*histo));
+
+	return (result);
+}
+
+void
+isc_histo_attach(isc_histo_t *histo, isc_histo_t **histop) {
+	REQUIRE(ISC_HISTO_VALID(histo));
+	REQUIRE(histop != NULL && *histop == NULL);
+
+	LOCK(&histo->lock);
+	histo->references++;
+	UNLOCK(&histo->lock);
+
+	*histop = histo;
+}
+
+void
+isc_histo_detach(isc_histo_t **histop) {
+	isc_histo_t *histo;
+	isc_boolean_t destroy;
+
+	REQUIRE(histop != NULL && ISC_HISTO_VALID(*histop));
+
+	histo = *histop;
+	*histop = NULL;
+
+	LOCK(&histo->lock);
+	histo->references--;
+	destroy = ISC_TF(histo->references == 0);
+	UNLOCK(&histo->lock);
+
+	if (destroy) {
+		isc_stats_detach(&histo->buckets);
+		DESTROYLOCK(&histo->lock);
+		histo->magic = 0;
+		isc_mem_putanddetach(&histo->mctx, histo, sizeof(*histo));
+	}
+}
+
+void
+isc_histo_add(isc_histo_t *histo, isc_uint64_t value) {
+	REQUIRE(ISC_HISTO_VALID(histo));
+
+	isc_stats_increment(histo->buckets, isc_histo_bucket(value));
+}
+
+/*%
+ * Take a snapshot of all the buckets.
+ */
+static void
+getcount(isc_statscounter_t bucket, isc_uint64_t count, void *arg) {
+	isc_uint64_t *counts = arg;
+
+	counts[bucket] = count;
+}
+
+static isc_uint64_t
+snapshot(isc_histo_t *histo, isc_uint64_t *counts) {
+	isc_uint64_t total = 0;
+	unsigned int b;
+
+	memset(counts, 0, sizeof(*counts) * ISC_HISTO_NBUCKETS);
+	isc_stats_dump(histo->buckets, getcount, counts, 0);
+	for (b = 0; b < ISC_HISTO_NBUCKETS; b++)
+		total += counts[b];
+	return (total);
+}
+
+void
+isc_histo_dump(isc_histo_t *histo, isc_histo_dumper_t dump_fn, void *arg) {
+	isc_uint64_t counts[ISC_HISTO_NBUCKETS];
+	isc_uint64_t lower, upper;
+	unsigned int b;
+
+	REQUIRE(ISC_HISTO_VALID(histo));
+
+	(void)snapshot(histo, counts);
+	for (b = 0; b < ISC_HISTO_NBUCKETS; b++) {
+		if (counts[b] == 0)
+			continue;
+		isc_histo_bucketrange(b, &lower, &upper);
+		dump_fn(lower, upper, counts[b], arg);
+	}
+}
+
+isc_uint64_t
+isc_histo_quantiles(isc_histo_t *histo, unsigned int n,
+		    const double *fractions, isc_uint64_t *values)
+{
+	isc_uint64_t counts[ISC_HISTO_NBUCKETS];
+	isc_uint64_t total, rank, seen, lower;
+	unsigned int i, b;
+	double f;
+
+	REQUIRE(ISC_HISTO_VALID(histo));
+	REQUIRE(n == 0 || (fractions != NULL && values != NULL));
+
+	total = snapshot(histo, counts);
+
+	for (i = 0; i < n; i++) {
+		values[i] = 0;
+		if (total == 0)
+			continue;
+
+		/*
+		 * The quantile is the value of rank ceil(f * total),
+		 * counting from 1.
+		 */
+		f = fractions[i];
+		if (f < 0.0)
+			f = 0.0;
+		if (f > 1.0)
+			f = 1.0;
+		rank = (isc_uint64_t)(f * (double)total);
+		if ((double)rank < f * (double)total)
+			rank++;
+		if (rank == 0)
+			rank = 1;
+		if (rank > total)
+			rank = total;
+
+		seen = 0;
+		for (b = 0; b < ISC_HISTO_NBUCKETS; b++) {
+			seen += counts[b];
+			if (seen >= rank)
+				break;
+		}
+		INSIST(b < ISC_HISTO_NBUCKETS);
+		isc_histo_bucketrange(b, &lower, &values[i]);
+	}
+
+	return (total);
+}
@@ -60,6 +60,8 @@
 #define HTTPD_FOUNDHOST		0x0002 /* Got a Host: header */
 #define HTTPD_KEEPALIVE		0x0004 /* Got a Connection: Keep-Alive */
 #define HTTPD_ACCEPT_DEFLATE   0x0008
+#define HTTPD_CHUNKED		0x0010 /* Streaming with chunked encoding */
+#define HTTPD_CHUNKOPEN		0x0020 /* A chunk needs its closing CRLF */
 
 /*% http client */
 struct isc_httpd {
@@ -120,6 +122,14 @@ struct isc_httpd {
 	isc_buffer_t		bodybuffer;
 	isc_httpdfree_t	       *freecb;
 	void		       *freecb_arg;
+
+	/*%
+	 * Streamed response state.  While 'next' is set, each senddone
+	 * asks it for the next piece of the body instead of waiting for
+	 * another request.
+	 */
+	isc_httpdnext_t	       *next;
+	void		       *next_arg;
 };
 
 /*% lightweight socket manager for httpd output */
@@ -206,6 +216,8 @@ static isc_result_t process_request(isc_httpd_t *, int);
 static void httpdmgr_destroy(isc_httpdmgr_t *);
 static isc_result_t grow_headerspace(isc_httpd_t *);
 static void reset_client(isc_httpd_t *httpd);
+static void stream_end(isc_httpd_t *httpd);
+static void stream_send(isc_httpd_t *httpd, isc_task_t *task);
 
 static isc_httpdaction_t render_404;
 static isc_httpdaction_t render_500;
@@ -220,6 +232,9 @@ destroy_client(isc_httpd_t **httpdp) {
 
 	*httpdp = NULL;
 
+	if (httpd->next != NULL)
+		stream_end(httpd);
+
 	LOCK(&httpdmgr->lock);
 
 	isc_socket_detach(&httpd->sock);
@@ -667,6 +682,8 @@ isc_httpd_accept(isc_task_t *task, isc_event_t *ev) {
 
 	isc_buffer_initnull(&httpd->compbuffer);
 	isc_buffer_initnull(&httpd->bodybuffer);
+	httpd->next = NULL;
+	httpd->next_arg = NULL;
 	reset_client(httpd);
 
 	r.base = (unsigned char *)httpd->recvbuf;
@@ -897,7 +914,21 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 						&httpd->bodybuffer,
 						&httpd->freecb,
 						&httpd->freecb_arg);
-	else
+	else if (url->stream != NULL) {
+		httpd->freecb = NULL;
+		httpd->freecb_arg = NULL;
+		result = url->stream(httpd->url, url,
+				     httpd->querystring,
+				     httpd->headers,
+				     url->action_arg,
+				     &httpd->retcode, &httpd->retmsg,
+				     &httpd->mimetype,
+				     &httpd->next, &httpd->next_arg);
+		if (result != ISC_R_SUCCESS) {
+			httpd->next = NULL;
+			httpd->next_arg = NULL;
+		}
+	} else
 		result = url->action(httpd->url, url,
 				     httpd->querystring,
 				     httpd->headers,
@@ -919,7 +950,7 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 	}
 
 #ifdef HAVE_ZLIB
-	if (httpd->flags & HTTPD_ACCEPT_DEFLATE) {
+	if (httpd->flags & HTTPD_ACCEPT_DEFLATE && httpd->next == NULL) {
 			result = isc_httpd_compress(httpd);
 			if (result == ISC_R_SUCCESS) {
 				is_compressed = ISC_TRUE;
@@ -927,6 +958,19 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 	}
 #endif
 
+	/*
+	 * The length of a streamed response is not known up front: an
+	 * HTTP/1.0 client is told it ends when the connection closes.
+	 */
+	if (httpd->next != NULL) {
+		if (strcmp(httpd->protocol, "HTTP/1.1") == 0)
+			httpd->flags |= HTTPD_CHUNKED;
+		else {
+			httpd->flags |= HTTPD_CLOSE;
+			httpd->flags &= ~HTTPD_KEEPALIVE;
+		}
+	}
+
 	isc_httpd_response(httpd);
 	if ((httpd->flags & HTTPD_KEEPALIVE) != 0)
 		isc_httpd_addheader(httpd, "Connection", "Keep-Alive");
@@ -948,7 +992,13 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 
 	isc_httpd_addheader(httpd, "Server: libisc", NULL);
 
-	if (is_compressed == ISC_TRUE) {
+	if (httpd->next != NULL) {
+		if ((httpd->flags & HTTPD_CHUNKED) != 0)
+			isc_httpd_addheader(httpd, "Transfer-Encoding",
+					    "chunked");
+		else
+			isc_httpd_addheader(httpd, "Connection", "close");
+	} else if (is_compressed == ISC_TRUE) {
 		isc_httpd_addheader(httpd, "Content-Encoding", "deflate");
 		isc_httpd_addheaderuint(httpd, "Content-Length",
 					isc_buffer_usedlength(&httpd->compbuffer));
@@ -959,6 +1009,11 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 
 	isc_httpd_endheaders(httpd);  /* done */
 
+	if (httpd->next != NULL) {
+		stream_send(httpd, task);
+		goto out;
+	}
+
 	ISC_LIST_APPEND(httpd->bufflist, &httpd->headerbuffer, link);
 	/*
 	 * Link the data buffer into our send queue, should we have any data
@@ -982,6 +1037,74 @@ isc_httpd_recvdone(isc_task_t *task, isc_event_t *ev) {
 	EXIT("recv");
 }
 
+/*%
+ * Release the chunk function's argument once a streamed response is
+ * complete or abandoned.
+ */
+static void
+stream_end(isc_httpd_t *httpd) {
+	isc_httpdnext_t *next = httpd->next;
+	void *next_arg = httpd->next_arg;
+
+	httpd->next = NULL;
+	httpd->next_arg = NULL;
+	(void)(next)(NULL, next_arg);
+}
+
+/*%
+ * Send the next piece of a streamed response after whatever is already
+ * in the header buffer.  With chunked encoding the header buffer also
+ * carries the framing: the CRLF closing the previous chunk followed by
+ * the size of this one, or by the final zero-length chunk.
+ */
+static void
+stream_send(isc_httpd_t *httpd, isc_task_t *task) {
+	isc_result_t result;
+	unsigned int length = 0;
+	char sizebuf[sizeof("\r\nffffffff")];
+
+	do {
+		isc_buffer_initnull(&httpd->bodybuffer);
+		result = (httpd->next)(&httpd->bodybuffer, httpd->next_arg);
+		if (result == ISC_R_SUCCESS)
+			length = isc_buffer_usedlength(&httpd->bodybuffer);
+	} while (result == ISC_R_SUCCESS && length == 0);
+
+	if (result != ISC_R_SUCCESS && result != ISC_R_NOMORE) {
+		NOTICE("stream_send chunk function failed");
+		destroy_client(&httpd);
+		return;
+	}
+
+	if (result == ISC_R_NOMORE)
+		stream_end(httpd);
+
+	if ((httpd->flags & HTTPD_CHUNKED) != 0) {
+		snprintf(sizebuf, sizeof(sizebuf), "%s%x",
+			 (httpd->flags & HTTPD_CHUNKOPEN) != 0 ? "\r\n" : "",
+			 length);
+		isc_httpd_addheader(httpd, sizebuf, NULL);
+		if (length == 0)
+			isc_httpd_endheaders(httpd);
+		httpd->flags |= HTTPD_CHUNKOPEN;
+	}
+
+	if (isc_buffer_usedlength(&httpd->headerbuffer) == 0 && length == 0) {
+		/* An HTTP/1.0 stream ends with the connection. */
+		destroy_client(&httpd);
+		return;
+	}
+
+	if (isc_buffer_usedlength(&httpd->headerbuffer) > 0)
+		ISC_LIST_APPEND(httpd->bufflist, &httpd->headerbuffer, link);
+	if (length > 0)
+		ISC_LIST_APPEND(httpd->bufflist, &httpd->bodybuffer, link);
+
+	/* check return code? */
+	(void)isc_socket_sendv(httpd->sock, &httpd->bufflist, task,
+			       isc_httpd_senddone, httpd);
+}
+
 void
 isc_httpdmgr_shutdown(isc_httpdmgr_t **httpdmgrp) {
 	isc_httpdmgr_t *httpdmgr;
@@ -1140,7 +1263,8 @@ isc_httpd_senddone(isc_task_t *task, isc_event_t *ev) {
 	 * and we know it's address, so we can just remove it directly.
 	 */
 	NOTICE("senddone unlinked header");
-	ISC_LIST_UNLINK(sev->bufferlist, &httpd->headerbuffer, link);
+	if (ISC_LINK_LINKED(&httpd->headerbuffer, link))
+		ISC_LIST_UNLINK(sev->bufferlist, &httpd->headerbuffer, link);
 
 	/*
 	 * We will always want to clean up our receive buffer, even if we
@@ -1170,6 +1294,13 @@ isc_httpd_senddone(isc_task_t *task, isc_event_t *ev) {
 		goto out;
 	}
 
+	if (httpd->next != NULL) {
+		NOTICE("senddone sending next piece of stream");
+		isc_buffer_clear(&httpd->headerbuffer);
+		stream_send(httpd, task);
+		goto out;
+	}
+
 	if ((httpd->flags & HTTPD_CLOSE) != 0) {
 		destroy_client(&httpd);
 		goto out;
@@ -1201,6 +1332,7 @@ reset_client(isc_httpd_t *httpd) {
 	INSIST(ISC_HTTPD_ISRECV(httpd));
 	INSIST(!ISC_LINK_LINKED(&httpd->headerbuffer, link));
 	INSIST(!ISC_LINK_LINKED(&httpd->bodybuffer, link));
+	INSIST(httpd->next == NULL);
 
 	httpd->recvbuf[0] = 0;
 	httpd->recvlen = 0;
@@ -1246,6 +1378,7 @@ isc_httpdmgr_addurl2(isc_httpdmgr_t *httpdmgr, const char *url,
 	}
 
 	item->action = func;
+	item->stream = NULL;
 	item->action_arg = arg;
 	item->isstatic = isstatic;
 	isc_time_now(&item->loadtime);
@@ -1256,6 +1389,26 @@ isc_httpdmgr_addurl2(isc_httpdmgr_t *httpdmgr, const char *url,
 	return (ISC_R_SUCCESS);
 }
 
+isc_result_t
+isc_httpdmgr_addstream(isc_httpdmgr_t *httpdmgr, const char *url,
+		       isc_httpdstream_t *func, void *arg)
+{
+	isc_httpdurl_t *item;
+	isc_result_t result;
+
+	REQUIRE(url != NULL);
+	REQUIRE(func != NULL);
+
+	result = isc_httpdmgr_addurl2(httpdmgr, url, ISC_FALSE, NULL, arg);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	item = ISC_LIST_TAIL(httpdmgr->urls);
+	item->stream = func;
+
+	return (ISC_R_SUCCESS);
+}
+
 void
 isc_httpd_setfinishhook(void (*fn)(void))
 {
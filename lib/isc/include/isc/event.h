@@ -32,6 +32,7 @@ typedef void (*isc_eventdestructor_t)(isc_event_t *);
 	void *				ev_sender; \
 	isc_eventdestructor_t		ev_destroy; \
 	void *				ev_destroy_arg; \
+	isc_uint64_t			ev_timestamp; \
 	ISC_LINK(ltype)			ev_link
 
 /*%
@@ -61,6 +62,7 @@ do { \
 	(event)->ev_sender = (sn); \
 	(event)->ev_destroy = (df); \
 	(event)->ev_destroy_arg = (da); \
+	(event)->ev_timestamp = 0; \
 	ISC_LINK_INIT((event), ev_link); \
 } while (0)
 
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+#ifndef ISC_HISTO_H
+#define ISC_HISTO_H 1
+
+/*! \file isc/histo.h
+ * \brief Log-linear histograms of unsigned values.
+ *
+ * Each power of two is split into #ISC_HISTO_SUBBUCKETS equal buckets,
+ * so a value is never reported more than 12.5% above what was recorded,
+ * whatever its magnitude.  Values of 2^40 and above are counted in the
+ * last bucket.
+ *
+ * Adding a value is lock-free: the buckets are counters in an
+ * isc_stats_t.  A histogram created with #ISC_HISTO_SHARDED keeps them
+ * in per-CPU shards, so that threads adding values do not contend.
+ */
+
+#include <isc/types.h>
+
+ISC_LANG_BEGINDECLS
+
+#define ISC_HISTO_SUBBITS	3
+#define ISC_HISTO_SUBBUCKETS	(1 << ISC_HISTO_SUBBITS)
+#define ISC_HISTO_MAXBITS	40
+#define ISC_HISTO_NBUCKETS \
+	((ISC_HISTO_MAXBITS - ISC_HISTO_SUBBITS + 1) * ISC_HISTO_SUBBUCKETS)
+
+/*%
+ * Flags for isc_histo_create().
+ */
+#define ISC_HISTO_SHARDED	0x00000001
+
+/*%<
+ * Dump callback type: the lowest and highest value counted in a bucket,
+ * and how many values it holds.
+ */
+typedef void (*isc_histo_dumper_t)(isc_uint64_t, isc_uint64_t, isc_uint64_t,
+				   void *);
+
+isc_result_t
+isc_histo_create(isc_mem_t *mctx, unsigned int flags, isc_histo_t **histop);
+/*%<
+ * Create an empty histogram.
+ *
+ * If 'flags' includes ISC_HISTO_SHARDED, the buckets are kept in per-CPU
+ * shards (see isc_stats_create2()).  This should be used for histograms
+ * that every query updates, such as the query latency ones.
+ *
+ * Requires:
+ *\li	'mctx' must be a valid memory context.
+ *
+ *\li	'histop' != NULL && '*histop' == NULL.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS	-- all ok
+ *
+ *\li	anything else	-- failure
+ */
+
+void
+isc_histo_attach(isc_histo_t *histo, isc_histo_t **histop);
+/*%<
+ * Attach to a histogram.
+ *
+ * Requires:
+ *\li	'histo' is a valid isc_histo_t.
+ *
+ *\li	'histop' != NULL && '*histop' == NULL
+ */
+
+void
+isc_histo_detach(isc_histo_t **histop);
+/*%<
+ * Detach from a histogram.
+ *
+ * Requires:
+ *\li	'histop' != NULL and '*histop' is a valid isc_histo_t.
+ */
+
+void
+isc_histo_add(isc_histo_t *histo, isc_uint64_t value);
+/*%<
+ * Count 'value' in its bucket.
+ *
+ * Requires:
+ *\li	'histo' is a valid isc_histo_t.
+ */
+
+void
+isc_histo_dump(isc_histo_t *histo, isc_histo_dumper_t dump_fn, void *arg);
+/*%<
+ * Call 'dump_fn' once for each non-empty bucket, lowest values first.
+ *
+ * Requires:
+ *\li	'histo' is a valid isc_histo_t.
+ */
+
+isc_uint64_t
+isc_histo_quantiles(isc_histo_t *histo, unsigned int n,
+		    const double *fractions, isc_uint64_t *values);
+/*%<
+ * Estimate 'n' quantiles at once from a single snapshot of the buckets.
+ * Each 'fractions[i]' is between 0.0 and 1.0 (0.99 for the 99th
+ * percentile) and its quantile is stored in 'values[i]' as the highest
+ * value of the bucket it falls into; 0 if the histogram is empty.
+ *
+ * Returns the number of values counted in the snapshot.
+ *
+ * Requires:
+ *\li	'histo' is a valid isc_histo_t.
+ *
+ *\li	'fractions' and 'values' point to arrays of 'n' elements.
+ */
+
+void
+isc_histo_bucketrange(unsigned int bucket, isc_uint64_t *lowerp,
+		      isc_uint64_t *upperp);
+/*%<
+ * Return the lowest and highest values counted in 'bucket'.
+ *
+ * Requires:
+ *\li	'bucket' < ISC_HISTO_NBUCKETS.
+ */
+
+unsigned int
+isc_histo_bucket(isc_uint64_t value);
+/*%<
+ * Return the bucket 'value' is counted in.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* ISC_HISTO_H */
@@ -30,6 +30,7 @@
 struct isc_httpdurl {
 	char			       *url;
 	isc_httpdaction_t	       *action;
+	isc_httpdstream_t	       *stream;
 	void			       *action_arg;
 	isc_boolean_t			isstatic;
 	isc_time_t			loadtime;
@@ -63,6 +64,31 @@ isc_httpdmgr_addurl2(isc_httpdmgr_t *httpdmgr, const char *url,
 		     isc_boolean_t isstatic,
 		     isc_httpdaction_t *func, void *arg);
 
+isc_result_t
+isc_httpdmgr_addstream(isc_httpdmgr_t *httpdmgr, const char *url,
+		       isc_httpdstream_t *func, void *arg);
+/*%<
+ * Add a URL whose response is rendered a piece at a time.
+ *
+ * 'func' is called once per request, like an isc_httpdaction_t, to
+ * check the request and fill in the response code, message and MIME
+ * type.  Instead of rendering the body it returns a chunk function and
+ * its argument in '*nextp' and '*next_argp'.
+ *
+ * The chunk function is then called with a buffer each time the
+ * previous piece has been sent.  It points the buffer at the next piece
+ * of the body, which it manages and keeps valid until it is called
+ * again, and returns ISC_R_SUCCESS, or ISC_R_NOMORE once the body is
+ * complete.  Any other result aborts the connection.  Finally it is
+ * called exactly once with a NULL buffer, whether or not the body was
+ * completed, to release its argument.
+ *
+ * HTTP/1.1 responses are sent with "Transfer-Encoding: chunked"; an
+ * HTTP/1.0 response ends when the connection is closed.  The task the
+ * manager runs on is free to process other events between pieces.
+ * Streamed responses are never compressed.
+ */
+
 isc_result_t
 isc_httpd_response(isc_httpd_t *httpd);
 
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+#ifndef ISC_LOCKPROF_H
+#define ISC_LOCKPROF_H 1
+
+/*! \file isc/lockprof.h
+ * \brief Sampling lock contention profiler.
+ *
+ * When enabled, one lock acquisition in every 'rate' made by each
+ * thread through isc_mutex_lock() (pthreads only) or RWLOCK() is
+ * sampled.  Samples are accumulated per call site (the file and line
+ * of the LOCK() or RWLOCK()): how many were taken, how many found the
+ * lock held, and how long those waited for it.
+ *
+ * While disabled the only cost is a test of #isc_lockprof_rate on
+ * each acquisition.  This header must not include isc/mutex.h, which
+ * includes it.
+ */
+
+#include <isc/lang.h>
+#include <isc/platform.h>
+#include <isc/types.h>
+
+ISC_LANG_BEGINDECLS
+
+typedef enum {
+	isc_lockproftype_mutex = 0,
+	isc_lockproftype_read,
+	isc_lockproftype_write
+} isc_lockproftype_t;
+
+/*%
+ * What was sampled at one call site.  Times are in microseconds;
+ * 'acquired' and 'contended' count samples, so multiply them by the
+ * sampling rate to estimate the actual number of acquisitions.
+ */
+typedef struct isc_lockprofsite {
+	const char *		file;
+	unsigned int		line;
+	isc_lockproftype_t	type;
+	isc_uint64_t		acquired;
+	isc_uint64_t		contended;
+	isc_uint64_t		waittime;
+	isc_uint64_t		maxwait;
+} isc_lockprofsite_t;
+
+typedef void (*isc_lockprofdumper_t)(const isc_lockprofsite_t *, void *);
+
+/*%
+ * Sample one acquisition in this many; 0 when profiling is disabled.
+ * Read-only: use isc_lockprof_setrate() to change it.
+ */
+LIBISC_EXTERNAL_DATA extern unsigned int isc_lockprof_rate;
+
+void
+isc_lockprof_setrate(unsigned int rate);
+/*%<
+ * Sample one lock acquisition in every 'rate' made by each thread, or
+ * stop sampling if 'rate' is 0.  Samples already taken are kept.
+ */
+
+void
+isc_lockprof_reset(void);
+/*%<
+ * Forget every sample taken so far.
+ */
+
+isc_result_t
+isc_lockprof_dump(isc_mem_t *mctx, isc_lockprofdumper_t dump_fn, void *arg);
+/*%<
+ * Call 'dump_fn' once for each call site sampled since the last reset,
+ * longest total wait first.  Sites that did not fit in the profile's
+ * fixed-size table are reported together as file "other", line 0.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context, used for a temporary copy of
+ *	the profile.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+/*
+ * Internal: used by the lock implementations.
+ */
+isc_boolean_t
+isc__lockprof_sample(void);
+/*%<
+ * Return ISC_TRUE if the calling thread's next acquisition should be
+ * sampled.
+ */
+
+void
+isc__lockprof_record(const char *file, unsigned int line,
+		     isc_lockproftype_t type, isc_boolean_t contended,
+		     isc_uint64_t waittime);
+/*%<
+ * Account for a sampled acquisition at 'file':'line' that waited for
+ * 'waittime' microseconds if 'contended'.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* ISC_LOCKPROF_H */
@@ -62,6 +62,7 @@
 #define ISC_LOG_PRINTPREFIX	0x0020		/* tag only, no colon */
 #define ISC_LOG_PRINTALL	0x003F
 #define ISC_LOG_BUFFERED	0x0040
+#define ISC_LOG_ASYNC		0x0080		/* write from another thread */
 #define ISC_LOG_DEBUGONLY	0x1000
 #define ISC_LOG_OPENERR		0x8000		/* internal */
 /*@}*/
@@ -426,6 +427,14 @@ isc_log_createchannel(isc_logconfig_t *lcfg, const char *name,
  *	debug level of the logging context (see isc_log_setdebuglevel)
  *	is non-zero.
  *
+ *\li	#ISC_LOG_ASYNC on an #ISC_LOG_TOFILE or #ISC_LOG_TOFILEDESC
+ *	channel queues each formatted message in a per-thread buffer
+ *	which is written out by a separate thread, so that the logging
+ *	thread never waits for the disk.  Messages from one thread keep
+ *	their order; if a thread's buffer is full its messages are
+ *	dropped and counted (see isc_log_getdropped()).  The flag is
+ *	ignored for other channel types and in non-threaded builds.
+ *
  * Requires:
  *\li	lcfg is a valid logging configuration.
  *
@@ -439,7 +448,7 @@ isc_log_createchannel(isc_logconfig_t *lcfg, const char *name,
  *\li	level is >= #ISC_LOG_CRITICAL (the most negative logging level).
  *
  *\li	flags does not include any bits aside from the ISC_LOG_PRINT* bits,
- *	#ISC_LOG_DEBUGONLY or #ISC_LOG_BUFFERED.
+ *	#ISC_LOG_DEBUGONLY, #ISC_LOG_BUFFERED or #ISC_LOG_ASYNC.
  *
  * Ensures:
  *\li	#ISC_R_SUCCESS
@@ -850,6 +859,9 @@ isc_log_closefilelogs(isc_log_t *lctx);
  *
  *\li	#ISC_LOG_TOFILEDESC channels are unaffected.
  *
+ *\li	Messages queued for #ISC_LOG_ASYNC channels are written out
+ *	first.
+ *
  * Requires:
  *\li	lctx is a valid context.
  *
@@ -858,6 +870,16 @@ isc_log_closefilelogs(isc_log_t *lctx);
  *	next needed.
  */
 
+isc_uint64_t
+isc_log_getdropped(isc_log_t *lctx);
+/*%<
+ * Return the number of messages for #ISC_LOG_ASYNC channels that have
+ * been dropped because the logging thread's buffer was full.
+ *
+ * Requires:
+ *\li	lctx is a valid context.
+ */
+
 isc_logcategory_t *
 isc_log_categorybyname(isc_log_t *lctx, const char *name);
 /*%<
@@ -15,6 +15,7 @@
 
 #include <isc/condition.h>
 #include <isc/lang.h>
+#include <isc/lockprof.h>
 #include <isc/platform.h>
 #include <isc/types.h>
 
@@ -67,6 +68,15 @@ struct isc_rwlock {
 	/* Unlocked. */
 	unsigned int		write_quota;
 
+	/*
+	 * Set by isc_rwlock_initdistributed(): per-thread reader counts,
+	 * one per cache line, which are summed by writers.  The
+	 * write_requests and write_completions counters are not used and
+	 * cnt_and_flag only holds WRITER_ACTIVE.
+	 */
+	isc_mem_t *		mctx;
+	isc_int32_t *		readers;
+
 #else  /* ISC_PLATFORM_HAVEXADD && ISC_PLATFORM_HAVECMPXCHG */
 
 	/*%< Locked by lock. */
@@ -104,9 +114,42 @@ isc_result_t
 isc_rwlock_init(isc_rwlock_t *rwl, unsigned int read_quota,
 		unsigned int write_quota);
 
+isc_result_t
+isc_rwlock_initdistributed(isc_rwlock_t *rwl, isc_mem_t *mctx);
+/*%<
+ * Initialize a lock that is optimized for readers.  Instead of sharing
+ * one counter, each reader increments a counter belonging to its own
+ * thread, so readers on different CPUs do not contend for a cache
+ * line; a writer must check every counter, and makes new readers wait
+ * until it is done.  This suits locks that are taken for reading on
+ * every query and very rarely for writing.  The lock is otherwise used
+ * exactly as one set up with isc_rwlock_init().
+ *
+ * Without atomic operations or threads this is isc_rwlock_init() with
+ * the default quotas.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context; it is used for the reader
+ *	counts, which take about a kilobyte.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#ISC_R_UNEXPECTED
+ */
+
 isc_result_t
 isc_rwlock_lock(isc_rwlock_t *rwl, isc_rwlocktype_t type);
 
+isc_result_t
+isc__rwlock_lockprof(isc_rwlock_t *rwl, isc_rwlocktype_t type,
+		     const char *file, unsigned int line);
+/*%<
+ * isc_rwlock_lock(), sampled by the lock contention profiler as an
+ * acquisition at 'file':'line'.  RWLOCK() calls this instead of
+ * isc_rwlock_lock() while the profiler is enabled.
+ */
+
 isc_result_t
 isc_rwlock_trylock(isc_rwlock_t *rwl, isc_rwlocktype_t type);
 
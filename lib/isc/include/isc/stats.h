@@ -22,6 +22,11 @@ ISC_LANG_BEGINDECLS
  */
 #define ISC_STATSDUMP_VERBOSE	0x00000001 /*%< dump 0-value counters */
 
+/*%<
+ * Flag(s) for isc_stats_create2().
+ */
+#define ISC_STATS_SHARDED	0x00000001 /*%< one copy per CPU */
+
 /*%<
  * Dump callback type.
  */
@@ -44,6 +49,28 @@ isc_stats_create(isc_mem_t *mctx, isc_stats_t **statsp, int ncounters);
  *\li	anything else	-- failure
  */
 
+isc_result_t
+isc_stats_create2(isc_mem_t *mctx, isc_stats_t **statsp, int ncounters,
+		  unsigned int flags);
+/*%<
+ * Like isc_stats_create(), but if 'flags' includes ISC_STATS_SHARDED
+ * each counter is kept in one shard per CPU; a thread always updates the
+ * same shard, and reading the counters adds their shards up.  This
+ * avoids contention on sets that every query updates, at the cost of a
+ * copy of the counters, padded to whole cache lines, per CPU, so it
+ * should only be used for a few global sets.
+ *
+ * Requires:
+ *\li	'mctx' must be a valid memory context.
+ *
+ *\li	'statsp' != NULL && '*statsp' == NULL.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS	-- all ok
+ *
+ *\li	anything else	-- failure
+ */
+
 void
 isc_stats_attach(isc_stats_t *stats, isc_stats_t **statsp);
 /*%<
@@ -86,6 +113,19 @@ isc_stats_increment(isc_stats_t *stats, isc_statscounter_t counter);
  *	on creation.
  */
 
+void
+isc_stats_add(isc_stats_t *stats, isc_statscounter_t counter,
+	      isc_uint32_t val);
+/*%<
+ * Add 'val' to the counter-th counter of stats.
+ *
+ * Requires:
+ *\li	'stats' is a valid isc_stats_t.
+ *
+ *\li	counter is less than the maximum available ID for the stats specified
+ *	on creation.
+ */
+
 void
 isc_stats_decrement(isc_stats_t *stats, isc_statscounter_t counter);
 /*%<
@@ -102,7 +142,9 @@ isc_stats_dump(isc_stats_t *stats, isc_stats_dumper_t dump_fn, void *arg,
  * Dump the current statistics counters in a specified way.  For each counter
  * in stats, dump_fn is called with its current value and the given argument
  * arg.  By default counters that have a value of 0 is skipped; if options has
- * the ISC_STATSDUMP_VERBOSE flag, even such counters are dumped.
+ * the ISC_STATSDUMP_VERBOSE flag, even such counters are dumped.  The value
+ * passed is the sum of the counter's shards, which is only a snapshot while
+ * other threads are still counting.
  *
  * Requires:
  *\li	'stats' is a valid isc_stats_t.
@@ -281,6 +281,57 @@ isc_task_sendanddetach(isc_task_t **taskp, isc_event_t **eventp);
  *		all resources used by the task will be freed.
  */
 
+void
+isc_task_sendlist(isc_task_t *task, isc_eventlist_t *events);
+/*%<
+ * Send every event on 'events' to 'task', in order.
+ *
+ * Notes:
+ *
+ *\li	This is equivalent to calling isc_task_send() for each event,
+ *	but the task is locked once and, if it was idle, made ready
+ *	once.
+ *
+ * Requires:
+ *
+ *\li	'task' is a valid task.
+ *\li	'events' is a valid list of events that are not linked into
+ *	any other list.
+ *
+ * Ensures:
+ *
+ *\li	'events' is empty.
+ */
+
+void
+isc_task_sendmany(isc_task_t **tasks, isc_event_t **events,
+		  unsigned int count);
+void
+isc_task_sendmanyanddetach(isc_task_t **tasks, isc_event_t **events,
+			   unsigned int count);
+/*%<
+ * Send 'events[i]' to 'tasks[i]' for each 'i' from 0 to 'count' - 1,
+ * in order, and with isc_task_sendmanyanddetach() detach 'tasks[i]'.
+ *
+ * Notes:
+ *
+ *\li	This is equivalent to calling isc_task_send() or
+ *	isc_task_sendanddetach() for each pair, but consecutive events
+ *	for the same task are sent under one lock of the task, and the
+ *	tasks that become ready are queued with one lock of the task
+ *	manager.  Events for different tasks may therefore be run in
+ *	a different order than they were sent.
+ *
+ * Requires:
+ *
+ *\li	'tasks[i]' is a valid task and events[i] != NULL for each 'i'.
+ *
+ * Ensures:
+ *
+ *\li	events[i] == NULL for each 'i'.
+ *
+ *\li	tasks[i] == NULL for each 'i' (isc_task_sendmanyanddetach()).
+ */
 
 unsigned int
 isc_task_purgerange(isc_task_t *task, void *sender, isc_eventtype_t first,
@@ -782,6 +833,65 @@ isc_taskmgr_excltask(isc_taskmgr_t *mgr, isc_task_t **taskp);
  *\li	taskp != NULL && *taskp == NULL
  */
 
+/*%
+ * Keys of a task profile; see isc_taskmgr_profile().
+ */
+typedef enum {
+	isc_taskprofile_name,
+	isc_taskprofile_eventtype
+} isc_taskprofilekey_t;
+
+/*%<
+ * Task profile dump callback: the key, the number of events run, and the
+ * total time spent running them and waiting in the task's event queue,
+ * in microseconds.
+ */
+typedef void (*isc_taskprofiledumper_t)(const char *, isc_uint64_t,
+					isc_uint64_t, isc_uint64_t, void *);
+
+void
+isc_taskmgr_setprofiling(isc_taskmgr_t *mgr, isc_boolean_t enable);
+
+isc_boolean_t
+isc_taskmgr_profiling(isc_taskmgr_t *mgr);
+/*%<
+ * Set/get whether the task manager profiles the events it runs.  While
+ * profiling, each worker counts the events it runs, their run time and
+ * the time they waited in the task's queue, by task name and by event
+ * type.  Task names that differ only by a trailing number are counted
+ * together.  Profiling costs two clock readings per event and is off
+ * by default; the counts are kept when it is turned off.
+ *
+ * Requires:
+ *\li	'mgr' is a valid task manager.
+ */
+
+void
+isc_taskmgr_resetprofile(isc_taskmgr_t *mgr);
+/*%<
+ * Clear the profile counts.
+ *
+ * Requires:
+ *\li	'mgr' is a valid task manager.
+ */
+
+isc_result_t
+isc_taskmgr_profile(isc_taskmgr_t *mgr, isc_taskprofilekey_t key,
+		    isc_taskprofiledumper_t dump_fn, void *arg);
+/*%<
+ * Call 'dump_fn' for each task name, or each event type, that has
+ * run events, those with the longest total run time first.  Event types
+ * are given as the name of their class and their number within it,
+ * e.g. "timer+1" for ISC_TIMEREVENT_TICK.  Once a worker has seen too
+ * many different keys, the rest are counted as "other".
+ *
+ * Requires:
+ *\li	'mgr' is a valid task manager.
+ *
+ * Returns:
+ *\li	ISC_R_SUCCESS
+ *\li	ISC_R_NOMEMORY
+ */
 
 #ifdef HAVE_LIBXML2
 int
@@ -48,6 +48,7 @@ typedef ISC_LIST(isc_event_t)		isc_eventlist_t;	/*%< Event List */
 typedef unsigned int			isc_eventtype_t;	/*%< Event Type */
 typedef isc_uint32_t			isc_fsaccess_t;		/*%< FS Access */
 typedef struct isc_hash			isc_hash_t;		/*%< Hash */
+typedef struct isc_histo		isc_histo_t;		/*%< Histogram */
 typedef struct isc_httpd		isc_httpd_t;		/*%< HTTP client */
 typedef void (isc_httpdfree_t)(isc_buffer_t *, void *);		/*%< HTTP free function */
 typedef struct isc_httpdmgr		isc_httpdmgr_t;		/*%< HTTP manager */
@@ -105,6 +106,17 @@ typedef isc_result_t (isc_httpdaction_t)(const char *url,
 					 isc_buffer_t *body,
 					 isc_httpdfree_t **freecb,
 					 void **freecb_args);
+typedef isc_result_t (isc_httpdnext_t)(isc_buffer_t *, void *);
+typedef isc_result_t (isc_httpdstream_t)(const char *url,
+					 isc_httpdurl_t *urlinfo,
+					 const char *querystring,
+					 const char *headers,
+					 void *arg,
+					 unsigned int *retcode,
+					 const char **retmsg,
+					 const char **mimetype,
+					 isc_httpdnext_t **nextp,
+					 void **next_argp);
 typedef isc_boolean_t (isc_httpdclientok_t)(const isc_sockaddr_t *, void *);
 
 /*% Resource */
@@ -120,11 +132,12 @@ typedef enum {
 	isc_resource_stacksize
 } isc_resource_t;
 
-/*% Statistics formats (text file or XML) */
+/*% Statistics formats (text file, XML, JSON or Prometheus text) */
 typedef enum {
 	isc_statsformat_file,
 	isc_statsformat_xml,
-	isc_statsformat_json
+	isc_statsformat_json,
+	isc_statsformat_prometheus
 } isc_statsformat_t;
 
 #endif /* ISC_TYPES_H */
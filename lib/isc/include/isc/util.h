@@ -157,7 +157,9 @@
 			       isc_msgcat_get(isc_msgcat, ISC_MSGSET_UTIL, \
 					      ISC_MSG_RWLOCK, "RWLOCK"), \
 			       (lp), (t), __FILE__, __LINE__)); \
-	RUNTIME_CHECK(isc_rwlock_lock((lp), (t)) == ISC_R_SUCCESS); \
+	RUNTIME_CHECK(((isc_lockprof_rate != 0) ? \
+		       isc__rwlock_lockprof((lp), (t), __FILE__, __LINE__) : \
+		       isc_rwlock_lock((lp), (t))) == ISC_R_SUCCESS); \
 	ISC_UTIL_TRACE(fprintf(stderr, "%s %p, %d %s %d\n", \
 			       isc_msgcat_get(isc_msgcat, ISC_MSGSET_UTIL, \
 					      ISC_MSG_RWLOCKED, "RWLOCKED"), \
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <isc/lockprof.h>
+#include <isc/mem.h>
+#include <isc/mutex.h>
+#include <isc/once.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+/*%
+ * Call sites are spread over LOCKPROF_STRIPES independently locked
+ * tables, so that threads recording samples for different sites rarely
+ * meet.  A site that finds its stripe full is counted in the stripe's
+ * 'other' entry instead.
+ */
+#define LOCKPROF_STRIPES	16
+#define LOCKPROF_SITES		64
+
+/*%
+ * Each thread counts down the acquisitions it has left before its next
+ * sample.  While a thread is updating the profile its countdown is
+ * LOCKPROF_BUSY, so that taking a stripe lock is never itself sampled:
+ * recording that sample could need the very stripe lock being taken.
+ */
+#define LOCKPROF_BUSY		((unsigned int)-1)
+
+typedef struct {
+	isc_mutex_t		lock;
+	isc_lockprofsite_t	other;
+	isc_lockprofsite_t	sites[LOCKPROF_SITES];
+} lockprof_stripe_t;
+
+LIBISC_EXTERNAL_DATA unsigned int isc_lockprof_rate = 0;
+
+static lockprof_stripe_t stripes[LOCKPROF_STRIPES];
+static isc_once_t lockprof_once = ISC_ONCE_INIT;
+static isc_boolean_t lockprof_ok = ISC_FALSE;
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_thread_key_t countdown_key;
+#else
+static unsigned int countdown = 0;
+#endif
+
+static void
+init_lockprof(void) {
+	unsigned int i;
+
+	memset(stripes, 0, sizeof(stripes));
+	for (i = 0; i < LOCKPROF_STRIPES; i++) {
+		RUNTIME_CHECK(isc_mutex_init(&stripes[i].lock) ==
+			      ISC_R_SUCCESS);
+		stripes[i].other.file = "other";
+	}
+#ifdef ISC_PLATFORM_USETHREADS
+	if (isc_thread_key_create(&countdown_key, NULL) != 0)
+		return;
+#endif
+	lockprof_ok = ISC_TRUE;
+}
+
+static inline unsigned int
+getcountdown(void) {
+#ifdef ISC_PLATFORM_USETHREADS
+	return ((unsigned int)(size_t)
+		isc_thread_key_getspecific(countdown_key));
+#else
+	return (countdown);
+#endif
+}
+
+static inline void
+setcountdown(unsigned int value) {
+#ifdef ISC_PLATFORM_USETHREADS
+	(void)isc_thread_key_setspecific(countdown_key, (void *)(size_t)value);
+#else
+	countdown = value;
+#endif
+}
+
+void
+isc_lockprof_setrate(unsigned int rate) {
+	RUNTIME_CHECK(isc_once_do(&lockprof_once, init_lockprof) ==
+		      ISC_R_SUCCESS);
+
+	if (lockprof_ok)
+		isc_lockprof_rate = rate;
+}
+
+isc_boolean_t
+isc__lockprof_sample(void) {
+	unsigned int rate = isc_lockprof_rate;
+	unsigned int left;
+
+	if (rate == 0 || !lockprof_ok)
+		return (ISC_FALSE);
+
+	left = getcountdown();
+	if (left == LOCKPROF_BUSY)
+		return (ISC_FALSE);
+	if (left == 0) {
+		setcountdown(rate - 1);
+		return (ISC_TRUE);
+	}
+	if (left > rate)
+		left = rate;
+	setcountdown(left - 1);
+	return (ISC_FALSE);
+}
+
+/*
+ * Mark the calling thread as updating the profile, returning the
+ * countdown to restore with leave().
+ */
+static inline unsigned int
+enter(void) {
+	unsigned int left = 0;
+
+	if (lockprof_ok) {
+		left = getcountdown();
+		setcountdown(LOCKPROF_BUSY);
+	}
+	return (left);
+}
+
+static inline void
+leave(unsigned int left) {
+	if (lockprof_ok)
+		setcountdown(left);
+}
+
+static inline unsigned int
+sitehash(const char *file, unsigned int line, isc_lockproftype_t type) {
+	unsigned int h = line * 3 + type;
+
+	while (*file != '\0')
+		h = h * 31 + (unsigned char)*file++;
+	return (h);
+}
+
+void
+isc__lockprof_record(const char *file, unsigned int line,
+		     isc_lockproftype_t type, isc_boolean_t contended,
+		     isc_uint64_t waittime)
+{
+	lockprof_stripe_t *stripe;
+	isc_lockprofsite_t *site = NULL;
+	unsigned int h, i, n, left;
+
+	h = sitehash(file, line, type);
+	stripe = &stripes[h % LOCKPROF_STRIPES];
+	h /= LOCKPROF_STRIPES;
+
+	left = enter();
+	LOCK(&stripe->lock);
+	for (n = 0; n < LOCKPROF_SITES; n++) {
+		i = (h + n) % LOCKPROF_SITES;
+		site = &stripe->sites[i];
+		if (site->file == NULL) {
+			site->file = file;
+			site->line = line;
+			site->type = type;
+			break;
+		}
+		if (site->line == line && site->type == type &&
+		    (site->file == file || strcmp(site->file, file) == 0))
+			break;
+	}
+	if (n == LOCKPROF_SITES)
+		site = &stripe->other;
+
+	site->acquired++;
+	if (contended) {
+		site->contended++;
+		site->waittime += waittime;
+		if (waittime > site->maxwait)
+			site->maxwait = waittime;
+	}
+	UNLOCK(&stripe->lock);
+	leave(left);
+}
+
+void
+isc_lockprof_reset(void) {
+	lockprof_stripe_t *stripe;
+	unsigned int i, left;
+
+	RUNTIME_CHECK(isc_once_do(&lockprof_once, init_lockprof) ==
+		      ISC_R_SUCCESS);
+
+	left = enter();
+	for (i = 0; i < LOCKPROF_STRIPES; i++) {
+		stripe = &stripes[i];
+		LOCK(&stripe->lock);
+		memset(stripe->sites, 0, sizeof(stripe->sites));
+		stripe->other.acquired = 0;
+		stripe->other.contended = 0;
+		stripe->other.waittime = 0;
+		stripe->other.maxwait = 0;
+		UNLOCK(&stripe->lock);
+	}
+	leave(left);
+}
+
+static int
+site_compare(const void *a, const void *b) {
+	const isc_lockprofsite_t *sa = a, *sb = b;
+
+	if (sa->waittime != sb->waittime)
+		return (sa->waittime > sb->waittime ? -1 : 1);
+	if (sa->contended != sb->contended)
+		return (sa->contended > sb->contended ? -1 : 1);
+	if (sa->acquired != sb->acquired)
+		return (sa->acquired > sb->acquired ? -1 : 1);
+	return (0);
+}
+
+isc_result_t
+isc_lockprof_dump(isc_mem_t *mctx, isc_lockprofdumper_t dump_fn, void *arg) {
+	isc_lockprofsite_t *sites, other;
+	lockprof_stripe_t *stripe;
+	unsigned int i, j, n, nalloc, left;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(dump_fn != NULL);
+
+	RUNTIME_CHECK(isc_once_do(&lockprof_once, init_lockprof) ==
+		      ISC_R_SUCCESS);
+
+	nalloc = LOCKPROF_STRIPES * LOCKPROF_SITES + 1;
+	sites = isc_mem_get(mctx, nalloc * sizeof(*sites));
+	if (sites == NULL)
+		return (ISC_R_NOMEMORY);
+
+	memset(&other, 0, sizeof(other));
+	other.file = "other";
+	n = 0;
+
+	left = enter();
+	for (i = 0; i < LOCKPROF_STRIPES; i++) {
+		stripe = &stripes[i];
+		LOCK(&stripe->lock);
+		for (j = 0; j < LOCKPROF_SITES; j++) {
+			if (stripe->sites[j].file != NULL)
+				sites[n++] = stripe->sites[j];
+		}
+		other.acquired += stripe->other.acquired;
+		other.contended += stripe->other.contended;
+		other.waittime += stripe->other.waittime;
+		if (stripe->other.maxwait > other.maxwait)
+			other.maxwait = stripe->other.maxwait;
+		UNLOCK(&stripe->lock);
+	}
+	leave(left);
+
+	if (other.acquired != 0)
+		sites[n++] = other;
+
+	qsort(sites, n, sizeof(*sites), site_compare);
+	for (i = 0; i < n; i++)
+		dump_fn(&sites[i], arg);
+
+	isc_mem_put(mctx, sites, nalloc * sizeof(*sites));
+
+	return (ISC_R_SUCCESS);
+}
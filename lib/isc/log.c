@@ -20,6 +20,7 @@
 
 #include <sys/types.h>	/* dev_t FreeBSD 2.1 */
 
+#include <isc/condition.h>
 #include <isc/dir.h>
 #include <isc/file.h>
 #include <isc/log.h>
@@ -30,6 +31,7 @@
 #include <isc/stat.h>
 #include <isc/stdio.h>
 #include <isc/string.h>
+#include <isc/thread.h>
 #include <isc/time.h>
 #include <isc/util.h>
 
@@ -64,6 +66,11 @@ struct isc_logchannel {
 	unsigned int			type;
 	int 				level;
 	unsigned int			flags;
+	/*
+	 * ISC_LOG_OPENERR of an ISC_LOG_ASYNC channel, which only the
+	 * writer thread uses.
+	 */
+	unsigned int			asyncflags;
 	isc_logdestination_t 		destination;
 	ISC_LINK(isc_logchannel_t)	link;
 };
@@ -96,6 +103,68 @@ struct isc_logmessage {
 	ISC_LINK(isc_logmessage_t)	link;
 };
 
+#ifdef ISC_PLATFORM_USETHREADS
+/*!
+ * Channels with ISC_LOG_ASYNC set are written by a dedicated thread.
+ * Once it is running, isc_log_doit() formats each message in a buffer
+ * belonging to the calling thread before it locks the log context,
+ * and appends the line for each asynchronous channel to that thread's
+ * ring buffer; the writer thread empties the rings in turn, writing
+ * each batch with stdio and flushing it once.  Messages from one
+ * thread therefore keep their order, but messages from different
+ * threads may be reordered.
+ *
+ * A message that does not fit in its thread's ring is dropped and
+ * counted.  The writer wakes up every LOG_ASYNC_INTERVAL milliseconds,
+ * or sooner when a ring becomes half full or a flush is requested.
+ * Channels being closed or destroyed are flushed first, so the writer
+ * never sees a channel that has been freed.
+ */
+#define LOG_ASYNC_RINGSIZE	(64 * 1024)
+#define LOG_ASYNC_INTERVAL	50
+
+typedef struct isc_logring isc_logring_t;
+
+struct isc_logring {
+	isc_mutex_t			lock;
+	/* Locked by lock. */
+	unsigned int			head;
+	unsigned int			used;
+	unsigned int			dropped;
+	unsigned char			buffer[LOG_ASYNC_RINGSIZE];
+	/* Locked by the isc_logasync lock. */
+	ISC_LINK(isc_logring_t)		link;
+	/* Used only by the thread the ring belongs to. */
+	char				text[LOG_BUFFER_SIZE];
+	char				line[LOG_BUFFER_SIZE + 512];
+};
+
+/*%
+ * Each message in a ring is this header followed by 'length' bytes
+ * of text, including the newline.
+ */
+typedef struct isc_logrecord {
+	isc_logchannel_t *		channel;
+	unsigned int			length;
+} isc_logrecord_t;
+
+typedef struct isc_logasync {
+	isc_thread_t			thread;
+	isc_thread_key_t		key;
+	isc_mutex_t			lock;
+	isc_condition_t			wakeup;
+	isc_condition_t			flushed_cond;
+	/* Locked by lock. */
+	ISC_LIST(isc_logring_t)		rings;
+	isc_boolean_t			shutdown;
+	isc_uint64_t			flush_requested;
+	isc_uint64_t			flushed;
+	isc_uint64_t			dropped;
+	/* Used only by the writer thread. */
+	unsigned char			batch[LOG_ASYNC_RINGSIZE];
+} isc_logasync_t;
+#endif /* ISC_PLATFORM_USETHREADS */
+
 /*!
  * The isc_logconfig structure is used to store the configurable information
  * about where messages are actually supposed to be sent -- the information
@@ -146,6 +215,14 @@ struct isc_log {
 	isc_logconfig_t * 		logconfig;
 	char 				buffer[LOG_BUFFER_SIZE];
 	ISC_LIST(isc_logmessage_t)	messages;
+#ifdef ISC_PLATFORM_USETHREADS
+	/*
+	 * Set once under the isc_log lock, before any channel is written
+	 * asynchronously, and cleared only when the context is destroyed;
+	 * isc_log_doit() reads it without the lock.
+	 */
+	isc_logasync_t *		async;
+#endif
 };
 
 /*!
@@ -225,6 +302,17 @@ sync_channellist(isc_logconfig_t *lcfg);
 static isc_result_t
 greatest_version(isc_logfile_t *file, int *greatest);
 
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_result_t
+async_start(isc_log_t *lctx);
+
+static void
+async_flush(isc_logasync_t *async);
+
+static void
+async_stop(isc_log_t *lctx);
+#endif
+
 static void
 isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 	     isc_logmodule_t *module, int level, isc_boolean_t write_once,
@@ -271,6 +359,9 @@ isc_log_create(isc_mem_t *mctx, isc_log_t **lctxp, isc_logconfig_t **lcfgp) {
 		lctx->modules = NULL;
 		lctx->module_count = 0;
 		lctx->debug_level = 0;
+#ifdef ISC_PLATFORM_USETHREADS
+		lctx->async = NULL;
+#endif
 
 		ISC_LIST_INIT(lctx->messages);
 
@@ -465,6 +556,11 @@ isc_log_destroy(isc_log_t **lctxp) {
 		isc_logconfig_destroy(&lcfg);
 	}
 
+#ifdef ISC_PLATFORM_USETHREADS
+	if (lctx->async != NULL)
+		async_stop(lctx);
+#endif
+
 	DESTROYLOCK(&lctx->lock);
 
 	while ((message = ISC_LIST_HEAD(lctx->messages)) != NULL) {
@@ -509,6 +605,15 @@ isc_logconfig_destroy(isc_logconfig_t **lcfgp) {
 
 	mctx = lcfg->lctx->mctx;
 
+#ifdef ISC_PLATFORM_USETHREADS
+	/*
+	 * Anything still queued for these channels must be written
+	 * before they go away.
+	 */
+	if (lcfg->lctx->async != NULL)
+		async_flush(lcfg->lctx->async);
+#endif
+
 	while ((channel = ISC_LIST_HEAD(lcfg->channels)) != NULL) {
 		ISC_LIST_UNLINK(lcfg->channels, channel, link);
 
@@ -697,7 +802,10 @@ isc_log_createchannel(isc_logconfig_t *lcfg, const char *name,
 	isc_logchannel_t *channel;
 	isc_mem_t *mctx;
 	unsigned int permitted = ISC_LOG_PRINTALL | ISC_LOG_DEBUGONLY |
-				 ISC_LOG_BUFFERED;
+				 ISC_LOG_BUFFERED | ISC_LOG_ASYNC;
+#ifdef ISC_PLATFORM_USETHREADS
+	isc_result_t result;
+#endif
 
 	REQUIRE(VALID_CONFIG(lcfg));
 	REQUIRE(name != NULL);
@@ -709,6 +817,22 @@ isc_log_createchannel(isc_logconfig_t *lcfg, const char *name,
 
 	/* XXXDCL find duplicate names? */
 
+	/*
+	 * Only file channels can be written asynchronously, and only
+	 * when there are threads to do it.
+	 */
+	if (type != ISC_LOG_TOFILE && type != ISC_LOG_TOFILEDESC)
+		flags &= ~ISC_LOG_ASYNC;
+#ifdef ISC_PLATFORM_USETHREADS
+	if ((flags & ISC_LOG_ASYNC) != 0) {
+		result = async_start(lcfg->lctx);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+#else
+	flags &= ~ISC_LOG_ASYNC;
+#endif
+
 	mctx = lcfg->lctx->mctx;
 
 	channel = isc_mem_get(mctx, sizeof(*channel));
@@ -724,6 +848,7 @@ isc_log_createchannel(isc_logconfig_t *lcfg, const char *name,
 	channel->type = type;
 	channel->level = level;
 	channel->flags = flags;
+	channel->asyncflags = 0;
 	ISC_LINK_INIT(channel, link);
 
 	switch (type) {
@@ -1026,6 +1151,14 @@ isc_log_closefilelogs(isc_log_t *lctx) {
 	REQUIRE(VALID_CONTEXT(lctx));
 
 	LOCK(&lctx->lock);
+#ifdef ISC_PLATFORM_USETHREADS
+	/*
+	 * Holding the lock keeps anything new from being queued while
+	 * the streams are closed.
+	 */
+	if (lctx->async != NULL)
+		async_flush(lctx->async);
+#endif
 	for (channel = ISC_LIST_HEAD(lctx->logconfig->channels);
 	     channel != NULL;
 	     channel = ISC_LIST_NEXT(channel, link))
@@ -1038,6 +1171,23 @@ isc_log_closefilelogs(isc_log_t *lctx) {
 	UNLOCK(&lctx->lock);
 }
 
+isc_uint64_t
+isc_log_getdropped(isc_log_t *lctx) {
+	isc_uint64_t dropped = 0;
+
+	REQUIRE(VALID_CONTEXT(lctx));
+
+#ifdef ISC_PLATFORM_USETHREADS
+	if (lctx->async != NULL) {
+		LOCK(&lctx->async->lock);
+		dropped = lctx->async->dropped;
+		UNLOCK(&lctx->async->lock);
+	}
+#endif
+
+	return (dropped);
+}
+
 /****
  **** Internal functions
  ****/
@@ -1303,8 +1453,13 @@ isc_logfile_roll(isc_logfile_t *file) {
 	return (ISC_R_SUCCESS);
 }
 
+/*
+ * Open a file channel's stream.  ISC_LOG_OPENERR is noted in '*flagsp',
+ * which is the channel's flags or, for an ISC_LOG_ASYNC channel, the
+ * flags that only the writer thread uses.
+ */
 static isc_result_t
-isc_log_open(isc_logchannel_t *channel) {
+isc_log_open(isc_logchannel_t *channel, unsigned int *flagsp) {
 	struct stat statbuf;
 	isc_boolean_t regular_file;
 	isc_boolean_t roll = ISC_FALSE;
@@ -1345,13 +1500,13 @@ isc_log_open(isc_logchannel_t *channel) {
 			return (ISC_R_MAXSIZE);
 		result = isc_logfile_roll(&channel->destination.file);
 		if (result != ISC_R_SUCCESS) {
-			if ((channel->flags & ISC_LOG_OPENERR) == 0) {
+			if ((*flagsp & ISC_LOG_OPENERR) == 0) {
 				syslog(LOG_ERR,
 				       "isc_log_open: isc_logfile_roll '%s' "
 				       "failed: %s",
 				       FILE_NAME(channel),
 				       isc_result_totext(result));
-				channel->flags |= ISC_LOG_OPENERR;
+				*flagsp |= ISC_LOG_OPENERR;
 			}
 			return (result);
 		}
@@ -1362,6 +1517,367 @@ isc_log_open(isc_logchannel_t *channel) {
 	return (result);
 }
 
+/*
+ * Make sure a file channel's stream is open, rolling the file if it
+ * has reached its maximum size.  Returns ISC_FALSE if the message
+ * should not be written.  'flagsp' is as for isc_log_open().
+ */
+static isc_boolean_t
+logfile_ready(isc_logchannel_t *channel, unsigned int *flagsp) {
+	struct stat statbuf;
+	isc_result_t result;
+
+	if (channel->type != ISC_LOG_TOFILE)
+		return (ISC_TRUE);
+
+	if (FILE_MAXREACHED(channel)) {
+		/*
+		 * If the file can be rolled, OR
+		 * If the file no longer exists, OR
+		 * If the file is less than the maximum size,
+		 *    (such as if it had been renamed and
+		 *     a new one touched, or it was truncated
+		 *     in place)
+		 * ... then close it to trigger reopening.
+		 */
+		if (FILE_VERSIONS(channel) != ISC_LOG_ROLLNEVER ||
+		    (stat(FILE_NAME(channel), &statbuf) != 0 &&
+		     errno == ENOENT) ||
+		    statbuf.st_size < FILE_MAXSIZE(channel)) {
+			(void)fclose(FILE_STREAM(channel));
+			FILE_STREAM(channel) = NULL;
+			FILE_MAXREACHED(channel) = ISC_FALSE;
+		} else
+			/*
+			 * Eh, skip it.
+			 */
+			return (ISC_FALSE);
+	}
+
+	if (FILE_STREAM(channel) == NULL) {
+		result = isc_log_open(channel, flagsp);
+		if (result != ISC_R_SUCCESS &&
+		    result != ISC_R_MAXSIZE &&
+		    (*flagsp & ISC_LOG_OPENERR) == 0) {
+			syslog(LOG_ERR,
+			       "isc_log_open '%s' failed: %s",
+			       FILE_NAME(channel),
+			       isc_result_totext(result));
+			*flagsp |= ISC_LOG_OPENERR;
+		}
+		if (result != ISC_R_SUCCESS)
+			return (ISC_FALSE);
+		*flagsp &= ~ISC_LOG_OPENERR;
+	}
+
+	return (ISC_TRUE);
+}
+
+/*
+ * Called after writing to a file channel: flush it unless it is
+ * buffered, and note if it now exceeds its maximum size so that it
+ * will not be logged to any more.
+ */
+static void
+logfile_written(isc_logchannel_t *channel) {
+	struct stat statbuf;
+
+	if ((channel->flags & ISC_LOG_BUFFERED) == 0)
+		fflush(FILE_STREAM(channel));
+
+	if (FILE_MAXSIZE(channel) > 0) {
+		INSIST(channel->type == ISC_LOG_TOFILE);
+
+		/* XXXDCL NT fstat/fileno */
+		/* XXXDCL complain if fstat fails? */
+		if (fstat(fileno(FILE_STREAM(channel)), &statbuf) >= 0 &&
+		    statbuf.st_size > FILE_MAXSIZE(channel))
+			FILE_MAXREACHED(channel) = ISC_TRUE;
+	}
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+/*
+ * Write out everything queued in 'ring'.  Called by the writer thread
+ * only.
+ */
+static void
+async_drain(isc_logasync_t *async, isc_logring_t *ring) {
+	isc_logchannel_t *channel, *last = NULL;
+	isc_logrecord_t record;
+	unsigned int used, first, dropped, offset;
+	isc_boolean_t ready = ISC_FALSE;
+
+	LOCK(&ring->lock);
+	used = ring->used;
+	first = ISC_MIN(used, LOG_ASYNC_RINGSIZE - ring->head);
+	memmove(async->batch, ring->buffer + ring->head, first);
+	memmove(async->batch + first, ring->buffer, used - first);
+	ring->head = (ring->head + used) % LOG_ASYNC_RINGSIZE;
+	ring->used = 0;
+	dropped = ring->dropped;
+	ring->dropped = 0;
+	UNLOCK(&ring->lock);
+
+	if (dropped != 0) {
+		LOCK(&async->lock);
+		async->dropped += dropped;
+		UNLOCK(&async->lock);
+	}
+
+	for (offset = 0;
+	     offset < used;
+	     offset += sizeof(record) + record.length)
+	{
+		memmove(&record, async->batch + offset, sizeof(record));
+		channel = record.channel;
+		if (channel != last) {
+			if (last != NULL && ready)
+				logfile_written(last);
+			last = channel;
+			ready = logfile_ready(channel,
+					      &channel->asyncflags);
+		}
+		if (ready)
+			(void)fwrite(async->batch + offset + sizeof(record),
+				     1, record.length, FILE_STREAM(channel));
+	}
+	if (last != NULL && ready)
+		logfile_written(last);
+}
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+async_run(isc_threadarg_t arg) {
+	isc_logasync_t *async = arg;
+	isc_logring_t *ring;
+	isc_uint64_t want;
+	isc_boolean_t shutdown;
+	isc_interval_t interval;
+	isc_time_t when;
+
+	isc_interval_set(&interval, 0, LOG_ASYNC_INTERVAL * 1000000);
+
+	LOCK(&async->lock);
+	for (;;) {
+		/*
+		 * Everything queued before 'want' was requested is
+		 * written in this pass.
+		 */
+		want = async->flush_requested;
+		shutdown = async->shutdown;
+
+		for (ring = ISC_LIST_HEAD(async->rings);
+		     ring != NULL;
+		     ring = ISC_LIST_NEXT(ring, link))
+		{
+			UNLOCK(&async->lock);
+			async_drain(async, ring);
+			LOCK(&async->lock);
+		}
+
+		async->flushed = want;
+		BROADCAST(&async->flushed_cond);
+
+		if (shutdown)
+			break;
+		if (async->flush_requested == want &&
+		    isc_time_nowplusinterval(&when, &interval) ==
+		    ISC_R_SUCCESS)
+			(void)WAITUNTIL(&async->wakeup, &async->lock, &when);
+	}
+	UNLOCK(&async->lock);
+
+	return ((isc_threadresult_t)0);
+}
+
+/*
+ * Start the writer thread, unless it is already running.
+ */
+static isc_result_t
+async_start(isc_log_t *lctx) {
+	isc_logasync_t *async;
+	isc_result_t result;
+
+	LOCK(&lctx->lock);
+	if (lctx->async != NULL) {
+		UNLOCK(&lctx->lock);
+		return (ISC_R_SUCCESS);
+	}
+
+	async = isc_mem_get(lctx->mctx, sizeof(*async));
+	if (async == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto unlock;
+	}
+
+	ISC_LIST_INIT(async->rings);
+	async->shutdown = ISC_FALSE;
+	async->flush_requested = 0;
+	async->flushed = 0;
+	async->dropped = 0;
+
+	if (isc_thread_key_create(&async->key, NULL) != 0) {
+		result = ISC_R_UNEXPECTED;
+		goto free_async;
+	}
+	result = isc_mutex_init(&async->lock);
+	if (result != ISC_R_SUCCESS)
+		goto free_key;
+	result = isc_condition_init(&async->wakeup);
+	if (result != ISC_R_SUCCESS)
+		goto free_lock;
+	result = isc_condition_init(&async->flushed_cond);
+	if (result != ISC_R_SUCCESS)
+		goto free_wakeup;
+	result = isc_thread_create(async_run, async, &async->thread);
+	if (result != ISC_R_SUCCESS)
+		goto free_flushed;
+
+	lctx->async = async;
+	UNLOCK(&lctx->lock);
+	return (ISC_R_SUCCESS);
+
+ free_flushed:
+	(void)isc_condition_destroy(&async->flushed_cond);
+ free_wakeup:
+	(void)isc_condition_destroy(&async->wakeup);
+ free_lock:
+	DESTROYLOCK(&async->lock);
+ free_key:
+	(void)isc_thread_key_delete(async->key);
+ free_async:
+	isc_mem_put(lctx->mctx, async, sizeof(*async));
+ unlock:
+	UNLOCK(&lctx->lock);
+	return (result);
+}
+
+/*
+ * Wait until everything queued so far has been written.
+ */
+static void
+async_flush(isc_logasync_t *async) {
+	isc_uint64_t want;
+
+	LOCK(&async->lock);
+	want = ++async->flush_requested;
+	SIGNAL(&async->wakeup);
+	while (async->flushed < want)
+		WAIT(&async->flushed_cond, &async->lock);
+	UNLOCK(&async->lock);
+}
+
+static void
+async_stop(isc_log_t *lctx) {
+	isc_logasync_t *async = lctx->async;
+	isc_logring_t *ring;
+
+	LOCK(&async->lock);
+	async->shutdown = ISC_TRUE;
+	SIGNAL(&async->wakeup);
+	UNLOCK(&async->lock);
+
+	RUNTIME_CHECK(isc_thread_join(async->thread, NULL) == ISC_R_SUCCESS);
+
+	while ((ring = ISC_LIST_HEAD(async->rings)) != NULL) {
+		ISC_LIST_UNLINK(async->rings, ring, link);
+		DESTROYLOCK(&ring->lock);
+		isc_mem_put(lctx->mctx, ring, sizeof(*ring));
+	}
+	(void)isc_condition_destroy(&async->flushed_cond);
+	(void)isc_condition_destroy(&async->wakeup);
+	DESTROYLOCK(&async->lock);
+	(void)isc_thread_key_delete(async->key);
+
+	lctx->async = NULL;
+	isc_mem_put(lctx->mctx, async, sizeof(*async));
+}
+
+/*
+ * Return the calling thread's ring, creating it the first time the
+ * thread logs, or NULL if that fails.
+ */
+static isc_logring_t *
+async_ring(isc_log_t *lctx) {
+	isc_logasync_t *async = lctx->async;
+	isc_logring_t *ring;
+
+	ring = isc_thread_key_getspecific(async->key);
+	if (ring != NULL)
+		return (ring);
+
+	ring = isc_mem_get(lctx->mctx, sizeof(*ring));
+	if (ring == NULL)
+		return (NULL);
+	if (isc_mutex_init(&ring->lock) != ISC_R_SUCCESS) {
+		isc_mem_put(lctx->mctx, ring, sizeof(*ring));
+		return (NULL);
+	}
+	ring->head = 0;
+	ring->used = 0;
+	ring->dropped = 0;
+	ISC_LINK_INIT(ring, link);
+	LOCK(&async->lock);
+	ISC_LIST_APPEND(async->rings, ring, link);
+	UNLOCK(&async->lock);
+	(void)isc_thread_key_setspecific(async->key, ring);
+
+	return (ring);
+}
+
+/*
+ * Queue 'length' bytes of 'text' for 'channel' in the calling thread's
+ * ring.  Called with the log context locked.
+ */
+static void
+async_write(isc_log_t *lctx, isc_logring_t *ring, isc_logchannel_t *channel,
+	    const char *text, unsigned int length)
+{
+	isc_logasync_t *async = lctx->async;
+	isc_logrecord_t record;
+	unsigned char *data[2];
+	unsigned int size[2];
+	unsigned int tail, first, i, n, off;
+	isc_boolean_t wake = ISC_FALSE;
+
+	record.channel = channel;
+	record.length = length;
+	data[0] = (unsigned char *)&record;
+	size[0] = sizeof(record);
+	DE_CONST(text, data[1]);
+	size[1] = length;
+
+	LOCK(&ring->lock);
+	if (ring->used + size[0] + size[1] > LOG_ASYNC_RINGSIZE) {
+		ring->dropped++;
+	} else {
+		tail = (ring->head + ring->used) % LOG_ASYNC_RINGSIZE;
+		for (i = 0; i < 2; i++) {
+			n = size[i];
+			first = ISC_MIN(n, LOG_ASYNC_RINGSIZE - tail);
+			memmove(ring->buffer + tail, data[i], first);
+			off = first;
+			memmove(ring->buffer, data[i] + off, n - first);
+			tail = (tail + n) % LOG_ASYNC_RINGSIZE;
+		}
+		wake = ISC_TF(ring->used < LOG_ASYNC_RINGSIZE / 2 &&
+			      ring->used + size[0] + size[1] >=
+			      LOG_ASYNC_RINGSIZE / 2);
+		ring->used += size[0] + size[1];
+	}
+	UNLOCK(&ring->lock);
+
+	if (wake) {
+		LOCK(&async->lock);
+		SIGNAL(&async->wakeup);
+		UNLOCK(&async->lock);
+	}
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
 isc_boolean_t
 isc_log_wouldlog(isc_log_t *lctx, int level) {
 	/*
@@ -1399,14 +1915,16 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 	char time_string[64];
 	char level_string[24];
 	const char *iformat;
-	struct stat statbuf;
-	isc_boolean_t matched = ISC_FALSE;
+	const char *text = NULL;
+	isc_boolean_t matched = ISC_FALSE, formatted = ISC_FALSE;
 	isc_boolean_t printtime, printtag, printcolon;
-	isc_boolean_t printcategory, printmodule, printlevel, buffered;
+	isc_boolean_t printcategory, printmodule, printlevel;
 	isc_logconfig_t *lcfg;
 	isc_logchannel_t *channel;
 	isc_logchannellist_t *category_channels;
-	isc_result_t result;
+#ifdef ISC_PLATFORM_USETHREADS
+	isc_logring_t *ring = NULL;
+#endif
 
 	REQUIRE(lctx == NULL || VALID_CONTEXT(lctx));
 	REQUIRE(category != NULL);
@@ -1436,9 +1954,22 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 	time_string[0]  = '\0';
 	level_string[0] = '\0';
 
-	LOCK(&lctx->lock);
+#ifdef ISC_PLATFORM_USETHREADS
+	/*
+	 * Once there is a writer thread, each thread formats its messages
+	 * in its own buffer rather than in lctx->buffer under the lock.
+	 */
+	if (lctx->async != NULL) {
+		ring = async_ring(lctx);
+		if (ring != NULL) {
+			(void)vsnprintf(ring->text, sizeof(ring->text),
+					iformat, args);
+			text = ring->text;
+		}
+	}
+#endif
 
-	lctx->buffer[0] = '\0';
+	LOCK(&lctx->lock);
 
 	lcfg = lctx->logconfig;
 
@@ -1525,9 +2056,14 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 		/*
 		 * Only format the message once.
 		 */
-		if (lctx->buffer[0] == '\0') {
-			(void)vsnprintf(lctx->buffer, sizeof(lctx->buffer),
-					iformat, args);
+		if (!formatted) {
+			formatted = ISC_TRUE;
+			if (text == NULL) {
+				(void)vsnprintf(lctx->buffer,
+						sizeof(lctx->buffer),
+						iformat, args);
+				text = lctx->buffer;
+			}
 
 			/*
 			 * Check for duplicates.
@@ -1590,7 +2126,7 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 					 * This message is in the duplicate
 					 * filtering interval ...
 					 */
-					if (strcmp(lctx->buffer, message->text)
+					if (strcmp(text, message->text)
 					    == 0) {
 						/*
 						 * ... and it is a duplicate.
@@ -1610,14 +2146,14 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 				 */
 				new = isc_mem_get(lctx->mctx,
 						  sizeof(isc_logmessage_t) +
-						  strlen(lctx->buffer) + 1);
+						  strlen(text) + 1);
 				if (new != NULL) {
 					/*
 					 * Put the text immediately after
 					 * the struct.  The strcpy is safe.
 					 */
 					new->text = (char *)(new + 1);
-					strcpy(new->text, lctx->buffer);
+					strcpy(new->text, text);
 
 					TIME_NOW(&new->time);
 
@@ -1641,51 +2177,50 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 				       != 0);
 		printlevel    = ISC_TF((channel->flags & ISC_LOG_PRINTLEVEL)
 				       != 0);
-		buffered      = ISC_TF((channel->flags & ISC_LOG_BUFFERED)
-				       != 0);
 
-		switch (channel->type) {
-		case ISC_LOG_TOFILE:
-			if (FILE_MAXREACHED(channel)) {
-				/*
-				 * If the file can be rolled, OR
-				 * If the file no longer exists, OR
-				 * If the file is less than the maximum size,
-				 *    (such as if it had been renamed and
-				 *     a new one touched, or it was truncated
-				 *     in place)
-				 * ... then close it to trigger reopening.
-				 */
-				if (FILE_VERSIONS(channel) !=
-				    ISC_LOG_ROLLNEVER ||
-				    (stat(FILE_NAME(channel), &statbuf) != 0 &&
-				     errno == ENOENT) ||
-				    statbuf.st_size < FILE_MAXSIZE(channel)) {
-					(void)fclose(FILE_STREAM(channel));
-					FILE_STREAM(channel) = NULL;
-					FILE_MAXREACHED(channel) = ISC_FALSE;
-				} else
-					/*
-					 * Eh, skip it.
-					 */
-					break;
-			}
+#ifdef ISC_PLATFORM_USETHREADS
+		if ((channel->flags & ISC_LOG_ASYNC) != 0) {
+			int n;
 
-			if (FILE_STREAM(channel) == NULL) {
-				result = isc_log_open(channel);
-				if (result != ISC_R_SUCCESS &&
-				    result != ISC_R_MAXSIZE &&
-				    (channel->flags & ISC_LOG_OPENERR) == 0) {
-					syslog(LOG_ERR,
-					       "isc_log_open '%s' failed: %s",
-					       FILE_NAME(channel),
-					       isc_result_totext(result));
-					channel->flags |= ISC_LOG_OPENERR;
-				}
-				if (result != ISC_R_SUCCESS)
-					break;
-				channel->flags &= ~ISC_LOG_OPENERR;
+			if (ring == NULL)
+				ring = async_ring(lctx);
+			if (ring == NULL) {
+				LOCK(&lctx->async->lock);
+				lctx->async->dropped++;
+				UNLOCK(&lctx->async->lock);
+				continue;
+			}
+			n = snprintf(ring->line, sizeof(ring->line),
+				     "%s%s%s%s%s%s%s%s%s%s\n",
+				     printtime     ? time_string	: "",
+				     printtime     ? " "		: "",
+				     printtag      ? lcfg->tag		: "",
+				     printcolon    ? ": "		: "",
+				     printcategory ? category->name	: "",
+				     printcategory ? ": "		: "",
+				     printmodule   ? (module != NULL
+						      ? module->name
+						      : "no_module")
+						   : "",
+				     printmodule   ? ": "		: "",
+				     printlevel    ? level_string	: "",
+				     text);
+			if (n < 0)
+				continue;
+			if ((size_t)n >= sizeof(ring->line)) {
+				/* Truncated; keep the newline. */
+				n = sizeof(ring->line) - 1;
+				ring->line[n - 1] = '\n';
 			}
+			async_write(lctx, ring, channel, ring->line, n);
+			continue;
+		}
+#endif
+
+		switch (channel->type) {
+		case ISC_LOG_TOFILE:
+			if (!logfile_ready(channel, &channel->flags))
+				break;
 			/* FALLTHROUGH */
 
 		case ISC_LOG_TOFILEDESC:
@@ -1702,27 +2237,9 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 								: "",
 				printmodule   ? ": "		: "",
 				printlevel    ? level_string	: "",
-				lctx->buffer);
-
-			if (!buffered)
-				fflush(FILE_STREAM(channel));
-
-			/*
-			 * If the file now exceeds its maximum size
-			 * threshold, note it so that it will not be logged
-			 * to any more.
-			 */
-			if (FILE_MAXSIZE(channel) > 0) {
-				INSIST(channel->type == ISC_LOG_TOFILE);
-
-				/* XXXDCL NT fstat/fileno */
-				/* XXXDCL complain if fstat fails? */
-				if (fstat(fileno(FILE_STREAM(channel)),
-					  &statbuf) >= 0 &&
-				    statbuf.st_size > FILE_MAXSIZE(channel))
-					FILE_MAXREACHED(channel) = ISC_TRUE;
-			}
+				text);
 
+			logfile_written(channel);
 			break;
 
 		case ISC_LOG_TOSYSLOG:
@@ -1747,7 +2264,7 @@ isc_log_doit(isc_log_t *lctx, isc_logcategory_t *category,
 								: "",
 			       printmodule   ? ": "		: "",
 			       printlevel    ? level_string	: "",
-			       lctx->buffer);
+			       text);
 			break;
 
 		case ISC_LOG_TONULL:
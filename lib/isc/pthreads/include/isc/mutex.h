@@ -17,6 +17,7 @@
 #include <stdio.h>
 
 #include <isc/lang.h>
+#include <isc/lockprof.h>
 #include <isc/result.h>		/* for ISC_R_ codes */
 
 ISC_LANG_BEGINDECLS
@@ -75,9 +76,17 @@ isc_result_t isc__mutex_init(isc_mutex_t *mp, const char *file, unsigned int lin
 #define isc_mutex_lock(mp) \
 	isc_mutex_lock_profile((mp), __FILE__, __LINE__)
 #else
+/*!
+ * Unless ISC_MUTEX_PROFILE is defined, acquisitions are sampled by the
+ * lock contention profiler (isc/lockprof.h) while it is enabled.
+ */
 #define isc_mutex_lock(mp) \
-	((pthread_mutex_lock((mp)) == 0) ? \
+	((isc_lockprof_rate != 0) ? \
+	 isc__mutex_lockprof((mp), __FILE__, __LINE__) : \
+	 (pthread_mutex_lock((mp)) == 0) ? \
 	 ISC_R_SUCCESS : ISC_R_UNEXPECTED)
+isc_result_t isc__mutex_lockprof(isc_mutex_t *mp, const char *file,
+				 unsigned int line);
 #endif
 
 #if ISC_MUTEX_PROFILE
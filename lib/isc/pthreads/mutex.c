@@ -17,11 +17,13 @@
 #include <sys/time.h>
 #include <errno.h>
 
+#include <isc/lockprof.h>
 #include <isc/mutex.h>
 #include <isc/util.h>
 #include <isc/print.h>
 #include <isc/strerror.h>
 #include <isc/once.h>
+#include <isc/time.h>
 
 #if ISC_MUTEX_PROFILE
 
@@ -297,3 +299,31 @@ isc__mutex_init(isc_mutex_t *mp, const char *file, unsigned int line) {
 	return (result);
 }
 #endif
+
+#if !ISC_MUTEX_PROFILE
+isc_result_t
+isc__mutex_lockprof(isc_mutex_t *mp, const char *file, unsigned int line) {
+	isc_time_t start, end;
+	int err;
+
+	if (!isc__lockprof_sample())
+		return ((pthread_mutex_lock(mp) == 0) ?
+			ISC_R_SUCCESS : ISC_R_UNEXPECTED);
+
+	if (pthread_mutex_trylock(mp) == 0) {
+		isc__lockprof_record(file, line, isc_lockproftype_mutex,
+				     ISC_FALSE, 0);
+		return (ISC_R_SUCCESS);
+	}
+
+	TIME_NOW(&start);
+	err = pthread_mutex_lock(mp);
+	TIME_NOW(&end);
+	if (err != 0)
+		return (ISC_R_UNEXPECTED);
+
+	isc__lockprof_record(file, line, isc_lockproftype_mutex, ISC_TRUE,
+			     isc_time_microdiff(&end, &start));
+	return (ISC_R_SUCCESS);
+}
+#endif /* !ISC_MUTEX_PROFILE */
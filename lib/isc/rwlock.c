@@ -13,13 +13,19 @@
 #include <config.h>
 
 #include <stddef.h>
+#include <string.h>
 
 #include <isc/atomic.h>
+#include <isc/lockprof.h>
 #include <isc/magic.h>
+#include <isc/mem.h>
 #include <isc/msgs.h>
+#include <isc/once.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/rwlock.h>
+#include <isc/thread.h>
+#include <isc/time.h>
 #include <isc/util.h>
 
 #define RWLOCK_MAGIC		ISC_MAGIC('R', 'W', 'L', 'k')
@@ -40,8 +46,26 @@
 #endif
 
 #if defined(ISC_PLATFORM_HAVEXADD) && defined(ISC_PLATFORM_HAVECMPXCHG)
+/*%
+ * Distributed locks have RWLOCK_READER_SLOTS reader counts, each at the
+ * start of its own RWLOCK_CACHELINE bytes.
+ */
+#ifndef RWLOCK_READER_SLOTS
+#define RWLOCK_READER_SLOTS 16
+#endif
+
+#ifndef RWLOCK_CACHELINE
+#define RWLOCK_CACHELINE 64
+#endif
+
+#define RWLOCK_SLOT_STRIDE	(RWLOCK_CACHELINE / sizeof(isc_int32_t))
+#define RWLOCK_READERS_SIZE	(RWLOCK_READER_SLOTS * RWLOCK_CACHELINE)
+
 static isc_result_t
 isc__rwlock_lock(isc_rwlock_t *rwl, isc_rwlocktype_t type);
+
+static isc_int32_t
+distributed_readers(isc_rwlock_t *rwl);
 #endif
 
 #ifdef ISC_RWLOCK_TRACE
@@ -92,6 +116,8 @@ isc_rwlock_init(isc_rwlock_t *rwl, unsigned int read_quota,
 	rwl->cnt_and_flag = 0;
 	rwl->readers_waiting = 0;
 	rwl->write_granted = 0;
+	rwl->mctx = NULL;
+	rwl->readers = NULL;
 	if (read_quota != 0) {
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
 				 "read quota is not supported");
@@ -158,6 +184,12 @@ isc_rwlock_destroy(isc_rwlock_t *rwl) {
 #if defined(ISC_PLATFORM_HAVEXADD) && defined(ISC_PLATFORM_HAVECMPXCHG)
 	REQUIRE(rwl->write_requests == rwl->write_completions &&
 		rwl->cnt_and_flag == 0 && rwl->readers_waiting == 0);
+	if (rwl->readers != NULL) {
+		REQUIRE(distributed_readers(rwl) == 0);
+		isc_mem_putanddetach(&rwl->mctx, rwl->readers,
+				     RWLOCK_READERS_SIZE);
+		rwl->readers = NULL;
+	}
 #else
 	LOCK(&rwl->lock);
 	REQUIRE(rwl->active == 0 &&
@@ -239,6 +271,205 @@ isc_rwlock_destroy(isc_rwlock_t *rwl) {
 #define WRITER_ACTIVE	0x1
 #define READER_INCR	0x2
 
+/*
+ * Distributed locks.
+ *
+ * A lock set up by isc_rwlock_initdistributed() keeps a separate reader
+ * count for each of RWLOCK_READER_SLOTS slots.  Each thread is given a
+ * slot the first time it takes such a lock, round robin, and always
+ * counts itself there; the slots are a cache line apart, so as long as
+ * there are no more busy threads than slots a reader only ever writes
+ * to its own cache line.
+ *
+ * A writer first waits for any other writer, under the lock's mutex,
+ * then sets WRITER_ACTIVE in cnt_and_flag and waits until the sum of
+ * the reader counts drops to zero.  A reader increments its count and
+ * then checks cnt_and_flag.  Both steps are full barriers, so either
+ * the reader sees WRITER_ACTIVE, decrements its count again and sleeps
+ * until the writer is done, or the writer sees the reader and waits for
+ * it.  A reader that decrements its count while WRITER_ACTIVE is set
+ * wakes the writers; as above, they re-check under the mutex before
+ * sleeping.
+ *
+ * Writers are expected to be rare, so they are not queued and there is
+ * no write quota: when a writer finishes, every waiting reader and
+ * writer is woken.
+ */
+
+static isc_once_t slot_once = ISC_ONCE_INIT;
+static isc_boolean_t slot_key_ok = ISC_FALSE;
+static isc_thread_key_t slot_key;
+static isc_int32_t slot_next = 0;
+
+static void
+init_slotkey(void) {
+	if (isc_thread_key_create(&slot_key, NULL) == 0)
+		slot_key_ok = ISC_TRUE;
+}
+
+/*
+ * Return the calling thread's reader count in 'rwl'.
+ */
+static inline isc_int32_t *
+reader_count(isc_rwlock_t *rwl) {
+	unsigned int slot;
+
+	/* Slots are stored plus one, so that NULL means "none yet". */
+	slot = (unsigned int)(size_t)isc_thread_key_getspecific(slot_key);
+	if (slot == 0) {
+		slot = (unsigned int)isc_atomic_xadd(&slot_next, 1);
+		slot = slot % RWLOCK_READER_SLOTS + 1;
+		(void)isc_thread_key_setspecific(slot_key,
+						 (void *)(size_t)slot);
+	}
+	return (&rwl->readers[(slot - 1) * RWLOCK_SLOT_STRIDE]);
+}
+
+static isc_int32_t
+distributed_readers(isc_rwlock_t *rwl) {
+	isc_int32_t readers = 0;
+	unsigned int i;
+
+	for (i = 0; i < RWLOCK_READER_SLOTS; i++)
+		readers += rwl->readers[i * RWLOCK_SLOT_STRIDE];
+	return (readers);
+}
+
+/*
+ * Drop a read reference, waking writers if one is waiting for it.
+ */
+static inline void
+distributed_readdone(isc_rwlock_t *rwl, isc_int32_t *count) {
+	(void)isc_atomic_xadd(count, -1);
+	if (rwl->cnt_and_flag != 0) {
+		LOCK(&rwl->lock);
+		BROADCAST(&rwl->writeable);
+		UNLOCK(&rwl->lock);
+	}
+}
+
+/*
+ * Clear WRITER_ACTIVE and wake everything waiting for it.  Called
+ * with the mutex held.
+ */
+static inline void
+distributed_writedone(isc_rwlock_t *rwl) {
+	(void)isc_atomic_xadd(&rwl->cnt_and_flag, -WRITER_ACTIVE);
+	if (rwl->readers_waiting > 0)
+		BROADCAST(&rwl->readable);
+	BROADCAST(&rwl->writeable);
+}
+
+static isc_result_t
+distributed_lock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
+	isc_int32_t *count;
+
+	if (type == isc_rwlocktype_read) {
+		count = reader_count(rwl);
+		for (;;) {
+			(void)isc_atomic_xadd(count, 1);
+			if (rwl->cnt_and_flag == 0)
+				break;
+
+			/* A writer is waiting or working; let it go first. */
+			distributed_readdone(rwl, count);
+			LOCK(&rwl->lock);
+			rwl->readers_waiting++;
+			while (rwl->cnt_and_flag != 0)
+				WAIT(&rwl->readable, &rwl->lock);
+			rwl->readers_waiting--;
+			UNLOCK(&rwl->lock);
+		}
+	} else {
+		LOCK(&rwl->lock);
+		while (rwl->cnt_and_flag != 0)
+			WAIT(&rwl->writeable, &rwl->lock);
+		(void)isc_atomic_xadd(&rwl->cnt_and_flag, WRITER_ACTIVE);
+		while (distributed_readers(rwl) != 0)
+			WAIT(&rwl->writeable, &rwl->lock);
+		UNLOCK(&rwl->lock);
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+distributed_trylock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
+	isc_int32_t *count;
+	isc_result_t result = ISC_R_SUCCESS;
+
+	if (type == isc_rwlocktype_read) {
+		count = reader_count(rwl);
+		(void)isc_atomic_xadd(count, 1);
+		if (rwl->cnt_and_flag != 0) {
+			distributed_readdone(rwl, count);
+			result = ISC_R_LOCKBUSY;
+		}
+	} else {
+		LOCK(&rwl->lock);
+		if (rwl->cnt_and_flag != 0)
+			result = ISC_R_LOCKBUSY;
+		else {
+			(void)isc_atomic_xadd(&rwl->cnt_and_flag,
+					      WRITER_ACTIVE);
+			if (distributed_readers(rwl) != 0) {
+				distributed_writedone(rwl);
+				result = ISC_R_LOCKBUSY;
+			}
+		}
+		UNLOCK(&rwl->lock);
+	}
+
+	return (result);
+}
+
+static isc_result_t
+distributed_tryupgrade(isc_rwlock_t *rwl) {
+	isc_result_t result = ISC_R_LOCKBUSY;
+
+	LOCK(&rwl->lock);
+	/*
+	 * If a writer is already waiting it is waiting for us, so we
+	 * must not wait for it.
+	 */
+	if (rwl->cnt_and_flag == 0) {
+		(void)isc_atomic_xadd(&rwl->cnt_and_flag, WRITER_ACTIVE);
+		if (distributed_readers(rwl) == 1) {
+			/* We are the only reader. */
+			(void)isc_atomic_xadd(reader_count(rwl), -1);
+			result = ISC_R_SUCCESS;
+		} else
+			distributed_writedone(rwl);
+	}
+	UNLOCK(&rwl->lock);
+
+	return (result);
+}
+
+static void
+distributed_downgrade(isc_rwlock_t *rwl) {
+	INSIST(rwl->cnt_and_flag == WRITER_ACTIVE);
+
+	LOCK(&rwl->lock);
+	(void)isc_atomic_xadd(reader_count(rwl), 1);
+	distributed_writedone(rwl);
+	UNLOCK(&rwl->lock);
+}
+
+static isc_result_t
+distributed_unlock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
+	if (type == isc_rwlocktype_read)
+		distributed_readdone(rwl, reader_count(rwl));
+	else {
+		INSIST(rwl->cnt_and_flag == WRITER_ACTIVE);
+		LOCK(&rwl->lock);
+		distributed_writedone(rwl);
+		UNLOCK(&rwl->lock);
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
 static isc_result_t
 isc__rwlock_lock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 	isc_int32_t cntflag;
@@ -355,6 +586,9 @@ isc_rwlock_lock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 	isc_int32_t max_cnt = rwl->spins * 2 + 10;
 	isc_result_t result = ISC_R_SUCCESS;
 
+	if (rwl->readers != NULL)
+		return (distributed_lock(rwl, type));
+
 	if (max_cnt > RWLOCK_MAX_ADAPTIVE_COUNT)
 		max_cnt = RWLOCK_MAX_ADAPTIVE_COUNT;
 
@@ -379,6 +613,9 @@ isc_rwlock_trylock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 
 	REQUIRE(VALID_RWLOCK(rwl));
 
+	if (rwl->readers != NULL)
+		return (distributed_trylock(rwl, type));
+
 #ifdef ISC_RWLOCK_TRACE
 	print_lock(isc_msgcat_get(isc_msgcat, ISC_MSGSET_RWLOCK,
 				  ISC_MSG_PRELOCK, "prelock"), rwl, type);
@@ -441,6 +678,9 @@ isc_rwlock_tryupgrade(isc_rwlock_t *rwl) {
 
 	REQUIRE(VALID_RWLOCK(rwl));
 
+	if (rwl->readers != NULL)
+		return (distributed_tryupgrade(rwl));
+
 	/* Try to acquire write access. */
 	prevcnt = isc_atomic_cmpxchg(&rwl->cnt_and_flag,
 				     READER_INCR, WRITER_ACTIVE);
@@ -470,6 +710,11 @@ isc_rwlock_downgrade(isc_rwlock_t *rwl) {
 
 	REQUIRE(VALID_RWLOCK(rwl));
 
+	if (rwl->readers != NULL) {
+		distributed_downgrade(rwl);
+		return;
+	}
+
 	/* Become an active reader. */
 	prev_readers = isc_atomic_xadd(&rwl->cnt_and_flag, READER_INCR);
 	/* We must have been a writer. */
@@ -492,6 +737,9 @@ isc_rwlock_unlock(isc_rwlock_t *rwl, isc_rwlocktype_t type) {
 
 	REQUIRE(VALID_RWLOCK(rwl));
 
+	if (rwl->readers != NULL)
+		return (distributed_unlock(rwl, type));
+
 #ifdef ISC_RWLOCK_TRACE
 	print_lock(isc_msgcat_get(isc_msgcat, ISC_MSGSET_RWLOCK,
 				  ISC_MSG_PREUNLOCK, "preunlock"), rwl, type);
@@ -852,3 +1100,61 @@ isc_rwlock_destroy(isc_rwlock_t *rwl) {
 }
 
 #endif /* ISC_PLATFORM_USETHREADS */
+
+isc_result_t
+isc__rwlock_lockprof(isc_rwlock_t *rwl, isc_rwlocktype_t type,
+		     const char *file, unsigned int line)
+{
+	isc_lockproftype_t proftype;
+	isc_time_t start, end;
+	isc_result_t result;
+
+	if (!isc__lockprof_sample())
+		return (isc_rwlock_lock(rwl, type));
+
+	proftype = (type == isc_rwlocktype_read) ? isc_lockproftype_read
+						 : isc_lockproftype_write;
+
+	if (isc_rwlock_trylock(rwl, type) == ISC_R_SUCCESS) {
+		isc__lockprof_record(file, line, proftype, ISC_FALSE, 0);
+		return (ISC_R_SUCCESS);
+	}
+
+	TIME_NOW(&start);
+	result = isc_rwlock_lock(rwl, type);
+	TIME_NOW(&end);
+	if (result == ISC_R_SUCCESS)
+		isc__lockprof_record(file, line, proftype, ISC_TRUE,
+				     isc_time_microdiff(&end, &start));
+	return (result);
+}
+
+isc_result_t
+isc_rwlock_initdistributed(isc_rwlock_t *rwl, isc_mem_t *mctx) {
+	isc_result_t result;
+
+	REQUIRE(mctx != NULL);
+
+	result = isc_rwlock_init(rwl, 0, 0);
+#ifdef ISC_RWLOCK_USEATOMIC
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	RUNTIME_CHECK(isc_once_do(&slot_once, init_slotkey) ==
+		      ISC_R_SUCCESS);
+	if (!slot_key_ok)
+		return (ISC_R_SUCCESS);		/* Use a plain lock. */
+
+	rwl->readers = isc_mem_get(mctx, RWLOCK_READERS_SIZE);
+	if (rwl->readers == NULL) {
+		isc_rwlock_destroy(rwl);
+		return (ISC_R_NOMEMORY);
+	}
+	memset(rwl->readers, 0, RWLOCK_READERS_SIZE);
+	isc_mem_attach(mctx, &rwl->mctx);
+#else
+	UNUSED(mctx);
+#endif
+
+	return (result);
+}
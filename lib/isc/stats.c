@@ -18,10 +18,13 @@
 #include <isc/buffer.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
+#include <isc/once.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/rwlock.h>
 #include <isc/stats.h>
+#include <isc/thread.h>
 #include <isc/util.h>
 
 #define ISC_STATS_MAGIC			ISC_MAGIC('S', 't', 'a', 't')
@@ -76,11 +79,33 @@ typedef struct {
 typedef isc_uint64_t isc_stat_t;
 #endif
 
+/*%
+ * In a set created with ISC_STATS_SHARDED each counter is kept in one
+ * shard per CPU, and a thread only ever updates the shard it was given
+ * the first time it touched any sharded statistics, so that threads
+ * counting the same events don't keep stealing the cache line from
+ * each other.  Reading a counter sums its shards.  The shards of a set
+ * are a cache line apart.  Other sets have a single shard.
+ */
+#define ISC_STATS_MAXSHARDS	16
+#define ISC_STATS_LINESTATS	(64 / sizeof(isc_stat_t))
+
+static isc_once_t shards_once = ISC_ONCE_INIT;
+static unsigned int nshards = 1;
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_thread_key_t shard_key;
+static isc_boolean_t shard_key_ok = ISC_FALSE;
+static isc_mutex_t shard_lock;
+static unsigned int shard_next = 0;	/* locked by shard_lock */
+#endif
+
 struct isc_stats {
 	/*% Unlocked */
 	unsigned int	magic;
 	isc_mem_t	*mctx;
 	int		ncounters;
+	unsigned int	nshards;
+	unsigned int	stride;		/* distance between shards */
 
 	isc_mutex_t	lock;
 	unsigned int	references; /* locked by lock */
@@ -92,7 +117,7 @@ struct isc_stats {
 #if ISC_STATS_LOCKCOUNTERS
 	isc_rwlock_t	counterlock;
 #endif
-	isc_stat_t	*counters;
+	isc_stat_t	*counters;	/* nshards * stride */
 
 	/*%
 	 * We don't want to lock the counters while we are dumping, so we first
@@ -108,13 +133,62 @@ struct isc_stats {
 	isc_uint64_t	*copiedcounters;
 };
 
+static void
+init_shards(void) {
+#ifdef ISC_PLATFORM_USETHREADS
+	nshards = ISC_MIN(isc_os_ncpus(), ISC_STATS_MAXSHARDS);
+	if (nshards == 0)
+		nshards = 1;
+	RUNTIME_CHECK(isc_mutex_init(&shard_lock) == ISC_R_SUCCESS);
+	if (nshards > 1 && isc_thread_key_create(&shard_key, NULL) == 0)
+		shard_key_ok = ISC_TRUE;
+	else
+		nshards = 1;
+#endif
+}
+
+/*%
+ * Return the shard the calling thread updates.  Threads are handed
+ * shards in turn; when there are more threads than shards, some share
+ * one, which is why updates remain atomic.
+ */
+static inline unsigned int
+getshard(void) {
+#ifdef ISC_PLATFORM_USETHREADS
+	void *value;
+	unsigned int shard;
+
+	if (!shard_key_ok)
+		return (0);
+
+	value = isc_thread_key_getspecific(shard_key);
+	if (value != NULL)
+		return ((unsigned int)(size_t)value - 1);
+
+	LOCK(&shard_lock);
+	shard = shard_next++ % nshards;
+	UNLOCK(&shard_lock);
+	(void)isc_thread_key_setspecific(shard_key,
+					 (void *)(size_t)(shard + 1));
+	return (shard);
+#else
+	return (0);
+#endif
+}
+
 static isc_result_t
-create_stats(isc_mem_t *mctx, int ncounters, isc_stats_t **statsp) {
+create_stats(isc_mem_t *mctx, int ncounters, unsigned int flags,
+	     isc_stats_t **statsp)
+{
 	isc_stats_t *stats;
 	isc_result_t result = ISC_R_SUCCESS;
 
 	REQUIRE(statsp != NULL && *statsp == NULL);
 
+	if ((flags & ISC_STATS_SHARDED) != 0)
+		RUNTIME_CHECK(isc_once_do(&shards_once, init_shards) ==
+			      ISC_R_SUCCESS);
+
 	stats = isc_mem_get(mctx, sizeof(*stats));
 	if (stats == NULL)
 		return (ISC_R_NOMEMORY);
@@ -123,7 +197,19 @@ create_stats(isc_mem_t *mctx, int ncounters, isc_stats_t **statsp) {
 	if (result != ISC_R_SUCCESS)
 		goto clean_stats;
 
-	stats->counters = isc_mem_get(mctx, sizeof(isc_stat_t) * ncounters);
+	/*
+	 * Round each shard up to whole cache lines, plus one more so
+	 * that neighbouring shards never share a line whatever the
+	 * alignment of the allocation.
+	 */
+	stats->nshards = ((flags & ISC_STATS_SHARDED) != 0) ? nshards : 1;
+	stats->stride = ncounters;
+	if (stats->nshards > 1)
+		stats->stride = (ncounters + ISC_STATS_LINESTATS - 1) /
+				ISC_STATS_LINESTATS * ISC_STATS_LINESTATS +
+				ISC_STATS_LINESTATS;
+	stats->counters = isc_mem_get(mctx, sizeof(isc_stat_t) *
+				      stats->stride * stats->nshards);
 	if (stats->counters == NULL) {
 		result = ISC_R_NOMEMORY;
 		goto clean_mutex;
@@ -142,7 +228,8 @@ create_stats(isc_mem_t *mctx, int ncounters, isc_stats_t **statsp) {
 #endif
 
 	stats->references = 1;
-	memset(stats->counters, 0, sizeof(isc_stat_t) * ncounters);
+	memset(stats->counters, 0,
+	       sizeof(isc_stat_t) * stats->stride * stats->nshards);
 	stats->mctx = NULL;
 	isc_mem_attach(mctx, &stats->mctx);
 	stats->ncounters = ncounters;
@@ -153,7 +240,8 @@ create_stats(isc_mem_t *mctx, int ncounters, isc_stats_t **statsp) {
 	return (result);
 
 clean_counters:
-	isc_mem_put(mctx, stats->counters, sizeof(isc_stat_t) * ncounters);
+	isc_mem_put(mctx, stats->counters,
+		    sizeof(isc_stat_t) * stats->stride * stats->nshards);
 
 #if ISC_STATS_LOCKCOUNTERS
 clean_copiedcounters:
@@ -198,7 +286,8 @@ isc_stats_detach(isc_stats_t **statsp) {
 		isc_mem_put(stats->mctx, stats->copiedcounters,
 			    sizeof(isc_stat_t) * stats->ncounters);
 		isc_mem_put(stats->mctx, stats->counters,
-			    sizeof(isc_stat_t) * stats->ncounters);
+			    sizeof(isc_stat_t) * stats->stride *
+			    stats->nshards);
 		UNLOCK(&stats->lock);
 		DESTROYLOCK(&stats->lock);
 #if ISC_STATS_LOCKCOUNTERS
@@ -219,9 +308,12 @@ isc_stats_ncounters(isc_stats_t *stats) {
 }
 
 static inline void
-incrementcounter(isc_stats_t *stats, int counter) {
+addcounter(isc_stats_t *stats, int counter, isc_uint32_t val) {
 	isc_int32_t prev;
 
+	if (stats->nshards > 1)
+		counter += getshard() * stats->stride;
+
 #if ISC_STATS_LOCKCOUNTERS
 	/*
 	 * We use a "read" lock to prevent other threads from reading the
@@ -232,7 +324,8 @@ incrementcounter(isc_stats_t *stats, int counter) {
 #endif
 
 #if ISC_STATS_USEMULTIFIELDS
-	prev = isc_atomic_xadd((isc_int32_t *)&stats->counters[counter].lo, 1);
+	prev = isc_atomic_xadd((isc_int32_t *)&stats->counters[counter].lo,
+			       (isc_int32_t)val);
 	/*
 	 * If the lower 32-bit field overflows, increment the higher field.
 	 * Note that it's *theoretically* possible that the lower field
@@ -241,14 +334,15 @@ incrementcounter(isc_stats_t *stats, int counter) {
 	 * isc_stats_copy() is called where the whole process is protected
 	 * by the write (exclusive) lock.
 	 */
-	if (prev == (isc_int32_t)0xffffffff)
+	if ((isc_uint32_t)prev + val < (isc_uint32_t)prev)
 		isc_atomic_xadd((isc_int32_t *)&stats->counters[counter].hi, 1);
 #elif ISC_STATS_HAVEATOMICQ
 	UNUSED(prev);
-	isc_atomic_xaddq((isc_int64_t *)&stats->counters[counter], 1);
+	isc_atomic_xaddq((isc_int64_t *)&stats->counters[counter],
+			 (isc_int64_t)val);
 #else
 	UNUSED(prev);
-	stats->counters[counter]++;
+	stats->counters[counter] += val;
 #endif
 
 #if ISC_STATS_LOCKCOUNTERS
@@ -260,6 +354,9 @@ static inline void
 decrementcounter(isc_stats_t *stats, int counter) {
 	isc_int32_t prev;
 
+	if (stats->nshards > 1)
+		counter += getshard() * stats->stride;
+
 #if ISC_STATS_LOCKCOUNTERS
 	isc_rwlock_lock(&stats->counterlock, isc_rwlocktype_read);
 #endif
@@ -284,6 +381,8 @@ decrementcounter(isc_stats_t *stats, int counter) {
 
 static void
 copy_counters(isc_stats_t *stats) {
+	isc_stat_t *shard;
+	unsigned int s;
 	int i;
 
 #if ISC_STATS_LOCKCOUNTERS
@@ -294,18 +393,23 @@ copy_counters(isc_stats_t *stats) {
 	isc_rwlock_lock(&stats->counterlock, isc_rwlocktype_write);
 #endif
 
-	for (i = 0; i < stats->ncounters; i++) {
+	memset(stats->copiedcounters, 0,
+	       sizeof(isc_uint64_t) * stats->ncounters);
+	for (s = 0; s < stats->nshards; s++) {
+		shard = stats->counters + s * stats->stride;
+		for (i = 0; i < stats->ncounters; i++) {
 #if ISC_STATS_USEMULTIFIELDS
-		stats->copiedcounters[i] =
-			(isc_uint64_t)(stats->counters[i].hi) << 32 |
-			stats->counters[i].lo;
+			stats->copiedcounters[i] +=
+				(isc_uint64_t)(shard[i].hi) << 32 |
+				shard[i].lo;
 #elif ISC_STATS_HAVEATOMICQ
-		/* use xaddq(..., 0) as an atomic load */
-		stats->copiedcounters[i] =
-			(isc_uint64_t)isc_atomic_xaddq((isc_int64_t *)&stats->counters[i], 0);
+			/* use xaddq(..., 0) as an atomic load */
+			stats->copiedcounters[i] += (isc_uint64_t)
+				isc_atomic_xaddq((isc_int64_t *)&shard[i], 0);
 #else
-		stats->copiedcounters[i] = stats->counters[i];
+			stats->copiedcounters[i] += shard[i];
 #endif
+		}
 	}
 
 #if ISC_STATS_LOCKCOUNTERS
@@ -317,7 +421,16 @@ isc_result_t
 isc_stats_create(isc_mem_t *mctx, isc_stats_t **statsp, int ncounters) {
 	REQUIRE(statsp != NULL && *statsp == NULL);
 
-	return (create_stats(mctx, ncounters, statsp));
+	return (create_stats(mctx, ncounters, 0, statsp));
+}
+
+isc_result_t
+isc_stats_create2(isc_mem_t *mctx, isc_stats_t **statsp, int ncounters,
+		  unsigned int flags)
+{
+	REQUIRE(statsp != NULL && *statsp == NULL);
+
+	return (create_stats(mctx, ncounters, flags, statsp));
 }
 
 void
@@ -325,7 +438,17 @@ isc_stats_increment(isc_stats_t *stats, isc_statscounter_t counter) {
 	REQUIRE(ISC_STATS_VALID(stats));
 	REQUIRE(counter < stats->ncounters);
 
-	incrementcounter(stats, (int)counter);
+	addcounter(stats, (int)counter, 1);
+}
+
+void
+isc_stats_add(isc_stats_t *stats, isc_statscounter_t counter,
+	      isc_uint32_t val)
+{
+	REQUIRE(ISC_STATS_VALID(stats));
+	REQUIRE(counter < stats->ncounters);
+
+	addcounter(stats, (int)counter, val);
 }
 
 void
@@ -358,6 +481,9 @@ void
 isc_stats_set(isc_stats_t *stats, isc_uint64_t val,
 	      isc_statscounter_t counter)
 {
+	isc_stat_t *stat;
+	unsigned int s;
+
 	REQUIRE(ISC_STATS_VALID(stats));
 	REQUIRE(counter < stats->ncounters);
 
@@ -369,14 +495,21 @@ isc_stats_set(isc_stats_t *stats, isc_uint64_t val,
 	isc_rwlock_lock(&stats->counterlock, isc_rwlocktype_write);
 #endif
 
+	/*
+	 * The first shard takes the value and the others are cleared.
+	 */
+	for (s = 0; s < stats->nshards; s++) {
+		stat = &stats->counters[s * stats->stride + counter];
 #if ISC_STATS_USEMULTIFIELDS
-	stats->counters[counter].hi = (isc_uint32_t)((val >> 32) & 0xffffffff);
-	stats->counters[counter].lo = (isc_uint32_t)(val & 0xffffffff);
+		stat->hi = (isc_uint32_t)((val >> 32) & 0xffffffff);
+		stat->lo = (isc_uint32_t)(val & 0xffffffff);
 #elif ISC_STATS_HAVEATOMICQ
-	isc_atomic_storeq((isc_int64_t *)&stats->counters[counter], val);
+		isc_atomic_storeq((isc_int64_t *)stat, val);
 #else
-	stats->counters[counter] = val;
+		*stat = val;
 #endif
+		val = 0;
+	}
 
 #if ISC_STATS_LOCKCOUNTERS
 	isc_rwlock_unlock(&stats->counterlock, isc_rwlocktype_write);
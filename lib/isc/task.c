@@ -17,6 +17,9 @@
 
 #include <config.h>
 
+#include <ctype.h>
+#include <stdlib.h>
+
 #include <isc/app.h>
 #include <isc/condition.h>
 #include <isc/event.h>
@@ -126,6 +129,34 @@ struct isc__task {
 
 typedef ISC_LIST(isc__task_t)	isc__tasklist_t;
 
+/*%
+ * Task profiling.  Each worker counts the events it runs in its own
+ * tables, one keyed by task name and one by event type, so recording an
+ * event takes no lock and shares no cache line with other workers.
+ * Only the worker adds entries to its tables, and it does so holding
+ * the worker lock so that readers, who take the same lock, never see
+ * an entry half written.  When a table is full, further keys are all
+ * counted in its last entry.
+ */
+#define TASKPROF_NAMES			64
+#define TASKPROF_TYPES			128
+
+typedef struct taskprof {
+	isc_boolean_t			used;
+	char				name[16];	/* task name key */
+	isc_eventtype_t			type;		/* event type key */
+	isc_uint64_t			events;
+	isc_uint64_t			runtime;	/* microseconds */
+	isc_uint64_t			waittime;	/* microseconds */
+} taskprof_t;
+
+typedef struct isc__taskworker {
+	isc__taskmgr_t *		manager;
+	isc_mutex_t			lock;
+	taskprof_t			names[TASKPROF_NAMES + 1];
+	taskprof_t			types[TASKPROF_TYPES + 1];
+} isc__taskworker_t;
+
 struct isc__taskmgr {
 	/* Not locked. */
 	isc_taskmgr_t			common;
@@ -135,6 +166,9 @@ struct isc__taskmgr {
 	unsigned int			workers;
 	isc_thread_t *			threads;
 #endif /* ISC_PLATFORM_USETHREADS */
+	isc__taskworker_t *		workerstate;
+	unsigned int			nworkerstate;
+	isc_boolean_t			profiling;
 	/* Locked by task manager lock. */
 	unsigned int			default_quantum;
 	LIST(isc__task_t)		tasks;
@@ -189,6 +223,11 @@ void
 isc__task_send(isc_task_t *task0, isc_event_t **eventp);
 void
 isc__task_sendanddetach(isc_task_t **taskp, isc_event_t **eventp);
+void
+isc__task_sendlist(isc_task_t *task0, isc_eventlist_t *events);
+void
+isc__task_sendmany(isc_task_t **tasks, isc_event_t **events,
+		   unsigned int count, isc_boolean_t detach);
 unsigned int
 isc__task_purgerange(isc_task_t *task0, void *sender, isc_eventtype_t first,
 		     isc_eventtype_t last, void *tag);
@@ -295,6 +334,107 @@ static isc_taskmgrmethods_t taskmgrmethods = {
 	isc_taskmgr_excltask
 };
 
+/***
+ *** Task profiling.
+ ***/
+
+static inline isc_uint64_t
+prof_usecs(const isc_time_t *t) {
+	return ((isc_uint64_t)isc_time_seconds(t) * 1000000 +
+		isc_time_nanoseconds(t) / 1000);
+}
+
+static inline isc_uint64_t
+prof_now(void) {
+	isc_time_t now;
+
+	TIME_NOW(&now);
+	return (prof_usecs(&now));
+}
+
+static void
+prof_init(isc__taskworker_t *worker) {
+	memset(worker->names, 0, sizeof(worker->names));
+	memset(worker->types, 0, sizeof(worker->types));
+	strcpy(worker->names[TASKPROF_NAMES].name, "other");
+	worker->names[TASKPROF_NAMES].used = ISC_TRUE;
+	worker->types[TASKPROF_TYPES].type = ISC_EVENTTYPE_LASTEVENT;
+	worker->types[TASKPROF_TYPES].used = ISC_TRUE;
+}
+
+/*%
+ * Find the entry for 'name' and 'type' in 'table', adding it if needed.
+ */
+static taskprof_t *
+prof_lookup(isc__taskworker_t *worker, taskprof_t *table, unsigned int size,
+	    unsigned int hash, const char *name, isc_eventtype_t type)
+{
+	taskprof_t *entry;
+	unsigned int i, n;
+
+	for (n = 0, i = hash % size; n < size; n++, i = (i + 1) % size) {
+		entry = &table[i];
+		if (!entry->used) {
+			LOCK(&worker->lock);
+			strcpy(entry->name, name);
+			entry->type = type;
+			entry->used = ISC_TRUE;
+			UNLOCK(&worker->lock);
+			return (entry);
+		}
+		if (entry->type == type && strcmp(entry->name, name) == 0)
+			return (entry);
+	}
+
+	return (&table[size]);
+}
+
+/*%
+ * Tasks whose names differ only by a trailing number, such as the
+ * resolver's "res0" to "res522", are counted together.
+ */
+static taskprof_t *
+prof_taskname(isc__taskworker_t *worker, isc__task_t *task) {
+	char name[sizeof(task->name)];
+	unsigned int hash = 0;
+	size_t len, i;
+
+	len = strlen(task->name);
+	while (len > 1 && isdigit((unsigned char)task->name[len - 1]))
+		len--;
+	for (i = 0; i < len; i++) {
+		name[i] = task->name[i];
+		hash = hash * 31 + (unsigned char)name[i];
+	}
+	name[len] = '\0';
+
+	return (prof_lookup(worker, worker->names, TASKPROF_NAMES, hash,
+			    name, 0));
+}
+
+static inline void
+prof_record(isc__taskworker_t *worker, taskprof_t *byname,
+	    isc_eventtype_t type, isc_uint64_t queued, isc_uint64_t start,
+	    isc_uint64_t end)
+{
+	taskprof_t *bytype;
+	isc_uint64_t runtime, waittime = 0;
+
+	runtime = (end > start) ? end - start : 0;
+	if (queued != 0 && start > queued)
+		waittime = start - queued;
+
+	bytype = prof_lookup(worker, worker->types, TASKPROF_TYPES,
+			     type ^ (type >> 16), "", type);
+
+	byname->events++;
+	byname->runtime += runtime;
+	byname->waittime += waittime;
+	bytype->events++;
+	bytype->runtime += runtime;
+	bytype->waittime += waittime;
+}
+
 /***
  *** Tasks.
  ***/
@@ -532,8 +672,13 @@ isc__task_detach(isc_task_t **taskp) {
 	*taskp = NULL;
 }
 
+/*
+ * Queue '*eventp' on 'task', stamped with 'timestamp'.
+ */
 static inline isc_boolean_t
-task_send(isc__task_t *task, isc_event_t **eventp) {
+task_sendstamped(isc__task_t *task, isc_event_t **eventp,
+		 isc_uint64_t timestamp)
+{
 	isc_boolean_t was_idle = ISC_FALSE;
 	isc_event_t *event;
 
@@ -556,6 +701,7 @@ task_send(isc__task_t *task, isc_event_t **eventp) {
 	}
 	INSIST(task->state == task_state_ready ||
 	       task->state == task_state_running);
+	event->ev_timestamp = timestamp;
 	ENQUEUE(task->events, event, ev_link);
 	task->nevents++;
 	*eventp = NULL;
@@ -563,6 +709,12 @@ task_send(isc__task_t *task, isc_event_t **eventp) {
 	return (was_idle);
 }
 
+static inline isc_boolean_t
+task_send(isc__task_t *task, isc_event_t **eventp) {
+	return (task_sendstamped(task, eventp,
+				 task->manager->profiling ? prof_now() : 0));
+}
+
 void
 isc__task_send(isc_task_t *task0, isc_event_t **eventp) {
 	isc__task_t *task = (isc__task_t *)task0;
@@ -639,6 +791,140 @@ isc__task_sendanddetach(isc_task_t **taskp, isc_event_t **eventp) {
 	*taskp = NULL;
 }
 
+void
+isc__task_sendlist(isc_task_t *task0, isc_eventlist_t *events) {
+	isc__task_t *task = (isc__task_t *)task0;
+	isc_boolean_t was_idle = ISC_FALSE;
+	isc_uint64_t timestamp;
+	isc_event_t *event;
+
+	/*
+	 * Send all of 'events' to 'task', in order.
+	 */
+
+	REQUIRE(VALID_TASK(task));
+	REQUIRE(events != NULL);
+
+	XTRACE("isc_task_sendlist");
+
+	if (EMPTY(*events))
+		return;
+
+	timestamp = task->manager->profiling ? prof_now() : 0;
+
+	LOCK(&task->lock);
+	while ((event = HEAD(*events)) != NULL) {
+		DEQUEUE(*events, event, ev_link);
+		if (task_sendstamped(task, &event, timestamp))
+			was_idle = ISC_TRUE;
+	}
+	UNLOCK(&task->lock);
+
+	/*
+	 * See isc__task_send() for why this is done after the task lock
+	 * is released.
+	 */
+	if (was_idle)
+		task_ready(task);
+}
+
+/*%
+ * isc__task_sendmany() makes at most this many tasks ready with one
+ * acquisition of the manager lock.
+ */
+#define SENDMANY_READY	32
+
+/*
+ * Push 'ready[0..count-1]', which all belong to 'manager', onto its
+ * ready queue.
+ */
+static void
+ready_many(isc__taskmgr_t *manager, isc__task_t **ready,
+	   isc_boolean_t *privileged, unsigned int count)
+{
+	unsigned int i;
+
+	LOCK(&manager->lock);
+	for (i = 0; i < count; i++) {
+		REQUIRE(ready[i]->state == task_state_ready);
+		push_readyq(manager, ready[i]);
+#ifdef USE_WORKER_THREADS
+		if (manager->mode == isc_taskmgrmode_normal || privileged[i])
+			SIGNAL(&manager->work_available);
+#else
+		UNUSED(privileged);
+#endif /* USE_WORKER_THREADS */
+	}
+	UNLOCK(&manager->lock);
+}
+
+void
+isc__task_sendmany(isc_task_t **tasks, isc_event_t **events,
+		   unsigned int count, isc_boolean_t detach)
+{
+	isc__task_t *ready[SENDMANY_READY];
+	isc_boolean_t privileged[SENDMANY_READY];
+	isc__taskmgr_t *manager = NULL;
+	isc__task_t *task;
+	isc_boolean_t idle1, idle2;
+	isc_uint64_t timestamp = 0;
+	unsigned int i, nready = 0;
+
+	/*
+	 * Send 'events[i]' to 'tasks[i]' for each 'i'.  Each task's lock
+	 * is taken once for a run of events for the same task, and the
+	 * tasks that become ready are queued together.
+	 */
+
+	REQUIRE(tasks != NULL && events != NULL);
+
+	XTRACE("isc_task_sendmany");
+
+	for (i = 0; i < count; ) {
+		task = (isc__task_t *)tasks[i];
+		REQUIRE(VALID_TASK(task));
+
+		if (task->manager != manager) {
+			if (nready > 0)
+				ready_many(manager, ready, privileged, nready);
+			nready = 0;
+			manager = task->manager;
+			timestamp = manager->profiling ? prof_now() : 0;
+		}
+
+		idle1 = idle2 = ISC_FALSE;
+		LOCK(&task->lock);
+		do {
+			if (task_sendstamped(task, &events[i], timestamp))
+				idle1 = ISC_TRUE;
+			if (detach) {
+				if (task_detach(task))
+					idle2 = ISC_TRUE;
+				tasks[i] = NULL;
+			}
+			i++;
+		} while (i < count && tasks[i] == (isc_task_t *)task);
+		if (idle1 || idle2)
+			privileged[nready] =
+				ISC_TF((task->flags & TASK_F_PRIVILEGED) != 0);
+		UNLOCK(&task->lock);
+
+		/* See isc__task_sendanddetach(). */
+		INSIST(!(idle1 && idle2));
+
+		if (idle1 || idle2) {
+			ready[nready++] = task;
+			if (nready == SENDMANY_READY) {
+				ready_many(manager, ready, privileged, nready);
+				nready = 0;
+			}
+		}
+	}
+
+	if (nready > 0)
+		ready_many(manager, ready, privileged, nready);
+}
+
 #define PURGE_OK(event)	(((event)->ev_attributes & ISC_EVENTATTR_NOPURGE) == 0)
 
 static unsigned int
@@ -997,8 +1283,12 @@ push_readyq(isc__taskmgr_t *manager, isc__task_t *task) {
 }
 
 static void
-dispatch(isc__taskmgr_t *manager) {
+dispatch(isc__taskmgr_t *manager, isc__taskworker_t *worker) {
 	isc__task_t *task;
+	taskprof_t *byname = NULL;
+	isc_boolean_t profiling;
+	isc_uint64_t start = 0, end, queued;
+	isc_eventtype_t type;
 #ifndef USE_WORKER_THREADS
 	unsigned int total_dispatch_count = 0;
 	isc__tasklist_t new_ready_tasks;
@@ -1121,11 +1411,18 @@ dispatch(isc__taskmgr_t *manager) {
 					      ISC_MSG_RUNNING, "running"));
 			TIME_NOW(&task->tnow);
 			task->now = isc_time_seconds(&task->tnow);
+			profiling = manager->profiling;
+			if (profiling) {
+				byname = prof_taskname(worker, task);
+				start = prof_usecs(&task->tnow);
+			}
 			do {
 				if (!EMPTY(task->events)) {
 					event = HEAD(task->events);
 					DEQUEUE(task->events, event, ev_link);
 					task->nevents--;
+					type = event->ev_type;
+					queued = event->ev_timestamp;
 
 					/*
 					 * Execute the event action.
@@ -1141,6 +1438,13 @@ dispatch(isc__taskmgr_t *manager) {
 							event);
 						LOCK(&task->lock);
 					}
+					if (profiling) {
+						end = prof_now();
+						prof_record(worker, byname,
+							    type, queued,
+							    start, end);
+						start = end;
+					}
 					dispatch_count++;
 #ifndef USE_WORKER_THREADS
 					total_dispatch_count++;
@@ -1303,12 +1607,13 @@ static isc_threadresult_t
 WINAPI
 #endif
 run(void *uap) {
-	isc__taskmgr_t *manager = uap;
+	isc__taskworker_t *worker = uap;
+	isc__taskmgr_t *manager = worker->manager;
 
 	XTHREADTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
 				    ISC_MSG_STARTING, "starting"));
 
-	dispatch(manager);
+	dispatch(manager, worker);
 
 	XTHREADTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
 				    ISC_MSG_EXITING, "exiting"));
@@ -1324,6 +1629,12 @@ run(void *uap) {
 static void
 manager_free(isc__taskmgr_t *manager) {
 	isc_mem_t *mctx;
+	unsigned int i;
+
+	for (i = 0; i < manager->nworkerstate; i++)
+		DESTROYLOCK(&manager->workerstate[i].lock);
+	isc_mem_put(manager->mctx, manager->workerstate,
+		    manager->nworkerstate * sizeof(isc__taskworker_t));
 
 #ifdef USE_WORKER_THREADS
 	(void)isc_condition_destroy(&manager->exclusive_granted);
@@ -1360,7 +1671,6 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 	REQUIRE(managerp != NULL && *managerp == NULL);
 
 #ifndef USE_WORKER_THREADS
-	UNUSED(i);
 	UNUSED(started);
 #endif
 
@@ -1391,6 +1701,34 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 		goto cleanup_mgr;
 	}
 
+	/*
+	 * Per-worker state; without worker threads there is one "worker",
+	 * the caller of isc__taskmgr_dispatch().
+	 */
+#ifndef USE_WORKER_THREADS
+	workers = 1;
+#endif
+	manager->profiling = ISC_FALSE;
+	manager->workerstate = isc_mem_get(mctx, workers *
+					   sizeof(isc__taskworker_t));
+	if (manager->workerstate == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_excllock;
+	}
+	for (i = 0; i < workers; i++) {
+		result = isc_mutex_init(&manager->workerstate[i].lock);
+		if (result != ISC_R_SUCCESS) {
+			while (i > 0)
+				DESTROYLOCK(&manager->workerstate[--i].lock);
+			isc_mem_put(mctx, manager->workerstate,
+				    workers * sizeof(isc__taskworker_t));
+			goto cleanup_excllock;
+		}
+		manager->workerstate[i].manager = manager;
+		prof_init(&manager->workerstate[i]);
+	}
+	manager->nworkerstate = workers;
+
 #ifdef USE_WORKER_THREADS
 	manager->workers = 0;
 	manager->threads = isc_mem_allocate(mctx,
@@ -1445,7 +1783,8 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 	 * Start workers.
 	 */
 	for (i = 0; i < workers; i++) {
-		if (isc_thread_create(run, manager,
+		if (isc_thread_create(run,
+				      &manager->workerstate[manager->workers],
 				      &manager->threads[manager->workers]) ==
 		    ISC_R_SUCCESS) {
 			manager->workers++;
@@ -1477,8 +1816,14 @@ isc__taskmgr_create(isc_mem_t *mctx, unsigned int workers,
  cleanup_threads:
 	isc_mem_free(mctx, manager->threads);
  cleanup_lock:
-	DESTROYLOCK(&manager->lock);
+	for (i = 0; i < manager->nworkerstate; i++)
+		DESTROYLOCK(&manager->workerstate[i].lock);
+	isc_mem_put(mctx, manager->workerstate,
+		    manager->nworkerstate * sizeof(isc__taskworker_t));
 #endif
+ cleanup_excllock:
+	DESTROYLOCK(&manager->excl_lock);
+	DESTROYLOCK(&manager->lock);
  cleanup_mgr:
 	isc_mem_put(mctx, manager, sizeof(*manager));
 	return (result);
@@ -1645,7 +1990,7 @@ isc__taskmgr_dispatch(isc_taskmgr_t *manager0) {
 	if (manager == NULL)
 		return (ISC_R_NOTFOUND);
 
-	dispatch(manager);
+	dispatch(manager, &manager->workerstate[0]);
 
 	return (ISC_R_SUCCESS);
 }
@@ -1803,13 +2148,191 @@ isc_task_exiting(isc_task_t *t) {
 	return (TASK_SHUTTINGDOWN(task));
 }
 
+void
+isc_taskmgr_setprofiling(isc_taskmgr_t *mgr0, isc_boolean_t enable) {
+	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
+
+	REQUIRE(VALID_MANAGER(mgr));
+
+	LOCK(&mgr->lock);
+	mgr->profiling = enable;
+	UNLOCK(&mgr->lock);
+}
+
+isc_boolean_t
+isc_taskmgr_profiling(isc_taskmgr_t *mgr0) {
+	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
+
+	REQUIRE(VALID_MANAGER(mgr));
+
+	return (mgr->profiling);
+}
+
+void
+isc_taskmgr_resetprofile(isc_taskmgr_t *mgr0) {
+	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
+	isc__taskworker_t *worker;
+	unsigned int i, j;
+
+	REQUIRE(VALID_MANAGER(mgr));
+
+	/*
+	 * The keys are kept, as a worker may be looking one up; counts
+	 * being added while we clear them may survive the reset.
+	 */
+	for (i = 0; i < mgr->nworkerstate; i++) {
+		worker = &mgr->workerstate[i];
+		LOCK(&worker->lock);
+		for (j = 0; j <= TASKPROF_NAMES; j++) {
+			worker->names[j].events = 0;
+			worker->names[j].runtime = 0;
+			worker->names[j].waittime = 0;
+		}
+		for (j = 0; j <= TASKPROF_TYPES; j++) {
+			worker->types[j].events = 0;
+			worker->types[j].runtime = 0;
+			worker->types[j].waittime = 0;
+		}
+		UNLOCK(&worker->lock);
+	}
+}
+
+static int
+prof_compare(const void *a, const void *b) {
+	const taskprof_t *pa = a, *pb = b;
+
+	if (pa->runtime > pb->runtime)
+		return (-1);
+	if (pa->runtime < pb->runtime)
+		return (1);
+	return (0);
+}
+
+static const char *eventclasses[] = {
+	"task", "timer", "socket", "file", "dns", "app", "omapi",
+	"ratelimiter", "isccc"
+};
+#define NEVENTCLASSES	(sizeof(eventclasses) / sizeof(eventclasses[0]))
+
+isc_result_t
+isc_taskmgr_profile(isc_taskmgr_t *mgr0, isc_taskprofilekey_t key,
+		    isc_taskprofiledumper_t dump_fn, void *arg)
+{
+	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
+	taskprof_t *merged, *table, *entry;
+	unsigned int i, j, k, size, nmerged = 0, nalloc;
+	unsigned int eclass;
+	char buf[sizeof("ratelimiter+65535")];
+
+	REQUIRE(VALID_MANAGER(mgr));
+	REQUIRE(key == isc_taskprofile_name ||
+		key == isc_taskprofile_eventtype);
+
+	size = (key == isc_taskprofile_name) ? TASKPROF_NAMES + 1
+					     : TASKPROF_TYPES + 1;
+	nalloc = size * mgr->nworkerstate;
+	merged = isc_mem_get(mgr->mctx, nalloc * sizeof(*merged));
+	if (merged == NULL)
+		return (ISC_R_NOMEMORY);
+
+	for (i = 0; i < mgr->nworkerstate; i++) {
+		LOCK(&mgr->workerstate[i].lock);
+		table = (key == isc_taskprofile_name)
+				? mgr->workerstate[i].names
+				: mgr->workerstate[i].types;
+		for (j = 0; j < size; j++) {
+			entry = &table[j];
+			if (!entry->used || entry->events == 0)
+				continue;
+			for (k = 0; k < nmerged; k++)
+				if (merged[k].type == entry->type &&
+				    strcmp(merged[k].name, entry->name) == 0)
+					break;
+			if (k == nmerged) {
+				INSIST(nmerged < nalloc);
+				merged[k] = *entry;
+				nmerged++;
+				continue;
+			}
+			merged[k].events += entry->events;
+			merged[k].runtime += entry->runtime;
+			merged[k].waittime += entry->waittime;
+		}
+		UNLOCK(&mgr->workerstate[i].lock);
+	}
+
+	qsort(merged, nmerged, sizeof(*merged), prof_compare);
+
+	for (k = 0; k < nmerged; k++) {
+		entry = &merged[k];
+		if (key == isc_taskprofile_name) {
+			dump_fn(entry->name, entry->events, entry->runtime,
+				entry->waittime, arg);
+			continue;
+		}
+		eclass = entry->type >> 16;
+		if (entry->type == ISC_EVENTTYPE_LASTEVENT)
+			strcpy(buf, "other");
+		else if (eclass < NEVENTCLASSES)
+			snprintf(buf, sizeof(buf), "%s+%u",
+				 eventclasses[eclass], entry->type & 0xffff);
+		else
+			snprintf(buf, sizeof(buf), "%u+%u", eclass,
+				 entry->type & 0xffff);
+		dump_fn(buf, entry->events, entry->runtime, entry->waittime,
+			arg);
+	}
+
+	isc_mem_put(mgr->mctx, merged, nalloc * sizeof(*merged));
+	return (ISC_R_SUCCESS);
+}
+
 
 #ifdef HAVE_LIBXML2
 #define TRY0(a) do { xmlrc = (a); if (xmlrc < 0) goto error; } while(0)
+
+typedef struct {
+	xmlTextWriterPtr	writer;
+	const char		*element;
+	const char		*attribute;
+	int			xmlrc;
+} profxml_t;
+
+static void
+profile_xmldump(const char *key, isc_uint64_t events, isc_uint64_t runtime,
+		isc_uint64_t waittime, void *arg)
+{
+	profxml_t *px = arg;
+	xmlTextWriterPtr writer = px->writer;
+	int xmlrc;
+
+	if (px->xmlrc < 0)
+		return;
+
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR px->element));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR px->attribute,
+					 ISC_XMLCHAR key));
+	TRY0(xmlTextWriterWriteFormatElement(writer, ISC_XMLCHAR "events",
+					     "%" ISC_PRINT_QUADFORMAT "u",
+					     events));
+	TRY0(xmlTextWriterWriteFormatElement(writer, ISC_XMLCHAR "run-time",
+					     "%" ISC_PRINT_QUADFORMAT "u",
+					     runtime));
+	TRY0(xmlTextWriterWriteFormatElement(writer, ISC_XMLCHAR "queue-time",
+					     "%" ISC_PRINT_QUADFORMAT "u",
+					     waittime));
+	TRY0(xmlTextWriterEndElement(writer));
+	return;
+
+ error:
+	px->xmlrc = xmlrc;
+}
+
 int
 isc_taskmgr_renderxml(isc_taskmgr_t *mgr0, xmlTextWriterPtr writer) {
 	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
 	isc__task_t *task = NULL;
+	profxml_t px;
 	int xmlrc;
 
 	LOCK(&mgr->lock);
@@ -1898,6 +2421,30 @@ isc_taskmgr_renderxml(isc_taskmgr_t *mgr0, xmlTextWriterPtr writer) {
 	}
 	TRY0(xmlTextWriterEndElement(writer)); /* tasks */
 
+	/*
+	 * Events run and the time spent running them and waiting in
+	 * the queue, in microseconds, by task name and by event type.
+	 */
+	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "profile"));
+	TRY0(xmlTextWriterWriteAttribute(writer, ISC_XMLCHAR "state",
+					 ISC_XMLCHAR (mgr->profiling ? "on"
+								   : "off")));
+	px.writer = writer;
+	px.xmlrc = 0;
+	px.element = "task";
+	px.attribute = "name";
+	if (isc_taskmgr_profile(mgr0, isc_taskprofile_name,
+				profile_xmldump, &px) != ISC_R_SUCCESS)
+		px.xmlrc = -1;
+	TRY0(px.xmlrc);
+	px.element = "event";
+	px.attribute = "type";
+	if (isc_taskmgr_profile(mgr0, isc_taskprofile_eventtype,
+				profile_xmldump, &px) != ISC_R_SUCCESS)
+		px.xmlrc = -1;
+	TRY0(px.xmlrc);
+	TRY0(xmlTextWriterEndElement(writer)); /* profile */
+
  error:
 	if (task != NULL)
 		UNLOCK(&task->lock);
@@ -1915,12 +2462,51 @@ isc_taskmgr_renderxml(isc_taskmgr_t *mgr0, xmlTextWriterPtr writer) {
 	} \
 } while(0)
 
+typedef struct {
+	json_object		*parent;
+	isc_result_t		result;
+} profjson_t;
+
+static void
+profile_jsondump(const char *key, isc_uint64_t events, isc_uint64_t runtime,
+		 isc_uint64_t waittime, void *arg)
+{
+	profjson_t *pj = arg;
+	isc_result_t result = ISC_R_SUCCESS;
+	json_object *entry, *obj;
+
+	if (pj->result != ISC_R_SUCCESS)
+		return;
+
+	entry = json_object_new_object();
+	CHECKMEM(entry);
+	json_object_object_add(pj->parent, key, entry);
+
+	obj = json_object_new_int64(events);
+	CHECKMEM(obj);
+	json_object_object_add(entry, "events", obj);
+
+	obj = json_object_new_int64(runtime);
+	CHECKMEM(obj);
+	json_object_object_add(entry, "run-time", obj);
+
+	obj = json_object_new_int64(waittime);
+	CHECKMEM(obj);
+	json_object_object_add(entry, "queue-time", obj);
+	return;
+
+ error:
+	pj->result = result;
+}
+
 isc_result_t
 isc_taskmgr_renderjson(isc_taskmgr_t *mgr0, json_object *tasks) {
 	isc_result_t result = ISC_R_SUCCESS;
 	isc__taskmgr_t *mgr = (isc__taskmgr_t *)mgr0;
 	isc__task_t *task = NULL;
 	json_object *obj = NULL, *array = NULL, *taskobj = NULL;
+	json_object *profile = NULL;
+	profjson_t pj;
 
 	LOCK(&mgr->lock);
 
@@ -2005,6 +2591,37 @@ isc_taskmgr_renderjson(isc_taskmgr_t *mgr0, json_object *tasks) {
 
 	json_object_object_add(tasks, "tasks", array);
 	array = NULL;
+
+	profile = json_object_new_object();
+	CHECKMEM(profile);
+	json_object_object_add(tasks, "profile", profile);
+
+	obj = json_object_new_string(mgr->profiling ? "on" : "off");
+	CHECKMEM(obj);
+	json_object_object_add(profile, "state", obj);
+
+	pj.parent = json_object_new_object();
+	CHECKMEM(pj.parent);
+	json_object_object_add(profile, "tasks", pj.parent);
+	pj.result = ISC_R_SUCCESS;
+	result = isc_taskmgr_profile(mgr0, isc_taskprofile_name,
+				     profile_jsondump, &pj);
+	if (result == ISC_R_SUCCESS)
+		result = pj.result;
+	if (result != ISC_R_SUCCESS)
+		goto error;
+
+	pj.parent = json_object_new_object();
+	CHECKMEM(pj.parent);
+	json_object_object_add(profile, "events", pj.parent);
+	pj.result = ISC_R_SUCCESS;
+	result = isc_taskmgr_profile(mgr0, isc_taskprofile_eventtype,
+				     profile_jsondump, &pj);
+	if (result == ISC_R_SUCCESS)
+		result = pj.result;
+	if (result != ISC_R_SUCCESS)
+		goto error;
+
 	result = ISC_R_SUCCESS;
 
  error:
@@ -2184,6 +2801,65 @@ isc_task_sendanddetach(isc_task_t **taskp, isc_event_t **eventp) {
 	ENSURE(*taskp == NULL);
 }
 
+void
+isc_task_sendlist(isc_task_t *task, isc_eventlist_t *events) {
+	isc_event_t *event;
+
+	REQUIRE(ISCAPI_TASK_VALID(task));
+	REQUIRE(events != NULL);
+
+	if (isc_bind9)
+		isc__task_sendlist(task, events);
+	else {
+		while ((event = ISC_LIST_HEAD(*events)) != NULL) {
+			ISC_LIST_UNLINK(*events, event, ev_link);
+			task->methods->send(task, &event);
+			ENSURE(event == NULL);
+		}
+	}
+
+	ENSURE(ISC_LIST_EMPTY(*events));
+}
+
+void
+isc_task_sendmany(isc_task_t **tasks, isc_event_t **events,
+		  unsigned int count)
+{
+	unsigned int i;
+
+	REQUIRE(tasks != NULL && events != NULL);
+
+	if (isc_bind9)
+		isc__task_sendmany(tasks, events, count, ISC_FALSE);
+	else {
+		for (i = 0; i < count; i++) {
+			REQUIRE(ISCAPI_TASK_VALID(tasks[i]));
+			tasks[i]->methods->send(tasks[i], &events[i]);
+			ENSURE(events[i] == NULL);
+		}
+	}
+}
+
+void
+isc_task_sendmanyanddetach(isc_task_t **tasks, isc_event_t **events,
+			   unsigned int count)
+{
+	unsigned int i;
+
+	REQUIRE(tasks != NULL && events != NULL);
+
+	if (isc_bind9)
+		isc__task_sendmany(tasks, events, count, ISC_TRUE);
+	else {
+		for (i = 0; i < count; i++) {
+			REQUIRE(ISCAPI_TASK_VALID(tasks[i]));
+			tasks[i]->methods->sendanddetach(&tasks[i],
+							 &events[i]);
+			ENSURE(events[i] == NULL && tasks[i] == NULL);
+		}
+	}
+}
+
 unsigned int
 isc_task_unsend(isc_task_t *task, void *sender, isc_eventtype_t type,
 		void *tag, isc_eventlist_t *events)
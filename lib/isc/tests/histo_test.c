@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <isc/histo.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+/*
+ * Helper functions
+ */
+
+static isc_uint64_t dumped, dumpedcount;
+
+static void
+getbucket(isc_uint64_t lower, isc_uint64_t upper, isc_uint64_t count,
+	  void *arg)
+{
+	UNUSED(arg);
+
+	ATF_CHECK(lower <= upper);
+	dumped++;
+	dumpedcount += count;
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_histo_t *thisto;
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+fill(isc_threadarg_t arg) {
+	isc_uint64_t i;
+
+	UNUSED(arg);
+
+	for (i = 1; i <= 1000; i++)
+		isc_histo_add(thisto, i);
+
+	return ((isc_threadresult_t)0);
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(buckets);
+ATF_TC_HEAD(buckets, tc) {
+	atf_tc_set_md_var(tc, "descr", "buckets are contiguous and every "
+				       "value falls within its bucket");
+}
+ATF_TC_BODY(buckets, tc) {
+	isc_uint64_t lower, upper, next;
+	isc_uint64_t v;
+	unsigned int b, bit;
+
+	UNUSED(tc);
+
+	next = 0;
+	for (b = 0; b < ISC_HISTO_NBUCKETS; b++) {
+		isc_histo_bucketrange(b, &lower, &upper);
+		ATF_REQUIRE_EQ(lower, next);
+		ATF_REQUIRE(lower <= upper);
+		ATF_CHECK_EQ(isc_histo_bucket(lower), b);
+		if (b < ISC_HISTO_NBUCKETS - 1) {
+			ATF_CHECK_EQ(isc_histo_bucket(upper), b);
+			/* No bucket is wider than 1/8 of its lowest value. */
+			ATF_CHECK(upper - lower <= lower / 8);
+		}
+		next = upper + 1;
+	}
+	ATF_CHECK_EQ(upper, ISC_UINT64_MAX);
+
+	for (bit = 0; bit < 64; bit++) {
+		v = (isc_uint64_t)1 << bit;
+		b = isc_histo_bucket(v);
+		ATF_REQUIRE(b < ISC_HISTO_NBUCKETS);
+		isc_histo_bucketrange(b, &lower, &upper);
+		ATF_CHECK(lower <= v && v <= upper);
+		b = isc_histo_bucket(v + v / 3);
+		isc_histo_bucketrange(b, &lower, &upper);
+		ATF_CHECK(lower <= v + v / 3 && v + v / 3 <= upper);
+	}
+}
+
+ATF_TC(quantiles);
+ATF_TC_HEAD(quantiles, tc) {
+	atf_tc_set_md_var(tc, "descr", "quantiles are within one bucket "
+				       "of the exact values");
+}
+ATF_TC_BODY(quantiles, tc) {
+	static const double fractions[] = { 0.0, 0.5, 0.9, 0.99, 1.0 };
+	static const isc_uint64_t exact[] = { 1, 5000, 9000, 9900, 10000 };
+	isc_uint64_t values[5];
+	isc_histo_t *histo = NULL;
+	isc_result_t result;
+	isc_uint64_t i;
+	unsigned int q;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_histo_create(mctx, 0, &histo);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* An empty histogram has no quantiles. */
+	ATF_CHECK_EQ(isc_histo_quantiles(histo, 5, fractions, values), 0);
+	for (q = 0; q < 5; q++)
+		ATF_CHECK_EQ(values[q], 0);
+
+	for (i = 1; i <= 10000; i++)
+		isc_histo_add(histo, i);
+
+	ATF_CHECK_EQ(isc_histo_quantiles(histo, 5, fractions, values), 10000);
+	for (q = 0; q < 5; q++) {
+		ATF_CHECK(values[q] >= exact[q]);
+		ATF_CHECK(values[q] <= exact[q] + exact[q] / 8);
+	}
+
+	dumped = dumpedcount = 0;
+	isc_histo_dump(histo, getbucket, NULL);
+	ATF_CHECK_EQ(dumpedcount, 10000);
+	ATF_CHECK_EQ(dumped, isc_histo_bucket(10000));
+
+	/* A single huge value lands in the last bucket. */
+	isc_histo_add(histo, ISC_UINT64_MAX);
+	ATF_CHECK_EQ(isc_histo_quantiles(histo, 1, &fractions[4], values),
+		     10001);
+	ATF_CHECK_EQ(values[0], ISC_UINT64_MAX);
+
+	isc_histo_detach(&histo);
+	isc_test_end();
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+ATF_TC(threads);
+ATF_TC_HEAD(threads, tc) {
+	atf_tc_set_md_var(tc, "descr", "values added from several threads "
+				       "are all counted");
+}
+ATF_TC_BODY(threads, tc) {
+	isc_thread_t threads[4];
+	isc_result_t result;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	thisto = NULL;
+	result = isc_histo_create(mctx, ISC_HISTO_SHARDED, &thisto);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 4; i++)
+		ATF_REQUIRE_EQ(isc_thread_create(fill, NULL, &threads[i]),
+			       ISC_R_SUCCESS);
+	for (i = 0; i < 4; i++)
+		ATF_REQUIRE_EQ(isc_thread_join(threads[i], NULL),
+			       ISC_R_SUCCESS);
+
+	dumped = dumpedcount = 0;
+	isc_histo_dump(thisto, getbucket, NULL);
+	ATF_CHECK_EQ(dumpedcount, 4000);
+
+	isc_histo_detach(&thisto);
+	isc_test_end();
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, buckets);
+	ATF_TP_ADD_TC(tp, quantiles);
+#ifdef ISC_PLATFORM_USETHREADS
+	ATF_TP_ADD_TC(tp, threads);
+#endif /* ISC_PLATFORM_USETHREADS */
+
+	return (atf_no_error());
+}
@@ -36,6 +36,7 @@ isc_timermgr_t *timermgr = NULL;
 isc_socketmgr_t *socketmgr = NULL;
 isc_task_t *maintask = NULL;
 int ncpus;
+isc_boolean_t debug_mem_record = ISC_TRUE;
 
 static isc_boolean_t hash_active = ISC_FALSE;
 
@@ -92,7 +93,8 @@ isc_result_t
 isc_test_begin(FILE *logfile, isc_boolean_t start_managers) {
 	isc_result_t result;
 
-	isc_mem_debugging |= ISC_MEM_DEBUGRECORD;
+	if (debug_mem_record)
+		isc_mem_debugging |= ISC_MEM_DEBUGRECORD;
 	CHECK(isc_mem_create(0, 0, &mctx));
 	CHECK(isc_entropy_create(mctx, &ectx));
 
@@ -38,6 +38,7 @@ extern isc_taskmgr_t *taskmgr;
 extern isc_timermgr_t *timermgr;
 extern isc_socketmgr_t *socketmgr;
 extern int ncpus;
+extern isc_boolean_t debug_mem_record;
 
 isc_result_t
 isc_test_begin(FILE *logfile, isc_boolean_t start_managers);
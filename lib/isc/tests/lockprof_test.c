@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <isc/lockprof.h>
+#include <isc/mutex.h>
+#include <isc/rwlock.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+/*
+ * Helper functions
+ */
+
+static unsigned int wantline;
+static isc_lockproftype_t wanttype;
+static isc_lockprofsite_t found;
+
+static void
+getsite(const isc_lockprofsite_t *site, void *arg) {
+	UNUSED(arg);
+
+	ATF_CHECK(site->contended <= site->acquired);
+	if (site->line == wantline && site->type == wanttype &&
+	    strstr(site->file, "lockprof_test.c") != NULL)
+		found = *site;
+}
+
+static void
+lookup(unsigned int line, isc_lockproftype_t type) {
+	isc_result_t result;
+
+	wantline = line;
+	wanttype = type;
+	memset(&found, 0, sizeof(found));
+	result = isc_lockprof_dump(mctx, getsite, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_mutex_t contended;
+static unsigned int contendedline;
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+waiter(isc_threadarg_t arg) {
+	UNUSED(arg);
+
+	contendedline = __LINE__ + 1;
+	LOCK(&contended);
+	UNLOCK(&contended);
+
+	return ((isc_threadresult_t)0);
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(sites);
+ATF_TC_HEAD(sites, tc) {
+	atf_tc_set_md_var(tc, "descr", "acquisitions are counted by call "
+				       "site when every one is sampled");
+}
+ATF_TC_BODY(sites, tc) {
+	isc_rwlock_t rwlock;
+	isc_result_t result;
+	unsigned int i, rline;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_rwlock_init(&rwlock, 0, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_lockprof_setrate(1);
+	isc_lockprof_reset();
+
+	for (i = 0; i < 10; i++) {
+		RWLOCK(&rwlock, isc_rwlocktype_read);
+		RWUNLOCK(&rwlock, isc_rwlocktype_read);
+	}
+	rline = __LINE__ - 3;
+	RWLOCK(&rwlock, isc_rwlocktype_write);
+	RWUNLOCK(&rwlock, isc_rwlocktype_write);
+
+	isc_lockprof_setrate(0);
+
+	lookup(rline, isc_lockproftype_read);
+	ATF_CHECK_EQ(found.acquired, 10);
+	ATF_CHECK_EQ(found.contended, 0);
+	lookup(rline + 4, isc_lockproftype_write);
+	ATF_CHECK_EQ(found.acquired, 1);
+
+	/* Nothing is sampled while the profiler is disabled. */
+	RWLOCK(&rwlock, isc_rwlocktype_read);
+	RWUNLOCK(&rwlock, isc_rwlocktype_read);
+	lookup(__LINE__ - 2, isc_lockproftype_read);
+	ATF_CHECK_EQ(found.acquired, 0);
+
+	isc_lockprof_reset();
+	lookup(rline, isc_lockproftype_read);
+	ATF_CHECK_EQ(found.acquired, 0);
+
+	isc_rwlock_destroy(&rwlock);
+	isc_test_end();
+}
+
+ATF_TC(sampling);
+ATF_TC_HEAD(sampling, tc) {
+	atf_tc_set_md_var(tc, "descr", "one acquisition in 'rate' is "
+				       "sampled");
+}
+ATF_TC_BODY(sampling, tc) {
+	isc_rwlock_t rwlock;
+	isc_result_t result;
+	unsigned int i, rline;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_rwlock_init(&rwlock, 0, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_lockprof_setrate(4);
+	isc_lockprof_reset();
+
+	for (i = 0; i < 100; i++) {
+		RWLOCK(&rwlock, isc_rwlocktype_read);
+		RWUNLOCK(&rwlock, isc_rwlocktype_read);
+	}
+	rline = __LINE__ - 3;
+
+	isc_lockprof_setrate(0);
+
+	/* The first sample depends on where the countdown was left. */
+	lookup(rline, isc_lockproftype_read);
+	ATF_CHECK(found.acquired >= 24 && found.acquired <= 26);
+
+	isc_lockprof_reset();
+	isc_rwlock_destroy(&rwlock);
+	isc_test_end();
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+ATF_TC(contention);
+ATF_TC_HEAD(contention, tc) {
+	atf_tc_set_md_var(tc, "descr", "time spent waiting for a mutex "
+				       "is recorded");
+}
+ATF_TC_BODY(contention, tc) {
+	isc_thread_t thread;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_mutex_init(&contended);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_lockprof_setrate(1);
+	isc_lockprof_reset();
+
+	LOCK(&contended);
+	ATF_REQUIRE_EQ(isc_thread_create(waiter, NULL, &thread),
+		       ISC_R_SUCCESS);
+	usleep(100000);
+	UNLOCK(&contended);
+	ATF_REQUIRE_EQ(isc_thread_join(thread, NULL), ISC_R_SUCCESS);
+
+	isc_lockprof_setrate(0);
+
+	lookup(contendedline, isc_lockproftype_mutex);
+	ATF_CHECK_EQ(found.acquired, 1);
+	ATF_CHECK_EQ(found.contended, 1);
+	ATF_CHECK(found.waittime >= 50000);
+	ATF_CHECK_EQ(found.maxwait, found.waittime);
+
+	isc_lockprof_reset();
+	DESTROYLOCK(&contended);
+	isc_test_end();
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, sites);
+	ATF_TP_ADD_TC(tp, sampling);
+#ifdef ISC_PLATFORM_USETHREADS
+	ATF_TP_ADD_TC(tp, contention);
+#endif /* ISC_PLATFORM_USETHREADS */
+
+	return (atf_no_error());
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <isc/log.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+#define LOGFILE		"log_test.out"
+#define SYNCFILE	"log_test.sync"
+#define NTHREADS	4
+#define NMESSAGES	500
+
+/*
+ * Helper functions
+ */
+
+static isc_log_t *logctx = NULL;
+
+static void
+create_async(isc_boolean_t both) {
+	isc_logconfig_t *logconfig = NULL;
+	isc_logdestination_t destination;
+	isc_result_t result;
+
+	unlink(LOGFILE);
+	unlink(SYNCFILE);
+
+	result = isc_log_create(mctx, &logctx, &logconfig);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	destination.file.stream = NULL;
+	destination.file.name = LOGFILE;
+	destination.file.versions = ISC_LOG_ROLLNEVER;
+	destination.file.maximum_size = 0;
+	result = isc_log_createchannel(logconfig, "async", ISC_LOG_TOFILE,
+				       ISC_LOG_INFO, &destination,
+				       ISC_LOG_ASYNC);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = isc_log_usechannel(logconfig, "async", NULL, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	if (!both)
+		return;
+
+	destination.file.name = SYNCFILE;
+	result = isc_log_createchannel(logconfig, "sync", ISC_LOG_TOFILE,
+				       ISC_LOG_INFO, &destination, 0);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = isc_log_usechannel(logconfig, "sync", NULL, NULL);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+}
+
+/*
+ * Check that every line in the log file is "<thread> <n>", with each
+ * thread's messages in order, and return the number of lines.
+ */
+static unsigned int
+check_lines(void) {
+	unsigned int next[NTHREADS];
+	unsigned int count = 0, t, n;
+	char line[100];
+	FILE *fp;
+
+	memset(next, 0, sizeof(next));
+
+	fp = fopen(LOGFILE, "r");
+	ATF_REQUIRE(fp != NULL);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		ATF_REQUIRE_EQ(sscanf(line, "%u %u", &t, &n), 2);
+		ATF_REQUIRE(t < NTHREADS);
+		ATF_CHECK(n >= next[t]);
+		next[t] = n + 1;
+		count++;
+	}
+	fclose(fp);
+
+	return (count);
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+writer(isc_threadarg_t arg) {
+	unsigned int t = (unsigned int)(size_t)arg;
+	unsigned int n;
+
+	for (n = 0; n < NMESSAGES; n++)
+		isc_log_write(logctx, ISC_LOGCATEGORY_GENERAL,
+			      ISC_LOGMODULE_OTHER, ISC_LOG_INFO,
+			      "%u %u", t, n);
+
+	return ((isc_threadresult_t)0);
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Individual unit tests
+ */
+
+#ifdef ISC_PLATFORM_USETHREADS
+ATF_TC(async_threads);
+ATF_TC_HEAD(async_threads, tc) {
+	atf_tc_set_md_var(tc, "descr", "messages from several threads are "
+				       "written in order or counted as "
+				       "dropped");
+}
+ATF_TC_BODY(async_threads, tc) {
+	isc_thread_t threads[NTHREADS];
+	isc_result_t result;
+	unsigned int t, count;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	create_async(ISC_FALSE);
+
+	for (t = 0; t < NTHREADS; t++)
+		ATF_REQUIRE_EQ(isc_thread_create(writer, (void *)(size_t)t,
+						 &threads[t]),
+			       ISC_R_SUCCESS);
+	for (t = 0; t < NTHREADS; t++)
+		ATF_REQUIRE_EQ(isc_thread_join(threads[t], NULL),
+			       ISC_R_SUCCESS);
+
+	/* Closing the files writes out whatever is still queued. */
+	isc_log_closefilelogs(logctx);
+
+	count = check_lines();
+	ATF_CHECK_EQ(count + isc_log_getdropped(logctx),
+		     NTHREADS * NMESSAGES);
+
+	isc_log_destroy(&logctx);
+	unlink(LOGFILE);
+	isc_test_end();
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+ATF_TC(async_destroy);
+ATF_TC_HEAD(async_destroy, tc) {
+	atf_tc_set_md_var(tc, "descr", "queued messages are written when "
+				       "the log context is destroyed");
+}
+ATF_TC_BODY(async_destroy, tc) {
+	isc_result_t result;
+	unsigned int n;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	create_async(ISC_FALSE);
+
+	for (n = 0; n < 10; n++)
+		isc_log_write(logctx, ISC_LOGCATEGORY_GENERAL,
+			      ISC_LOGMODULE_OTHER, ISC_LOG_INFO,
+			      "0 %u", n);
+	ATF_CHECK_EQ(isc_log_getdropped(logctx), 0);
+
+	isc_log_destroy(&logctx);
+
+	ATF_CHECK_EQ(check_lines(), 10);
+	unlink(LOGFILE);
+	isc_test_end();
+}
+
+ATF_TC(async_mixed);
+ATF_TC_HEAD(async_mixed, tc) {
+	atf_tc_set_md_var(tc, "descr", "a message logged to synchronous and "
+				       "asynchronous channels is written to "
+				       "both");
+}
+ATF_TC_BODY(async_mixed, tc) {
+	isc_result_t result;
+	char async[100], sync[100];
+	unsigned int n;
+	FILE *afp, *sfp;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	create_async(ISC_TRUE);
+
+	for (n = 0; n < 10; n++)
+		isc_log_write(logctx, ISC_LOGCATEGORY_GENERAL,
+			      ISC_LOGMODULE_OTHER, ISC_LOG_INFO,
+			      "0 %u", n);
+	isc_log_destroy(&logctx);
+
+	afp = fopen(LOGFILE, "r");
+	ATF_REQUIRE(afp != NULL);
+	sfp = fopen(SYNCFILE, "r");
+	ATF_REQUIRE(sfp != NULL);
+	n = 0;
+	while (fgets(async, sizeof(async), afp) != NULL) {
+		ATF_REQUIRE(fgets(sync, sizeof(sync), sfp) != NULL);
+		ATF_CHECK_STREQ(async, sync);
+		n++;
+	}
+	ATF_CHECK(fgets(sync, sizeof(sync), sfp) == NULL);
+	ATF_CHECK_EQ(n, 10);
+	fclose(afp);
+	fclose(sfp);
+
+	unlink(LOGFILE);
+	unlink(SYNCFILE);
+	isc_test_end();
+}
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+#ifdef ISC_PLATFORM_USETHREADS
+	ATF_TP_ADD_TC(tp, async_threads);
+#endif /* ISC_PLATFORM_USETHREADS */
+	ATF_TP_ADD_TC(tp, async_destroy);
+	ATF_TP_ADD_TC(tp, async_mixed);
+
+	return (atf_no_error());
+}
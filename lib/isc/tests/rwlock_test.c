@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <isc/rwlock.h>
+#include <isc/thread.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+/*
+ * Helper functions
+ */
+
+#ifdef ISC_PLATFORM_USETHREADS
+#define NTHREADS	4
+#define NLOCKS		20000
+
+static isc_rwlock_t lock;
+static unsigned int first, second;
+
+/*
+ * Take 'lock' NLOCKS times, for writing once in every 100, checking
+ * that readers never see a half-finished write.
+ */
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+worker(isc_threadarg_t arg) {
+	unsigned int i;
+
+	UNUSED(arg);
+
+	for (i = 1; i <= NLOCKS; i++) {
+		if (i % 100 == 0) {
+			RWLOCK(&lock, isc_rwlocktype_write);
+			first++;
+			second++;
+			RWUNLOCK(&lock, isc_rwlocktype_write);
+		} else {
+			RWLOCK(&lock, isc_rwlocktype_read);
+			ATF_CHECK_EQ(first, second);
+			RWUNLOCK(&lock, isc_rwlocktype_read);
+		}
+	}
+
+	return ((isc_threadresult_t)0);
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(distributed_try);
+ATF_TC_HEAD(distributed_try, tc) {
+	atf_tc_set_md_var(tc, "descr", "trylock, tryupgrade and downgrade "
+				       "on a distributed lock");
+}
+ATF_TC_BODY(distributed_try, tc) {
+	isc_rwlock_t rwl;
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_rwlock_initdistributed(&rwl, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* Readers share the lock and keep writers out. */
+	ATF_CHECK_EQ(isc_rwlock_trylock(&rwl, isc_rwlocktype_read),
+		     ISC_R_SUCCESS);
+	ATF_CHECK_EQ(isc_rwlock_trylock(&rwl, isc_rwlocktype_read),
+		     ISC_R_SUCCESS);
+	ATF_CHECK_EQ(isc_rwlock_trylock(&rwl, isc_rwlocktype_write),
+		     ISC_R_LOCKBUSY);
+
+	/* Upgrading needs the only read lock. */
+	ATF_CHECK_EQ(isc_rwlock_tryupgrade(&rwl), ISC_R_LOCKBUSY);
+	ATF_CHECK_EQ(isc_rwlock_unlock(&rwl, isc_rwlocktype_read),
+		     ISC_R_SUCCESS);
+	ATF_CHECK_EQ(isc_rwlock_tryupgrade(&rwl), ISC_R_SUCCESS);
+
+	/* A writer keeps everyone else out. */
+	ATF_CHECK_EQ(isc_rwlock_trylock(&rwl, isc_rwlocktype_read),
+		     ISC_R_LOCKBUSY);
+	ATF_CHECK_EQ(isc_rwlock_trylock(&rwl, isc_rwlocktype_write),
+		     ISC_R_LOCKBUSY);
+
+	isc_rwlock_downgrade(&rwl);
+	ATF_CHECK_EQ(isc_rwlock_trylock(&rwl, isc_rwlocktype_read),
+		     ISC_R_SUCCESS);
+	ATF_CHECK_EQ(isc_rwlock_unlock(&rwl, isc_rwlocktype_read),
+		     ISC_R_SUCCESS);
+	ATF_CHECK_EQ(isc_rwlock_unlock(&rwl, isc_rwlocktype_read),
+		     ISC_R_SUCCESS);
+
+	ATF_CHECK_EQ(isc_rwlock_lock(&rwl, isc_rwlocktype_write),
+		     ISC_R_SUCCESS);
+	ATF_CHECK_EQ(isc_rwlock_unlock(&rwl, isc_rwlocktype_write),
+		     ISC_R_SUCCESS);
+
+	isc_rwlock_destroy(&rwl);
+	isc_test_end();
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+ATF_TC(distributed_threads);
+ATF_TC_HEAD(distributed_threads, tc) {
+	atf_tc_set_md_var(tc, "descr", "a distributed lock excludes "
+				       "readers while writing");
+}
+ATF_TC_BODY(distributed_threads, tc) {
+	isc_thread_t threads[NTHREADS];
+	isc_result_t result;
+	unsigned int i;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_rwlock_initdistributed(&lock, mctx);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	first = second = 0;
+	for (i = 0; i < NTHREADS; i++)
+		ATF_REQUIRE_EQ(isc_thread_create(worker, NULL, &threads[i]),
+			       ISC_R_SUCCESS);
+	for (i = 0; i < NTHREADS; i++)
+		ATF_REQUIRE_EQ(isc_thread_join(threads[i], NULL),
+			       ISC_R_SUCCESS);
+
+	ATF_CHECK_EQ(first, NTHREADS * NLOCKS / 100);
+	ATF_CHECK_EQ(second, first);
+
+	isc_rwlock_destroy(&lock);
+	isc_test_end();
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, distributed_try);
+#ifdef ISC_PLATFORM_USETHREADS
+	ATF_TP_ADD_TC(tp, distributed_threads);
+#endif /* ISC_PLATFORM_USETHREADS */
+
+	return (atf_no_error());
+}
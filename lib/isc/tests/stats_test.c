@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <isc/os.h>
+#include <isc/stats.h>
+#include <isc/thread.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+#define NCOUNTERS	10
+
+/*
+ * Helper functions
+ */
+
+static isc_uint64_t values[NCOUNTERS];
+
+static void
+getvalue(isc_statscounter_t counter, isc_uint64_t value, void *arg) {
+	UNUSED(arg);
+
+	values[counter] = value;
+}
+
+static void
+getvalues(isc_stats_t *stats) {
+	memset(values, 0, sizeof(values));
+	isc_stats_dump(stats, getvalue, NULL, ISC_STATSDUMP_VERBOSE);
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+static isc_stats_t *tstats;
+static unsigned int tcount;
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+count(isc_threadarg_t arg) {
+	isc_statscounter_t counter;
+	unsigned int i;
+
+	UNUSED(arg);
+
+	for (i = 0; i < tcount; i++)
+		for (counter = 0; counter < NCOUNTERS; counter++)
+			isc_stats_increment(tstats, counter);
+
+	return ((isc_threadresult_t)0);
+}
+
+static isc_threadresult_t
+#ifdef _WIN32
+WINAPI
+#endif
+uncount(isc_threadarg_t arg) {
+	unsigned int i;
+
+	UNUSED(arg);
+
+	for (i = 0; i < tcount; i++)
+		isc_stats_decrement(tstats, 0);
+
+	return ((isc_threadresult_t)0);
+}
+
+static void
+run(isc_threadfunc_t func, unsigned int nthreads) {
+	isc_thread_t threads[32];
+	unsigned int i;
+
+	for (i = 0; i < nthreads; i++)
+		ATF_REQUIRE_EQ(isc_thread_create(func, NULL, &threads[i]),
+			       ISC_R_SUCCESS);
+	for (i = 0; i < nthreads; i++)
+		ATF_REQUIRE_EQ(isc_thread_join(threads[i], NULL),
+			       ISC_R_SUCCESS);
+}
+#endif /* ISC_PLATFORM_USETHREADS */
+
+static void
+check_sum(unsigned int flags) {
+	isc_result_t result;
+	isc_stats_t *stats = NULL;
+
+	result = isc_stats_create2(mctx, &stats, NCOUNTERS, flags);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(isc_stats_ncounters(stats), NCOUNTERS);
+
+	isc_stats_increment(stats, 1);
+	isc_stats_add(stats, 2, 5);
+	isc_stats_decrement(stats, 3);
+	getvalues(stats);
+	ATF_CHECK_EQ(values[0], 0);
+	ATF_CHECK_EQ(values[1], 1);
+	ATF_CHECK_EQ(values[2], 5);
+	ATF_CHECK_EQ(values[3], (isc_uint64_t)-1);
+	isc_stats_increment(stats, 3);
+
+#ifdef ISC_PLATFORM_USETHREADS
+	tstats = stats;
+	tcount = 10000;
+	run(count, 4);
+	getvalues(stats);
+	ATF_CHECK_EQ(values[0], 40000);
+	ATF_CHECK_EQ(values[1], 40001);
+	ATF_CHECK_EQ(values[2], 40005);
+	ATF_CHECK_EQ(values[NCOUNTERS - 1], 40000);
+
+	/* Counted up in some threads and down in others. */
+	run(uncount, 2);
+	getvalues(stats);
+	ATF_CHECK_EQ(values[0], 20000);
+#endif /* ISC_PLATFORM_USETHREADS */
+
+	/* Setting a counter replaces whatever every thread counted. */
+	isc_stats_set(stats, 7, 0);
+	getvalues(stats);
+	ATF_CHECK_EQ(values[0], 7);
+	isc_stats_increment(stats, 0);
+	getvalues(stats);
+	ATF_CHECK_EQ(values[0], 8);
+
+	isc_stats_detach(&stats);
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(sum);
+ATF_TC_HEAD(sum, tc) {
+	atf_tc_set_md_var(tc, "descr", "counters updated from several "
+				       "threads read back as their totals");
+}
+ATF_TC_BODY(sum, tc) {
+	isc_result_t result;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	check_sum(0);
+	check_sum(ISC_STATS_SHARDED);
+
+	isc_test_end();
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+#ifdef ISC_BENCHMARK_TESTS
+
+/*
+ * Not part of the unit test runs; build with -DISC_BENCHMARK_TESTS to
+ * measure the cost of counting the same events from many threads.
+ */
+
+ATF_TC(benchmark);
+ATF_TC_HEAD(benchmark, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "Benchmark isc_stats_increment() from many threads");
+}
+ATF_TC_BODY(benchmark, tc) {
+	isc_result_t result;
+	isc_time_t ts1, ts2;
+	unsigned int nthreads;
+	isc_uint64_t t;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_FALSE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	tstats = NULL;
+	result = isc_stats_create2(mctx, &tstats, NCOUNTERS,
+				   ISC_STATS_SHARDED);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	nthreads = ISC_MIN(isc_os_ncpus(), 32);
+	nthreads = ISC_MAX(nthreads, 2);
+	tcount = 2000000;
+
+	TIME_NOW(&ts1);
+	run(count, nthreads);
+	TIME_NOW(&ts2);
+
+	t = isc_time_microdiff(&ts2, &ts1);
+	printf("%u increments in %u threads, %f seconds, "
+	       "%f ns/increment\n",
+	       nthreads * tcount * NCOUNTERS, nthreads, t / 1000000.0,
+	       t * 1000.0 / ((double)nthreads * tcount * NCOUNTERS));
+
+	getvalues(tstats);
+	ATF_CHECK_EQ(values[0], (isc_uint64_t)nthreads * tcount);
+
+	isc_stats_detach(&tstats);
+	isc_test_end();
+}
+
+#endif /* ISC_BENCHMARK_TESTS */
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, sum);
+#ifdef ISC_PLATFORM_USETHREADS
+#ifdef ISC_BENCHMARK_TESTS
+	ATF_TP_ADD_TC(tp, benchmark);
+#endif /* ISC_BENCHMARK_TESTS */
+#endif /* ISC_PLATFORM_USETHREADS */
+
+	return (atf_no_error());
+}
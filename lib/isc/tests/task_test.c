@@ -14,6 +14,7 @@
 
 #include <atf-c.h>
 
+#include <string.h>
 #include <unistd.h>
 
 #include <isc/task.h>
@@ -56,6 +57,36 @@ set_and_drop(isc_task_t *task, isc_event_t *event) {
 	isc_taskmgr_setmode(taskmgr, isc_taskmgrmode_normal);
 }
 
+/* task event handler, naps and counts */
+static void
+nap_and_count(isc_task_t *task, isc_event_t *event) {
+	int *value = (int *) event->ev_arg;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	isc_test_nap(1000);
+	LOCK(&set_lock);
+	(*value)++;
+	UNLOCK(&set_lock);
+}
+
+static isc_uint64_t profevents, profruntime;
+
+static void
+getprofile(const char *key, isc_uint64_t events, isc_uint64_t runtime,
+	   isc_uint64_t waittime, void *arg)
+{
+	const char *want = arg;
+
+	UNUSED(waittime);
+
+	if (strcmp(key, want) == 0) {
+		profevents = events;
+		profruntime = runtime;
+	}
+}
+
 /*
  * Individual unit tests
  */
@@ -394,6 +425,182 @@ ATF_TC_BODY(privilege_drop, tc) {
 	isc_test_end();
 }
 
+/* Profile events */
+ATF_TC(profile);
+ATF_TC_HEAD(profile, tc) {
+	atf_tc_set_md_var(tc, "descr", "events are profiled by task name "
+				       "and event type");
+}
+ATF_TC_BODY(profile, tc) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_event_t *event;
+	char name[] = "profiled", type[] = "task+1";
+	int done = 0;
+	int i;
+
+	UNUSED(tc);
+
+	result = isc_mutex_init(&set_lock);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ATF_CHECK(!isc_taskmgr_profiling(taskmgr));
+	isc_taskmgr_setprofiling(taskmgr, ISC_TRUE);
+	ATF_CHECK(isc_taskmgr_profiling(taskmgr));
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	isc_task_setname(task, "profiled12", NULL);
+
+	for (i = 0; i < 5; i++) {
+		event = isc_event_allocate(mctx, task, ISC_TASKEVENT_TEST,
+					   nap_and_count, &done,
+					   sizeof (isc_event_t));
+		ATF_REQUIRE(event != NULL);
+		isc_task_send(task, &event);
+	}
+
+	i = 0;
+	while (done < 5 && i++ < 5000) {
+#ifndef ISC_PLATFORM_USETHREADS
+		while (isc__taskmgr_ready(taskmgr))
+			isc__taskmgr_dispatch(taskmgr);
+#endif
+		isc_test_nap(1000);
+	}
+	ATF_REQUIRE_EQ(done, 5);
+
+	/* The trailing number is not part of the name. */
+	profevents = profruntime = 0;
+	result = isc_taskmgr_profile(taskmgr, isc_taskprofile_name,
+				     getprofile, name);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(profevents, 5);
+	ATF_CHECK(profruntime >= 5000);
+
+	profevents = profruntime = 0;
+	result = isc_taskmgr_profile(taskmgr, isc_taskprofile_eventtype,
+				     getprofile, type);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK(profevents >= 5);
+	ATF_CHECK(profruntime >= 5000);
+
+	isc_taskmgr_resetprofile(taskmgr);
+	profevents = 0;
+	result = isc_taskmgr_profile(taskmgr, isc_taskprofile_name,
+				     getprofile, name);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(profevents, 0);
+
+	isc_taskmgr_setprofiling(taskmgr, ISC_FALSE);
+	ATF_CHECK(!isc_taskmgr_profiling(taskmgr));
+
+	isc_task_destroy(&task);
+	ATF_REQUIRE_EQ(task, NULL);
+
+	isc_test_end();
+}
+
+/* Send events in batches */
+ATF_TC(batch_events);
+ATF_TC_HEAD(batch_events, tc) {
+	atf_tc_set_md_var(tc, "descr", "send lists and arrays of events");
+}
+ATF_TC_BODY(batch_events, tc) {
+	isc_result_t result;
+	isc_task_t *task1 = NULL, *task2 = NULL;
+	isc_task_t *tasks[4];
+	isc_event_t *event, *events[4];
+	isc_eventlist_t list;
+	int values[4];
+	int i;
+
+	UNUSED(tc);
+
+	counter = 1;
+
+	result = isc_mutex_init(&set_lock);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	result = isc_task_create(taskmgr, 0, &task1);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = isc_task_create(taskmgr, 0, &task2);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* A list is run in order. */
+	memset(values, 0, sizeof(values));
+	ISC_LIST_INIT(list);
+	for (i = 0; i < 4; i++) {
+		event = isc_event_allocate(mctx, task1, ISC_TASKEVENT_TEST,
+					   set, &values[i],
+					   sizeof (isc_event_t));
+		ATF_REQUIRE(event != NULL);
+		ISC_LIST_APPEND(list, event, ev_link);
+	}
+	isc_task_sendlist(task1, &list);
+	ATF_CHECK(ISC_LIST_EMPTY(list));
+
+	/* An empty list is a no-op. */
+	isc_task_sendlist(task1, &list);
+
+	i = 0;
+	while (values[3] == 0 && i++ < 5000) {
+#ifndef ISC_PLATFORM_USETHREADS
+		while (isc__taskmgr_ready(taskmgr))
+			isc__taskmgr_dispatch(taskmgr);
+#endif
+		isc_test_nap(1000);
+	}
+	for (i = 0; i < 4; i++)
+		ATF_CHECK_EQ(values[i], i + 1);
+
+	/* Each event goes to its own task, which is then detached. */
+	memset(values, 0, sizeof(values));
+	for (i = 0; i < 4; i++) {
+		tasks[i] = NULL;
+		isc_task_attach((i % 2) == 0 ? task1 : task2, &tasks[i]);
+		events[i] = isc_event_allocate(mctx, tasks[i],
+					       ISC_TASKEVENT_TEST,
+					       set, &values[i],
+					       sizeof (isc_event_t));
+		ATF_REQUIRE(events[i] != NULL);
+	}
+	isc_task_sendmanyanddetach(tasks, events, 4);
+	for (i = 0; i < 4; i++) {
+		ATF_CHECK_EQ(tasks[i], NULL);
+		ATF_CHECK_EQ(events[i], NULL);
+	}
+
+	i = 0;
+	while ((values[0] == 0 || values[1] == 0 ||
+		values[2] == 0 || values[3] == 0) && i++ < 5000)
+	{
+#ifndef ISC_PLATFORM_USETHREADS
+		while (isc__taskmgr_ready(taskmgr))
+			isc__taskmgr_dispatch(taskmgr);
+#endif
+		isc_test_nap(1000);
+	}
+	for (i = 0; i < 4; i++)
+		ATF_CHECK(values[i] != 0);
+	/* Events for the same task still run in order. */
+	ATF_CHECK(values[0] < values[2]);
+	ATF_CHECK(values[1] < values[3]);
+
+	isc_task_destroy(&task1);
+	ATF_REQUIRE_EQ(task1, NULL);
+	isc_task_destroy(&task2);
+	ATF_REQUIRE_EQ(task2, NULL);
+
+	isc_test_end();
+}
+
 /*
  * Main
  */
@@ -402,6 +609,8 @@ ATF_TP_ADD_TCS(tp) {
 	ATF_TP_ADD_TC(tp, all_events);
 	ATF_TP_ADD_TC(tp, privileged_events);
 	ATF_TP_ADD_TC(tp, privilege_drop);
+	ATF_TP_ADD_TC(tp, profile);
+	ATF_TP_ADD_TC(tp, batch_events);
 
 	return (atf_no_error());
 }
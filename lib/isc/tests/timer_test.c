@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) 2016  Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/* $Id$ */
+
+/*! \file */
+
+#include <config.h>
+
+#include <atf-c.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <isc/condition.h>
+#include <isc/mutex.h>
+#include <isc/random.h>
+#include <isc/task.h>
+#include <isc/time.h>
+#include <isc/timer.h>
+#include <isc/util.h>
+
+#include "isctest.h"
+
+/*
+ * Helper functions
+ */
+
+static isc_mutex_t lock;
+static isc_condition_t cv;
+static unsigned int fired, early, ticks, idles, lifes;
+
+static void
+setup(void) {
+	RUNTIME_CHECK(isc_mutex_init(&lock) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(isc_condition_init(&cv) == ISC_R_SUCCESS);
+	fired = early = ticks = idles = lifes = 0;
+}
+
+static void
+teardown(void) {
+	(void)isc_condition_destroy(&cv);
+	DESTROYLOCK(&lock);
+}
+
+/*
+ * Count the event by type, and note any event delivered before the
+ * timer was due.
+ */
+static void
+count(isc_task_t *task, isc_event_t *event) {
+	isc_timerevent_t *tevent = (isc_timerevent_t *)event;
+	isc_time_t now;
+
+	UNUSED(task);
+
+	TIME_NOW(&now);
+
+	LOCK(&lock);
+	if (isc_time_compare(&now, &tevent->due) < 0)
+		early++;
+	switch (event->ev_type) {
+	case ISC_TIMEREVENT_TICK:
+		ticks++;
+		break;
+	case ISC_TIMEREVENT_IDLE:
+		idles++;
+		break;
+	case ISC_TIMEREVENT_LIFE:
+		lifes++;
+		break;
+	}
+	fired++;
+	BROADCAST(&cv);
+	UNLOCK(&lock);
+
+	isc_event_free(&event);
+}
+
+/*
+ * Wait up to 'seconds' for 'n' events to have fired.
+ */
+static unsigned int
+waitfor(unsigned int n, unsigned int seconds) {
+	isc_time_t due;
+	isc_interval_t interval;
+	unsigned int result;
+
+	isc_interval_set(&interval, seconds, 0);
+	RUNTIME_CHECK(isc_time_nowplusinterval(&due, &interval) ==
+		      ISC_R_SUCCESS);
+
+	LOCK(&lock);
+	while (fired < n) {
+		if (WAITUNTIL(&cv, &lock, &due) == ISC_R_TIMEDOUT)
+			break;
+	}
+	result = fired;
+	UNLOCK(&lock);
+
+	return (result);
+}
+
+/*
+ * Individual unit tests
+ */
+
+ATF_TC(ticker);
+ATF_TC_HEAD(ticker, tc) {
+	atf_tc_set_md_var(tc, "descr", "ticker and limited timers tick "
+				       "until they are stopped or expire");
+}
+ATF_TC_BODY(ticker, tc) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_timer_t *ticker = NULL, *limited = NULL;
+	isc_interval_t interval;
+	isc_time_t expires;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	setup();
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	isc_interval_set(&interval, 0, 20000000);
+	result = isc_timer_create(timermgr, isc_timertype_ticker, NULL,
+				  &interval, task, count, NULL, &ticker);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	ATF_CHECK(waitfor(5, 5) >= 5);
+	result = isc_timer_reset(ticker, isc_timertype_inactive, NULL, NULL,
+				 ISC_TRUE);
+	ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	isc_test_nap(100000);
+
+	LOCK(&lock);
+	ATF_CHECK_EQ(ticks, fired);
+	ATF_CHECK_EQ(early, 0);
+	fired = ticks = 0;
+	UNLOCK(&lock);
+
+	/* Stopped: nothing more arrives. */
+	isc_test_nap(100000);
+	LOCK(&lock);
+	ATF_CHECK_EQ(fired, 0);
+	UNLOCK(&lock);
+
+	/* A limited timer ticks and then reports the end of its life. */
+	isc_interval_set(&interval, 0, 200000000);
+	result = isc_time_nowplusinterval(&expires, &interval);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	isc_interval_set(&interval, 0, 50000000);
+	result = isc_timer_create(timermgr, isc_timertype_limited, &expires,
+				  &interval, task, count, NULL, &limited);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	(void)waitfor(100, 1);
+	LOCK(&lock);
+	ATF_CHECK(ticks >= 2 && ticks <= 4);
+	ATF_CHECK_EQ(lifes, 1);
+	ATF_CHECK_EQ(early, 0);
+	UNLOCK(&lock);
+
+	isc_timer_detach(&limited);
+	isc_timer_detach(&ticker);
+	isc_task_detach(&task);
+	teardown();
+	isc_test_end();
+}
+
+ATF_TC(once);
+ATF_TC_HEAD(once, tc) {
+	atf_tc_set_md_var(tc, "descr", "once timers fire on expiry, or on "
+				       "idleness that touching postpones");
+}
+ATF_TC_BODY(once, tc) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_timer_t *timer = NULL;
+	isc_interval_t interval;
+	isc_time_t expires, start, now;
+	int i;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	setup();
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* Expiry. */
+	isc_interval_set(&interval, 0, 100000000);
+	result = isc_time_nowplusinterval(&expires, &interval);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = isc_timer_create(timermgr, isc_timertype_once, &expires,
+				  NULL, task, count, NULL, &timer);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(waitfor(1, 5), 1);
+	isc_test_nap(100000);
+	LOCK(&lock);
+	ATF_CHECK_EQ(fired, 1);
+	ATF_CHECK_EQ(lifes, 1);
+	ATF_CHECK_EQ(early, 0);
+	fired = lifes = 0;
+	UNLOCK(&lock);
+
+	/* Idleness, postponed by touching. */
+	TIME_NOW(&start);
+	isc_interval_set(&interval, 0, 100000000);
+	result = isc_timer_reset(timer, isc_timertype_once, NULL, &interval,
+				 ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	for (i = 0; i < 5; i++) {
+		isc_test_nap(50000);
+		result = isc_timer_touch(timer);
+		ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	}
+	ATF_CHECK_EQ(waitfor(1, 5), 1);
+	TIME_NOW(&now);
+	ATF_CHECK(isc_time_microdiff(&now, &start) >= 350000);
+	LOCK(&lock);
+	ATF_CHECK_EQ(idles, 1);
+	ATF_CHECK_EQ(early, 0);
+	fired = idles = 0;
+	UNLOCK(&lock);
+
+	/* An expiry set in the past fires at once. */
+	isc_time_settoepoch(&expires);
+	isc_interval_set(&interval, 1, 0);
+	result = isc_time_subtract(&start, &interval, &expires);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	result = isc_timer_reset(timer, isc_timertype_once, &expires, NULL,
+				 ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	ATF_CHECK_EQ(waitfor(1, 5), 1);
+
+	isc_timer_detach(&timer);
+	isc_task_detach(&task);
+	teardown();
+	isc_test_end();
+}
+
+ATF_TC(many);
+ATF_TC_HEAD(many, tc) {
+	atf_tc_set_md_var(tc, "descr", "many timers over a range of due "
+				       "times each fire once, never early, "
+				       "and rescheduled timers follow their "
+				       "new due time");
+}
+ATF_TC_BODY(many, tc) {
+#define NTIMERS 2000
+	isc_result_t result;
+	isc_task_t *tasks[4] = { NULL, NULL, NULL, NULL };
+	isc_timer_t **timers;
+	isc_interval_t interval;
+	isc_uint32_t r;
+	int i;
+
+	UNUSED(tc);
+
+	result = isc_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	setup();
+
+	timers = malloc(NTIMERS * sizeof(*timers));
+	ATF_REQUIRE(timers != NULL);
+
+	for (i = 0; i < 4; i++) {
+		result = isc_task_create(taskmgr, 0, &tasks[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	/*
+	 * Half the timers are due within a second; the rest are due
+	 * from minutes to days away and are then brought in.
+	 */
+	for (i = 0; i < NTIMERS; i++) {
+		isc_random_get(&r);
+		if (i % 2 == 0)
+			isc_interval_set(&interval, 0,
+					 (r % 999 + 1) * 1000000);
+		else
+			isc_interval_set(&interval, 60 + r % (86400 * 30), 0);
+		timers[i] = NULL;
+		result = isc_timer_create(timermgr, isc_timertype_once, NULL,
+					  &interval, tasks[i % 4], count,
+					  NULL, &timers[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+
+	ATF_CHECK_EQ(waitfor(NTIMERS / 2, 10), NTIMERS / 2);
+
+	for (i = 1; i < NTIMERS; i += 2) {
+		isc_random_get(&r);
+		isc_interval_set(&interval, 0, (r % 500 + 1) * 1000000);
+		result = isc_timer_reset(timers[i], isc_timertype_once, NULL,
+					 &interval, ISC_FALSE);
+		ATF_CHECK_EQ(result, ISC_R_SUCCESS);
+	}
+
+	ATF_CHECK_EQ(waitfor(NTIMERS, 10), NTIMERS);
+	isc_test_nap(100000);
+
+	LOCK(&lock);
+	ATF_CHECK_EQ(fired, NTIMERS);
+	ATF_CHECK_EQ(idles, NTIMERS);
+	ATF_CHECK_EQ(early, 0);
+	UNLOCK(&lock);
+
+	for (i = 0; i < NTIMERS; i++)
+		isc_timer_detach(&timers[i]);
+	for (i = 0; i < 4; i++)
+		isc_task_detach(&tasks[i]);
+	free(timers);
+	teardown();
+	isc_test_end();
+#undef NTIMERS
+}
+
+#ifdef ISC_PLATFORM_USETHREADS
+#ifdef ISC_BENCHMARK_TESTS
+
+/*
+ * Not part of the unit test runs; build with -DISC_BENCHMARK_TESTS to
+ * measure the cost of creating, resetting and firing timers.
+ */
+
+#define BENCH_TIMERS	200000
+
+static void
+report(const char *what, unsigned int n, isc_time_t *ts1, isc_time_t *ts2) {
+	isc_uint64_t t = isc_time_microdiff(ts2, ts1);
+
+	printf("%-8s %u timers in %f seconds, %f us/timer\n",
+	       what, n, t / 1000000.0, (double)t / n);
+}
+
+ATF_TC(benchmark);
+ATF_TC_HEAD(benchmark, tc) {
+	atf_tc_set_md_var(tc, "descr",
+			  "Benchmark timer create, reset and fire");
+}
+ATF_TC_BODY(benchmark, tc) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_timer_t **timers;
+	isc_interval_t interval;
+	isc_time_t ts1, ts2;
+	isc_uint32_t r;
+	unsigned int i, round;
+
+	UNUSED(tc);
+
+	debug_mem_record = ISC_FALSE;
+	result = isc_test_begin(NULL, ISC_TRUE);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	setup();
+
+	timers = malloc(BENCH_TIMERS * sizeof(*timers));
+	ATF_REQUIRE(timers != NULL);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+
+	/* Live timers with the spread of a busy resolver's. */
+	TIME_NOW(&ts1);
+	for (i = 0; i < BENCH_TIMERS; i++) {
+		isc_random_get(&r);
+		isc_interval_set(&interval, 10 + r % 60, r % 1000000000);
+		timers[i] = NULL;
+		result = isc_timer_create(timermgr, isc_timertype_once, NULL,
+					  &interval, task, count, NULL,
+					  &timers[i]);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+	TIME_NOW(&ts2);
+	report("create", BENCH_TIMERS, &ts1, &ts2);
+
+	TIME_NOW(&ts1);
+	for (round = 0; round < 5; round++) {
+		for (i = 0; i < BENCH_TIMERS; i++) {
+			isc_random_get(&r);
+			isc_interval_set(&interval, 10 + r % 60,
+					 r % 1000000000);
+			result = isc_timer_reset(timers[i],
+						 isc_timertype_once, NULL,
+						 &interval, ISC_FALSE);
+			ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+		}
+	}
+	TIME_NOW(&ts2);
+	report("reset", 5 * BENCH_TIMERS, &ts1, &ts2);
+
+	/* Bring them all in to fire within the next 50 milliseconds. */
+	TIME_NOW(&ts1);
+	for (i = 0; i < BENCH_TIMERS; i++) {
+		isc_random_get(&r);
+		isc_interval_set(&interval, 0, (r % 50 + 1) * 1000000);
+		result = isc_timer_reset(timers[i], isc_timertype_once, NULL,
+					 &interval, ISC_FALSE);
+		ATF_REQUIRE_EQ(result, ISC_R_SUCCESS);
+	}
+	ATF_CHECK_EQ(waitfor(BENCH_TIMERS, 60), BENCH_TIMERS);
+	TIME_NOW(&ts2);
+	report("fire", BENCH_TIMERS, &ts1, &ts2);
+	LOCK(&lock);
+	ATF_CHECK_EQ(early, 0);
+	UNLOCK(&lock);
+
+	TIME_NOW(&ts1);
+	for (i = 0; i < BENCH_TIMERS; i++)
+		isc_timer_detach(&timers[i]);
+	TIME_NOW(&ts2);
+	report("destroy", BENCH_TIMERS, &ts1, &ts2);
+
+	isc_task_detach(&task);
+	free(timers);
+	teardown();
+	isc_test_end();
+}
+
+#endif /* ISC_BENCHMARK_TESTS */
+#endif /* ISC_PLATFORM_USETHREADS */
+
+/*
+ * Main
+ */
+ATF_TP_ADD_TCS(tp) {
+	ATF_TP_ADD_TC(tp, ticker);
+	ATF_TP_ADD_TC(tp, once);
+	ATF_TP_ADD_TC(tp, many);
+#ifdef ISC_PLATFORM_USETHREADS
+#ifdef ISC_BENCHMARK_TESTS
+	ATF_TP_ADD_TC(tp, benchmark);
+#endif /* ISC_BENCHMARK_TESTS */
+#endif /* ISC_PLATFORM_USETHREADS */
+
+	return (atf_no_error());
+}
@@ -14,12 +14,12 @@
 
 #include <isc/app.h>
 #include <isc/condition.h>
-#include <isc/heap.h>
 #include <isc/log.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
 #include <isc/msgs.h>
 #include <isc/once.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/task.h>
@@ -60,32 +60,93 @@
 #define XTRACETIMER(s, t, d)
 #endif /* ISC_TIMER_TRACE */
 
+/*%
+ * Timers are kept in hierarchical timing wheels rather than in a single
+ * heap, so that scheduling, rescheduling and cancelling a timer are
+ * constant time.  Time is counted in ticks of one millisecond.  Level 0
+ * has a slot for each of the next 256 ticks; each of the four levels
+ * above it has 64 slots, each covering 64 slots of the level below, for
+ * a total range of 2^32 ticks (about 49 days).  Timers further out than
+ * that wait in the last level and are placed again when it cascades.
+ *
+ * Whenever the current tick crosses a slot boundary of a higher level,
+ * the timers in that slot are "cascaded", i.e. placed again into the
+ * levels below.  A timer never fires before its due time: the tick it
+ * is placed at is its due time rounded up.
+ *
+ * A manager has one wheel per CPU, each with its own lock, so that
+ * timers of unrelated tasks don't contend for a single manager lock.
+ * A timer belongs to the wheel its task hashes to.
+ */
+#define WHEEL_LEVELS			5
+#define WHEEL_BITS0			8
+#define WHEEL_BITS			6
+#define WHEEL_SLOTS0			(1 << WHEEL_BITS0)
+#define WHEEL_SLOTS			(1 << WHEEL_BITS)
+#define WHEEL_NSLOTS			(WHEEL_SLOTS0 + \
+					 (WHEEL_LEVELS - 1) * WHEEL_SLOTS)
+#define WHEEL_SHIFT(l)			(WHEEL_BITS0 + WHEEL_BITS * ((l) - 1))
+#define WHEEL_BASE(l)			(WHEEL_SLOTS0 + WHEEL_SLOTS * ((l) - 1))
+#define WHEEL_RANGE			((isc_uint64_t)1 << \
+					 WHEEL_SHIFT(WHEEL_LEVELS))
+#define WHEEL_NEVER			ISC_UINT64_MAX
+#define WHEEL_MAX			16
+
 #define TIMER_MAGIC			ISC_MAGIC('T', 'I', 'M', 'R')
 #define VALID_TIMER(t)			ISC_MAGIC_VALID(t, TIMER_MAGIC)
 
 typedef struct isc__timer isc__timer_t;
 typedef struct isc__timermgr isc__timermgr_t;
+typedef struct isc__timerwheel isc__timerwheel_t;
 
 struct isc__timer {
 	/*! Not locked. */
 	isc_timer_t			common;
 	isc__timermgr_t *		manager;
+	isc__timerwheel_t *		wheel;
 	isc_mutex_t			lock;
 	/*! Locked by timer lock. */
 	unsigned int			references;
 	isc_time_t			idle;
-	/*! Locked by manager lock. */
+	/*! Locked by wheel lock. */
 	isc_timertype_t			type;
 	isc_time_t			expires;
 	isc_interval_t			interval;
 	isc_task_t *			task;
 	isc_taskaction_t		action;
 	void *				arg;
-	unsigned int			index;
 	isc_time_t			due;
+	isc_uint64_t			when;
+	unsigned int			slot;	/* 0 when not scheduled */
 	LINK(isc__timer_t)		link;
+	LINK(isc__timer_t)		slotlink;
 };
 
+struct isc__timerwheel {
+	isc__timermgr_t *		manager;
+	isc_mutex_t			lock;
+	/* Locked by wheel lock. */
+	LIST(isc__timer_t)		timers;
+	isc_uint64_t			now;
+	isc_uint64_t			next;
+	unsigned int			count;
+	unsigned int			levelcount[WHEEL_LEVELS];
+	LIST(isc__timer_t)		slots[WHEEL_NSLOTS];
+};
+
+/*%
+ * Events posted while a wheel is advanced are collected and sent with
+ * isc_task_sendmany(), so that the task manager is locked once per
+ * batch rather than once per event.
+ */
+#define POST_BATCH			32
+
+typedef struct {
+	unsigned int			count;
+	isc_task_t *			tasks[POST_BATCH];
+	isc_event_t *			events[POST_BATCH];
+} postbatch_t;
+
 #define TIMER_MANAGER_MAGIC		ISC_MAGIC('T', 'I', 'M', 'M')
 #define VALID_MANAGER(m)		ISC_MAGIC_VALID(m, TIMER_MANAGER_MAGIC)
 
@@ -94,11 +155,13 @@ struct isc__timermgr {
 	isc_timermgr_t			common;
 	isc_mem_t *			mctx;
 	isc_mutex_t			lock;
+	unsigned int			nwheels;
+	isc__timerwheel_t *		wheels;
 	/* Locked by manager lock. */
 	isc_boolean_t			done;
-	LIST(isc__timer_t)		timers;
-	unsigned int			nscheduled;
-	isc_time_t			due;
+	isc_boolean_t			scanning;
+	isc_boolean_t			rescan;
+	isc_uint64_t			wake;
 #ifdef USE_TIMER_THREAD
 	isc_condition_t			wakeup;
 	isc_thread_t			thread;
@@ -106,7 +169,6 @@ struct isc__timermgr {
 #ifdef USE_SHARED_MANAGER
 	unsigned int			refs;
 #endif /* USE_SHARED_MANAGER */
-	isc_heap_t *			heap;
 };
 
 /*%
@@ -174,14 +236,163 @@ static struct isc__timermgrmethods {
 static isc__timermgr_t *timermgr = NULL;
 #endif /* USE_SHARED_MANAGER */
 
+/*
+ * Convert between times and ticks.  A due time is rounded up to the
+ * next tick, and the current time down, so that a timer is never
+ * found due early.
+ */
+static inline isc_uint64_t
+tick_ceil(const isc_time_t *t) {
+	return ((isc_uint64_t)isc_time_seconds(t) * 1000 +
+		(isc_time_nanoseconds(t) + 999999) / 1000000);
+}
+
+static inline isc_uint64_t
+tick_floor(const isc_time_t *t) {
+	return ((isc_uint64_t)isc_time_seconds(t) * 1000 +
+		isc_time_nanoseconds(t) / 1000000);
+}
+
+static inline void
+tick_totime(isc_uint64_t tick, isc_time_t *t) {
+	isc_time_set(t, (unsigned int)(tick / 1000),
+		     (unsigned int)(tick % 1000) * 1000000);
+}
+
+static inline unsigned int
+slot_level(unsigned int slot) {
+	if (slot < WHEEL_SLOTS0)
+		return (0);
+	return (1 + (slot - WHEEL_SLOTS0) / WHEEL_SLOTS);
+}
+
+static isc__timerwheel_t *
+wheel_for(isc__timermgr_t *manager, isc_task_t *task) {
+	isc_uint32_t h;
+
+	/*
+	 * Tasks are not tied to a worker thread, so keep all of a task's
+	 * timers on one wheel and spread the tasks.
+	 */
+	h = (isc_uint32_t)((size_t)task >> 4);
+	h ^= h >> 9;
+	return (&manager->wheels[h % manager->nwheels]);
+}
+
+/*
+ * Put 'timer' into the slot for its tick, and return the tick at which
+ * the wheel must next be advanced to deal with it: its own tick on
+ * level 0, or the start of the slot it must be cascaded from.
+ *
+ * The caller must be holding the wheel lock.
+ */
+static isc_uint64_t
+place(isc__timerwheel_t *wheel, isc__timer_t *timer) {
+	isc_uint64_t delta, tick;
+	unsigned int level, slot;
+
+	if (timer->when < wheel->now)
+		timer->when = wheel->now;
+	delta = timer->when - wheel->now;
+
+	if (delta < WHEEL_SLOTS0) {
+		level = 0;
+		tick = timer->when;
+		slot = (unsigned int)(tick & (WHEEL_SLOTS0 - 1));
+	} else {
+		if (delta >= WHEEL_RANGE)
+			delta = WHEEL_RANGE - 1;
+		for (level = 1; level < WHEEL_LEVELS - 1; level++)
+			if ((delta >> WHEEL_SHIFT(level + 1)) == 0)
+				break;
+		tick = (wheel->now + delta) >> WHEEL_SHIFT(level);
+		slot = WHEEL_BASE(level) +
+		       (unsigned int)(tick & (WHEEL_SLOTS - 1));
+		tick <<= WHEEL_SHIFT(level);
+	}
+
+	APPEND(wheel->slots[slot], timer, slotlink);
+	timer->slot = slot + 1;
+	wheel->levelcount[level]++;
+	wheel->count++;
+
+	return (tick);
+}
+
+static inline void
+unplace(isc__timerwheel_t *wheel, isc__timer_t *timer) {
+	unsigned int slot = timer->slot - 1;
+
+	UNLINK(wheel->slots[slot], timer, slotlink);
+	timer->slot = 0;
+	INSIST(wheel->count > 0);
+	wheel->levelcount[slot_level(slot)]--;
+	wheel->count--;
+}
+
+/*
+ * Work out the tick at which the wheel must next be advanced.
+ */
+static void
+settle(isc__timerwheel_t *wheel) {
+	isc_uint64_t next = WHEEL_NEVER, block, tick;
+	unsigned int level, i;
+
+	if (wheel->levelcount[0] > 0) {
+		for (tick = wheel->now; ; tick++)
+			if (!EMPTY(wheel->slots[tick & (WHEEL_SLOTS0 - 1)]))
+				break;
+		next = tick;
+	}
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		if (wheel->levelcount[level] == 0)
+			continue;
+		block = wheel->now >> WHEEL_SHIFT(level);
+		for (i = 1; i <= WHEEL_SLOTS; i++)
+			if (!EMPTY(wheel->slots[WHEEL_BASE(level) +
+				   ((block + i) & (WHEEL_SLOTS - 1))]))
+				break;
+		INSIST(i <= WHEEL_SLOTS);
+		tick = (block + i) << WHEEL_SHIFT(level);
+		if (tick < next)
+			next = tick;
+	}
+
+	wheel->next = next;
+}
+
+/*
+ * Place again the timers of every higher level slot whose span starts
+ * at the current tick.
+ */
+static void
+cascade(isc__timerwheel_t *wheel) {
+	isc__timer_t *timer;
+	unsigned int level, slot;
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		if ((wheel->now &
+		     (((isc_uint64_t)1 << WHEEL_SHIFT(level)) - 1)) != 0)
+			break;
+		slot = WHEEL_BASE(level) +
+		       (unsigned int)((wheel->now >> WHEEL_SHIFT(level)) &
+				      (WHEEL_SLOTS - 1));
+		while ((timer = HEAD(wheel->slots[slot])) != NULL) {
+			unplace(wheel, timer);
+			(void)place(wheel, timer);
+		}
+	}
+}
+
 static inline isc_result_t
 schedule(isc__timer_t *timer, isc_time_t *now, isc_boolean_t signal_ok) {
 	isc_result_t result;
-	isc__timermgr_t *manager;
+	isc__timerwheel_t *wheel;
 	isc_time_t due;
-	int cmp;
+	isc_uint64_t tick;
 #ifdef USE_TIMER_THREAD
-	isc_boolean_t timedwait;
+	isc__timermgr_t *manager;
 #endif
 
 	/*!
@@ -194,16 +405,7 @@ schedule(isc__timer_t *timer, isc_time_t *now, isc_boolean_t signal_ok) {
 	UNUSED(signal_ok);
 #endif /* USE_TIMER_THREAD */
 
-	manager = timer->manager;
-
-#ifdef USE_TIMER_THREAD
-	/*!
-	 * If the manager was timed wait, we may need to signal the
-	 * manager to force a wakeup.
-	 */
-	timedwait = ISC_TF(manager->nscheduled > 0 &&
-			   isc_time_seconds(&manager->due) != 0);
-#endif
+	wheel = timer->wheel;
 
 	/*
 	 * Compute the new due time.
@@ -227,128 +429,77 @@ schedule(isc__timer_t *timer, isc_time_t *now, isc_boolean_t signal_ok) {
 	}
 
 	/*
-	 * Schedule the timer.
+	 * Schedule the timer.  An empty wheel may have fallen behind;
+	 * catch it up first so the timer lands on the lowest level it can.
 	 */
-
-	if (timer->index > 0) {
-		/*
-		 * Already scheduled.
-		 */
-		cmp = isc_time_compare(&due, &timer->due);
-		timer->due = due;
-		switch (cmp) {
-		case -1:
-			isc_heap_increased(manager->heap, timer->index);
-			break;
-		case 1:
-			isc_heap_decreased(manager->heap, timer->index);
-			break;
-		case 0:
-			/* Nothing to do. */
-			break;
-		}
-	} else {
-		timer->due = due;
-		result = isc_heap_insert(manager->heap, timer);
-		if (result != ISC_R_SUCCESS) {
-			INSIST(result == ISC_R_NOMEMORY);
-			return (ISC_R_NOMEMORY);
-		}
-		manager->nscheduled++;
+	if (timer->slot > 0)
+		unplace(wheel, timer);
+	else if (wheel->count == 0) {
+		tick = tick_floor(now);
+		if (tick > wheel->now)
+			wheel->now = tick;
 	}
+	timer->due = due;
+	timer->when = tick_ceil(&due);
+	tick = place(wheel, timer);
 
 	XTRACETIMER(isc_msgcat_get(isc_msgcat, ISC_MSGSET_TIMER,
 				   ISC_MSG_SCHEDULE, "schedule"), timer, due);
 
 	/*
-	 * If this timer is at the head of the queue, we need to ensure
-	 * that we won't miss it if it has a more recent due time than
-	 * the current "next" timer.  We do this either by waking up the
-	 * run thread, or explicitly setting the value in the manager.
+	 * If the wheel must now be advanced sooner than it would have been,
+	 * we need to ensure the run thread won't sleep past it: wake it up
+	 * if it is waiting, or have it look again if it is busy advancing
+	 * the wheels.  Without a run thread, the wheel's next tick is read
+	 * directly.
 	 */
+	if (tick < wheel->next) {
+		wheel->next = tick;
 #ifdef USE_TIMER_THREAD
-
-	/*
-	 * This is a temporary (probably) hack to fix a bug on tru64 5.1
-	 * and 5.1a.  Sometimes, pthread_cond_timedwait() doesn't actually
-	 * return when the time expires, so here, we check to see if
-	 * we're 15 seconds or more behind, and if we are, we signal
-	 * the dispatcher.  This isn't such a bad idea as a general purpose
-	 * watchdog, so perhaps we should just leave it in here.
-	 */
-	if (signal_ok && timedwait) {
-		isc_interval_t fifteen;
-		isc_time_t then;
-
-		isc_interval_set(&fifteen, 15, 0);
-		result = isc_time_add(&manager->due, &fifteen, &then);
-
-		if (result == ISC_R_SUCCESS &&
-		    isc_time_compare(&then, now) < 0) {
-			SIGNAL(&manager->wakeup);
-			signal_ok = ISC_FALSE;
-			isc_log_write(isc_lctx, ISC_LOGCATEGORY_GENERAL,
-				      ISC_LOGMODULE_TIMER, ISC_LOG_WARNING,
-				      "*** POKED TIMER ***");
+		if (signal_ok) {
+			manager = wheel->manager;
+			LOCK(&manager->lock);
+			if (manager->scanning)
+				manager->rescan = ISC_TRUE;
+			else if (tick < manager->wake) {
+				manager->wake = tick;
+				XTRACE(isc_msgcat_get(isc_msgcat,
+						      ISC_MSGSET_TIMER,
+						      ISC_MSG_SIGNALSCHED,
+						      "signal (schedule)"));
+				SIGNAL(&manager->wakeup);
+			}
+			UNLOCK(&manager->lock);
 		}
-	}
-
-	if (timer->index == 1 && signal_ok) {
-		XTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_TIMER,
-				      ISC_MSG_SIGNALSCHED,
-				      "signal (schedule)"));
-		SIGNAL(&manager->wakeup);
-	}
-#else /* USE_TIMER_THREAD */
-	if (timer->index == 1 &&
-	    isc_time_compare(&timer->due, &manager->due) < 0)
-		manager->due = timer->due;
 #endif /* USE_TIMER_THREAD */
+	}
 
 	return (ISC_R_SUCCESS);
 }
 
 static inline void
 deschedule(isc__timer_t *timer) {
-#ifdef USE_TIMER_THREAD
-	isc_boolean_t need_wakeup = ISC_FALSE;
-#endif
-	isc__timermgr_t *manager;
-
 	/*
 	 * The caller must ensure locking.
+	 *
+	 * The wheel's next tick is left alone; if it was this timer's,
+	 * the run thread will merely find nothing to do then.
 	 */
 
-	manager = timer->manager;
-	if (timer->index > 0) {
-#ifdef USE_TIMER_THREAD
-		if (timer->index == 1)
-			need_wakeup = ISC_TRUE;
-#endif
-		isc_heap_delete(manager->heap, timer->index);
-		timer->index = 0;
-		INSIST(manager->nscheduled > 0);
-		manager->nscheduled--;
-#ifdef USE_TIMER_THREAD
-		if (need_wakeup) {
-			XTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_TIMER,
-					      ISC_MSG_SIGNALDESCHED,
-					      "signal (deschedule)"));
-			SIGNAL(&manager->wakeup);
-		}
-#endif /* USE_TIMER_THREAD */
-	}
+	if (timer->slot > 0)
+		unplace(timer->wheel, timer);
 }
 
 static void
 destroy(isc__timer_t *timer) {
 	isc__timermgr_t *manager = timer->manager;
+	isc__timerwheel_t *wheel = timer->wheel;
 
 	/*
 	 * The caller must ensure it is safe to destroy the timer.
 	 */
 
-	LOCK(&manager->lock);
+	LOCK(&wheel->lock);
 
 	(void)isc_task_purgerange(timer->task,
 				  timer,
@@ -356,9 +507,9 @@ destroy(isc__timer_t *timer) {
 				  ISC_TIMEREVENT_LASTEVENT,
 				  NULL);
 	deschedule(timer);
-	UNLINK(manager->timers, timer, link);
+	UNLINK(wheel->timers, timer, link);
 
-	UNLOCK(&manager->lock);
+	UNLOCK(&wheel->lock);
 
 	isc_task_detach(&timer->task);
 	DESTROYLOCK(&timer->lock);
@@ -375,6 +526,7 @@ isc__timer_create(isc_timermgr_t *manager0, isc_timertype_t type,
 {
 	isc__timermgr_t *manager = (isc__timermgr_t *)manager0;
 	isc__timer_t *timer;
+	isc__timerwheel_t *wheel;
 	isc_result_t result;
 	isc_time_t now;
 
@@ -419,6 +571,7 @@ isc__timer_create(isc_timermgr_t *manager0, isc_timertype_t type,
 		return (ISC_R_NOMEMORY);
 
 	timer->manager = manager;
+	timer->wheel = wheel = wheel_for(manager, task);
 	timer->references = 1;
 
 	if (type == isc_timertype_once && !isc_interval_iszero(interval)) {
@@ -447,7 +600,8 @@ isc__timer_create(isc_timermgr_t *manager0, isc_timertype_t type,
 	 * keep track of whether arg started as a true const.
 	 */
 	DE_CONST(arg, timer->arg);
-	timer->index = 0;
+	timer->when = 0;
+	timer->slot = 0;
 	result = isc_mutex_init(&timer->lock);
 	if (result != ISC_R_SUCCESS) {
 		isc_task_detach(&timer->task);
@@ -455,11 +609,12 @@ isc__timer_create(isc_timermgr_t *manager0, isc_timertype_t type,
 		return (result);
 	}
 	ISC_LINK_INIT(timer, link);
+	ISC_LINK_INIT(timer, slotlink);
 	timer->common.impmagic = TIMER_MAGIC;
 	timer->common.magic = ISCAPI_TIMER_MAGIC;
 	timer->common.methods = (isc_timermethods_t *)&timermethods;
 
-	LOCK(&manager->lock);
+	LOCK(&wheel->lock);
 
 	/*
 	 * Note we don't have to lock the timer like we normally would because
@@ -471,9 +626,9 @@ isc__timer_create(isc_timermgr_t *manager0, isc_timertype_t type,
 	else
 		result = ISC_R_SUCCESS;
 	if (result == ISC_R_SUCCESS)
-		APPEND(manager->timers, timer, link);
+		APPEND(wheel->timers, timer, link);
 
-	UNLOCK(&manager->lock);
+	UNLOCK(&wheel->lock);
 
 	if (result != ISC_R_SUCCESS) {
 		timer->common.impmagic = 0;
@@ -496,7 +651,7 @@ isc__timer_reset(isc_timer_t *timer0, isc_timertype_t type,
 {
 	isc__timer_t *timer = (isc__timer_t *)timer0;
 	isc_time_t now;
-	isc__timermgr_t *manager;
+	isc__timerwheel_t *wheel;
 	isc_result_t result;
 
 	/*
@@ -506,8 +661,8 @@ isc__timer_reset(isc_timer_t *timer0, isc_timertype_t type,
 	 */
 
 	REQUIRE(VALID_TIMER(timer));
-	manager = timer->manager;
-	REQUIRE(VALID_MANAGER(manager));
+	REQUIRE(VALID_MANAGER(timer->manager));
+	wheel = timer->wheel;
 
 	if (expires == NULL)
 		expires = isc_time_epoch;
@@ -532,7 +687,7 @@ isc__timer_reset(isc_timer_t *timer0, isc_timertype_t type,
 		isc_time_settoepoch(&now);
 	}
 
-	LOCK(&manager->lock);
+	LOCK(&wheel->lock);
 	LOCK(&timer->lock);
 
 	if (purge)
@@ -560,7 +715,7 @@ isc__timer_reset(isc_timer_t *timer0, isc_timertype_t type,
 	}
 
 	UNLOCK(&timer->lock);
-	UNLOCK(&manager->lock);
+	UNLOCK(&wheel->lock);
 
 	return (result);
 }
@@ -598,7 +753,7 @@ isc__timer_touch(isc_timer_t *timer0) {
 	 *
 	 *	REQUIRE(timer->type == isc_timertype_once);
 	 *
-	 * but we cannot without locking the manager lock too, which we
+	 * but we cannot without locking the wheel lock too, which we
 	 * don't want to do.
 	 */
 
@@ -654,123 +809,218 @@ isc__timer_detach(isc_timer_t **timerp) {
 	*timerp = NULL;
 }
 
+/*
+ * Send the events collected in 'batch'.
+ *
+ * The caller must be holding the lock of the wheel the events' timers
+ * are on, so that the timers, which hold references to the tasks,
+ * cannot be destroyed first.
+ */
 static void
-dispatch(isc__timermgr_t *manager, isc_time_t *now) {
-	isc_boolean_t done = ISC_FALSE, post_event, need_schedule;
+post_flush(postbatch_t *batch) {
+	if (batch->count > 0) {
+		isc_task_sendmany(batch->tasks, batch->events, batch->count);
+		batch->count = 0;
+	}
+}
+
+/*
+ * Post the event for 'timer', which has been taken off its wheel, to
+ * 'batch', and schedule it again if needed.
+ *
+ * The caller must be holding the wheel lock.
+ */
+static void
+expire(isc__timer_t *timer, isc_time_t *now, postbatch_t *batch) {
+	isc_boolean_t post_event, need_schedule;
 	isc_timerevent_t *event;
 	isc_eventtype_t type = 0;
-	isc__timer_t *timer;
 	isc_result_t result;
 	isc_boolean_t idle;
 
-	/*!
-	 * The caller must be holding the manager lock.
-	 */
+	INSIST(timer->type != isc_timertype_inactive);
 
-	while (manager->nscheduled > 0 && !done) {
-		timer = isc_heap_element(manager->heap, 1);
-		INSIST(timer != NULL && timer->type != isc_timertype_inactive);
-		if (isc_time_compare(now, &timer->due) >= 0) {
-			if (timer->type == isc_timertype_ticker) {
-				type = ISC_TIMEREVENT_TICK;
-				post_event = ISC_TRUE;
-				need_schedule = ISC_TRUE;
-			} else if (timer->type == isc_timertype_limited) {
-				int cmp;
-				cmp = isc_time_compare(now, &timer->expires);
-				if (cmp >= 0) {
-					type = ISC_TIMEREVENT_LIFE;
-					post_event = ISC_TRUE;
-					need_schedule = ISC_FALSE;
-				} else {
-					type = ISC_TIMEREVENT_TICK;
-					post_event = ISC_TRUE;
-					need_schedule = ISC_TRUE;
-				}
-			} else if (!isc_time_isepoch(&timer->expires) &&
-				   isc_time_compare(now,
-						    &timer->expires) >= 0) {
-				type = ISC_TIMEREVENT_LIFE;
-				post_event = ISC_TRUE;
-				need_schedule = ISC_FALSE;
-			} else {
-				idle = ISC_FALSE;
-
-				LOCK(&timer->lock);
-				if (!isc_time_isepoch(&timer->idle) &&
-				    isc_time_compare(now,
-						     &timer->idle) >= 0) {
-					idle = ISC_TRUE;
-				}
-				UNLOCK(&timer->lock);
-				if (idle) {
-					type = ISC_TIMEREVENT_IDLE;
-					post_event = ISC_TRUE;
-					need_schedule = ISC_FALSE;
-				} else {
-					/*
-					 * Idle timer has been touched;
-					 * reschedule.
-					 */
-					XTRACEID(isc_msgcat_get(isc_msgcat,
-								ISC_MSGSET_TIMER,
-								ISC_MSG_IDLERESCHED,
-								"idle reschedule"),
-						 timer);
-					post_event = ISC_FALSE;
-					need_schedule = ISC_TRUE;
-				}
-			}
+	if (isc_time_compare(now, &timer->due) < 0) {
+		/*
+		 * Not due yet after all (the clock may have been stepped
+		 * back); put it back where it belongs.
+		 */
+		(void)place(timer->wheel, timer);
+		return;
+	}
 
-			if (post_event) {
-				XTRACEID(isc_msgcat_get(isc_msgcat,
-							ISC_MSGSET_TIMER,
-							ISC_MSG_POSTING,
-							"posting"), timer);
-				/*
-				 * XXX We could preallocate this event.
-				 */
-				event = (isc_timerevent_t *)isc_event_allocate(manager->mctx,
-							   timer,
-							   type,
-							   timer->action,
-							   timer->arg,
-							   sizeof(*event));
-
-				if (event != NULL) {
-					event->due = timer->due;
-					isc_task_send(timer->task,
-						      ISC_EVENT_PTR(&event));
-				} else
-					UNEXPECTED_ERROR(__FILE__, __LINE__, "%s",
-						 isc_msgcat_get(isc_msgcat,
-							 ISC_MSGSET_TIMER,
-							 ISC_MSG_EVENTNOTALLOC,
-							 "couldn't "
-							 "allocate event"));
-			}
+	if (timer->type == isc_timertype_ticker) {
+		type = ISC_TIMEREVENT_TICK;
+		post_event = ISC_TRUE;
+		need_schedule = ISC_TRUE;
+	} else if (timer->type == isc_timertype_limited) {
+		int cmp;
+		cmp = isc_time_compare(now, &timer->expires);
+		if (cmp >= 0) {
+			type = ISC_TIMEREVENT_LIFE;
+			post_event = ISC_TRUE;
+			need_schedule = ISC_FALSE;
+		} else {
+			type = ISC_TIMEREVENT_TICK;
+			post_event = ISC_TRUE;
+			need_schedule = ISC_TRUE;
+		}
+	} else if (!isc_time_isepoch(&timer->expires) &&
+		   isc_time_compare(now, &timer->expires) >= 0) {
+		type = ISC_TIMEREVENT_LIFE;
+		post_event = ISC_TRUE;
+		need_schedule = ISC_FALSE;
+	} else {
+		idle = ISC_FALSE;
 
-			timer->index = 0;
-			isc_heap_delete(manager->heap, 1);
-			manager->nscheduled--;
-
-			if (need_schedule) {
-				result = schedule(timer, now, ISC_FALSE);
-				if (result != ISC_R_SUCCESS)
-					UNEXPECTED_ERROR(__FILE__, __LINE__,
-							 "%s: %u",
-						isc_msgcat_get(isc_msgcat,
-							ISC_MSGSET_TIMER,
-							ISC_MSG_SCHEDFAIL,
-							"couldn't schedule "
-							"timer"),
-							 result);
-			}
+		LOCK(&timer->lock);
+		if (!isc_time_isepoch(&timer->idle) &&
+		    isc_time_compare(now, &timer->idle) >= 0) {
+			idle = ISC_TRUE;
+		}
+		UNLOCK(&timer->lock);
+		if (idle) {
+			type = ISC_TIMEREVENT_IDLE;
+			post_event = ISC_TRUE;
+			need_schedule = ISC_FALSE;
 		} else {
-			manager->due = timer->due;
-			done = ISC_TRUE;
+			/*
+			 * Idle timer has been touched; reschedule.
+			 */
+			XTRACEID(isc_msgcat_get(isc_msgcat,
+						ISC_MSGSET_TIMER,
+						ISC_MSG_IDLERESCHED,
+						"idle reschedule"),
+				 timer);
+			post_event = ISC_FALSE;
+			need_schedule = ISC_TRUE;
 		}
 	}
+
+	if (post_event) {
+		XTRACEID(isc_msgcat_get(isc_msgcat, ISC_MSGSET_TIMER,
+					ISC_MSG_POSTING, "posting"), timer);
+		/*
+		 * XXX We could preallocate this event.
+		 */
+		event = (isc_timerevent_t *)
+			isc_event_allocate(timer->manager->mctx, timer, type,
+					   timer->action, timer->arg,
+					   sizeof(*event));
+
+		if (event != NULL) {
+			event->due = timer->due;
+			if (batch->count == POST_BATCH)
+				post_flush(batch);
+			batch->tasks[batch->count] = timer->task;
+			batch->events[batch->count] = (isc_event_t *)event;
+			batch->count++;
+		} else
+			UNEXPECTED_ERROR(__FILE__, __LINE__, "%s",
+					 isc_msgcat_get(isc_msgcat,
+						 ISC_MSGSET_TIMER,
+						 ISC_MSG_EVENTNOTALLOC,
+						 "couldn't "
+						 "allocate event"));
+	}
+
+	if (need_schedule) {
+		result = schedule(timer, now, ISC_FALSE);
+		if (result != ISC_R_SUCCESS)
+			UNEXPECTED_ERROR(__FILE__, __LINE__, "%s: %u",
+					 isc_msgcat_get(isc_msgcat,
+						 ISC_MSGSET_TIMER,
+						 ISC_MSG_SCHEDFAIL,
+						 "couldn't schedule "
+						 "timer"),
+					 result);
+	}
+}
+
+/*
+ * Advance 'wheel' through every tick up to and including 'target',
+ * cascading and expiring timers on the way.
+ *
+ * The caller must be holding the wheel lock.
+ */
+static void
+advance(isc__timerwheel_t *wheel, isc_time_t *now, isc_uint64_t target) {
+	LIST(isc__timer_t) expired;
+	isc__timer_t *timer;
+	isc_uint64_t tick;
+	unsigned int level, slot;
+	postbatch_t batch;
+
+	batch.count = 0;
+
+	while (wheel->now <= target) {
+		if (wheel->count == 0) {
+			wheel->now = target + 1;
+			break;
+		}
+
+		if (wheel->levelcount[0] == 0) {
+			/*
+			 * Nothing can expire before the lowest level
+			 * in use cascades next; skip ahead to it.
+			 */
+			for (level = 1; wheel->levelcount[level] == 0; level++)
+				;
+			tick = (wheel->now |
+				(((isc_uint64_t)1 << WHEEL_SHIFT(level)) - 1))
+			       + 1;
+			if (tick > target + 1) {
+				wheel->now = target + 1;
+				break;
+			}
+			wheel->now = tick;
+			cascade(wheel);
+			continue;
+		}
+
+		INIT_LIST(expired);
+		slot = (unsigned int)(wheel->now & (WHEEL_SLOTS0 - 1));
+		while ((timer = HEAD(wheel->slots[slot])) != NULL) {
+			unplace(wheel, timer);
+			APPEND(expired, timer, slotlink);
+		}
+
+		wheel->now++;
+		if ((wheel->now & (WHEEL_SLOTS0 - 1)) == 0)
+			cascade(wheel);
+
+		while ((timer = HEAD(expired)) != NULL) {
+			UNLINK(expired, timer, slotlink);
+			expire(timer, now, &batch);
+		}
+	}
+
+	post_flush(&batch);
+	settle(wheel);
+}
+
+/*
+ * Advance each wheel that has something due by 'now', and return the
+ * tick at which the next one must be advanced.
+ */
+static isc_uint64_t
+dispatch(isc__timermgr_t *manager, isc_time_t *now) {
+	isc__timerwheel_t *wheel;
+	isc_uint64_t target, next = WHEEL_NEVER;
+	unsigned int i;
+
+	target = tick_floor(now);
+	for (i = 0; i < manager->nwheels; i++) {
+		wheel = &manager->wheels[i];
+		LOCK(&wheel->lock);
+		if (wheel->next <= target)
+			advance(wheel, now, target);
+		if (wheel->next < next)
+			next = wheel->next;
+		UNLOCK(&wheel->lock);
+	}
+
+	return (next);
 }
 
 #ifdef USE_TIMER_THREAD
@@ -780,26 +1030,44 @@ WINAPI
 #endif
 run(void *uap) {
 	isc__timermgr_t *manager = uap;
-	isc_time_t now;
+	isc_time_t now, due;
+	isc_uint64_t next;
 	isc_result_t result;
 
 	LOCK(&manager->lock);
 	while (!manager->done) {
+		/*
+		 * The wheels are advanced without the manager lock held;
+		 * a timer scheduled meanwhile on a wheel already looked at
+		 * sets 'rescan' rather than signalling.
+		 */
+		manager->scanning = ISC_TRUE;
+		manager->rescan = ISC_FALSE;
+		UNLOCK(&manager->lock);
+
 		TIME_NOW(&now);
 
 		XTRACETIME(isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
 					  ISC_MSG_RUNNING,
 					  "running"), now);
 
-		dispatch(manager, &now);
+		next = dispatch(manager, &now);
+
+		LOCK(&manager->lock);
+		manager->scanning = ISC_FALSE;
+		if (manager->rescan || manager->done)
+			continue;
 
-		if (manager->nscheduled > 0) {
+		manager->wake = next;
+		if (next != WHEEL_NEVER) {
+			tick_totime(next, &due);
 			XTRACETIME2(isc_msgcat_get(isc_msgcat,
 						   ISC_MSGSET_GENERAL,
 						   ISC_MSG_WAITUNTIL,
 						   "waituntil"),
-				    manager->due, now);
-			result = WAITUNTIL(&manager->wakeup, &manager->lock, &manager->due);
+				    due, now);
+			result = WAITUNTIL(&manager->wakeup, &manager->lock,
+					   &due);
 			INSIST(result == ISC_R_SUCCESS ||
 			       result == ISC_R_TIMEDOUT);
 		} else {
@@ -807,6 +1075,7 @@ run(void *uap) {
 						  ISC_MSG_WAIT, "wait"), now);
 			WAIT(&manager->wakeup, &manager->lock);
 		}
+		manager->wake = WHEEL_NEVER;
 		XTRACE(isc_msgcat_get(isc_msgcat, ISC_MSGSET_TIMER,
 				      ISC_MSG_WAKEUP, "wakeup"));
 	}
@@ -820,34 +1089,13 @@ run(void *uap) {
 }
 #endif /* USE_TIMER_THREAD */
 
-static isc_boolean_t
-sooner(void *v1, void *v2) {
-	isc__timer_t *t1, *t2;
-
-	t1 = v1;
-	t2 = v2;
-	REQUIRE(VALID_TIMER(t1));
-	REQUIRE(VALID_TIMER(t2));
-
-	if (isc_time_compare(&t1->due, &t2->due) < 0)
-		return (ISC_TRUE);
-	return (ISC_FALSE);
-}
-
-static void
-set_index(void *what, unsigned int index) {
-	isc__timer_t *timer;
-
-	timer = what;
-	REQUIRE(VALID_TIMER(timer));
-
-	timer->index = index;
-}
-
 isc_result_t
 isc__timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp) {
 	isc__timermgr_t *manager;
+	isc__timerwheel_t *wheel;
 	isc_result_t result;
+	isc_time_t now;
+	unsigned int i, j;
 
 	/*
 	 * Create a timer manager.
@@ -872,47 +1120,70 @@ isc__timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp) {
 	manager->common.methods = (isc_timermgrmethods_t *)&timermgrmethods;
 	manager->mctx = NULL;
 	manager->done = ISC_FALSE;
-	INIT_LIST(manager->timers);
-	manager->nscheduled = 0;
-	isc_time_settoepoch(&manager->due);
-	manager->heap = NULL;
-	result = isc_heap_create(mctx, sooner, set_index, 0, &manager->heap);
-	if (result != ISC_R_SUCCESS) {
-		INSIST(result == ISC_R_NOMEMORY);
+	manager->scanning = ISC_FALSE;
+	manager->rescan = ISC_FALSE;
+	manager->wake = WHEEL_NEVER;
+#ifdef USE_TIMER_THREAD
+	manager->nwheels = ISC_MIN(isc_os_ncpus(), WHEEL_MAX);
+	if (manager->nwheels == 0)
+		manager->nwheels = 1;
+#else
+	manager->nwheels = 1;
+#endif
+	manager->wheels = isc_mem_get(mctx, manager->nwheels *
+				      sizeof(manager->wheels[0]));
+	if (manager->wheels == NULL) {
 		isc_mem_put(mctx, manager, sizeof(*manager));
 		return (ISC_R_NOMEMORY);
 	}
-	result = isc_mutex_init(&manager->lock);
-	if (result != ISC_R_SUCCESS) {
-		isc_heap_destroy(&manager->heap);
-		isc_mem_put(mctx, manager, sizeof(*manager));
-		return (result);
+	TIME_NOW(&now);
+	for (i = 0; i < manager->nwheels; i++) {
+		wheel = &manager->wheels[i];
+		result = isc_mutex_init(&wheel->lock);
+		if (result != ISC_R_SUCCESS) {
+			while (i-- > 0)
+				DESTROYLOCK(&manager->wheels[i].lock);
+			isc_mem_put(mctx, manager->wheels, manager->nwheels *
+				    sizeof(manager->wheels[0]));
+			isc_mem_put(mctx, manager, sizeof(*manager));
+			return (result);
+		}
+		wheel->manager = manager;
+		INIT_LIST(wheel->timers);
+		wheel->now = tick_floor(&now);
+		wheel->next = WHEEL_NEVER;
+		wheel->count = 0;
+		for (j = 0; j < WHEEL_LEVELS; j++)
+			wheel->levelcount[j] = 0;
+		for (j = 0; j < WHEEL_NSLOTS; j++)
+			INIT_LIST(wheel->slots[j]);
 	}
+	result = isc_mutex_init(&manager->lock);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_wheels;
 	isc_mem_attach(mctx, &manager->mctx);
 #ifdef USE_TIMER_THREAD
 	if (isc_condition_init(&manager->wakeup) != ISC_R_SUCCESS) {
 		isc_mem_detach(&manager->mctx);
 		DESTROYLOCK(&manager->lock);
-		isc_heap_destroy(&manager->heap);
-		isc_mem_put(mctx, manager, sizeof(*manager));
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
 				 "isc_condition_init() %s",
 				 isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
 						ISC_MSG_FAILED, "failed"));
-		return (ISC_R_UNEXPECTED);
+		result = ISC_R_UNEXPECTED;
+		goto cleanup_wheels;
 	}
 	if (isc_thread_create(run, manager, &manager->thread) !=
 	    ISC_R_SUCCESS) {
 		isc_mem_detach(&manager->mctx);
 		(void)isc_condition_destroy(&manager->wakeup);
 		DESTROYLOCK(&manager->lock);
-		isc_heap_destroy(&manager->heap);
-		isc_mem_put(mctx, manager, sizeof(*manager));
 		UNEXPECTED_ERROR(__FILE__, __LINE__,
 				 "isc_thread_create() %s",
 				 isc_msgcat_get(isc_msgcat, ISC_MSGSET_GENERAL,
 						ISC_MSG_FAILED, "failed"));
-		return (ISC_R_UNEXPECTED);
+		result = ISC_R_UNEXPECTED;
+		goto cleanup_wheels;
 	}
 #endif
 #ifdef USE_SHARED_MANAGER
@@ -923,6 +1194,14 @@ isc__timermgr_create(isc_mem_t *mctx, isc_timermgr_t **managerp) {
 	*managerp = (isc_timermgr_t *)manager;
 
 	return (ISC_R_SUCCESS);
+
+ cleanup_wheels:
+	for (i = 0; i < manager->nwheels; i++)
+		DESTROYLOCK(&manager->wheels[i].lock);
+	isc_mem_put(mctx, manager->wheels,
+		    manager->nwheels * sizeof(manager->wheels[0]));
+	isc_mem_put(mctx, manager, sizeof(*manager));
+	return (result);
 }
 
 void
@@ -942,6 +1221,7 @@ void
 isc__timermgr_destroy(isc_timermgr_t **managerp) {
 	isc__timermgr_t *manager;
 	isc_mem_t *mctx;
+	unsigned int i;
 
 	/*
 	 * Destroy a timer manager.
@@ -967,7 +1247,8 @@ isc__timermgr_destroy(isc_timermgr_t **managerp) {
 	isc__timermgr_dispatch((isc_timermgr_t *)manager);
 #endif
 
-	REQUIRE(EMPTY(manager->timers));
+	for (i = 0; i < manager->nwheels; i++)
+		REQUIRE(EMPTY(manager->wheels[i].timers));
 	manager->done = ISC_TRUE;
 
 #ifdef USE_TIMER_THREAD
@@ -996,10 +1277,13 @@ isc__timermgr_destroy(isc_timermgr_t **managerp) {
 	(void)isc_condition_destroy(&manager->wakeup);
 #endif /* USE_TIMER_THREAD */
 	DESTROYLOCK(&manager->lock);
-	isc_heap_destroy(&manager->heap);
+	for (i = 0; i < manager->nwheels; i++)
+		DESTROYLOCK(&manager->wheels[i].lock);
 	manager->common.impmagic = 0;
 	manager->common.magic = 0;
 	mctx = manager->mctx;
+	isc_mem_put(mctx, manager->wheels,
+		    manager->nwheels * sizeof(manager->wheels[0]));
 	isc_mem_put(mctx, manager, sizeof(*manager));
 	isc_mem_detach(&mctx);
 
@@ -1014,14 +1298,21 @@ isc__timermgr_destroy(isc_timermgr_t **managerp) {
 isc_result_t
 isc__timermgr_nextevent(isc_timermgr_t *manager0, isc_time_t *when) {
 	isc__timermgr_t *manager = (isc__timermgr_t *)manager0;
+	isc_uint64_t next = WHEEL_NEVER;
+	unsigned int i;
 
 #ifdef USE_SHARED_MANAGER
 	if (manager == NULL)
 		manager = timermgr;
 #endif
-	if (manager == NULL || manager->nscheduled == 0)
+	if (manager == NULL)
+		return (ISC_R_NOTFOUND);
+	for (i = 0; i < manager->nwheels; i++)
+		if (manager->wheels[i].next < next)
+			next = manager->wheels[i].next;
+	if (next == WHEEL_NEVER)
 		return (ISC_R_NOTFOUND);
-	*when = manager->due;
+	tick_totime(next, when);
 	return (ISC_R_SUCCESS);
 }
 
@@ -1037,7 +1328,7 @@ isc__timermgr_dispatch(isc_timermgr_t *manager0) {
 	if (manager == NULL)
 		return;
 	TIME_NOW(&now);
-	dispatch(manager, &now);
+	(void)dispatch(manager, &now);
 }
 #endif /* USE_TIMER_THREAD */
 